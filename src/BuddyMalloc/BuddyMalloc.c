@@ -2237,6 +2237,31 @@ void BuddyGetStats(buddy_stats_t * budd_stats)
 
 }
 
+/**
+ *  Get the memory space allocated by all the threads.
+ */
+size_t BuddyGetTotalMemSpace(void)
+{
+  size_t total = 0;
+#ifndef _MONOTHREAD_MEMALLOC
+  BuddyThreadContext_t *context;
+
+  P(ContextListMutex);
+
+  for(context = first_context; context != NULL; context = context->next)
+    total += context->Stats.TotalMemSpace;
+
+  V(ContextListMutex);
+#else
+  BuddyThreadContext_t *context = GetThreadContext();
+
+  if(context != NULL)
+    total = context->Stats.TotalMemSpace;
+#endif
+
+  return total;
+}
+
 
 #ifdef _DEBUG_MEMLEAKS
 
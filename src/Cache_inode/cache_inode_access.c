@@ -84,7 +84,6 @@ cache_inode_access_sw(cache_entry_t * pentry,
 {
     fsal_attrib_list_t attr;
     fsal_status_t fsal_status;
-    cache_inode_status_t cache_status;
     fsal_accessflags_t used_access_type;
     fsal_handle_t *pfsal_handle = NULL;
 
@@ -113,7 +112,7 @@ cache_inode_access_sw(cache_entry_t * pentry,
             used_access_type = access_type & ~FSAL_F_OK;
 
             /* We get the attributes */
-            attr = pentry->attributes;
+            cache_inode_get_attributes(pentry, &attr);
             /*
              * Function FSAL_test_access is used instead of FSAL_access.
              * This allow to take benefit of the previously cached
@@ -124,7 +123,7 @@ cache_inode_access_sw(cache_entry_t * pentry,
             if(pclient->use_test_access == 1)
                 {
                     /* We get the attributes */
-		    attr = pentry->attributes;
+		    cache_inode_get_attributes(pentry, &attr);
 
                     fsal_status = FSAL_test_access(pcontext, used_access_type, &attr);
                 }
@@ -188,14 +187,9 @@ cache_inode_access_sw(cache_entry_t * pentry,
 
             return *pstatus;
         }
-    /* stats and validation */
-    cache_status = cache_inode_valid(pentry,
-                                     CACHE_INODE_OP_GET,
-                                     pclient);
-    if(cache_status != CACHE_INODE_SUCCESS)
-        inc_func_err_retryable(pclient, CACHE_INODE_ACCESS);
-    else
-        inc_func_success(pclient, CACHE_INODE_ACCESS);
+    /* stats and validation, the entry may only be locked for reading */
+    cache_inode_touch(pentry, pclient);
+    inc_func_success(pclient, CACHE_INODE_ACCESS);
 
     if(use_mutex)
         V_r(&pentry->lock);
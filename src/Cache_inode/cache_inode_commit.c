@@ -95,10 +95,7 @@ cache_inode_commit(cache_entry_t * pentry,
                    cache_inode_status_t * pstatus)
 {
     cache_inode_status_t status;
-    fsal_seek_t seek_descriptor;
-    fsal_size_t size_io_done;
-    fsal_boolean_t eof;
-    cache_inode_unstable_data_t *udata;
+    cache_inode_opened_file_t *pfd;
     fsal_status_t fsal_status;
 
     /* Do not use this function is Data Cache is used */
@@ -116,9 +113,9 @@ cache_inode_commit(cache_entry_t * pentry,
       P_w(&pentry->lock);
 
       /* Can't sync a file descriptor if it's currently closed. */
-      if(cache_inode_open(pentry,
-                          pclient,
-                          FSAL_O_WRONLY, pcontext, pstatus) != CACHE_INODE_SUCCESS)
+      if((pfd = cache_inode_fd_get(pentry,
+                                   pclient,
+                                   FSAL_O_WRONLY, pcontext, pstatus)) == NULL)
         {
 
           V_w(&pentry->lock);
@@ -130,10 +127,12 @@ cache_inode_commit(cache_entry_t * pentry,
         }
 
 #ifdef _USE_MFSL      
-      fsal_status = MFSL_commit(&(pentry->object.file.open_fd.mfsl_fd), offset, count, NULL); 
+      fsal_status = MFSL_commit(&(pfd->mfsl_fd), offset, count, NULL); 
 #else
-      fsal_status = FSAL_commit(&(pentry->object.file.open_fd.fd), offset, count );
+      fsal_status = FSAL_commit(&(pfd->fd), offset, count );
 #endif
+      cache_inode_fd_put(pfd, pclient);
+
       if(FSAL_IS_ERROR(fsal_status))
       {
         LogMajor(COMPONENT_CACHE_INODE,
@@ -174,59 +173,80 @@ cache_inode_commit(cache_entry_t * pentry,
       return *pstatus;
     }
 
-    /* Ok, it looks like we're using the Ganesha write buffer. This means we
-     * will either be writing to the buffer, or writing a stable write to the
-     * file system if the buffer is already full. */
+    /* Ok, it looks like we're using the Ganesha write buffer. The dirty
+     * extents of the range not written behind yet are written now, and
+     * those the write-behind threads are writing are waited for. */
 
-    udata = &pentry->object.file.unstable_data;
-    if(udata->buffer == NULL)
-        {
-            *pstatus = CACHE_INODE_SUCCESS;
-            return *pstatus;
-        }
-    if(count == 0 || count == 0xFFFFFFFFL)
-        {
-            /* Count = 0 means "flush all data to permanent storage */
-            seek_descriptor.offset = udata->offset;
-            seek_descriptor.whence = FSAL_SEEK_SET;
+    P_r(&pentry->lock);
 
-            status = cache_inode_rdwr(pentry,
-                                      CACHE_INODE_WRITE,
-                                      &seek_descriptor, udata->length,
-                                      &size_io_done, pfsal_attr,
-                                      udata->buffer, &eof, ht,
-                                      pclient, pcontext, TRUE, pstatus);
-            if (status != CACHE_INODE_SUCCESS)
-                return *pstatus;
+    /* Count = 0 means "flush all data to permanent storage */
+    if(count == 0xFFFFFFFFL)
+      count = 0;
 
-            P_w(&pentry->lock);
+    if(cache_inode_dirty_commit(pentry, offset, count,
+                                pclient, pstatus) != CACHE_INODE_SUCCESS)
+      {
+        V_r(&pentry->lock);
 
-            Mem_Free(udata->buffer);
-            udata->buffer = NULL;
+        /* stats */
+        pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_COMMIT] += 1;
+
+        return *pstatus;
+      }
+
+    /* The extents are written, they are now committed in the FSAL */
+    if((pfd = cache_inode_fd_get(pentry,
+                                 pclient,
+                                 FSAL_O_WRONLY, pcontext, pstatus)) == NULL)
+      {
+        V_r(&pentry->lock);
+
+        /* stats */
+        pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_COMMIT] += 1;
+
+        return *pstatus;
+      }
+
+#ifdef _USE_MFSL
+    fsal_status = MFSL_commit(&(pfd->mfsl_fd), offset, count, NULL);
+#else
+    fsal_status = FSAL_commit(&(pfd->fd), offset, count);
+#endif
+
+    if(FSAL_IS_ERROR(fsal_status))
+      {
+        LogMajor(COMPONENT_CACHE_INODE,
+                 "cache_inode_commit: fsal_commit() failed: fsal_status.major = %d",
+                 fsal_status.major);
+
+        /* The next I/O opens the file again */
+        cache_inode_fd_discard(pfd, pclient);
+
+        V_r(&pentry->lock);
+
+        /* stats */
+        pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_COMMIT] += 1;
+
+        *pstatus = CACHE_INODE_FSAL_ERROR;
+        return *pstatus;
+      }
+
+    cache_inode_fd_put(pfd, pclient);
+
+    P(pentry->object.file.io_mutex);
+    cache_inode_close(pentry, pclient, &status);
+    V(pentry->object.file.io_mutex);
+
+    /* Return attributes to caller */
+    if(pfsal_attr != NULL && pentry->internal_md.type == REGULAR_FILE)
+      {
+        P(pentry->object.file.io_mutex);
+        *pfsal_attr = pentry->attributes;
+        V(pentry->object.file.io_mutex);
+      }
+
+    V_r(&pentry->lock);
 
-            V_w(&pentry->lock);
-        }
-    else
-        {
-            if(offset < udata->offset)
-                {
-                    *pstatus = CACHE_INODE_INVALID_ARGUMENT;
-                    return *pstatus;
-                }
-
-            seek_descriptor.offset = offset;
-            seek_descriptor.whence = FSAL_SEEK_SET;
-
-            return cache_inode_rdwr(pentry,
-                                    CACHE_INODE_WRITE,
-                                    &seek_descriptor,
-                                    count,
-                                    &size_io_done,
-                                    pfsal_attr,
-                                    (char *)(udata->buffer + offset - udata->offset),
-                                    &eof, ht, pclient,
-                                    pcontext, TRUE, pstatus);
-    }
   /* Regulat exit */
   *pstatus = CACHE_INODE_SUCCESS;
   return *pstatus;
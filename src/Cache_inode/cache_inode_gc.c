@@ -55,11 +55,86 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/param.h>
+#include <sys/time.h>
 #include <time.h>
 #include <pthread.h>
 
 static cache_inode_gc_policy_t cache_inode_gc_policy;   /*<< the policy to be used by the garbage collector */
 
+/* Number of entries examined between two checks of the time given to a reclaim step */
+#define CACHE_INODE_CLOCK_TIME_CHECK 64
+
+/* All the entries of the cache, whatever the client that created them, in a
+ * ring swept by the hand of the reclaimer (CLOCK algorithm). The entries
+ * used since the hand last passed are given a second chance. */
+static struct cache_inode_clock__
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;                /**< signaled when the high water mark is crossed    */
+  cache_entry_t *hand;                /**< next entry to be examined                       */
+  unsigned int nb_entries;            /**< number of entries in the ring                   */
+  unsigned int nb_unreclaimable;      /**< entries examined since the last one reclaimed   */
+  unsigned int reclaiming;            /**< TRUE from a high water mark to the low one      */
+} cache_inode_clock =
+{
+PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, FALSE};
+
+#if !defined(_USE_SLAB_ALLOC) && !defined(_NO_BLOCK_PREALLOC)
+/* With block preallocation, an entry released goes to the free list of the
+ * pool it is released to, which only the owner of the pool allocates from.
+ * The reclaimers hand what they release over to the workers through these
+ * lists instead of keeping it in their own pools. */
+typedef struct cache_inode_gc_free_list__
+{
+  prealloc_header *head;
+  prealloc_header *tail;
+} cache_inode_gc_free_list_t;
+
+static struct cache_inode_gc_free__
+{
+  pthread_mutex_t mutex;
+  cache_inode_gc_free_list_t entry;
+  cache_inode_gc_free_list_t entry_symlink;
+  cache_inode_gc_free_list_t dir_entry;
+  cache_inode_gc_free_list_t parent;
+  cache_inode_gc_free_list_t key;
+} cache_inode_gc_free =
+{
+PTHREAD_MUTEX_INITIALIZER};
+
+static void cache_inode_gc_give_list(struct prealloc_pool *pool,
+                                     cache_inode_gc_free_list_t * plist)
+{
+  prealloc_header *first;
+  prealloc_header *tail;
+
+  /* The first one is kept: the reclaimer builds a hash key for each entry */
+  if(pool->pa_free == NULL || pool->pa_free->pa_next == NULL)
+    return;
+
+  first = pool->pa_free->pa_next;
+  for(tail = first; tail->pa_next != NULL; tail = tail->pa_next) ;
+
+  tail->pa_next = plist->head;
+  if(plist->head == NULL)
+    plist->tail = tail;
+  plist->head = first;
+  pool->pa_free->pa_next = NULL;
+}                               /* cache_inode_gc_give_list */
+
+static void cache_inode_gc_take_list(struct prealloc_pool *pool,
+                                     cache_inode_gc_free_list_t * plist)
+{
+  if(plist->head == NULL)
+    return;
+
+  plist->tail->pa_next = pool->pa_free;
+  pool->pa_free = plist->head;
+  plist->head = NULL;
+  plist->tail = NULL;
+}                               /* cache_inode_gc_take_list */
+#endif
+
 #ifdef _USE_NFS4_ACL
 static void cache_inode_gc_acl(cache_entry_t * pentry);
 #endif                          /* _USE_NFS4_ACL */
@@ -154,6 +229,9 @@ static int cache_inode_gc_clean_entry(cache_entry_t * pentry,
       return LRU_LIST_SET_INVALID;
     }
 
+  /* Not to be found by the reclaimer any more */
+  cache_inode_clock_remove(pentry);
+
   /* Clean up the associated ressources in the FSAL */
   if(FSAL_IS_ERROR(fsal_status = FSAL_CleanObjectResources(pfsal_handle)))
     {
@@ -205,6 +283,10 @@ static int cache_inode_gc_clean_entry(cache_entry_t * pentry,
   if (pentry->internal_md.type == SYMBOLIC_LINK)
     cache_inode_release_symlink(pentry, &pgcparam->pclient->pool_entry_symlink);
 
+  /* Close the fds kept open on a file */
+  cache_inode_forget_fds(pentry, pgcparam->pclient);
+  cache_inode_forget_dirty(pentry);
+
   /* Free and Destroy the mutex associated with the pentry */
   V_w(&pentry->lock);
 
@@ -281,6 +363,40 @@ static int cache_inode_gc_invalidate_related_dirents(
   return LRU_LIST_SET_INVALID;
 }                               /* cache_inode_gc_invalidate_related_dirent */
 
+/**
+ *
+ * cache_inode_gc_evict: removes a write locked entry from the cache inode.
+ *
+ * @param pentry   [INOUT] entry to be removed, write locked.
+ * @param pgcparam [IN]    additional parameter used for cleaning.
+ *
+ * @return LRU_LIST_SET_INVALID if the entry was removed (its lock is gone with it),
+ * @return LRU_LIST_DO_NOT_SET_INVALID if it was kept, still locked.
+ *
+ */
+static int cache_inode_gc_evict(cache_entry_t * pentry,
+                                cache_inode_param_gc_t * pgcparam)
+{
+  /* Set the entry as invalid */
+  pentry->internal_md.valid_state = INVALID;
+
+  LogDebug(COMPONENT_CACHE_INODE_GC,
+               "****> cache_inode_gc_evict on %p type=%d",
+               pentry, pentry->internal_md.type);
+
+  /* Remove refences in the parent entries */
+  if(cache_inode_gc_invalidate_related_dirents(pentry, pgcparam)
+     != LRU_LIST_SET_INVALID)
+    return LRU_LIST_DO_NOT_SET_INVALID;
+
+  /* The entry leaves the LRU of the client that used it last */
+  if(pentry->gc_lru_entry != NULL)
+    LRU_invalidate(pentry->gc_lru, pentry->gc_lru_entry);
+
+  /* Clean the entry, the mutex is freed at destruction time */
+  return cache_inode_gc_clean_entry(pentry, pgcparam);
+}                               /* cache_inode_gc_evict */
+
 /**
  *
  * cache_inode_gc_suppress_file: suppress a file entry from the cache inode.
@@ -291,9 +407,6 @@ static int cache_inode_gc_invalidate_related_dirents(
  *
  * @return LRU_LIST_SET_INVALID if entry is successfully suppressed, LRU_LIST_DO_NOT_SET_INVALID otherwise
  *
- * @see LRU_invalidate_by_function
- * @see LRU_gc_invalid
- *
  */
 int cache_inode_gc_suppress_file(cache_entry_t * pentry,
                                  cache_inode_param_gc_t * pgcparam)
@@ -304,21 +417,11 @@ int cache_inode_gc_suppress_file(cache_entry_t * pentry,
                "Entry %p (REGULAR_FILE/SYMBOLIC_LINK) will be garbaged",
                pentry);
 
-  /* Set the entry as invalid */
-  pentry->internal_md.valid_state = INVALID;
-
-  LogDebug(COMPONENT_CACHE_INODE_GC,
-               "****> cache_inode_gc_suppress_file on %p",
-               pentry);
-
-  /* Remove refences in the parent entries */
-  cache_inode_gc_invalidate_related_dirents(pentry, pgcparam);
-
-  /* Clean the entry */
-  if(cache_inode_gc_clean_entry(pentry, pgcparam) != LRU_LIST_SET_INVALID)
-    return LRU_LIST_DO_NOT_SET_INVALID;
-
-  /* Mutex has already been freed at destruction time */
+  if(cache_inode_gc_evict(pentry, pgcparam) != LRU_LIST_SET_INVALID)
+    {
+      V_w(&pentry->lock);
+      return LRU_LIST_DO_NOT_SET_INVALID;
+    }
 
   return LRU_LIST_SET_INVALID;
 }                               /* cache_inode_gc_suppress_file */
@@ -333,15 +436,11 @@ int cache_inode_gc_suppress_file(cache_entry_t * pentry,
  *
  * @return 1 if entry is successfully suppressed, 0 otherwise
  *
- * @see LRU_invalidate_by_function
- * @see LRU_gc_invalid
- *
  */
 int cache_inode_gc_suppress_directory(cache_entry_t * pentry,
                                       cache_inode_param_gc_t * pgcparam)
 {
   P_w(&pentry->lock);
-  pentry->internal_md.valid_state = INVALID;
 
   if(cache_inode_is_dir_empty(pentry) != CACHE_INODE_SUCCESS)
     {
@@ -360,55 +459,32 @@ int cache_inode_gc_suppress_directory(cache_entry_t * pentry,
                "Entry %p (DIRECTORY) will be garbaged",
                pentry);
 
-  LogDebug(COMPONENT_CACHE_INODE_GC,
-               "****> cache_inode_gc_suppress_directory on %p",
-               pentry);
-
-  /* Remove refences in the parent entries */
-  if(cache_inode_gc_invalidate_related_dirents(pentry, pgcparam)
-     != LRU_LIST_SET_INVALID)
+  if(cache_inode_gc_evict(pentry, pgcparam) != LRU_LIST_SET_INVALID)
     {
       V_w(&pentry->lock);
       return LRU_LIST_DO_NOT_SET_INVALID;
     }
 
-  if(cache_inode_gc_clean_entry(pentry, pgcparam) != LRU_LIST_SET_INVALID)
-    {
-      V_w(&pentry->lock);
-      return LRU_LIST_DO_NOT_SET_INVALID;
-    }
-
-  /* Mutex has already been freed at destruction time */
-
   return LRU_LIST_SET_INVALID;
 }                               /* cache_inode_gc_suppress_directory */
 
 /**
  *
- * cache_inode_gc_function: Tests is an entry in cache inode is to be set invalid (has expired).
- *
- * Tests is an entry in cache inode is to be set invalid (has expired).
- * If entry is invalidated, does the cleaning stuff on it.
+ * cache_inode_gc_is_reclaimable: tells if a locked entry may leave the cache.
  *
- * @param pentry [IN] pointer to the entry to test
+ * An entry may leave the cache once it has not been used for longer than
+ * the lifetime of its type. Directories must be empty, files must hold no
+ * state.
  *
- * @return 1 if entry must be set invalid, 0 if not.
+ * @param pentry       [IN] entry to be tested, locked.
+ * @param current_time [IN] the time now.
  *
- * @see LRU_invalidate_by_function
- * @see LRU_gc_invalid
+ * @return TRUE if the entry may be reclaimed, FALSE otherwise.
  *
  */
-int cache_inode_gc_function(LRU_entry_t * plru_entry, void *addparam)
+static int cache_inode_gc_is_reclaimable(cache_entry_t * pentry, time_t current_time)
 {
-  time_t entry_time = 0;
-  time_t current_time = time(NULL);
-  cache_entry_t *pentry = NULL;
-  cache_inode_param_gc_t *pgcparam = (cache_inode_param_gc_t *) addparam;
-
-  time_t allocated;
-
-  /* Get the entry */
-  pentry = (cache_entry_t *) (plru_entry->buffdata.pdata);
+  time_t entry_time;
 
   /* Get the entry time (the larger value in read_time and mod_time ) */
   if(pentry->internal_md.read_time > pentry->internal_md.mod_time)
@@ -416,63 +492,59 @@ int cache_inode_gc_function(LRU_entry_t * plru_entry, void *addparam)
   else
     entry_time = pentry->internal_md.mod_time;
 
-  allocated = pentry->internal_md.alloc_time;
+  switch (pentry->internal_md.type)
+    {
+    case DIRECTORY:
+      if(cache_inode_gc_policy.directory_expiration_delay <= 0 ||
+         current_time - entry_time <= cache_inode_gc_policy.directory_expiration_delay)
+        return FALSE;
+
+      return cache_inode_is_dir_empty(pentry) == CACHE_INODE_SUCCESS;
+
+    case REGULAR_FILE:
+      /* Files with states, or unstable writes not written yet, are not to be gc-ed */
+      if(cache_inode_file_holds_state(pentry) ||
+         pentry->object.file.write_behind != NULL)
+        return FALSE;
+
+      /* fall through */
+    case SYMBOLIC_LINK:
+      return cache_inode_gc_policy.file_expiration_delay > 0 &&
+          current_time - entry_time > cache_inode_gc_policy.file_expiration_delay;
+
+    default:
+      return FALSE;
+    }
+}                               /* cache_inode_gc_is_reclaimable */
 
-  if(pgcparam->nb_to_be_purged != 0)
+/* Takes an entry out of the ring, clock mutex held */
+static void cache_inode_clock_unlink(cache_entry_t * pentry)
+{
+  if(pentry->clock_next == pentry)
+    cache_inode_clock.hand = NULL;
+  else
     {
-      LogMidDebug(COMPONENT_CACHE_INODE_GC,
-                   "We still need %d entries to be garbaged",
-                   pgcparam->nb_to_be_purged);
-
-      /* Check if the entry is not a file that holds state
-       *  Files with states are not to be gc-ed  */
-      if( ( pentry->internal_md.type == REGULAR_FILE ) && 
-           cache_inode_file_holds_state( pentry ) )
-         return LRU_LIST_DO_NOT_SET_INVALID ;
-
-      /* Should we get ride of this entry ? */
-      if((pentry->internal_md.type == DIRECTORY) &&
-         (cache_inode_gc_policy.directory_expiration_delay > 0))
-        {
-          if(current_time - entry_time > cache_inode_gc_policy.directory_expiration_delay)
-            {
-              /* Entry should be tagged invalid */
-              LogMidDebug(COMPONENT_CACHE_INODE_GC,
-                       "----->>>>>>>> DIR GC : Garbage collection on dir entry %p",
-                       pentry);
-              return cache_inode_gc_suppress_directory(pentry, pgcparam);
-            }
-          else
-            LogFullDebug(COMPONENT_CACHE_INODE_GC,
-                         "No garbage on dir entry %p used:%d allocated:%d %d",
-                         pentry, (int)(current_time - entry_time),
-                         (int)(current_time - allocated),
-                         cache_inode_gc_policy.directory_expiration_delay);
-        }
-      else if((pentry->internal_md.type == REGULAR_FILE
-               || pentry->internal_md.type == SYMBOLIC_LINK)
-              && (cache_inode_gc_policy.file_expiration_delay > 0))
-        {
-          if(current_time - entry_time > cache_inode_gc_policy.file_expiration_delay)
-            {
-              /* Entry should be suppress and tagged invalid */
-              LogMidDebug(COMPONENT_CACHE_INODE_GC,
-                       "----->>>>>> REGULAR/SYMLINK GC : Garbage collection on regular/symlink entry %p",
-                       pentry);
-              return cache_inode_gc_suppress_file(pentry, pgcparam);
-            }
-          else
-            LogFullDebug(COMPONENT_CACHE_INODE_GC,
-                         "No garbage on regular/symlink entry %p used:%d allocated:%d %d",
-                         pentry, (int)(current_time - entry_time),
-                         (int)(current_time - allocated),
-                         cache_inode_gc_policy.file_expiration_delay);
-        }
+      pentry->clock_prev->clock_next = pentry->clock_next;
+      pentry->clock_next->clock_prev = pentry->clock_prev;
+      if(cache_inode_clock.hand == pentry)
+        cache_inode_clock.hand = pentry->clock_next;
     }
 
-  /* Default return, entry is not to be set invalid */
-  return LRU_LIST_DO_NOT_SET_INVALID;
-}                               /* cache_inode_gc_function */
+  pentry->clock_next = NULL;
+  pentry->clock_prev = NULL;
+  cache_inode_clock.nb_entries -= 1;
+}                               /* cache_inode_clock_unlink */
+
+/* Tells if entries are to be reclaimed, clock mutex held */
+static int cache_inode_clock_pressure(void)
+{
+  if(cache_inode_clock.nb_entries > cache_inode_gc_policy.hwmark_nb_entries)
+    cache_inode_clock.reclaiming = TRUE;
+  else if(cache_inode_clock.nb_entries <= cache_inode_gc_policy.lwmark_nb_entries)
+    cache_inode_clock.reclaiming = FALSE;
+
+  return cache_inode_clock.reclaiming;
+}                               /* cache_inode_clock_pressure */
 
 /* @} */
 
@@ -510,11 +582,294 @@ cache_inode_gc_policy_t cache_inode_get_gc_policy(void)
   return cache_inode_gc_policy;
 }                               /* cache_inode_get_gc_policy */
 
+/**
+ *
+ * cache_inode_clock_insert: puts a new entry under the reclaimer's watch.
+ *
+ * The entry is placed just behind the hand, marked as used.
+ *
+ * @param pentry [INOUT] entry just added to the cache.
+ *
+ * @return nothing (void function)
+ *
+ */
+void cache_inode_clock_insert(cache_entry_t * pentry)
+{
+  P(cache_inode_clock.mutex);
+
+  pentry->clock_referenced = TRUE;
+
+  if(cache_inode_clock.hand == NULL)
+    {
+      pentry->clock_next = pentry;
+      pentry->clock_prev = pentry;
+      cache_inode_clock.hand = pentry;
+    }
+  else
+    {
+      pentry->clock_next = cache_inode_clock.hand;
+      pentry->clock_prev = cache_inode_clock.hand->clock_prev;
+      pentry->clock_prev->clock_next = pentry;
+      cache_inode_clock.hand->clock_prev = pentry;
+    }
+
+  cache_inode_clock.nb_entries += 1;
+
+  /* Wake up the reclaimer when the cache grows too large */
+  if(!cache_inode_clock.reclaiming &&
+     cache_inode_clock.nb_entries > cache_inode_gc_policy.hwmark_nb_entries)
+    pthread_cond_signal(&cache_inode_clock.cond);
+
+  V(cache_inode_clock.mutex);
+}                               /* cache_inode_clock_insert */
+
+/**
+ *
+ * cache_inode_clock_remove: takes an entry leaving the cache out of the reclaimer's watch.
+ *
+ * @param pentry [INOUT] entry being removed from the cache, locked.
+ *
+ * @return nothing (void function)
+ *
+ */
+void cache_inode_clock_remove(cache_entry_t * pentry)
+{
+  P(cache_inode_clock.mutex);
+
+  /* The reclaimer may have taken it already */
+  if(pentry->clock_next != NULL)
+    cache_inode_clock_unlink(pentry);
+
+  V(cache_inode_clock.mutex);
+}                               /* cache_inode_clock_remove */
+
+/**
+ *
+ * cache_inode_gc_wait_pressure: waits for entries to be reclaimed.
+ *
+ * Returns as soon as the cache holds more entries than the high water mark,
+ * or after timeout seconds. Entries are also to be reclaimed, down to the low
+ * water mark, when more memory than the memory high water mark is allocated.
+ *
+ * @param timeout [IN] maximum time to wait, in seconds.
+ *
+ * @return TRUE if entries are to be reclaimed, FALSE otherwise.
+ *
+ */
+int cache_inode_gc_wait_pressure(unsigned int timeout)
+{
+  struct timespec deadline;
+  int memory_pressure = FALSE;
+  int pressure;
+
+  P(cache_inode_clock.mutex);
+
+  if(!cache_inode_clock_pressure())
+    {
+      deadline.tv_sec = time(NULL) + timeout;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&cache_inode_clock.cond, &cache_inode_clock.mutex,
+                             &deadline);
+    }
+
+  V(cache_inode_clock.mutex);
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(cache_inode_gc_policy.memory_hwmark != 0 &&
+     BuddyGetTotalMemSpace() > cache_inode_gc_policy.memory_hwmark)
+    memory_pressure = TRUE;
+#elif defined(_USE_SLAB_ALLOC)
+  if(cache_inode_gc_policy.memory_hwmark != 0 &&
+     SlabGetTotalMemSpace() > cache_inode_gc_policy.memory_hwmark)
+    memory_pressure = TRUE;
+#endif
+
+  P(cache_inode_clock.mutex);
+
+  if(memory_pressure &&
+     cache_inode_clock.nb_entries > cache_inode_gc_policy.lwmark_nb_entries)
+    cache_inode_clock.reclaiming = TRUE;
+
+  pressure = cache_inode_clock_pressure();
+
+  V(cache_inode_clock.mutex);
+
+  return pressure;
+}                               /* cache_inode_gc_wait_pressure */
+
+/**
+ *
+ * cache_inode_gc_reclaim: reclaims entries for a limited time.
+ *
+ * Sweeps the entries of the cache with the clock hand, and removes the
+ * reclaimable ones until the low water mark is reached or the time is
+ * over. Entries locked by somebody else are in use, they are skipped.
+ *
+ * @param ht         [INOUT] the hashtable used to stored the cache_inode entries.
+ * @param pclient    [INOUT] ressource allocated by the reclaimer, receives the freed entries.
+ * @param duration   [IN]    time given to the step in milliseconds, 0 for no limit.
+ * @param pexhausted [OUT]   TRUE if all the entries were examined without finding enough to reclaim.
+ *
+ * @return the number of entries reclaimed.
+ *
+ */
+unsigned int cache_inode_gc_reclaim(hash_table_t * ht,
+                                    cache_inode_client_t * pclient,
+                                    unsigned int duration, int *pexhausted)
+{
+  cache_inode_param_gc_t gcparam;
+  cache_entry_t *pentry;
+  struct timeval start;
+  struct timeval now;
+  time_t current_time = time(NULL);
+  unsigned int nb_reclaimed = 0;
+  unsigned int nb_scanned = 0;
+
+  *pexhausted = FALSE;
+
+  /* Nothing ever expires */
+  if(cache_inode_gc_policy.file_expiration_delay <= 0 &&
+     cache_inode_gc_policy.directory_expiration_delay <= 0)
+    {
+      *pexhausted = TRUE;
+      return 0;
+    }
+
+  gcparam.ht = ht;
+  gcparam.pclient = pclient;
+  gcparam.nb_to_be_purged = 0;
+
+  gettimeofday(&start, NULL);
+
+  P(cache_inode_clock.mutex);
+
+  while(cache_inode_clock_pressure() && cache_inode_clock.hand != NULL)
+    {
+      /* Every entry had its second chance, the others are not reclaimable now */
+      if(cache_inode_clock.nb_unreclaimable > 2 * cache_inode_clock.nb_entries)
+        {
+          cache_inode_clock.nb_unreclaimable = 0;
+          *pexhausted = TRUE;
+          break;
+        }
+
+      if(duration != 0 && (++nb_scanned % CACHE_INODE_CLOCK_TIME_CHECK) == 0)
+        {
+          gettimeofday(&now, NULL);
+          if((now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000
+             >= (long)duration)
+            break;
+        }
+
+      pentry = cache_inode_clock.hand;
+      cache_inode_clock.hand = pentry->clock_next;
+      cache_inode_clock.nb_unreclaimable += 1;
+
+      /* Entries used since the hand last passed get a second chance */
+      if(pentry->clock_referenced)
+        {
+          pentry->clock_referenced = FALSE;
+          continue;
+        }
+
+      /* Entries locked by somebody else are in use */
+      if(P_w_try(&pentry->lock) != 0)
+        continue;
+
+      if(!cache_inode_gc_is_reclaimable(pentry, current_time))
+        {
+          V_w(&pentry->lock);
+          continue;
+        }
+
+      cache_inode_clock_unlink(pentry);
+      cache_inode_clock.nb_unreclaimable = 0;
+
+      V(cache_inode_clock.mutex);
+
+      if(cache_inode_gc_evict(pentry, &gcparam) == LRU_LIST_SET_INVALID)
+        nb_reclaimed += 1;
+      else
+        {
+          cache_inode_clock_insert(pentry);
+          V_w(&pentry->lock);
+        }
+
+      P(cache_inode_clock.mutex);
+    }
+
+  V(cache_inode_clock.mutex);
+
+  LogFullDebug(COMPONENT_CACHE_INODE_GC,
+               "Reclaim step: %u entries reclaimed, %u entries left",
+               nb_reclaimed, cache_inode_clock.nb_entries);
+
+  return nb_reclaimed;
+}                               /* cache_inode_gc_reclaim */
+
+/**
+ *
+ * cache_inode_gc_give_back: hands the free entries of a reclaimer over to the workers.
+ *
+ * The entries reclaimed are released to the pools of the reclaimer, which
+ * never allocates entries: it gives them back to be taken by the next worker
+ * that runs out of entries with cache_inode_gc_take_back. Without block
+ * preallocation, the entries are freed when released and this does nothing.
+ *
+ * @param pclient [INOUT] the client of the reclaimer.
+ *
+ * @return nothing (void function)
+ *
+ */
+void cache_inode_gc_give_back(cache_inode_client_t * pclient)
+{
+#if !defined(_USE_SLAB_ALLOC) && !defined(_NO_BLOCK_PREALLOC)
+  P(cache_inode_gc_free.mutex);
+  cache_inode_gc_give_list(&pclient->pool_entry, &cache_inode_gc_free.entry);
+  cache_inode_gc_give_list(&pclient->pool_entry_symlink,
+                           &cache_inode_gc_free.entry_symlink);
+  cache_inode_gc_give_list(&pclient->pool_dir_entry, &cache_inode_gc_free.dir_entry);
+  cache_inode_gc_give_list(&pclient->pool_parent, &cache_inode_gc_free.parent);
+  cache_inode_gc_give_list(&pclient->pool_key, &cache_inode_gc_free.key);
+  V(cache_inode_gc_free.mutex);
+#endif
+}                               /* cache_inode_gc_give_back */
+
+/**
+ *
+ * cache_inode_gc_take_back: takes the entries given back by the reclaimers.
+ *
+ * @param pclient [INOUT] the client of the worker, whose pools get the entries.
+ *
+ * @return nothing (void function)
+ *
+ */
+void cache_inode_gc_take_back(cache_inode_client_t * pclient)
+{
+#if !defined(_USE_SLAB_ALLOC) && !defined(_NO_BLOCK_PREALLOC)
+  /* Only once the worker runs out of entries */
+  if(pclient->pool_entry.pa_free != NULL || cache_inode_gc_free.entry.head == NULL)
+    return;
+
+  P(cache_inode_gc_free.mutex);
+  cache_inode_gc_take_list(&pclient->pool_entry, &cache_inode_gc_free.entry);
+  cache_inode_gc_take_list(&pclient->pool_entry_symlink,
+                           &cache_inode_gc_free.entry_symlink);
+  cache_inode_gc_take_list(&pclient->pool_dir_entry, &cache_inode_gc_free.dir_entry);
+  cache_inode_gc_take_list(&pclient->pool_parent, &cache_inode_gc_free.parent);
+  cache_inode_gc_take_list(&pclient->pool_key, &cache_inode_gc_free.key);
+  V(cache_inode_gc_free.mutex);
+#endif
+}                               /* cache_inode_gc_take_back */
+
 /**
  *
  * cache_inode_gc: Perform garbbage collection on the ressources managed by a client.
  *
- * Perform garbbage collection on the ressources managed by a client.
+ * Perform garbbage collection on the ressources managed by a client. When the
+ * cache holds more entries than the high water mark, reclaimable entries are
+ * removed until the low water mark is reached, in a single run. The server
+ * does it from its reclaimer threads instead, a step at a time.
  *
  * @param ht      [INOUT] the hashtable used to stored the cache_inode entries.
  * @param pclient [INOUT] ressource allocated by the client for the nfs management.
@@ -523,19 +878,15 @@ cache_inode_gc_policy_t cache_inode_get_gc_policy(void)
  * @return CACHE_INODE_SUCCESS if operation is a success \n
  * @return CACHE_INODE_LRU_ERROR if allocation error occured when validating the entry
  *
- * @see HashTable_GetSize
- * @see LRU_invalidate_by_function
- * @see LRU_gc_invalid
+ * @see cache_inode_gc_reclaim
  *
  */
 cache_inode_status_t cache_inode_gc(hash_table_t * ht,
                                     cache_inode_client_t * pclient,
                                     cache_inode_status_t * pstatus)
 {
-  cache_inode_param_gc_t gcparam;
-  unsigned int hash_size;
-  unsigned int invalid_before_gc = 0;
-  unsigned int invalid_after_gc = 0;
+  unsigned int nb_reclaimed;
+  int exhausted;
 
   /* Set the return default to CACHE_INODE_SUCCESS */
   *pstatus = CACHE_INODE_SUCCESS;
@@ -553,105 +904,33 @@ cache_inode_status_t cache_inode_gc(hash_table_t * ht,
 
   LogInfo(COMPONENT_CACHE_INODE_GC, "Checking if garbage collection is needed");
 
-  /* 1st ; we get the hash table size to see if garbage is required */
-  hash_size = HashTable_GetSize(ht);
-
-  if(hash_size > cache_inode_gc_policy.hwmark_nb_entries)
-    {
-      /*
-       * Garbage collection is made in several steps
-       *    1- Set the oldest entry as invalid and garbage their contents
-       *    2- Free the invalid entry in the LRU
-       *
-       *    Behaviour: - A directory is garbaged when all its entries are
-       *                 garbaged
-       *
-       */
-
-      gcparam.ht = ht;
-      gcparam.pclient = pclient;
-      gcparam.nb_to_be_purged = hash_size - cache_inode_gc_policy.lwmark_nb_entries;    /* try to purge until lw mark is reached */
-
-      LogInfo(COMPONENT_CACHE_INODE_GC,
-              "Garbage collection started (to be purged=%u, LRU size=%u)",
-              pclient->lru_gc->nb_entry, gcparam.nb_to_be_purged);
-
-      invalid_before_gc = pclient->lru_gc->nb_invalid;
-      if(LRU_invalidate_by_function
-         (pclient->lru_gc, cache_inode_gc_function, (void *)&gcparam)
-         != LRU_LIST_SUCCESS)
-        {
-          *pstatus = CACHE_INODE_LRU_ERROR;
-          return *pstatus;
-        }
-
-      invalid_after_gc = pclient->lru_gc->nb_invalid;
+  nb_reclaimed = cache_inode_gc_reclaim(ht, pclient, 0, &exhausted);
 
-      /* Removes the LRU entries and put them back to the pool */
-      if(LRU_gc_invalid(pclient->lru_gc, NULL) != LRU_LIST_SUCCESS)
-        {
-          *pstatus = CACHE_INODE_LRU_ERROR;
-          return *pstatus;
-        }
+  if(nb_reclaimed != 0)
+    LogInfo(COMPONENT_CACHE_INODE_GC,
+            "Garbage collection finished, %u entries removed", nb_reclaimed);
 
-      LogInfo(COMPONENT_CACHE_INODE_GC,
-              "Garbage collection finished, %u entries removed",
-              invalid_after_gc - invalid_before_gc);
-
-      *pstatus = CACHE_INODE_SUCCESS;
-    }
-  else
-    {
-      /* no garbage is required, just gets ride of the invalid in tyhe LRU list */
-      /* Removes the LRU entries and put them back to the pool */
-      if(LRU_gc_invalid(pclient->lru_gc, NULL) != LRU_LIST_SUCCESS)
-        {
-          *pstatus = CACHE_INODE_LRU_ERROR;
-          return *pstatus;
-        }
-      else
-        *pstatus = CACHE_INODE_SUCCESS;
-    }
+  /* Removes the invalid LRU entries and put them back to the pool */
+  if(LRU_gc_invalid(pclient->lru_gc, NULL) != LRU_LIST_SUCCESS)
+    *pstatus = CACHE_INODE_LRU_ERROR;
 
   return *pstatus;
 }                               /* cache_inode_gc */
 
-int cache_inode_gc_fd_func(LRU_entry_t * plru_entry, void *addparam)
-{
-  cache_entry_t *pentry = NULL;
-  cache_inode_param_gc_t *pgcparam = (cache_inode_param_gc_t *) addparam;
-  cache_inode_status_t status;
-
-  /* Get the entry */
-  pentry = (cache_entry_t *) (plru_entry->buffdata.pdata);
-
-  /* check if a file descriptor is opened on the file for a long time */
-
-  if((pentry->internal_md.type == REGULAR_FILE)
-     && (pentry->object.file.open_fd.fileno != 0)
-     && (time(NULL) - pentry->object.file.open_fd.last_op > pgcparam->pclient->retention))
-    {
-      P_w(&pentry->lock);
-      cache_inode_close(pentry, pgcparam->pclient, &status);
-      V_w(&pentry->lock);
-
-      pgcparam->nb_to_be_purged--;
-    }
-
-  /* return true for continuing */
-  if(pgcparam->nb_to_be_purged == 0)
-    return FALSE;
-  else
-    return TRUE;
-}
-
 /**
- * Garbagge opened file descriptors
+ *
+ * cache_inode_gc_fd: closes the fds unused for longer than the retention.
+ *
+ * @param pclient [INOUT] ressource allocated by the client for the nfs management.
+ * @param pstatus [OUT]   returned status.
+ *
+ * @return CACHE_INODE_SUCCESS
+ *
  */
 cache_inode_status_t cache_inode_gc_fd(cache_inode_client_t * pclient,
                                        cache_inode_status_t * pstatus)
 {
-  cache_inode_param_gc_t gcparam;
+  unsigned int nb_closed;
 
   /* Set the return default to CACHE_INODE_SUCCESS */
   *pstatus = CACHE_INODE_SUCCESS;
@@ -664,25 +943,14 @@ cache_inode_status_t cache_inode_gc_fd(cache_inode_client_t * pclient,
   if(time(NULL) - pclient->time_of_last_gc_fd < pclient->retention)
     return *pstatus;
 
-  gcparam.ht = NULL;            /* not used */
-  gcparam.pclient = pclient;
-  gcparam.nb_to_be_purged = pclient->max_fd;
-
-  if(LRU_apply_function(pclient->lru_gc, cache_inode_gc_fd_func, (void *)&gcparam) !=
-     LRU_LIST_SUCCESS)
-    {
-      *pstatus = CACHE_INODE_LRU_ERROR;
-      return *pstatus;
-    }
+  nb_closed = cache_inode_close_idle_fds(pclient);
 
   LogFullDebug(COMPONENT_CACHE_INODE_GC,
-           "File descriptor GC: %u files closed",
-           pclient->max_fd - gcparam.nb_to_be_purged);
+               "File descriptor GC: %u files closed", nb_closed);
   pclient->time_of_last_gc_fd = time(NULL);
 
-  *pstatus = CACHE_INODE_SUCCESS;
   return *pstatus;
-}
+}                               /* cache_inode_gc_fd */
 
 #ifdef _USE_NFS4_ACL
 /**
@@ -59,50 +59,34 @@
 
 /**
  *
- * cache_inode_getattr: Gets the attributes for a cached entry.
+ * cache_inode_getattr_renew: renews the attributes of an entry from the FSAL.
  *
- * Gets the attributes for a cached entry. The FSAL attributes are kept in a structure when the entry
- * is added to the cache.
+ * Locks the entry for writing to renew it, then only for reading to get its
+ * attributes.
  *
  * @param pentry [IN] entry to be managed.
  * @param pattr [OUT] pointer to the results
- * @param ht [IN] hash table used for the cache, unused in this call.
+ * @param ht [IN] hash table used for the cache.
  * @param pclient [INOUT] ressource allocated by the client for the nfs management.
  * @param pcontext [IN] FSAL credentials
  * @param pstatus [OUT] returned status.
  *
- * @return CACHE_INODE_SUCCESS if operation is a success \n
- * @return CACHE_INODE_LRU_ERROR if allocation error occured when validating the entry
+ * @return CACHE_INODE_SUCCESS with the entry locked for reading, an error with
+ * the entry unlocked.
  *
  */
-cache_inode_status_t
-cache_inode_getattr(cache_entry_t * pentry,
-                    fsal_attrib_list_t * pattr,
-                    hash_table_t * ht, /* Unused, kept for protototype's homogeneity */
-                    cache_inode_client_t * pclient,
-                    fsal_op_context_t * pcontext,
-                    cache_inode_status_t * pstatus)
+static cache_inode_status_t
+cache_inode_getattr_renew(cache_entry_t * pentry,
+                          fsal_attrib_list_t * pattr,
+                          hash_table_t * ht,
+                          cache_inode_client_t * pclient,
+                          fsal_op_context_t * pcontext,
+                          cache_inode_status_t * pstatus)
 {
     cache_inode_status_t status;
     fsal_handle_t *pfsal_handle = NULL;
     fsal_status_t fsal_status;
-
-    /* sanity check */
-    if(pentry == NULL || pattr == NULL ||
-       ht == NULL || pclient == NULL || pcontext == NULL)
-        {
-            *pstatus = CACHE_INODE_INVALID_ARGUMENT;
-            LogDebug(COMPONENT_CACHE_INODE,
-                     "cache_inode_getattr: returning CACHE_INODE_INVALID_ARGUMENT because of bad arg");
-            return *pstatus;
-        }
-
-    /* Set the return default to CACHE_INODE_SUCCESS */
-    *pstatus = CACHE_INODE_SUCCESS;
-
-    /* stats */
-    pclient->stat.nb_call_total += 1;
-    inc_func_call(pclient, CACHE_INODE_GETATTR);
+    cache_inode_opened_file_t *pfd;
 
     /* Lock the entry */
     P_w(&pentry->lock);
@@ -121,7 +105,7 @@ cache_inode_getattr(cache_entry_t * pentry,
     /* RW Lock goes for writer to reader */
     rw_lock_downgrade(&pentry->lock);
 
-    *pattr = pentry->attributes;
+    cache_inode_get_attributes(pentry, pattr);
 
     if(FSAL_TEST_MASK(pattr->asked_attributes,
                       FSAL_ATTR_RDATTR_ERR))
@@ -135,6 +119,7 @@ cache_inode_getattr(cache_entry_t * pentry,
                                  "cache_inode_getattr: returning %d(%s) "
 				 "from cache_inode_renew_entry - unexpected md_type",
                                  *pstatus, cache_inode_err_str(*pstatus));
+                    V_r(&pentry->lock);
                     return *pstatus;
                 }
             pfsal_handle = &pentry->handle;
@@ -143,11 +128,16 @@ cache_inode_getattr(cache_entry_t * pentry,
              * An error occured when trying to get
              * the attributes, they have to be renewed
              */
+            pfd = cache_inode_fd_pin(pentry);
 #ifdef _USE_MFSL
-            fsal_status = FSAL_getattrs_descriptor(&(cache_inode_fd(pentry)->fsal_file), pfsal_handle, pcontext, pattr);
+            fsal_status = FSAL_getattrs_descriptor(pfd != NULL ? &(pfd->mfsl_fd.fsal_file) : NULL,
+                                                   pfsal_handle, pcontext, pattr);
 #else
-            fsal_status = FSAL_getattrs_descriptor(cache_inode_fd(pentry), pfsal_handle, pcontext, pattr);
+            fsal_status = FSAL_getattrs_descriptor(pfd != NULL ? &(pfd->fd) : NULL,
+                                                   pfsal_handle, pcontext, pattr);
 #endif
+            if(pfd != NULL)
+              cache_inode_fd_put(pfd, pclient);
             if(FSAL_IS_ERROR(fsal_status))
                 {
                     *pstatus = cache_inode_error_convert(fsal_status);
@@ -184,7 +174,73 @@ cache_inode_getattr(cache_entry_t * pentry,
             /* Set the new attributes */
             cache_inode_set_attributes(pentry, pattr);
         }
-    *pstatus = cache_inode_valid(pentry, CACHE_INODE_OP_GET, pclient);
+
+    *pstatus = CACHE_INODE_SUCCESS;
+    return *pstatus;
+}                               /* cache_inode_getattr_renew */
+
+/**
+ *
+ * cache_inode_getattr: Gets the attributes for a cached entry.
+ *
+ * Gets the attributes for a cached entry. The FSAL attributes are kept in a structure when the entry
+ * is added to the cache. While they are valid, the entry is only locked for reading.
+ *
+ * @param pentry [IN] entry to be managed.
+ * @param pattr [OUT] pointer to the results
+ * @param ht [IN] hash table used for the cache, unused in this call.
+ * @param pclient [INOUT] ressource allocated by the client for the nfs management.
+ * @param pcontext [IN] FSAL credentials
+ * @param pstatus [OUT] returned status.
+ *
+ * @return CACHE_INODE_SUCCESS if operation is a success \n
+ * @return CACHE_INODE_LRU_ERROR if allocation error occured when validating the entry
+ *
+ */
+cache_inode_status_t
+cache_inode_getattr(cache_entry_t * pentry,
+                    fsal_attrib_list_t * pattr,
+                    hash_table_t * ht, /* Unused, kept for protototype's homogeneity */
+                    cache_inode_client_t * pclient,
+                    fsal_op_context_t * pcontext,
+                    cache_inode_status_t * pstatus)
+{
+    /* sanity check */
+    if(pentry == NULL || pattr == NULL ||
+       ht == NULL || pclient == NULL || pcontext == NULL)
+        {
+            *pstatus = CACHE_INODE_INVALID_ARGUMENT;
+            LogDebug(COMPONENT_CACHE_INODE,
+                     "cache_inode_getattr: returning CACHE_INODE_INVALID_ARGUMENT because of bad arg");
+            return *pstatus;
+        }
+
+    /* Set the return default to CACHE_INODE_SUCCESS */
+    *pstatus = CACHE_INODE_SUCCESS;
+
+    /* stats */
+    pclient->stat.nb_call_total += 1;
+    inc_func_call(pclient, CACHE_INODE_GETATTR);
+
+    /* Attributes still valid in the cache only need the entry locked for reading */
+    P_r(&pentry->lock);
+
+    if(!cache_inode_renew_needed(pentry, pclient) &&
+       !FSAL_TEST_MASK(pentry->attributes.asked_attributes, FSAL_ATTR_RDATTR_ERR))
+        {
+            cache_inode_get_attributes(pentry, pattr);
+            cache_inode_touch(pentry, pclient);
+        }
+    else
+        {
+            V_r(&pentry->lock);
+
+            if(cache_inode_getattr_renew(pentry, pattr, ht, pclient, pcontext,
+                                         pstatus) != CACHE_INODE_SUCCESS)
+                return *pstatus;
+
+            *pstatus = cache_inode_valid(pentry, CACHE_INODE_OP_GET, pclient);
+        }
 
     V_r(&pentry->lock);
 
@@ -128,7 +128,6 @@ int cache_inode_client_init(cache_inode_client_t * pclient,
   pclient->pworker = pworker_data;
   pclient->use_fd_cache = paramp->use_fd_cache;
   pclient->retention = paramp->retention;
-  pclient->max_fd = paramp->max_fd;
 
   /* introducing desynchronisation for GC */
   pclient->time_of_last_gc = time(NULL) + thread_index * 20;
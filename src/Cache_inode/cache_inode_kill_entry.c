@@ -215,6 +215,9 @@ cache_inode_status_t cache_inode_kill_entry( cache_entry_t          * pentry,
   /* Release the hash key data */
   cache_inode_release_fsaldata_key(&old_key, pclient);
 
+  /* Not to be found by the reclaimer any more */
+  cache_inode_clock_remove(pentry);
+
   /* Clean up the associated ressources in the FSAL */
   if(FSAL_IS_ERROR(fsal_status = FSAL_CleanObjectResources(pfsal_handle)))
     {
@@ -251,6 +254,10 @@ cache_inode_status_t cache_inode_kill_entry( cache_entry_t          * pentry,
     {
       cache_content_status_t cache_content_status;
 
+      /* Close the fds kept open on the file, drop its unstable writes */
+      cache_inode_forget_fds(pentry, pclient);
+      cache_inode_forget_dirty(pentry);
+
       if(pentry->object.file.pentry_content != NULL)
         if(cache_content_release_entry
            ((cache_content_entry_t *) pentry->object.file.pentry_content,
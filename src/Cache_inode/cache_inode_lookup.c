@@ -62,7 +62,9 @@
  * cached entry.
  * 
  * Looks up for a name in a directory indicated by a cached entry. The directory
- * should have been cached before.
+ * should have been cached before. A name found in the cached entries of a
+ * directory still valid only needs the directory locked for reading; it is
+ * locked for writing to be renewed or to have an entry added.
  *
  * @param pentry_parent [IN]    entry for the parent directory to be managed.
  * @param name          [IN]    name of the entry that we are looking for in the
@@ -126,6 +128,55 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
    * whether a mutating operation is safe--and, the caller should have
    * already renewed the entry */
   if(use_mutex == TRUE) {
+      /* A name in the cached entries of a directory still valid is found
+       * with the directory locked for reading */
+      P_r(&pentry_parent->lock);
+
+      if(pentry_parent->internal_md.type == DIRECTORY &&
+         !cache_inode_renew_needed(pentry_parent, pclient) &&
+         FSAL_namecmp(pname, (fsal_name_t *) & FSAL_DOT) &&
+         FSAL_namecmp(pname, (fsal_name_t *) & FSAL_DOT_DOT))
+        {
+          access_mask = FSAL_MODE_MASK_SET(FSAL_X_OK) |
+                        FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_LIST_DIR);
+          if(cache_inode_access_no_mutex(pentry_parent,
+                                         access_mask,
+                                         ht,
+                                         pclient,
+                                         pcontext,
+                                         pstatus) != CACHE_INODE_SUCCESS)
+            {
+              V_r(&pentry_parent->lock);
+
+              (pclient->stat.func_stats.nb_err_retryable[CACHE_INODE_GETATTR])++;
+              return NULL;
+            }
+
+          FSAL_namecpy(&dirent_key->name, pname);
+          dirent_node = avltree_lookup(&dirent_key->node_n,
+                                       &pentry_parent->object.dir.dentries);
+          if(dirent_node)
+            {
+              dirent = avltree_container_of(dirent_node, cache_inode_dir_entry_t,
+                                            node_n);
+              pentry = dirent->pentry;
+
+              /* Return the attributes */
+              cache_inode_get_attributes(pentry, pattr);
+
+              cache_inode_touch(pentry_parent, pclient);
+
+              V_r(&pentry_parent->lock);
+
+              (pclient->stat.func_stats.nb_success[CACHE_INODE_LOOKUP])++;
+              return pentry;
+            }
+        }
+
+      V_r(&pentry_parent->lock);
+
+      /* The directory is renewed, or the entry added to it, with the
+       * directory locked for writing until the end */
       P_w(&pentry_parent->lock);
 
       cache_status = cache_inode_renew_entry(pentry_parent, pattr, ht,
@@ -139,9 +190,6 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
                        *pstatus, cache_inode_err_str(*pstatus));
           return NULL;
       }
-
-      /* RW Lock goes for writer to reader */
-      rw_lock_downgrade(&pentry_parent->lock);
   }
 
   if(pentry_parent->internal_md.type != DIRECTORY)
@@ -153,7 +201,7 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
       (pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_LOOKUP])++;
 
       if(use_mutex == TRUE)
-        V_r(&pentry_parent->lock);
+        V_w(&pentry_parent->lock);
 
       return NULL;
     }
@@ -190,7 +238,7 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
                                      pstatus) != CACHE_INODE_SUCCESS)
         {
           if(use_mutex == TRUE)
-            V_r(&pentry_parent->lock);
+            V_w(&pentry_parent->lock);
 
           (pclient->stat.func_stats.nb_err_retryable[CACHE_INODE_GETATTR])++;
           return NULL;
@@ -255,7 +303,7 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
               *pstatus = cache_inode_error_convert(fsal_status);
 
               if(use_mutex == TRUE)
-                V_r(&pentry_parent->lock);
+                V_w(&pentry_parent->lock);
 
               /* Stale File Handle to be detected and managed */
               if(fsal_status.major == ERR_FSAL_STALE)
@@ -309,7 +357,7 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
                 {
                   *pstatus = cache_inode_error_convert(fsal_status);
                   if(use_mutex == TRUE)
-                    V_r(&pentry_parent->lock);
+                    V_w(&pentry_parent->lock);
 
                   /* Stale File Handle to be detected and managed */
                   if(fsal_status.major == ERR_FSAL_STALE)
@@ -357,7 +405,7 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
                                               pstatus ) ) == NULL )
             {
               if(use_mutex == TRUE)
-                V_r(&pentry_parent->lock);
+                V_w(&pentry_parent->lock);
 
               /* stats */
               (pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_LOOKUP])++;
@@ -380,7 +428,7 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
              && cache_status != CACHE_INODE_ENTRY_EXISTS)
             {
               if(use_mutex == TRUE)
-                V_r(&pentry_parent->lock);
+                V_w(&pentry_parent->lock);
 
               /* stats */
               (pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_LOOKUP])++;
@@ -392,12 +440,12 @@ cache_entry_t *cache_inode_lookup_sw(cache_entry_t        * pentry_parent,
     }
 
   /* Return the attributes */
-  *pattr = pentry->attributes;
+  cache_inode_get_attributes(pentry, pattr);
 
   *pstatus = cache_inode_valid(pentry_parent, CACHE_INODE_OP_GET, pclient);
 
   if(use_mutex == TRUE)
-    V_r(&pentry_parent->lock);
+    V_w(&pentry_parent->lock);
 
   /* stat */
   if(*pstatus != CACHE_INODE_SUCCESS)
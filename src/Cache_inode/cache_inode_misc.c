@@ -415,6 +415,9 @@ cache_entry_t *cache_inode_new_entry(cache_inode_fsal_data_t   * pfsdata,
       return pentry;
     }
 
+  /* Reuse the entries the reclaimers freed before allocating new ones */
+  cache_inode_gc_take_back(pclient);
+
   GetFromPool(pentry, &pclient->pool_entry, cache_entry_t);
   if(pentry == NULL)
     {
@@ -499,6 +502,8 @@ cache_entry_t *cache_inode_new_entry(cache_inode_fsal_data_t   * pfsdata,
 
   pentry->gc_lru_entry = NULL;
   pentry->gc_lru = NULL;
+  pentry->clock_next = NULL;
+  pentry->clock_prev = NULL;
 
   pentry->policy = policy ;
 
@@ -522,6 +527,8 @@ cache_entry_t *cache_inode_new_entry(cache_inode_fsal_data_t   * pfsdata,
       pentry->object.file.pentry_content = NULL;    /* Not yet a File Content entry associated with this entry */
       init_glist(&pentry->object.file.state_list);  /* No associated states yet */
       init_glist(&pentry->object.file.lock_list);   /* No associated locks yet */
+      itree_init(&pentry->object.file.lock_granted_tree);
+      itree_init(&pentry->object.file.lock_blocked_tree);
       if(pthread_mutex_init(&pentry->object.file.lock_list_mutex, NULL) != 0)
         {
           ReleaseToPool(pentry, &pclient->pool_entry);
@@ -536,16 +543,30 @@ cache_entry_t *cache_inode_new_entry(cache_inode_fsal_data_t   * pfsdata,
           (pclient->stat.func_stats.nb_err_retryable[CACHE_INODE_NEW_ENTRY])++;
           return NULL;
         }
-      pentry->object.file.open_fd.fileno = 0;
-      pentry->object.file.open_fd.last_op = 0;
-      pentry->object.file.open_fd.openflags = 0;
-#ifdef _USE_MFSL
-      memset(&(pentry->object.file.open_fd.mfsl_fd), 0, sizeof(mfsl_file_t));
-#else
-      memset(&(pentry->object.file.open_fd.fd), 0, sizeof(fsal_file_t));
-#endif
-      memset(&(pentry->object.file.unstable_data), 0,
-             sizeof(cache_inode_unstable_data_t));
+      memset(&(pentry->object.file.open_fd), 0, sizeof(cache_inode_opened_file_t));
+      init_glist(&pentry->object.file.open_fd.fd_lru);
+      pentry->object.file.open_fd.pentry = pentry;
+      memset(&(pentry->object.file.read_fd), 0, sizeof(cache_inode_opened_file_t));
+      init_glist(&pentry->object.file.read_fd.fd_lru);
+      pentry->object.file.read_fd.pentry = pentry;
+      pentry->object.file.write_behind = NULL;
+      if(pthread_mutex_init(&pentry->object.file.io_mutex, NULL) != 0 ||
+         pthread_cond_init(&pentry->object.file.io_cond, NULL) != 0)
+        {
+          ReleaseToPool(pentry, &pclient->pool_entry);
+
+          LogCrit(COMPONENT_CACHE_INODE,
+                  "cache_inode_new_entry: init of io_mutex returned %d (%s)",
+                  errno, strerror(errno));
+
+          *pstatus = CACHE_INODE_INIT_ENTRY_FAILED;
+
+          /* stat */
+          (pclient->stat.func_stats.nb_err_retryable[CACHE_INODE_NEW_ENTRY])++;
+          return NULL;
+        }
+      init_glist(&pentry->object.file.io_ranges);
+      pentry->object.file.io_waiters = 0;
 #ifdef _USE_PROXY
       pentry->object.file.pname = NULL;
       pentry->object.file.pentry_parent_open = NULL;
@@ -776,6 +797,9 @@ cache_entry_t *cache_inode_new_entry(cache_inode_fsal_data_t   * pfsdata,
   /* Now that added as a new entry, init attribute. */
   pentry->attributes = fsal_attributes;
 
+  /* From now on, the reclaimer may find it */
+  cache_inode_clock_insert(pentry);
+
 #ifdef _USE_NFS4_ACL
   LogDebug(COMPONENT_CACHE_INODE, "init_attributes: md_type=%d, acl=%p",
            pentry->internal_md.type, pentry->attributes.acl);
@@ -990,6 +1014,34 @@ cache_inode_status_t cache_inode_error_convert(fsal_status_t fsal_status)
   return CACHE_INODE_FSAL_ERROR;
 }                               /* cache_inode_error_convert */
 
+/**
+ *
+ * cache_inode_touch: marks an entry as used, with the entry locked for reading.
+ *
+ * The lookups and getattrs served from the cache only lock the entry for
+ * reading: they cannot move it in the GC LRU like cache_inode_valid does,
+ * they only tell the reclaimer that the entry is in use. The values are
+ * not stored again when already set, to keep the cache line of an entry
+ * read by many workers shared.
+ *
+ * @param pentry [INOUT] entry read.
+ * @param pclient [INOUT] ressource allocated by the client for the nfs management.
+ *
+ */
+void cache_inode_touch(cache_entry_t * pentry, cache_inode_client_t * pclient)
+{
+  time_t now = time(NULL);
+
+  /* Concurrent readers store the same values */
+  if(pentry->internal_md.read_time != now)
+    pentry->internal_md.read_time = now;
+
+  if(!pentry->clock_referenced)
+    pentry->clock_referenced = TRUE;
+
+  pclient->call_since_last_gc++;
+}                               /* cache_inode_touch */
+
 /**
  *
  * cache_inode_valid: validates an entry to update its garbagge status.
@@ -1058,6 +1110,9 @@ cache_inode_status_t cache_inode_valid(cache_entry_t * pentry,
   if (pentry->internal_md.valid_state != STALE)
     pentry->internal_md.valid_state = VALID;
 
+  /* Seen as used by the reclaimer */
+  pentry->clock_referenced = TRUE;
+
   if(op == CACHE_INODE_OP_GET)
     pentry->internal_md.read_time = time(NULL);
 
@@ -1071,26 +1126,18 @@ cache_inode_status_t cache_inode_valid(cache_entry_t * pentry,
   pclient->call_since_last_gc++;
 
   /* If open/close fd cache is used for FSAL, manage it here */
-    LogFullDebug(COMPONENT_CACHE_INODE_GC,
-                 "--------> use_fd_cache=%u fileno=%d last_op=%u time(NULL)=%u delta=%u retention=%u",
-                 pclient->use_fd_cache, pentry->object.file.open_fd.fileno,
-                 (unsigned int)pentry->object.file.open_fd.last_op, (unsigned int)time(NULL),
-                 (unsigned int)(time(NULL) - pentry->object.file.open_fd.last_op), (unsigned int)pclient->retention);
-
   if(pentry->internal_md.type == REGULAR_FILE)
     {
       if(pclient->use_fd_cache == 1)
         {
-          if(pentry->object.file.open_fd.fileno != 0)
+          if(pentry->object.file.open_fd.fileno != 0 || pentry->object.file.read_fd.fileno != 0)
             {
-              if(time(NULL) - pentry->object.file.open_fd.last_op > pclient->retention)
+              /* Closes the fds unused for longer than the retention */
+              if(cache_inode_close(pentry, pclient, &cache_status) !=
+                 CACHE_INODE_SUCCESS)
                 {
-                  if(cache_inode_close(pentry, pclient, &cache_status) !=
-                     CACHE_INODE_SUCCESS)
-                    {
-                      /* Bad close */
-                      return cache_status;
-                    }
+                  /* Bad close */
+                  return cache_status;
                 }
             }
         }
@@ -1172,12 +1219,26 @@ cache_inode_status_t cache_inode_valid(cache_entry_t * pentry,
  */
 void cache_inode_set_attributes(cache_entry_t * pentry, fsal_attrib_list_t * pattr)
 {
+  uint64_t dirty_end;
 #ifdef _USE_NFS4_ACL
   fsal_acl_t *p_oldacl = pentry->attributes.acl;
   fsal_acl_t *p_newacl = pattr->acl;
 #endif                          /* _USE_NFS4_ACL */
 
-  pentry->attributes = *pattr;
+  if(pentry->internal_md.type == REGULAR_FILE)
+    {
+      /* The unstable writes not written behind yet may make the file larger */
+      dirty_end = cache_inode_dirty_end(pentry);
+
+      /* The I/O on the file update its attributes under io_mutex */
+      P(pentry->object.file.io_mutex);
+      pentry->attributes = *pattr;
+      if(dirty_end > pentry->attributes.filesize)
+        pentry->attributes.filesize = dirty_end;
+      V(pentry->object.file.io_mutex);
+    }
+  else
+    pentry->attributes = *pattr;
 
 #ifdef _USE_NFS4_ACL
   /* If acl has been changed, release old acl and increase the reference
@@ -1207,6 +1268,32 @@ void cache_inode_set_attributes(cache_entry_t * pentry, fsal_attrib_list_t * pat
 #endif                          /* _USE_NFS4_ACL */
 }                               /* cache_inode_set_attributes */
 
+/**
+ *
+ * cache_inode_get_attributes: gets a copy of the attributes cached in the entry.
+ *
+ * The reads and writes of a file run with the entry locked for reading and
+ * update its size and times under its io_mutex: the copy of the attributes
+ * of a file made with the entry locked for reading is made under it as well.
+ *
+ * @param pentry [IN] the entry to deal with, locked.
+ * @param pattr [OUT] the attributes of the entry.
+ *
+ * @return nothing (void function).
+ *
+ */
+void cache_inode_get_attributes(cache_entry_t * pentry, fsal_attrib_list_t * pattr)
+{
+  if(pentry->internal_md.type == REGULAR_FILE)
+    {
+      P(pentry->object.file.io_mutex);
+      *pattr = pentry->attributes;
+      V(pentry->object.file.io_mutex);
+    }
+  else
+    *pattr = pentry->attributes;
+}                               /* cache_inode_get_attributes */
+
 /**
  *
  * cache_inode_fsal_type_convert: converts an FSAL type to the cache_inode type to be used.
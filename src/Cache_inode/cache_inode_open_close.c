@@ -26,10 +26,15 @@
  * \author  $Author: deniel $
  * \date    $Date: 2005/11/28 17:02:27 $
  * \version $Revision: 1.20 $
- * \brief   Removes an entry of any type.
+ * \brief   Opens and closes the files in the FSAL.
  *
- * cache_inode_rdwr.c : performs an IO on a REGULAR_FILE.
+ * cache_inode_open_close.c : opens and closes the files in the FSAL.
  *
+ * The files opened are kept open in their entry, one fd for reads and one
+ * for writes, shared by all the workers. All the open fds are in a single
+ * LRU: past the budget of open files, the least recently used fds that no
+ * I/O is using are closed. The fds of a file holding locks or states are
+ * never closed, closing them would drop the locks in the FSAL.
  *
  */
 #ifdef HAVE_CONFIG_H
@@ -59,160 +64,434 @@
 #include <pthread.h>
 #include <strings.h>
 
-#ifdef _USE_MFSL
-mfsl_file_t * cache_inode_fd(cache_entry_t * pentry)
-#else
-fsal_file_t * cache_inode_fd(cache_entry_t * pentry)
-#endif
+
+/* Most fds closed at once, out of fd_cache_mutex */
+#define CACHE_INODE_FD_CLOSE_BATCH 8
+
+/* The open fds of all the entries, least recently used first. The fds of an
+ * entry are opened, closed and pinned under this mutex */
+static pthread_mutex_t fd_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head fd_cache_lru = { &fd_cache_lru, &fd_cache_lru };
+static cache_inode_fd_stat_t fd_cache_stat = {.max_opened = CACHE_INODE_DEFAULT_MAX_FD };
+
+/**
+ *
+ * cache_inode_fd_slot: chooses the fd of an entry to use with openflags.
+ *
+ * Reads go through the fd for writes when it is open read/write, the other
+ * reads have an fd of their own. Must be called with fd_cache_mutex held.
+ *
+ */
+static cache_inode_opened_file_t *cache_inode_fd_slot(cache_entry_t * pentry,
+                                                      fsal_openflags_t openflags)
 {
-  if(pentry == NULL)
-    return NULL;
+  if(openflags == FSAL_O_RDONLY &&
+     (pentry->object.file.open_fd.fileno == 0 ||
+      pentry->object.file.open_fd.openflags != FSAL_O_RDWR))
+    return &pentry->object.file.read_fd;
 
-  if(pentry->internal_md.type != REGULAR_FILE)
-      return NULL;
+  return &pentry->object.file.open_fd;
+}                               /* cache_inode_fd_slot */
+
+/* Marks an fd as just used, and pins it if asked. fd_cache_mutex held */
+static void cache_inode_fd_touch(cache_inode_opened_file_t * pfd, int pin)
+{
+  pfd->last_op = time(NULL);
+
+  glist_del(&pfd->fd_lru);
+  glist_add_tail(&fd_cache_lru, &pfd->fd_lru);
+
+  if(pin)
+    pfd->refcount += 1;
+}                               /* cache_inode_fd_touch */
+
+/**
+ *
+ * cache_inode_fd_detach: takes an fd out of its entry, to be closed.
+ *
+ * The fd is copied to pclosed, to be closed with cache_inode_fd_fsal_close
+ * once fd_cache_mutex is released. Must be called with fd_cache_mutex held.
+ *
+ */
+static void cache_inode_fd_detach(cache_inode_opened_file_t * pfd,
+                                  cache_inode_opened_file_t * pclosed)
+{
+  *pclosed = *pfd;
+
+  glist_del(&pfd->fd_lru);
+  pfd->fileno = 0;
+  pfd->last_op = 0;
+  pfd->openflags = 0;
+
+  fd_cache_stat.nb_opened -= 1;
+  fd_cache_stat.nb_close += 1;
+}                               /* cache_inode_fd_detach */
+
+static fsal_status_t cache_inode_fd_fsal_close(cache_inode_opened_file_t * pclosed,
+                                               cache_inode_client_t * pclient)
+{
+  LogFullDebug(COMPONENT_CACHE_INODE,
+               "cache_inode_fd_fsal_close: pentry %p, fileno = %d, lastop=%d ago",
+               pclosed->pentry, pclosed->fileno, (int)(time(NULL) - pclosed->last_op));
 
-  if(((pentry->object.file.open_fd.openflags == FSAL_O_RDONLY) ||
-      (pentry->object.file.open_fd.openflags == FSAL_O_RDWR) ||
-      (pentry->object.file.open_fd.openflags == FSAL_O_WRONLY)) &&
-     (pentry->object.file.open_fd.fileno != 0))
-    {
 #ifdef _USE_MFSL
-      return &pentry->object.file.open_fd.mfsl_fd;
+  return MFSL_close(&pclosed->mfsl_fd, &pclient->mfsl_context, NULL);
 #else
-      return &pentry->object.file.open_fd.fd;
+  return FSAL_close(&pclosed->fd);
 #endif
+}                               /* cache_inode_fd_fsal_close */
+
+/**
+ *
+ * cache_inode_fd_collect: takes out the fds to close to keep within the budget.
+ *
+ * Walks the LRU, least recently used first, and detaches the fds over the
+ * budget or unused since idle_before. The fds in use and the fds of files
+ * holding locks or states are skipped. Must be called with fd_cache_mutex
+ * held.
+ *
+ * @param pkeep       [IN]  an fd not to close, may be NULL
+ * @param idle_before [IN]  the fds unused since are closed too, 0 for none
+ * @param pclosed     [OUT] the fds to close
+ * @param max         [IN]  most fds to detach
+ *
+ * @return the number of fds detached.
+ *
+ */
+static unsigned int cache_inode_fd_collect(cache_inode_opened_file_t * pkeep,
+                                           time_t idle_before,
+                                           cache_inode_opened_file_t * pclosed,
+                                           unsigned int max)
+{
+  struct glist_head *glist;
+  struct glist_head *glistn;
+  cache_inode_opened_file_t *pfd;
+  cache_entry_t *pentry;
+  unsigned int nb_closed = 0;
+  int stateful;
+
+  glist_for_each_safe(glist, glistn, &fd_cache_lru)
+    {
+      pfd = glist_entry(glist, cache_inode_opened_file_t, fd_lru);
+
+      if(nb_closed == max)
+        break;
+
+      if(fd_cache_stat.nb_opened <= fd_cache_stat.max_opened && pfd->last_op >= idle_before)
+        break;
+
+      if(pfd == pkeep || pfd->refcount != 0)
+        continue;
+
+      /* The lock operations hold the lock list mutex of the file, do not wait for it */
+      pentry = pfd->pentry;
+      if(pthread_mutex_trylock(&pentry->object.file.lock_list_mutex) != 0)
+        continue;
+
+      stateful = !glist_empty(&pentry->object.file.lock_list) ||
+          !glist_empty(&pentry->object.file.state_list);
+
+      pthread_mutex_unlock(&pentry->object.file.lock_list_mutex);
+
+      if(stateful)
+        continue;
+
+      if(fd_cache_stat.nb_opened > fd_cache_stat.max_opened)
+        fd_cache_stat.nb_evict += 1;
+
+      cache_inode_fd_detach(pfd, &pclosed[nb_closed++]);
     }
 
-  return NULL;
-}
+  return nb_closed;
+}                               /* cache_inode_fd_collect */
 
 /**
  *
- * cache_content_open: opens the local fd on  the cache.
+ * cache_inode_fd_open: opens an entry in the FSAL, unless it is already.
  *
- * Opens the fd on  the FSAL
+ * Opens the file in the FSAL with openflags, by name if pentry_dir is not
+ * NULL, and keeps the fd in the entry. The fd already kept is used if it is
+ * open with the same flags, or read/write. Opening a file may close the
+ * least recently used fds of the other files, to keep within the budget.
+ * With pattr NULL the attributes of the entry are left as they are, the
+ * caller may have the entry locked for reading only.
  *
- * @param pentry    [IN]  entry in file content layer whose content is to be accessed.
- * @param pclient   [IN]  ressource allocated by the client for the nfs management.
- * @param openflags [IN]  flags to be used to open the file
- * @param pcontent  [IN]  FSAL operation context
- * @pstatus         [OUT] returned status.
+ * @param pentry_dir [IN]  parent directory to open by name, NULL to open by handle
+ * @param pname      [IN]  name of the file in pentry_dir
+ * @param pentry     [IN]  file entry to be opened
+ * @param pclient    [IN]  ressource allocated by the client for the nfs management.
+ * @param openflags  [IN]  flags to be used to open the file
+ * @param pcontext   [IN]  FSAL operation context
+ * @param pattr      [OUT] the attributes got at open, may be NULL
+ * @param pin        [IN]  if true, the fd is returned pinned
+ * @param pstatus    [OUT] returned status.
  *
- * @return CACHE_CONTENT_SUCCESS is successful .
+ * @return the fd, NULL if the file could not be opened
  *
  */
-
-cache_inode_status_t cache_inode_open(cache_entry_t * pentry,
-                                      cache_inode_client_t * pclient,
-                                      fsal_openflags_t openflags,
-                                      fsal_op_context_t * pcontext,
-                                      cache_inode_status_t * pstatus)
+static cache_inode_opened_file_t *cache_inode_fd_open(cache_entry_t * pentry_dir,
+                                                      fsal_name_t * pname,
+                                                      cache_entry_t * pentry,
+                                                      cache_inode_client_t * pclient,
+                                                      fsal_openflags_t openflags,
+                                                      fsal_op_context_t * pcontext,
+                                                      fsal_attrib_list_t * pattr,
+                                                      int pin,
+                                                      cache_inode_status_t * pstatus)
 {
+  cache_inode_opened_file_t *pfd;
+  cache_inode_opened_file_t opened;
+  cache_inode_opened_file_t closed[CACHE_INODE_FD_CLOSE_BATCH];
+  unsigned int nb_closed = 0;
+  unsigned int i;
   fsal_status_t fsal_status;
+  fsal_size_t save_filesize = 0;
+  fsal_size_t save_spaceused = 0;
+  fsal_time_t save_mtime = {
+    .seconds = 0,
+    .nseconds = 0
+  };
 
-  if((pentry == NULL) || (pclient == NULL) || (pcontext == NULL) || (pstatus == NULL))
-    return CACHE_INODE_INVALID_ARGUMENT;
+  P(fd_cache_mutex);
 
-  if(pentry->internal_md.type != REGULAR_FILE)
+  pfd = cache_inode_fd_slot(pentry, openflags);
+
+  /* Open file need to be closed, unless it is already open as read/write */
+  if((pfd->fileno != 0) &&
+     (pfd->openflags != FSAL_O_RDWR) && (pfd->openflags != openflags))
     {
-      *pstatus = CACHE_INODE_BAD_TYPE;
-      return *pstatus;
+      if(pfd->refcount != 0)
+        {
+          V(fd_cache_mutex);
+
+          /* Reopened once the I/O in progress are done, the client retries */
+          *pstatus = CACHE_INODE_FSAL_DELAY;
+          return NULL;
+        }
+
+      cache_inode_fd_detach(pfd, &closed[nb_closed++]);
     }
 
-  /* Open file need to be closed, unless it is already open as read/write */
-  if((pentry->object.file.open_fd.openflags != FSAL_O_RDWR) &&
-     (pentry->object.file.open_fd.openflags != 0) &&
-     (pentry->object.file.open_fd.fileno != 0) &&
-     (pentry->object.file.open_fd.openflags != openflags))
+  if(pfd->fileno != 0)
     {
-#ifdef _USE_MFSL
-      fsal_status = MFSL_close(&(pentry->object.file.open_fd.mfsl_fd), &pclient->mfsl_context, NULL);
-#else
-      fsal_status = FSAL_close(&(pentry->object.file.open_fd.fd));
-#endif
+      cache_inode_fd_touch(pfd, pin);
+      fd_cache_stat.nb_reuse += 1;
+
+      V(fd_cache_mutex);
+
+      *pstatus = CACHE_INODE_SUCCESS;
+      return pfd;
+    }
+
+  V(fd_cache_mutex);
+
+  if(nb_closed != 0)
+    {
+      fsal_status = cache_inode_fd_fsal_close(&closed[0], pclient);
+
       if(FSAL_IS_ERROR(fsal_status) && (fsal_status.major != ERR_FSAL_NOT_OPENED))
         {
           *pstatus = cache_inode_error_convert(fsal_status);
 
           LogDebug(COMPONENT_CACHE_INODE,
-                   "cache_inode_open: returning %d(%s) from FSAL_close",
+                   "cache_inode_fd_open: returning %d(%s) from FSAL_close",
                    *pstatus, cache_inode_err_str(*pstatus));
 
-          return *pstatus;
+          return NULL;
         }
-
-      /* force re-openning */
-      pentry->object.file.open_fd.last_op = 0;
-      pentry->object.file.open_fd.fileno = 0;
-
     }
 
-  if((pentry->object.file.open_fd.last_op == 0)
-     || (pentry->object.file.open_fd.fileno == 0))
+  memset(&opened, 0, sizeof(opened));
+
+  /* opened file is not preserved yet */
+  if(pentry_dir == NULL)
     {
-      /* opened file is not preserved yet */
 #ifdef _USE_MFSL
       fsal_status = MFSL_open(&(pentry->mobject),
                               pcontext,
                               &pclient->mfsl_context,
                               openflags,
-                              &pentry->object.file.open_fd.mfsl_fd,
-                              &(pentry->attributes),
+                              &opened.mfsl_fd,
+                              pattr,
                               NULL );
 #else
       fsal_status = FSAL_open(&(pentry->handle),
                               pcontext,
                               openflags,
-                              &pentry->object.file.open_fd.fd,
-                              &(pentry->attributes));
+                              &opened.fd,
+                              pattr);
 #endif
-
-      if(FSAL_IS_ERROR(fsal_status))
+    }
+  else
+    {
+      /* Keep coherency with the cache_content */
+      if(pentry->object.file.pentry_content != NULL)
         {
-          *pstatus = cache_inode_error_convert(fsal_status);
+          save_filesize = pentry->attributes.filesize;
+          save_spaceused = pentry->attributes.spaceused;
+          save_mtime = pentry->attributes.mtime;
+        }
 
-          LogDebug(COMPONENT_CACHE_INODE,
-                   "cache_inode_open: returning %d(%s) from FSAL_open",
-                   *pstatus, cache_inode_err_str(*pstatus));
+#ifdef _USE_MFSL
+      fsal_status = MFSL_open_by_name(&(pentry_dir->mobject),
+                                      pname,
+                                      pcontext,
+                                      &pclient->mfsl_context,
+                                      openflags,
+                                      &opened.mfsl_fd,
+                                      pattr,
+                                      NULL );
+#else
+      fsal_status = FSAL_open_by_name(&(pentry_dir->handle),
+                                      pname,
+                                      pcontext,
+                                      openflags,
+                                      &opened.fd,
+                                      pattr);
+#endif
 
-          return *pstatus;
+      if(!FSAL_IS_ERROR(fsal_status) && pentry->object.file.pentry_content != NULL)
+        {
+          pentry->attributes.filesize = save_filesize;
+          pentry->attributes.spaceused = save_spaceused;
+          pentry->attributes.mtime = save_mtime;
         }
+    }
+
+  if(FSAL_IS_ERROR(fsal_status))
+    {
+      *pstatus = cache_inode_error_convert(fsal_status);
+
+      LogDebug(COMPONENT_CACHE_INODE,
+               "cache_inode_fd_open: returning %d(%s) from FSAL_open",
+               *pstatus, cache_inode_err_str(*pstatus));
+
+      return NULL;
+    }
+
+#ifdef _USE_MFSL
+  opened.fileno = (int)FSAL_FILENO(&(opened.mfsl_fd.fsal_file));
+#else
+  opened.fileno = (int)FSAL_FILENO(&(opened.fd));
+#endif
+  opened.openflags = openflags;
+  opened.pentry = pentry;
+
+  LogFullDebug(COMPONENT_CACHE_INODE,
+               "cache_inode_fd_open: pentry %p: fileno = %d, openflags = %d",
+               pentry, opened.fileno, (int) openflags);
+
+  nb_closed = 0;
+  P(fd_cache_mutex);
 
+  fd_cache_stat.nb_open += 1;
+
+  if(pfd->fileno == 0)
+    {
 #ifdef _USE_MFSL
-      pentry->object.file.open_fd.fileno = FSAL_FILENO(&(pentry->object.file.open_fd.mfsl_fd.fsal_file));
+      pfd->mfsl_fd = opened.mfsl_fd;
 #else
-      pentry->object.file.open_fd.fileno = FSAL_FILENO(&(pentry->object.file.open_fd.fd));
+      pfd->fd = opened.fd;
 #endif
-      pentry->object.file.open_fd.openflags = openflags;
+      pfd->fileno = opened.fileno;
+      pfd->openflags = openflags;
+      glist_add_tail(&fd_cache_lru, &pfd->fd_lru);
+      fd_cache_stat.nb_opened += 1;
+      cache_inode_fd_touch(pfd, pin);
 
-      LogFullDebug(COMPONENT_CACHE_INODE,
-               "cache_inode_open: pentry %p: lastop=0, fileno = %d, openflags = %d",
-               pentry, pentry->object.file.open_fd.fileno, (int) openflags);
+      *pstatus = CACHE_INODE_SUCCESS;
     }
+  else
+    {
+      /* Another worker opened the file meanwhile, its fd is kept */
+      closed[nb_closed++] = opened;
+      fd_cache_stat.nb_close += 1;
+
+      if((pfd->openflags != FSAL_O_RDWR) && (pfd->openflags != openflags))
+        *pstatus = CACHE_INODE_FSAL_DELAY;
+      else
+        {
+          cache_inode_fd_touch(pfd, pin);
+          *pstatus = CACHE_INODE_SUCCESS;
+        }
+    }
+
+  nb_closed += cache_inode_fd_collect(pfd, 0, closed + nb_closed,
+                                      CACHE_INODE_FD_CLOSE_BATCH - nb_closed);
+
+  V(fd_cache_mutex);
+
+  for(i = 0; i < nb_closed; i++)
+    cache_inode_fd_fsal_close(&closed[i], pclient);
 
-  /* regular exit */
-  pentry->object.file.open_fd.last_op = time(NULL);
+  if(*pstatus != CACHE_INODE_SUCCESS)
+    return NULL;
 
-  /* if file descriptor is too high, garbage collect FDs */
-  if(pclient->use_fd_cache
-     && (pentry->object.file.open_fd.fileno > pclient->max_fd))
+#ifdef _USE_PROXY
+  if(pentry_dir != NULL)
     {
-      if(cache_inode_gc_fd(pclient, pstatus) != CACHE_INODE_SUCCESS)
+      /* If proxy if used, we should keep the name of the file to do FSAL_rcp if needed */
+      if(pentry->object.file.pname == NULL &&
+         (pentry->object.file.pname =
+          (fsal_name_t *) Mem_Alloc_Label(sizeof(fsal_name_t), "fsal_name_t")) == NULL)
         {
-          LogCrit(COMPONENT_CACHE_INODE_GC,
-                  "FAILURE performing FD garbage collection");
-          return *pstatus;
+          if(pin)
+            cache_inode_fd_put(pfd, pclient);
+
+          *pstatus = CACHE_INODE_MALLOC_ERROR;
+          return NULL;
         }
+
+      pentry->object.file.pentry_parent_open = pentry_dir;
+      pentry->object.file.pname->len = pname->len;
+      memcpy((char *)(pentry->object.file.pname->name), (char *)(pname->name),
+             FSAL_MAX_NAME_LEN);
     }
+#endif
 
-  *pstatus = CACHE_INODE_SUCCESS;
-  return *pstatus;
+  return pfd;
+}                               /* cache_inode_fd_open */
+
+/**
+ *
+ * cache_inode_open: opens the local fd on  the cache.
+ *
+ * Opens the fd on  the FSAL
+ *
+ * @param pentry    [IN]  entry in file content layer whose content is to be accessed.
+ * @param pclient   [IN]  ressource allocated by the client for the nfs management.
+ * @param openflags [IN]  flags to be used to open the file
+ * @param pcontent  [IN]  FSAL operation context
+ * @pstatus         [OUT] returned status.
+ *
+ * @return CACHE_CONTENT_SUCCESS is successful .
+ *
+ */
+
+cache_inode_status_t cache_inode_open(cache_entry_t * pentry,
+                                      cache_inode_client_t * pclient,
+                                      fsal_openflags_t openflags,
+                                      fsal_op_context_t * pcontext,
+                                      cache_inode_status_t * pstatus)
+{
+  if((pentry == NULL) || (pclient == NULL) || (pcontext == NULL) || (pstatus == NULL))
+    return CACHE_INODE_INVALID_ARGUMENT;
 
+  if(pentry->internal_md.type != REGULAR_FILE)
+    {
+      *pstatus = CACHE_INODE_BAD_TYPE;
+      return *pstatus;
+    }
+
+  cache_inode_fd_open(NULL, NULL, pentry, pclient, openflags, pcontext,
+                      &pentry->attributes, FALSE, pstatus);
+
+  return *pstatus;
 }                               /* cache_inode_open */
 
 /**
  *
- * cache_content_open: opens the local fd on  the cache.
+ * cache_inode_open_by_name: opens the local fd on  the cache.
  *
  * Opens the fd on  the FSAL
  *
@@ -236,14 +515,6 @@ cache_inode_status_t cache_inode_open_by_name(cache_entry_t * pentry_dir,
                                               fsal_op_context_t * pcontext,
                                               cache_inode_status_t * pstatus)
 {
-  fsal_status_t fsal_status;
-  fsal_size_t save_filesize = 0;
-  fsal_size_t save_spaceused = 0;
-  fsal_time_t save_mtime = {
-    .seconds = 0,
-    .nseconds = 0
-  };
-
   if((pentry_dir == NULL) || (pname == NULL) || (pentry_file == NULL) ||
      (pclient == NULL) || (pcontext == NULL) || (pstatus == NULL))
     return CACHE_INODE_INVALID_ARGUMENT;
@@ -260,148 +531,243 @@ cache_inode_status_t cache_inode_open_by_name(cache_entry_t * pentry_dir,
       return *pstatus;
     }
 
-  /* Open file need to be closed, unless it is already open as read/write */
-  if((pentry_file->object.file.open_fd.openflags != FSAL_O_RDWR) &&
-     (pentry_file->object.file.open_fd.openflags != 0) &&
-     (pentry_file->object.file.open_fd.fileno != 0) &&
-     (pentry_file->object.file.open_fd.openflags != openflags))
+  cache_inode_fd_open(pentry_dir, pname, pentry_file, pclient, openflags, pcontext,
+                      &pentry_file->attributes, FALSE, pstatus);
+
+  return *pstatus;
+}                               /* cache_inode_open_by_name */
+
+/**
+ *
+ * cache_inode_fd_get: gets an fd to do I/O on a file.
+ *
+ * Gets the fd kept for the file, opening it if needed. The fd is pinned: it
+ * stays open until released with cache_inode_fd_put, whatever the other
+ * workers do with the file. The attributes of the entry are not updated,
+ * the entry may be locked for reading only.
+ *
+ * @param pentry    [IN]  the file
+ * @param pclient   [IN]  ressource allocated by the client for the nfs management.
+ * @param openflags [IN]  flags to be used to open the file
+ * @param pcontext  [IN]  FSAL operation context
+ * @param pstatus   [OUT] returned status.
+ *
+ * @return the fd, NULL if the file could not be opened.
+ *
+ */
+cache_inode_opened_file_t *cache_inode_fd_get(cache_entry_t * pentry,
+                                              cache_inode_client_t * pclient,
+                                              fsal_openflags_t openflags,
+                                              fsal_op_context_t * pcontext,
+                                              cache_inode_status_t * pstatus)
+{
+  if(pentry->internal_md.type != REGULAR_FILE)
     {
-#ifdef _USE_MFSL
-      fsal_status =
-          MFSL_close(&(pentry_file->object.file.open_fd.mfsl_fd), &pclient->mfsl_context, NULL);
-#else
-      fsal_status = FSAL_close(&(pentry_file->object.file.open_fd.fd));
-#endif
-      if(FSAL_IS_ERROR(fsal_status) && (fsal_status.major != ERR_FSAL_NOT_OPENED))
-        {
-          *pstatus = cache_inode_error_convert(fsal_status);
+      *pstatus = CACHE_INODE_BAD_TYPE;
+      return NULL;
+    }
 
-          LogDebug(COMPONENT_CACHE_INODE,
-                   "cache_inode_open_by_name: returning %d(%s) from FSAL_close",
-                   *pstatus, cache_inode_err_str(*pstatus));
+  return cache_inode_fd_open(NULL, NULL, pentry, pclient, openflags, pcontext, NULL,
+                             TRUE, pstatus);
+}                               /* cache_inode_fd_get */
 
-          return *pstatus;
-        }
+/**
+ *
+ * cache_inode_fd_pin: pins the fd open on a file, if any.
+ *
+ * Pins the fd open for writes if any, the fd open for reads otherwise. The
+ * fd is to be released with cache_inode_fd_put.
+ *
+ * @param pentry [IN] the file
+ *
+ * @return the fd, NULL if the file is not open.
+ *
+ */
+cache_inode_opened_file_t *cache_inode_fd_pin(cache_entry_t * pentry)
+{
+  cache_inode_opened_file_t *pfd = NULL;
 
-      pentry_file->object.file.open_fd.last_op = 0;
-      pentry_file->object.file.open_fd.fileno = 0;
-    }
+  if(pentry == NULL || pentry->internal_md.type != REGULAR_FILE)
+    return NULL;
 
-  if(pentry_file->object.file.open_fd.last_op == 0
-     || pentry_file->object.file.open_fd.fileno == 0)
-    {
-      LogFullDebug(COMPONENT_FSAL,
-               "cache_inode_open_by_name: pentry %p: lastop=0", pentry_file);
+  P(fd_cache_mutex);
 
-      /* Keep coherency with the cache_content */
-      if(pentry_file->object.file.pentry_content != NULL)
-        {
-          save_filesize = pentry_file->attributes.filesize;
-          save_spaceused = pentry_file->attributes.spaceused;
-          save_mtime = pentry_file->attributes.mtime;
-        }
+  if(pentry->object.file.open_fd.fileno != 0)
+    pfd = &pentry->object.file.open_fd;
+  else if(pentry->object.file.read_fd.fileno != 0)
+    pfd = &pentry->object.file.read_fd;
 
-      /* opened file is not preserved yet */
-#ifdef _USE_MFSL
-      fsal_status = MFSL_open_by_name(&(pentry_dir->mobject),
-                                      pname,
-                                      pcontext,
-                                      &pclient->mfsl_context,
-                                      openflags,
-                                      &pentry_file->object.file.open_fd.mfsl_fd,
-                                      &(pentry_file->attributes),
-                                      NULL );
+  if(pfd != NULL)
+    pfd->refcount += 1;
 
-#else
-      fsal_status = FSAL_open_by_name(&(pentry_dir->handle),
-                                      pname,
-                                      pcontext,
-                                      openflags,
-                                      &pentry_file->object.file.open_fd.fd,
-                                      &(pentry_file->attributes));
-#endif
+  V(fd_cache_mutex);
 
-      if(FSAL_IS_ERROR(fsal_status))
-        {
-          *pstatus = cache_inode_error_convert(fsal_status);
+  return pfd;
+}                               /* cache_inode_fd_pin */
 
-          LogDebug(COMPONENT_CACHE_INODE,
-                   "cache_inode_open_by_name: returning %d(%s) from FSAL_open_by_name",
-                   *pstatus, cache_inode_err_str(*pstatus));
+/* Releases a pinned fd, closing it if discard is set and nobody else uses it */
+static void cache_inode_fd_release(cache_inode_opened_file_t * pfd,
+                                   cache_inode_client_t * pclient, int discard)
+{
+  cache_inode_opened_file_t closed;
+  int close_it = FALSE;
 
-          return *pstatus;
-        }
+  P(fd_cache_mutex);
 
-#ifdef _USE_PROXY
+  pfd->refcount -= 1;
 
-      /* If proxy if used, we should keep the name of the file to do FSAL_rcp if needed */
-      if((pentry_file->object.file.pname =
-          (fsal_name_t *) Mem_Alloc_Label(sizeof(fsal_name_t), "fsal_name_t")) == NULL)
-        {
-          *pstatus = CACHE_INODE_MALLOC_ERROR;
+  if(discard && pfd->refcount == 0 && pfd->fileno != 0)
+    {
+      cache_inode_fd_detach(pfd, &closed);
+      close_it = TRUE;
+    }
 
-          return *pstatus;
-        }
+  V(fd_cache_mutex);
 
-      pentry_file->object.file.pentry_parent_open = pentry_dir;
-      pentry_file->object.file.pname->len = pname->len;
-      memcpy((char *)(pentry_file->object.file.pname->name), (char *)(pname->name),
-             FSAL_MAX_NAME_LEN);
+  if(close_it)
+    cache_inode_fd_fsal_close(&closed, pclient);
+}                               /* cache_inode_fd_release */
 
-#endif
+/**
+ *
+ * cache_inode_fd_put: releases an fd got with cache_inode_fd_get or cache_inode_fd_pin.
+ *
+ * @param pfd     [IN] the fd
+ * @param pclient [IN] ressource allocated by the client for the nfs management.
+ *
+ */
+void cache_inode_fd_put(cache_inode_opened_file_t * pfd, cache_inode_client_t * pclient)
+{
+  cache_inode_fd_release(pfd, pclient, FALSE);
+}                               /* cache_inode_fd_put */
 
-      /* Keep coherency with the cache_content */
-      if(pentry_file->object.file.pentry_content != NULL)
-        {
-          pentry_file->attributes.filesize = save_filesize;
-          pentry_file->attributes.spaceused = save_spaceused;
-          pentry_file->attributes.mtime = save_mtime;
-        }
+/**
+ *
+ * cache_inode_fd_discard: releases an fd found unusable.
+ *
+ * Releases an fd an I/O failed on. It is closed when no other I/O uses it,
+ * the next I/O opens the file again.
+ *
+ * @param pfd     [IN] the fd
+ * @param pclient [IN] ressource allocated by the client for the nfs management.
+ *
+ */
+void cache_inode_fd_discard(cache_inode_opened_file_t * pfd,
+                            cache_inode_client_t * pclient)
+{
+  cache_inode_fd_release(pfd, pclient, TRUE);
+}                               /* cache_inode_fd_discard */
 
-#ifdef _USE_MFSL
-      pentry_file->object.file.open_fd.fileno =
-          (int)FSAL_FILENO(&(pentry_file->object.file.open_fd.mfsl_fd.fsal_file));
-#else
-      pentry_file->object.file.open_fd.fileno =
-          (int)FSAL_FILENO(&(pentry_file->object.file.open_fd.fd));
-#endif
-      pentry_file->object.file.open_fd.last_op = time(NULL);
-      pentry_file->object.file.open_fd.openflags = openflags;
+/**
+ *
+ * cache_inode_forget_fds: closes the fds of an entry about to be freed.
+ *
+ * Must be called with the entry locked for writing: no I/O is in progress.
+ *
+ * @param pentry  [IN] the file
+ * @param pclient [IN] ressource allocated by the client for the nfs management.
+ *
+ */
+void cache_inode_forget_fds(cache_entry_t * pentry, cache_inode_client_t * pclient)
+{
+  cache_inode_opened_file_t closed[2];
+  cache_inode_opened_file_t *pfds[2];
+  unsigned int nb_closed = 0;
+  unsigned int i;
+
+  if(pentry->internal_md.type != REGULAR_FILE)
+    return;
+
+  pfds[0] = &pentry->object.file.open_fd;
+  pfds[1] = &pentry->object.file.read_fd;
+
+  P(fd_cache_mutex);
 
-      LogFullDebug(COMPONENT_FSAL,
-               "cache_inode_open_by_name: pentry %p: fd=%u",
-               pentry_file, pentry_file->object.file.open_fd.fileno);
+  for(i = 0; i < 2; i++)
+    {
+      if(pfds[i]->refcount != 0)
+        LogCrit(COMPONENT_CACHE_INODE,
+                "cache_inode_forget_fds: pentry %p freed with %u I/O in progress",
+                pentry, pfds[i]->refcount);
 
+      if(pfds[i]->fileno != 0)
+        cache_inode_fd_detach(pfds[i], &closed[nb_closed++]);
     }
 
-  /* regular exit */
-  pentry_file->object.file.open_fd.last_op = time(NULL);
+  V(fd_cache_mutex);
+
+  for(i = 0; i < nb_closed; i++)
+    cache_inode_fd_fsal_close(&closed[i], pclient);
+}                               /* cache_inode_forget_fds */
+
+/**
+ *
+ * cache_inode_close_idle_fds: closes the fds unused for longer than the retention.
+ *
+ * @param pclient [IN] ressource allocated by the client for the nfs management.
+ *
+ * @return the number of fds closed.
+ *
+ */
+unsigned int cache_inode_close_idle_fds(cache_inode_client_t * pclient)
+{
+  cache_inode_opened_file_t closed[CACHE_INODE_FD_CLOSE_BATCH];
+  unsigned int nb_closed;
+  unsigned int total = 0;
+  unsigned int i;
 
-  /* if file descriptor is too high, garbage collect FDs */
-  if(pclient->use_fd_cache
-     && (pentry_file->object.file.open_fd.fileno > pclient->max_fd))
+  do
     {
-      if(cache_inode_gc_fd(pclient, pstatus) != CACHE_INODE_SUCCESS)
-        {
-          LogCrit(COMPONENT_CACHE_INODE_GC,
-                  "FAILURE performing FD garbage collection");
-          return *pstatus;
-        }
+      P(fd_cache_mutex);
+      nb_closed = cache_inode_fd_collect(NULL, time(NULL) - pclient->retention, closed,
+                                         CACHE_INODE_FD_CLOSE_BATCH);
+      V(fd_cache_mutex);
+
+      for(i = 0; i < nb_closed; i++)
+        cache_inode_fd_fsal_close(&closed[i], pclient);
+
+      total += nb_closed;
     }
+  while(nb_closed == CACHE_INODE_FD_CLOSE_BATCH);
 
-  *pstatus = CACHE_INODE_SUCCESS;
-  return *pstatus;
+  return total;
+}                               /* cache_inode_close_idle_fds */
 
-}                               /* cache_inode_open_by_name */
+/**
+ *
+ * cache_inode_set_fd_cache_budget: sets the most fds kept open.
+ *
+ * @param max_opened [IN] the budget, for all the workers
+ *
+ */
+void cache_inode_set_fd_cache_budget(unsigned int max_opened)
+{
+  P(fd_cache_mutex);
+  fd_cache_stat.max_opened = max_opened;
+  V(fd_cache_mutex);
+}                               /* cache_inode_set_fd_cache_budget */
 
 /**
  *
- * cache_inode_close: closes the local fd in the FSAL.
+ * cache_inode_get_fd_cache_stats: gets the open and close counters.
  *
- * Closes the local fd in the FSAL.
+ * @param pstat [OUT] the counters
  *
- * No lock management is done in this layer: the related pentry in the cache inode layer is
- * locked and will prevent from concurent accesses.
+ */
+void cache_inode_get_fd_cache_stats(cache_inode_fd_stat_t * pstat)
+{
+  P(fd_cache_mutex);
+  *pstat = fd_cache_stat;
+  V(fd_cache_mutex);
+}                               /* cache_inode_get_fd_cache_stats */
+
+/**
+ *
+ * cache_inode_close: closes the local fd in the FSAL.
+ *
+ * Closes the fds of the file nobody uses, if the fds are not cached or have
+ * not been used for longer than the retention. The fds of a file holding
+ * locks or states are kept.
  *
  * @param pentry  [IN] entry in file content layer whose content is to be accessed.
  * @param pclient [IN]  ressource allocated by the client for the nfs management.
@@ -414,7 +780,12 @@ cache_inode_status_t cache_inode_close(cache_entry_t * pentry,
                                        cache_inode_client_t * pclient,
                                        cache_inode_status_t * pstatus)
 {
+  cache_inode_opened_file_t closed[2];
+  cache_inode_opened_file_t *pfds[2];
+  unsigned int nb_closed = 0;
+  unsigned int i;
   fsal_status_t fsal_status;
+  time_t now = time(NULL);
 
   if((pentry == NULL) || (pclient == NULL) || (pstatus == NULL))
     return CACHE_CONTENT_INVALID_ARGUMENT;
@@ -425,13 +796,6 @@ cache_inode_status_t cache_inode_close(cache_entry_t * pentry,
       return *pstatus;
     }
 
-  /* if nothing is opened, do nothing */
-  if(pentry->object.file.open_fd.fileno < 0)
-    {
-      *pstatus = CACHE_INODE_SUCCESS;
-      return *pstatus;
-    }
-
   /* if locks are held in the file, do not close */
   if( cache_inode_file_holds_state( pentry ) )
     {
@@ -439,24 +803,23 @@ cache_inode_status_t cache_inode_close(cache_entry_t * pentry,
       return *pstatus;
     }
 
-  if((pclient->use_fd_cache == 0) ||
-     (time(NULL) - pentry->object.file.open_fd.last_op > pclient->retention) ||
-     (pentry->object.file.open_fd.fileno > (int)(pclient->max_fd)))
-    {
+  pfds[0] = &pentry->object.file.open_fd;
+  pfds[1] = &pentry->object.file.read_fd;
 
-      LogFullDebug(COMPONENT_CACHE_INODE,
-               "cache_inode_close: pentry %p, fileno = %d, lastop=%d ago",
-               pentry, pentry->object.file.open_fd.fileno,
-               (int)(time(NULL) - pentry->object.file.open_fd.last_op));
+  P(fd_cache_mutex);
 
-#ifdef _USE_MFSL
-      fsal_status = MFSL_close(&(pentry->object.file.open_fd.mfsl_fd), &pclient->mfsl_context, NULL);
-#else
-      fsal_status = FSAL_close(&(pentry->object.file.open_fd.fd));
-#endif
+  for(i = 0; i < 2; i++)
+    if((pfds[i]->fileno != 0) && (pfds[i]->refcount == 0) &&
+       ((pclient->use_fd_cache == 0) || (now - pfds[i]->last_op > pclient->retention)))
+      cache_inode_fd_detach(pfds[i], &closed[nb_closed++]);
+
+  V(fd_cache_mutex);
+
+  *pstatus = CACHE_INODE_SUCCESS;
 
-      pentry->object.file.open_fd.fileno = 0;
-      pentry->object.file.open_fd.last_op = 0;
+  for(i = 0; i < nb_closed; i++)
+    {
+      fsal_status = cache_inode_fd_fsal_close(&closed[i], pclient);
 
       if(FSAL_IS_ERROR(fsal_status) && (fsal_status.major != ERR_FSAL_NOT_OPENED))
         {
@@ -465,10 +828,12 @@ cache_inode_status_t cache_inode_close(cache_entry_t * pentry,
           LogDebug(COMPONENT_CACHE_INODE,
                    "cache_inode_close: returning %d(%s) from FSAL_close",
                    *pstatus, cache_inode_err_str(*pstatus));
-
-          return *pstatus;
         }
     }
+
+  if(*pstatus != CACHE_INODE_SUCCESS)
+    return *pstatus;
+
 #ifdef _USE_PROXY
   /* If proxy if used, free the name if needed */
   if(pentry->object.file.pname != NULL)
@@ -479,7 +844,5 @@ cache_inode_status_t cache_inode_close(cache_entry_t * pentry,
   pentry->object.file.pentry_parent_open = NULL;
 #endif
 
-  *pstatus = CACHE_CONTENT_SUCCESS;
-
   return *pstatus;
 }                               /* cache_content_close */
@@ -60,11 +60,290 @@
 #include <time.h>
 #include <pthread.h>
 
+
+/* Do two I/O ranges have to be serialized ? */
+static int cache_inode_io_range_conflict(cache_inode_io_range_t * prange1,
+                                         cache_inode_io_range_t * prange2)
+{
+  if(prange1->direction == CACHE_INODE_READ && prange2->direction == CACHE_INODE_READ)
+    return FALSE;
+
+  return (prange1->offset < prange2->offset + prange2->length) &&
+      (prange2->offset < prange1->offset + prange1->length);
+}                               /* cache_inode_io_range_conflict */
+
+/**
+ *
+ * cache_inode_io_range_lock: waits for the I/O overlapping a range to be done.
+ *
+ * Records an I/O in progress on a range of the file, once the overlapping
+ * writes are done, or the overlapping reads and writes if this is a write.
+ * The I/O on disjoint ranges go on concurrently. The entry must be locked
+ * (for reading at least), the range is released with
+ * cache_inode_io_range_unlock.
+ *
+ * @param pentry    [IN]  the file
+ * @param prange    [OUT] the range, kept by the caller until released
+ * @param direction [IN]  CACHE_INODE_READ or CACHE_INODE_WRITE
+ * @param offset    [IN]  first byte of the I/O
+ * @param length    [IN]  bytes read or written
+ *
+ */
+void cache_inode_io_range_lock(cache_entry_t * pentry,
+                               cache_inode_io_range_t * prange,
+                               cache_inode_io_direction_t direction,
+                               uint64_t offset, uint64_t length)
+{
+  struct glist_head *glist;
+  int conflict;
+
+  prange->direction = direction;
+  prange->offset = offset;
+  prange->length = length;
+
+  P(pentry->object.file.io_mutex);
+
+  do
+    {
+      conflict = FALSE;
+
+      glist_for_each(glist, &pentry->object.file.io_ranges)
+        if(cache_inode_io_range_conflict(prange,
+                                         glist_entry(glist, cache_inode_io_range_t,
+                                                     io_list)))
+          {
+            conflict = TRUE;
+            break;
+          }
+
+      if(conflict)
+        {
+          pentry->object.file.io_waiters += 1;
+          pthread_cond_wait(&pentry->object.file.io_cond, &pentry->object.file.io_mutex);
+          pentry->object.file.io_waiters -= 1;
+        }
+    }
+  while(conflict);
+
+  glist_add_tail(&pentry->object.file.io_ranges, &prange->io_list);
+
+  V(pentry->object.file.io_mutex);
+}                               /* cache_inode_io_range_lock */
+
+/**
+ *
+ * cache_inode_io_range_unlock: releases a range got with cache_inode_io_range_lock.
+ *
+ * @param pentry [IN] the file
+ * @param prange [IN] the range
+ *
+ */
+void cache_inode_io_range_unlock(cache_entry_t * pentry, cache_inode_io_range_t * prange)
+{
+  P(pentry->object.file.io_mutex);
+
+  glist_del(&prange->io_list);
+
+  if(pentry->object.file.io_waiters != 0)
+    pthread_cond_broadcast(&pentry->object.file.io_cond);
+
+  V(pentry->object.file.io_mutex);
+}                               /* cache_inode_io_range_unlock */
+
+/**
+ *
+ * cache_inode_rdwr_fsal: Reads/Writes directly in the FSAL.
+ *
+ * Does the I/O on the fd kept for the file, within an I/O range, then
+ * updates the size and the times of the entry under its io_mutex. The entry
+ * must be locked, for reading at least: the I/O on the same file run
+ * concurrently.
+ *
+ * @param pentry [IN] entry in cache inode layer whose content is to be accessed.
+ * @param read_or_write [IN] CACHE_INODE_READ or CACHE_INODE_WRITE.
+ * @param seek_descriptor [IN] absolute position (in the FSAL file) where the IO will be done.
+ * @param io_size [IN] size of the buffer pointed by parameter 'buffer'.
+ * @param pio_size [OUT] the size of the io that was successfully made.
+ * @param buffer write:[IN] read:[OUT] the buffer for the data.
+ * @param p_fsal_eof [OUT] end of file reached by the read.
+ * @param pclient [IN]  ressource allocated by the client for the nfs management.
+ * @param pcontext [IN] fsal context for the operation.
+ * @pstatus [OUT] returned status.
+ *
+ * @return CACHE_INODE_SUCCESS is successful .
+ *
+ */
+static cache_inode_status_t cache_inode_rdwr_fsal(cache_entry_t * pentry,
+                                                  cache_inode_io_direction_t read_or_write,
+                                                  fsal_seek_t * seek_descriptor,
+                                                  fsal_size_t io_size,
+                                                  fsal_size_t * pio_size,
+                                                  caddr_t buffer,
+                                                  fsal_boolean_t * p_fsal_eof,
+                                                  cache_inode_client_t * pclient,
+                                                  fsal_op_context_t * pcontext,
+                                                  cache_inode_status_t * pstatus)
+{
+  fsal_status_t fsal_status;
+  fsal_openflags_t openflags;
+  cache_inode_opened_file_t *pfd;
+  cache_inode_io_range_t range;
+  fsal_attrib_list_t post_write_attr;
+  fsal_status_t fsal_status_getattr;
+
+  openflags = (read_or_write == CACHE_INODE_READ) ? FSAL_O_RDONLY : FSAL_O_WRONLY;
+
+  /* The unstable writes of the range kept in memory come first */
+  if(cache_inode_dirty_flush(pentry, seek_descriptor->offset, io_size,
+                             pclient, pstatus) != CACHE_INODE_SUCCESS)
+    return *pstatus;
+
+  cache_inode_io_range_lock(pentry, &range, read_or_write, seek_descriptor->offset,
+                            io_size);
+
+  /* We need to open if we don't have a cached
+   * descriptor or our open flags differs. The fd stays open
+   * until the I/O is done.
+   */
+  if((pfd = cache_inode_fd_get(pentry,
+                               pclient, openflags, pcontext, pstatus)) == NULL)
+    {
+      cache_inode_io_range_unlock(pentry, &range);
+      return *pstatus;
+    }
+
+  /* Call FSAL_read or FSAL_write */
+
+  if(read_or_write == CACHE_INODE_READ)
+    {
+#ifdef _USE_MFSL
+      fsal_status = MFSL_read(&(pfd->mfsl_fd),
+                              seek_descriptor,
+                              io_size,
+                              buffer,
+                              pio_size, p_fsal_eof, &pclient->mfsl_context, NULL);
+#else
+      fsal_status = FSAL_read(&(pfd->fd),
+                              seek_descriptor, io_size, buffer, pio_size, p_fsal_eof);
+#endif
+    }
+  else
+    {
+#ifdef _USE_MFSL
+      fsal_status = MFSL_write(&(pfd->mfsl_fd),
+                               seek_descriptor,
+                               io_size, buffer, pio_size, &pclient->mfsl_context, NULL);
+#else
+      fsal_status = FSAL_write(&(pfd->fd), seek_descriptor, io_size, buffer, pio_size);
+#endif
+    }
+
+  LogFullDebug(COMPONENT_FSAL,
+               "cache_inode_rdwr: FSAL IO operation returned %d, asked_size=%llu, effective_size=%llu",
+               fsal_status.major, (unsigned long long)io_size,
+               (unsigned long long)*pio_size);
+
+  if(FSAL_IS_ERROR(fsal_status))
+    {
+      if(fsal_status.major == ERR_FSAL_DELAY)
+        LogEvent(COMPONENT_CACHE_INODE, "cache_inode_rdwr: FSAL_write returned EBUSY");
+      else
+        LogDebug(COMPONENT_CACHE_INODE,
+                 "cache_inode_rdwr: fsal_status.major = %d", fsal_status.major);
+
+      if(fsal_status.major != ERR_FSAL_NOT_OPENED)
+        {
+          LogDebug(COMPONENT_CACHE_INODE,
+                   "cache_inode_rdwr: CLOSING pentry %p: fd=%d", pentry, pfd->fileno);
+
+          *pstatus = cache_inode_error_convert(fsal_status);
+        }
+      else
+        {
+          /* the fd has been close by another thread.
+           * return CACHE_INODE_FSAL_DELAY so the client will
+           * retry with a new fd.
+           */
+          *pstatus = CACHE_INODE_FSAL_DELAY;
+        }
+
+      /* The next I/O opens the file again */
+      cache_inode_fd_discard(pfd, pclient);
+      cache_inode_io_range_unlock(pentry, &range);
+
+      return *pstatus;
+    }
+
+  cache_inode_fd_put(pfd, pclient);
+  cache_inode_io_range_unlock(pentry, &range);
+
+  LogFullDebug(COMPONENT_CACHE_INODE,
+               "cache_inode_rdwr: inode/direct: io_size=%llu, pio_size=%llu, eof=%d, seek=%d.%"PRIu64,
+               io_size, *pio_size, *p_fsal_eof, seek_descriptor->whence,
+               seek_descriptor->offset);
+
+  P(pentry->object.file.io_mutex);
+  cache_inode_close(pentry, pclient, pstatus);
+  V(pentry->object.file.io_mutex);
+
+  if(*pstatus != CACHE_INODE_SUCCESS)
+    {
+      LogEvent(COMPONENT_CACHE_INODE, "cache_inode_rdwr: cache_inode_close = %d", *pstatus);
+      return *pstatus;
+    }
+
+  if(read_or_write == CACHE_INODE_WRITE)
+    {
+      /* Do a getattr in order to have update information on filesize
+       * This query is done directly on FSAL (object is not data cached), and result
+       * will be propagated to cache Inode */
+
+      /* WARNING: This operation is to be done AFTER FSAL_close (some FSAL, like POSIX,
+       * may not flush data until the file is closed */
+
+      post_write_attr.asked_attributes = FSAL_ATTR_SIZE | FSAL_ATTR_SPACEUSED;
+      fsal_status_getattr = FSAL_getattrs(&(pentry->handle), pcontext, &post_write_attr);
+
+      P(pentry->object.file.io_mutex);
+
+      /* The size is only truncated with the entry locked for writing: the size got
+       * by a concurrent write that completed earlier may be the smaller one */
+      if(!FSAL_IS_ERROR(fsal_status_getattr) &&
+         post_write_attr.filesize >= pentry->attributes.filesize)
+        {
+          pentry->attributes.filesize = post_write_attr.filesize;
+          pentry->attributes.spaceused = post_write_attr.spaceused;
+        }
+
+      /* Set mtime and ctime */
+      cache_inode_set_time_current(&pentry->attributes.mtime);
+
+      /* BUGAZOMEU : write operation must NOT modify file's ctime */
+      pentry->attributes.ctime = pentry->attributes.mtime;
+
+      V(pentry->object.file.io_mutex);
+    }
+  else
+    {
+      /* Set the atime */
+      P(pentry->object.file.io_mutex);
+      cache_inode_set_time_current(&pentry->attributes.atime);
+      V(pentry->object.file.io_mutex);
+    }
+
+  *pstatus = CACHE_INODE_SUCCESS;
+  return *pstatus;
+}                               /* cache_inode_rdwr_fsal */
+
 /**
  *
  * cache_inode_rdwr: Reads/Writes through the cache layer.
  *
- * Reads/Writes through the cache layer.
+ * Reads/Writes through the cache layer. The I/O done directly in the FSAL,
+ * and the unstable writes kept in memory, only lock the entry for reading:
+ * the reads and the writes on the same file run concurrently, serialized by
+ * range when they overlap. The I/O on data cached files lock the entry for
+ * writing.
  *
  * @param pentry [IN] entry in cache inode layer whose content is to be accessed.
  * @param read_or_write [IN] a flag of type cache_content_io_direction_t to tell if a read or write is to be done.
@@ -96,17 +375,14 @@ cache_inode_status_t cache_inode_rdwr(cache_entry_t * pentry,
                                       hash_table_t * ht,
                                       cache_inode_client_t * pclient,
                                       fsal_op_context_t * pcontext,
-                                      uint64_t stable, 
+                                      uint64_t stable,
 				      cache_inode_status_t * pstatus)
 {
   int statindex = 0;
   cache_content_io_direction_t io_direction;
   cache_content_status_t cache_content_status;
-  fsal_status_t fsal_status;
-  fsal_openflags_t openflags;
+  cache_inode_op_t valid_op;
   fsal_size_t io_size;
-  fsal_attrib_list_t post_write_attr;
-  fsal_status_t fsal_status_getattr;
   struct stat buffstat;
 
   /* Set the return default to CACHE_INODE_SUCCESS */
@@ -133,17 +409,61 @@ cache_inode_status_t cache_inode_rdwr(cache_entry_t * pentry,
     {
       statindex = CACHE_INODE_READ_DATA;
       io_direction = CACHE_CONTENT_READ;
-      openflags = FSAL_O_RDONLY;
+      valid_op = CACHE_INODE_OP_GET;
       pclient->stat.func_stats.nb_call[CACHE_INODE_READ_DATA] += 1;
     }
   else
     {
       statindex = CACHE_INODE_WRITE_DATA;
       io_direction = CACHE_CONTENT_WRITE;
-      openflags = FSAL_O_WRONLY;
+      valid_op = CACHE_INODE_OP_SET;
       pclient->stat.func_stats.nb_call[CACHE_INODE_WRITE_DATA] += 1;
     }
 
+  /* Reads and writes going straight to the FSAL, or kept in memory, share the entry lock */
+  P_r(&pentry->lock);
+
+  if(pentry->internal_md.type == REGULAR_FILE &&
+     pentry->object.file.pentry_content == NULL)
+    {
+      if(read_or_write == CACHE_INODE_WRITE &&
+         stable == FSAL_UNSAFE_WRITE_TO_GANESHA_BUFFER)
+        {
+          /* Kept in the dirty extents of the file, written behind */
+          if(cache_inode_dirty_write(pentry, seek_descriptor->offset, io_size, buffer,
+                                     pclient, pcontext, pstatus) == CACHE_INODE_SUCCESS)
+            *pio_size = io_size;
+        }
+      else
+        cache_inode_rdwr_fsal(pentry, read_or_write, seek_descriptor, io_size,
+                              pio_size, buffer, p_fsal_eof, pclient, pcontext, pstatus);
+
+      if(*pstatus == CACHE_INODE_SUCCESS)
+        {
+          P(pentry->object.file.io_mutex);
+
+          /* Return attributes to caller */
+          if(pfsal_attr != NULL)
+            *pfsal_attr = pentry->attributes;
+
+          *pstatus = cache_inode_valid(pentry, valid_op, pclient);
+
+          V(pentry->object.file.io_mutex);
+        }
+
+      V_r(&pentry->lock);
+
+      /* stats */
+      if(*pstatus != CACHE_INODE_SUCCESS)
+        pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
+      else
+        pclient->stat.func_stats.nb_success[statindex] += 1;
+
+      return *pstatus;
+    }
+
+  V_r(&pentry->lock);
+
   P_w(&pentry->lock);
 
   /* IO are done only on REGULAR_FILEs */
@@ -170,66 +490,10 @@ cache_inode_status_t cache_inode_rdwr(cache_entry_t * pentry,
       return *pstatus;
     }
 
-  /* Do we use stable or unstable storage ? */
+  /* Data cached files keep no unstable writes, they go through the data cache */
   if(stable == FSAL_UNSAFE_WRITE_TO_GANESHA_BUFFER)
-    {
-      /* Data will be stored in memory and not flush to FSAL */
+    stable = FSAL_SAFE_WRITE_TO_FS;
 
-      /* If the unstable_data buffer allocated ? */
-      if(pentry->object.file.unstable_data.buffer == NULL)
-        {
-          if((pentry->object.file.unstable_data.buffer =
-              Mem_Alloc_Label(CACHE_INODE_UNSTABLE_BUFFERSIZE,
-                              "Cache_Inode Unstable Buffer")) == NULL)
-            {
-              *pstatus = CACHE_INODE_MALLOC_ERROR;
-              V_w(&pentry->lock);
-
-              /* stats */
-              pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
-
-              return *pstatus;
-            }
-
-          pentry->object.file.unstable_data.offset = seek_descriptor->offset;
-          pentry->object.file.unstable_data.length = buffer_size;
-
-          memcpy(pentry->object.file.unstable_data.buffer, buffer, buffer_size);
-
-          /* Set mtime and ctime */
-          cache_inode_set_time_current( &pentry->attributes.mtime ) ;  
-
-          /* BUGAZOMEU : write operation must NOT modify file's ctime */
-          pentry->attributes.ctime = pentry->attributes.mtime;
-
-          *pio_size = buffer_size;
-        }                       /* if( pentry->object.file.unstable_data.buffer == NULL ) */
-      else
-        {
-          if((pentry->object.file.unstable_data.offset < seek_descriptor->offset) &&
-             (buffer_size + seek_descriptor->offset < CACHE_INODE_UNSTABLE_BUFFERSIZE))
-            {
-              pentry->object.file.unstable_data.length =
-                  buffer_size + seek_descriptor->offset;
-              memcpy((char *)(pentry->object.file.unstable_data.buffer +
-                              seek_descriptor->offset), buffer, buffer_size);
-
-              /* Set mtime and ctime */
-              cache_inode_set_time_current( &pentry->attributes.mtime ) ;
-
-              /* BUGAZOMEU : write operation must NOT modify file's ctime */
-              pentry->attributes.ctime = pentry->attributes.mtime;
-
-              *pio_size = buffer_size;
-            }
-          else
-            {
-              /* Go back to regular situation */
-              stable = FSAL_SAFE_WRITE_TO_FS;
-            }
-        }
-
-    }
   /* if( stable == FALSE ) */
   if(stable == FSAL_SAFE_WRITE_TO_FS ||
      stable == FSAL_UNSAFE_WRITE_TO_FS_BUFFER)
@@ -321,183 +585,35 @@ cache_inode_status_t cache_inode_rdwr(cache_entry_t * pentry,
           pentry->attributes.spaceused =
               buffstat.st_blksize * buffstat.st_blocks;
 
-        }
-      else
-        {
-          /* No data cache entry, we operated directly on FSAL */
-          pentry->attributes.asked_attributes = pclient->attrmask;
-
-          /* We need to open if we don't have a cached
-           * descriptor or our open flags differs.
-           */
-          if(cache_inode_open(pentry,
-                              pclient,
-                              openflags, pcontext, pstatus) != CACHE_INODE_SUCCESS)
-            {
-              V_w(&pentry->lock);
-
-              /* stats */
-              pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
-
-              return *pstatus;
-            }
-
-          /* Call FSAL_read or FSAL_write */
-
-          if(read_or_write == CACHE_INODE_READ)
-            {
-#ifdef _USE_MFSL
-              fsal_status = MFSL_read(&(pentry->object.file.open_fd.mfsl_fd),
-                                      seek_descriptor,
-                                      io_size,
-                                      buffer,
-                                      pio_size, p_fsal_eof, &pclient->mfsl_context, NULL);
-#else
-              fsal_status = FSAL_read(&(pentry->object.file.open_fd.fd),
-                                      seek_descriptor,
-                                      io_size, buffer, pio_size, p_fsal_eof);
-#endif
-            }
-          else
-            {
-#ifdef _USE_MFSL
-              fsal_status = MFSL_write(&(pentry->object.file.open_fd.mfsl_fd),
-                                       seek_descriptor,
-                                       io_size, buffer, pio_size, &pclient->mfsl_context, NULL);
-#else
-              fsal_status = FSAL_write(&(pentry->object.file.open_fd.fd),
-                                       seek_descriptor, io_size, buffer, pio_size);
-#endif
-
-#if 0
-              /* Alright, the unstable write is complete. Now if it was supposed to be a stable write
-               * we can sync to the hard drive. */
-              if(stable == FSAL_SAFE_WRITE_TO_FS)
-                {
-#ifdef _USE_MFSL
-                  fsal_status = MFSL_commit(&(pentry->object.file.open_fd.mfsl_fd), NULL);
-#else
-                  fsal_status = FSAL_commit(&(pentry->object.file.open_fd.fd));
-#endif
-#endif
-
-            }
-
-          LogFullDebug(COMPONENT_FSAL,
-                       "cache_inode_rdwr: FSAL IO operation returned %d, asked_size=%llu, effective_size=%llu",
-                       fsal_status.major, (unsigned long long)io_size,
-                       (unsigned long long)*pio_size);
-
-          if(FSAL_IS_ERROR(fsal_status))
+          /* IO was successfull, we manually update the times in the attributes */
+          switch (read_or_write)
             {
+            case CACHE_INODE_READ:
+              /* Set the atime */
+              cache_inode_set_time_current( & pentry->attributes.atime ) ;
+              break;
 
-              if(fsal_status.major == ERR_FSAL_DELAY)
-                LogEvent(COMPONENT_CACHE_INODE,
-                         "cache_inode_rdwr: FSAL_write returned EBUSY");
-              else
-                LogDebug(COMPONENT_CACHE_INODE,
-                         "cache_inode_rdwr: fsal_status.major = %d",
-                         fsal_status.major);
-
-              if((fsal_status.major != ERR_FSAL_NOT_OPENED)
-                 && (pentry->object.file.open_fd.fileno != 0))
-                {
-
-                  LogDebug(COMPONENT_CACHE_INODE,
-                               "cache_inode_rdwr: CLOSING pentry %p: fd=%d",
-                               pentry, pentry->object.file.open_fd.fileno);
-
-#ifdef _USE_MFSL
-                  MFSL_close(&(pentry->object.file.open_fd.mfsl_fd), &pclient->mfsl_context, NULL);
-#else
-                  FSAL_close(&(pentry->object.file.open_fd.fd));
-#endif
-
-                  *pstatus = cache_inode_error_convert(fsal_status);
-                }
-              else
-                {
-                  /* the fd has been close by another thread.
-                   * return CACHE_INODE_FSAL_DELAY so the client will
-                   * retry with a new fd.
-                   */
-                  *pstatus = CACHE_INODE_FSAL_DELAY;
-                }
-
-              pentry->object.file.open_fd.last_op = 0;
-              pentry->object.file.open_fd.fileno = 0;
-
-              V_w(&pentry->lock);
-
-              /* stats */
-              pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
-
-              return *pstatus;
-            }
-
-          LogFullDebug(COMPONENT_CACHE_INODE,
-                       "cache_inode_rdwr: inode/direct: io_size=%llu, pio_size=%llu, eof=%d, seek=%d.%"PRIu64,
-                       io_size, *pio_size, *p_fsal_eof, seek_descriptor->whence,
-                       seek_descriptor->offset);
-
-          if(cache_inode_close(pentry, pclient, pstatus) != CACHE_INODE_SUCCESS)
-            {
-              LogEvent(COMPONENT_CACHE_INODE,
-                       "cache_inode_rdwr: cache_inode_close = %d", *pstatus);
-
-              V_w(&pentry->lock);
-
-              /* stats */
-              pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
+            case CACHE_INODE_WRITE:
+              /* Set mtime and ctime */
+              cache_inode_set_time_current( & pentry->attributes.mtime ) ;
 
-              return *pstatus;
-            }
+              /* BUGAZOMEU : write operation must NOT modify file's ctime */
+              pentry->attributes.ctime = pentry->attributes.mtime;
 
-          if(read_or_write == CACHE_INODE_WRITE)
-            {
-              /* Do a getattr in order to have update information on filesize
-               * This query is done directly on FSAL (object is not data cached), and result
-               * will be propagated to cache Inode */
-
-              /* WARNING: This operation is to be done AFTER FSAL_close (some FSAL, like POSIX,
-               * may not flush data until the file is closed */
-
-              /*post_write_attr.asked_attributes =  pclient->attrmask ; */
-              post_write_attr.asked_attributes = FSAL_ATTR_SIZE | FSAL_ATTR_SPACEUSED;
-              fsal_status_getattr =
-                  FSAL_getattrs(&(pentry->handle), pcontext,
-                                &post_write_attr);
-
-              /* if failed, the next block will handle the error */
-              if(FSAL_IS_ERROR(fsal_status_getattr))
-                fsal_status = fsal_status_getattr;
-              else
-                {
-                  /* Update Cache Inode attributes */
-                  pentry->attributes.filesize = post_write_attr.filesize;
-                  pentry->attributes.spaceused = post_write_attr.spaceused;
-                }
+              break;
             }
-
         }
-
-      /* IO was successfull (through cache content or not), we manually update the times in the attributes */
-
-      switch (read_or_write)
+      else if(cache_inode_rdwr_fsal(pentry, read_or_write, seek_descriptor, io_size,
+                                    pio_size, buffer, p_fsal_eof, pclient, pcontext,
+                                    pstatus) != CACHE_INODE_SUCCESS)
         {
-        case CACHE_INODE_READ:
-          /* Set the atime */
-          cache_inode_set_time_current( & pentry->attributes.atime ) ;
-          break;
-
-        case CACHE_INODE_WRITE:
-          /* Set mtime and ctime */
-          cache_inode_set_time_current( & pentry->attributes.mtime ) ;
+          /* No data cache entry, we operated directly on FSAL */
+          V_w(&pentry->lock);
 
-          /* BUGAZOMEU : write operation must NOT modify file's ctime */
-          pentry->attributes.ctime = pentry->attributes.mtime;
+          /* stats */
+          pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
 
-          break;
+          return *pstatus;
         }
     }
 
@@ -509,24 +625,12 @@ cache_inode_status_t cache_inode_rdwr(cache_entry_t * pentry,
   *pstatus = CACHE_INODE_SUCCESS;
 
   /* stat */
-  if(read_or_write == CACHE_INODE_READ)
-    {
-      *pstatus = cache_inode_valid(pentry, CACHE_INODE_OP_GET, pclient);
+  *pstatus = cache_inode_valid(pentry, valid_op, pclient);
 
-      if(*pstatus != CACHE_INODE_SUCCESS)
-        pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_READ] += 1;
-      else
-        pclient->stat.func_stats.nb_success[CACHE_INODE_READ] += 1;
-    }
+  if(*pstatus != CACHE_INODE_SUCCESS)
+    pclient->stat.func_stats.nb_err_unrecover[statindex] += 1;
   else
-    {
-      *pstatus = cache_inode_valid(pentry, CACHE_INODE_OP_SET, pclient);
-
-      if(*pstatus != CACHE_INODE_SUCCESS)
-        pclient->stat.func_stats.nb_err_unrecover[CACHE_INODE_WRITE] += 1;
-      else
-        pclient->stat.func_stats.nb_success[CACHE_INODE_WRITE] += 1;
-    }
+    pclient->stat.func_stats.nb_success[statindex] += 1;
 
   V_w(&pentry->lock);
 
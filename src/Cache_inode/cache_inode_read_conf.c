@@ -57,6 +57,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
+#include <stdlib.h>
 
 /**
  *
@@ -131,6 +132,16 @@ cache_inode_status_t cache_inode_read_conf_hash_parameter(config_file_t in_confi
         {
           pparam->hparam.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hparam.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_CACHE_INODE_HASH);
+              return CACHE_INODE_INVALID_ARGUMENT;
+            }
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -321,6 +332,18 @@ cache_inode_status_t cache_inode_read_conf_client_parameter(config_file_t in_con
         {
           pparam->use_fsal_hash = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "Max_Dirty_Data"))
+        {
+          pparam->max_dirty = strtoull(key_value, NULL, 10);
+        }
+      else if(!strcasecmp(key_name, "Write_Behind_Chunk"))
+        {
+          pparam->write_behind_chunk = strtoull(key_value, NULL, 10);
+        }
+      else if(!strcasecmp(key_name, "Write_Behind_Delay"))
+        {
+          pparam->write_behind_delay = atoi(key_value);
+        }
       else if(!strcasecmp(key_name, "DebugLevel"))
         {
           DebugLevel = ReturnLevelAscii(key_value);
@@ -442,6 +465,14 @@ cache_inode_status_t cache_inode_read_conf_gc_policy(config_file_t in_config,
         {
           ppolicy->nb_call_before_gc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Memory_HighWater"))
+        {
+          ppolicy->memory_hwmark = strtoull(key_value, NULL, 10);
+        }
+      else if(!strcasecmp(key_name, "Reclaim_Step_Duration"))
+        {
+          ppolicy->reclaim_step_duration = atoi(key_value);
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -475,6 +506,8 @@ void cache_inode_print_conf_hash_parameter(FILE * output, cache_inode_parameter_
           param.hparam.alphabet_length);
   fprintf(output, "CacheInode Hash: Prealloc_Node_Pool_Size = %d\n",
           param.hparam.nb_node_prealloc);
+  fprintf(output, "CacheInode Hash: Hash_Backend            = %s\n",
+          HashTable_BackendToStr(param.hparam.backend));
 }                               /* cache_inode_print_conf_hash_parameter */
 
 /**
@@ -535,4 +568,8 @@ void cache_inode_print_conf_gc_policy(FILE * output, cache_inode_gc_policy_t gcp
   fprintf(output, "Garbage Policy: Nb_Call_Before_GC   = %d\n",
           gcpolicy.nb_call_before_gc);
   fprintf(output, "Garbage Policy: Runtime_Interval    = %d\n", gcpolicy.run_interval);
+  fprintf(output, "Garbage Policy: Memory_HighWater    = %llu\n",
+          (unsigned long long)gcpolicy.memory_hwmark);
+  fprintf(output, "Garbage Policy: Reclaim_Step_Duration = %u\n",
+          gcpolicy.reclaim_step_duration);
 }                               /* cache_inode_print_gc_pol */
@@ -166,6 +166,13 @@ cache_inode_status_t cache_inode_clean_internal(cache_entry_t * to_remove_entry,
   /* release the key used for hash query */
   cache_inode_release_fsaldata_key(&key, pclient);
 
+  /* Not to be found by the reclaimer any more */
+  cache_inode_clock_remove(to_remove_entry);
+
+  /* Close the fds kept open on a file, drop what is left of its unstable writes */
+  cache_inode_forget_fds(to_remove_entry, pclient);
+  cache_inode_forget_dirty(to_remove_entry);
+
   /* Free the parent list entries */
 
   parent_iter = to_remove_entry->parent_list;
@@ -64,6 +64,60 @@ static cache_inode_status_t isNumlinksZero(cache_entry_t *pentry,
                                            hash_table_t *ht,
                                            fsal_attrib_list_t *object_attributes);
 
+/**
+ *
+ * cache_inode_renew_needed: tells if cache_inode_renew_entry has work to do.
+ *
+ * Tells, with the entry locked for reading only, whether the cached
+ * attributes, directory entries or link content have expired. The lookups
+ * and getattrs served from the cache lock the entry for writing only when
+ * they have.
+ *
+ * @param pentry  [IN] entry to be tested.
+ * @param pclient [IN] ressource allocated by the client for the nfs management.
+ *
+ * @return TRUE if the entry is to be renewed, FALSE otherwise.
+ *
+ */
+int cache_inode_renew_needed(cache_entry_t * pentry, cache_inode_client_t * pclient)
+{
+  time_t elapsed = time(NULL) - pentry->internal_md.refresh_time;
+
+  /* Data cached files do not expire, see cache_inode_renew_entry */
+  if(pentry->internal_md.type == REGULAR_FILE &&
+     pentry->object.file.pentry_content != NULL)
+    return FALSE;
+
+  if(pentry->internal_md.valid_state == STALE)
+    return TRUE;
+
+  switch (pentry->internal_md.type)
+    {
+    case DIRECTORY:
+      /* The mtime of the directory is then checked in the FSAL every time */
+      if(pclient->getattr_dir_invalidation &&
+         FSAL_TEST_MASK(pclient->attrmask, FSAL_ATTR_MTIME))
+        return TRUE;
+
+      if(pentry->object.dir.has_been_readdir == CACHE_INODE_YES)
+        return pclient->expire_type_dirent != CACHE_INODE_EXPIRE_NEVER &&
+            elapsed >= pclient->grace_period_dirent;
+
+      return pclient->expire_type_attr != CACHE_INODE_EXPIRE_NEVER &&
+          elapsed >= pclient->grace_period_attr;
+
+    case SYMBOLIC_LINK:
+      if(pclient->expire_type_link != CACHE_INODE_EXPIRE_NEVER &&
+         elapsed >= pclient->grace_period_link)
+        return TRUE;
+
+      /* fall through */
+    default:
+      return pclient->expire_type_attr != CACHE_INODE_EXPIRE_NEVER &&
+          elapsed >= pclient->grace_period_attr;
+    }
+}                               /* cache_inode_renew_needed */
+
 /**
  *
  * cache_inode_renew_entry: Renews the attributes for an entry.
@@ -90,6 +144,7 @@ cache_inode_status_t cache_inode_renew_entry(cache_entry_t * pentry,
 {
   fsal_handle_t *pfsal_handle = NULL;
   fsal_status_t fsal_status;
+  cache_inode_opened_file_t *pfd;
   fsal_attrib_list_t object_attributes;
   fsal_path_t link_content;
   time_t current_time = time(NULL);
@@ -530,11 +585,16 @@ cache_inode_status_t cache_inode_renew_entry(cache_entry_t * pentry,
 
       /* Call FSAL to get the attributes */
       object_attributes.asked_attributes = pclient->attrmask;
+      pfd = cache_inode_fd_pin(pentry);
 #ifdef _USE_MFSL
-      fsal_status = FSAL_getattrs_descriptor(&(cache_inode_fd(pentry)->fsal_file), pfsal_handle, pcontext, &object_attributes);
+      fsal_status = FSAL_getattrs_descriptor(pfd != NULL ? &(pfd->mfsl_fd.fsal_file) : NULL,
+                                             pfsal_handle, pcontext, &object_attributes);
 #else
-      fsal_status = FSAL_getattrs_descriptor(cache_inode_fd(pentry), pfsal_handle, pcontext, &object_attributes);
+      fsal_status = FSAL_getattrs_descriptor(pfd != NULL ? &(pfd->fd) : NULL,
+                                             pfsal_handle, pcontext, &object_attributes);
 #endif
+      if(pfd != NULL)
+        cache_inode_fd_put(pfd, pclient);
       if(FSAL_IS_ERROR(fsal_status) && fsal_status.major == ERR_FSAL_NOT_OPENED)
         {
           //TODO: LOOKATME !!!!!
@@ -160,6 +160,9 @@ cache_inode_status_t cache_inode_setattr(cache_entry_t * pentry, fsal_attrib_lis
     {
       truncate_attributes.asked_attributes = pclient->attrmask;
 
+      /* The unstable writes past the new size are not to be written behind */
+      cache_inode_dirty_truncate(pentry, pattr->filesize);
+
       fsal_status = FSAL_truncate(pfsal_handle,
                                   pcontext, pattr->filesize, NULL, &truncate_attributes);
       if(FSAL_IS_ERROR(fsal_status))
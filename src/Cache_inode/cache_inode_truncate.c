@@ -142,6 +142,9 @@ cache_inode_status_t cache_inode_truncate_sw(cache_entry_t * pentry,
     }
   else
     {
+      /* The unstable writes past the new size are not to be written behind */
+      cache_inode_dirty_truncate(pentry, length);
+
       /* Call FSAL to actually truncate */
       pentry->attributes.asked_attributes = pclient->attrmask;
 #ifdef _USE_MFSL
@@ -0,0 +1,1071 @@
+/**
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * \file    cache_inode_write_behind.c
+ * \brief   Keeps the unstable writes in memory and writes them behind.
+ *
+ * cache_inode_write_behind.c : keeps the unstable writes in memory and
+ * writes them behind.
+ *
+ * The unstable writes of a file are kept in a list of dirty extents, sorted
+ * by offset and disjoint. The file is cut in aligned chunks, a write is
+ * merged with the extents of its chunk it overlaps or touches, an extent
+ * never crosses a chunk boundary. The write-behind threads write to the FSAL
+ * the extents filling a whole chunk, and the others once they are old
+ * enough, or all of them when half of the memory budget is used. Past the
+ * budget, the worker writes its own data before replying. COMMIT only waits
+ * for what is still dirty in its range, then commits the file in the FSAL.
+ *
+ * An extent the FSAL failed to write keeps its data and its error: the
+ * write-behind threads leave it, the next COMMIT, read or direct write of its
+ * range tries it again. The error of the file is returned to the next COMMIT.
+ *
+ * The extents and the write_behind of a file are protected by its io_mutex,
+ * the queue of the files to write and the counters by wb_mutex, always
+ * taken after an io_mutex. A file queued or being written by a thread is
+ * not freed: cache_inode_forget_dirty takes it out of the queue, or waits.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "fsal.h"
+
+#include "log.h"
+#include "cache_inode.h"
+#include "stuff_alloc.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/* Smallest buffer of an extent, they grow by doubling up to the chunk */
+#define CACHE_INODE_DIRTY_MIN_SIZE 4096
+
+/* The files with dirty extents, in the order they are to be written */
+static pthread_mutex_t wb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wb_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head wb_queue = { &wb_queue, &wb_queue };
+static unsigned int wb_nb_queued = 0;
+static unsigned int wb_nb_idle = 0;     /* files taken in a row with nothing to write */
+static uint64_t wb_chunk = CACHE_INODE_DEFAULT_WRITE_BEHIND_CHUNK;
+static time_t wb_delay = CACHE_INODE_DEFAULT_WRITE_BEHIND_DELAY;
+static cache_inode_wb_stat_t wb_stat = {.max_dirty = CACHE_INODE_DEFAULT_MAX_DIRTY };
+
+/* Waits for an extent or an I/O range of the file to be released, io_mutex held */
+static void cache_inode_dirty_wait(cache_entry_t * pentry)
+{
+  pentry->object.file.io_waiters += 1;
+  pthread_cond_wait(&pentry->object.file.io_cond, &pentry->object.file.io_mutex);
+  pentry->object.file.io_waiters -= 1;
+}                               /* cache_inode_dirty_wait */
+
+/* Frees an extent taken out of its list, returns the memory released */
+static uint64_t cache_inode_dirty_free(cache_inode_dirty_extent_t * pext)
+{
+  uint64_t size = pext->size;
+
+  Mem_Free(pext->buffer);
+  Mem_Free(pext);
+
+  return size;
+}                               /* cache_inode_dirty_free */
+
+/* Frees the write_behind of a clean file nobody queued, io_mutex held */
+static void cache_inode_dirty_release(cache_entry_t * pentry)
+{
+  cache_inode_write_behind_t *pwb = pentry->object.file.write_behind;
+  int clean;
+
+  if(pwb == NULL || !glist_empty(&pwb->extents) || pwb->status != CACHE_INODE_SUCCESS)
+    return;
+
+  P(wb_mutex);
+  clean = (pwb->state == CACHE_INODE_WB_IDLE);
+  V(wb_mutex);
+
+  if(!clean)
+    return;
+
+  pentry->object.file.write_behind = NULL;
+  Mem_Free(pwb);
+}                               /* cache_inode_dirty_release */
+
+/* Is an extent to be written by the write-behind threads now ? */
+static int cache_inode_dirty_ready(cache_inode_dirty_extent_t * pext, time_t now,
+                                   int background)
+{
+  /* Tried again by the worker flushing its range */
+  if(pext->status != CACHE_INODE_SUCCESS)
+    return FALSE;
+
+  if(background)
+    return TRUE;
+
+  if(pext->offset % wb_chunk == 0 && pext->length == wb_chunk)
+    return TRUE;
+
+  return now - pext->dirty_time >= wb_delay;
+}                               /* cache_inode_dirty_ready */
+
+/* Has the file extents for the write-behind threads, those in error left ? */
+static int cache_inode_dirty_pending(cache_inode_write_behind_t * pwb)
+{
+  struct glist_head *glist;
+
+  glist_for_each(glist, &pwb->extents)
+    if(glist_entry(glist, cache_inode_dirty_extent_t, extent_list)->status ==
+       CACHE_INODE_SUCCESS)
+      return TRUE;
+
+  return FALSE;
+}                               /* cache_inode_dirty_pending */
+
+/**
+ *
+ * cache_inode_dirty_insert: merges a write with the dirty extents of its chunk.
+ *
+ * The write must not cross a chunk boundary. The extents of the chunk it
+ * overlaps or touches are merged into one, copied into a larger buffer if
+ * needed, then the data of the write is copied over them. Must be called
+ * with io_mutex held.
+ *
+ * @param pwb        [INOUT] the unstable writes of the file
+ * @param offset     [IN]    first byte of the write
+ * @param length     [IN]    bytes written
+ * @param buffer     [IN]    the data
+ * @param pbusy      [OUT]   TRUE if an extent to merge with is being written, to wait for
+ * @param pdelta     [OUT]   memory taken by the extents, added
+ * @param pcoalesced [OUT]   TRUE if merged with an extent
+ * @param pfull      [OUT]   TRUE if the extent now fills its chunk
+ *
+ * @return CACHE_INODE_SUCCESS, or CACHE_INODE_MALLOC_ERROR.
+ *
+ */
+static cache_inode_status_t cache_inode_dirty_insert(cache_inode_write_behind_t * pwb,
+                                                     uint64_t offset,
+                                                     uint64_t length,
+                                                     caddr_t buffer,
+                                                     int *pbusy,
+                                                     int64_t * pdelta,
+                                                     int *pcoalesced, int *pfull)
+{
+  struct glist_head *glist;
+  struct glist_head *glistn;
+  struct glist_head *pnext = &pwb->extents;
+  cache_inode_dirty_extent_t *pext;
+  cache_inode_dirty_extent_t *ptarget = NULL;
+  uint64_t window = offset - offset % wb_chunk;
+  uint64_t start = offset;
+  uint64_t end = offset + length;
+  uint64_t size;
+  time_t dirty_time = time(NULL);
+  caddr_t newbuf;
+
+  *pbusy = FALSE;
+  *pcoalesced = FALSE;
+
+  /* The extents of the chunk the write overlaps or touches */
+  glist_for_each(glist, &pwb->extents)
+    {
+      pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+
+      if(pnext == &pwb->extents && pext->offset > offset)
+        pnext = glist;
+
+      if(pext->offset > offset + length)
+        break;
+
+      if(pext->offset + pext->length < offset || pext->offset < window ||
+         pext->offset >= window + wb_chunk)
+        continue;
+
+      if(pext->flushing)
+        {
+          *pbusy = TRUE;
+          return CACHE_INODE_SUCCESS;
+        }
+
+      if(ptarget == NULL)
+        ptarget = pext;
+
+      if(pext->offset < start)
+        start = pext->offset;
+      if(pext->offset + pext->length > end)
+        end = pext->offset + pext->length;
+      if(pext->dirty_time < dirty_time)
+        dirty_time = pext->dirty_time;
+    }
+
+  if(ptarget == NULL || ptarget->offset != start || ptarget->size < end - start)
+    {
+      /* A larger buffer, doubling, within the chunk */
+      for(size = CACHE_INODE_DIRTY_MIN_SIZE; size < end - start; size *= 2) ;
+      if(size > window + wb_chunk - start)
+        size = window + wb_chunk - start;
+
+      if((newbuf = Mem_Alloc_Label(size, "Cache_Inode Dirty Extent")) == NULL)
+        return CACHE_INODE_MALLOC_ERROR;
+
+      if(ptarget == NULL)
+        {
+          if((ptarget = (cache_inode_dirty_extent_t *)
+              Mem_Alloc(sizeof(cache_inode_dirty_extent_t))) == NULL)
+            {
+              Mem_Free(newbuf);
+              return CACHE_INODE_MALLOC_ERROR;
+            }
+
+          ptarget->offset = start;
+          ptarget->length = 0;
+          ptarget->size = 0;
+          ptarget->buffer = NULL;
+          ptarget->flushing = FALSE;
+          ptarget->status = CACHE_INODE_SUCCESS;
+          ptarget->flush_gen = 0;
+
+          /* Before the first extent past its start, the list stays sorted */
+          glist_add_tail(pnext, &ptarget->extent_list);
+        }
+      else
+        {
+          memcpy(newbuf + (ptarget->offset - start), ptarget->buffer, ptarget->length);
+          Mem_Free(ptarget->buffer);
+        }
+
+      *pdelta += (int64_t) size - (int64_t) ptarget->size;
+      ptarget->buffer = newbuf;
+      ptarget->size = size;
+      ptarget->offset = start;
+    }
+
+  /* The other extents merged are right after the target */
+  for(glist = ptarget->extent_list.next; glist != &pwb->extents; glist = glistn)
+    {
+      glistn = glist->next;
+      pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+
+      if(pext->offset > offset + length || pext->offset >= window + wb_chunk)
+        break;
+
+      memcpy(ptarget->buffer + (pext->offset - start), pext->buffer, pext->length);
+
+      glist_del(&pext->extent_list);
+      *pdelta -= cache_inode_dirty_free(pext);
+    }
+
+  *pcoalesced = (ptarget->length != 0);
+
+  memcpy(ptarget->buffer + (offset - start), buffer, length);
+  ptarget->length = end - start;
+  ptarget->dirty_time = dirty_time;
+
+  /* Written again, the write-behind tries it again, the file keeps the error */
+  ptarget->status = CACHE_INODE_SUCCESS;
+
+  *pfull = (ptarget->offset == window && ptarget->length == wb_chunk);
+
+  return CACHE_INODE_SUCCESS;
+}                               /* cache_inode_dirty_insert */
+
+/**
+ *
+ * cache_inode_dirty_write_extent: writes an extent to the FSAL.
+ *
+ * Called without io_mutex, the extent is marked flushing: it is not
+ * changed, nor freed, until the write is done.
+ *
+ */
+static cache_inode_status_t cache_inode_dirty_write_extent(cache_entry_t * pentry,
+                                                           cache_inode_dirty_extent_t * pext,
+                                                           cache_inode_client_t * pclient,
+                                                           fsal_op_context_t * pcontext,
+                                                           cache_inode_status_t * pstatus)
+{
+  cache_inode_opened_file_t *pfd;
+  cache_inode_io_range_t range;
+  fsal_status_t fsal_status;
+  fsal_seek_t seek_descriptor;
+  fsal_size_t io_done = 0;
+  fsal_size_t io_size;
+
+  /* After the direct I/O on the same bytes that started before */
+  cache_inode_io_range_lock(pentry, &range, CACHE_INODE_WRITE, pext->offset, pext->length);
+
+  if((pfd = cache_inode_fd_get(pentry,
+                               pclient, FSAL_O_WRONLY, pcontext, pstatus)) == NULL)
+    {
+      cache_inode_io_range_unlock(pentry, &range);
+      return *pstatus;
+    }
+
+  *pstatus = CACHE_INODE_SUCCESS;
+
+  while(io_done < pext->length)
+    {
+      seek_descriptor.whence = FSAL_SEEK_SET;
+      seek_descriptor.offset = pext->offset + io_done;
+      io_size = 0;
+
+#ifdef _USE_MFSL
+      fsal_status = MFSL_write(&(pfd->mfsl_fd), &seek_descriptor,
+                               pext->length - io_done, pext->buffer + io_done,
+                               &io_size, &pclient->mfsl_context, NULL);
+#else
+      fsal_status = FSAL_write(&(pfd->fd), &seek_descriptor,
+                               pext->length - io_done, pext->buffer + io_done, &io_size);
+#endif
+
+      if(FSAL_IS_ERROR(fsal_status) || io_size == 0)
+        {
+          LogEvent(COMPONENT_CACHE_INODE,
+                   "cache_inode_dirty_write_extent: pentry %p, write of %llu bytes at %llu failed, fsal_status.major = %d",
+                   pentry, (unsigned long long)(pext->length - io_done),
+                   (unsigned long long)seek_descriptor.offset, fsal_status.major);
+
+          *pstatus = FSAL_IS_ERROR(fsal_status) ?
+              cache_inode_error_convert(fsal_status) : CACHE_INODE_IO_ERROR;
+          break;
+        }
+
+      io_done += io_size;
+    }
+
+  if(*pstatus != CACHE_INODE_SUCCESS)
+    cache_inode_fd_discard(pfd, pclient);
+  else
+    cache_inode_fd_put(pfd, pclient);
+
+  cache_inode_io_range_unlock(pentry, &range);
+
+  return *pstatus;
+}                               /* cache_inode_dirty_write_extent */
+
+/**
+ *
+ * cache_inode_dirty_flush_range: writes the dirty extents of a range to the FSAL.
+ *
+ * Must be called with io_mutex held, released while the extents are
+ * written. Each extent is tried once: one the FSAL failed to write is kept
+ * with its error, the error of the file is kept for the next COMMIT.
+ *
+ * @param pentry      [IN]  the file
+ * @param offset      [IN]  first byte of the range
+ * @param end         [IN]  first byte past the range
+ * @param ready_only  [IN]  only write the extents ready for the write-behind
+ * @param background  [IN]  with ready_only, half of the budget is used
+ * @param wait        [IN]  wait for the extents written by another thread
+ * @param pclient     [IN]  ressource allocated by the client for the nfs management.
+ * @param pnb_flushed [OUT] bytes written
+ * @param pstatus     [OUT] returned status, the first error.
+ *
+ */
+static cache_inode_status_t cache_inode_dirty_flush_range(cache_entry_t * pentry,
+                                                          uint64_t offset,
+                                                          uint64_t end,
+                                                          int ready_only,
+                                                          int background,
+                                                          int wait,
+                                                          cache_inode_client_t * pclient,
+                                                          uint64_t * pnb_flushed,
+                                                          cache_inode_status_t * pstatus)
+{
+  cache_inode_write_behind_t *pwb;
+  cache_inode_dirty_extent_t *pext;
+  cache_inode_dirty_extent_t *pick;
+  struct glist_head *glist;
+  cache_inode_status_t status;
+  cache_inode_status_t close_status;
+  fsal_op_context_t context;
+  uint64_t length;
+  uint64_t size;
+  unsigned int gen;
+  time_t now;
+  int busy;
+
+  *pstatus = CACHE_INODE_SUCCESS;
+  *pnb_flushed = 0;
+
+  if((pwb = pentry->object.file.write_behind) == NULL)
+    return *pstatus;
+
+  gen = ++pwb->flush_gen;
+
+  while((pwb = pentry->object.file.write_behind) != NULL)
+    {
+      pick = NULL;
+      busy = FALSE;
+      now = time(NULL);
+
+      glist_for_each(glist, &pwb->extents)
+        {
+          pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+
+          if(pext->offset >= end)
+            break;
+
+          if(pext->offset + pext->length <= offset)
+            continue;
+
+          if(pext->flushing)
+            {
+              busy = TRUE;
+              continue;
+            }
+
+          if(ready_only && !cache_inode_dirty_ready(pext, now, background))
+            continue;
+
+          /* Failed in this flush already */
+          if(pext->status != CACHE_INODE_SUCCESS && pext->flush_gen == gen)
+            continue;
+
+          pick = pext;
+          break;
+        }
+
+      if(pick == NULL)
+        {
+          if(!busy || !wait)
+            break;
+
+          cache_inode_dirty_wait(pentry);
+          continue;
+        }
+
+      /* The extent stays in the list, the write_behind is not freed meanwhile */
+      pick->flushing = TRUE;
+      context = pwb->context;
+
+      V(pentry->object.file.io_mutex);
+
+      cache_inode_dirty_write_extent(pentry, pick, pclient, &context, &status);
+
+      P(pentry->object.file.io_mutex);
+
+      cache_inode_close(pentry, pclient, &close_status);
+
+      if(status == CACHE_INODE_SUCCESS)
+        {
+          glist_del(&pick->extent_list);
+          length = pick->length;
+          size = cache_inode_dirty_free(pick);
+          *pnb_flushed += length;
+
+          P(wb_mutex);
+          wb_stat.nb_flush += 1;
+          wb_stat.nb_dirty -= size;
+          wb_stat.nb_flushed_bytes += length;
+          V(wb_mutex);
+        }
+      else
+        {
+          /* The data stays dirty, the client is told by the next COMMIT */
+          pick->flushing = FALSE;
+          pick->status = status;
+          pick->flush_gen = gen;
+
+          P(wb_mutex);
+          wb_stat.nb_flush += 1;
+          wb_stat.nb_error += 1;
+          V(wb_mutex);
+
+          if(pwb->status == CACHE_INODE_SUCCESS)
+            pwb->status = status;
+          if(*pstatus == CACHE_INODE_SUCCESS)
+            *pstatus = status;
+        }
+
+      if(pentry->object.file.io_waiters != 0)
+        pthread_cond_broadcast(&pentry->object.file.io_cond);
+    }
+
+  return *pstatus;
+}                               /* cache_inode_dirty_flush_range */
+
+/**
+ *
+ * cache_inode_set_write_behind_policy: sets the budget of the unstable writes.
+ *
+ * @param max_dirty [IN] memory of the dirty extents, for all the files
+ * @param chunk     [IN] size and alignment of the extents written behind
+ * @param delay     [IN] age of the extents written behind before they fill a chunk
+ *
+ */
+void cache_inode_set_write_behind_policy(uint64_t max_dirty, uint64_t chunk, time_t delay)
+{
+  if(chunk < CACHE_INODE_DIRTY_MIN_SIZE)
+    {
+      LogEvent(COMPONENT_CACHE_INODE,
+               "Write_Behind_Chunk raised from %llu to %u bytes",
+               (unsigned long long)chunk, CACHE_INODE_DIRTY_MIN_SIZE);
+      chunk = CACHE_INODE_DIRTY_MIN_SIZE;
+    }
+
+  P(wb_mutex);
+  wb_stat.max_dirty = max_dirty;
+  wb_chunk = chunk;
+  wb_delay = delay;
+  V(wb_mutex);
+}                               /* cache_inode_set_write_behind_policy */
+
+/**
+ *
+ * cache_inode_get_write_behind_stats: gets the counters of the unstable writes.
+ *
+ * @param pstat [OUT] the counters
+ *
+ */
+void cache_inode_get_write_behind_stats(cache_inode_wb_stat_t * pstat)
+{
+  P(wb_mutex);
+  *pstat = wb_stat;
+  V(wb_mutex);
+}                               /* cache_inode_get_write_behind_stats */
+
+/**
+ *
+ * cache_inode_dirty_write: keeps an unstable write in memory.
+ *
+ * Merges the write with the dirty extents of the file and queues the file
+ * for the write-behind threads. Past the memory budget, the bytes written
+ * are written to the FSAL before returning. The entry must be locked, for
+ * reading at least.
+ *
+ * @param pentry   [IN]  the file
+ * @param offset   [IN]  first byte of the write
+ * @param size     [IN]  bytes written
+ * @param buffer   [IN]  the data
+ * @param pclient  [IN]  ressource allocated by the client for the nfs management.
+ * @param pcontext [IN]  fsal context of the write, used to write it behind
+ * @param pstatus  [OUT] returned status.
+ *
+ * @return CACHE_INODE_SUCCESS if the data is kept or written.
+ *
+ */
+cache_inode_status_t cache_inode_dirty_write(cache_entry_t * pentry,
+                                             uint64_t offset,
+                                             fsal_size_t size,
+                                             caddr_t buffer,
+                                             cache_inode_client_t * pclient,
+                                             fsal_op_context_t * pcontext,
+                                             cache_inode_status_t * pstatus)
+{
+  cache_inode_write_behind_t *pwb;
+  cache_inode_status_t status = CACHE_INODE_SUCCESS;
+  uint64_t done = 0;
+  uint64_t piece;
+  uint64_t nb_flushed;
+  int64_t delta = 0;
+  int busy;
+  int coalesced;
+  int full;
+  int any_coalesced = FALSE;
+  int any_full = FALSE;
+  int over;
+
+  *pstatus = CACHE_INODE_SUCCESS;
+
+  if(size == 0)
+    return *pstatus;
+
+  P(pentry->object.file.io_mutex);
+
+  while(done < size)
+    {
+      if((pwb = pentry->object.file.write_behind) == NULL)
+        {
+          if((pwb = (cache_inode_write_behind_t *)
+              Mem_Alloc(sizeof(cache_inode_write_behind_t))) == NULL)
+            {
+              status = CACHE_INODE_MALLOC_ERROR;
+              break;
+            }
+
+          init_glist(&pwb->extents);
+          init_glist(&pwb->wb_list);
+          pwb->state = CACHE_INODE_WB_IDLE;
+          pwb->requeue = FALSE;
+          pwb->status = CACHE_INODE_SUCCESS;
+          pwb->flush_gen = 0;
+          pwb->pentry = pentry;
+          pentry->object.file.write_behind = pwb;
+        }
+
+      /* Cut at the chunk boundaries */
+      piece = wb_chunk - (offset + done) % wb_chunk;
+      if(piece > size - done)
+        piece = size - done;
+
+      status = cache_inode_dirty_insert(pwb, offset + done, piece, buffer + done,
+                                        &busy, &delta, &coalesced, &full);
+      if(status != CACHE_INODE_SUCCESS)
+        break;
+
+      if(busy)
+        {
+          /* The extent is being written, the new data goes after it */
+          cache_inode_dirty_wait(pentry);
+          continue;
+        }
+
+      pwb->context = *pcontext;
+#ifndef _USE_HPSS
+      /* The extents are written after the request: past FSAL_NGROUPS_MAX,
+       * with the first groups of the user only */
+      FSAL_CRED_DROP_EXT_GROUPS(&pwb->context.credential);
+#endif
+      any_coalesced |= coalesced;
+      any_full |= full;
+      done += piece;
+    }
+
+  if(done != 0)
+    {
+      /* The size seen by the clients includes what is not written yet */
+      if(offset + done > pentry->attributes.filesize)
+        pentry->attributes.filesize = offset + done;
+
+      /* Set mtime and ctime */
+      cache_inode_set_time_current(&pentry->attributes.mtime);
+
+      /* BUGAZOMEU : write operation must NOT modify file's ctime */
+      pentry->attributes.ctime = pentry->attributes.mtime;
+    }
+
+  P(wb_mutex);
+
+  wb_stat.nb_dirty += delta;
+
+  if(status == CACHE_INODE_SUCCESS)
+    {
+      wb_stat.nb_write += 1;
+      if(any_coalesced)
+        wb_stat.nb_coalesced += 1;
+
+      pwb = pentry->object.file.write_behind;
+
+      if(pwb->state == CACHE_INODE_WB_IDLE)
+        {
+          pwb->state = CACHE_INODE_WB_QUEUED;
+          glist_add_tail(&wb_queue, &pwb->wb_list);
+          wb_nb_queued += 1;
+          wb_nb_idle = 0;
+          pthread_cond_signal(&wb_cond);
+        }
+      else if(pwb->state == CACHE_INODE_WB_RUNNING)
+        pwb->requeue = TRUE;
+
+      if(any_full || wb_stat.nb_dirty >= wb_stat.max_dirty / 2)
+        {
+          wb_nb_idle = 0;
+          pthread_cond_signal(&wb_cond);
+        }
+    }
+
+  over = (wb_stat.nb_dirty > wb_stat.max_dirty);
+  if(status == CACHE_INODE_SUCCESS && over)
+    wb_stat.nb_throttled += 1;
+
+  V(wb_mutex);
+
+  if(status != CACHE_INODE_SUCCESS)
+    {
+      /* What was kept of the write stays dirty, the client sends it again */
+      cache_inode_dirty_release(pentry);
+      V(pentry->object.file.io_mutex);
+
+      *pstatus = status;
+      return *pstatus;
+    }
+
+  /* Over budget, the worker writes its own data */
+  if(over)
+    cache_inode_dirty_flush_range(pentry, offset, offset + size, FALSE, FALSE, TRUE,
+                                  pclient, &nb_flushed, &status);
+
+  cache_inode_dirty_release(pentry);
+
+  V(pentry->object.file.io_mutex);
+
+  *pstatus = status;
+  return *pstatus;
+}                               /* cache_inode_dirty_write */
+
+/**
+ *
+ * cache_inode_dirty_flush: writes the unstable writes of a range to the FSAL.
+ *
+ * Used before a read or a direct write of the range, which have to come
+ * after the unstable writes. The extents being written by another thread
+ * are waited for. The entry must be locked, for reading at least.
+ *
+ * @param pentry  [IN]  the file
+ * @param offset  [IN]  first byte of the range
+ * @param length  [IN]  bytes in the range, 0 for the whole file
+ * @param pclient [IN]  ressource allocated by the client for the nfs management.
+ * @param pstatus [OUT] returned status.
+ *
+ * @return CACHE_INODE_SUCCESS if the range has nothing dirty left.
+ *
+ */
+cache_inode_status_t cache_inode_dirty_flush(cache_entry_t * pentry,
+                                             uint64_t offset,
+                                             uint64_t length,
+                                             cache_inode_client_t * pclient,
+                                             cache_inode_status_t * pstatus)
+{
+  uint64_t nb_flushed;
+
+  *pstatus = CACHE_INODE_SUCCESS;
+
+  if(pentry->internal_md.type != REGULAR_FILE)
+    return *pstatus;
+
+  P(pentry->object.file.io_mutex);
+
+  if(pentry->object.file.write_behind != NULL)
+    {
+      cache_inode_dirty_flush_range(pentry, offset,
+                                    (length == 0) ? UINT64_MAX : offset + length,
+                                    FALSE, FALSE, TRUE, pclient, &nb_flushed, pstatus);
+      cache_inode_dirty_release(pentry);
+    }
+
+  V(pentry->object.file.io_mutex);
+
+  return *pstatus;
+}                               /* cache_inode_dirty_flush */
+
+/**
+ *
+ * cache_inode_dirty_commit: makes the unstable writes of a range stable.
+ *
+ * Writes what is still dirty in the range, the extents that failed before
+ * included, and waits for the extents the write-behind threads are writing.
+ * Returns the error of any unstable write that could not be written since
+ * the last COMMIT, whose data is kept and tried again by the next COMMIT of
+ * its range. The caller commits the file in the FSAL then. The entry must be
+ * locked, for reading at least.
+ *
+ * @param pentry  [IN]  the file
+ * @param offset  [IN]  first byte of the range
+ * @param length  [IN]  bytes in the range, 0 for the whole file
+ * @param pclient [IN]  ressource allocated by the client for the nfs management.
+ * @param pstatus [OUT] returned status.
+ *
+ * @return CACHE_INODE_SUCCESS if the unstable writes are all written.
+ *
+ */
+cache_inode_status_t cache_inode_dirty_commit(cache_entry_t * pentry,
+                                              uint64_t offset,
+                                              uint64_t length,
+                                              cache_inode_client_t * pclient,
+                                              cache_inode_status_t * pstatus)
+{
+  cache_inode_write_behind_t *pwb;
+
+  if(pentry->internal_md.type != REGULAR_FILE)
+    {
+      *pstatus = CACHE_INODE_SUCCESS;
+      return *pstatus;
+    }
+
+  cache_inode_dirty_flush(pentry, offset, length, pclient, pstatus);
+
+  P(pentry->object.file.io_mutex);
+
+  /* The client is told once, by this COMMIT, of the errors of the file */
+  if((pwb = pentry->object.file.write_behind) != NULL &&
+     pwb->status != CACHE_INODE_SUCCESS)
+    {
+      if(*pstatus == CACHE_INODE_SUCCESS)
+        *pstatus = pwb->status;
+      pwb->status = CACHE_INODE_SUCCESS;
+      cache_inode_dirty_release(pentry);
+    }
+
+  V(pentry->object.file.io_mutex);
+
+  return *pstatus;
+}                               /* cache_inode_dirty_commit */
+
+/**
+ *
+ * cache_inode_dirty_truncate: drops the unstable writes past a new size.
+ *
+ * Must be called with the entry locked for writing, before the file is
+ * truncated in the FSAL. The extents past the size the write-behind threads
+ * are writing are waited for.
+ *
+ * @param pentry [IN] the file
+ * @param length [IN] the new size
+ *
+ */
+void cache_inode_dirty_truncate(cache_entry_t * pentry, uint64_t length)
+{
+  cache_inode_write_behind_t *pwb;
+  cache_inode_dirty_extent_t *pext;
+  struct glist_head *glist;
+  struct glist_head *glistn;
+  uint64_t released = 0;
+  int busy;
+
+  if(pentry->internal_md.type != REGULAR_FILE)
+    return;
+
+  P(pentry->object.file.io_mutex);
+
+  do
+    {
+      busy = FALSE;
+
+      if((pwb = pentry->object.file.write_behind) == NULL)
+        break;
+
+      glist_for_each(glist, &pwb->extents)
+        {
+          pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+          if(pext->flushing && pext->offset + pext->length > length)
+            busy = TRUE;
+        }
+
+      if(busy)
+        cache_inode_dirty_wait(pentry);
+    }
+  while(busy);
+
+  if(pwb != NULL)
+    {
+      glist_for_each_safe(glist, glistn, &pwb->extents)
+        {
+          pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+
+          if(pext->offset >= length)
+            {
+              glist_del(&pext->extent_list);
+              released += cache_inode_dirty_free(pext);
+            }
+          else if(pext->offset + pext->length > length)
+            pext->length = length - pext->offset;
+        }
+
+      P(wb_mutex);
+      wb_stat.nb_dirty -= released;
+      V(wb_mutex);
+
+      cache_inode_dirty_release(pentry);
+    }
+
+  V(pentry->object.file.io_mutex);
+}                               /* cache_inode_dirty_truncate */
+
+/**
+ *
+ * cache_inode_dirty_end: gets the end of the unstable writes of a file.
+ *
+ * @param pentry [IN] the file
+ *
+ * @return the first byte past the last dirty extent, 0 if none.
+ *
+ */
+uint64_t cache_inode_dirty_end(cache_entry_t * pentry)
+{
+  cache_inode_dirty_extent_t *pext;
+  uint64_t end = 0;
+
+  if(pentry->internal_md.type != REGULAR_FILE)
+    return 0;
+
+  P(pentry->object.file.io_mutex);
+
+  if(pentry->object.file.write_behind != NULL &&
+     !glist_empty(&pentry->object.file.write_behind->extents))
+    {
+      pext = glist_entry(pentry->object.file.write_behind->extents.prev,
+                         cache_inode_dirty_extent_t, extent_list);
+      end = pext->offset + pext->length;
+    }
+
+  V(pentry->object.file.io_mutex);
+
+  return end;
+}                               /* cache_inode_dirty_end */
+
+/**
+ *
+ * cache_inode_forget_dirty: drops the unstable writes of an entry about to be freed.
+ *
+ * Must be called with the entry locked for writing. The file is taken out
+ * of the write-behind queue, or waited for if a thread is writing it.
+ *
+ * @param pentry [IN] the file
+ *
+ */
+void cache_inode_forget_dirty(cache_entry_t * pentry)
+{
+  cache_inode_write_behind_t *pwb;
+  cache_inode_dirty_extent_t *pext;
+  struct glist_head *glist;
+  struct glist_head *glistn;
+  uint64_t released = 0;
+  uint64_t dropped = 0;
+  int running;
+
+  if(pentry->internal_md.type != REGULAR_FILE)
+    return;
+
+  P(pentry->object.file.io_mutex);
+
+  while((pwb = pentry->object.file.write_behind) != NULL)
+    {
+      P(wb_mutex);
+
+      running = (pwb->state == CACHE_INODE_WB_RUNNING);
+      if(pwb->state == CACHE_INODE_WB_QUEUED)
+        {
+          glist_del(&pwb->wb_list);
+          wb_nb_queued -= 1;
+          pwb->state = CACHE_INODE_WB_IDLE;
+        }
+
+      V(wb_mutex);
+
+      if(running)
+        {
+          cache_inode_dirty_wait(pentry);
+          continue;
+        }
+
+      glist_for_each_safe(glist, glistn, &pwb->extents)
+        {
+          pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+
+          glist_del(&pext->extent_list);
+          dropped += pext->length;
+          released += cache_inode_dirty_free(pext);
+        }
+
+      P(wb_mutex);
+      wb_stat.nb_dirty -= released;
+      V(wb_mutex);
+
+      pentry->object.file.write_behind = NULL;
+      Mem_Free(pwb);
+    }
+
+  V(pentry->object.file.io_mutex);
+
+  if(dropped != 0)
+    LogDebug(COMPONENT_CACHE_INODE,
+             "cache_inode_forget_dirty: pentry %p freed with %llu bytes of unstable writes",
+             pentry, (unsigned long long)dropped);
+}                               /* cache_inode_forget_dirty */
+
+/**
+ *
+ * cache_inode_write_behind_run: writes behind the next file of the queue.
+ *
+ * Waits for a file to write up to timeout seconds, or when every queued file
+ * was found with nothing ready. The extents of the file filling a chunk, or
+ * old enough, or all of them when half of the budget is used, are written.
+ * The file is queued again if it has extents left, other than those the
+ * FSAL failed to write.
+ *
+ * @param pclient [IN] ressource allocated by the write-behind thread.
+ * @param timeout [IN] most seconds to wait for a file.
+ *
+ * @return the bytes written.
+ *
+ */
+uint64_t cache_inode_write_behind_run(cache_inode_client_t * pclient, unsigned int timeout)
+{
+  cache_inode_write_behind_t *pwb;
+  cache_entry_t *pentry;
+  cache_inode_status_t status;
+  struct timespec deadline;
+  uint64_t nb_flushed;
+  int background;
+
+  P(wb_mutex);
+
+  if(glist_empty(&wb_queue) || wb_nb_idle >= wb_nb_queued)
+    {
+      deadline.tv_sec = time(NULL) + timeout;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&wb_cond, &wb_mutex, &deadline);
+      wb_nb_idle = 0;
+    }
+
+  if(glist_empty(&wb_queue))
+    {
+      V(wb_mutex);
+      return 0;
+    }
+
+  /* Not freed while RUNNING */
+  pwb = glist_first_entry(&wb_queue, cache_inode_write_behind_t, wb_list);
+  glist_del(&pwb->wb_list);
+  wb_nb_queued -= 1;
+  pwb->state = CACHE_INODE_WB_RUNNING;
+  pwb->requeue = FALSE;
+  pentry = pwb->pentry;
+  background = (wb_stat.nb_dirty >= wb_stat.max_dirty / 2);
+
+  V(wb_mutex);
+
+  P(pentry->object.file.io_mutex);
+
+  cache_inode_dirty_flush_range(pentry, 0, UINT64_MAX, TRUE, background, FALSE,
+                                pclient, &nb_flushed, &status);
+
+  P(wb_mutex);
+
+  if(pwb->requeue || cache_inode_dirty_pending(pwb))
+    {
+      pwb->state = CACHE_INODE_WB_QUEUED;
+      glist_add_tail(&wb_queue, &pwb->wb_list);
+      wb_nb_queued += 1;
+    }
+  else
+    pwb->state = CACHE_INODE_WB_IDLE;
+
+  if(nb_flushed == 0)
+    wb_nb_idle += 1;
+  else
+    wb_nb_idle = 0;
+
+  V(wb_mutex);
+
+  cache_inode_dirty_release(pentry);
+
+  /* cache_inode_forget_dirty may wait for the end of the run */
+  if(pentry->object.file.io_waiters != 0)
+    pthread_cond_broadcast(&pentry->object.file.io_cond);
+
+  V(pentry->object.file.io_mutex);
+
+  return nb_flushed;
+}                               /* cache_inode_write_behind_run */
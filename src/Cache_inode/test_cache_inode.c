@@ -126,14 +126,15 @@ main(int argc, char *argv[])
 
   char *configfile = argv[1];
   int i = 0;
-  int rc = 0;
 
   /* Init the Buddy System allocation */
-  if((rc = BuddyInit(NULL)) != BUDDY_SUCCESS)
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
     {
       LogTest("Error initializing memory allocator");
       exit(1);
     }
+#endif
 
 
   /* init debug */
@@ -249,6 +250,7 @@ main(int argc, char *argv[])
   cache_param.hparam.hash_func_key = cache_inode_fsal_hash_func;
   cache_param.hparam.hash_func_rbt = cache_inode_fsal_rbt_func;
   cache_param.hparam.hash_func_both = NULL ; /* BUGAZOMEU */
+  cache_param.hparam.backend = HASHTABLE_BACKEND_RBT;
   cache_param.hparam.compare_key = cache_inode_compare_key_fsal;
   cache_param.hparam.key_to_str = display_key;
   cache_param.hparam.val_to_str = display_value;
@@ -431,12 +431,12 @@ fsal_status_t fsal_internal_testAccess(cephfsal_op_context_t* context,
     {
       for(i = 0; i < context->credential.nbgroups; i++)
         {
-          is_grp = context->credential.alt_groups[i] == gid;
+          is_grp = FSAL_CRED_GROUPS(&context->credential)[i] == gid;
 
           if(is_grp)
             LogFullDebug(COMPONENT_FSAL,
                          "File belongs to user's alt group %d",
-                         context->credential.alt_groups[i]);
+                         FSAL_CRED_GROUPS(&context->credential)[i]);
 
           // exits loop if found
           if(is_grp)
@@ -348,7 +348,7 @@ fsal_status_t GPFSFSAL_setattrs(fsal_handle_t * p_filehandle,       /* IN */
           else
             for(i = 0; i < p_context->credential.nbgroups; i++)
               {
-                if((in_grp = (wanted_attrs.group == p_context->credential.alt_groups[i])))
+                if((in_grp = (wanted_attrs.group == FSAL_CRED_GROUPS(&p_context->credential)[i])))
                   break;
               }
     
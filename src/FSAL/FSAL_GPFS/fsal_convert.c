@@ -735,9 +735,13 @@ fsal_status_t fsal_cred_2_gpfs_cred(struct user_credentials *p_fsalcred,
   p_gpfscred->group = p_fsalcred->group;
   p_gpfscred->num_groups = p_fsalcred->nbgroups;
 
-  for(i = 0; i < p_fsalcred->nbgroups; i++)
+  /* GPFS takes fewer groups than the FSAL credentials hold */
+  if(p_gpfscred->num_groups > XSTAT_CRED_NGROUPS)
+    p_gpfscred->num_groups = XSTAT_CRED_NGROUPS;
+
+  for(i = 0; i < p_gpfscred->num_groups; i++)
     {
-      p_gpfscred->eGroups[i] = p_fsalcred->alt_groups[i];
+      p_gpfscred->eGroups[i] = FSAL_CRED_GROUPS(p_fsalcred)[i];
     }
 
   ReturnCode(ERR_FSAL_NO_ERROR, 0);
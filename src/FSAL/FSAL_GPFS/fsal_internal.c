@@ -962,7 +962,7 @@ static fsal_boolean_t fsal_check_ace_group(fsal_gid_t gid, fsal_op_context_t *p_
 
   for(i = 0; i < p_context->credential.nbgroups; i++)
     {
-      if(p_context->credential.alt_groups[i] == gid)
+      if(FSAL_CRED_GROUPS(&p_context->credential)[i] == gid)
         return TRUE;
     }
 
@@ -1442,11 +1442,11 @@ static fsal_status_t fsal_internal_testAccess_no_acl(fsal_op_context_t * p_conte
   if(!is_grp)
     for(i = 0; i < p_context->credential.nbgroups; i++)
       {
-        is_grp = (p_context->credential.alt_groups[i] == gid);
+        is_grp = (FSAL_CRED_GROUPS(&p_context->credential)[i] == gid);
         if(is_grp)
           LogDebug(COMPONENT_FSAL,
                        "File belongs to user's alt group %d",
-                       p_context->credential.alt_groups[i]);
+                       FSAL_CRED_GROUPS(&p_context->credential)[i]);
         if(is_grp)
           break;
       }
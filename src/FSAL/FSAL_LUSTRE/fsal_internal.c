@@ -553,12 +553,12 @@ fsal_status_t fsal_internal_testAccess(fsal_op_context_t * p_context,     /* IN
     {
       for(i = 0; i < p_context->credential.nbgroups; i++)
         {
-          is_grp = (p_context->credential.alt_groups[i] == gid);
+          is_grp = (FSAL_CRED_GROUPS(&p_context->credential)[i] == gid);
 
           if(is_grp)
             LogFullDebug(COMPONENT_FSAL,
                               "File belongs to user's alt group %d",
-                              p_context->credential.alt_groups[i]);
+                              FSAL_CRED_GROUPS(&p_context->credential)[i]);
 
           // exits loop if found
           if(is_grp)
@@ -1506,7 +1506,8 @@ void *FSAL_proxy_change_user(proxyfsal_op_context_t * p_thr_context)
 	      authunix_create(hostname,
 			      p_thr_context->credential.user,
 			      p_thr_context->credential.group,
-			      p_thr_context->credential.nbgroups,
+			      p_thr_context->credential.nbgroups > FSAL_NGROUPS_MAX ?
+			      FSAL_NGROUPS_MAX : p_thr_context->credential.nbgroups,
 			      p_thr_context->credential.alt_groups);
       break;
 #ifdef _USE_GSSRPC
@@ -341,7 +341,7 @@ fsal_status_t VFSFSAL_setattrs(fsal_handle_t * p_filehandle,       /* IN */
       else
         for(i = 0; i < vfs_context->credential.nbgroups; i++)
           {
-            if((in_grp = (attrs.group == vfs_context->credential.alt_groups[i])))
+            if((in_grp = (attrs.group == FSAL_CRED_GROUPS(&vfs_context->credential)[i])))
               break;
           }
 
@@ -241,12 +241,17 @@ fsal_status_t VFSFSAL_GetClientContext(fsal_op_context_t * thr_context,    /* IN
   p_thr_context->credential.user = uid;
   p_thr_context->credential.group = gid;
 
-  if(ng > FSAL_NGROUPS_MAX)
-    ng = FSAL_NGROUPS_MAX;
   if((ng > 0) && (alt_groups == NULL))
     Return(ERR_FSAL_FAULT, 0, INDEX_FSAL_GetClientContext);
 
+  /* Past FSAL_NGROUPS_MAX, the list of the caller is used as is */
   p_thr_context->credential.nbgroups = ng;
+  p_thr_context->credential.ext_groups = NULL;
+  if(ng > FSAL_NGROUPS_MAX)
+    {
+      p_thr_context->credential.ext_groups = alt_groups;
+      ng = FSAL_NGROUPS_MAX;
+    }
 
   for(i = 0; i < ng; i++)
     p_thr_context->credential.alt_groups[i] = alt_groups[i];
@@ -263,7 +268,7 @@ fsal_status_t VFSFSAL_GetClientContext(fsal_op_context_t * thr_context,    /* IN
         {
           for(i = 0; i < p_thr_context->credential.nbgroups; i++)
             LogFullDebug(COMPONENT_FSAL, "\tAlt grp: %d",
-                         p_thr_context->credential.alt_groups[i]);
+                         FSAL_CRED_GROUPS(&p_thr_context->credential)[i]);
         }
    }
 
@@ -21,6 +21,7 @@
 #include "fsal_convert.h"
 #include "stuff_alloc.h"
 #include <string.h>
+#include <stddef.h>
 
 /**
  * FSAL_opendir :
@@ -153,7 +154,9 @@ struct linux_dirent
   char d_name[];
 };
 
-#define BUF_SIZE 1024
+/* Several hundreds of entries per getdents, their attributes are got as a batch */
+#define BUF_SIZE 32768
+#define MIN_DIRENT_SIZE (offsetof(struct linux_dirent, d_name) + 2)
 
 fsal_status_t VFSFSAL_readdir(fsal_dir_t * dir_descriptor,      /* IN */
                               fsal_cookie_t startposition,      /* IN */
@@ -170,19 +173,15 @@ fsal_status_t VFSFSAL_readdir(fsal_dir_t * dir_descriptor,      /* IN */
   vfsfsal_cookie_t * p_end_position = (vfsfsal_cookie_t *) end_position;
   fsal_status_t st;
   fsal_count_t max_dir_entries;
-  fsal_name_t entry_name;
   char buff[BUF_SIZE];
+  char *names[BUF_SIZE / MIN_DIRENT_SIZE];
+  fsal_dirent_t *p_batch;
+  unsigned int nb_batch, i;
   struct linux_dirent *dp = NULL;
   int bpos = 0;
 
-  char d_type;
-  struct stat buffstat;
-
   int rc = 0;
 
-  memset(buff, 0, BUF_SIZE);
-  memset(&entry_name, 0, sizeof(fsal_name_t));
-
   /*****************/
   /* sanity checks */
   /*****************/
@@ -211,7 +210,7 @@ fsal_status_t VFSFSAL_readdir(fsal_dir_t * dir_descriptor,      /* IN */
   while(*p_nb_entries < max_dir_entries)
     {
     /***********************/
-      /* read the next entry */
+      /* read the next entries */
     /***********************/
       TakeTokenFSCall();
       rc = syscall(SYS_getdents, p_dir_descriptor->fd, buff, BUF_SIZE);
@@ -228,83 +227,55 @@ fsal_status_t VFSFSAL_readdir(fsal_dir_t * dir_descriptor,      /* IN */
           break;
         }
 
-    /***********************************/
-      /* Get information about the entry */
-    /***********************************/
+      /* The entries read are stored from here */
+      p_batch = &p_pdirent[*p_nb_entries];
+      nb_batch = 0;
 
       for(bpos = 0; bpos < rc;)
         {
           dp = (struct linux_dirent *)(buff + bpos);
-          d_type = *(buff + bpos + dp->d_reclen - 1);
 
           bpos += dp->d_reclen;
 
-          if(!(*p_nb_entries < max_dir_entries))
+          if(!(*p_nb_entries + nb_batch < max_dir_entries))
             break;
 
           /* skip . and .. */
           if(!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, ".."))
             continue;
 
-          /* build the full path of the file into "fsalpath */
           if(FSAL_IS_ERROR
              (st =
               FSAL_str2name(dp->d_name, FSAL_MAX_NAME_LEN,
-                            &(p_pdirent[*p_nb_entries].name))))
+                            &(p_batch[nb_batch].name))))
             ReturnStatus(st, INDEX_FSAL_readdir);
 
+          names[nb_batch] = dp->d_name;
+          ((vfsfsal_cookie_t *) (&p_batch[nb_batch].cookie))->data.cookie = dp->d_off;
+          nb_batch++;
+        }                       /* for */
+
+      // TODO: there is a race here, because between handle fetch
+      // and open at things might change.  we need to figure out if there
+      // is another way to open without the pcontext
 
-          // TODO: there is a race here, because between handle fetch
-          // and open at things might change.  we need to figure out if there
-          // is another way to open without the pcontext
-
-          strncpy(entry_name.name, dp->d_name, sizeof(entry_name.name));
-          entry_name.len = strlen(entry_name.name);
-
-          /* get object handle */
-          TakeTokenFSCall();
-
-          
-          if(fstatat(p_dir_descriptor->fd, dp->d_name, &buffstat, AT_SYMLINK_NOFOLLOW) < 0 )
-            {
-              ReleaseTokenFSCall();
-              Return(posix2fsal_error(errno), errno, INDEX_FSAL_readdir);
-            }
-
-          st = fsal_internal_get_handle_at( p_dir_descriptor->fd, dp->d_name,
-		           				            &p_pdirent[*p_nb_entries].handle) ;
-          if(FSAL_IS_ERROR(st))
-            {
-              ReleaseTokenFSCall();
-              ReturnStatus(st, INDEX_FSAL_readdir);
-            }
-          p_pdirent[*p_nb_entries].attributes.asked_attributes = get_attr_mask;
-
-          st = posix2fsal_attributes(&buffstat, &p_pdirent[*p_nb_entries].attributes);
-          if(FSAL_IS_ERROR(st))
-            {
-              ReleaseTokenFSCall();
-              FSAL_CLEAR_MASK(p_pdirent[*p_nb_entries].attributes.asked_attributes);
-              FSAL_SET_MASK(p_pdirent[*p_nb_entries].attributes.asked_attributes,
-                            FSAL_ATTR_RDATTR_ERR);
-              ReturnStatus(st, INDEX_FSAL_getattrs);
-            }
-
-          ReleaseTokenFSCall();
-
-          //p_pdirent[*p_nb_entries].cookie.cookie = dp->d_off;
-          ((vfsfsal_cookie_t *) (&p_pdirent[*p_nb_entries].cookie))->data.cookie = dp->d_off;
+      /* get the handles and the attributes of the whole batch at once */
+      st = vfsfsal_stat_entries(p_dir_descriptor->fd, names, p_batch, nb_batch,
+                                get_attr_mask);
+      if(FSAL_IS_ERROR(st))
+        ReturnStatus(st, INDEX_FSAL_readdir);
+
+      for(i = 0; i < nb_batch; i++)
+        {
           p_pdirent[*p_nb_entries].nextentry = NULL;
           if(*p_nb_entries)
             p_pdirent[*p_nb_entries - 1].nextentry = &(p_pdirent[*p_nb_entries]);
 
-          //(*p_end_position) = p_pdirent[*p_nb_entries].cookie;
           memcpy((char *)p_end_position, (char *)&p_pdirent[*p_nb_entries].cookie,
                  sizeof(vfsfsal_cookie_t));
 
           (*p_nb_entries)++;
-
-        }                       /* for */
+        }
     }                           /* While */
 
   Return(ERR_FSAL_NO_ERROR, 0, INDEX_FSAL_readdir);
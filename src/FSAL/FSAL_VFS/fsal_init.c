@@ -75,6 +75,11 @@ fsal_status_t VFSFSAL_Init(fsal_parameter_t * init_info /* IN */
                                      &(init_info->fs_common_info),
                                      & (init_info->fs_specific_info));
 
+  if(FSAL_IS_ERROR(status))
+    Return(status.major, status.minor, INDEX_FSAL_Init);
+
+  status = vfsfsal_readdir_pool_init(init_info->fs_specific_info.readdir_threads);
+
   if(FSAL_IS_ERROR(status))
     Return(status.major, status.minor, INDEX_FSAL_Init);
 
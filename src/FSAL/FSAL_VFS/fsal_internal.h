@@ -116,6 +116,16 @@ fsal_status_t fsal_internal_fd2handle(  fsal_op_context_t * p_context,
 
 fsal_status_t fsal_internal_link_at(int srcfd, int dfd, char *name);
 
+/**
+ * Gets the handles and attributes of directory entries, in parallel.
+ */
+fsal_status_t vfsfsal_readdir_pool_init(unsigned int nb_threads);
+
+fsal_status_t vfsfsal_stat_entries(int dirfd, char **names,
+                                   fsal_dirent_t * p_dirents,
+                                   unsigned int nb_entries,
+                                   fsal_attrib_mask_t attr_mask);
+
 fsal_status_t fsal_stat_by_handle(fsal_op_context_t * p_context,
                                   fsal_handle_t * p_handle, struct stat64 *buf);
 
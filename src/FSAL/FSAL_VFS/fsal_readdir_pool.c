@@ -0,0 +1,318 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ *
+ * \file    fsal_readdir_pool.c
+ * \brief   Gets the handles and attributes of directory entries in parallel.
+ *
+ * FSAL_readdir returns each entry with its handle and attributes. Getting
+ * them costs two system calls per entry (fstatat and name_to_handle_at),
+ * which dominate the time to list a large directory. The entries read by
+ * one getdents are given as a batch to a pool of threads, the reading
+ * thread taking its share of the work, so that these calls are issued
+ * concurrently instead of one after the other.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <pthread.h>
+#include "fsal.h"
+#include "fsal_internal.h"
+#include "fsal_convert.h"
+#include "stuff_alloc.h"
+
+typedef struct vfsfsal_stat_batch__
+{
+  int dirfd;
+  char **names;
+  fsal_dirent_t *dirents;
+  fsal_status_t *status;
+  fsal_attrib_mask_t attr_mask;
+  unsigned int nb_entries;
+  unsigned int next;                    /* next entry to be handled, under the pool mutex */
+  unsigned int done;                    /* entries handled, under the batch mutex */
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct vfsfsal_stat_batch__ *next_batch;
+} vfsfsal_stat_batch_t;
+
+static struct vfsfsal_readdir_pool__
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  vfsfsal_stat_batch_t *head;           /* batches with entries left to hand out */
+  vfsfsal_stat_batch_t *tail;
+  unsigned int nb_threads;
+} readdir_pool =
+{
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0
+};
+
+/**
+ * vfsfsal_stat_entry:
+ * Gets the handle and the attributes of one entry of a batch.
+ */
+static void vfsfsal_stat_entry(vfsfsal_stat_batch_t * p_batch, unsigned int i)
+{
+  fsal_dirent_t *p_dirent = &p_batch->dirents[i];
+  struct stat buffstat;
+  fsal_status_t st;
+
+  TakeTokenFSCall();
+
+  if(fstatat(p_batch->dirfd, p_batch->names[i], &buffstat, AT_SYMLINK_NOFOLLOW) < 0)
+    {
+      ReleaseTokenFSCall();
+      p_batch->status[i].major = posix2fsal_error(errno);
+      p_batch->status[i].minor = errno;
+      return;
+    }
+
+  st = fsal_internal_get_handle_at(p_batch->dirfd, p_batch->names[i], &p_dirent->handle);
+  if(FSAL_IS_ERROR(st))
+    {
+      ReleaseTokenFSCall();
+      p_batch->status[i] = st;
+      return;
+    }
+
+  ReleaseTokenFSCall();
+
+  p_dirent->attributes.asked_attributes = p_batch->attr_mask;
+
+  st = posix2fsal_attributes(&buffstat, &p_dirent->attributes);
+  if(FSAL_IS_ERROR(st))
+    {
+      FSAL_CLEAR_MASK(p_dirent->attributes.asked_attributes);
+      FSAL_SET_MASK(p_dirent->attributes.asked_attributes, FSAL_ATTR_RDATTR_ERR);
+    }
+
+  p_batch->status[i] = st;
+}                               /* vfsfsal_stat_entry */
+
+/**
+ * vfsfsal_take_entry:
+ * Takes the next entry of the first batch in the queue.
+ * Must be called with the pool mutex held.
+ *
+ * \return the batch of the entry, NULL if no batch is queued, *p_index
+ *         is then left unchanged.
+ */
+static vfsfsal_stat_batch_t *vfsfsal_take_entry(unsigned int *p_index)
+{
+  vfsfsal_stat_batch_t *p_batch = readdir_pool.head;
+
+  if(p_batch == NULL)
+    return NULL;
+
+  *p_index = p_batch->next++;
+
+  /* All of its entries are handed out, the batch leaves the queue */
+  if(p_batch->next == p_batch->nb_entries)
+    {
+      readdir_pool.head = p_batch->next_batch;
+      if(readdir_pool.head == NULL)
+        readdir_pool.tail = NULL;
+    }
+
+  return p_batch;
+}                               /* vfsfsal_take_entry */
+
+/**
+ * vfsfsal_entry_done:
+ * Counts an entry as handled, and wakes up the owner of the batch
+ * once they all are.
+ */
+static void vfsfsal_entry_done(vfsfsal_stat_batch_t * p_batch)
+{
+  pthread_mutex_lock(&p_batch->mutex);
+  p_batch->done += 1;
+  if(p_batch->done == p_batch->nb_entries)
+    pthread_cond_signal(&p_batch->cond);
+  pthread_mutex_unlock(&p_batch->mutex);
+}                               /* vfsfsal_entry_done */
+
+static void *vfsfsal_readdir_thread(void *arg)
+{
+  vfsfsal_stat_batch_t *p_batch;
+  unsigned int index;
+
+  SetNameFunction("VFS readdir");
+
+  while(1)
+    {
+      pthread_mutex_lock(&readdir_pool.mutex);
+      while((p_batch = vfsfsal_take_entry(&index)) == NULL)
+        pthread_cond_wait(&readdir_pool.cond, &readdir_pool.mutex);
+      pthread_mutex_unlock(&readdir_pool.mutex);
+
+      vfsfsal_stat_entry(p_batch, index);
+      vfsfsal_entry_done(p_batch);
+    }
+
+  return NULL;
+}                               /* vfsfsal_readdir_thread */
+
+/**
+ * vfsfsal_readdir_pool_init:
+ * Starts the threads getting the attributes of the directory entries.
+ *
+ * \param nb_threads (input):
+ *        Number of threads, 0 to get the attributes in the reading thread.
+ *
+ * \return ERR_FSAL_NO_ERROR, or ERR_FSAL_SERVERFAULT if a thread
+ *         could not be started.
+ */
+fsal_status_t vfsfsal_readdir_pool_init(unsigned int nb_threads)
+{
+  pthread_attr_t attr_thr;
+  pthread_t thrid;
+  unsigned int i;
+  int rc;
+
+  pthread_attr_init(&attr_thr);
+  pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM);
+  pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_DETACHED);
+
+  for(i = 0; i < nb_threads; i++)
+    {
+      if((rc = pthread_create(&thrid, &attr_thr, vfsfsal_readdir_thread, NULL)) != 0)
+        {
+          LogCrit(COMPONENT_FSAL,
+                  "FSAL INIT: could not start readdir thread #%u, error %d", i, rc);
+          pthread_attr_destroy(&attr_thr);
+          ReturnCode(ERR_FSAL_SERVERFAULT, rc);
+        }
+
+      pthread_mutex_lock(&readdir_pool.mutex);
+      readdir_pool.nb_threads += 1;
+      pthread_mutex_unlock(&readdir_pool.mutex);
+    }
+
+  pthread_attr_destroy(&attr_thr);
+
+  LogDebug(COMPONENT_FSAL,
+           "FSAL INIT: %u threads get the attributes of the directory entries",
+           nb_threads);
+
+  ReturnCode(ERR_FSAL_NO_ERROR, 0);
+}                               /* vfsfsal_readdir_pool_init */
+
+/**
+ * vfsfsal_stat_entries:
+ * Gets the handles and the attributes of entries of a directory.
+ *
+ * \param dirfd (input):
+ *        The directory, opened.
+ * \param names (input):
+ *        The names of the entries.
+ * \param p_dirents (output):
+ *        Their handles and attributes are stored there.
+ * \param nb_entries (input):
+ *        Number of entries.
+ * \param attr_mask (input):
+ *        Attributes asked.
+ *
+ * \return The status of the first entry in error, in their order,
+ *         ERR_FSAL_NO_ERROR if none is.
+ */
+fsal_status_t vfsfsal_stat_entries(int dirfd, char **names,
+                                   fsal_dirent_t * p_dirents,
+                                   unsigned int nb_entries,
+                                   fsal_attrib_mask_t attr_mask)
+{
+  vfsfsal_stat_batch_t batch;
+  vfsfsal_stat_batch_t *p_batch;
+  fsal_status_t *status;
+  unsigned int i;
+  unsigned int index = 0;
+
+  if(nb_entries == 0)
+    ReturnCode(ERR_FSAL_NO_ERROR, 0);
+
+  if((status = (fsal_status_t *) Mem_Alloc(nb_entries * sizeof(fsal_status_t))) == NULL)
+    ReturnCode(ERR_FSAL_NOMEM, 0);
+
+  batch.dirfd = dirfd;
+  batch.names = names;
+  batch.dirents = p_dirents;
+  batch.status = status;
+  batch.attr_mask = attr_mask;
+  batch.nb_entries = nb_entries;
+  batch.next = 0;
+  batch.done = 0;
+  batch.next_batch = NULL;
+
+  if(readdir_pool.nb_threads == 0 || nb_entries == 1)
+    {
+      for(i = 0; i < nb_entries; i++)
+        vfsfsal_stat_entry(&batch, i);
+    }
+  else
+    {
+      pthread_mutex_init(&batch.mutex, NULL);
+      pthread_cond_init(&batch.cond, NULL);
+
+      pthread_mutex_lock(&readdir_pool.mutex);
+      if(readdir_pool.tail == NULL)
+        readdir_pool.head = &batch;
+      else
+        readdir_pool.tail->next_batch = &batch;
+      readdir_pool.tail = &batch;
+      pthread_cond_broadcast(&readdir_pool.cond);
+
+      /* Take a share of the work, of this batch or of the ones queued before */
+      while(batch.next < batch.nb_entries)
+        {
+          p_batch = vfsfsal_take_entry(&index);
+          pthread_mutex_unlock(&readdir_pool.mutex);
+
+          vfsfsal_stat_entry(p_batch, index);
+          vfsfsal_entry_done(p_batch);
+
+          pthread_mutex_lock(&readdir_pool.mutex);
+        }
+      pthread_mutex_unlock(&readdir_pool.mutex);
+
+      /* Wait for the entries being handled by the pool */
+      pthread_mutex_lock(&batch.mutex);
+      while(batch.done < batch.nb_entries)
+        pthread_cond_wait(&batch.cond, &batch.mutex);
+      pthread_mutex_unlock(&batch.mutex);
+
+      pthread_mutex_destroy(&batch.mutex);
+      pthread_cond_destroy(&batch.cond);
+    }
+
+  for(i = 0; i < nb_entries; i++)
+    if(FSAL_IS_ERROR(status[i]))
+      {
+        fsal_status_t st = status[i];
+
+        Mem_Free(status);
+        return st;
+      }
+
+  Mem_Free(status);
+  ReturnCode(ERR_FSAL_NO_ERROR, 0);
+}                               /* vfsfsal_stat_entries */
@@ -403,6 +403,8 @@ q  strcpy(out_parameter->fs_specific_info.dbparams.host, "localhost");
 
 #endif
 
+  out_parameter->fs_specific_info.readdir_threads = VFS_READDIR_THREADS_DEFAULT;
+
   ReturnCode(ERR_FSAL_NO_ERROR, 0);
 
 }
@@ -436,6 +438,72 @@ fsal_status_t VFSFSAL_load_FS_specific_parameter_from_conf(config_file_t in_conf
                                                            fsal_parameter_t *
                                                            out_parameter)
 {
+  int err;
+  int var_max, var_index;
+  char *key_name;
+  char *key_value;
+  config_item_t block;
+  vfsfs_specific_initinfo_t *initinfo
+      = (vfsfs_specific_initinfo_t *) &out_parameter->fs_specific_info;
+
+  block = config_FindItemByName(in_config, CONF_LABEL_FS_SPECIFIC);
+
+  /* the block is optional, the defaults are kept */
+  if(block == NULL)
+    ReturnCode(ERR_FSAL_NO_ERROR, 0);
+  else if(config_ItemType(block) != CONFIG_ITEM_BLOCK)
+    {
+      LogCrit(COMPONENT_CONFIG,
+              "FSAL LOAD PARAMETER: Item \"%s\" is expected to be a block",
+              CONF_LABEL_FS_SPECIFIC);
+      ReturnCode(ERR_FSAL_INVAL, 0);
+    }
+
+  var_max = config_GetNbItems(block);
+
+  for(var_index = 0; var_index < var_max; var_index++)
+    {
+      config_item_t item;
+
+      item = config_GetItemByIndex(block, var_index);
+
+      err = config_GetKeyValue(item, &key_name, &key_value);
+      if(err)
+        {
+          LogCrit(COMPONENT_CONFIG,
+                  "FSAL LOAD PARAMETER: ERROR reading key[%d] from section \"%s\" of configuration file.",
+                  var_index, CONF_LABEL_FS_SPECIFIC);
+          ReturnCode(ERR_FSAL_SERVERFAULT, err);
+        }
+      /* does the variable exists ? */
+      if(!STRCMP(key_name, "Readdir_Threads"))
+        {
+          int threads = s_read_int(key_value);
+
+          if(threads < 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "FSAL LOAD PARAMETER: ERROR: Unexpected value for %s: null or positive integer expected.",
+                      key_name);
+              ReturnCode(ERR_FSAL_INVAL, 0);
+            }
+          initinfo->readdir_threads = threads;
+        }
+      else if(!STRCMP(key_name, "OpenByHandleDeviceFile"))
+        {
+          /* No longer used: handles come from name_to_handle_at */
+          LogDebug(COMPONENT_CONFIG,
+                   "FSAL LOAD PARAMETER: %s is ignored (item %s)",
+                   key_name, CONF_LABEL_FS_SPECIFIC);
+        }
+      else
+        {
+          LogCrit(COMPONENT_CONFIG,
+                  "FSAL LOAD PARAMETER: ERROR: Unknown or unsettable key: %s (item %s)",
+                  key_name, CONF_LABEL_FS_SPECIFIC);
+          ReturnCode(ERR_FSAL_INVAL, 0);
+        }
+    }
 
   ReturnCode(ERR_FSAL_NO_ERROR, 0);
 
@@ -292,7 +292,7 @@ fsal_status_t XFSFSAL_setattrs(fsal_handle_t * p_filehandle, /* IN */
       else
         for(i = 0; i < ((xfsfsal_op_context_t *)p_context)->credential.nbgroups; i++)
           {
-            if((in_grp = (attrs.group == ((xfsfsal_op_context_t *)p_context)->credential.alt_groups[i])))
+            if((in_grp = (attrs.group == FSAL_CRED_GROUPS(&((xfsfsal_op_context_t *)p_context)->credential)[i])))
               break;
           }
 
@@ -77,9 +77,13 @@ fsal_status_t COMMON_GetClientContext(fsal_op_context_t * p_thr_context,  /* IN/
   p_thr_context->credential.user = uid;
   p_thr_context->credential.group = gid;
 
-  if(ng > FSAL_NGROUPS_MAX) /* this artificially truncates the group list ! */
-	  ng = FSAL_NGROUPS_MAX;
+  /* Past FSAL_NGROUPS_MAX, the list of the caller is used as is */
   p_thr_context->credential.nbgroups = ng;
+  p_thr_context->credential.ext_groups = NULL;
+  if(ng > FSAL_NGROUPS_MAX) {
+	  p_thr_context->credential.ext_groups = alt_groups;
+	  ng = FSAL_NGROUPS_MAX;
+  }
 
   for(i = 0; i < ng; i++)
 	  p_thr_context->credential.alt_groups[i] = alt_groups[i];
@@ -92,7 +96,7 @@ fsal_status_t COMMON_GetClientContext(fsal_op_context_t * p_thr_context,  /* IN/
 		       p_thr_context->credential.group);
 	  for(i = 0; i < p_thr_context->credential.nbgroups; i++)
 		  LogFullDebug(COMPONENT_FSAL, "\tAlt grp: %d",
-			       p_thr_context->credential.alt_groups[i]);
+			       FSAL_CRED_GROUPS(&p_thr_context->credential)[i]);
   }
   Return(ERR_FSAL_NO_ERROR, 0, INDEX_FSAL_GetClientContext);
 }
@@ -187,6 +187,9 @@ cache_content_entry_t *cache_content_new_entry(cache_entry_t * pentry_inode,
   /* Set the local fd info */
   pfc_pentry->local_fs_entry.opened_file.local_fd = -1;
   pfc_pentry->local_fs_entry.opened_file.last_op = 0;
+  pfc_pentry->local_fs_entry.opened_file.seq_offset = 0;
+  pfc_pentry->local_fs_entry.opened_file.readahead_end = 0;
+  pfc_pentry->local_fs_entry.write_count = 0;
 
   /* Dump the inode entry to the index file */
   if(cache_inode_dump_content(pfc_pentry->local_fs_entry.cache_path_index, pentry_inode) 
@@ -0,0 +1,202 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    cache_content_aio.c
+ * \brief   Asynchronous I/O on the local data cache.
+ *
+ * cache_content_aio.c : A pool of I/O threads reads ahead of the sequential
+ * readers of the local cache files, so that the pages they are about to read
+ * are brought in the page cache while their worker serves other requests.
+ *
+ * Readahead hints are kept in a fixed ring, and are dropped when it is full.
+ * With no I/O thread, there is no readahead.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include "log.h"
+#include "stuff_alloc.h"
+#include "cache_content.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct cache_content_readahead__
+{
+  int fd;                       /* duplicated, closed once the readahead is done */
+  off_t offset;
+  size_t size;
+} cache_content_readahead_t;
+
+static struct cache_content_aio_engine__
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unsigned int nb_threads;
+  cache_content_readahead_t readahead[CACHE_CONTENT_AIO_READAHEAD_SLOTS];
+  unsigned int readahead_first;
+  unsigned int readahead_count;
+} aio_engine =
+{
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0
+};
+
+static void cache_content_aio_serve_readahead(cache_content_readahead_t * pra)
+{
+#ifdef POSIX_FADV_WILLNEED
+  /* Starts reading the pages into the page cache */
+  posix_fadvise(pra->fd, pra->offset, pra->size, POSIX_FADV_WILLNEED);
+#endif
+  close(pra->fd);
+}                               /* cache_content_aio_serve_readahead */
+
+static void *cache_content_aio_thread(void *arg)
+{
+  cache_content_readahead_t readahead;
+
+  SetNameFunction("cache_content_aio");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    LogFatal(COMPONENT_CACHE_CONTENT,
+             "Memory manager could not be initialized for a data cache I/O thread");
+#endif
+
+  for(;;)
+    {
+      P(aio_engine.mutex);
+
+      while(aio_engine.readahead_count == 0)
+        pthread_cond_wait(&aio_engine.cond, &aio_engine.mutex);
+
+      readahead = aio_engine.readahead[aio_engine.readahead_first];
+      aio_engine.readahead_first =
+          (aio_engine.readahead_first + 1) % CACHE_CONTENT_AIO_READAHEAD_SLOTS;
+      aio_engine.readahead_count -= 1;
+
+      V(aio_engine.mutex);
+
+      cache_content_aio_serve_readahead(&readahead);
+    }
+
+  return NULL;
+}                               /* cache_content_aio_thread */
+
+/**
+ *
+ * cache_content_aio_init: starts the I/O threads of the local data cache.
+ *
+ * @param nb_threads [IN] number of I/O threads, 0 for no readahead.
+ *
+ * @return 0 if successful, the error of pthread_create otherwise.
+ *
+ */
+int cache_content_aio_init(unsigned int nb_threads)
+{
+  pthread_attr_t attr_thr;
+  pthread_t thrid;
+  unsigned int i;
+  int rc;
+
+  pthread_attr_init(&attr_thr);
+  pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM);
+  pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_DETACHED);
+
+  for(i = 0; i < nb_threads; i++)
+    {
+      if((rc = pthread_create(&thrid, &attr_thr, cache_content_aio_thread, NULL)) != 0)
+        {
+          LogCrit(COMPONENT_CACHE_CONTENT,
+                  "Could not start data cache I/O thread #%u, error %d", i, rc);
+          return rc;
+        }
+
+      /* Readaheads are queued as soon as a thread is there */
+      P(aio_engine.mutex);
+      aio_engine.nb_threads += 1;
+      V(aio_engine.mutex);
+    }
+
+  LogInfo(COMPONENT_CACHE_CONTENT, "%u data cache I/O threads started", nb_threads);
+
+  return 0;
+}                               /* cache_content_aio_init */
+
+/**
+ *
+ * cache_content_aio_readahead: asks for a range of a local file to be read ahead.
+ *
+ * This is a hint: it is ignored when there is no I/O thread or when too
+ * many readaheads are pending. The caller may close fd at once.
+ *
+ * @param fd     [IN] the local file
+ * @param offset [IN] start of the range
+ * @param size   [IN] length of the range
+ *
+ * @return nothing (void function)
+ *
+ */
+void cache_content_aio_readahead(int fd, off_t offset, size_t size)
+{
+  cache_content_readahead_t *pra;
+  int dupfd;
+
+  if(aio_engine.nb_threads == 0 || size == 0)
+    return;
+
+  if((dupfd = dup(fd)) == -1)
+    return;
+
+  P(aio_engine.mutex);
+
+  if(aio_engine.readahead_count == CACHE_CONTENT_AIO_READAHEAD_SLOTS)
+    {
+      V(aio_engine.mutex);
+      close(dupfd);
+      return;
+    }
+
+  pra = &aio_engine.readahead[(aio_engine.readahead_first + aio_engine.readahead_count)
+                              % CACHE_CONTENT_AIO_READAHEAD_SLOTS];
+  pra->fd = dupfd;
+  pra->offset = offset;
+  pra->size = size;
+  aio_engine.readahead_count += 1;
+
+  pthread_cond_signal(&aio_engine.cond);
+
+  V(aio_engine.mutex);
+}                               /* cache_content_aio_readahead */
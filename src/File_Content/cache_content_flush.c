@@ -50,6 +50,9 @@
 #include "cache_content.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include <time.h>
@@ -57,6 +60,65 @@
 #include <errno.h>
 #include <string.h>
 
+/**
+ *
+ * cache_content_copy_file: copies a local data file.
+ *
+ * @param src    [IN] path of the file to be copied.
+ * @param fd_dst [IN] fd of the copy, closed when done.
+ *
+ * @return 0 if successful, an errno otherwise.
+ *
+ */
+static int cache_content_copy_file(char *src, int fd_dst)
+{
+  char buffer[CACHE_CONTENT_FLUSH_BUFFER_SIZE];
+  ssize_t nb_read;
+  ssize_t nb_written;
+  ssize_t done;
+  int fd_src;
+  int rc = 0;
+
+  if((fd_src = open(src, O_RDONLY)) == -1)
+    {
+      rc = errno;
+      close(fd_dst);
+      return rc;
+    }
+
+  while((nb_read = read(fd_src, buffer, CACHE_CONTENT_FLUSH_BUFFER_SIZE)) != 0)
+    {
+      if(nb_read == -1)
+        {
+          if(errno == EINTR)
+            continue;
+          rc = errno;
+          break;
+        }
+
+      for(done = 0; done < nb_read; done += nb_written)
+        if((nb_written = write(fd_dst, buffer + done, nb_read - done)) == -1)
+          {
+            if(errno == EINTR)
+              {
+                nb_written = 0;
+                continue;
+              }
+            rc = errno;
+            break;
+          }
+
+      if(rc != 0)
+        break;
+    }
+
+  close(fd_src);
+  if(close(fd_dst) == -1 && rc == 0)
+    rc = errno;
+
+  return rc;
+}                               /* cache_content_copy_file */
+
 /**
  *
  * cache_content_flush: Flushes the content of a file in the local cache to the FSAL data. 
@@ -64,8 +126,10 @@
  * Flushes the content of a file in the local cache to the FSAL data. 
  * This routine should be called only from the cache_inode layer. 
  *
- * No lock management is done in this layer: the related pentry in the cache inode layer is 
- * locked and will prevent from concurent accesses.
+ * The related pentry in the cache inode layer is write locked only while the
+ * data file is copied to a snapshot, not while the snapshot is sent to the
+ * FSAL, so that the clients of the file are not stalled by the flush. If the
+ * file was written meanwhile, it is left dirty for the next flush.
  *
  * @param pentry   [IN]  entry in file content layer whose content is to be flushed.
  * @param flushhow [IN]  should we delete the cached entry in local or not ? 
@@ -84,16 +148,24 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
   fsal_handle_t *pfsal_handle = NULL;
   fsal_status_t fsal_status;
   cache_inode_status_t cache_inode_status;
+  cache_entry_t *pentry_inode = NULL;
   fsal_path_t local_path;
+  char snapshot_path[MAXPATHLEN];
+  unsigned int write_count;
+  int fd_snapshot;
+  int rc;
 
   *pstatus = CACHE_CONTENT_SUCCESS;
 
   /* stat */
   pclient->stat.func_stats.nb_call[CACHE_CONTENT_FLUSH] += 1;
 
+  /* Get the related cache inode entry */
+  pentry_inode = (cache_entry_t *) pentry->pentry_inode;
+
   /* Get the fsal handle */
   if((pfsal_handle =
-      cache_inode_get_fsal_handle(pentry->pentry_inode, &cache_inode_status)) == NULL)
+      cache_inode_get_fsal_handle(pentry_inode, &cache_inode_status)) == NULL)
     {
       *pstatus = CACHE_CONTENT_BAD_CACHE_INODE_ENTRY;
 
@@ -105,25 +177,75 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
       return *pstatus;
     }
 
-  /* Lock related Cache Inode pentry to avoid concurrency while read/write operation */
-  P_w(&pentry->pentry_inode->lock);
+  /* Each flush has its own snapshot: the gc thread and the administration
+   * commands may flush the same entry at the same time */
+  if(snprintf(snapshot_path, MAXPATHLEN, "%s.flush.XXXXXX",
+              pentry->local_fs_entry.cache_path_data) >= MAXPATHLEN)
+    {
+      LogCrit(COMPONENT_CACHE_CONTENT, "Path %s is too long to be flushed",
+              pentry->local_fs_entry.cache_path_data);
+
+      *pstatus = CACHE_CONTENT_LOCAL_CACHE_ERROR;
+
+      /* stat */
+      pclient->stat.func_stats.nb_err_unrecover[CACHE_CONTENT_FLUSH] += 1;
+
+      return *pstatus;
+    }
+
+  if((fd_snapshot = mkstemp(snapshot_path)) == -1)
+    {
+      LogCrit(COMPONENT_CACHE_CONTENT, "Can't create %s for flushing, errno=%u(%s)",
+              snapshot_path, errno, strerror(errno));
+
+      *pstatus = CACHE_CONTENT_LOCAL_CACHE_ERROR;
+
+      /* stat */
+      pclient->stat.func_stats.nb_err_unrecover[CACHE_CONTENT_FLUSH] += 1;
+
+      return *pstatus;
+    }
 
   /* Convert the path to FSAL path */
-  fsal_status =
-      FSAL_str2path(pentry->local_fs_entry.cache_path_data, MAXPATHLEN, &local_path);
+  fsal_status = FSAL_str2path(snapshot_path, MAXPATHLEN, &local_path);
 
   if(FSAL_IS_ERROR(fsal_status))
     {
+      close(fd_snapshot);
+      unlink(snapshot_path);
+
       *pstatus = CACHE_CONTENT_FSAL_ERROR;
 
-      /* Unlock related Cache Inode pentry */
-      V_w(&pentry->pentry_inode->lock);
+      /* stat */
+      pclient->stat.func_stats.nb_err_unrecover[CACHE_CONTENT_FLUSH] += 1;
+
+      return *pstatus;
+    }
+
+  /* Lock related Cache Inode pentry to avoid concurrency while the data file is copied */
+  P_w(&pentry_inode->lock);
+
+  write_count = pentry->local_fs_entry.write_count;
+
+  rc = cache_content_copy_file(pentry->local_fs_entry.cache_path_data, fd_snapshot);
+
+  /* Unlock related Cache Inode pentry */
+  V_w(&pentry_inode->lock);
+
+  if(rc != 0)
+    {
+      LogCrit(COMPONENT_CACHE_CONTENT, "Can't copy %s to %s for flushing, errno=%u(%s)",
+              pentry->local_fs_entry.cache_path_data, snapshot_path, rc, strerror(rc));
+      unlink(snapshot_path);
+
+      *pstatus = CACHE_CONTENT_LOCAL_CACHE_ERROR;
 
       /* stat */
       pclient->stat.func_stats.nb_err_unrecover[CACHE_CONTENT_FLUSH] += 1;
 
       return *pstatus;
     }
+
 #if ( defined( _USE_PROXY ) && defined( _BY_NAME) )
   fsal_status =
       FSAL_rcp_by_name(
@@ -131,10 +253,12 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
           pentry_inode->object.file.pname, pcontext, &local_path,
           FSAL_RCP_LOCAL_TO_FS);
 #else
-  /* Write the data from the local data file to the fs file */
+  /* Write the data from the snapshot of the local data file to the fs file */
   fsal_status = FSAL_rcp(pfsal_handle, pcontext, &local_path, FSAL_RCP_LOCAL_TO_FS);
 #endif
 
+  unlink(snapshot_path);
+
   if(FSAL_IS_ERROR(fsal_status))
     {
 #if ( defined( _USE_PROXY ) && defined( _BY_NAME) )
@@ -147,9 +271,6 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
                         fsal_status.minor);
 #endif
 
-      /* Unlock related Cache Inode pentry */
-      V_w(&pentry->pentry_inode->lock);
-
       *pstatus = CACHE_CONTENT_FSAL_ERROR;
 
       /* stat */
@@ -158,6 +279,29 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
       return *pstatus;
     }
 
+  P_w(&pentry_inode->lock);
+
+  /* The entry may have been released from the data cache while unlocked */
+  if(pentry_inode->object.file.pentry_content != pentry)
+    {
+      V_w(&pentry_inode->lock);
+
+      pclient->stat.func_stats.nb_success[CACHE_CONTENT_FLUSH] += 1;
+      return *pstatus;
+    }
+
+  /* If the file was written during the copy, what was sent is already stale */
+  if(pentry->local_fs_entry.write_count != write_count)
+    {
+      V_w(&pentry_inode->lock);
+
+      LogDebug(COMPONENT_CACHE_CONTENT,
+               "Entry %p was written while flushed, keeping it dirty", pentry);
+
+      pclient->stat.func_stats.nb_success[CACHE_CONTENT_FLUSH] += 1;
+      return *pstatus;
+    }
+
   /* To delete or not to delete ? That is the question ... */
   if(flushhow == CACHE_CONTENT_FLUSH_AND_DELETE)
     {
@@ -165,7 +309,7 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
       if(unlink(pentry->local_fs_entry.cache_path_index))
         {
           /* Unlock related Cache Inode pentry */
-          V_w(&pentry->pentry_inode->lock);
+          V_w(&pentry_inode->lock);
 
           LogCrit(COMPONENT_CACHE_CONTENT, "Can't unlink flushed index %s, errno=%u(%s)",
                      pentry->local_fs_entry.cache_path_index, errno, strerror(errno));
@@ -177,7 +321,7 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
       if(unlink(pentry->local_fs_entry.cache_path_data))
         {
           /* Unlock related Cache Inode pentry */
-          V_w(&pentry->pentry_inode->lock);
+          V_w(&pentry_inode->lock);
 
           LogCrit(COMPONENT_CACHE_CONTENT, "Can't unlink flushed index %s, errno=%u(%s)",
                      pentry->local_fs_entry.cache_path_data, errno, strerror(errno));
@@ -186,16 +330,16 @@ cache_content_status_t cache_content_flush(cache_content_entry_t * pentry,
         }
     }
 
+  /* Update the internal metadata */
+  pentry->internal_md.last_flush_time = time(NULL);
+  pentry->local_fs_entry.sync_state = SYNC_OK;
+
   /* Unlock related Cache Inode pentry */
-  V_w(&pentry->pentry_inode->lock);
+  V_w(&pentry_inode->lock);
 
   /* Exit the function with no error */
   pclient->stat.func_stats.nb_success[CACHE_CONTENT_FLUSH] += 1;
 
-  /* Update the internal metadata */
-  pentry->internal_md.last_flush_time = time(NULL);
-  pentry->local_fs_entry.sync_state = SYNC_OK;
-
   return *pstatus;
 }                               /* cache_content_flush */
 
@@ -134,6 +134,7 @@ int cache_content_client_init(cache_content_client_t * pclient,
   pclient->max_fd = param.max_fd ;
   pclient->retention = param.retention;
   pclient->use_fd_cache = param.use_fd_cache;
+  pclient->readahead_size = param.readahead_size;
   strncpy(pclient->cache_dir, param.cache_dir, MAXPATHLEN);
 
   MakePool(&pclient->content_pool, pclient->nb_prealloc, cache_content_entry_t,
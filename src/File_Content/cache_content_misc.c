@@ -530,6 +530,7 @@ cache_content_status_t cache_content_valid(cache_content_entry_t * pentry,
       pentry->internal_md.mod_time = time(NULL);
       pentry->internal_md.refresh_time = pentry->internal_md.mod_time;
       pentry->local_fs_entry.sync_state = FLUSH_NEEDED;
+      pentry->local_fs_entry.write_count += 1;
       break;
 
     case CACHE_CONTENT_OP_FLUSH:
@@ -61,6 +61,51 @@
 
 /* Missing prototypes */
 
+/**
+ *
+ * cache_content_readahead: reads ahead of sequential reads.
+ *
+ * Once a read follows the previous one, the readahead window is kept at
+ * least half of Readahead_Size ahead of the reader.
+ *
+ * @param pentry  [INOUT] entry in file content layer that was read.
+ * @param pclient [IN]    ressource allocated by the client for the nfs management.
+ * @param offset  [IN]    offset of the read.
+ * @param size    [IN]    bytes read.
+ *
+ * @return nothing (void function)
+ *
+ */
+static void cache_content_readahead(cache_content_entry_t * pentry,
+                                    cache_content_client_t * pclient,
+                                    off_t offset, size_t size)
+{
+  cache_content_opened_file_t *pfile = &pentry->local_fs_entry.opened_file;
+  off_t end = offset + size;
+  off_t start;
+
+  if(pclient->readahead_size == 0 || size == 0)
+    return;
+
+  if(offset != pfile->seq_offset)
+    {
+      /* Random access, start over */
+      pfile->seq_offset = end;
+      pfile->readahead_end = 0;
+      return;
+    }
+
+  pfile->seq_offset = end;
+
+  if(pfile->readahead_end - end >= (off_t) (pclient->readahead_size / 2))
+    return;
+
+  start = (pfile->readahead_end > end) ? pfile->readahead_end : end;
+  pfile->readahead_end = end + pclient->readahead_size;
+
+  cache_content_aio_readahead(pfile->local_fd, start, pfile->readahead_end - start);
+}                               /* cache_content_readahead */
+
 /**
  *
  * cache_content_open: opens the local fd on  the cache.
@@ -336,8 +381,8 @@ cache_content_status_t cache_content_rdwr(cache_content_entry_t * pentry,
           return *pstatus;
         }
 
-      /* Get the eof */
-      if(iosize_after == 0)
+      /* Get the eof, a short read of the local file means it was reached */
+      if((size_t) iosize_after < iosize_before)
         *p_fsal_eof = TRUE;
       else
         {
@@ -348,6 +393,9 @@ cache_content_status_t cache_content_rdwr(cache_content_entry_t * pentry,
           else
             *p_fsal_eof = FALSE;
         }
+
+      if(*p_fsal_eof == FALSE)
+        cache_content_readahead(pentry, pclient, offset, iosize_after);
     }
   else
     {
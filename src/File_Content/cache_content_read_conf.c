@@ -168,6 +168,14 @@ cache_content_status_t cache_content_read_conf_client_parameter(config_file_t in
         {
           pparam->use_fd_cache = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "AIO_Threads"))
+        {
+          pparam->aio_threads = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Readahead_Size"))
+        {
+          pparam->readahead_size = atoi(key_value);
+        }
       else
         {
           fprintf(stderr,
@@ -219,6 +227,9 @@ void cache_content_print_conf_client_parameter(FILE * output,
   fprintf(output, "FileContent Client: Entry_Prealloc_PoolSize = %d\n",
           param.nb_prealloc_entry);
   fprintf(output, "FileContent Client: Cache Directory         = %s\n", param.cache_dir);
+  fprintf(output, "FileContent Client: AIO_Threads             = %u\n", param.aio_threads);
+  fprintf(output, "FileContent Client: Readahead_Size          = %zu\n",
+          param.readahead_size);
 }                               /* cache_content_print_conf_client_parameter */
 
 /**
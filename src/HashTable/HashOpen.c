@@ -0,0 +1,895 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    HashOpen.c
+ * \brief   Open addressing backend for the hash tables.
+ *
+ * HashOpen.c : Each partition of the table is a flat array of slots, probed
+ * linearly from a position derived from the rbt value of the key. A parallel
+ * array of 64 bits fingerprints (rbt value and key length) is scanned first,
+ * so that a probe only touches the slot itself when it is very likely to hold
+ * the key.
+ *
+ * Writers take the partition lock and make the sequence counter odd while
+ * they modify the arrays. When the table says its keys are buffers
+ * (parameter.inline_keys), short keys are copied into their slot, which lets
+ * HashTable_Get run without any lock: it copies the candidate slot, compares
+ * the copy, then checks that the sequence counter did not move. Longer keys,
+ * keys that are values, or lookups that take a reference, use the read lock.
+ *
+ * A partition grows by doubling its array when it is 3/4 full, counting the
+ * deleted slots. The old array is chained to the new one, since a lockless
+ * reader may still be scanning it, and freed by the first writer that finds
+ * no lockless reader in the partition; until then this costs at most as much
+ * memory as the current array. When the deleted slots alone fill the array,
+ * it is rebuilt in place: the readers see the sequence counter move and retry.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "RW_Lock.h"
+#include "HashTable.h"
+#include "abstract_atomic.h"
+#include "stuff_alloc.h"
+#include "log.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Fingerprint of a slot that never held anything, and of a deleted one. */
+#define HASHOPEN_EMPTY   0LL
+#define HASHOPEN_DELETED 1LL
+
+#define HASHOPEN_MIN_SIZE 8
+#define HASHOPEN_MAX_INITIAL_SIZE 1024
+
+/* Number of lockless attempts before a reader falls back on the lock */
+#define HASHOPEN_OPTIMISTIC_RETRY 4
+
+/**
+ *
+ * HashOpen_Values: Computes the partition and the rbt value of a key.
+ *
+ * @param ht [IN] the hashtable.
+ * @param buffkey [IN] the key.
+ * @param phashval [OUT] the partition.
+ * @param prbt_value [OUT] the value the probe sequence and fingerprint derive from.
+ *
+ * @return HASHTABLE_SUCCESS if ok, HASHTABLE_ERROR_INVALID_ARGUMENT if the key could not be hashed.
+ *
+ */
+static int HashOpen_Values(hash_table_t * ht, hash_buffer_t * buffkey,
+                           uint32_t * phashval, uint32_t * prbt_value)
+{
+  if(ht->parameter.hash_func_both != NULL)
+    {
+      if((*(ht->parameter.hash_func_both)) (&ht->parameter, buffkey, phashval, prbt_value) == 0)
+        return HASHTABLE_ERROR_INVALID_ARGUMENT;
+    }
+  else
+    {
+      *phashval = (*(ht->parameter.hash_func_key)) (&ht->parameter, buffkey);
+      *prbt_value = (*(ht->parameter.hash_func_rbt)) (&ht->parameter, buffkey);
+    }
+
+  if(*phashval >= ht->parameter.index_size)
+    return HASHTABLE_ERROR_INVALID_ARGUMENT;
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_Values */
+
+static inline uint64_t HashOpen_Fingerprint(uint32_t rbt_value, size_t len)
+{
+  /* Bit 1 is always set so a fingerprint never looks like an empty or deleted slot */
+  return ((uint64_t) rbt_value << 32) | ((uint64_t) (len & 0x3fffffff) << 2) | 2LL;
+}                               /* HashOpen_Fingerprint */
+
+static inline unsigned int HashOpen_FirstSlot(hash_open_array_t * array, uint32_t rbt_value)
+{
+  uint32_t h = rbt_value;
+
+  /* rbt values are often small integers, spread them over the whole array */
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+
+  return h & (array->size - 1);
+}                               /* HashOpen_FirstSlot */
+
+static hash_open_array_t *HashOpen_AllocArray(unsigned int size)
+{
+  hash_open_array_t *array;
+  size_t len;
+
+  len = sizeof(hash_open_array_t) + size * (sizeof(uint64_t) + sizeof(hash_open_slot_t));
+
+  if((array = (hash_open_array_t *) Mem_Alloc_Label(len, "hash_open_array_t")) == NULL)
+    return NULL;
+
+  memset((char *)array, 0, len);
+
+  array->size = size;
+  array->fingerprint = (uint64_t *) (array + 1);
+  array->slot = (hash_open_slot_t *) (array->fingerprint + size);
+  array->retired = NULL;
+
+  return array;
+}                               /* HashOpen_AllocArray */
+
+/**
+ *
+ * HashOpen_Locate: Looks for a key in a partition, the caller holds its lock.
+ *
+ * @param ht [IN] the hashtable.
+ * @param array [IN] the partition's array.
+ * @param buffkey [IN] the key.
+ * @param rbt_value [IN] the rbt value of the key.
+ * @param pfree [OUT] if not NULL, the first slot the key could be inserted in.
+ *
+ * @return the index of the key's slot, or -1 if not found.
+ *
+ */
+static int HashOpen_Locate(hash_table_t * ht, hash_open_array_t * array,
+                           hash_buffer_t * buffkey, uint32_t rbt_value, int *pfree)
+{
+  uint64_t fingerprint = HashOpen_Fingerprint(rbt_value, buffkey->len);
+  unsigned int mask = array->size - 1;
+  unsigned int i = HashOpen_FirstSlot(array, rbt_value);
+  unsigned int n;
+  int free_slot = -1;
+
+  for(n = 0; n < array->size; n++, i = (i + 1) & mask)
+    {
+      if(array->fingerprint[i] == HASHOPEN_EMPTY)
+        {
+          if(free_slot == -1)
+            free_slot = i;
+          break;
+        }
+
+      if(array->fingerprint[i] == HASHOPEN_DELETED)
+        {
+          if(free_slot == -1)
+            free_slot = i;
+          continue;
+        }
+
+      if(array->fingerprint[i] == fingerprint &&
+         !ht->parameter.compare_key(buffkey, &array->slot[i].data.buffkey))
+        return i;
+    }
+
+  if(pfree != NULL)
+    *pfree = free_slot;
+
+  return -1;
+}                               /* HashOpen_Locate */
+
+static void HashOpen_FillSlot(hash_table_t * ht, hash_open_array_t * array, unsigned int i,
+                              uint32_t rbt_value, hash_data_t * pdata)
+{
+  hash_open_slot_t *pslot = &array->slot[i];
+
+  pslot->data = *pdata;
+
+  memset(pslot->inline_key, 0, HASHTABLE_INLINE_KEY_SIZE);
+  if(ht->parameter.inline_keys &&
+     pdata->buffkey.len > 0 && pdata->buffkey.len <= HASHTABLE_INLINE_KEY_SIZE)
+    {
+      memcpy(pslot->inline_key, pdata->buffkey.pdata, pdata->buffkey.len);
+      pslot->inline_len = pdata->buffkey.len;
+    }
+  else
+    pslot->inline_len = 0;
+
+  array->fingerprint[i] = HashOpen_Fingerprint(rbt_value, pdata->buffkey.len);
+}                               /* HashOpen_FillSlot */
+
+static void HashOpen_WriteBegin(hash_open_partition_t * part)
+{
+  P_w(&part->lock);
+  atomic_inc_uint32_t(&part->seq);
+}                               /* HashOpen_WriteBegin */
+
+/**
+ *
+ * HashOpen_Reclaim: Frees the arrays a partition retired, if no one reads them.
+ *
+ * Called under the write lock. A lockless reader counts itself in the
+ * partition before it loads the array: once the new array is published, a
+ * reader that is not counted yet can only get the new one.
+ *
+ * @param part [IN] the partition.
+ *
+ * @return nothing (void function)
+ *
+ */
+static void HashOpen_Reclaim(hash_open_partition_t * part)
+{
+  hash_open_array_t *retired = part->array->retired;
+  hash_open_array_t *next;
+
+  if(retired == NULL)
+    return;
+
+  atomic_barrier();
+  if(atomic_fetch_uint32_t(&part->readers) != 0)
+    return;
+
+  part->array->retired = NULL;
+
+  for(; retired != NULL; retired = next)
+    {
+      next = retired->retired;
+      Mem_Free(retired);
+    }
+}                               /* HashOpen_Reclaim */
+
+static void HashOpen_WriteEnd(hash_open_partition_t * part)
+{
+  HashOpen_Reclaim(part);
+  atomic_inc_uint32_t(&part->seq);
+  V_w(&part->lock);
+}                               /* HashOpen_WriteEnd */
+
+/**
+ *
+ * HashOpen_Resize: Moves the live entries of a partition to a new array.
+ *
+ * Called under the write lock when the partition is too full. The array is
+ * doubled until the live entries fill at most half of it; if deleted slots
+ * were the problem, the array is just rebuilt with the same size. The
+ * rebuilt array is copied back over the current one, so that the arrays
+ * retired never outgrow the current one however many entries come and go,
+ * should the readers keep them from being reclaimed.
+ *
+ * @param ht [IN] the hashtable.
+ * @param hashval [IN] the partition.
+ *
+ * @return HASHTABLE_SUCCESS if ok, HASHTABLE_INSERT_MALLOC_ERROR otherwise.
+ *
+ */
+static int HashOpen_Resize(hash_table_t * ht, uint32_t hashval)
+{
+  hash_open_partition_t *part = &ht->open_partition[hashval];
+  hash_open_array_t *old = part->array;
+  hash_open_array_t *array;
+  unsigned int size = old->size;
+  unsigned int nb_entries = ht->stat_dynamic[hashval].nb_entries;
+  unsigned int i, j;
+  uint32_t rbt_value;
+
+  while((nb_entries + 1) * 2 >= size)
+    size <<= 1;
+
+  if((array = HashOpen_AllocArray(size)) == NULL)
+    return HASHTABLE_INSERT_MALLOC_ERROR;
+
+  for(i = 0; i < old->size; i++)
+    {
+      if(old->fingerprint[i] == HASHOPEN_EMPTY || old->fingerprint[i] == HASHOPEN_DELETED)
+        continue;
+
+      rbt_value = (uint32_t) (old->fingerprint[i] >> 32);
+
+      for(j = HashOpen_FirstSlot(array, rbt_value);
+          array->fingerprint[j] != HASHOPEN_EMPTY; j = (j + 1) & (size - 1)) ;
+
+      array->slot[j] = old->slot[i];
+      array->fingerprint[j] = old->fingerprint[i];
+    }
+
+  LogFullDebug(COMPONENT_HASHTABLE,
+               "Hash table %s partition %u: resized from %u to %u slots for %u entries",
+               ht->parameter.name != NULL ? ht->parameter.name : "Unamed",
+               hashval, old->size, size, nb_entries);
+
+  part->nb_used = nb_entries;
+
+  if(size == old->size)
+    {
+      /* The caller made the sequence counter odd, the lockless readers
+       * scanning the current array will retry */
+      memcpy((char *)old->fingerprint, (char *)array->fingerprint, size * sizeof(uint64_t));
+      memcpy((char *)old->slot, (char *)array->slot, size * sizeof(hash_open_slot_t));
+      Mem_Free(array);
+      return HASHTABLE_SUCCESS;
+    }
+
+  array->retired = old;
+  atomic_store_voidptr((void **)&part->array, array);
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_Resize */
+
+/**
+ *
+ * HashOpen_Init: Inits the open addressing partitions of a hashtable.
+ *
+ * @param ht [INOUT] the hashtable, whose parameter field is set.
+ *
+ * @return HASHTABLE_SUCCESS if ok, an error code otherwise.
+ *
+ */
+int HashOpen_Init(hash_table_t * ht)
+{
+  unsigned int size = HASHOPEN_MIN_SIZE;
+  unsigned int i;
+  int rc = HASHTABLE_SUCCESS;
+
+  while(size < ht->parameter.nb_node_prealloc && size < HASHOPEN_MAX_INITIAL_SIZE)
+    size <<= 1;
+
+  if((ht->stat_dynamic =
+      (hash_stat_dynamic_t *) Mem_Alloc_Label(sizeof(hash_stat_dynamic_t) *
+                                              ht->parameter.index_size,
+                                              "hash_stat_dynamic_t")) == NULL)
+    return HASHTABLE_INSERT_MALLOC_ERROR;
+
+  memset((char *)ht->stat_dynamic, 0, sizeof(hash_stat_dynamic_t) * ht->parameter.index_size);
+
+  if((ht->open_partition =
+      (hash_open_partition_t *) Mem_Alloc_Label(sizeof(hash_open_partition_t) *
+                                                ht->parameter.index_size,
+                                                "hash_open_partition_t")) == NULL)
+    {
+      Mem_Free(ht->stat_dynamic);
+      return HASHTABLE_INSERT_MALLOC_ERROR;
+    }
+
+  memset((char *)ht->open_partition, 0,
+         sizeof(hash_open_partition_t) * ht->parameter.index_size);
+
+  for(i = 0; i < ht->parameter.index_size; i++)
+    {
+      if(rw_lock_init(&ht->open_partition[i].lock) != 0)
+        {
+          rc = HASHTABLE_ERROR_INVALID_ARGUMENT;
+          break;
+        }
+
+      if((ht->open_partition[i].array = HashOpen_AllocArray(size)) == NULL)
+        {
+          rw_lock_destroy(&ht->open_partition[i].lock);
+          rc = HASHTABLE_INSERT_MALLOC_ERROR;
+          break;
+        }
+    }
+
+  if(rc != HASHTABLE_SUCCESS)
+    {
+      /* Undo the partitions already set up */
+      while(i-- > 0)
+        {
+          Mem_Free(ht->open_partition[i].array);
+          rw_lock_destroy(&ht->open_partition[i].lock);
+        }
+
+      Mem_Free(ht->open_partition);
+      Mem_Free(ht->stat_dynamic);
+      ht->open_partition = NULL;
+      ht->stat_dynamic = NULL;
+      return rc;
+    }
+
+  atomic_barrier();
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_Init */
+
+/**
+ *
+ * HashOpen_Test_And_Set: Open addressing version of HashTable_Test_And_Set.
+ *
+ * @see HashTable_Test_And_Set
+ *
+ */
+int HashOpen_Test_And_Set(hash_table_t * ht, hash_buffer_t * buffkey,
+                          hash_buffer_t * buffval, hashtable_set_how_t how)
+{
+  hash_open_partition_t *part;
+  hash_stat_dynamic_t *pstat;
+  hash_data_t data;
+  uint32_t hashval, rbt_value;
+  int i, free_slot;
+  int rc;
+
+  if((rc = HashOpen_Values(ht, buffkey, &hashval, &rbt_value)) != HASHTABLE_SUCCESS)
+    return rc;
+
+  part = &ht->open_partition[hashval];
+  pstat = &ht->stat_dynamic[hashval];
+
+  data.buffkey = *buffkey;
+  data.buffval = *buffval;
+
+  HashOpen_WriteBegin(part);
+
+  if((i = HashOpen_Locate(ht, part->array, buffkey, rbt_value, &free_slot)) >= 0)
+    {
+      /* An entry of that key already exists */
+      if(how == HASHTABLE_SET_HOW_TEST_ONLY)
+        {
+          atomic_inc_uint32_t(&pstat->ok.nb_test);
+          HashOpen_WriteEnd(part);
+          return HASHTABLE_SUCCESS;
+        }
+
+      if(how == HASHTABLE_SET_HOW_SET_NO_OVERWRITE)
+        {
+          atomic_inc_uint32_t(&pstat->err.nb_test);
+          HashOpen_WriteEnd(part);
+          return HASHTABLE_ERROR_KEY_ALREADY_EXISTS;
+        }
+
+      HashOpen_FillSlot(ht, part->array, i, rbt_value, &data);
+      atomic_inc_uint32_t(&pstat->ok.nb_set);
+      HashOpen_WriteEnd(part);
+      return HASHTABLE_SUCCESS;
+    }
+
+  if(how == HASHTABLE_SET_HOW_TEST_ONLY)
+    {
+      atomic_inc_uint32_t(&pstat->notfound.nb_test);
+      HashOpen_WriteEnd(part);
+      return HASHTABLE_ERROR_NO_SUCH_KEY;
+    }
+
+  /* Taking an empty slot may leave too few of them */
+  if(free_slot < 0 ||
+     (part->array->fingerprint[free_slot] == HASHOPEN_EMPTY &&
+      (part->nb_used + 1) * 4 > part->array->size * 3))
+    {
+      if(HashOpen_Resize(ht, hashval) != HASHTABLE_SUCCESS)
+        {
+          atomic_inc_uint32_t(&pstat->err.nb_set);
+          HashOpen_WriteEnd(part);
+          return HASHTABLE_INSERT_MALLOC_ERROR;
+        }
+      HashOpen_Locate(ht, part->array, buffkey, rbt_value, &free_slot);
+    }
+
+  if(part->array->fingerprint[free_slot] == HASHOPEN_EMPTY)
+    part->nb_used += 1;
+
+  HashOpen_FillSlot(ht, part->array, free_slot, rbt_value, &data);
+
+  pstat->nb_entries += 1;
+  atomic_inc_uint32_t(&pstat->ok.nb_set);
+
+  HashOpen_WriteEnd(part);
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_Test_And_Set */
+
+/**
+ *
+ * HashOpen_GetOptimistic: Looks for a short key without taking any lock.
+ *
+ * @param ht [IN] the hashtable.
+ * @param part [IN] the partition.
+ * @param buffkey [IN] the key, its length is at most HASHTABLE_INLINE_KEY_SIZE.
+ * @param rbt_value [IN] the rbt value of the key.
+ * @param buffval [OUT] the value, if found.
+ *
+ * @return HASHTABLE_SUCCESS or HASHTABLE_ERROR_NO_SUCH_KEY, or HASHTABLE_NOT_DELETED if writers kept getting in the way.
+ *
+ */
+static int HashOpen_GetOptimistic(hash_table_t * ht, hash_open_partition_t * part,
+                                  hash_buffer_t * buffkey, uint32_t rbt_value,
+                                  hash_buffer_t * buffval)
+{
+  uint64_t fingerprint = HashOpen_Fingerprint(rbt_value, buffkey->len);
+  volatile uint64_t *pfingerprint;
+  hash_open_array_t *array;
+  hash_open_slot_t slot;
+  char key[HASHTABLE_INLINE_KEY_SIZE + 1];
+  hash_buffer_t localkey;
+  unsigned int mask, i, n;
+  uint32_t seq;
+  int retry, found;
+
+  /* Keeps the arrays we may scan from being freed */
+  atomic_inc_uint32_t(&part->readers);
+
+  for(retry = 0; retry < HASHOPEN_OPTIMISTIC_RETRY; retry++)
+    {
+      if((seq = atomic_fetch_uint32_t(&part->seq)) & 1)
+        continue;
+
+      array = (hash_open_array_t *) atomic_fetch_voidptr((void **)&part->array);
+      pfingerprint = array->fingerprint;
+      mask = array->size - 1;
+      found = FALSE;
+
+      for(n = 0, i = HashOpen_FirstSlot(array, rbt_value); n < array->size;
+          n++, i = (i + 1) & mask)
+        {
+          if(pfingerprint[i] == HASHOPEN_EMPTY)
+            break;
+
+          if(pfingerprint[i] != fingerprint)
+            continue;
+
+          /* Work on a copy, the slot may change under our feet */
+          memcpy(&slot, (char *)&array->slot[i], sizeof(hash_open_slot_t));
+          atomic_barrier();
+          if(atomic_fetch_uint32_t(&part->seq) != seq)
+            break;
+
+          if(slot.inline_len != buffkey->len)
+            continue;
+
+          memcpy(key, slot.inline_key, HASHTABLE_INLINE_KEY_SIZE);
+          key[HASHTABLE_INLINE_KEY_SIZE] = '\0';
+          localkey.pdata = key;
+          localkey.len = slot.inline_len;
+
+          if(!ht->parameter.compare_key(buffkey, &localkey))
+            {
+              found = TRUE;
+              break;
+            }
+        }
+
+      atomic_barrier();
+      if(atomic_fetch_uint32_t(&part->seq) != seq)
+        continue;
+
+      atomic_dec_uint32_t(&part->readers);
+
+      if(!found)
+        return HASHTABLE_ERROR_NO_SUCH_KEY;
+
+      *buffval = slot.data.buffval;
+      return HASHTABLE_SUCCESS;
+    }
+
+  atomic_dec_uint32_t(&part->readers);
+
+  return HASHTABLE_NOT_DELETED;
+}                               /* HashOpen_GetOptimistic */
+
+/**
+ *
+ * HashOpen_GetRef: Open addressing version of HashTable_GetRef.
+ *
+ * @see HashTable_GetRef
+ *
+ */
+int HashOpen_GetRef(hash_table_t * ht, hash_buffer_t * buffkey, hash_buffer_t * buffval,
+                    void (*get_ref)(hash_buffer_t *) )
+{
+  hash_open_partition_t *part;
+  hash_stat_dynamic_t *pstat;
+  uint32_t hashval, rbt_value;
+  int i;
+  int rc;
+
+  if((rc = HashOpen_Values(ht, buffkey, &hashval, &rbt_value)) != HASHTABLE_SUCCESS)
+    return rc;
+
+  part = &ht->open_partition[hashval];
+  pstat = &ht->stat_dynamic[hashval];
+
+  if(ht->parameter.inline_keys && get_ref == NULL &&
+     buffkey->len > 0 && buffkey->len <= HASHTABLE_INLINE_KEY_SIZE)
+    {
+      rc = HashOpen_GetOptimistic(ht, part, buffkey, rbt_value, buffval);
+
+      if(rc == HASHTABLE_SUCCESS)
+        {
+          atomic_inc_uint32_t(&pstat->ok.nb_get);
+          return rc;
+        }
+
+      if(rc == HASHTABLE_ERROR_NO_SUCH_KEY)
+        {
+          atomic_inc_uint32_t(&pstat->notfound.nb_get);
+          return rc;
+        }
+    }
+
+  P_r(&part->lock);
+
+  if((i = HashOpen_Locate(ht, part->array, buffkey, rbt_value, NULL)) < 0)
+    {
+      atomic_inc_uint32_t(&pstat->notfound.nb_get);
+      V_r(&part->lock);
+      return HASHTABLE_ERROR_NO_SUCH_KEY;
+    }
+
+  *buffval = part->array->slot[i].data.buffval;
+  atomic_inc_uint32_t(&pstat->ok.nb_get);
+
+  if(get_ref != NULL)
+    get_ref(buffval);
+
+  V_r(&part->lock);
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_GetRef */
+
+/**
+ *
+ * HashOpen_Get_and_Del: Open addressing version of HashTable_Get_and_Del.
+ *
+ * @see HashTable_Get_and_Del
+ *
+ */
+int HashOpen_Get_and_Del(hash_table_t * ht, hash_buffer_t * buffkey,
+                         hash_buffer_t * buffval, hash_buffer_t * buff_used_key)
+{
+  hash_open_partition_t *part;
+  hash_stat_dynamic_t *pstat;
+  uint32_t hashval, rbt_value;
+  int i;
+  int rc;
+
+  if((rc = HashOpen_Values(ht, buffkey, &hashval, &rbt_value)) != HASHTABLE_SUCCESS)
+    return rc;
+
+  part = &ht->open_partition[hashval];
+  pstat = &ht->stat_dynamic[hashval];
+
+  HashOpen_WriteBegin(part);
+
+  if((i = HashOpen_Locate(ht, part->array, buffkey, rbt_value, NULL)) < 0)
+    {
+      atomic_inc_uint32_t(&pstat->notfound.nb_get);
+      HashOpen_WriteEnd(part);
+      return HASHTABLE_ERROR_NO_SUCH_KEY;
+    }
+
+  *buffval = part->array->slot[i].data.buffval;
+  if(buff_used_key != NULL)
+    *buff_used_key = part->array->slot[i].data.buffkey;
+
+  part->array->fingerprint[i] = HASHOPEN_DELETED;
+
+  pstat->nb_entries -= 1;
+  atomic_inc_uint32_t(&pstat->ok.nb_get);
+  atomic_inc_uint32_t(&pstat->ok.nb_del);
+
+  HashOpen_WriteEnd(part);
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_Get_and_Del */
+
+/**
+ *
+ * HashOpen_DelRef: Open addressing version of HashTable_DelRef.
+ *
+ * @see HashTable_DelRef
+ *
+ */
+int HashOpen_DelRef(hash_table_t * ht, hash_buffer_t * buffkey,
+                    hash_buffer_t * p_usedbuffkey, hash_buffer_t * p_usedbuffdata,
+                    int (*put_ref)(hash_buffer_t *) )
+{
+  hash_open_partition_t *part;
+  hash_stat_dynamic_t *pstat;
+  hash_open_slot_t *pslot;
+  uint32_t hashval, rbt_value;
+  int i;
+  int rc;
+
+  if((rc = HashOpen_Values(ht, buffkey, &hashval, &rbt_value)) != HASHTABLE_SUCCESS)
+    return rc;
+
+  part = &ht->open_partition[hashval];
+  pstat = &ht->stat_dynamic[hashval];
+
+  HashOpen_WriteBegin(part);
+
+  if((i = HashOpen_Locate(ht, part->array, buffkey, rbt_value, NULL)) < 0)
+    {
+      atomic_inc_uint32_t(&pstat->notfound.nb_del);
+      HashOpen_WriteEnd(part);
+      return HASHTABLE_ERROR_NO_SUCH_KEY;
+    }
+
+  pslot = &part->array->slot[i];
+
+  if(p_usedbuffkey != NULL)
+    *p_usedbuffkey = pslot->data.buffkey;
+
+  if(p_usedbuffdata != NULL)
+    *p_usedbuffdata = pslot->data.buffval;
+
+  if(put_ref != NULL)
+    if(put_ref(&pslot->data.buffval) != 0)
+      {
+        HashOpen_WriteEnd(part);
+        return HASHTABLE_NOT_DELETED;
+      }
+
+  part->array->fingerprint[i] = HASHOPEN_DELETED;
+
+  pstat->nb_entries -= 1;
+  atomic_inc_uint32_t(&pstat->ok.nb_del);
+
+  HashOpen_WriteEnd(part);
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_DelRef */
+
+/**
+ *
+ * HashOpen_Delall: Open addressing version of HashTable_Delall.
+ *
+ * @see HashTable_Delall
+ *
+ */
+int HashOpen_Delall(hash_table_t * ht, int (*free_func)(hash_buffer_t, hash_buffer_t) )
+{
+  hash_open_partition_t *part;
+  hash_open_array_t *array;
+  hash_data_t data;
+  unsigned int hashval, i;
+
+  for(hashval = 0; hashval < ht->parameter.index_size; hashval++)
+    {
+      part = &ht->open_partition[hashval];
+
+      HashOpen_WriteBegin(part);
+
+      array = part->array;
+      for(i = 0; i < array->size; i++)
+        {
+          if(array->fingerprint[i] == HASHOPEN_EMPTY || array->fingerprint[i] == HASHOPEN_DELETED)
+            continue;
+
+          data = array->slot[i].data;
+          array->fingerprint[i] = HASHOPEN_DELETED;
+
+          ht->stat_dynamic[hashval].nb_entries -= 1;
+          atomic_inc_uint32_t(&ht->stat_dynamic[hashval].ok.nb_del);
+
+          if(free_func(data.buffkey, data.buffval) == 0)
+            {
+              HashOpen_WriteEnd(part);
+              return HASHTABLE_ERROR_DELALL_FAIL;
+            }
+        }
+
+      /* The partition is empty, forget about the deleted slots */
+      memset((char *)array->fingerprint, 0, array->size * sizeof(uint64_t));
+      part->nb_used = 0;
+
+      HashOpen_WriteEnd(part);
+    }
+
+  return HASHTABLE_SUCCESS;
+}                               /* HashOpen_Delall */
+
+/**
+ *
+ * HashOpen_Walk: Open addressing version of HashTable_Walk.
+ *
+ * @see HashTable_Walk
+ *
+ */
+unsigned int HashOpen_Walk(hash_table_t * ht, unsigned int first,
+                           int (*walk_func)(hash_data_t *, void *), void *arg)
+{
+  hash_open_partition_t *part;
+  hash_open_array_t *array;
+  unsigned int hashval, i;
+
+  for(hashval = first; hashval < ht->parameter.index_size; hashval++)
+    {
+      part = &ht->open_partition[hashval];
+
+      P_r(&part->lock);
+
+      array = part->array;
+      for(i = 0; i < array->size; i++)
+        {
+          if(array->fingerprint[i] == HASHOPEN_EMPTY || array->fingerprint[i] == HASHOPEN_DELETED)
+            continue;
+
+          if(!walk_func(&array->slot[i].data, arg))
+            {
+              V_r(&part->lock);
+              return hashval;
+            }
+        }
+
+      V_r(&part->lock);
+    }
+
+  return ht->parameter.index_size;
+}                               /* HashOpen_Walk */
+
+/**
+ *
+ * HashOpen_Log: Open addressing version of HashTable_Log and HashTable_Print.
+ *
+ * @param component [IN] the component debugging config to use.
+ * @param ht [IN] the hashtable to be used.
+ * @param to_stderr [IN] print to stderr instead of logging.
+ *
+ * @return nothing (void function)
+ *
+ */
+void HashOpen_Log(log_components_t component, hash_table_t * ht, int to_stderr)
+{
+  hash_open_partition_t *part;
+  hash_open_array_t *array;
+  char dispkey[HASHTABLE_DISPLAY_STRLEN];
+  char dispval[HASHTABLE_DISPLAY_STRLEN];
+  unsigned int hashval, i;
+
+  for(hashval = 0; hashval < ht->parameter.index_size; hashval++)
+    {
+      part = &ht->open_partition[hashval];
+
+      P_r(&part->lock);
+
+      array = part->array;
+
+      if(to_stderr)
+        fprintf(stderr, "The partition %u contains: %u entries in %u slots\n",
+                hashval, ht->stat_dynamic[hashval].nb_entries, array->size);
+      else
+        LogFullDebug(component, "The partition %u contains: %u entries in %u slots",
+                     hashval, ht->stat_dynamic[hashval].nb_entries, array->size);
+
+      for(i = 0; i < array->size; i++)
+        {
+          if(array->fingerprint[i] == HASHOPEN_EMPTY || array->fingerprint[i] == HASHOPEN_DELETED)
+            continue;
+
+          ht->parameter.key_to_str(&array->slot[i].data.buffkey, dispkey);
+          ht->parameter.val_to_str(&array->slot[i].data.buffval, dispval);
+
+          if(to_stderr)
+            fprintf(stderr, "%s => %s; hashval=%u slot=%u rbtval=%u\n",
+                    dispkey, dispval, hashval, i,
+                    (uint32_t) (array->fingerprint[i] >> 32));
+          else
+            LogFullDebug(component, "%s => %s; hashval=%u slot=%u rbtval=%u",
+                         dispkey, dispval, hashval, i,
+                         (uint32_t) (array->fingerprint[i] >> 32));
+        }
+
+      V_r(&part->lock);
+    }
+}                               /* HashOpen_Log */
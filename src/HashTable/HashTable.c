@@ -210,6 +210,38 @@ const char *hash_table_err_to_str(int err)
   return "UNKNOWN HASH TABLE ERROR";
 }
 
+/**
+ *
+ * HashTable_BackendFromStr: Parses the name of a hash table backend.
+ *
+ * @param str [IN] the name, as found in the configuration file.
+ * @param pbackend [OUT] the backend.
+ *
+ * @return 0 if ok, -1 if the name is unknown.
+ *
+ */
+int HashTable_BackendFromStr(char *str, hash_table_backend_t * pbackend)
+{
+  if(!strcasecmp(str, "RBT") || !strcasecmp(str, "Red_Black_Tree"))
+    *pbackend = HASHTABLE_BACKEND_RBT;
+  else if(!strcasecmp(str, "Open_Addressing") || !strcasecmp(str, "Open"))
+    *pbackend = HASHTABLE_BACKEND_OPEN;
+  else
+    return -1;
+
+  return 0;
+}                               /* HashTable_BackendFromStr */
+
+const char *HashTable_BackendToStr(hash_table_backend_t backend)
+{
+  switch(backend)
+    {
+      case HASHTABLE_BACKEND_RBT:  return "RBT";
+      case HASHTABLE_BACKEND_OPEN: return "Open_Addressing";
+    }
+  return "Unknown";
+}                               /* HashTable_BackendToStr */
+
 /**
  * 
  * simple_hash_func: A template hash function, which considers the hash key as a polynom
@@ -417,6 +449,17 @@ hash_table_t *HashTable_Init(hash_parameter_t hparam)
 
   /* we have to keep the discriminant values */
   ht->parameter = hparam;
+  ht->open_partition = NULL;
+
+  if(hparam.backend == HASHTABLE_BACKEND_OPEN)
+    {
+      if(HashOpen_Init(ht) != HASHTABLE_SUCCESS)
+        {
+          Mem_Free( ht ) ;
+          return NULL;
+        }
+      return ht;
+    }
 
   if(pthread_mutexattr_init(&mutexattr) != 0)
     {
@@ -580,6 +623,9 @@ int HashTable_Test_And_Set(hash_table_t * ht, hash_buffer_t * buffkey,
   else if(buffval == NULL)
     return HASHTABLE_ERROR_INVALID_ARGUMENT;
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    return HashOpen_Test_And_Set(ht, buffkey, buffval, how);
+
   /* Compute values to locate into the hashtable */
   if( ht->parameter.hash_func_both != NULL )
    {
@@ -710,6 +756,9 @@ int HashTable_GetRef(hash_table_t * ht, hash_buffer_t * buffkey, hash_buffer_t *
   if(ht == NULL || buffkey == NULL || buffval == NULL)
     return HASHTABLE_ERROR_INVALID_ARGUMENT;
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    return HashOpen_GetRef(ht, buffkey, buffval, get_ref);
+
   /* Compute values to locate into the hashtable */
   if( ht->parameter.hash_func_both != NULL )
    {
@@ -793,6 +842,9 @@ int HashTable_Get_and_Del(hash_table_t  * ht,
   if(ht == NULL || buffkey == NULL || buffval == NULL)
     return HASHTABLE_ERROR_INVALID_ARGUMENT;
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    return HashOpen_Get_and_Del(ht, buffkey, buffval, buff_used_key);
+
   /* Compute values to locate into the hashtable */
   if( ht->parameter.hash_func_both != NULL )
    {
@@ -881,6 +933,9 @@ int HashTable_Delall(hash_table_t * ht, int (*free_func)(hash_buffer_t, hash_buf
   if (ht == NULL || free_func == NULL)
     return HASHTABLE_ERROR_INVALID_ARGUMENT;
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    return HashOpen_Delall(ht, free_func);
+
   LogFullDebug(COMPONENT_HASHTABLE, "Deleting all entries in hashtable.");
 
   /* For each bucket of the hashtable */
@@ -926,6 +981,57 @@ int HashTable_Delall(hash_table_t * ht, int (*free_func)(hash_buffer_t, hash_buf
   return HASHTABLE_SUCCESS;  
 }
 
+/**
+ *
+ * HashTable_Walk: Calls a function on the entries of the hashtable.
+ *
+ * Walks the partitions from the one given, each under its read lock, calling
+ * walk_func on every entry until it returns FALSE. walk_func must not use the
+ * hashtable: to act on an entry, it notes it and stops the walk, the caller
+ * acts once the lock is released then walks again from the partition the walk
+ * stopped in. This works the same whatever the backend of the hashtable.
+ *
+ * @param ht the hashtable to be walked.
+ * @param first the first partition walked.
+ * @param walk_func called on each entry with arg, returns FALSE to stop the walk.
+ * @param arg passed to walk_func.
+ *
+ * @return the partition the walk stopped in, parameter.index_size if the walk went to the end.
+ *
+ */
+unsigned int HashTable_Walk(hash_table_t * ht, unsigned int first,
+                            int (*walk_func)(hash_data_t *, void *), void *arg)
+{
+  struct rbt_head *head_rbt;
+  struct rbt_node *pn;
+  unsigned int hashval;
+
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    return HashOpen_Walk(ht, first, walk_func, arg);
+
+  for(hashval = first; hashval < ht->parameter.index_size; hashval++)
+    {
+      head_rbt = &(ht->array_rbt[hashval]);
+
+      P_r(&(ht->array_lock[hashval]));
+
+      RBT_LOOP(head_rbt, pn)
+        {
+          if(!walk_func((hash_data_t *) RBT_OPAQ(pn), arg))
+            {
+              V_r(&(ht->array_lock[hashval]));
+              return hashval;
+            }
+
+          RBT_INCREMENT(pn);
+        }
+
+      V_r(&(ht->array_lock[hashval]));
+    }
+
+  return ht->parameter.index_size;
+}                               /* HashTable_Walk */
+
 /**
  * 
  * HashTable_Del: Remove a (key,val) couple from the hashtable.
@@ -959,6 +1065,9 @@ int HashTable_DelRef(hash_table_t * ht, hash_buffer_t * buffkey,
   if(ht == NULL || buffkey == NULL)
     return HASHTABLE_ERROR_INVALID_ARGUMENT;
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    return HashOpen_DelRef(ht, buffkey, p_usedbuffkey, p_usedbuffdata, put_ref);
+
   /* Compute values to locate into the hashtable */
   if( ht->parameter.hash_func_both != NULL )
    {
@@ -1044,6 +1153,7 @@ int HashTable_Del(hash_table_t * ht, hash_buffer_t * buffkey,
 void HashTable_GetStats(hash_table_t * ht, hash_stat_t * hstat)
 {
   unsigned int i = 0;
+  unsigned int num_node;
 
   /* Sanity check */
   if(ht == NULL || hstat == NULL)
@@ -1076,13 +1186,18 @@ void HashTable_GetStats(hash_table_t * ht, hash_stat_t * hstat)
 
   for(i = 0; i < ht->parameter.index_size; i++)
     {
-      if(ht->array_rbt[i].rbt_num_node > hstat->computed.max_rbt_num_node)
-        hstat->computed.max_rbt_num_node = ht->array_rbt[i].rbt_num_node;
+      if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+        num_node = ht->stat_dynamic[i].nb_entries;
+      else
+        num_node = ht->array_rbt[i].rbt_num_node;
 
-      if(ht->array_rbt[i].rbt_num_node < hstat->computed.min_rbt_num_node)
-        hstat->computed.min_rbt_num_node = ht->array_rbt[i].rbt_num_node;
+      if(num_node > hstat->computed.max_rbt_num_node)
+        hstat->computed.max_rbt_num_node = num_node;
 
-      hstat->computed.average_rbt_num_node += ht->array_rbt[i].rbt_num_node;
+      if(num_node < hstat->computed.min_rbt_num_node)
+        hstat->computed.min_rbt_num_node = num_node;
+
+      hstat->computed.average_rbt_num_node += num_node;
 
       hstat->dynamic.nb_entries += ht->stat_dynamic[i].nb_entries;
 
@@ -1174,6 +1289,12 @@ void HashTable_Log(log_components_t component, hash_table_t * ht)
 
   LogFullDebug(component, "The hash contains %d entries", nb_entries);
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    {
+      HashOpen_Log(component, ht, FALSE);
+      return;
+    }
+
   for(i = 0; i < ht->parameter.index_size; i++)
     {
       tete_rbt = &((ht->array_rbt)[i]);
@@ -1255,6 +1376,12 @@ void HashTable_Print( hash_table_t * ht)
 
   fprintf(stderr,"The hash contains %d entries\n", nb_entries);
 
+  if(ht->parameter.backend == HASHTABLE_BACKEND_OPEN)
+    {
+      HashOpen_Log(COMPONENT_HASHTABLE, ht, TRUE);
+      return;
+    }
+
   for(i = 0; i < ht->parameter.index_size; i++)
     {
       tete_rbt = &((ht->array_rbt)[i]);
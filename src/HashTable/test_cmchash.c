@@ -80,8 +80,10 @@
 #include <stdlib.h>
 #include <strings.h>
 #include <string.h>
+#include <pthread.h>
 #include "BuddyMalloc.h"
 #include "HashTable.h"
+#include "abstract_atomic.h"
 #include "MesureTemps.h"
 #include "log.h"
 
@@ -93,6 +95,21 @@
 #define CRITERE 12
 #define CRITERE_2 14
 
+#define NB_GROWTH 5000          /* Entries put in a table that starts tiny */
+#define LONG_KEY_SIZE 48        /* Longer than HASHTABLE_INLINE_KEY_SIZE */
+#define NB_CHURN 100000         /* Entries set then deleted, a few live at a time */
+#define NB_CHURN_LIVE 50
+#define NB_VALUE_KEYS 1000      /* Keys held in pdata itself, as in the id mapper */
+#define NB_BENCH_KEYS 100000
+#define NB_BENCH_GETS 500000    /* Per thread */
+#define MAX_BENCH_THREADS 4
+#define NB_RECLAIM_READERS 3
+
+static char bench_keys[NB_BENCH_KEYS][12];
+static hash_table_t *bench_ht;
+static uint32_t bench_nb_set;   /* Keys of bench_keys already in bench_ht */
+static uint32_t bench_done;
+
 int compare_string_buffer(hash_buffer_t * buff1, hash_buffer_t * buff2)
 {
   /* Test if one of teh entries are NULL */
@@ -113,15 +130,33 @@ int display_buff(hash_buffer_t * pbuff, char *str)
   return snprintf(str, HASHTABLE_DISPLAY_STRLEN, "%s", (char *)pbuff->pdata);
 }
 
+/* Keys that are values, like the uid of the id mapper caches */
+static int compare_value_key(hash_buffer_t * buff1, hash_buffer_t * buff2)
+{
+  return ((unsigned long)buff1->pdata == (unsigned long)buff2->pdata) ? 0 : 1;
+}
+
+static unsigned long value_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef)
+{
+  return (unsigned long)buffclef->pdata % p_hparam->index_size;
+}
+
+static unsigned long value_rbt_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef)
+{
+  return (unsigned long)buffclef->pdata;
+}
+
+static int display_value(hash_buffer_t * pbuff, char *str)
+{
+  return snprintf(str, HASHTABLE_DISPLAY_STRLEN, "%lu", (unsigned long)pbuff->pdata);
+}
+
 unsigned long simple_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef);
 unsigned long double_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef);
 unsigned long rbt_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef);
 
-int main(int argc, char *argv[])
+static void test_table(hash_table_backend_t backend)
 {
-  SetDefaultLogging("TEST");
-  SetNamePgm("test_cmchash");
-
   hash_table_t *ht = NULL;
   hash_parameter_t hparam;
   hash_buffer_t buffval;
@@ -138,6 +173,10 @@ int main(int argc, char *argv[])
   int critere_recherche = 0;
   int random_val = 0;
 
+  LogTest("=========================================");
+  LogTest("Testing the %s backend", HashTable_BackendToStr(backend));
+
+  memset(&hparam, 0, sizeof(hparam));
   hparam.index_size = PRIME;
   hparam.alphabet_length = 10;
   hparam.nb_node_prealloc = NB_PREALLOC;
@@ -147,8 +186,9 @@ int main(int argc, char *argv[])
   hparam.compare_key = compare_string_buffer;
   hparam.key_to_str = display_buff;
   hparam.val_to_str = display_buff;
-
-  BuddyInit(NULL);
+  hparam.name = "Test";
+  hparam.backend = backend;
+  hparam.inline_keys = TRUE;
 
   /* Init de la table */
   if((ht = HashTable_Init(hparam)) == NULL)
@@ -433,8 +473,545 @@ int main(int argc, char *argv[])
       exit(1);
     }
 
+  if(statistiques.dynamic.nb_entries != MAXTEST - MAXDESTROY - 1)
+    {
+      LogTest("Test FAILED: Incorrect statistics: nb_entries ");
+      exit(1);
+    }
+}                               /* test_table */
+
+/* Grows a table from its smallest size, with short and long keys */
+/* Counts the entries walked, stops the walk at the one given by arg */
+static unsigned int nb_walked;
+
+static int count_walk(hash_data_t * pdata, void *arg)
+{
+  nb_walked += 1;
+  return pdata->buffval.pdata != arg;
+}
+
+static void test_growth(hash_table_backend_t backend)
+{
+  hash_table_t *ht = NULL;
+  hash_parameter_t hparam;
+  hash_buffer_t buffval;
+  hash_buffer_t buffkey;
+  static char strtab[NB_GROWTH][LONG_KEY_SIZE + 1];
+  char tmpstr[LONG_KEY_SIZE + 1];
+  int i;
+  int rc;
+
+  LogTest("Growth test for the %s backend", HashTable_BackendToStr(backend));
+
+  memset(&hparam, 0, sizeof(hparam));
+  hparam.index_size = 3;
+  hparam.alphabet_length = 10;
+  hparam.nb_node_prealloc = 1;
+  hparam.hash_func_key = simple_hash_func;
+  hparam.hash_func_rbt = rbt_hash_func;
+  hparam.compare_key = compare_string_buffer;
+  hparam.key_to_str = display_buff;
+  hparam.val_to_str = display_buff;
+  hparam.name = "Growth";
+  hparam.backend = backend;
+  hparam.inline_keys = TRUE;
+
+  if((ht = HashTable_Init(hparam)) == NULL)
+    {
+      LogTest("Test FAILED: Bad init");
+      exit(1);
+    }
+
+  /* Even entries have keys too long to be copied in an open addressing slot */
+  for(i = 0; i < NB_GROWTH; i++)
+    {
+      if(i % 2)
+        sprintf(strtab[i], "%d", i);
+      else
+        sprintf(strtab[i], "%d%0*d", i, LONG_KEY_SIZE - 8, 0);
+
+      buffkey.len = strlen(strtab[i]);
+      buffkey.pdata = strtab[i];
+      buffval = buffkey;
+
+      if((rc = HashTable_Set(ht, &buffkey, &buffval)) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: insert of %s returned %d", strtab[i], rc);
+          exit(1);
+        }
+    }
+
+  /* Delete one entry out of 3, check the others are still there */
+  for(i = 0; i < NB_GROWTH; i += 3)
+    {
+      buffkey.len = strlen(strtab[i]);
+      buffkey.pdata = strtab[i];
+
+      if((rc = HashTable_Del(ht, &buffkey, NULL, NULL)) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: delete of %s returned %d", strtab[i], rc);
+          exit(1);
+        }
+    }
+
+  for(i = 0; i < NB_GROWTH; i++)
+    {
+      /* Use a copy of the key, not the stored one */
+      strcpy(tmpstr, strtab[i]);
+      buffkey.len = strlen(tmpstr);
+      buffkey.pdata = tmpstr;
+
+      rc = HashTable_Get(ht, &buffkey, &buffval);
+
+      if(i % 3 == 0 && rc != HASHTABLE_ERROR_NO_SUCH_KEY)
+        {
+          LogTest("Test FAILED: deleted key %s was found", tmpstr);
+          exit(1);
+        }
+
+      if(i % 3 != 0 && (rc != HASHTABLE_SUCCESS || buffval.pdata != strtab[i]))
+        {
+          LogTest("Test FAILED: key %s was not found (%d)", tmpstr, rc);
+          exit(1);
+        }
+    }
+
+  if(HashTable_GetSize(ht) != NB_GROWTH - (NB_GROWTH + 2) / 3)
+    {
+      LogTest("Test FAILED: the table holds %u entries", HashTable_GetSize(ht));
+      exit(1);
+    }
+
+  /* The walk meets every entry once, and stops where it is told to */
+  nb_walked = 0;
+  if(HashTable_Walk(ht, 0, count_walk, NULL) != hparam.index_size ||
+     nb_walked != HashTable_GetSize(ht))
+    {
+      LogTest("Test FAILED: walked %u entries out of %u", nb_walked, HashTable_GetSize(ht));
+      exit(1);
+    }
+
+  nb_walked = 0;
+  if(HashTable_Walk(ht, 0, count_walk, strtab[1]) >= hparam.index_size ||
+     nb_walked == 0 || nb_walked > HashTable_GetSize(ht))
+    {
+      LogTest("Test FAILED: the walk did not stop on %s", strtab[1]);
+      exit(1);
+    }
+}                               /* test_growth */
+
+/* Keys held in pdata are never dereferenced, whatever the backend */
+static void test_value_keys(hash_table_backend_t backend)
+{
+  hash_table_t *ht = NULL;
+  hash_parameter_t hparam;
+  hash_buffer_t buffval;
+  hash_buffer_t buffkey;
+  unsigned long i;
+  int rc;
+
+  LogTest("Value keys test for the %s backend", HashTable_BackendToStr(backend));
+
+  memset(&hparam, 0, sizeof(hparam));
+  hparam.index_size = 7;
+  hparam.alphabet_length = 10;
+  hparam.nb_node_prealloc = 1;
+  hparam.hash_func_key = value_hash_func;
+  hparam.hash_func_rbt = value_rbt_func;
+  hparam.compare_key = compare_value_key;
+  hparam.key_to_str = display_value;
+  hparam.val_to_str = display_value;
+  hparam.name = "Values";
+  hparam.backend = backend;
+
+  if((ht = HashTable_Init(hparam)) == NULL)
+    {
+      LogTest("Test FAILED: Bad init");
+      exit(1);
+    }
+
+  for(i = 0; i < NB_VALUE_KEYS; i++)
+    {
+      buffkey.pdata = (caddr_t) i;
+      buffkey.len = sizeof(unsigned long);
+      buffval.pdata = (caddr_t) (i + 1);
+      buffval.len = sizeof(unsigned long);
+
+      if((rc = HashTable_Set(ht, &buffkey, &buffval)) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: insert of %lu returned %d", i, rc);
+          exit(1);
+        }
+    }
+
+  for(i = 0; i < NB_VALUE_KEYS; i += 2)
+    {
+      buffkey.pdata = (caddr_t) i;
+      buffkey.len = sizeof(unsigned long);
+
+      if((rc = HashTable_Del(ht, &buffkey, NULL, NULL)) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: delete of %lu returned %d", i, rc);
+          exit(1);
+        }
+    }
+
+  for(i = 0; i < NB_VALUE_KEYS; i++)
+    {
+      buffkey.pdata = (caddr_t) i;
+      buffkey.len = sizeof(unsigned long);
+
+      rc = HashTable_Get(ht, &buffkey, &buffval);
+
+      if(i % 2 == 0 && rc != HASHTABLE_ERROR_NO_SUCH_KEY)
+        {
+          LogTest("Test FAILED: deleted key %lu was found", i);
+          exit(1);
+        }
+
+      if(i % 2 != 0 && (rc != HASHTABLE_SUCCESS || (unsigned long)buffval.pdata != i + 1))
+        {
+          LogTest("Test FAILED: key %lu was not found (%d)", i, rc);
+          exit(1);
+        }
+    }
+}                               /* test_value_keys */
+
+/* Sets and deletes many different keys, a few at a time, in one partition:
+ * the deleted slots fill its array again and again, which must not retire
+ * more arrays than the partition ever needed. No lockless reader runs, so
+ * the retired arrays are all freed by the writers */
+static void test_churn(void)
+{
+  hash_table_t *ht = NULL;
+  hash_parameter_t hparam;
+  hash_buffer_t buffval;
+  hash_buffer_t buffkey;
+  hash_open_array_t *array;
+  static char strtab[NB_CHURN_LIVE][16];
+  unsigned int nb_retired;
+  size_t retired_size;
+  int i;
+  int rc;
+
+  LogTest("Churn test for the %s backend",
+          HashTable_BackendToStr(HASHTABLE_BACKEND_OPEN));
+
+  memset(&hparam, 0, sizeof(hparam));
+  hparam.index_size = 1;
+  hparam.alphabet_length = 10;
+  hparam.nb_node_prealloc = 1;
+  hparam.hash_func_key = simple_hash_func;
+  hparam.hash_func_rbt = rbt_hash_func;
+  hparam.compare_key = compare_string_buffer;
+  hparam.key_to_str = display_buff;
+  hparam.val_to_str = display_buff;
+  hparam.name = "Churn";
+  hparam.backend = HASHTABLE_BACKEND_OPEN;
+  hparam.inline_keys = TRUE;
+
+  if((ht = HashTable_Init(hparam)) == NULL)
+    {
+      LogTest("Test FAILED: Bad init");
+      exit(1);
+    }
+
+  for(i = 0; i < NB_CHURN; i++)
+    {
+      /* The key set NB_CHURN_LIVE insertions ago goes away first */
+      if(i >= NB_CHURN_LIVE)
+        {
+          buffkey.len = strlen(strtab[i % NB_CHURN_LIVE]);
+          buffkey.pdata = strtab[i % NB_CHURN_LIVE];
+
+          if((rc = HashTable_Del(ht, &buffkey, NULL, NULL)) != HASHTABLE_SUCCESS)
+            {
+              LogTest("Test FAILED: delete of %s returned %d", strtab[i % NB_CHURN_LIVE], rc);
+              exit(1);
+            }
+        }
+
+      sprintf(strtab[i % NB_CHURN_LIVE], "%d", i);
+      buffkey.len = strlen(strtab[i % NB_CHURN_LIVE]);
+      buffkey.pdata = strtab[i % NB_CHURN_LIVE];
+      buffval = buffkey;
+
+      if((rc = HashTable_Set(ht, &buffkey, &buffval)) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: insert of %s returned %d", strtab[i % NB_CHURN_LIVE], rc);
+          exit(1);
+        }
+    }
+
+  nb_retired = 0;
+  retired_size = 0;
+  for(array = ht->open_partition[0].array->retired; array != NULL; array = array->retired)
+    {
+      nb_retired += 1;
+      retired_size += array->size;
+    }
+
+  if(HashTable_GetSize(ht) != NB_CHURN_LIVE || nb_retired != 0 ||
+     ht->open_partition[0].readers != 0)
+    {
+      LogTest("Test FAILED: %u entries, %u arrays retired holding %llu slots for %u",
+              HashTable_GetSize(ht), nb_retired, (unsigned long long)retired_size,
+              ht->open_partition[0].array->size);
+      exit(1);
+    }
+
+  LogTest("No array left retired, the current one has %u slots",
+          ht->open_partition[0].array->size);
+}                               /* test_churn */
+
+static void *reclaim_get_thread(void *arg)
+{
+  unsigned int seed = (unsigned int)(unsigned long)arg;
+  hash_buffer_t buffval;
+  hash_buffer_t buffkey;
+  uint32_t nb_set;
+  int k;
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  while(!atomic_fetch_uint32_t(&bench_done))
+    {
+      if((nb_set = atomic_fetch_uint32_t(&bench_nb_set)) == 0)
+        continue;
+
+      k = rand_r(&seed) % nb_set;
+      buffkey.len = strlen(bench_keys[k]);
+      buffkey.pdata = bench_keys[k];
+
+      if(HashTable_Get(bench_ht, &buffkey, &buffval) != HASHTABLE_SUCCESS ||
+         buffval.pdata != bench_keys[k])
+        {
+          LogTest("Test FAILED: key %s lost while the table grew", bench_keys[k]);
+          exit(1);
+        }
+    }
+
+  return NULL;
+}                               /* reclaim_get_thread */
+
+/* Grows a one partition table while lockless readers look it up: the arrays
+ * it retires are freed as the readers let go of them */
+static void test_reclaim(void)
+{
+  hash_parameter_t hparam;
+  hash_buffer_t buffkey;
+  hash_open_array_t *array;
+  pthread_t thrid[NB_RECLAIM_READERS];
+  unsigned int nb_retired;
+  int i;
+
+  LogTest("Reclaim test for the %s backend",
+          HashTable_BackendToStr(HASHTABLE_BACKEND_OPEN));
+
+  memset(&hparam, 0, sizeof(hparam));
+  hparam.index_size = 1;
+  hparam.alphabet_length = 10;
+  hparam.nb_node_prealloc = 1;
+  hparam.hash_func_key = simple_hash_func;
+  hparam.hash_func_rbt = rbt_hash_func;
+  hparam.compare_key = compare_string_buffer;
+  hparam.key_to_str = display_buff;
+  hparam.val_to_str = display_buff;
+  hparam.name = "Reclaim";
+  hparam.backend = HASHTABLE_BACKEND_OPEN;
+  hparam.inline_keys = TRUE;
+
+  if((bench_ht = HashTable_Init(hparam)) == NULL)
+    {
+      LogTest("Test FAILED: Bad init");
+      exit(1);
+    }
+
+  bench_nb_set = 0;
+  bench_done = FALSE;
+
+  for(i = 0; i < NB_RECLAIM_READERS; i++)
+    pthread_create(&thrid[i], NULL, reclaim_get_thread, (void *)(unsigned long)(i + 1));
+
+  for(i = 0; i < NB_BENCH_KEYS; i++)
+    {
+      buffkey.len = strlen(bench_keys[i]);
+      buffkey.pdata = bench_keys[i];
+
+      if(HashTable_Set(bench_ht, &buffkey, &buffkey) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: insert of %s failed", bench_keys[i]);
+          exit(1);
+        }
+
+      atomic_inc_uint32_t(&bench_nb_set);
+    }
+
+  atomic_store_uint32_t(&bench_done, TRUE);
+
+  for(i = 0; i < NB_RECLAIM_READERS; i++)
+    pthread_join(thrid[i], NULL);
+
+  /* The readers are gone, the next write frees what they held */
+  buffkey.len = strlen(bench_keys[0]);
+  buffkey.pdata = bench_keys[0];
+  HashTable_Del(bench_ht, &buffkey, NULL, NULL);
+
+  nb_retired = 0;
+  for(array = bench_ht->open_partition[0].array->retired; array != NULL; array = array->retired)
+    nb_retired += 1;
+
+  if(nb_retired != 0)
+    {
+      LogTest("Test FAILED: %u arrays still retired", nb_retired);
+      exit(1);
+    }
+}                               /* test_reclaim */
+
+static void *bench_get_thread(void *arg)
+{
+  unsigned int seed = (unsigned int)(unsigned long)arg;
+  hash_buffer_t buffval;
+  hash_buffer_t buffkey;
+  int i, k;
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  for(i = 0; i < NB_BENCH_GETS; i++)
+    {
+      k = rand_r(&seed) % NB_BENCH_KEYS;
+      buffkey.len = strlen(bench_keys[k]);
+      buffkey.pdata = bench_keys[k];
+
+      if(HashTable_Get(bench_ht, &buffkey, &buffval) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: key %s not found during the benchmark", bench_keys[k]);
+          exit(1);
+        }
+    }
+
+  return NULL;
+}                               /* bench_get_thread */
+
+/* Times inserts, lookups from several threads and deletes */
+static void bench_table(hash_table_backend_t backend)
+{
+  hash_parameter_t hparam;
+  hash_buffer_t buffval;
+  hash_buffer_t buffkey;
+  pthread_t thrid[MAX_BENCH_THREADS];
+  struct Temps debut, fin;
+  char set_time[40];
+  unsigned int nb_threads;
+  int i;
+
+  memset(&hparam, 0, sizeof(hparam));
+  hparam.index_size = PRIME;
+  hparam.alphabet_length = 10;
+  hparam.nb_node_prealloc = NB_PREALLOC;
+  hparam.hash_func_key = simple_hash_func;
+  hparam.hash_func_rbt = rbt_hash_func;
+  hparam.compare_key = compare_string_buffer;
+  hparam.key_to_str = display_buff;
+  hparam.val_to_str = display_buff;
+  hparam.name = "Bench";
+  hparam.backend = backend;
+  hparam.inline_keys = TRUE;
+
+  if((bench_ht = HashTable_Init(hparam)) == NULL)
+    {
+      LogTest("Test FAILED: Bad init");
+      exit(1);
+    }
+
+  MesureTemps(&debut, NULL);
+  for(i = 0; i < NB_BENCH_KEYS; i++)
+    {
+      buffkey.len = strlen(bench_keys[i]);
+      buffkey.pdata = bench_keys[i];
+      buffval = buffkey;
+
+      if(HashTable_Set(bench_ht, &buffkey, &buffval) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: insert of %s failed", bench_keys[i]);
+          exit(1);
+        }
+    }
+  MesureTemps(&fin, &debut);
+  strncpy(set_time, ConvertiTempsChaine(fin, NULL), sizeof(set_time) - 1);
+  set_time[sizeof(set_time) - 1] = '\0';
+
+  for(nb_threads = 1; nb_threads <= MAX_BENCH_THREADS; nb_threads *= 2)
+    {
+      MesureTemps(&debut, NULL);
+      for(i = 0; i < nb_threads; i++)
+        pthread_create(&thrid[i], NULL, bench_get_thread, (void *)(unsigned long)(i + 1));
+      for(i = 0; i < nb_threads; i++)
+        pthread_join(thrid[i], NULL);
+      MesureTemps(&fin, &debut);
+
+      LogTest("%-15s: %d sets in %s, %u thread(s) x %d gets in %s",
+              HashTable_BackendToStr(backend), NB_BENCH_KEYS, set_time,
+              nb_threads, NB_BENCH_GETS, ConvertiTempsChaine(fin, NULL));
+    }
+
+  MesureTemps(&debut, NULL);
+  for(i = 0; i < NB_BENCH_KEYS; i++)
+    {
+      buffkey.len = strlen(bench_keys[i]);
+      buffkey.pdata = bench_keys[i];
+
+      if(HashTable_Del(bench_ht, &buffkey, NULL, NULL) != HASHTABLE_SUCCESS)
+        {
+          LogTest("Test FAILED: delete of %s failed", bench_keys[i]);
+          exit(1);
+        }
+    }
+  MesureTemps(&fin, &debut);
+  LogTest("%-15s: %d dels in %s", HashTable_BackendToStr(backend), NB_BENCH_KEYS,
+          ConvertiTempsChaine(fin, NULL));
+}                               /* bench_table */
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_cmchash");
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  test_table(HASHTABLE_BACKEND_RBT);
+  test_table(HASHTABLE_BACKEND_OPEN);
+
+  test_growth(HASHTABLE_BACKEND_RBT);
+  test_growth(HASHTABLE_BACKEND_OPEN);
+  test_churn();
+
+  test_value_keys(HASHTABLE_BACKEND_RBT);
+  test_value_keys(HASHTABLE_BACKEND_OPEN);
+
+  for(i = 0; i < NB_BENCH_KEYS; i++)
+    sprintf(bench_keys[i], "%d", i);
+
+  test_reclaim();
+
+  LogTest("=========================================");
+  LogTest("Benchmark");
+
+  bench_table(HASHTABLE_BACKEND_RBT);
+  bench_table(HASHTABLE_BACKEND_OPEN);
+
   /* Tous les tests sont ok */
+#ifndef _NO_BUDDY_SYSTEM
   BuddyDumpMem(stdout);
+#endif
 
   LogTest("\n-----------------------------------------");
   LogTest("Test succeeded: all tests pass successfully");
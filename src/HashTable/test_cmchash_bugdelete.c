@@ -201,7 +201,9 @@ int main(int argc, char *argv[])
   hparam.key_to_str = display_buff;
   hparam.val_to_str = display_buff;
 
+#ifndef _NO_BUDDY_SYSTEM
   BuddyInit(NULL);
+#endif
 
   /* Init de la table */
   if((ht = HashTable_Init(hparam)) == NULL)
@@ -410,7 +412,9 @@ int main(int argc, char *argv[])
     }
 
   /* Tous les tests sont ok */
+#ifndef _NO_BUDDY_SYSTEM
   BuddyDumpMem(stdout);
+#endif
 
   LogTest("\n-----------------------------------------");
   LogTest("Test succeeded: all tests pass successfully");
@@ -231,16 +231,18 @@ int main(int argc, char *argv[])
   int expected_rc;
   char c;
 
+#ifndef _NO_BUDDY_SYSTEM
   BuddyInit(NULL);
+#endif
 
   if((astrkey = (char *)Mem_Alloc(MAXTEST * STRSIZE)) == NULL)
     {
-      printf("Test FAILED: problem with Mem_Alloc : keys, BuddyErrno = %d", BuddyErrno);
+      printf("Test FAILED: problem with Mem_Alloc : keys, Mem_Errno = %d", Mem_Errno);
     }
 
   if((astrval = (char *)Mem_Alloc(MAXTEST * STRSIZE)) == NULL)
     {
-      printf("Test FAILED: problem with Mem_Alloc : values, BuddyErrno = %d", BuddyErrno);
+      printf("Test FAILED: problem with Mem_Alloc : values, Mem_Errno = %d", Mem_Errno);
     }
 
   hparam.index_size = PRIME;
@@ -441,7 +443,9 @@ int main(int argc, char *argv[])
       fflush(stdout);
     }
 
+#ifndef _NO_BUDDY_SYSTEM
   BuddyDumpMem(stderr);
+#endif
 
   LogTest("====================================================");
   LogTest("Test succeeded: all tests pass successfully");
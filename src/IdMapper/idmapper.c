@@ -51,6 +51,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <sys/time.h>
 #include <grp.h>
 
 #ifdef _USE_NFSIDMAP
@@ -88,11 +89,17 @@ int nfsidmap_set_conf()
 }
 #endif                          /* _USE_NFSIDMAP */
 
+/* Working area of the getpwnam_r-like functions */
+#define IDMAP_NSS_BUFLEN 8192
+
+/* Groups asked for first, the list grows to the groups of the user */
+#define UID2GRP_NSS_GROUPS 64
+
 /**
  *
- * uid2name: convert a uid to a name. 
+ * uid2name_nss: asks the name service for the name of a uid.
  *
- * convert a uid to a name. 
+ * Asks the name service for the name of a uid, and caches the mapping found.
  *
  * @param name [OUT]  the name of the user
  * @param uid  [IN]   the input uid
@@ -100,12 +107,10 @@ int nfsidmap_set_conf()
  * return 1 if successful, 0 otherwise
  *
  */
-int uid2name(char *name, uid_t * puid)
+static int uid2name_nss(char *name, uid_t uid)
 {
-  char fqname[NFS4_MAX_DOMAIN_LEN];
-
 #ifdef _USE_NFSIDMAP
-
+  char fqname[NFS4_MAX_DOMAIN_LEN];
   int rc;
 
   if(!nfsidmap_set_conf())
@@ -115,99 +120,80 @@ int uid2name(char *name, uid_t * puid)
       return 0;
     }
 
-  if(unamemap_get(*puid, name) == ID_MAPPER_SUCCESS)
+  rc = nfs4_uid_to_name(uid, idmap_domain, name, NFS4_MAX_DOMAIN_LEN);
+  if(rc != 0)
     {
-      LogFullDebug(COMPONENT_IDMAPPER,
-                   "uid2name: unamemap_get uid %d returned %s",
-                   *puid, name);
-      return 1;
+      LogDebug(COMPONENT_IDMAPPER,
+               "uid2name: nfs4_uid_to_name %d returned %d (%s)",
+               uid, -rc, strerror(-rc));
+      return 0;
     }
-  else
-    {
-      rc = nfs4_uid_to_name(*puid, idmap_domain, name, NFS4_MAX_DOMAIN_LEN);
-      if(rc != 0)
-        {
-          LogDebug(COMPONENT_IDMAPPER,
-                   "uid2name: nfs4_uid_to_name %d returned %d (%s)",
-                   *puid, -rc, strerror(-rc));
-          return 0;
-        }
-
-      strncpy(fqname, name, NFS4_MAX_DOMAIN_LEN);
-      if(strchr(name, '@') == NULL)
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "uid2name: adding domain %s",
-                       idmap_domain);
-          sprintf(fqname, "%s@%s", name, idmap_domain);
-          strncpy(name, fqname, NFS4_MAX_DOMAIN_LEN);
-        }
 
+  strncpy(fqname, name, NFS4_MAX_DOMAIN_LEN);
+  if(strchr(name, '@') == NULL)
+    {
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "uid2name: nfs4_uid_to_name uid %d returned %s",
-                   *puid, name);
+                   "uid2name: adding domain %s",
+                   idmap_domain);
+      sprintf(fqname, "%s@%s", name, idmap_domain);
+      strncpy(name, fqname, NFS4_MAX_DOMAIN_LEN);
+    }
 
-      if(uidmap_add(fqname, *puid) != ID_MAPPER_SUCCESS)
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "uid2name: uidmap_add %s %d failed",
-                  fqname, *puid);
-          return 0;
-        }
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "uid2name: nfs4_uid_to_name uid %d returned %s",
+               uid, name);
+
+  if(uidmap_add(fqname, uid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "uid2name: uidmap_add %s %d failed",
+              fqname, uid);
+      return 0;
     }
+
   return 1;
 
 #else
   struct passwd p;
   struct passwd *pp;
-  char buff[NFS4_MAX_DOMAIN_LEN];
+  char buff[IDMAP_NSS_BUFLEN];
 
-  if(unamemap_get(*puid, name) == ID_MAPPER_SUCCESS)
-    {
-      LogFullDebug(COMPONENT_IDMAPPER,
-                   "uid2name: unamemap_get uid %d returned %s",
-                   *puid, name);
-      return 1;
-    }
-  else
-    {
 #ifdef _SOLARIS
-      if(getpwuid_r(*puid, &p, buff, MAXPATHLEN) != 0)
+  if(getpwuid_r(uid, &p, buff, IDMAP_NSS_BUFLEN) != 0)
 #else
-      if((getpwuid_r(*puid, &p, buff, MAXPATHLEN, &pp) != 0) ||
-	 (pp == NULL))
+  if((getpwuid_r(uid, &p, buff, IDMAP_NSS_BUFLEN, &pp) != 0) ||
+     (pp == NULL))
 #endif                          /* _SOLARIS */
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "uid2name: getpwuid_r %d failed",
-                       *puid);
-          return 0;
-        }
+    {
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "uid2name: getpwuid_r %d failed",
+                   uid);
+      return 0;
+    }
 
-      strncpy(name, p.pw_name, NFS4_MAX_DOMAIN_LEN);
+  strncpy(name, p.pw_name, NFS4_MAX_DOMAIN_LEN);
 
-      LogFullDebug(COMPONENT_IDMAPPER,
-                   "uid2name: getpwuid_r uid %d returned %s",
-                   *puid, name);
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "uid2name: getpwuid_r uid %d returned %s",
+               uid, name);
 
-      if(uidmap_add(name, *puid) != ID_MAPPER_SUCCESS)
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "uid2name: uidmap_add %s %d failed",
-                  name, *puid);
-          return 0;
-        }
+  if(uidmap_add(name, uid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "uid2name: uidmap_add %s %d failed",
+              name, uid);
+      return 0;
     }
 
   return 1;
 #endif                          /* _USE_NFSIDMAP */
-}                               /* uid2name */
+}                               /* uid2name_nss */
 
 /**
  *
- * name2uid: convert a name to a uid
+ * name2uid_nss: asks the name service for the uid of a name.
  *
- * convert a name to a uid
+ * Asks the name service for the uid of a name, and caches the mapping found.
  *
  * @param name [IN]  the name of the user
  * @param puid [OUT] the resulting uid
@@ -215,12 +201,11 @@ int uid2name(char *name, uid_t * puid)
  * return 1 if successful, 0 otherwise
  *
  */
-int name2uid(char *name, uid_t * puid)
+static int name2uid_nss(char *name, uid_t * puid)
 {
   struct passwd passwd;
   struct passwd *ppasswd;
-  char buff[NFS4_MAX_DOMAIN_LEN];
-  uid_t uid;
+  char buff[IDMAP_NSS_BUFLEN];
 #ifdef _HAVE_GSSAPI
   gid_t gss_gid;
   uid_t gss_uid;
@@ -230,126 +215,465 @@ int name2uid(char *name, uid_t * puid)
   int rc;
 #endif
 
-  /* NFsv4 specific features: RPCSEC_GSS will provide user like nfs/<host>
-   * choice is made to map them to root */
-  if(!strncmp(name, "nfs/", 4))
+#ifdef _SOLARIS
+  if(getpwnam_r(name, &passwd, buff, IDMAP_NSS_BUFLEN) != 0)
+#else
+  if((getpwnam_r(name, &passwd, buff, IDMAP_NSS_BUFLEN, &ppasswd) != 0) ||
+     (ppasswd == NULL))
+#endif                          /* _SOLARIS */
     {
-      /* This is a "root" request made from the hostbased nfs principal, use root */
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "name2uid: mapping %s to root (uid = 0)",
+                   "name2uid: getpwnam_r %s failed",
                    name);
-      *puid = 0;
+      *puid = -1;
+      return 0;
+    }
+  else
+    {
+      *puid = passwd.pw_uid;
+#ifdef _HAVE_GSSAPI
+      if(uidgidmap_add(passwd.pw_uid, passwd.pw_gid) != ID_MAPPER_SUCCESS)
+        {
+          LogCrit(COMPONENT_IDMAPPER,
+                  "name2uid: uidgidmap_add gss_uid %d gss_gid %d failed",
+                  passwd.pw_uid, passwd.pw_gid);
+          return 0;
+        }
+#endif                          /* _HAVE_GSSAPI */
+      if(uidmap_add(name, passwd.pw_uid) != ID_MAPPER_SUCCESS)
+        {
+          LogCrit(COMPONENT_IDMAPPER,
+                  "name2uid: uidmap_add %s %d failed",
+                  name, passwd.pw_uid);
+          return 0;
+        }
 
-      return 1;
+       return 1 ; /* Job is done */
     }
 
-  if(uidmap_get(name, (unsigned long *)&uid) == ID_MAPPER_SUCCESS)
+#ifdef _USE_NFSIDMAP
+  if(!nfsidmap_set_conf())
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "name2uid: nfsidmap_set_conf failed");
+      return 0;
+    }
+
+  /* obtain fully qualified name */
+  if(strchr(name, '@') == NULL)
+    sprintf(fqname, "%s@%s", name, idmap_domain);
+  else
+    strncpy(fqname, name, NFS4_MAX_DOMAIN_LEN - 1);
+
+  rc = nfs4_name_to_uid(fqname, puid);
+  if(rc)
     {
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "name2uid: uidmap_get mapped %s to uid= %d",
-                   name, uid);
-      *puid = uid;
+                   "name2uid: nfs4_name_to_uid %s failed %d (%s)",
+                   fqname, -rc, strerror(-rc));
+      return 0;
+    }
+
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "name2uid: nfs4_name_to_uid %s returned %d",
+               fqname, *puid);
 
-      return 1 ;
+  if(uidmap_add(fqname, *puid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "name2uid: uidmap_add %s %d failed",
+              fqname, *puid);
+      return 0;
     }
-  else
+
+#ifdef _HAVE_GSSAPI
+  /* nfs4_gss_princ_to_ids required to extract uid/gid from gss creds
+   * XXX: currently uses unqualified name as per libnfsidmap comments */
+  rc = nfs4_gss_princ_to_ids("krb5", name, &gss_uid, &gss_gid);
+  if(rc)
     {
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "name2uid: nfs4_gss_princ_to_ids %s failed %d (%s)",
+                   name, -rc, strerror(-rc));
+      return 0;
+    }
+
+  if(uidgidmap_add(gss_uid, gss_gid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "name2uid: uidgidmap_add gss_uid %d gss_gid %d failed",
+              gss_uid, gss_gid);
+      return 0;
+    }
+#endif                          /* _HAVE_GSSAPI */
+
+#endif                           /* _USE_NFSIDMAP */
+
+  return 1;
+}                               /* name2uid_nss */
+
+/**
+ *
+ * gid2name_nss: asks the name service for the name of a gid.
+ *
+ * Asks the name service for the name of a gid, and caches the mapping found.
+ *
+ * @param name [OUT]  the name of the group
+ * @param gid  [IN]   the input gid
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+static int gid2name_nss(char *name, gid_t gid)
+{
+#ifdef _USE_NFSIDMAP
+  int rc;
+
+  if(!nfsidmap_set_conf())
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "gid2name: nfsidmap_set_conf failed");
+      return 0;
+    }
+
+  rc = nfs4_gid_to_name(gid, idmap_domain, name, NFS4_MAX_DOMAIN_LEN);
+  if(rc != 0)
+    {
+      LogDebug(COMPONENT_IDMAPPER,
+               "gid2name: nfs4_gid_to_name %d returned %d (%s)",
+               gid, -rc, strerror(-rc));
+      return 0;
+    }
+
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "gid2name: nfs4_gid_to_name gid %d returned %s",
+               gid, name);
+
+  if(gidmap_add(name, gid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "gid2name: gidmap_add %s %d failed",
+              name, gid);
+      return 0;
+    }
+
+  return 1;
+
+#else
+  struct group g;
+#ifndef _SOLARIS
+  struct group *pg = NULL;
+#endif
+  char buff[IDMAP_NSS_BUFLEN]; /* Working area for getgrgid_r */
+
 #ifdef _SOLARIS
-      if(getpwnam_r(name, &passwd, buff, NFS4_MAX_DOMAIN_LEN) != 0)
+  if(getgrgid_r(gid, &g, buff, IDMAP_NSS_BUFLEN) != 0)
 #else
-      if(getpwnam_r(name, &passwd, buff, NFS4_MAX_DOMAIN_LEN, &ppasswd) != 0)
+  if((getgrgid_r(gid, &g, buff, IDMAP_NSS_BUFLEN, &pg) != 0) ||
+     (pg == NULL))
 #endif                          /* _SOLARIS */
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "name2uid: getpwnam_r %s failed",
-                       name);
-          *puid = -1;
-          return 0;
-        }
-      else
-        {
-          *puid = passwd.pw_uid;
-#ifdef _HAVE_GSSAPI
-          if(uidgidmap_add(passwd.pw_uid, passwd.pw_gid) != ID_MAPPER_SUCCESS)
-            {
-              LogCrit(COMPONENT_IDMAPPER,
-                      "name2uid: uidgidmap_add gss_uid %d gss_gid %d failed",
-                      passwd.pw_uid, passwd.pw_gid);
-              return 0;
-            }
-#endif                          /* _HAVE_GSSAPI */
-          if(uidmap_add(name, passwd.pw_uid) != ID_MAPPER_SUCCESS)
-            {
-              LogCrit(COMPONENT_IDMAPPER,
-                      "name2uid: uidmap_add %s %d failed",
-                      name, passwd.pw_uid);
-              return 0;
-            }
-
-           return 1 ; /* Job is done */
-        }
+    {
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "gid2name: getgrgid_r %d failed",
+                   gid);
+      return 0;
+    }
+
+  strncpy(name, g.gr_name, NFS4_MAX_DOMAIN_LEN);
+
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "gid2name: getgrgid_r gid %d returned %s",
+               gid, name);
 
+  if(gidmap_add(name, gid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "gid2name: gidmap_add %s %d failed",
+              name, gid);
+      return 0;
+    }
+
+  return 1;
+#endif                          /* _USE_NFSIDMAP */
+}                               /* gid2name_nss */
+
+/**
+ *
+ * name2gid_nss: asks the name service for the gid of a name.
+ *
+ * Asks the name service for the gid of a name, and caches the mapping found.
+ *
+ * @param name [IN]  the name of the group
+ * @param pgid [OUT] the resulting gid
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+static int name2gid_nss(char *name, gid_t * pgid)
+{
 #ifdef _USE_NFSIDMAP
-      if(!nfsidmap_set_conf())
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "name2uid: nfsidmap_set_conf failed");
-          return 0;
-        }
+  int rc;
 
-      /* obtain fully qualified name */
-      if(strchr(name, '@') == NULL)
-        sprintf(fqname, "%s@%s", name, idmap_domain);
-      else
-        strncpy(fqname, name, NFS4_MAX_DOMAIN_LEN - 1);
+  if(!nfsidmap_set_conf())
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "name2gid: nfsidmap_set_conf failed");
+      return 0;
+    }
 
-      rc = nfs4_name_to_uid(fqname, puid);
-      if(rc)
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "name2uid: nfs4_name_to_uid %s failed %d (%s)",
-                       fqname, -rc, strerror(-rc));
-          return 0;
-        }
+  rc = nfs4_name_to_gid(name, pgid);
+  if(rc)
+    {
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "name2gid: nfs4_name_to_gid %s failed %d (%s)",
+                   name, -rc, strerror(-rc));
+      return 0;
+    }
+
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "name2gid: nfs4_name_to_gid %s returned %d",
+               name, *pgid);
+
+  if(gidmap_add(name, *pgid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "name2gid: gidmap_add %s %d failed",
+              name, *pgid);
+      return 0;
+    }
+
+#else
+  struct group g;
+#ifndef _SOLARIS
+  struct group *pg = NULL;
+#endif
+  char buff[IDMAP_NSS_BUFLEN]; /* Working area for getgrnam_r */
 
+#ifdef _SOLARIS
+  if(getgrnam_r(name, &g, buff, IDMAP_NSS_BUFLEN) != 0)
+#else
+  if((getgrnam_r(name, &g, buff, IDMAP_NSS_BUFLEN, &pg) != 0) ||
+     (pg == NULL))
+#endif
+    {
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "name2uid: nfs4_name_to_uid %s returned %d",
-                   fqname, *puid);
+                   "name2gid: getgrnam_r %s failed",
+                   name);
+      *pgid = -1;
+      return 0;
+    }
 
-      if(uidmap_add(fqname, *puid) != ID_MAPPER_SUCCESS)
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "name2uid: uidmap_add %s %d failed",
-                  fqname, *puid);
-          return 0;
-        }
+  *pgid = g.gr_gid;
 
-#ifdef _HAVE_GSSAPI
-      /* nfs4_gss_princ_to_ids required to extract uid/gid from gss creds
-       * XXX: currently uses unqualified name as per libnfsidmap comments */
-      rc = nfs4_gss_princ_to_ids("krb5", name, &gss_uid, &gss_gid);
-      if(rc)
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "name2uid: nfs4_gss_princ_to_ids %s failed %d (%s)",
-                       name, -rc, strerror(-rc));
-          return 0;
-        }
+  if(gidmap_add(name, g.gr_gid) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "name2gid: gidmap_add %s %d failed",
+              name, g.gr_gid);
+      return 0;
+    }
+#endif                          /* _USE_NFSIDMAP */
 
-      if(uidgidmap_add(gss_uid, gss_gid) != ID_MAPPER_SUCCESS)
+  return 1;
+}                               /* name2gid_nss */
+
+/**
+ *
+ * idmap_resolve: asks the name service for a mapping.
+ *
+ * Asks the name service for a mapping, and caches it if found. Called on the
+ * cache misses, and by the refresh thread for the mappings used shortly before
+ * they expire. The time spent in the name service goes to the stats.
+ *
+ * @param maptype [IN]    UIDMAP_TYPE or GIDMAP_TYPE
+ * @param by_id   [IN]    look the id up, else the name
+ * @param name    [INOUT] the name, found if by_id
+ * @param pid     [INOUT] the id, found if not by_id
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+int idmap_resolve(idmap_type_t maptype, int by_id, char *name, unsigned int *pid)
+{
+  struct timeval start;
+  struct timeval end;
+  int found;
+
+  gettimeofday(&start, NULL);
+
+  if(maptype == UIDMAP_TYPE)
+    found = by_id ? uid2name_nss(name, *pid) : name2uid_nss(name, (uid_t *) pid);
+  else
+    found = by_id ? gid2name_nss(name, *pid) : name2gid_nss(name, (gid_t *) pid);
+
+  gettimeofday(&end, NULL);
+
+  idmap_resolve_done(maptype,
+                     (end.tv_sec - start.tv_sec) * 1000000ULL + end.tv_usec - start.tv_usec,
+                     found);
+
+  return found;
+}                               /* idmap_resolve */
+
+/**
+ *
+ * uid2grp_resolve: asks the name service for the groups of a uid.
+ *
+ * Asks the name service for the primary group of a uid and for all the groups
+ * its user is a member of. Called by the group list cache, which keeps the
+ * result; the caller frees the list with Mem_Free.
+ *
+ * @param uid       [IN]  the uid
+ * @param pgid      [OUT] the primary group
+ * @param pgroups   [OUT] the groups, primary one included
+ * @param pnbgroups [OUT] the number of groups
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+int uid2grp_resolve(uid_t uid, gid_t * pgid, gid_t ** pgroups, unsigned int *pnbgroups)
+{
+  struct passwd p;
+#ifndef _SOLARIS
+  struct passwd *pp;
+#endif
+  char buff[IDMAP_NSS_BUFLEN];
+  gid_t *groups;
+  gid_t *bigger;
+  int nbgroups = UID2GRP_NSS_GROUPS;
+  int allocated = UID2GRP_NSS_GROUPS;
+
+#ifdef _SOLARIS
+  if(getpwuid_r(uid, &p, buff, IDMAP_NSS_BUFLEN) != 0)
+#else
+  if((getpwuid_r(uid, &p, buff, IDMAP_NSS_BUFLEN, &pp) != 0) ||
+     (pp == NULL))
+#endif                          /* _SOLARIS */
+    {
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "uid2grp: getpwuid_r %d failed",
+                   uid);
+      return 0;
+    }
+
+  if((groups = (gid_t *) Mem_Alloc_Label(nbgroups * sizeof(gid_t), "uid2grp")) == NULL)
+    return 0;
+
+  /* getgrouplist gives the number of groups when they do not fit, or should */
+  while(getgrouplist(p.pw_name, p.pw_gid, groups, &nbgroups) == -1)
+    {
+      if(nbgroups <= allocated)
+        nbgroups = allocated * 2;
+
+      if((bigger = (gid_t *) Mem_Realloc_Label(groups, nbgroups * sizeof(gid_t),
+                                               "uid2grp")) == NULL)
         {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "name2uid: uidgidmap_add gss_uid %d gss_gid %d failed",
-                  gss_uid, gss_gid);
+          Mem_Free(groups);
           return 0;
         }
-#endif                          /* _HAVE_GSSAPI */
+      groups = bigger;
+      allocated = nbgroups;
+    }
 
-#endif                           /* _USE_NFSIDMAP */
+  LogFullDebug(COMPONENT_IDMAPPER,
+               "uid2grp: uid %d (%s) is in %d groups",
+               uid, p.pw_name, nbgroups);
 
-    }
+  *pgid = p.pw_gid;
+  *pgroups = groups;
+  *pnbgroups = nbgroups;
 
   return 1;
+}                               /* uid2grp_resolve */
+
+/**
+ *
+ * uid2name: convert a uid to a name.
+ *
+ * convert a uid to a name. The name service is asked on cache misses, and
+ * the uids it does not know are cached too.
+ *
+ * @param name [OUT]  the name of the user
+ * @param uid  [IN]   the input uid
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+int uid2name(char *name, uid_t * puid)
+{
+  switch (unamemap_get(*puid, name))
+    {
+    case ID_MAPPER_SUCCESS:
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "uid2name: unamemap_get uid %d returned %s",
+                   *puid, name);
+      return 1;
+
+    case ID_MAPPER_NEGATIVE:
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "uid2name: uid %d is not known",
+                   *puid);
+      return 0;
+    }
+
+  if(idmap_resolve(UIDMAP_TYPE, TRUE, name, puid))
+    return 1;
+
+  unamemap_add_negative(*puid);
+  return 0;
+}                               /* uid2name */
+
+/**
+ *
+ * name2uid: convert a name to a uid
+ *
+ * convert a name to a uid
+ *
+ * @param name [IN]  the name of the user
+ * @param puid [OUT] the resulting uid
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+int name2uid(char *name, uid_t * puid)
+{
+  unsigned long uid;
+
+  /* NFsv4 specific features: RPCSEC_GSS will provide user like nfs/<host>
+   * choice is made to map them to root */
+  if(!strncmp(name, "nfs/", 4))
+    {
+      /* This is a "root" request made from the hostbased nfs principal, use root */
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "name2uid: mapping %s to root (uid = 0)",
+                   name);
+      *puid = 0;
+
+      return 1;
+    }
+
+  switch (uidmap_get(name, &uid))
+    {
+    case ID_MAPPER_SUCCESS:
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "name2uid: uidmap_get mapped %s to uid= %lu",
+                   name, uid);
+      *puid = uid;
+      return 1;
+
+    case ID_MAPPER_NEGATIVE:
+      LogFullDebug(COMPONENT_IDMAPPER,
+                   "name2uid: %s is not known",
+                   name);
+      *puid = -1;
+      return 0;
+    }
+
+  if(idmap_resolve(UIDMAP_TYPE, FALSE, name, puid))
+    return 1;
+
+  uidmap_add_negative(name);
+  return 0;
 }                               /* name2uid */
 
 /**
@@ -367,12 +691,17 @@ int name2uid(char *name, uid_t * puid)
 #ifdef _HAVE_GSSAPI
 int principal2uid(char *principal, uid_t * puid)
 {
+  unsigned long cached_uid;
   gid_t gss_gid;
   uid_t gss_uid;
   int rc;
 
 #ifdef _USE_NFSIDMAP
-  if(uidmap_get(principal, (unsigned long *)&gss_uid) != ID_MAPPER_SUCCESS)
+  if(uidmap_get(principal, &cached_uid) == ID_MAPPER_SUCCESS)
+    {
+      gss_uid = cached_uid;
+    }
+  else
     {
       if(!nfsidmap_set_conf())
         {
@@ -422,11 +751,12 @@ int principal2uid(char *principal, uid_t * puid)
 
 /**
  *
- * gid2name: convert a gid to a name. 
+ * gid2name: convert a gid to a name.
  *
- * convert a uid to a name. 
+ * convert a gid to a name. The name service is asked on cache misses, and
+ * the gids it does not know are cached too.
  *
- * @param name [OUT]  the name of the user
+ * @param name [OUT]  the name of the group
  * @param gid  [IN]   the input gid
  *
  * return 1 if successful, 0 otherwise
@@ -434,97 +764,26 @@ int principal2uid(char *principal, uid_t * puid)
  */
 int gid2name(char *name, gid_t * pgid)
 {
-#ifndef _USE_NFSIDMAP
-  struct group g;
-#ifndef _SOLARIS
-  struct group *pg = NULL;
-#endif
-  static char buff[NFS4_MAX_DOMAIN_LEN]; /* Working area for getgrnam_r */
-#endif
-
-#ifdef _USE_NFSIDMAP
-  int rc;
-
-  if(gnamemap_get(*pgid, name) == ID_MAPPER_SUCCESS)
-    {
-      LogFullDebug(COMPONENT_IDMAPPER,
-                   "gid2name: unamemap_get gid %d returned %s",
-                   *pgid, name);
-      return 1;
-    }
-  else
-    {
-      if(!nfsidmap_set_conf())
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "gid2name: nfsidmap_set_conf failed");
-          return 0;
-        }
-
-      rc = nfs4_gid_to_name(*pgid, idmap_domain, name, NFS4_MAX_DOMAIN_LEN);
-      if(rc != 0)
-        {
-          LogDebug(COMPONENT_IDMAPPER,
-                   "gid2name: nfs4_gid_to_name %d returned %d (%s)",
-                   *pgid, -rc, strerror(-rc));
-          return 0;
-        }
-
-      LogFullDebug(COMPONENT_IDMAPPER,
-                   "gid2name: nfs4_gid_to_name gid %d returned %s",
-                   *pgid, name);
-
-      if(gidmap_add(name, *pgid) != ID_MAPPER_SUCCESS)
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "gid2name: gidmap_add %s %d failed",
-                  name, *pgid);
-          return 0;
-        }
-    }
-
-  return 1;
-
-#else
-  if(gnamemap_get(*pgid, name) == ID_MAPPER_SUCCESS)
+  switch (gnamemap_get(*pgid, name))
     {
+    case ID_MAPPER_SUCCESS:
       LogFullDebug(COMPONENT_IDMAPPER,
                    "gid2name: gnamemap_get gid %d returned %s",
                    *pgid, name);
       return 1;
-    }
-  else
-    {
-#ifdef _SOLARIS
-      if(getgrgid_r(*pgid, &g, buff, NFS4_MAX_DOMAIN_LEN) != 0)
-#else
-      if((getgrgid_r(*pgid, &g, buff, NFS4_MAX_DOMAIN_LEN, &pg) != 0) ||
-	 (pg == NULL))
-#endif                          /* _SOLARIS */
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "gid2name: getgrgid_r %d failed",
-                       *pgid);
-          return 0;
-        }
-
-      strncpy(name, g.gr_name, NFS4_MAX_DOMAIN_LEN);
 
+    case ID_MAPPER_NEGATIVE:
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "gid2name: getgrgid_r gid %d returned %s",
-                   *pgid, name);
-
-      if(gidmap_add(name, *pgid) != ID_MAPPER_SUCCESS)
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "gid2name: gidmap_add %s %d failed",
-                  name, *pgid);
-          return 0;
-        }
+                   "gid2name: gid %d is not known",
+                   *pgid);
+      return 0;
     }
 
-  return 1;
-#endif                          /* _USE_NFSIDMAP */
+  if(idmap_resolve(GIDMAP_TYPE, TRUE, name, pgid))
+    return 1;
+
+  gnamemap_add_negative(*pgid);
+  return 0;
 }                               /* gid2name */
 
 /**
@@ -541,84 +800,30 @@ int gid2name(char *name, gid_t * pgid)
  */
 int name2gid(char *name, gid_t * pgid)
 {
-#ifndef _USE_NFSIDMAP
-  struct group g;
-#ifndef _SOLARIS
-  struct group *pg = NULL;
-#endif
-  static char buff[NFS4_MAX_DOMAIN_LEN]; /* Working area for getgrnam_r */
-#endif
-  gid_t gid;
-  int rc;
+  unsigned long gid;
 
-  if(gidmap_get(name, (unsigned long *)&gid) == ID_MAPPER_SUCCESS)
+  switch (gidmap_get(name, &gid))
     {
+    case ID_MAPPER_SUCCESS:
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "name2gid: gidmap_get mapped %s to gid= %d",
+                   "name2gid: gidmap_get mapped %s to gid= %lu",
                    name, gid);
       *pgid = gid;
-    }
-  else
-    {
-#ifdef _USE_NFSIDMAP
-      if(!nfsidmap_set_conf())
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "name2gid: nfsidmap_set_conf failed");
-          return 0;
-        }
-
-      rc = nfs4_name_to_gid(name, pgid);
-      if(rc)
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "name2gid: nfs4_name_to_gid %s failed %d (%s)",
-                       name, -rc, strerror(-rc));
-          return 0;
-        }
+      return 1;
 
+    case ID_MAPPER_NEGATIVE:
       LogFullDebug(COMPONENT_IDMAPPER,
-                   "name2gid: nfs4_name_to_gid %s returned %d",
-                   name, *pgid);
-
-      if(gidmap_add(name, *pgid) != ID_MAPPER_SUCCESS)
-        {
-          LogCrit(COMPONENT_IDMAPPER,
-                  "name2gid: gidmap_add %s %d failed",
-                  name, *pgid);
-          return 0;
-        }
-
-#else
-
-#ifdef _SOLARIS
-      if(getgrnam_r(name, &g, buff, NFS4_MAX_DOMAIN_LEN) != 0)
-#else
-      if(getgrnam_r(name, &g, buff, NFS4_MAX_DOMAIN_LEN, &pg) != 0)
-#endif
-        {
-          LogFullDebug(COMPONENT_IDMAPPER,
-                       "name2gid: getgrnam_r %s failed",
-                       name);
-          *pgid = -1;
-          return 0;
-        }
-      else
-        {
-          *pgid = g.gr_gid;
+                   "name2gid: %s is not known",
+                   name);
+      *pgid = -1;
+      return 0;
+    }
 
-          if(gidmap_add(name, g.gr_gid) != ID_MAPPER_SUCCESS)
-            {
-              LogCrit(COMPONENT_IDMAPPER,
-                      "name2gid: gidmap_add %s %d failed",
-                      name, g.gr_gid);
-              return 0;
-            }
+  if(idmap_resolve(GIDMAP_TYPE, FALSE, name, pgid))
+    return 1;
 
-        }
-#endif                          /* _USE_NFSIDMAP */
-    }
-  return 1;
+  gidmap_add_negative(name);
+  return 0;
 }                               /* name2gid */
 
 /**
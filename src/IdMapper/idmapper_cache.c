@@ -48,9 +48,15 @@
 #include "nfs_core.h"
 #include "nfs_exports.h"
 #include "config_parsing.h"
+#include "abstract_atomic.h"
+#include "nlm_list.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <grp.h>
 
@@ -67,6 +73,57 @@ hash_table_t *ht_pwuid;
 hash_table_t *ht_grgid;
 hash_table_t *ht_uidgid;
 
+/* A use in the last 1/IDMAP_REFRESH_FRACTION of the life of an entry queues it for a refresh */
+#define IDMAP_REFRESH_FRACTION  4
+
+/* Requests to the name service taking longer are logged */
+#define IDMAP_SLOW_RESOLVE_USEC 1000000
+
+/* Preloaded files: length of the lines read, and fields used (name, password, id, gid) */
+#define IDMAP_PRELOAD_LINE_LEN  1024
+#define IDMAP_PRELOAD_FIELDS    4
+
+#define IDMAP_INDEX( maptype ) ( ( maptype ) == UIDMAP_TYPE ? 0 : 1 )
+
+/**
+ * A mapping between a name and an id, or a failed lookup of a name or of an id.
+ * A mapping is hashed by name (in ht_pwnam or ht_grnam) and by id (in ht_pwuid
+ * or ht_grgid), a failed lookup only by what was looked up. The hash tables,
+ * the threads reading the entry and the refresh queue hold references; an entry
+ * is not modified once hashed, it is replaced.
+ */
+typedef struct idmap_entry__
+{
+  char name[PWENT_MAX_LEN];     /* first, the entry is its own key in the tables by name */
+  unsigned int id;
+  unsigned int negative;        /* the name service found no such name, or id */
+  idmap_type_t maptype;
+  time_t expires;               /* 0 if the entry never expires */
+  time_t refresh_after;         /* a use past this time queues the entry for a refresh */
+  unsigned int refresh_by_id;   /* the refresh looks the id up, else the name */
+  unsigned int refreshing;      /* queued or refreshed, under idmap_refresh_mutex */
+  uint32_t refcount;
+  struct glist_head refresh_list;
+} idmap_entry_t;
+
+/* Lifetimes of the entries, for the uid and the gid maps */
+static struct
+{
+  unsigned int positive;
+  unsigned int negative;
+} idmap_ttl[2] =
+{
+  {ID_MAPPER_POSITIVE_TTL, ID_MAPPER_NEGATIVE_TTL},
+  {ID_MAPPER_POSITIVE_TTL, ID_MAPPER_NEGATIVE_TTL}
+};
+
+static idmap_cache_stat_t idmap_stat[2];
+
+/* Entries to refresh */
+static pthread_mutex_t idmap_refresh_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idmap_refresh_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head idmap_refresh_list = { &idmap_refresh_list, &idmap_refresh_list };
+
 /**
  *
  * idmapper_rbt_hash_func: computes the hash value for the entry in id mapper stuff
@@ -197,6 +254,29 @@ int display_idmapper_val(hash_buffer_t * pbuff, char *str)
   return sprintf(str, "%lu", (unsigned long)(pbuff->pdata));
 }                               /* display_idmapper_val */
 
+/**
+ *
+ * display_idmapper_entry: displays the mapping stored in the buffer.
+ *
+ * Displays the mapping stored in the buffer. This function is to be used as
+ * 'val_to_str' field in the hashtables storing the id mapper stuff.
+ *
+ * @param buff1 [IN]  buffer to display
+ * @param buff2 [OUT] output string
+ *
+ * @return number of character written.
+ *
+ */
+int display_idmapper_entry(hash_buffer_t * pbuff, char *str)
+{
+  idmap_entry_t *pentry = (idmap_entry_t *) pbuff->pdata;
+
+  if(pentry->negative)
+    return sprintf(str, "%s unknown", pentry->name[0] != '\0' ? pentry->name : "id");
+
+  return sprintf(str, "%s=%u", pentry->name, pentry->id);
+}                               /* display_idmapper_entry */
+
 /**
  *
  * idmap_uid_init: Inits the hashtable for UID mapping.
@@ -217,6 +297,9 @@ int idmap_uid_init(nfs_idmap_cache_parameter_t param)
       return -1;
     }
 
+  idmap_ttl[IDMAP_INDEX(UIDMAP_TYPE)].positive = param.positive_ttl;
+  idmap_ttl[IDMAP_INDEX(UIDMAP_TYPE)].negative = param.negative_ttl;
+
   return ID_MAPPER_SUCCESS;
 }                               /* idmap_uid_init */
 
@@ -264,6 +347,9 @@ int idmap_gid_init(nfs_idmap_cache_parameter_t param)
       return -1;
     }
 
+  idmap_ttl[IDMAP_INDEX(GIDMAP_TYPE)].positive = param.positive_ttl;
+  idmap_ttl[IDMAP_INDEX(GIDMAP_TYPE)].negative = param.negative_ttl;
+
   return ID_MAPPER_SUCCESS;
 }                               /* idmap_uid_init */
 
@@ -393,79 +479,165 @@ int ___idmap_compute_hash_value(char *name, uint32_t * phashval)
 
 /**
  *
- * idmap_add: Adds a value by key
+ * idmap_entry_new: allocates an entry.
  *
- * Adss a value by key.
+ * Allocates an entry, with a reference for the caller. The entries which are
+ * not permanent expire after the TTL of their type of mapping.
  *
- * @param ht       [INOUT] the hash table to be used
- * @param key      [IN]  the ip address requested
- * @param val      [OUT] the value
+ * @param maptype   [IN] UIDMAP_TYPE or GIDMAP_TYPE
+ * @param name      [IN] the name, NULL for an unknown id
+ * @param id        [IN] the id, ignored for an unknown name
+ * @param negative  [IN] the name service knows no such name or id
+ * @param permanent [IN] the entry never expires
  *
- * @return ID_MAPPER_SUCCESS, ID_MAPPER_INSERT_MALLOC_ERROR, ID_MAPPER_INVALID_ARGUMENT
+ * @return the entry, NULL if no memory is available.
  *
  */
-int idmap_add(hash_table_t * ht, char *key, unsigned int val)
+static idmap_entry_t *idmap_entry_new(idmap_type_t maptype, char *name,
+                                      unsigned int id, int negative, int permanent)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffdata;
+  idmap_entry_t *pentry;
+  unsigned int ttl;
+
+  if((pentry = (idmap_entry_t *) Mem_Alloc_Label(sizeof(idmap_entry_t),
+                                                 "idmap_entry_t")) == NULL)
+    return NULL;
+
+  memset(pentry, 0, sizeof(idmap_entry_t));
+  if(name != NULL)
+    strncpy(pentry->name, name, PWENT_MAX_LEN - 1);
+  pentry->id = id;
+  pentry->negative = negative;
+  pentry->maptype = maptype;
+  pentry->refcount = 1;
+
+  ttl = negative ? idmap_ttl[IDMAP_INDEX(maptype)].negative
+                 : idmap_ttl[IDMAP_INDEX(maptype)].positive;
+
+  if(!permanent && ttl != 0)
+    {
+      pentry->expires = time(NULL) + ttl;
+      pentry->refresh_after = pentry->expires - ttl / IDMAP_REFRESH_FRACTION;
+    }
+
+  return pentry;
+}                               /* idmap_entry_new */
+
+static void idmap_entry_rele(idmap_entry_t * pentry)
+{
+  if(atomic_dec_uint32_t(&pentry->refcount) == 0)
+    Mem_Free(pentry);
+}                               /* idmap_entry_rele */
+
+/* Takes a reference on the entry found, under the lock of the hash table */
+static void idmap_entry_ref(hash_buffer_t * pbuffval)
+{
+  atomic_inc_uint32_t(&((idmap_entry_t *) pbuffval->pdata)->refcount);
+}                               /* idmap_entry_ref */
+
+/**
+ *
+ * idmap_hash_entry: hashes an entry, in place of the one with the same key.
+ *
+ * Hashes an entry, in place of the one with the same key. The table takes
+ * a reference on the entry, and drops the one it had on the entry replaced.
+ *
+ * @param ht     [INOUT] the hash table to be used
+ * @param pkey   [IN]    the key of the entry
+ * @param pentry [IN]    the entry
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_INSERT_MALLOC_ERROR
+ *
+ */
+static int idmap_hash_entry(hash_table_t * ht, hash_buffer_t * pkey,
+                            idmap_entry_t * pentry)
+{
+  hash_buffer_t buffval;
+  hash_buffer_t old_key;
+  hash_buffer_t old_val;
   int rc;
-  unsigned long local_val = (unsigned long)val;
 
-  if(ht == NULL || key == NULL)
-    return ID_MAPPER_INVALID_ARGUMENT;
+  if(HashTable_Del(ht, pkey, &old_key, &old_val) == HASHTABLE_SUCCESS)
+    idmap_entry_rele((idmap_entry_t *) old_val.pdata);
 
-  if((buffkey.pdata = (caddr_t) Mem_Alloc(PWENT_MAX_LEN)) == NULL)
-    return ID_MAPPER_INSERT_MALLOC_ERROR;
+  buffval.pdata = (caddr_t) pentry;
+  buffval.len = sizeof(idmap_entry_t);
 
-  /* Build the key */
-  strncpy((char *)(buffkey.pdata), key, PWENT_MAX_LEN);
-  buffkey.len = PWENT_MAX_LEN;
+  atomic_inc_uint32_t(&pentry->refcount);
+  rc = HashTable_Test_And_Set(ht, pkey, &buffval, HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
 
-  /* Build the value */
-  buffdata.pdata = (caddr_t) local_val;
-  buffdata.len = sizeof(unsigned long);
-  LogFullDebug(COMPONENT_IDMAPPER, "Adding the following principal->uid mapping: %s->%lu",
-	       (char *)buffkey.pdata, (unsigned long int)buffdata.pdata);
-  rc = HashTable_Test_And_Set(ht, &buffkey, &buffdata,
-                              HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+  /* Another thread hashed its own entry meanwhile, it is as recent */
+  if(rc != HASHTABLE_SUCCESS)
+    idmap_entry_rele(pentry);
 
   if(rc != HASHTABLE_SUCCESS && rc != HASHTABLE_ERROR_KEY_ALREADY_EXISTS)
     return ID_MAPPER_INSERT_MALLOC_ERROR;
 
   return ID_MAPPER_SUCCESS;
-}                               /* idmap_add */
+}                               /* idmap_hash_entry */
 
-int namemap_add(hash_table_t * ht, unsigned int key, char *val)
+/**
+ *
+ * idmap_set: Adds a mapping, or the lack of it.
+ *
+ * Adds a mapping by name and by id, in place of the previous ones. An unknown
+ * name is only added by name, an unknown id only by id.
+ *
+ * @param maptype   [IN] UIDMAP_TYPE or GIDMAP_TYPE
+ * @param name      [IN] the name, NULL for an unknown id
+ * @param id        [IN] the id, ignored for an unknown name
+ * @param negative  [IN] the name service knows no such name or id
+ * @param permanent [IN] the mapping never expires
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_INSERT_MALLOC_ERROR, ID_MAPPER_INVALID_ARGUMENT
+ *
+ */
+static int idmap_set(idmap_type_t maptype, char *name, unsigned int id,
+                     int negative, int permanent)
 {
+  hash_table_t *ht_byname = (maptype == UIDMAP_TYPE) ? ht_pwnam : ht_grnam;
+  hash_table_t *ht_byid = (maptype == UIDMAP_TYPE) ? ht_pwuid : ht_grgid;
+  idmap_entry_t *pentry;
   hash_buffer_t buffkey;
-  hash_buffer_t buffdata;
-  int rc = 0;
-  unsigned long local_key = (unsigned long)key;
+  int rc = ID_MAPPER_SUCCESS;
 
-  if(ht == NULL || val == NULL)
+  if(ht_byname == NULL || ht_byid == NULL || (name == NULL && !negative))
     return ID_MAPPER_INVALID_ARGUMENT;
 
-  if((buffdata.pdata = (caddr_t) Mem_Alloc(PWENT_MAX_LEN)) == NULL)
+  /* Failed lookups are not kept with a null negative TTL */
+  if(negative && idmap_ttl[IDMAP_INDEX(maptype)].negative == 0)
+    return ID_MAPPER_SUCCESS;
+
+  if((pentry = idmap_entry_new(maptype, name, id, negative, permanent)) == NULL)
     return ID_MAPPER_INSERT_MALLOC_ERROR;
 
-  /* Build the data */
-  strncpy((char *)(buffdata.pdata), val, PWENT_MAX_LEN);
-  buffdata.len = PWENT_MAX_LEN;
+  if(name != NULL)
+    {
+      LogFullDebug(COMPONENT_IDMAPPER, "Adding the following principal->id mapping: %s->%d",
+                   name, negative ? -1 : (int)id);
 
-  /* Build the value */
-  buffkey.pdata = (caddr_t) local_key;
-  buffkey.len = sizeof(unsigned int);
+      /* The entry is its own key, its name comes first */
+      buffkey.pdata = (caddr_t) pentry;
+      buffkey.len = PWENT_MAX_LEN;
 
-  LogFullDebug(COMPONENT_IDMAPPER, "Adding the following uid->principal mapping: %lu->%s",
-	       (unsigned long int)buffkey.pdata, (char *)buffdata.pdata);
-  rc = HashTable_Test_And_Set(ht, &buffkey, &buffdata,
-                              HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+      rc = idmap_hash_entry(ht_byname, &buffkey, pentry);
+    }
 
-  if(rc != HASHTABLE_SUCCESS && rc != HASHTABLE_ERROR_KEY_ALREADY_EXISTS)
-    return ID_MAPPER_INSERT_MALLOC_ERROR;
+  if(rc == ID_MAPPER_SUCCESS && (!negative || name == NULL))
+    {
+      LogFullDebug(COMPONENT_IDMAPPER, "Adding the following id->principal mapping: %u->%s",
+                   id, pentry->name);
 
-  return ID_MAPPER_SUCCESS;
-}                               /* idmap_add */
+      buffkey.pdata = (caddr_t) (unsigned long)id;
+      buffkey.len = sizeof(unsigned long);
+
+      rc = idmap_hash_entry(ht_byid, &buffkey, pentry);
+    }
+
+  idmap_entry_rele(pentry);
+
+  return rc;
+}                               /* idmap_set */
 
 int uidgidmap_add(unsigned int key, unsigned int value)
 {
@@ -513,11 +685,11 @@ static int idmap_free(hash_buffer_t key, hash_buffer_t val)
 {
   if (val.pdata != NULL)
     LogFullDebug(COMPONENT_IDMAPPER, "Freeing uid->principal mapping: %lu->%s",
-		 (unsigned long)key.pdata, (char *)val.pdata);
+		 (unsigned long)key.pdata, ((idmap_entry_t *)val.pdata)->name);
 
   /* key is just an integer caste to charptr */
   if (val.pdata != NULL)
-    Mem_Free(val.pdata);
+    idmap_entry_rele((idmap_entry_t *) val.pdata);
   return 1;
 }
 
@@ -533,13 +705,13 @@ int idmap_clear()
 
 static int namemap_free(hash_buffer_t key, hash_buffer_t val)
 {
-  if (key.pdata != NULL)
-    LogFullDebug(COMPONENT_IDMAPPER, "Freeing principal->uid mapping: %s->%lu",
-		 (char *)key.pdata, (unsigned long)val.pdata);
+  if (val.pdata != NULL)
+    LogFullDebug(COMPONENT_IDMAPPER, "Freeing principal->uid mapping: %s->%u",
+		 (char *)key.pdata, ((idmap_entry_t *)val.pdata)->id);
 
-  /* val is just an integer caste to charptr */
-  if (key.pdata != NULL)
-    Mem_Free(key.pdata);  
+  /* key is the entry itself, freed with it */
+  if (val.pdata != NULL)
+    idmap_entry_rele((idmap_entry_t *) val.pdata);
   return 1;
 }
 
@@ -556,133 +728,179 @@ int namemap_clear()
 
 int uidmap_add(char *key, unsigned int val)
 {
-  int rc1 = 0;
-  int rc2 = 0;
-
-  rc1 = idmap_add(ht_pwnam, key, val);
-  rc2 = namemap_add(ht_pwuid, val, key);
-
-  if(rc1 != ID_MAPPER_SUCCESS)
-    return rc1;
-  else if(rc2 != ID_MAPPER_SUCCESS)
-    return rc2;
-
-  return ID_MAPPER_SUCCESS;
+  return idmap_set(UIDMAP_TYPE, key, val, FALSE, FALSE);
 }                               /* uidmap_add */
 
 int unamemap_add(unsigned int key, char *val)
 {
-  int rc1 = 0;
-  int rc2 = 0;
-
-  rc1 = namemap_add(ht_pwuid, key, val);
-  rc2 = idmap_add(ht_pwnam, val, key);
-
-  if(rc1 != ID_MAPPER_SUCCESS)
-    return rc1;
-  else if(rc2 != ID_MAPPER_SUCCESS)
-    return rc2;
-
-  return ID_MAPPER_SUCCESS;
+  return idmap_set(UIDMAP_TYPE, val, key, FALSE, FALSE);
 }                               /* unamemap_add */
 
 int gidmap_add(char *key, unsigned int val)
 {
-  int rc1 = 0;
-  int rc2 = 0;
+  return idmap_set(GIDMAP_TYPE, key, val, FALSE, FALSE);
+}                               /* gidmap_add */
 
-  rc1 = idmap_add(ht_grnam, key, val);
-  rc2 = namemap_add(ht_grgid, val, key);
+int gnamemap_add(unsigned int key, char *val)
+{
+  return idmap_set(GIDMAP_TYPE, val, key, FALSE, FALSE);
+}                               /* gnamemap_add */
 
-  if(rc1 != ID_MAPPER_SUCCESS)
-    return rc1;
-  else if(rc2 != ID_MAPPER_SUCCESS)
-    return rc2;
+/**
+ *
+ * uidmap_add_negative: Keeps that the name service knows no such user name.
+ *
+ * Keeps that the name service knows no such user name, for the negative TTL
+ * of the uid map. The *_add_negative functions are alike.
+ *
+ * @param key [IN] the name which was not found
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_INSERT_MALLOC_ERROR
+ *
+ */
+int uidmap_add_negative(char *key)
+{
+  return idmap_set(UIDMAP_TYPE, key, (unsigned int)-1, TRUE, FALSE);
+}                               /* uidmap_add_negative */
 
-  return ID_MAPPER_SUCCESS;
-}                               /* gidmap_add */
+int unamemap_add_negative(unsigned int key)
+{
+  return idmap_set(UIDMAP_TYPE, NULL, key, TRUE, FALSE);
+}                               /* unamemap_add_negative */
 
-int gnamemap_add(unsigned int key, char *val)
+int gidmap_add_negative(char *key)
 {
-  int rc1 = 0;
-  int rc2 = 0;
+  return idmap_set(GIDMAP_TYPE, key, (unsigned int)-1, TRUE, FALSE);
+}                               /* gidmap_add_negative */
 
-  rc1 = namemap_add(ht_grgid, key, val);
-  rc2 = idmap_add(ht_grnam, val, key);
+int gnamemap_add_negative(unsigned int key)
+{
+  return idmap_set(GIDMAP_TYPE, NULL, key, TRUE, FALSE);
+}                               /* gnamemap_add_negative */
 
-  if(rc1 != ID_MAPPER_SUCCESS)
-    return rc1;
-  else if(rc2 != ID_MAPPER_SUCCESS)
-    return rc2;
+/**
+ *
+ * idmap_refresh_queue: queues an entry for the refresh thread.
+ *
+ * Queues an entry for the refresh thread, unless it already is.
+ *
+ * @param pentry [IN] the entry
+ * @param by_id  [IN] the refresh looks the id up, else the name
+ *
+ */
+static void idmap_refresh_queue(idmap_entry_t * pentry, int by_id)
+{
+  P(idmap_refresh_mutex);
 
-  return ID_MAPPER_SUCCESS;
-}                               /* gnamemap_add */
+  if(!pentry->refreshing)
+    {
+      pentry->refreshing = TRUE;
+      pentry->refresh_by_id = by_id;
+      atomic_inc_uint32_t(&pentry->refcount);
+      glist_add_tail(&idmap_refresh_list, &pentry->refresh_list);
+      pthread_cond_signal(&idmap_refresh_cond);
+    }
+
+  V(idmap_refresh_mutex);
+}                               /* idmap_refresh_queue */
 
 /**
  *
- * idmap_get: gets a value by key
+ * idmap_get: gets the entry of a key.
  *
- * Gets a value by key.
+ * Gets the entry of a key. An entry used shortly before it expires is queued
+ * for a refresh in the background, the caller does not wait for the name
+ * service as long as the name service answers before the entry expires.
  *
- * @param ht       [INOUT] the hash table to be used
- * @param key      [IN]  the ip address requested
- * @param hostname [OUT] the hostname
+ * @param ht    [IN]  the hash table to be used
+ * @param pkey  [IN]  the key
+ * @param by_id [IN]  the key is an id, else a name
+ * @param name  [OUT] the name found, may be NULL
+ * @param pid   [OUT] the id found, may be NULL
  *
- * @return ID_MAPPER_SUCCESS or ID_MAPPER_NOT_FOUND
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_NEGATIVE if the name service knows no
+ * such key, ID_MAPPER_NOT_FOUND if the name service has to be asked.
  *
  */
-int idmap_get(hash_table_t * ht, char *key, unsigned long *pval)
+static int idmap_get(hash_table_t * ht, hash_buffer_t * pkey, int by_id,
+                     char *name, unsigned long *pid)
 {
-  hash_buffer_t buffkey;
   hash_buffer_t buffval;
+  idmap_entry_t *pentry;
+  idmap_cache_stat_t *pstat;
+  time_t now;
   int status;
 
-  if(ht == NULL || key == NULL || pval == NULL)
+  if(ht == NULL)
     return ID_MAPPER_INVALID_ARGUMENT;
 
-  buffkey.pdata = (caddr_t) key;
-  buffkey.len = PWENT_MAX_LEN;
+  pstat = &idmap_stat[(ht == ht_pwnam || ht == ht_pwuid) ? 0 : 1];
 
-  if(HashTable_Get(ht, &buffkey, &buffval) == HASHTABLE_SUCCESS)
+  if(HashTable_GetRef(ht, pkey, &buffval, idmap_entry_ref) != HASHTABLE_SUCCESS)
     {
-      *pval = (unsigned long)buffval.pdata;
+      atomic_inc_uint64_t(&pstat->nb_misses);
+      return ID_MAPPER_NOT_FOUND;
+    }
 
-      status = ID_MAPPER_SUCCESS;
+  pentry = (idmap_entry_t *) buffval.pdata;
+  now = time(NULL);
+
+  if(pentry->expires != 0 && now >= pentry->expires)
+    {
+      atomic_inc_uint64_t(&pstat->nb_misses);
+      status = ID_MAPPER_NOT_FOUND;
     }
   else
     {
-      status = ID_MAPPER_NOT_FOUND;
+      if(pentry->negative)
+        {
+          atomic_inc_uint64_t(&pstat->nb_negative_hits);
+          status = ID_MAPPER_NEGATIVE;
+        }
+      else
+        {
+          atomic_inc_uint64_t(&pstat->nb_hits);
+          if(name != NULL)
+            strncpy(name, pentry->name, PWENT_MAX_LEN);
+          if(pid != NULL)
+            *pid = pentry->id;
+          status = ID_MAPPER_SUCCESS;
+        }
+
+      if(pentry->expires != 0 && now >= pentry->refresh_after && !pentry->refreshing)
+        idmap_refresh_queue(pentry, by_id);
     }
 
+  idmap_entry_rele(pentry);
+
   return status;
 }                               /* idmap_get */
 
-int namemap_get(hash_table_t * ht, unsigned int key, char *pval)
+static int idmap_get_byname(hash_table_t * ht, char *key, unsigned long *pval)
 {
   hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  int status;
-  long local_key = (long)key;
 
-  if(ht == NULL || pval == NULL)
+  if(key == NULL || pval == NULL)
     return ID_MAPPER_INVALID_ARGUMENT;
 
-  buffkey.pdata = (caddr_t) local_key;
-  buffkey.len = sizeof(unsigned long);
+  buffkey.pdata = (caddr_t) key;
+  buffkey.len = PWENT_MAX_LEN;
 
-  if(HashTable_Get(ht, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-    {
-      strncpy(pval, (char *)buffval.pdata, PWENT_MAX_LEN);
+  return idmap_get(ht, &buffkey, FALSE, NULL, pval);
+}                               /* idmap_get_byname */
 
-      status = ID_MAPPER_SUCCESS;
-    }
-  else
-    {
-      status = ID_MAPPER_NOT_FOUND;
-    }
+static int idmap_get_byid(hash_table_t * ht, unsigned int key, char *pval)
+{
+  hash_buffer_t buffkey;
 
-  return status;
-}                               /* idmap_get */
+  if(pval == NULL)
+    return ID_MAPPER_INVALID_ARGUMENT;
+
+  buffkey.pdata = (caddr_t) (unsigned long)key;
+  buffkey.len = sizeof(unsigned long);
+
+  return idmap_get(ht, &buffkey, TRUE, pval, NULL);
+}                               /* idmap_get_byid */
 
 int uidgidmap_get(unsigned int key, unsigned int *pval)
 {
@@ -720,22 +938,22 @@ int uidgidmap_get(unsigned int key, unsigned int *pval)
 
 int uidmap_get(char *key, unsigned long *pval)
 {
-  return idmap_get(ht_pwnam, key, pval);
+  return idmap_get_byname(ht_pwnam, key, pval);
 }
 
 int unamemap_get(unsigned int key, char *val)
 {
-  return namemap_get(ht_pwuid, key, val);
+  return idmap_get_byid(ht_pwuid, key, val);
 }
 
 int gidmap_get(char *key, unsigned long *pval)
 {
-  return idmap_get(ht_grnam, key, pval);
+  return idmap_get_byname(ht_grnam, key, pval);
 }
 
 int gnamemap_get(unsigned int key, char *val)
 {
-  return namemap_get(ht_grgid, key, val);
+  return idmap_get_byid(ht_grgid, key, val);
 }
 
 /**
@@ -745,26 +963,23 @@ int gnamemap_get(unsigned int key, char *val)
  * Tries to remove an entry for ID_MAPPER
  *
  * @param ht            [INOUT] the hash table to be used
- * @param key           [IN]    the key uncached.
+ * @param pkey          [IN]    the key uncached.
  *
  * @return the delete status
  *
  */
-int idmap_remove(hash_table_t * ht, char *key)
+static int idmap_remove(hash_table_t * ht, hash_buffer_t * pkey)
 {
-  hash_buffer_t buffkey, old_key;
+  hash_buffer_t old_key, old_data;
   int status;
 
-  if(ht == NULL || key == NULL)
+  if(ht == NULL)
     return ID_MAPPER_INVALID_ARGUMENT;
 
-  buffkey.pdata = (caddr_t) key;
-  buffkey.len = PWENT_MAX_LEN;
-
-  if(HashTable_Del(ht, &buffkey, &old_key, NULL) == HASHTABLE_SUCCESS)
+  if(HashTable_Del(ht, pkey, &old_key, &old_data) == HASHTABLE_SUCCESS)
     {
       status = ID_MAPPER_SUCCESS;
-      Mem_Free(old_key.pdata);
+      idmap_entry_rele((idmap_entry_t *) old_data.pdata);
     }
   else
     {
@@ -774,30 +989,28 @@ int idmap_remove(hash_table_t * ht, char *key)
   return status;
 }                               /* idmap_remove */
 
-int namemap_remove(hash_table_t * ht, unsigned int key)
+static int idmap_remove_byname(hash_table_t * ht, char *key)
 {
-  hash_buffer_t buffkey, old_data;
-  int status;
-  unsigned long local_key = (unsigned long)key;
+  hash_buffer_t buffkey;
 
-  if(ht == NULL)
+  if(key == NULL)
     return ID_MAPPER_INVALID_ARGUMENT;
 
-  buffkey.pdata = (caddr_t) local_key;
-  buffkey.len = sizeof(unsigned long);
+  buffkey.pdata = (caddr_t) key;
+  buffkey.len = PWENT_MAX_LEN;
 
-  if(HashTable_Del(ht, &buffkey, NULL, &old_data) == HASHTABLE_SUCCESS)
-    {
-      status = ID_MAPPER_SUCCESS;
-      Mem_Free(old_data.pdata);
-    }
-  else
-    {
-      status = ID_MAPPER_NOT_FOUND;
-    }
+  return idmap_remove(ht, &buffkey);
+}                               /* idmap_remove_byname */
 
-  return status;
-}                               /* idmap_remove */
+static int idmap_remove_byid(hash_table_t * ht, unsigned int key)
+{
+  hash_buffer_t buffkey;
+
+  buffkey.pdata = (caddr_t) (unsigned long)key;
+  buffkey.len = sizeof(unsigned long);
+
+  return idmap_remove(ht, &buffkey);
+}                               /* idmap_remove_byid */
 
 int uidgidmap_remove(unsigned int key)
 {
@@ -822,22 +1035,22 @@ int uidgidmap_remove(unsigned int key)
 
 int uidmap_remove(char *key)
 {
-  return idmap_remove(ht_pwnam, key);
+  return idmap_remove_byname(ht_pwnam, key);
 }
 
 int unamemap_remove(unsigned int key)
 {
-  return namemap_remove(ht_pwuid, key);
+  return idmap_remove_byid(ht_pwuid, key);
 }
 
 int gidmap_remove(char *key)
 {
-  return idmap_remove(ht_grnam, key);
+  return idmap_remove_byname(ht_grnam, key);
 }
 
 int gnamemap_remove(unsigned int key)
 {
-  return namemap_remove(ht_grgid, key);
+  return idmap_remove_byid(ht_grgid, key);
 }
 
 /**
@@ -858,8 +1071,6 @@ int idmap_populate(char *path, idmap_type_t maptype)
   char *key_name;
   char *key_value;
   char label[MAXNAMLEN];
-  hash_table_t *ht = NULL;
-  hash_table_t *ht_reverse = NULL;
   unsigned int value = 0;
   int rc = 0;
 
@@ -877,14 +1088,10 @@ int idmap_populate(char *path, idmap_type_t maptype)
     {
     case UIDMAP_TYPE:
       strncpy(label, CONF_LABEL_UID_MAPPER_TABLE, MAXNAMLEN);
-      ht = ht_pwnam;
-      ht_reverse = ht_pwuid;
       break;
 
     case GIDMAP_TYPE:
       strncpy(label, CONF_LABEL_GID_MAPPER_TABLE, MAXNAMLEN);
-      ht = ht_grnam;
-      ht_reverse = ht_grgid;
       break;
 
     default:
@@ -927,17 +1134,12 @@ int idmap_populate(char *path, idmap_type_t maptype)
 
       value = atoi(key_value);
 
-      if((rc = idmap_add(ht, key_name, value)) != ID_MAPPER_SUCCESS)
-        return rc;
-
-      if((rc = namemap_add(ht_reverse, value, key_name)) != ID_MAPPER_SUCCESS)
+      /* The mappings of the configuration never expire */
+      if((rc = idmap_set(maptype, key_name, value, FALSE, TRUE)) != ID_MAPPER_SUCCESS)
         return rc;
 
     }
 
-  /* HashTable_Log( ht ) ; */
-  /* HashTable_Log( ht_reverse ) ; */
-
   return ID_MAPPER_SUCCESS;
 }                               /* idmap_populate_by_conf */
 
@@ -984,3 +1186,225 @@ void idmap_get_stats(idmap_type_t maptype, hash_stat_t * phstat,
   HashTable_GetStats(ht_reverse, phstat_reverse);
 
 }                               /* idmap_get_stats */
+
+/**
+ *
+ * idmap_preload: Loads the mappings of a passwd or group style file.
+ *
+ * Loads the mappings of a passwd or group style file, such as the output of
+ * 'getent passwd' or 'getent group': each line is name:password:id:...
+ * The mappings loaded expire, and are refreshed, as those got from the name
+ * service. The primary groups of the users also go to the uid->gid map used
+ * with RPCSEC_GSS.
+ *
+ * @param path    [IN] the file to load
+ * @param maptype [IN] UIDMAP_TYPE for a passwd file, GIDMAP_TYPE for a group file
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_INVALID_ARGUMENT if the file can't be read
+ *
+ */
+int idmap_preload(char *path, idmap_type_t maptype)
+{
+  FILE *file;
+  char line[IDMAP_PRELOAD_LINE_LEN];
+  char *fields[IDMAP_PRELOAD_FIELDS];
+  char *end;
+  unsigned long id, gid;
+  unsigned int nb_lines = 0;
+  unsigned int nb_loaded = 0;
+  int i, rc;
+
+  if(maptype != UIDMAP_TYPE && maptype != GIDMAP_TYPE)
+    return ID_MAPPER_INVALID_ARGUMENT;
+
+  if((file = fopen(path, "r")) == NULL)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "Can't open file %s: %s", path, strerror(errno));
+      return ID_MAPPER_INVALID_ARGUMENT;
+    }
+
+  while(fgets(line, IDMAP_PRELOAD_LINE_LEN, file) != NULL)
+    {
+      nb_lines += 1;
+
+      /* Only the first fields matter, skip the rest of the long lines (group members) */
+      if(strchr(line, '\n') == NULL)
+        {
+          int c;
+
+          while((c = fgetc(file)) != EOF && c != '\n') ;
+        }
+
+      /* Comments, and the NIS +/- lines */
+      if(line[0] == '#' || line[0] == '+' || line[0] == '-')
+        continue;
+
+      fields[0] = line;
+      for(i = 1; i < IDMAP_PRELOAD_FIELDS; i++)
+        {
+          if(fields[i - 1] == NULL || (fields[i] = strchr(fields[i - 1], ':')) == NULL)
+            {
+              fields[i] = NULL;
+              continue;
+            }
+          *(fields[i]++) = '\0';
+        }
+
+      if(fields[0][0] == '\0' || fields[2] == NULL)
+        {
+          LogDebug(COMPONENT_IDMAPPER,
+                   "%s line %u: not a passwd or group entry", path, nb_lines);
+          continue;
+        }
+
+      id = strtoul(fields[2], &end, 10);
+      if(end == fields[2] || (*end != '\0' && *end != ':' && *end != '\n'))
+        {
+          LogDebug(COMPONENT_IDMAPPER,
+                   "%s line %u: invalid id for %s", path, nb_lines, fields[0]);
+          continue;
+        }
+
+      if((rc = idmap_set(maptype, fields[0], id, FALSE, FALSE)) != ID_MAPPER_SUCCESS)
+        {
+          fclose(file);
+          return rc;
+        }
+
+      if(maptype == UIDMAP_TYPE && fields[3] != NULL)
+        {
+          gid = strtoul(fields[3], &end, 10);
+          if(end != fields[3] && uidgidmap_add(id, gid) != ID_MAPPER_SUCCESS)
+            {
+              fclose(file);
+              return ID_MAPPER_INSERT_MALLOC_ERROR;
+            }
+        }
+
+      nb_loaded += 1;
+    }
+
+  fclose(file);
+
+  LogEvent(COMPONENT_IDMAPPER,
+           "%u %s loaded from %s", nb_loaded,
+           (maptype == UIDMAP_TYPE) ? "users" : "groups", path);
+
+  return ID_MAPPER_SUCCESS;
+}                               /* idmap_preload */
+
+/**
+ *
+ * idmap_resolve_done: accounts for a request to the name service.
+ *
+ * @param maptype [IN] type of the mapping requested (UIDMAP_TYPE or GIDMAP_TYPE)
+ * @param usec    [IN] time spent in the name service
+ * @param found   [IN] the name service found the mapping
+ *
+ */
+void idmap_resolve_done(idmap_type_t maptype, uint64_t usec, int found)
+{
+  idmap_cache_stat_t *pstat = &idmap_stat[IDMAP_INDEX(maptype)];
+  uint64_t max;
+
+  atomic_inc_uint64_t(&pstat->nb_resolve);
+  if(!found)
+    atomic_inc_uint64_t(&pstat->nb_resolve_failed);
+  atomic_add_uint64_t(&pstat->resolve_usec, usec);
+
+  do
+    {
+      max = atomic_fetch_uint64_t(&pstat->max_resolve_usec);
+    }
+  while(usec > max && !atomic_cas_uint64_t(&pstat->max_resolve_usec, max, usec));
+
+  if(usec >= IDMAP_SLOW_RESOLVE_USEC)
+    LogInfo(COMPONENT_IDMAPPER,
+            "The name service took %llu ms to answer",
+            (unsigned long long)usec / 1000);
+}                               /* idmap_resolve_done */
+
+/**
+ *
+ * idmap_get_cache_stats: gets the lookup statistics of a type of mapping.
+ *
+ * @param maptype [IN]  type of the mapping to be queried (UIDMAP_TYPE or GIDMAP_TYPE)
+ * @param pstat   [OUT] the resulting stats
+ *
+ */
+void idmap_get_cache_stats(idmap_type_t maptype, idmap_cache_stat_t * pstat)
+{
+  idmap_cache_stat_t *pcache_stat = &idmap_stat[IDMAP_INDEX(maptype)];
+
+  pstat->nb_hits = atomic_fetch_uint64_t(&pcache_stat->nb_hits);
+  pstat->nb_negative_hits = atomic_fetch_uint64_t(&pcache_stat->nb_negative_hits);
+  pstat->nb_misses = atomic_fetch_uint64_t(&pcache_stat->nb_misses);
+  pstat->nb_refresh = atomic_fetch_uint64_t(&pcache_stat->nb_refresh);
+  pstat->nb_resolve = atomic_fetch_uint64_t(&pcache_stat->nb_resolve);
+  pstat->nb_resolve_failed = atomic_fetch_uint64_t(&pcache_stat->nb_resolve_failed);
+  pstat->resolve_usec = atomic_fetch_uint64_t(&pcache_stat->resolve_usec);
+  pstat->max_resolve_usec = atomic_fetch_uint64_t(&pcache_stat->max_resolve_usec);
+}                               /* idmap_get_cache_stats */
+
+/**
+ *
+ * idmapper_refresh_thread: refreshes the mappings used before they expire.
+ *
+ * Asks the name service again for the entries queued by the lookups made
+ * shortly before they expire. The mappings found replace the entries; an
+ * entry for a name or id the name service no longer finds is left to expire,
+ * so that a name service failing for a while does not turn known users into
+ * unknown ones. The failed lookups still failing are kept longer.
+ * The entries are refreshed at most once.
+ *
+ */
+void *idmapper_refresh_thread(void *arg)
+{
+  idmap_entry_t *pentry;
+  char name[NFS4_MAX_DOMAIN_LEN + 1];   /* the name services return up to NFS4_MAX_DOMAIN_LEN */
+  unsigned int id;
+
+  SetNameFunction("idmap_refresh");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_IDMAPPER,
+               "ID MAPPER REFRESH: Memory manager could not be initialized");
+    }
+#endif
+
+  for(;;)
+    {
+      P(idmap_refresh_mutex);
+      while(glist_empty(&idmap_refresh_list))
+        pthread_cond_wait(&idmap_refresh_cond, &idmap_refresh_mutex);
+
+      pentry = glist_entry(idmap_refresh_list.next, idmap_entry_t, refresh_list);
+      glist_del(&pentry->refresh_list);
+      V(idmap_refresh_mutex);
+
+      memset(name, 0, sizeof(name));
+      strncpy(name, pentry->name, PWENT_MAX_LEN);
+      id = pentry->id;
+
+      if(pentry->refresh_by_id)
+        LogFullDebug(COMPONENT_IDMAPPER, "Refreshing id %u", id);
+      else
+        LogFullDebug(COMPONENT_IDMAPPER, "Refreshing name %s", name);
+
+      if(!idmap_resolve(pentry->maptype, pentry->refresh_by_id, name, &id) &&
+         pentry->negative)
+        idmap_set(pentry->maptype, pentry->refresh_by_id ? NULL : name, id, TRUE, FALSE);
+
+      atomic_inc_uint64_t(&idmap_stat[IDMAP_INDEX(pentry->maptype)].nb_refresh);
+
+      /* An entry not replaced stays marked as refreshing: it is not queued
+       * again, and expires */
+      idmap_entry_rele(pentry);
+    }
+
+  return NULL;
+}                               /* idmapper_refresh_thread */
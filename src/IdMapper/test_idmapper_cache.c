@@ -0,0 +1,355 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Checks the id mapper caches against a fake name service: hits, cached
+ * failures, expiry, refresh of the mappings used before they expire without
+ * the callers waiting for the name service, and preload of passwd and group
+ * files.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+
+/* These parameters are used throughout Ganesha code and must be initilized. */
+nfs_parameter_t nfs_param;
+
+#define POSITIVE_TTL  8
+#define NEGATIVE_TTL  1
+
+/* The fake name service: users are "user<uid>" with uid < 2000, groups "group<gid>" */
+static unsigned int nb_resolve = 0;
+static unsigned int resolve_delay = 0;
+
+int idmap_resolve(idmap_type_t maptype, int by_id, char *name, unsigned int *pid)
+{
+  const char *prefix = (maptype == UIDMAP_TYPE) ? "user" : "group";
+  unsigned int id;
+  char *end;
+  int found;
+
+  nb_resolve += 1;
+  sleep(resolve_delay);
+
+  if(by_id)
+    {
+      id = *pid;
+      sprintf(name, "%s%u", prefix, id);
+    }
+  else if(!strncmp(name, prefix, strlen(prefix)))
+    id = strtoul(name + strlen(prefix), &end, 10);
+
+  found = (by_id || (!strncmp(name, prefix, strlen(prefix)) && *end == '\0')) && id < 2000;
+  if(found)
+    {
+      *pid = id;
+      if(maptype == UIDMAP_TYPE)
+        uidmap_add(name, id);
+      else
+        gidmap_add(name, id);
+    }
+
+  idmap_resolve_done(maptype, resolve_delay * 1000000ULL, found);
+
+  return found;
+}
+
+/* What name2uid does */
+static int lookup_user(char *name, unsigned long *puid)
+{
+  unsigned int uid;
+
+  switch (uidmap_get(name, puid))
+    {
+    case ID_MAPPER_SUCCESS:
+      return ID_MAPPER_SUCCESS;
+
+    case ID_MAPPER_NEGATIVE:
+      return ID_MAPPER_NEGATIVE;
+    }
+
+  if(idmap_resolve(UIDMAP_TYPE, FALSE, name, &uid))
+    {
+      *puid = uid;
+      return ID_MAPPER_NOT_FOUND;
+    }
+
+  uidmap_add_negative(name);
+  return ID_MAPPER_NOT_FOUND;
+}
+
+static void init_params(nfs_idmap_cache_parameter_t * pparam, int by_name)
+{
+  memset(pparam, 0, sizeof(*pparam));
+  pparam->hash_param.index_size = PRIME_ID_MAPPER;
+  pparam->hash_param.alphabet_length = 10;
+  pparam->hash_param.nb_node_prealloc = NB_PREALLOC_ID_MAPPER;
+  pparam->hash_param.hash_func_key =
+      by_name ? idmapper_value_hash_func : namemapper_value_hash_func;
+  pparam->hash_param.hash_func_rbt = by_name ? idmapper_rbt_hash_func : namemapper_rbt_hash_func;
+  pparam->hash_param.compare_key = by_name ? compare_idmapper : compare_namemapper;
+  pparam->hash_param.key_to_str = by_name ? display_idmapper_key : display_idmapper_val;
+  pparam->hash_param.val_to_str = display_idmapper_entry;
+  pparam->hash_param.name = "Test Map Cache";
+  pparam->positive_ttl = POSITIVE_TTL;
+  pparam->negative_ttl = NEGATIVE_TTL;
+}
+
+static void init_caches(void)
+{
+  nfs_idmap_cache_parameter_t byname, byid;
+
+  init_params(&byname, TRUE);
+  init_params(&byid, FALSE);
+
+  if(idmap_uid_init(byname) != ID_MAPPER_SUCCESS ||
+     idmap_uname_init(byid) != ID_MAPPER_SUCCESS ||
+     idmap_gid_init(byname) != ID_MAPPER_SUCCESS ||
+     idmap_gname_init(byid) != ID_MAPPER_SUCCESS ||
+     uidgidmap_init(byid) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: could not init the id mapper caches");
+      exit(1);
+    }
+}
+
+static void check_lookups(void)
+{
+  unsigned long uid;
+  char name[PWENT_MAX_LEN];
+  unsigned int resolved;
+
+  /* A miss asks the name service, the next lookups are hits both ways */
+  if(lookup_user("user1000", &uid) != ID_MAPPER_NOT_FOUND || uid != 1000 ||
+     lookup_user("user1000", &uid) != ID_MAPPER_SUCCESS || uid != 1000 ||
+     unamemap_get(1000, name) != ID_MAPPER_SUCCESS || strcmp(name, "user1000") ||
+     nb_resolve != 1)
+    {
+      LogTest("Test FAILED: known user not cached");
+      exit(1);
+    }
+  LogTest("Known user cached OK");
+
+  /* A user the name service does not know is asked for once */
+  resolved = nb_resolve;
+  if(lookup_user("nobody_here", &uid) != ID_MAPPER_NOT_FOUND ||
+     lookup_user("nobody_here", &uid) != ID_MAPPER_NEGATIVE ||
+     lookup_user("nobody_here", &uid) != ID_MAPPER_NEGATIVE ||
+     nb_resolve != resolved + 1)
+    {
+      LogTest("Test FAILED: unknown user not cached");
+      exit(1);
+    }
+
+  /* Nor kept in the reverse map */
+  if(unamemap_add_negative(5000) != ID_MAPPER_SUCCESS ||
+     unamemap_get(5000, name) != ID_MAPPER_NEGATIVE ||
+     uidmap_get("nobody_here", &uid) != ID_MAPPER_NEGATIVE)
+    {
+      LogTest("Test FAILED: unknown uid not cached");
+      exit(1);
+    }
+  LogTest("Unknown user cached OK");
+
+  /* The failures expire first */
+  sleep(NEGATIVE_TTL + 1);
+  if(uidmap_get("nobody_here", &uid) != ID_MAPPER_NOT_FOUND ||
+     unamemap_get(5000, name) != ID_MAPPER_NOT_FOUND ||
+     uidmap_get("user1000", &uid) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: unknown user not expired");
+      exit(1);
+    }
+
+  sleep(POSITIVE_TTL - NEGATIVE_TTL);
+  if(uidmap_get("user1000", &uid) != ID_MAPPER_NOT_FOUND ||
+     unamemap_get(1000, name) != ID_MAPPER_NOT_FOUND)
+    {
+      LogTest("Test FAILED: known user not expired");
+      exit(1);
+    }
+  LogTest("Mappings expired OK");
+}
+
+static void check_refresh(void)
+{
+  pthread_t thrid;
+  struct timeval start, end;
+  idmap_cache_stat_t stats;
+  unsigned long gid;
+  unsigned int resolved;
+  int i;
+
+  if(pthread_create(&thrid, NULL, idmapper_refresh_thread, NULL) != 0)
+    {
+      LogTest("Test FAILED: could not start the refresh thread");
+      exit(1);
+    }
+
+  if(gidmap_add("group42", 42) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: could not add a group");
+      exit(1);
+    }
+
+  /* Used in the last quarter of its life, while the name service is slow */
+  sleep(POSITIVE_TTL - POSITIVE_TTL / 4);
+  resolved = nb_resolve;
+  resolve_delay = 1;
+
+  gettimeofday(&start, NULL);
+  if(gidmap_get("group42", &gid) != ID_MAPPER_SUCCESS || gid != 42)
+    {
+      LogTest("Test FAILED: group expired too early");
+      exit(1);
+    }
+  gettimeofday(&end, NULL);
+
+  if((end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec >= 500000)
+    {
+      LogTest("Test FAILED: lookup waited for the refresh");
+      exit(1);
+    }
+
+  for(i = 0; i < 50; i++)
+    {
+      idmap_get_cache_stats(GIDMAP_TYPE, &stats);
+      if(stats.nb_refresh == 1)
+        break;
+      usleep(100000);
+    }
+  resolve_delay = 0;
+
+  /* Past the first expiry, the refreshed mapping is still there */
+  sleep(2);
+  if(stats.nb_refresh != 1 || nb_resolve != resolved + 1 ||
+     gidmap_get("group42", &gid) != ID_MAPPER_SUCCESS || gid != 42 ||
+     stats.max_resolve_usec < 1000000)
+    {
+      LogTest("Test FAILED: group not refreshed");
+      exit(1);
+    }
+  LogTest("Mapping refreshed in the background OK");
+}
+
+static void check_preload(void)
+{
+  char passwd[] = "/tmp/test_idmapper_passwdXXXXXX";
+  char group[] = "/tmp/test_idmapper_groupXXXXXX";
+  char name[PWENT_MAX_LEN];
+  unsigned long id;
+  unsigned int gid;
+  FILE *file;
+  int fd, i;
+
+  if((fd = mkstemp(passwd)) < 0 || (file = fdopen(fd, "w")) == NULL)
+    {
+      LogTest("Test FAILED: could not create %s", passwd);
+      exit(1);
+    }
+  fprintf(file, "# users\n");
+  fprintf(file, "root:x:0:0:root:/root:/bin/bash\n");
+  fprintf(file, "alice:x:3000:300:Alice:/home/alice:/bin/sh\n");
+  fprintf(file, "+nisuser::::::\n");
+  fprintf(file, "broken:x:notanid:1::/:/bin/sh\n");
+  fprintf(file, "bob:x:3001:301\n");
+  fclose(file);
+
+  if((fd = mkstemp(group)) < 0 || (file = fdopen(fd, "w")) == NULL)
+    {
+      LogTest("Test FAILED: could not create %s", group);
+      exit(1);
+    }
+  /* A group with many members does not fit a line buffer */
+  fprintf(file, "staff:x:300:");
+  for(i = 0; i < 500; i++)
+    fprintf(file, "%smember%d", i ? "," : "", i);
+  fprintf(file, "\nwheel:x:10:root\n");
+  fclose(file);
+
+  if(idmap_preload(passwd, UIDMAP_TYPE) != ID_MAPPER_SUCCESS ||
+     idmap_preload(group, GIDMAP_TYPE) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: could not preload the files");
+      exit(1);
+    }
+  unlink(passwd);
+  unlink(group);
+
+  if(uidmap_get("alice", &id) != ID_MAPPER_SUCCESS || id != 3000 ||
+     uidmap_get("root", &id) != ID_MAPPER_SUCCESS || id != 0 ||
+     unamemap_get(3001, name) != ID_MAPPER_SUCCESS || strcmp(name, "bob") ||
+     uidgidmap_get(3000, &gid) != ID_MAPPER_SUCCESS || gid != 300 ||
+     uidmap_get("broken", &id) != ID_MAPPER_NOT_FOUND ||
+     uidmap_get("+nisuser", &id) != ID_MAPPER_NOT_FOUND ||
+     gidmap_get("staff", &id) != ID_MAPPER_SUCCESS || id != 300 ||
+     gnamemap_get(10, name) != ID_MAPPER_SUCCESS || strcmp(name, "wheel") ||
+     gidmap_get("member3", &id) != ID_MAPPER_NOT_FOUND)
+    {
+      LogTest("Test FAILED: wrong mappings preloaded");
+      exit(1);
+    }
+
+  if(idmap_preload("/nonexistent/passwd", UIDMAP_TYPE) != ID_MAPPER_INVALID_ARGUMENT)
+    {
+      LogTest("Test FAILED: missing file preloaded");
+      exit(1);
+    }
+  LogTest("Users and groups preloaded OK");
+}
+
+int main(int argc, char *argv[])
+{
+  idmap_cache_stat_t stats;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_idmapper_cache");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Memory manager could not be initialized");
+      exit(1);
+    }
+#endif
+
+  init_caches();
+  check_lookups();
+  check_refresh();
+  check_preload();
+
+  idmap_get_cache_stats(UIDMAP_TYPE, &stats);
+  LogTest("uid lookups: %llu hits, %llu unknown, %llu misses, %llu name service calls",
+          (unsigned long long)stats.nb_hits, (unsigned long long)stats.nb_negative_hits,
+          (unsigned long long)stats.nb_misses, (unsigned long long)stats.nb_resolve);
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -0,0 +1,281 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Runs the real resolvers of the id mapper, the name service below them
+ * returning names much longer than the cache keeps: the lookups by id, then
+ * their refresh in the background, must not overflow the name buffers. The
+ * refresh thread never returns: an overflow of its stack shows under valgrind
+ * or when built with -fsanitize=address.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+#include "nfs_proto_functions.h"
+
+/* These parameters are used throughout Ganesha code and must be initilized. */
+nfs_parameter_t nfs_param;
+
+#define POSITIVE_TTL  8
+#define NEGATIVE_TTL  1
+#define LONG_NAME_LEN 400       /* past PWENT_MAX_LEN, within NFS4_MAX_DOMAIN_LEN */
+
+/* The fake name service: the name of an id is its prefix, padded with 'x' to
+ * LONG_NAME_LEN, then the id */
+static void long_name(char *name, const char *prefix, unsigned int id)
+{
+  char suffix[16];
+  size_t len;
+
+  snprintf(suffix, sizeof(suffix), "%u", id);
+  strcpy(name, prefix);
+  len = strlen(prefix);
+  memset(name + len, 'x', LONG_NAME_LEN - len - strlen(suffix));
+  strcpy(name + LONG_NAME_LEN - strlen(suffix), suffix);
+}
+
+#ifdef _USE_NFSIDMAP
+int nfs4_init_name_mapping(char *conffile)
+{
+  return 0;
+}
+
+int nfs4_get_default_domain(char *server, char *domain, size_t len)
+{
+  strncpy(domain, "test", len);
+  return 0;
+}
+
+int nfs4_uid_to_name(uid_t uid, char *domain, char *name, size_t len)
+{
+  if(len <= LONG_NAME_LEN)
+    return -ENOBUFS;
+  long_name(name, "user", uid);
+  return 0;
+}
+
+int nfs4_gid_to_name(gid_t gid, char *domain, char *name, size_t len)
+{
+  if(len <= LONG_NAME_LEN)
+    return -ENOBUFS;
+  long_name(name, "group", gid);
+  return 0;
+}
+#else
+int getpwuid_r(uid_t uid, struct passwd *pwd, char *buf, size_t buflen,
+               struct passwd **result)
+{
+  *result = NULL;
+  if(buflen <= LONG_NAME_LEN)
+    return ERANGE;
+
+  memset(pwd, 0, sizeof(*pwd));
+  long_name(buf, "user", uid);
+  pwd->pw_name = buf;
+  pwd->pw_uid = uid;
+  pwd->pw_gid = uid;
+  *result = pwd;
+  return 0;
+}
+
+int getgrgid_r(gid_t gid, struct group *grp, char *buf, size_t buflen,
+               struct group **result)
+{
+  *result = NULL;
+  if(buflen <= LONG_NAME_LEN)
+    return ERANGE;
+
+  memset(grp, 0, sizeof(*grp));
+  long_name(buf, "group", gid);
+  grp->gr_name = buf;
+  grp->gr_gid = gid;
+  *result = grp;
+  return 0;
+}
+#endif                          /* _USE_NFSIDMAP */
+
+static void init_params(nfs_idmap_cache_parameter_t * pparam, int by_name)
+{
+  memset(pparam, 0, sizeof(*pparam));
+  pparam->hash_param.index_size = PRIME_ID_MAPPER;
+  pparam->hash_param.alphabet_length = 10;
+  pparam->hash_param.nb_node_prealloc = NB_PREALLOC_ID_MAPPER;
+  pparam->hash_param.hash_func_key =
+      by_name ? idmapper_value_hash_func : namemapper_value_hash_func;
+  pparam->hash_param.hash_func_rbt = by_name ? idmapper_rbt_hash_func : namemapper_rbt_hash_func;
+  pparam->hash_param.compare_key = by_name ? compare_idmapper : compare_namemapper;
+  pparam->hash_param.key_to_str = by_name ? display_idmapper_key : display_idmapper_val;
+  pparam->hash_param.val_to_str = display_idmapper_entry;
+  pparam->hash_param.name = "Test Map Cache";
+  pparam->positive_ttl = POSITIVE_TTL;
+  pparam->negative_ttl = NEGATIVE_TTL;
+}
+
+static void init_caches(void)
+{
+  nfs_idmap_cache_parameter_t byname, byid;
+
+  init_params(&byname, TRUE);
+  init_params(&byid, FALSE);
+
+  if(idmap_uid_init(byname) != ID_MAPPER_SUCCESS ||
+     idmap_uname_init(byid) != ID_MAPPER_SUCCESS ||
+     idmap_gid_init(byname) != ID_MAPPER_SUCCESS ||
+     idmap_gname_init(byid) != ID_MAPPER_SUCCESS ||
+     uidgidmap_init(byid) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: could not init the id mapper caches");
+      exit(1);
+    }
+}
+
+/* The name resolved starts with the name the name service returned, the
+ * name cached with its first PWENT_MAX_LEN - 1 characters */
+static void check_name(const char *name, const char *prefix, unsigned int id,
+                       size_t min_len)
+{
+  char expected[LONG_NAME_LEN + 1];
+  size_t len;
+
+  long_name(expected, prefix, id);
+  len = strlen(name) < LONG_NAME_LEN ? strlen(name) : LONG_NAME_LEN;
+
+  if(strlen(name) < min_len || strncmp(name, expected, len))
+    {
+      LogTest("Test FAILED: wrong name for %s %u: %s", prefix, id, name);
+      exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  char name[NFS4_MAX_DOMAIN_LEN + 1];
+  idmap_cache_stat_t ustats, gstats;
+  pthread_t thrid;
+  uid_t uid = 1000;
+  gid_t gid = 100;
+  int i;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_idmapper_resolve");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Memory manager could not be initialized");
+      exit(1);
+    }
+#endif
+
+  init_caches();
+
+  if(pthread_create(&thrid, NULL, idmapper_refresh_thread, NULL) != 0)
+    {
+      LogTest("Test FAILED: could not start the refresh thread");
+      exit(1);
+    }
+
+  /* The misses ask the name service, into the buffer of the caller */
+  memset(name, 0, sizeof(name));
+  if(!uid2name(name, &uid))
+    {
+      LogTest("Test FAILED: uid not resolved");
+      exit(1);
+    }
+  check_name(name, "user", uid, LONG_NAME_LEN);
+  memset(name, 0, sizeof(name));
+  if(!gid2name(name, &gid))
+    {
+      LogTest("Test FAILED: gid not resolved");
+      exit(1);
+    }
+  check_name(name, "group", gid, LONG_NAME_LEN);
+  LogTest("Long names resolved OK");
+
+  /* Used in the last quarter of their life, the refresh thread asks the
+   * name service again by id */
+  sleep(POSITIVE_TTL - POSITIVE_TTL / 4);
+
+  memset(name, 0, sizeof(name));
+  if(!uid2name(name, &uid))
+    {
+      LogTest("Test FAILED: uid expired too early");
+      exit(1);
+    }
+  check_name(name, "user", uid, PWENT_MAX_LEN - 1);
+
+  memset(name, 0, sizeof(name));
+  if(!gid2name(name, &gid))
+    {
+      LogTest("Test FAILED: gid expired too early");
+      exit(1);
+    }
+  check_name(name, "group", gid, PWENT_MAX_LEN - 1);
+
+  for(i = 0; i < 50; i++)
+    {
+      idmap_get_cache_stats(UIDMAP_TYPE, &ustats);
+      idmap_get_cache_stats(GIDMAP_TYPE, &gstats);
+      if(ustats.nb_refresh == 1 && gstats.nb_refresh == 1)
+        break;
+      usleep(100000);
+    }
+
+  /* Past the first expiry, the refreshed mappings are still there */
+  sleep(2);
+  if(ustats.nb_refresh != 1 || gstats.nb_refresh != 1 ||
+     ustats.nb_resolve != 2 || gstats.nb_resolve != 2)
+    {
+      LogTest("Test FAILED: long names not refreshed");
+      exit(1);
+    }
+
+  memset(name, 0, sizeof(name));
+  if(unamemap_get(uid, name) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: refreshed uid not cached");
+      exit(1);
+    }
+  check_name(name, "user", uid, PWENT_MAX_LEN - 1);
+
+  memset(name, 0, sizeof(name));
+  if(gnamemap_get(gid, name) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: refreshed gid not cached");
+      exit(1);
+    }
+  check_name(name, "group", gid, PWENT_MAX_LEN - 1);
+  LogTest("Long names refreshed in the background OK");
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
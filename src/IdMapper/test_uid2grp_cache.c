@@ -0,0 +1,262 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Checks the cache of the group lists against a fake name service: hits,
+ * unknown uids, expiry, the bound on the number of lists, and the refresh of
+ * the lists used before they expire.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+
+/* These parameters are used throughout Ganesha code and must be initilized. */
+nfs_parameter_t nfs_param;
+
+#define POSITIVE_TTL  8
+#define NEGATIVE_TTL  1
+#define MAX_ENTRIES   16
+
+/* The fake name service: uid < 2000 is in the groups uid, uid + 1, ... uid + uid % 40 */
+static unsigned int nb_resolve = 0;
+
+int uid2grp_resolve(uid_t uid, gid_t * pgid, gid_t ** pgroups, unsigned int *pnbgroups)
+{
+  unsigned int i;
+
+  nb_resolve += 1;
+
+  if(uid >= 2000)
+    return 0;
+
+  *pnbgroups = uid % 40 + 1;
+  if((*pgroups = (gid_t *) Mem_Alloc_Label(*pnbgroups * sizeof(gid_t), "uid2grp")) == NULL)
+    return 0;
+
+  for(i = 0; i < *pnbgroups; i++)
+    (*pgroups)[i] = uid + i;
+  *pgid = uid;
+
+  return 1;
+}
+
+static void init_cache(void)
+{
+  nfs_uid2grp_cache_parameter_t param;
+
+  memset(&param, 0, sizeof(param));
+  param.hash_param.index_size = PRIME_ID_MAPPER;
+  param.hash_param.alphabet_length = 10;
+  param.hash_param.nb_node_prealloc = NB_PREALLOC_ID_MAPPER;
+  param.hash_param.hash_func_key = namemapper_value_hash_func;
+  param.hash_param.hash_func_rbt = namemapper_rbt_hash_func;
+  param.hash_param.compare_key = compare_namemapper;
+  param.hash_param.key_to_str = display_idmapper_val;
+  param.hash_param.val_to_str = display_uid2grp_val;
+  param.hash_param.name = "Test UID2GRP Cache";
+  param.max_entries = MAX_ENTRIES;
+  param.positive_ttl = POSITIVE_TTL;
+  param.negative_ttl = NEGATIVE_TTL;
+
+  if(uid2grp_init(param) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: could not init the cache");
+      exit(1);
+    }
+}
+
+static void check_lookups(void)
+{
+  uid2grp_groups_t *pgroups;
+  unsigned int resolved;
+
+  /* A miss asks the name service, the next lookups are hits */
+  if(!uid2grp(1039, &pgroups) || pgroups->gid != 1039 || pgroups->nbgroups != 40 ||
+     pgroups->groups[39] != 1078)
+    {
+      LogTest("Test FAILED: wrong groups");
+      exit(1);
+    }
+  uid2grp_unref(pgroups);
+
+  if(!uid2grp(1039, &pgroups) || pgroups->nbgroups != 40 || nb_resolve != 1)
+    {
+      LogTest("Test FAILED: groups not cached");
+      exit(1);
+    }
+
+  /* A list in use survives its removal from the cache */
+  uid2grp_remove(1039);
+  if(pgroups->groups[0] != 1039)
+    {
+      LogTest("Test FAILED: list in use freed");
+      exit(1);
+    }
+  uid2grp_unref(pgroups);
+  LogTest("Groups cached OK");
+
+  /* A uid the name service does not know is asked for once */
+  resolved = nb_resolve;
+  if(uid2grp(5000, &pgroups) || uid2grp(5000, &pgroups) ||
+     uid2grp_get(5000, &pgroups) != ID_MAPPER_NEGATIVE || nb_resolve != resolved + 1)
+    {
+      LogTest("Test FAILED: unknown uid not cached");
+      exit(1);
+    }
+  LogTest("Unknown uid cached OK");
+
+  sleep(NEGATIVE_TTL + 1);
+  if(uid2grp_get(5000, &pgroups) != ID_MAPPER_NOT_FOUND)
+    {
+      LogTest("Test FAILED: unknown uid not expired");
+      exit(1);
+    }
+  LogTest("Unknown uid expired OK");
+}
+
+static void check_bound(void)
+{
+  uid2grp_groups_t *pgroups;
+  unsigned int uid, nb_cached;
+
+  /* One user keeps working while many others come and go */
+  for(uid = 100; uid < 100 + 10 * MAX_ENTRIES; uid++)
+    {
+      if(!uid2grp(7, &pgroups))
+        {
+          LogTest("Test FAILED: no groups for uid 7");
+          exit(1);
+        }
+      uid2grp_unref(pgroups);
+
+      if(!uid2grp(uid, &pgroups))
+        {
+          LogTest("Test FAILED: no groups for uid %u", uid);
+          exit(1);
+        }
+      uid2grp_unref(pgroups);
+    }
+
+  for(nb_cached = 0, uid = 100; uid < 100 + 10 * MAX_ENTRIES; uid++)
+    if(uid2grp_get(uid, &pgroups) == ID_MAPPER_SUCCESS)
+      {
+        nb_cached += 1;
+        uid2grp_unref(pgroups);
+      }
+
+  if(nb_cached >= MAX_ENTRIES || uid2grp_get(7, &pgroups) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: %u lists cached, uid 7 %s", nb_cached,
+              nb_cached >= MAX_ENTRIES ? "kept" : "dropped");
+      exit(1);
+    }
+  uid2grp_unref(pgroups);
+  LogTest("Cache bounded to %u lists, the one in use kept OK", MAX_ENTRIES);
+}
+
+static void check_refresh(void)
+{
+  pthread_t thrid;
+  uid2grp_groups_t *pgroups;
+  idmap_cache_stat_t stats;
+  unsigned int resolved;
+  int i;
+
+  if(pthread_create(&thrid, NULL, uid2grp_refresh_thread, NULL) != 0)
+    {
+      LogTest("Test FAILED: could not start the refresh thread");
+      exit(1);
+    }
+
+  uid2grp_remove(42);
+  if(!uid2grp(42, &pgroups))
+    {
+      LogTest("Test FAILED: no groups for uid 42");
+      exit(1);
+    }
+  uid2grp_unref(pgroups);
+
+  /* Used in the last quarter of its life */
+  sleep(POSITIVE_TTL - POSITIVE_TTL / 4);
+  resolved = nb_resolve;
+  if(uid2grp_get(42, &pgroups) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: groups expired too early");
+      exit(1);
+    }
+  uid2grp_unref(pgroups);
+
+  for(i = 0; i < 50; i++)
+    {
+      uid2grp_get_stats(&stats);
+      if(stats.nb_refresh == 1)
+        break;
+      usleep(100000);
+    }
+
+  /* Past the first expiry, the refreshed list is still there */
+  sleep(POSITIVE_TTL / 4 + 1);
+  if(stats.nb_refresh != 1 || nb_resolve != resolved + 1 ||
+     uid2grp_get(42, &pgroups) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: groups not refreshed");
+      exit(1);
+    }
+  uid2grp_unref(pgroups);
+  LogTest("Groups refreshed in the background OK");
+}
+
+int main(int argc, char *argv[])
+{
+  idmap_cache_stat_t stats;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_uid2grp_cache");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Memory manager could not be initialized");
+      exit(1);
+    }
+#endif
+
+  init_cache();
+  check_lookups();
+  check_bound();
+  check_refresh();
+
+  uid2grp_get_stats(&stats);
+  LogTest("group lists: %llu hits, %llu unknown, %llu misses, %llu name service calls",
+          (unsigned long long)stats.nb_hits, (unsigned long long)stats.nb_negative_hits,
+          (unsigned long long)stats.nb_misses, (unsigned long long)stats.nb_resolve);
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -0,0 +1,595 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    uid2grp_cache.c
+ * \brief   Cache of the group lists of the users
+ *
+ * uid2grp_cache.c : cache of the groups of the users, by uid.
+ *
+ * AUTH_UNIX credentials carry at most 16 groups. With Manage_Gids set on an
+ * export, the server uses the groups the name service knows for the uid
+ * instead. The group lists are kept by uid, shared by all the workers: the
+ * name service is asked once per user, not once per request.
+ *
+ * The cache is bounded: past max_entries, the lists not used since the last
+ * pass of a clock are dropped, in order of insertion. The lists expire after
+ * a TTL, and the lists used shortly before they expire are refreshed by
+ * uid2grp_refresh_thread, the requests using them do not wait.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include "HashData.h"
+#include "HashTable.h"
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+#include "abstract_atomic.h"
+#include "nlm_list.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/* A use in the last 1/UID2GRP_REFRESH_FRACTION of the life of a list queues it for a refresh */
+#define UID2GRP_REFRESH_FRACTION  4
+
+/* Requests to the name service taking longer are logged */
+#define UID2GRP_SLOW_RESOLVE_USEC 1000000
+
+/* Group lists, by uid */
+static hash_table_t *ht_uid2grp;
+
+static unsigned int uid2grp_max_entries = UID2GRP_MAX_ENTRIES;
+static unsigned int uid2grp_positive_ttl = ID_MAPPER_POSITIVE_TTL;
+static unsigned int uid2grp_negative_ttl = ID_MAPPER_NEGATIVE_TTL;
+
+/* The hashed lists, in order of insertion; the hash table changes under this mutex too */
+static pthread_mutex_t uid2grp_lru_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head uid2grp_lru = { &uid2grp_lru, &uid2grp_lru };
+static unsigned int uid2grp_nb_entries = 0;
+
+/* Lists to refresh */
+static pthread_mutex_t uid2grp_refresh_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uid2grp_refresh_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head uid2grp_refresh_list = { &uid2grp_refresh_list, &uid2grp_refresh_list };
+
+static idmap_cache_stat_t uid2grp_stat;
+
+/**
+ *
+ * display_uid2grp_val: displays the group list stored in the buffer.
+ *
+ * Displays the group list stored in the buffer. This function is to be used
+ * as 'val_to_str' field in the hashtable storing the group lists.
+ *
+ * @param pbuff [IN]  buffer to display
+ * @param str   [OUT] output string
+ *
+ * @return number of character written.
+ *
+ */
+int display_uid2grp_val(hash_buffer_t * pbuff, char *str)
+{
+  uid2grp_groups_t *pgroups = (uid2grp_groups_t *) pbuff->pdata;
+
+  if(pgroups->negative)
+    return sprintf(str, "uid %u unknown", (unsigned int)pgroups->uid);
+
+  return sprintf(str, "uid %u gid %u in %u groups", (unsigned int)pgroups->uid,
+                 (unsigned int)pgroups->gid, pgroups->nbgroups);
+}                               /* display_uid2grp_val */
+
+/**
+ *
+ * uid2grp_init: Inits the cache of the group lists.
+ *
+ * @param param [IN] parameter used to init the cache
+ *
+ * @return ID_MAPPER_SUCCESS if successful, -1 otherwise
+ *
+ */
+int uid2grp_init(nfs_uid2grp_cache_parameter_t param)
+{
+  if((ht_uid2grp = HashTable_Init(param.hash_param)) == NULL)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "NFS ID MAPPER: Cannot init UID2GRP cache");
+      return -1;
+    }
+
+  uid2grp_max_entries = param.max_entries;
+  uid2grp_positive_ttl = param.positive_ttl;
+  uid2grp_negative_ttl = param.negative_ttl;
+
+  return ID_MAPPER_SUCCESS;
+}                               /* uid2grp_init */
+
+void uid2grp_unref(uid2grp_groups_t * pgroups)
+{
+  if(atomic_dec_uint32_t(&pgroups->refcount) == 0)
+    {
+      if(pgroups->groups != NULL)
+        Mem_Free(pgroups->groups);
+      Mem_Free(pgroups);
+    }
+}                               /* uid2grp_unref */
+
+/* Takes a reference on the list found, under the lock of the hash table */
+static void uid2grp_ref(hash_buffer_t * pbuffval)
+{
+  atomic_inc_uint32_t(&((uid2grp_groups_t *) pbuffval->pdata)->refcount);
+}                               /* uid2grp_ref */
+
+/**
+ *
+ * uid2grp_unhash: removes a list from the hash table and from the clock.
+ *
+ * Must be called with uid2grp_lru_mutex held.
+ *
+ * @param uid [IN] the uid of the list
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_NOT_FOUND
+ *
+ */
+static int uid2grp_unhash(uid_t uid)
+{
+  hash_buffer_t buffkey;
+  hash_buffer_t old_key;
+  hash_buffer_t old_val;
+  uid2grp_groups_t *pgroups;
+
+  buffkey.pdata = (caddr_t) (unsigned long)uid;
+  buffkey.len = sizeof(unsigned long);
+
+  if(HashTable_Del(ht_uid2grp, &buffkey, &old_key, &old_val) != HASHTABLE_SUCCESS)
+    return ID_MAPPER_NOT_FOUND;
+
+  pgroups = (uid2grp_groups_t *) old_val.pdata;
+  glist_del(&pgroups->lru);
+  uid2grp_nb_entries -= 1;
+  uid2grp_unref(pgroups);
+
+  return ID_MAPPER_SUCCESS;
+}                               /* uid2grp_unhash */
+
+/**
+ *
+ * uid2grp_evict: drops lists until the cache is within its bound.
+ *
+ * Runs a clock over the lists, oldest first: a list used since the last pass
+ * gets a second chance at the end of the clock, the others are dropped. Must
+ * be called with uid2grp_lru_mutex held.
+ *
+ */
+static void uid2grp_evict(void)
+{
+  uid2grp_groups_t *pgroups;
+
+  while(uid2grp_max_entries != 0 && uid2grp_nb_entries > uid2grp_max_entries)
+    {
+      pgroups = glist_entry(uid2grp_lru.next, uid2grp_groups_t, lru);
+
+      if(pgroups->referenced)
+        {
+          pgroups->referenced = FALSE;
+          glist_del(&pgroups->lru);
+          glist_add_tail(&uid2grp_lru, &pgroups->lru);
+          continue;
+        }
+
+      LogFullDebug(COMPONENT_IDMAPPER, "Dropping the groups of uid %u",
+                   (unsigned int)pgroups->uid);
+
+      uid2grp_unhash(pgroups->uid);
+    }
+}                               /* uid2grp_evict */
+
+/**
+ *
+ * uid2grp_set: caches the groups of a uid, or that it is unknown.
+ *
+ * Caches the groups of a uid, in place of the ones cached before. The cache
+ * takes over the group list.
+ *
+ * @param uid      [IN]  the uid
+ * @param gid      [IN]  its primary group
+ * @param groups   [IN]  its groups, allocated with Mem_Alloc, NULL if unknown
+ * @param nbgroups [IN]  the number of groups
+ * @param ppgroups [OUT] if not NULL, the list cached, with a reference for the caller
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_INSERT_MALLOC_ERROR
+ *
+ */
+static int uid2grp_set(uid_t uid, gid_t gid, gid_t * groups, unsigned int nbgroups,
+                       uid2grp_groups_t ** ppgroups)
+{
+  uid2grp_groups_t *pgroups;
+  hash_buffer_t buffkey;
+  hash_buffer_t buffval;
+  unsigned int ttl;
+  int rc = HASHTABLE_SUCCESS;
+
+  if((pgroups = (uid2grp_groups_t *) Mem_Alloc_Label(sizeof(uid2grp_groups_t),
+                                                     "uid2grp_groups_t")) == NULL)
+    {
+      if(groups != NULL)
+        Mem_Free(groups);
+      return ID_MAPPER_INSERT_MALLOC_ERROR;
+    }
+
+  memset(pgroups, 0, sizeof(uid2grp_groups_t));
+  pgroups->uid = uid;
+  pgroups->gid = gid;
+  pgroups->groups = groups;
+  pgroups->nbgroups = nbgroups;
+  pgroups->negative = (groups == NULL);
+  pgroups->refcount = 1;
+  /* Not the first list the clock drops when it makes room for it */
+  pgroups->referenced = TRUE;
+
+  ttl = pgroups->negative ? uid2grp_negative_ttl : uid2grp_positive_ttl;
+  if(ttl != 0)
+    {
+      pgroups->expires = time(NULL) + ttl;
+      pgroups->refresh_after = pgroups->expires - ttl / UID2GRP_REFRESH_FRACTION;
+    }
+
+  /* Unknown uids are not kept with a null negative TTL */
+  if(!pgroups->negative || uid2grp_negative_ttl != 0)
+    {
+      buffkey.pdata = (caddr_t) (unsigned long)uid;
+      buffkey.len = sizeof(unsigned long);
+      buffval.pdata = (caddr_t) pgroups;
+      buffval.len = sizeof(uid2grp_groups_t);
+
+      P(uid2grp_lru_mutex);
+
+      uid2grp_unhash(uid);
+
+      /* The reference of the hash table, taken before the lookups see the list */
+      pgroups->refcount = 2;
+      rc = HashTable_Test_And_Set(ht_uid2grp, &buffkey, &buffval,
+                                  HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+      if(rc != HASHTABLE_SUCCESS)
+        pgroups->refcount = 1;
+      else
+        {
+          glist_add_tail(&uid2grp_lru, &pgroups->lru);
+          uid2grp_nb_entries += 1;
+          uid2grp_evict();
+        }
+
+      V(uid2grp_lru_mutex);
+    }
+
+  if(rc != HASHTABLE_SUCCESS)
+    {
+      uid2grp_unref(pgroups);
+      return ID_MAPPER_INSERT_MALLOC_ERROR;
+    }
+
+  if(ppgroups != NULL)
+    *ppgroups = pgroups;
+  else
+    uid2grp_unref(pgroups);
+
+  return ID_MAPPER_SUCCESS;
+}                               /* uid2grp_set */
+
+/**
+ *
+ * uid2grp_ask: asks the name service for the groups of a uid.
+ *
+ * Asks the name service for the groups of a uid. The time spent in the name
+ * service goes to the stats.
+ *
+ * @param uid       [IN]  the uid
+ * @param pgid      [OUT] the primary group
+ * @param pgroups   [OUT] the groups, NULL if the uid is unknown
+ * @param pnbgroups [OUT] the number of groups
+ *
+ * @return 1 if the name service knows the uid, 0 otherwise
+ *
+ */
+static int uid2grp_ask(uid_t uid, gid_t * pgid, gid_t ** pgroups, unsigned int *pnbgroups)
+{
+  struct timeval start;
+  struct timeval end;
+  uint64_t usec;
+  uint64_t max;
+  int found;
+
+  *pgid = -1;
+  *pgroups = NULL;
+  *pnbgroups = 0;
+
+  gettimeofday(&start, NULL);
+  found = uid2grp_resolve(uid, pgid, pgroups, pnbgroups);
+  gettimeofday(&end, NULL);
+
+  usec = (end.tv_sec - start.tv_sec) * 1000000ULL + end.tv_usec - start.tv_usec;
+
+  atomic_inc_uint64_t(&uid2grp_stat.nb_resolve);
+  if(!found)
+    atomic_inc_uint64_t(&uid2grp_stat.nb_resolve_failed);
+  atomic_add_uint64_t(&uid2grp_stat.resolve_usec, usec);
+
+  do
+    {
+      max = atomic_fetch_uint64_t(&uid2grp_stat.max_resolve_usec);
+    }
+  while(usec > max && !atomic_cas_uint64_t(&uid2grp_stat.max_resolve_usec, max, usec));
+
+  if(usec >= UID2GRP_SLOW_RESOLVE_USEC)
+    LogInfo(COMPONENT_IDMAPPER,
+            "The name service took %llu ms to give the groups of uid %u",
+            (unsigned long long)usec / 1000, (unsigned int)uid);
+
+  if(!found)
+    *pgroups = NULL;
+
+  return found;
+}                               /* uid2grp_ask */
+
+/**
+ *
+ * uid2grp_refresh_queue: queues a list for the refresh thread.
+ *
+ * Queues a list for the refresh thread, unless it already is.
+ *
+ * @param pgroups [IN] the list
+ *
+ */
+static void uid2grp_refresh_queue(uid2grp_groups_t * pgroups)
+{
+  P(uid2grp_refresh_mutex);
+
+  if(!pgroups->refreshing)
+    {
+      pgroups->refreshing = TRUE;
+      atomic_inc_uint32_t(&pgroups->refcount);
+      glist_add_tail(&uid2grp_refresh_list, &pgroups->refresh_list);
+      pthread_cond_signal(&uid2grp_refresh_cond);
+    }
+
+  V(uid2grp_refresh_mutex);
+}                               /* uid2grp_refresh_queue */
+
+/**
+ *
+ * uid2grp_get: gets the cached groups of a uid.
+ *
+ * Gets the cached groups of a uid. A list used shortly before it expires is
+ * queued for a refresh in the background.
+ *
+ * @param uid      [IN]  the uid
+ * @param ppgroups [OUT] the list, with a reference for the caller
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_NEGATIVE if the name service knows no
+ * such uid, ID_MAPPER_NOT_FOUND if the name service has to be asked.
+ *
+ */
+int uid2grp_get(uid_t uid, uid2grp_groups_t ** ppgroups)
+{
+  hash_buffer_t buffkey;
+  hash_buffer_t buffval;
+  uid2grp_groups_t *pgroups;
+  time_t now;
+
+  if(ht_uid2grp == NULL || ppgroups == NULL)
+    return ID_MAPPER_INVALID_ARGUMENT;
+
+  buffkey.pdata = (caddr_t) (unsigned long)uid;
+  buffkey.len = sizeof(unsigned long);
+
+  if(HashTable_GetRef(ht_uid2grp, &buffkey, &buffval, uid2grp_ref) != HASHTABLE_SUCCESS)
+    {
+      atomic_inc_uint64_t(&uid2grp_stat.nb_misses);
+      return ID_MAPPER_NOT_FOUND;
+    }
+
+  pgroups = (uid2grp_groups_t *) buffval.pdata;
+  now = time(NULL);
+
+  if(pgroups->expires != 0 && now >= pgroups->expires)
+    {
+      atomic_inc_uint64_t(&uid2grp_stat.nb_misses);
+      uid2grp_unref(pgroups);
+      return ID_MAPPER_NOT_FOUND;
+    }
+
+  pgroups->referenced = TRUE;
+
+  if(pgroups->expires != 0 && now >= pgroups->refresh_after && !pgroups->refreshing)
+    uid2grp_refresh_queue(pgroups);
+
+  if(pgroups->negative)
+    {
+      atomic_inc_uint64_t(&uid2grp_stat.nb_negative_hits);
+      uid2grp_unref(pgroups);
+      return ID_MAPPER_NEGATIVE;
+    }
+
+  atomic_inc_uint64_t(&uid2grp_stat.nb_hits);
+  *ppgroups = pgroups;
+
+  return ID_MAPPER_SUCCESS;
+}                               /* uid2grp_get */
+
+/**
+ *
+ * uid2grp: gets the groups of a uid.
+ *
+ * Gets the groups of a uid, from the cache, or from the name service on
+ * cache misses. The uids the name service does not know are cached too.
+ *
+ * @param uid      [IN]  the uid
+ * @param ppgroups [OUT] the list, with a reference to drop with uid2grp_unref
+ *
+ * return 1 if successful, 0 otherwise
+ *
+ */
+int uid2grp(uid_t uid, uid2grp_groups_t ** ppgroups)
+{
+  gid_t gid;
+  gid_t *groups;
+  unsigned int nbgroups;
+
+  switch (uid2grp_get(uid, ppgroups))
+    {
+    case ID_MAPPER_SUCCESS:
+      return 1;
+
+    case ID_MAPPER_NEGATIVE:
+    case ID_MAPPER_INVALID_ARGUMENT:
+      return 0;
+    }
+
+  if(!uid2grp_ask(uid, &gid, &groups, &nbgroups))
+    {
+      /* Kept as unknown, for the next requests */
+      if(uid2grp_set(uid, gid, NULL, 0, NULL) != ID_MAPPER_SUCCESS)
+        LogCrit(COMPONENT_IDMAPPER,
+                "uid2grp: could not cache that uid %u is unknown",
+                (unsigned int)uid);
+      return 0;
+    }
+
+  if(uid2grp_set(uid, gid, groups, nbgroups, ppgroups) != ID_MAPPER_SUCCESS)
+    {
+      LogCrit(COMPONENT_IDMAPPER,
+              "uid2grp: could not cache the groups of uid %u",
+              (unsigned int)uid);
+      return 0;
+    }
+
+  return 1;
+}                               /* uid2grp */
+
+/**
+ *
+ * uid2grp_remove: drops the cached groups of a uid.
+ *
+ * @param uid [IN] the uid
+ *
+ * @return ID_MAPPER_SUCCESS, ID_MAPPER_NOT_FOUND
+ *
+ */
+int uid2grp_remove(uid_t uid)
+{
+  int rc;
+
+  if(ht_uid2grp == NULL)
+    return ID_MAPPER_INVALID_ARGUMENT;
+
+  P(uid2grp_lru_mutex);
+  rc = uid2grp_unhash(uid);
+  V(uid2grp_lru_mutex);
+
+  return rc;
+}                               /* uid2grp_remove */
+
+/**
+ *
+ * uid2grp_get_stats: gets the lookup statistics of the group lists.
+ *
+ * @param pstat [OUT] the resulting stats
+ *
+ */
+void uid2grp_get_stats(idmap_cache_stat_t * pstat)
+{
+  pstat->nb_hits = atomic_fetch_uint64_t(&uid2grp_stat.nb_hits);
+  pstat->nb_negative_hits = atomic_fetch_uint64_t(&uid2grp_stat.nb_negative_hits);
+  pstat->nb_misses = atomic_fetch_uint64_t(&uid2grp_stat.nb_misses);
+  pstat->nb_refresh = atomic_fetch_uint64_t(&uid2grp_stat.nb_refresh);
+  pstat->nb_resolve = atomic_fetch_uint64_t(&uid2grp_stat.nb_resolve);
+  pstat->nb_resolve_failed = atomic_fetch_uint64_t(&uid2grp_stat.nb_resolve_failed);
+  pstat->resolve_usec = atomic_fetch_uint64_t(&uid2grp_stat.resolve_usec);
+  pstat->max_resolve_usec = atomic_fetch_uint64_t(&uid2grp_stat.max_resolve_usec);
+}                               /* uid2grp_get_stats */
+
+/**
+ *
+ * uid2grp_refresh_thread: refreshes the group lists used before they expire.
+ *
+ * Asks the name service again for the lists queued by the lookups made
+ * shortly before they expire, and caches the new lists. A list of a uid the
+ * name service no longer finds is left to expire, so that a name service
+ * failing for a while does not take their groups from known users. The
+ * unknown uids still unknown are kept longer.
+ *
+ */
+void *uid2grp_refresh_thread(void *arg)
+{
+  uid2grp_groups_t *pgroups;
+  gid_t gid;
+  gid_t *groups;
+  unsigned int nbgroups;
+  int found;
+
+  SetNameFunction("uid2grp_refresh");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_IDMAPPER,
+               "UID2GRP REFRESH: Memory manager could not be initialized");
+    }
+#endif
+
+  for(;;)
+    {
+      P(uid2grp_refresh_mutex);
+      while(glist_empty(&uid2grp_refresh_list))
+        pthread_cond_wait(&uid2grp_refresh_cond, &uid2grp_refresh_mutex);
+
+      pgroups = glist_entry(uid2grp_refresh_list.next, uid2grp_groups_t, refresh_list);
+      glist_del(&pgroups->refresh_list);
+      V(uid2grp_refresh_mutex);
+
+      LogFullDebug(COMPONENT_IDMAPPER, "Refreshing the groups of uid %u",
+                   (unsigned int)pgroups->uid);
+
+      found = uid2grp_ask(pgroups->uid, &gid, &groups, &nbgroups);
+
+      if(found)
+        uid2grp_set(pgroups->uid, gid, groups, nbgroups, NULL);
+      else if(pgroups->negative)
+        uid2grp_set(pgroups->uid, gid, NULL, 0, NULL);
+
+      atomic_inc_uint64_t(&uid2grp_stat.nb_refresh);
+
+      /* A list not replaced stays marked as refreshing: it is not queued
+       * again, and expires */
+      uid2grp_unref(pgroups);
+    }
+
+  return NULL;
+}                               /* uid2grp_refresh_thread */
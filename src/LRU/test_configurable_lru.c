@@ -141,7 +141,9 @@ int main(int argc, char *argv[])
   param.clean_entry = clean_entry;
   param.lp_name = "Test";
 
+#ifndef _NO_BUDDY_SYSTEM
   BuddyInit(NULL);
+#endif
 
   if((plru = LRU_Init(param, &status)) == NULL)
     {
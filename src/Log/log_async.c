@@ -0,0 +1,594 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    log_async.c
+ * \brief   Asynchronous writing of the messages logged to files.
+ *
+ * log_async.c : Once LogAsync_Start() has been called, the messages of the
+ * components that log to a file are no longer written by the thread that
+ * logs them. Each thread copies its formatted messages into a ring of its
+ * own, then a single writer thread drains all the rings, gathering the
+ * messages for a given file into one writev() on a descriptor it keeps
+ * open.
+ *
+ * A ring has a single producer (its thread) and a single consumer (the
+ * writer), neither takes a lock. When a ring is full, the message is dropped
+ * and counted; logging never waits for the disk. The writer reports the
+ * number of dropped messages in the log itself.
+ *
+ * Messages from different threads may be written slightly out of order, the
+ * messages of a given thread never are. LogAsync_Reopen() makes the writer
+ * close and reopen its files, for log rotation.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/param.h>
+#include "log.h"
+#include "abstract_atomic.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define LOG_ASYNC_MIN_RING_SIZE  (16 * 1024)
+#define LOG_ASYNC_MAX_FILES      16
+#define LOG_ASYNC_MAX_IOV        64
+#define LOG_ASYNC_FLUSH_MSEC     20
+
+/* Header of a record in a ring, the text follows, padded to 8 bytes */
+typedef struct log_record_header__
+{
+  uint32_t len;                 /**< Length of the text, 0 for a wrap marker */
+  uint32_t component;           /**< Component the message was logged for */
+} log_record_header_t;
+
+#define LOG_RECORD_SIZE(len) (sizeof(log_record_header_t) + (((len) + 7) & ~7))
+
+typedef struct log_ring__
+{
+  uint64_t head __attribute__ ((aligned(CACHE_LINE_SIZE)));  /**< Bytes produced, written by the owner */
+  uint64_t nb_dropped;                                      /**< Messages dropped, written by the owner */
+  uint64_t tail __attribute__ ((aligned(CACHE_LINE_SIZE)));  /**< Bytes consumed, written by the writer */
+  uint32_t dead;                                            /**< Owner exited, free once drained */
+  uint64_t mask;                                            /**< Ring size - 1 */
+  char *data;
+  struct log_ring__ *next;
+} log_ring_t;
+
+typedef struct log_async_file__
+{
+  char path[MAXPATHLEN];
+  int fd;
+} log_async_file_t;
+
+static int log_async_active = FALSE;
+static uint32_t log_async_stop = FALSE;
+static uint32_t log_async_reopen = FALSE;
+static uint64_t log_async_ring_size;
+
+static pthread_t log_async_thrid;
+static pthread_mutex_t log_async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_async_cond = PTHREAD_COND_INITIALIZER;
+
+/* Rings of all threads, protected by log_async_mutex */
+static log_ring_t *log_async_rings = NULL;
+
+static pthread_key_t log_ring_key;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static __thread log_ring_t *log_ring_self = NULL;
+
+/* Only used by the writer thread */
+static log_async_file_t log_async_files[LOG_ASYNC_MAX_FILES];
+static unsigned int log_async_nb_files = 0;
+static unsigned int log_async_victim = 0;
+static uint64_t log_async_nb_reported = 0;
+
+/* Statistics */
+static uint64_t log_async_nb_written = 0;
+static uint64_t log_async_nb_dropped_dead = 0;
+
+static cleanup_list_element log_async_cleanup_element;
+static int log_async_cleanup_registered = FALSE;
+
+static void log_ring_release(void *arg)
+{
+  log_ring_t *pring = (log_ring_t *) arg;
+
+  atomic_store_uint32_t(&pring->dead, TRUE);
+}                               /* log_ring_release */
+
+static void log_ring_init_key(void)
+{
+  pthread_key_create(&log_ring_key, log_ring_release);
+}                               /* log_ring_init_key */
+
+/**
+ *
+ * log_ring_get: Returns the ring of the calling thread, allocating it if needed.
+ *
+ * @return the ring, NULL if it could not be allocated.
+ *
+ */
+static log_ring_t *log_ring_get(void)
+{
+  log_ring_t *pring;
+
+  if(log_ring_self != NULL)
+    return log_ring_self;
+
+  pthread_once(&log_ring_once, log_ring_init_key);
+
+  if((pring = (log_ring_t *) malloc(sizeof(log_ring_t))) == NULL)
+    return NULL;
+
+  memset((char *)pring, 0, sizeof(log_ring_t));
+
+  if((pring->data = (char *)malloc(log_async_ring_size)) == NULL)
+    {
+      free(pring);
+      return NULL;
+    }
+
+  pring->mask = log_async_ring_size - 1;
+
+  pthread_setspecific(log_ring_key, pring);
+  log_ring_self = pring;
+
+  pthread_mutex_lock(&log_async_mutex);
+  pring->next = log_async_rings;
+  log_async_rings = pring;
+  pthread_mutex_unlock(&log_async_mutex);
+
+  return pring;
+}                               /* log_ring_get */
+
+/**
+ *
+ * LogAsync_IsActive: Tells if messages to files are written asynchronously.
+ *
+ * @return TRUE if LogAsync_Start was called and LogAsync_Stop was not.
+ *
+ */
+int LogAsync_IsActive(void)
+{
+  return log_async_active;
+}                               /* LogAsync_IsActive */
+
+/**
+ *
+ * LogAsync_Write: Queues a formatted message for the writer thread.
+ *
+ * Queues a formatted message in the ring of the calling thread. Never blocks.
+ *
+ * @param component [IN] the component the message is logged for, its file is used.
+ * @param text [IN] the message.
+ * @param len [IN] its length.
+ *
+ * @return SUCCES if the message was queued, ERR_FICHIER_LOG if it was dropped.
+ *
+ */
+int LogAsync_Write(log_components_t component, const char *text, size_t len)
+{
+  log_ring_t *pring;
+  log_record_header_t *phdr;
+  uint64_t head, tail, off, needed, contiguous;
+
+  if((pring = log_ring_get()) == NULL)
+    return ERR_FICHIER_LOG;
+
+  head = pring->head;
+  off = head & pring->mask;
+  contiguous = pring->mask + 1 - off;
+  needed = LOG_RECORD_SIZE(len);
+
+  /* A record never wraps, the end of the ring is skipped if needed */
+  if(needed > contiguous)
+    needed += contiguous;
+
+  tail = atomic_fetch_uint64_t(&pring->tail);
+
+  if(head + needed - tail > pring->mask + 1)
+    {
+      pring->nb_dropped += 1;
+      return ERR_FICHIER_LOG;
+    }
+
+  if(LOG_RECORD_SIZE(len) > contiguous)
+    {
+      phdr = (log_record_header_t *) (pring->data + off);
+      phdr->len = 0;
+      head += contiguous;
+      off = 0;
+    }
+
+  phdr = (log_record_header_t *) (pring->data + off);
+  phdr->len = len;
+  phdr->component = component;
+  memcpy((char *)(phdr + 1), text, len);
+
+  atomic_store_uint64_t(&pring->head, head + LOG_RECORD_SIZE(len));
+
+  /* The writer wakes up on its own regularly, only hurry it when needed */
+  if(head + LOG_RECORD_SIZE(len) - tail > (pring->mask + 1) / 2)
+    pthread_cond_signal(&log_async_cond);
+
+  return SUCCES;
+}                               /* LogAsync_Write */
+
+/**
+ *
+ * log_async_get_fd: Returns the descriptor of a log file, opening it if needed.
+ *
+ * @param path [IN] the path of the log file.
+ *
+ * @return the descriptor, -1 if the file could not be opened.
+ *
+ */
+static int log_async_get_fd(const char *path)
+{
+  log_async_file_t *pfile;
+  unsigned int i;
+
+  for(i = 0; i < log_async_nb_files; i++)
+    if(!strcmp(log_async_files[i].path, path))
+      return log_async_files[i].fd;
+
+  if(log_async_nb_files < LOG_ASYNC_MAX_FILES)
+    pfile = &log_async_files[log_async_nb_files++];
+  else
+    {
+      pfile = &log_async_files[log_async_victim];
+      log_async_victim = (log_async_victim + 1) % LOG_ASYNC_MAX_FILES;
+      close(pfile->fd);
+    }
+
+  strncpy(pfile->path, path, MAXPATHLEN - 1);
+  pfile->path[MAXPATHLEN - 1] = '\0';
+
+  if((pfile->fd = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1)
+    fprintf(stderr, "Error: could not open log file %s: %s\n", path, strerror(errno));
+
+  return pfile->fd;
+}                               /* log_async_get_fd */
+
+static void log_async_close_files(void)
+{
+  unsigned int i;
+
+  for(i = 0; i < log_async_nb_files; i++)
+    if(log_async_files[i].fd != -1)
+      close(log_async_files[i].fd);
+
+  log_async_nb_files = 0;
+  log_async_victim = 0;
+}                               /* log_async_close_files */
+
+static void log_async_writev(int fd, struct iovec *iov, int nb_iov)
+{
+  ssize_t expected = 0;
+  int i;
+
+  if(fd == -1 || nb_iov == 0)
+    return;
+
+  for(i = 0; i < nb_iov; i++)
+    expected += iov[i].iov_len;
+
+  if(writev(fd, iov, nb_iov) < expected)
+    fprintf(stderr, "Error: couldn't complete write to the log file, ensure disk has not filled up\n");
+}                               /* log_async_writev */
+
+/**
+ *
+ * log_async_drain: Writes the content of a ring to the log files.
+ *
+ * @param pring [INOUT] the ring to be drained.
+ *
+ * @return the number of messages written.
+ *
+ */
+static unsigned int log_async_drain(log_ring_t * pring)
+{
+  struct iovec iov[LOG_ASYNC_MAX_IOV];
+  log_record_header_t *phdr;
+  uint64_t tail = pring->tail;
+  uint64_t head = atomic_fetch_uint64_t(&pring->head);
+  uint64_t off;
+  int nb_iov = 0;
+  int batch_fd = -1;
+  int fd;
+  unsigned int nb_written = 0;
+
+  while(tail < head)
+    {
+      off = tail & pring->mask;
+      phdr = (log_record_header_t *) (pring->data + off);
+
+      if(phdr->len == 0)
+        {
+          tail += pring->mask + 1 - off;
+          continue;
+        }
+
+      if(phdr->component < COMPONENT_COUNT &&
+         LogComponents[phdr->component].comp_log_type == FILELOG)
+        fd = log_async_get_fd(LogComponents[phdr->component].comp_log_file);
+      else
+        fd = -1;
+
+      /* The iovecs point into the ring: release it only once written */
+      if((fd != batch_fd && nb_iov != 0) || nb_iov == LOG_ASYNC_MAX_IOV)
+        {
+          log_async_writev(batch_fd, iov, nb_iov);
+          atomic_store_uint64_t(&pring->tail, tail);
+          nb_iov = 0;
+        }
+
+      batch_fd = fd;
+      iov[nb_iov].iov_base = (char *)(phdr + 1);
+      iov[nb_iov].iov_len = phdr->len;
+      nb_iov += 1;
+      nb_written += 1;
+
+      tail += LOG_RECORD_SIZE(phdr->len);
+    }
+
+  log_async_writev(batch_fd, iov, nb_iov);
+  atomic_store_uint64_t(&pring->tail, tail);
+
+  return nb_written;
+}                               /* log_async_drain */
+
+/**
+ *
+ * log_async_drain_all: Drains every ring, frees the ones of exited threads.
+ *
+ * @return the number of messages written.
+ *
+ */
+static unsigned int log_async_drain_all(void)
+{
+  log_ring_t *pring;
+  log_ring_t **ppring;
+  uint64_t nb_dropped = 0;
+  unsigned int nb_written = 0;
+  char tampon[STR_LEN];
+  int fd;
+
+  if(atomic_cas_uint32_t(&log_async_reopen, TRUE, FALSE))
+    log_async_close_files();
+
+  pthread_mutex_lock(&log_async_mutex);
+
+  ppring = &log_async_rings;
+  while((pring = *ppring) != NULL)
+    {
+      /* Read dead first: once set, the owner will not write anymore */
+      if(atomic_fetch_uint32_t(&pring->dead))
+        {
+          nb_written += log_async_drain(pring);
+          log_async_nb_dropped_dead += pring->nb_dropped;
+          *ppring = pring->next;
+          free(pring->data);
+          free(pring);
+          continue;
+        }
+
+      nb_written += log_async_drain(pring);
+      nb_dropped += pring->nb_dropped;
+      ppring = &pring->next;
+    }
+
+  pthread_mutex_unlock(&log_async_mutex);
+
+  log_async_nb_written += nb_written;
+
+  nb_dropped += log_async_nb_dropped_dead;
+  if(nb_dropped > log_async_nb_reported &&
+     LogComponents[COMPONENT_LOG].comp_log_type == FILELOG &&
+     (fd = log_async_get_fd(LogComponents[COMPONENT_LOG].comp_log_file)) != -1)
+    {
+      snprintf(tampon, STR_LEN, "LOG: %llu messages dropped, logging threads filled their ring\n",
+               (unsigned long long)(nb_dropped - log_async_nb_reported));
+      if(write(fd, tampon, strlen(tampon)) < 0)
+        fprintf(stderr, "%s", tampon);
+      log_async_nb_reported = nb_dropped;
+    }
+
+  return nb_written;
+}                               /* log_async_drain_all */
+
+static void *log_async_thread(void *arg)
+{
+  struct timeval now;
+  struct timespec timeout;
+
+  SetNameFunction("log_writer");
+
+  while(!atomic_fetch_uint32_t(&log_async_stop))
+    {
+      if(log_async_drain_all() != 0)
+        continue;
+
+      gettimeofday(&now, NULL);
+      timeout.tv_sec = now.tv_sec;
+      timeout.tv_nsec = (now.tv_usec + LOG_ASYNC_FLUSH_MSEC * 1000) * 1000;
+      if(timeout.tv_nsec >= 1000000000)
+        {
+          timeout.tv_sec += 1;
+          timeout.tv_nsec -= 1000000000;
+        }
+
+      pthread_mutex_lock(&log_async_mutex);
+      pthread_cond_timedwait(&log_async_cond, &log_async_mutex, &timeout);
+      pthread_mutex_unlock(&log_async_mutex);
+    }
+
+  /* Write what is left */
+  while(log_async_drain_all() != 0) ;
+
+  log_async_close_files();
+
+  return NULL;
+}                               /* log_async_thread */
+
+static void log_async_cleanup(void)
+{
+  LogAsync_Stop();
+}                               /* log_async_cleanup */
+
+/**
+ *
+ * LogAsync_Start: Starts writing the messages logged to files from a dedicated thread.
+ *
+ * @param ring_size [IN] the size in bytes of the ring of each logging thread, rounded up to a power of 2.
+ *
+ * @return 0 if ok, -1 otherwise.
+ *
+ */
+int LogAsync_Start(unsigned int ring_size)
+{
+  pthread_attr_t attr;
+
+  if(log_async_active)
+    return 0;
+
+  log_async_ring_size = LOG_ASYNC_MIN_RING_SIZE;
+  while(log_async_ring_size < ring_size)
+    log_async_ring_size <<= 1;
+
+  log_async_stop = FALSE;
+  log_async_reopen = FALSE;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  if(pthread_create(&log_async_thrid, &attr, log_async_thread, NULL) != 0)
+    {
+      LogCrit(COMPONENT_LOG,
+              "Could not start the log writer thread, error %d (%s)",
+              errno, strerror(errno));
+      return -1;
+    }
+
+  if(!log_async_cleanup_registered)
+    {
+      log_async_cleanup_element.clean = log_async_cleanup;
+      RegisterCleanup(&log_async_cleanup_element);
+      log_async_cleanup_registered = TRUE;
+    }
+
+  atomic_barrier();
+  log_async_active = TRUE;
+
+  LogEvent(COMPONENT_LOG,
+           "LOG: messages to files are now written asynchronously, %llu bytes per thread",
+           (unsigned long long)log_async_ring_size);
+
+  return 0;
+}                               /* LogAsync_Start */
+
+/**
+ *
+ * LogAsync_Stop: Writes the queued messages and stops the writer thread.
+ *
+ * Writes the queued messages and stops the writer thread. Messages logged
+ * afterwards are written synchronously.
+ *
+ * @return nothing (void function)
+ *
+ */
+void LogAsync_Stop(void)
+{
+  if(!log_async_active)
+    return;
+
+  log_async_active = FALSE;
+  atomic_store_uint32_t(&log_async_stop, TRUE);
+  pthread_cond_signal(&log_async_cond);
+
+  if(!pthread_equal(pthread_self(), log_async_thrid))
+    pthread_join(log_async_thrid, NULL);
+}                               /* LogAsync_Stop */
+
+/**
+ *
+ * LogAsync_Reopen: Makes the writer thread reopen the log files.
+ *
+ * Makes the writer thread reopen the log files, so that they can be rotated.
+ *
+ * @return nothing (void function)
+ *
+ */
+void LogAsync_Reopen(void)
+{
+  atomic_store_uint32_t(&log_async_reopen, TRUE);
+  pthread_cond_signal(&log_async_cond);
+}                               /* LogAsync_Reopen */
+
+/**
+ *
+ * LogAsync_GetStats: Returns the number of messages written and dropped.
+ *
+ * @param pnb_written [OUT] messages written by the writer thread.
+ * @param pnb_dropped [OUT] messages dropped because a ring was full.
+ *
+ * @return nothing (void function)
+ *
+ */
+void LogAsync_GetStats(unsigned long long *pnb_written, unsigned long long *pnb_dropped)
+{
+  log_ring_t *pring;
+  uint64_t nb_dropped;
+
+  pthread_mutex_lock(&log_async_mutex);
+
+  nb_dropped = log_async_nb_dropped_dead;
+  for(pring = log_async_rings; pring != NULL; pring = pring->next)
+    nb_dropped += pring->nb_dropped;
+
+  *pnb_written = log_async_nb_written;
+  *pnb_dropped = nb_dropped;
+
+  pthread_mutex_unlock(&log_async_mutex);
+}                               /* LogAsync_GetStats */
@@ -611,6 +611,10 @@ static int DisplayLogPath_valist(char *path, char * function, log_components_t c
 
   DisplayLogString_valist(tampon, function, component, format, arguments);
 
+  /* The log writer thread owns the files */
+  if(LogAsync_IsActive())
+    return LogAsync_Write(component, tampon, strlen(tampon));
+
   if(path[0] != '\0')
     {
 #ifdef _LOCK_LOG
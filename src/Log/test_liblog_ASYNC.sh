@@ -0,0 +1,7 @@
+#!/bin/sh
+##
+## test_liblog_ASYNC.sh
+## test log functions (asynchronous writing to a file)
+##
+
+./test_liblog ASYNC /tmp/test_liblog.async.$$
@@ -35,6 +35,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include "log.h"
 
 #ifndef TRUE
@@ -463,10 +466,100 @@ void *run_MT_Tests(void *arg)
   return NULL ;
 }
 
-static char usage[] = "usage:\n\ttest_liblog STD|MT\n";
+static char usage[] = "usage:\n\ttest_liblog STD|MT\n\ttest_liblog ASYNC <logfile>\n";
 
 #define NB_THREADS 20
 
+#define NB_ASYNC_THREADS 4
+#define NB_ASYNC_MSG 20000
+
+void *run_Async_Tests(void *arg)
+{
+  unsigned long id = (unsigned long)arg;
+  int i;
+
+  for(i = 0; i < NB_ASYNC_MSG; i++)
+    LogEvent(COMPONENT_DISPATCH, "ASYNC thread %lu message %d", id, i);
+
+  return NULL;
+}
+
+/* Logs from several threads, returns the elapsed time */
+double run_Async_Threads(void)
+{
+  pthread_t threads[NB_ASYNC_THREADS];
+  struct timeval start, end;
+  unsigned long i;
+
+  gettimeofday(&start, NULL);
+
+  for(i = 0; i < NB_ASYNC_THREADS; i++)
+    pthread_create(&threads[i], NULL, run_Async_Tests, (void *)i);
+
+  for(i = 0; i < NB_ASYNC_THREADS; i++)
+    pthread_join(threads[i], NULL);
+
+  gettimeofday(&end, NULL);
+
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+/* Checks that each thread's messages are all there, in order, unless dropped */
+int check_Async_File(char *file, unsigned long long nb_dropped)
+{
+  char line[2048];
+  char *s;
+  int next[NB_ASYNC_THREADS];
+  unsigned long id;
+  int msg;
+  unsigned long long nb_lines = 0;
+  FILE *f;
+
+  memset(next, 0, sizeof(next));
+
+  if((f = fopen(file, "r")) == NULL)
+    {
+      LogTest("FAILURE: could not open %s", file);
+      return 1;
+    }
+
+  while(fgets(line, sizeof(line), f) != NULL)
+    {
+      if((s = strstr(line, "ASYNC thread ")) == NULL)
+        continue;
+
+      if(sscanf(s, "ASYNC thread %lu message %d", &id, &msg) != 2 ||
+         id >= NB_ASYNC_THREADS || msg < next[id])
+        {
+          LogTest("FAILURE: unexpected line %s", line);
+          fclose(f);
+          return 1;
+        }
+
+      /* A gap is only allowed if messages were dropped */
+      if(msg != next[id] && nb_dropped == 0)
+        {
+          LogTest("FAILURE: thread %lu message %d is missing", id, next[id]);
+          fclose(f);
+          return 1;
+        }
+
+      next[id] = msg + 1;
+      nb_lines += 1;
+    }
+
+  fclose(f);
+
+  if(nb_lines + nb_dropped != NB_ASYNC_THREADS * NB_ASYNC_MSG)
+    {
+      LogTest("FAILURE: %llu messages written and %llu dropped, expected %d",
+              nb_lines, nb_dropped, NB_ASYNC_THREADS * NB_ASYNC_MSG);
+      return 1;
+    }
+
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -549,6 +642,60 @@ int main(int argc, char *argv[])
 
         }
 
+      /* asynchronous logging to a file */
+
+      else if(!strcmp(argv[1], "ASYNC") && argc >= 3)
+        {
+          unsigned long long nb_written, nb_dropped;
+          double sync_time, async_time;
+
+          SetNamePgm("test_liblog");
+          SetNameHost("localhost");
+          SetDefaultLogging("TEST");
+          InitLogging();
+
+          SetComponentLogLevel(COMPONENT_DISPATCH, NIV_EVENT);
+
+          /* Synchronous first, as a reference */
+          unlink(argv[2]);
+          if(SetComponentLogFile(COMPONENT_DISPATCH, argv[2]) != 0)
+            {
+              LogTest("FAILURE: could not log to %s", argv[2]);
+              exit(1);
+            }
+          sync_time = run_Async_Threads();
+          if(check_Async_File(argv[2], 0) != 0)
+            exit(1);
+
+          unlink(argv[2]);
+          if(LogAsync_Start(64 * 1024) != 0)
+            {
+              LogTest("FAILURE: could not start the log writer");
+              exit(1);
+            }
+          async_time = run_Async_Threads();
+          LogAsync_Stop();
+          LogAsync_GetStats(&nb_written, &nb_dropped);
+
+          if(check_Async_File(argv[2], nb_dropped) != 0)
+            exit(1);
+
+          LogTest("%d threads x %d messages: synchronous %.3fs, asynchronous %.3fs (%llu written, %llu dropped)",
+                  NB_ASYNC_THREADS, NB_ASYNC_MSG, sync_time, async_time,
+                  nb_written, nb_dropped);
+
+          /* Once stopped, messages are written synchronously again */
+          LogEvent(COMPONENT_DISPATCH, "After the writer stopped");
+          if(LogAsync_IsActive())
+            {
+              LogTest("FAILURE: the log writer is still active");
+              exit(1);
+            }
+
+          unlink(argv[2]);
+          LogTest("PASSED!");
+        }
+
       /* unknown test */
       else
         {
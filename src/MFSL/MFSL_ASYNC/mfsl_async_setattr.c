@@ -187,6 +187,9 @@ fsal_status_t MFSL_setattrs(mfsl_object_t * filehandle, /* IN */
 
   pasyncopdesc->op_func = MFSL_setattr_async_op;
   pasyncopdesc->fsal_op_context = *p_context;
+#ifndef _USE_HPSS
+  FSAL_CRED_DROP_EXT_GROUPS(&pasyncopdesc->fsal_op_context.credential);
+#endif
 
   pasyncopdesc->ptr_mfsl_context = (caddr_t) p_mfsl_context;
 
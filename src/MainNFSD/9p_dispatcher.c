@@ -47,6 +47,10 @@
 #include <sys/file.h>           /* for having FNDELAY */
 #include <sys/select.h>
 #include <poll.h>
+#include <errno.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include "HashData.h"
 #include "HashTable.h"
 #include "log.h"
@@ -62,6 +66,7 @@
 #include "nfs_file_handle.h"
 #include "nfs_stat.h"
 #include "SemN.h"
+#include "abstract_atomic.h"
 #include "9p.h"
 
 #ifndef _USE_TIRPC_IPV6
@@ -72,223 +77,486 @@
 
 void DispatchWork9P( request_data_t *preq, unsigned int worker_index)
 {
-  LRU_entry_t *pentry = NULL;
-  LRU_status_t status;
-
   LogDebug(COMPONENT_DISPATCH,
            "Awaking Worker Thread #%u for 9P request %p, tcpsock=%lu",
            worker_index, preq, preq->rcontent._9p.pconn->sockfd);
 
-  P(workers_data[worker_index].wcb.tcb_mutex);
-  P(workers_data[worker_index].request_pool_mutex);
+  nfs_worker_queue_request(preq, worker_index);
+}
 
-  pentry = LRU_new_entry(workers_data[worker_index].pending_request, &status);
+/* Messages read from a connection before serving the others */
+#define _9P_IO_BATCH 16
 
-  if(pentry == NULL)
-    {
-      V(workers_data[worker_index].request_pool_mutex);
-      V(workers_data[worker_index].wcb.tcb_mutex);
-      LogMajor(COMPONENT_DISPATCH,
-               "Error while inserting 9P pending request to Worker Thread #%u... Exiting",
-               worker_index);
-      Fatal();
-    }
+/* Events handled by an I/O thread per wakeup */
+#define _9P_IO_EVENTS 64
 
-  pentry->buffdata.pdata = (caddr_t) preq;
-  pentry->buffdata.len = sizeof(*preq);
+#ifndef HAVE_SYS_EPOLL_H
+/* Connections served by an I/O thread when poll() is used */
+#define _9P_IO_MAX_CONN 1024
+#endif
 
-  if(pthread_cond_signal(&(workers_data[worker_index].wcb.tcb_condvar)) == -1)
-    {
-      V(workers_data[worker_index].request_pool_mutex);
-      V(workers_data[worker_index].wcb.tcb_mutex);
-      LogMajor(COMPONENT_THREAD,
-               "Error %d (%s) while signalling Worker Thread #%u... Exiting",
-               errno, strerror(errno), worker_index);
-      Fatal();
-    }
-  V(workers_data[worker_index].request_pool_mutex);
-  V(workers_data[worker_index].wcb.tcb_mutex);
-}
+/* State of a connection, as seen by the I/O thread serving it */
+typedef struct _9p_io_conn__
+{
+  _9p_conn_t     * pconn ;
+  request_data_t * preq ;          /* Message being received, NULL between messages */
+  unsigned int     worker_index ;  /* Worker whose pool preq comes from */
+  u32              received ;      /* Bytes of the message received so far */
+  char             strcaller[MAXNAMLEN] ;
+} _9p_io_conn_t ;
+
+typedef struct _9p_io_thread__
+{
+  pthread_t         thrid ;
+  unsigned int      index ;
+#ifdef HAVE_SYS_EPOLL_H
+  int               epoll_fd ;
+#else
+  pthread_mutex_t   lock ;         /* conns is filled by the 9P dispatcher */
+  unsigned int      nb_conns ;
+  _9p_io_conn_t   * conns[_9P_IO_MAX_CONN] ;
+#endif
+} _9p_io_thread_t ;
 
+static _9p_io_thread_t * _9p_io_threads = NULL ;
+static unsigned int _9p_nb_io_threads = 0 ;
 
 /**
- * _9p_socket_thread: 9p socket manager.
+ * _9p_conn_release: releases a reference on a 9P connection.
  *
- * This function is the main loop for the 9p socket manager. One such thread exists per connection.
+ * The I/O thread holds a reference on the connection until the client goes away, and every request
+ * being processed holds another one. The socket is closed with the last reference, so that a worker
+ * never sends a reply to a socket that has been reused for another client.
  *
- * @param Arg the socket number cast as a void * in pthread_create
+ * @param pconn [INOUT] the connection.
  *
- * @return NULL 
+ * @return nothing (void function).
  *
  */
+void _9p_conn_release( _9p_conn_t * pconn )
+{
+  if( atomic_dec_uint32_t( &pconn->refcount ) != 0 )
+    return ;
 
+  LogDebug( COMPONENT_9P, "Closing 9p socket #%ld", pconn->sockfd ) ;
 
-void * _9p_socket_thread( void * Arg )
+  close( pconn->sockfd ) ;
+  Mem_Free( pconn ) ;
+} /* _9p_conn_release */
+
+/**
+ * _9p_io_read: reads the messages available on a 9P connection.
+ *
+ * Complete messages are handed to the workers. A partial message is kept with the connection until
+ * the rest of it arrives, so that an I/O thread never waits for a slow client.
+ *
+ * @param pioconn [INOUT] the connection to read from.
+ *
+ * @return 0 if the connection is still usable, -1 if it has to be closed.
+ *
+ */
+static int _9p_io_read( _9p_io_conn_t * pioconn )
 {
-  long int tcp_sock = (long int)Arg;
-  int rc = -1 ;
-  struct pollfd fds[1] ;
-  int fdcount = 1 ;
-  static char my_name[MAXNAMLEN];
-  struct sockaddr_in addrpeer ;
-  socklen_t addrpeerlen = sizeof( addrpeer ) ;
-  char strcaller[MAXNAMLEN] ;
-  request_data_t *preq = NULL;
-  unsigned int worker_index;
+  request_data_t * preq ;
+  unsigned int nb_msg = 0 ;
+  ssize_t readlen ;
+  u32 msglen ;
+  u32 toread ;
 
-  char * _9pmsg ;
-  uint32_t * p_9pmsglen = NULL ;
+  while( nb_msg < _9P_IO_BATCH )
+   {
+     if( pioconn->preq == NULL )
+      {
+        /* choose a worker depending on its queue length */
+        pioconn->worker_index = nfs_core_select_worker_queue();
 
-  _9p_conn_t _9p_conn ;
+        /* Get a preq from the worker's pool */
+        P(workers_data[pioconn->worker_index].request_pool_mutex);
 
-  int readlen = 0  ;
+        GetFromPool(pioconn->preq, &workers_data[pioconn->worker_index].request_pool,
+                    request_data_t);
 
-  printf( "Je gre la socket %ld\n", tcp_sock );
+        V(workers_data[pioconn->worker_index].request_pool_mutex);
 
-  snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
-  SetNameFunction(my_name);
+        if( pioconn->preq == NULL )
+         {
+           LogMajor(COMPONENT_DISPATCH,
+                    "Empty request pool for the chosen worker ! Exiting...");
+           Fatal();
+         }
 
-  /* Init the _9p_conn_t structure */
-  _9p_conn.sockfd = tcp_sock ;
- 
-  if( gettimeofday( &_9p_conn.birth, NULL ) == -1 )
-   LogFatal( COMPONENT_9P, "Can get connection's time of birth" ) ;
+        /* Prepare to read the message */
+        pioconn->preq->rtype = _9P_REQUEST ;
+        pioconn->preq->rcontent._9p.pconn = pioconn->pconn ;
+        pioconn->received = 0 ;
+      }
 
-#ifndef _NO_BUDDY_SYSTEM
-  if((rc = BuddyInit(&nfs_param.buddy_param_tcp_mgr)) != BUDDY_SUCCESS)
-    {
-      /* Failed init */
-      #ifdef _DEBUG_MEMLEAKS
+     preq = pioconn->preq ;
+
+     /* An incoming 9P request: the msg has a 4 bytes header showing the size of the msg including the header */
+     if( pioconn->received < _9P_HDR_SIZE )
+       toread = _9P_HDR_SIZE - pioconn->received ;
+     else
+       toread = *((u32 *)preq->rcontent._9p._9pmsg) - pioconn->received ;
+
+     /* The socket stays blocking for the workers sending the replies, only this read must not wait */
+     readlen = recv( pioconn->pconn->sockfd,
+                     preq->rcontent._9p._9pmsg + pioconn->received,
+                     toread, MSG_DONTWAIT ) ;
+
+     if( readlen < 0 )
+      {
+        if( errno == EINTR )
+          continue ;
+
+        if( errno == EAGAIN || errno == EWOULDBLOCK )
+          return 0 ;
+
+        LogEvent( COMPONENT_9P, "Got error %u (%s) on socket %ld connected to %s",
+                  errno, strerror( errno ), pioconn->pconn->sockfd, pioconn->strcaller ) ;
+        return -1 ;
+      }
+
+     if( readlen == 0 )
       {
-        FILE *output = fopen("/tmp/buddymem", "w");
-        if (output != NULL)
-          BuddyDumpAll(output);
+        LogEvent( COMPONENT_9P, "Client %s on socket %ld has shut down",
+                  pioconn->strcaller, pioconn->pconn->sockfd ) ;
+        return -1 ;
       }
-      #endif
-      LogFatal(COMPONENT_DISPATCH, "Memory manager could not be initialized");
-    }
+
+     pioconn->received += readlen ;
+
+     if( pioconn->received < _9P_HDR_SIZE )
+       continue ;
+
+     msglen = *((u32 *)preq->rcontent._9p._9pmsg) ;
+
+     if( pioconn->received == _9P_HDR_SIZE )
+      {
+        LogFullDebug( COMPONENT_9P,
+                      "Received message of size %u from client %s on socket %ld",
+                      msglen, pioconn->strcaller, pioconn->pconn->sockfd ) ;
+
+        /* The stream can't be resynchronized after a bad header, give up the connection */
+        if( ( msglen < _9P_HDR_SIZE + _9P_TYPE_SIZE + _9P_TAG_SIZE ) || ( msglen > _9P_MSG_SIZE ) )
+         {
+           LogEvent( COMPONENT_9P,
+                     "Badly formed 9P message: bad size %u for client %s on socket %ld",
+                     msglen, pioconn->strcaller, pioconn->pconn->sockfd ) ;
+           return -1 ;
+         }
+      }
+
+     if( pioconn->received < msglen )
+       continue ;
+
+     /* Message is OK, push the request to the chosen worker */
+     atomic_inc_uint32_t( &pioconn->pconn->refcount ) ;
+     DispatchWork9P( preq, pioconn->worker_index ) ;
+
+     pioconn->preq = NULL ;
+     nb_msg += 1 ;
+   }
+
+  /* Other messages are left for the next round, the connection is still readable */
+  return 0 ;
+} /* _9p_io_read */
+
+/**
+ * _9p_io_close: stops serving a connection.
+ *
+ * @param pthr    [INOUT] the I/O thread serving the connection.
+ * @param pioconn [INOUT] the connection, freed on return.
+ *
+ * @return nothing (void function).
+ *
+ */
+static void _9p_io_close( _9p_io_thread_t * pthr, _9p_io_conn_t * pioconn )
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  /* ev is ignored but must be non NULL on old kernels */
+  if( epoll_ctl( pthr->epoll_fd, EPOLL_CTL_DEL, pioconn->pconn->sockfd, &ev ) != 0 )
+    LogCrit( COMPONENT_9P, "epoll_ctl(DEL) failed for socket %ld, errno=%u (%s)",
+             pioconn->pconn->sockfd, errno, strerror( errno ) ) ;
+#else
+  unsigned int i ;
+
+  P( pthr->lock ) ;
+  for( i = 0 ; i < pthr->nb_conns ; i++ )
+    if( pthr->conns[i] == pioconn )
+     {
+       pthr->conns[i] = pthr->conns[--pthr->nb_conns] ;
+       break ;
+     }
+  V( pthr->lock ) ;
 #endif
 
-  if( ( rc =  getpeername( tcp_sock, (struct sockaddr *)&addrpeer, &addrpeerlen) ) == -1 )
+  /* Release a partially received message */
+  if( pioconn->preq != NULL )
    {
-      LogMajor(COMPONENT_9P,
-               "Cannot get peername to tcp socket for 9p, error %d (%s)", errno, strerror(errno));
-      strncpy( strcaller, "(unresolved)", MAXNAMLEN ) ;
+     P(workers_data[pioconn->worker_index].request_pool_mutex);
+     ReleaseToPool(pioconn->preq, &workers_data[pioconn->worker_index].request_pool);
+     workers_data[pioconn->worker_index].passcounter += 1;
+     V(workers_data[pioconn->worker_index].request_pool_mutex);
    }
-  else
-   {
-     snprintf(strcaller, MAXNAMLEN, "0x%x=%d.%d.%d.%d",
-              ntohl(addrpeer.sin_addr.s_addr),
-             (ntohl(addrpeer.sin_addr.s_addr) & 0xFF000000) >> 24,
-             (ntohl(addrpeer.sin_addr.s_addr) & 0x00FF0000) >> 16,
-             (ntohl(addrpeer.sin_addr.s_addr) & 0x0000FF00) >> 8,
-             (ntohl(addrpeer.sin_addr.s_addr) & 0x000000FF));
 
-     LogEvent( COMPONENT_9P, "9p socket #%ld is connected to %s", tcp_sock, strcaller ) ; 
-   }
+  _9p_conn_release( pioconn->pconn ) ;
+  Mem_Free( pioconn ) ;
+} /* _9p_io_close */
 
-  /* Set up the structure used by poll */
-  memset( (char *)fds, 0, sizeof( struct pollfd ) ) ;
-  fds[0].fd = tcp_sock ;
-  fds[0].events = POLLIN|POLLPRI| POLLRDBAND|POLLRDNORM|POLLRDHUP|POLLHUP|POLLERR|POLLNVAL;
+/**
+ * _9p_io_thread: 9p I/O thread.
+ *
+ * This function is the main loop for a 9p I/O thread. A fixed number of such threads serve all the
+ * connections, each of them waiting for the messages of its own set of connections.
+ *
+ * @param Arg the I/O thread's _9p_io_thread_t, cast as a void * in pthread_create
+ *
+ * @return NULL
+ *
+ */
+static void * _9p_io_thread( void * Arg )
+{
+  _9p_io_thread_t * pthr = (_9p_io_thread_t *)Arg ;
+  _9p_io_conn_t * pioconn ;
+  char thr_name[32] ;
+  int nb, i ;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event events[_9P_IO_EVENTS] ;
+#else
+  struct pollfd fds[_9P_IO_MAX_CONN] ;
+  _9p_io_conn_t * conns[_9P_IO_MAX_CONN] ;
+  unsigned int nb_conns ;
+#endif
+
+  snprintf( thr_name, sizeof( thr_name ), "9p_io_thr#%u", pthr->index ) ;
+  SetNameFunction( thr_name ) ;
 
+#ifndef _NO_BUDDY_SYSTEM
+  if( BuddyInit( &nfs_param.buddy_param_tcp_mgr ) != BUDDY_SUCCESS )
+    LogFatal( COMPONENT_DISPATCH, "Memory manager could not be initialized" ) ;
+#endif
 
   for( ;; ) /* Infinite loop */
    {
-    
-     if( ( rc = poll( fds, fdcount, -1 ) ) == -1 ) /* timeout = -1 =>Wait indefinitely for incoming events */
+#ifdef HAVE_SYS_EPOLL_H
+     /* Level triggered, a connection left with pending messages is notified again */
+     if( ( nb = epoll_wait( pthr->epoll_fd, events, _9P_IO_EVENTS, -1 ) ) == -1 )
+#else
+     /* Work on a copy of the connection set, the timeout lets new connections in */
+     P( pthr->lock ) ;
+     nb_conns = pthr->nb_conns ;
+     for( i = 0 ; i < nb_conns ; i++ )
       {
-         /* Interruption if not an issue */
-         if( errno == EINTR )
-           continue ;
-
-         LogCrit( COMPONENT_9P,
-                  "Got error %u (%s) on fd %ld connect to %s while polling on socket", 
-                  errno, strerror( errno ), tcp_sock, strcaller ) ;
+        conns[i] = pthr->conns[i] ;
+        fds[i].fd = conns[i]->pconn->sockfd ;
+        fds[i].events = POLLIN ;
+        fds[i].revents = 0 ;
+      }
+     V( pthr->lock ) ;
 
+     if( ( nb = poll( fds, nb_conns, 100 ) ) == -1 )
+#endif
+      {
+        /* Interruption if not an issue */
+        if( errno != EINTR )
+          LogCrit( COMPONENT_9P, "Got error %u (%s) while waiting for 9p messages",
+                   errno, strerror( errno ) ) ;
+        continue ;
       }
 
-     if( fds[0].revents & POLLNVAL )
+#ifdef HAVE_SYS_EPOLL_H
+     for( i = 0 ; i < nb ; i++ )
       {
-        LogEvent( COMPONENT_9P, "Client %s on socket %lu produced POLLNVAL", strcaller, tcp_sock ) ;
-                  close( tcp_sock );
-        return NULL ;
+        pioconn = (_9p_io_conn_t *)events[i].data.ptr ;
+
+        if( _9p_io_read( pioconn ) != 0 )
+          _9p_io_close( pthr, pioconn ) ;
       }
+#else
+     for( i = 0 ; i < nb_conns && nb > 0 ; i++ )
+      {
+        if( fds[i].revents == 0 )
+          continue ;
 
-     if( fds[0].revents & (POLLERR|POLLHUP|POLLRDHUP) )
+        nb -= 1 ;
+        pioconn = conns[i] ;
+
+        if( ( fds[i].revents & POLLNVAL ) || _9p_io_read( pioconn ) != 0 )
+          _9p_io_close( pthr, pioconn ) ;
+      }
+#endif
+   } /* for( ;; ) */
+
+  return NULL ;
+} /* _9p_io_thread */
+
+/**
+ * _9p_io_start: starts the 9p I/O threads.
+ *
+ * @param nb_threads [IN] number of I/O threads.
+ *
+ * @return 0 if ok, -1 otherwise.
+ *
+ */
+static int _9p_io_start( unsigned int nb_threads )
+{
+  pthread_attr_t attr_thr;
+  unsigned int i ;
+  int rc ;
+
+  if( nb_threads == 0 )
+    nb_threads = 1 ;
+
+  if( ( _9p_io_threads = (_9p_io_thread_t *)Mem_Alloc( nb_threads * sizeof( _9p_io_thread_t ) ) ) == NULL )
+    return -1 ;
+
+  memset( _9p_io_threads, 0, nb_threads * sizeof( _9p_io_thread_t ) ) ;
+
+  /* Init for thread parameter (mostly for scheduling) */
+  if(pthread_attr_init(&attr_thr) != 0)
+    LogDebug(COMPONENT_9P_DISPATCH, "can't init pthread's attributes");
+
+  if(pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM) != 0)
+    LogDebug(COMPONENT_9P_DISPATCH, "can't set pthread's scope");
+
+  if(pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_JOINABLE) != 0)
+    LogDebug(COMPONENT_9P_DISPATCH, "can't set pthread's join state");
+
+  if(pthread_attr_setstacksize(&attr_thr, THREAD_STACK_SIZE) != 0)
+    LogDebug(COMPONENT_9P_DISPATCH, "can't set pthread's stack size");
+
+  for( i = 0 ; i < nb_threads ; i++ )
+   {
+     _9p_io_threads[i].index = i ;
+
+#ifdef HAVE_SYS_EPOLL_H
+     if( ( _9p_io_threads[i].epoll_fd = epoll_create( _9P_IO_EVENTS ) ) < 0 )
       {
-        LogEvent( COMPONENT_9P, "Client %s on socket %lu has shut down and closed", strcaller, tcp_sock ) ;
-                  close( tcp_sock );
-        return NULL ;
+        LogCrit( COMPONENT_9P_DISPATCH, "epoll_create failed, errno=%u (%s)",
+                 errno, strerror( errno ) ) ;
+        return -1 ;
       }
+     fcntl( _9p_io_threads[i].epoll_fd, F_SETFD, FD_CLOEXEC ) ;
+#else
+     pthread_mutex_init( &_9p_io_threads[i].lock, NULL ) ;
+#endif
 
-     if( fds[0].revents & (POLLIN|POLLRDNORM) )
+     if( ( rc = pthread_create( &_9p_io_threads[i].thrid, &attr_thr,
+                                _9p_io_thread, &_9p_io_threads[i] ) ) != 0 )
       {
-        /* choose a worker depending on its queue length */
-        worker_index = nfs_core_select_worker_queue();
+        LogCrit( COMPONENT_THREAD,
+                 "Could not create 9p I/O thread, error = %d (%s)",
+                 rc, strerror( rc ) ) ;
+        return -1 ;
+      }
 
-        /* Get a preq from the worker's pool */
-        P(workers_data[worker_index].request_pool_mutex);
+     /* Connections are only given to started threads */
+     _9p_nb_io_threads = i + 1 ;
+   }
 
-        GetFromPool(preq, &workers_data[worker_index].request_pool,
-                    request_data_t);
+  LogEvent( COMPONENT_9P_DISPATCH, "%u 9P I/O threads started", _9p_nb_io_threads ) ;
 
-        V(workers_data[worker_index].request_pool_mutex);
+  return 0 ;
+} /* _9p_io_start */
 
-        /* Prepare to read the message */
-        preq->rtype = _9P_REQUEST ;
-        _9pmsg = preq->rcontent._9p._9pmsg ;
-        preq->rcontent._9p.pconn = &_9p_conn ;
+/**
+ * _9p_io_new_conn: hands a new connection to one of the I/O threads.
+ *
+ * @param sock [IN] the connected socket.
+ *
+ * @return 0 if ok, -1 otherwise (the caller keeps the socket).
+ *
+ */
+static int _9p_io_new_conn( long int sock )
+{
+  static unsigned int next_thread = 0 ;
+  _9p_io_thread_t * pthr ;
+  _9p_io_conn_t * pioconn ;
+  _9p_conn_t * pconn ;
+  struct sockaddr_in addrpeer ;
+  socklen_t addrpeerlen = sizeof( addrpeer ) ;
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev ;
+#endif
 
-        /* An incoming 9P request: the msg has a 4 bytes header showing the size of the msg including the header */
-        if( (readlen = recv( fds[0].fd, _9pmsg ,_9P_HDR_SIZE, 0) == _9P_HDR_SIZE ) )
-         {
-	    p_9pmsglen = (uint32_t *)_9pmsg ;
-
-            LogFullDebug( COMPONENT_9P,
-                          "Received message of size %u from client %s on socket %lu",
-			   *p_9pmsglen, strcaller, tcp_sock ) ;
-
-	     if( ( *p_9pmsglen < _9P_HDR_SIZE ) ||
-		 ( readlen = recv( fds[0].fd,
-				   (char *)(_9pmsg + _9P_HDR_SIZE),  
-                                   *p_9pmsglen - _9P_HDR_SIZE, 0 ) ) !=  ( *p_9pmsglen - _9P_HDR_SIZE ) )
-                 
-             {
-		LogEvent( COMPONENT_9P, 
-			  "Badly formed 9P message: Header is too small for client %s on socket %lu: readlen=%u expected=%u", 
-                          strcaller, tcp_sock, readlen, *p_9pmsglen - _9P_HDR_SIZE ) ;
-
-                /* Release the entry */
-                P(workers_data[worker_index].request_pool_mutex);
-                ReleaseToPool(preq, &workers_data[worker_index].request_pool);
-  		workers_data[worker_index].passcounter += 1;
-                V(workers_data[worker_index].request_pool_mutex);
-
-                continue ;
-             }
-	    else
-             {
-		/* Message os OK push it the request to the right worker */
-                DispatchWork9P(preq, worker_index);
-             }
-         }
-        else if( readlen == 0 )
-         {
-           LogEvent( COMPONENT_9P, "Client %s on socket %lu has shut down", strcaller, tcp_sock ) ;
-           close( tcp_sock );
-           return NULL ;
-         }
-        else
-         {
-	   LogEvent( COMPONENT_9P, "Badly formed 9P header for client %s on socket %lu", strcaller, tcp_sock ) ;
-           continue ;
-         }
-      }
-   } /* for( ;; ) */
- 
-  return NULL ;
-} /* _9p_socket_thread */
+  if( ( pconn = (_9p_conn_t *)Mem_Alloc( sizeof( _9p_conn_t ) ) ) == NULL )
+    return -1 ;
+
+  if( ( pioconn = (_9p_io_conn_t *)Mem_Alloc( sizeof( _9p_io_conn_t ) ) ) == NULL )
+   {
+     Mem_Free( pconn ) ;
+     return -1 ;
+   }
+
+  /* Init the _9p_conn_t structure */
+  memset( pconn, 0, sizeof( _9p_conn_t ) ) ;
+  pconn->sockfd = sock ;
+  pconn->refcount = 1 ;
+
+  if( gettimeofday( &pconn->birth, NULL ) == -1 )
+   LogFatal( COMPONENT_9P, "Can get connection's time of birth" ) ;
+
+  memset( pioconn, 0, sizeof( _9p_io_conn_t ) ) ;
+  pioconn->pconn = pconn ;
+
+  if( getpeername( sock, (struct sockaddr *)&addrpeer, &addrpeerlen) == -1 )
+   {
+      LogMajor(COMPONENT_9P,
+               "Cannot get peername to tcp socket for 9p, error %d (%s)", errno, strerror(errno));
+      strncpy( pioconn->strcaller, "(unresolved)", MAXNAMLEN ) ;
+   }
+  else
+   {
+     snprintf(pioconn->strcaller, MAXNAMLEN, "0x%x=%d.%d.%d.%d",
+              ntohl(addrpeer.sin_addr.s_addr),
+             (ntohl(addrpeer.sin_addr.s_addr) & 0xFF000000) >> 24,
+             (ntohl(addrpeer.sin_addr.s_addr) & 0x00FF0000) >> 16,
+             (ntohl(addrpeer.sin_addr.s_addr) & 0x0000FF00) >> 8,
+             (ntohl(addrpeer.sin_addr.s_addr) & 0x000000FF));
+
+     LogEvent( COMPONENT_9P, "9p socket #%ld is connected to %s", sock, pioconn->strcaller ) ;
+   }
+
+  /* Only the 9P dispatcher thread hands connections, round robin is enough */
+  pthr = &_9p_io_threads[next_thread] ;
+  next_thread = ( next_thread + 1 ) % _9p_nb_io_threads ;
+
+#ifdef HAVE_SYS_EPOLL_H
+  memset( &ev, 0, sizeof( ev ) ) ;
+  ev.events = EPOLLIN ;
+  ev.data.ptr = pioconn ;
+
+  if( epoll_ctl( pthr->epoll_fd, EPOLL_CTL_ADD, sock, &ev ) != 0 )
+   {
+     LogCrit( COMPONENT_9P_DISPATCH, "epoll_ctl(ADD) failed for socket %ld, errno=%u (%s)",
+              sock, errno, strerror( errno ) ) ;
+     Mem_Free( pioconn ) ;
+     Mem_Free( pconn ) ;
+     return -1 ;
+   }
+#else
+  P( pthr->lock ) ;
+  if( pthr->nb_conns == _9P_IO_MAX_CONN )
+   {
+     V( pthr->lock ) ;
+     LogCrit( COMPONENT_9P_DISPATCH, "Too many 9p connections, refusing client %s",
+              pioconn->strcaller ) ;
+     Mem_Free( pioconn ) ;
+     Mem_Free( pconn ) ;
+     return -1 ;
+   }
+  pthr->conns[pthr->nb_conns++] = pioconn ;
+  V( pthr->lock ) ;
+#endif
+
+  LogDebug( COMPONENT_9P_DISPATCH, "9p socket #%ld is served by I/O thread #%u",
+            sock, pthr->index ) ;
+
+  return 0 ;
+} /* _9p_io_new_conn */
 
 /**
  * _9p_create_socket: create the accept socket for 9P 
@@ -397,6 +665,7 @@ int _9p_create_socket( void )
  * _9p_dispatcher_svc_run: main loop for 9p dispatcher
  *
  * This function is the main loop for the 9p dispatcher. It never returns because it is an infinite loop.
+ * It accepts the connections and hands them to the 9p I/O threads, that read the messages.
  *
  * @param sock accept socket for 9p dispatch
  *
@@ -405,46 +674,33 @@ int _9p_create_socket( void )
  */
 void _9p_dispatcher_svc_run( long int sock )
 {
-  int rc = 0;
   struct sockaddr_in addr;
   socklen_t addrlen = sizeof( addr ) ;
   long int newsock = -1 ;
-  pthread_attr_t attr_thr;
-  pthread_t tcp_thrid ;
 
 #ifdef _DEBUG_MEMLEAKS
   static int nb_iter_memleaks = 0;
 #endif
 
-  /* Init for thread parameter (mostly for scheduling) */
-  if(pthread_attr_init(&attr_thr) != 0)
-    LogDebug(COMPONENT_9P_DISPATCH, "can't init pthread's attributes");
-
-  if(pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM) != 0)
-    LogDebug(COMPONENT_9P_DISPATCH, "can't set pthread's scope");
-
-  if(pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_JOINABLE) != 0)
-    LogDebug(COMPONENT_9P_DISPATCH, "can't set pthread's join state");
-
-  if(pthread_attr_setstacksize(&attr_thr, THREAD_STACK_SIZE) != 0)
-    LogDebug(COMPONENT_9P_DISPATCH, "can't set pthread's stack size");
-
+  /* A fixed pool of threads serves all the connections */
+  if( _9p_io_start( nfs_param._9p_param.nb_io_threads ) != 0 )
+    LogFatal( COMPONENT_9P_DISPATCH, "Could not start the 9p I/O threads" ) ;
 
   LogEvent( COMPONENT_9P_DISPATCH, "9P dispatcher started" ) ;
   while(TRUE)
     {
+      addrlen = sizeof( addr ) ;
       if( ( newsock = accept( sock, (struct sockaddr *)&addr, &addrlen ) ) < 0 )
        {
-	 LogCrit( COMPONENT_9P_DISPATCH, "accept failed" ) ;
+         if( errno != EINTR )
+           LogCrit( COMPONENT_9P_DISPATCH, "accept failed" ) ;
 	 continue ; 
        }
 
-      /* Starting the thread dedicated to signal handling */
-      if( ( rc = pthread_create( &tcp_thrid, &attr_thr, _9p_socket_thread, (void *)newsock ) ) != 0 )
+      if( _9p_io_new_conn( newsock ) != 0 )
        {
-         LogFatal(COMPONENT_THREAD,
-                  "Could not create 9p socket manager thread, error = %d (%s)",
-                  errno, strerror(errno));
+         LogCrit( COMPONENT_9P_DISPATCH, "Could not serve 9p socket #%ld, closing it", newsock ) ;
+         close( newsock ) ;
        }
 
 #ifdef _DEBUG_MEMLEAKS
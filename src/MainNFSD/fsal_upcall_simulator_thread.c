@@ -76,40 +76,43 @@
 
 nfs_worker_data_t mydata ;
 
-static cache_entry_t * choose_pentry( hash_table_t * ht)
+/* The 10th entry met is the one chosen */
+typedef struct choose_pentry_arg__
 {
-  struct rbt_node *it;
-  struct rbt_head *tete_rbt;
-  cache_entry_t * pentry = NULL ;
-  unsigned int i = 0;
-  hash_data_t *pdata = NULL;
+  unsigned int counter ;
+  cache_entry_t * pentry ;
+} choose_pentry_arg_t ;
+
+static int choose_pentry_walk( hash_data_t * pdata, void * arg )
+{
+  choose_pentry_arg_t * pchoice = (choose_pentry_arg_t *)arg ;
+
+  pchoice->counter += 1 ;
+
+  /* No file invalidation for the moment (file can handle state) */
+  if( pchoice->counter >= 10 )
+   {
+     pchoice->pentry = (cache_entry_t *) (pdata->buffval.pdata) ;
+     return FALSE ;
+   }
 
+  return TRUE ;
+} /* choose_pentry_walk */
 
-  unsigned int counter = 0 ;
+static cache_entry_t * choose_pentry( hash_table_t * ht)
+{
+  choose_pentry_arg_t choice ;
 
   /* Sanity check */
   if(ht == NULL)
     return NULL ;
 
-  for(i = 0; i < ht->parameter.index_size; i++)
-    {
-      
-
-      tete_rbt = &((ht->array_rbt)[i]);
-      RBT_LOOP(tete_rbt, it)
-      {
-        counter += 1 ;
-        pdata = (hash_data_t *) it->rbt_opaq;
-        pentry = (cache_entry_t *) (pdata->buffval.pdata) ;
+  choice.counter = 0 ;
+  choice.pentry = NULL ;
 
-        /* No file invalidation for the moment (file can handle state) */
-        if( counter >= 10 ) 
-         return pentry ;
+  HashTable_Walk( ht, 0, choose_pentry_walk, &choice ) ;
 
-        RBT_INCREMENT(it);
-      }
-    }
-  return NULL ;
+  return choice.pentry ;
 } /* choose_pentry */
 
 
@@ -150,9 +150,13 @@ static int ChangeoverExports()
       pcurrent = nfs_param.pexportlist->next;
     }
 
-  /* Allocate memory if needed, could have started with NULL exports */
+  /* Allocate memory if needed, could have started with NULL exports.
+   * Otherwise drop the compiled client list of the old head, and the
+   * access decisions cached with it. */
   if (nfs_param.pexportlist == NULL)
     nfs_param.pexportlist = (exportlist_t *) Mem_Alloc(sizeof(exportlist_t));
+  else
+    export_client_index_free(&nfs_param.pexportlist->clients);
 
   if (nfs_param.pexportlist == NULL)
     return Mem_Errno;
@@ -0,0 +1,123 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * nfs_cache_inode_gc_thread.c : reclaims cache_inode entries in the background.
+ *
+ * The workers never garbage collect the cache_inode layer: the reclaimer
+ * threads wait for the cache to cross its high water mark (in entries or in
+ * memory), then remove entries a short step at a time, pausing between the
+ * steps, until the low water mark is reached.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <pthread.h>
+#include <unistd.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "cache_inode.h"
+#include "nfs_core.h"
+
+void *cache_inode_gc_thread(void *IndexArg)
+{
+  unsigned long gc_index = (unsigned long)IndexArg;
+  cache_inode_client_t gc_client;
+  cache_inode_gc_policy_t gcpol;
+  hash_table_t *ht = workers_data[0].ht;
+  unsigned int nb_reclaimed;
+  unsigned int interval;
+  int exhausted;
+  int rc;
+  cache_inode_status_t cache_status;
+  char thr_name[32];
+
+  snprintf(thr_name, sizeof(thr_name), "Cache Inode GC #%lu", gc_index);
+  SetNameFunction(thr_name);
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(&nfs_param.buddy_param_worker) != BUDDY_SUCCESS)
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_CACHE_INODE_GC,
+               "Memory manager could not be initialized");
+    }
+  LogInfo(COMPONENT_CACHE_INODE_GC, "Memory manager successfully initialized");
+#endif
+
+  /* The entries reclaimed are released to the pools of this client first */
+  if(cache_inode_client_init(&gc_client,
+                             &(nfs_param.cache_layers_param.cache_inode_client_param),
+                             SMALL_CLIENT_INDEX, NULL))
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_CACHE_INODE_GC,
+               "Cache Inode client could not be initialized");
+    }
+
+  LogInfo(COMPONENT_CACHE_INODE_GC, "%s successfully initialized", thr_name);
+
+  while(1)
+    {
+      gcpol = cache_inode_get_gc_policy();
+      interval = (gcpol.run_interval > 0) ? gcpol.run_interval : 1;
+
+      /* Sleep until the cache is too large, or it is time to check the memory */
+      rc = cache_inode_gc_wait_pressure(interval);
+
+      /* The fds kept open too long are closed whatever the pressure */
+      cache_inode_gc_fd(&gc_client, &cache_status);
+
+      if(!rc)
+        continue;
+
+      nb_reclaimed = cache_inode_gc_reclaim(ht, &gc_client,
+                                            gcpol.reclaim_step_duration, &exhausted);
+
+      /* What was reclaimed is for the workers to reuse */
+      if(nb_reclaimed > 0)
+        cache_inode_gc_give_back(&gc_client);
+
+      LogFullDebug(COMPONENT_CACHE_INODE_GC,
+                   "%u entries reclaimed", nb_reclaimed);
+
+      if(exhausted)
+        {
+          /* Nothing more can be reclaimed now, entries have to expire first */
+          LogDebug(COMPONENT_CACHE_INODE_GC,
+                   "No reclaimable entry left, waiting %u s", interval);
+          sleep(interval);
+        }
+      else
+        {
+          /* Leave the entries to the workers as long as the step lasted */
+          usleep(gcpol.reclaim_step_duration * 1000);
+        }
+    }
+
+  return NULL;
+}                               /* cache_inode_gc_thread */
@@ -0,0 +1,85 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * nfs_deleg_recall_thread.c : sends the callbacks of the delegations.
+ *
+ * The CB_NULL checking the callback of a confirmed client and the CB_RECALL
+ * of the delegations in conflict are queued by the workers, which answer
+ * NFS4ERR_DELAY meanwhile. This thread sends them, and revokes the
+ * delegations not returned within a lease of their recall.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <pthread.h>
+#include <unistd.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "cache_inode.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+
+/* Longest wait for a callback to send, the recalls are checked for timeout meanwhile */
+#define DELEG_RECALL_WAIT 1
+
+void *state_deleg_recall_thread(void *IndexArg)
+{
+  unsigned long recall_index = (unsigned long)IndexArg;
+  cache_inode_client_t recall_client;
+  char thr_name[32];
+
+  snprintf(thr_name, sizeof(thr_name), "Deleg Recall #%lu", recall_index);
+  SetNameFunction(thr_name);
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(&nfs_param.buddy_param_worker) != BUDDY_SUCCESS)
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_STATE,
+               "Memory manager could not be initialized");
+    }
+  LogInfo(COMPONENT_STATE, "Memory manager successfully initialized");
+#endif
+
+  /* The delegations revoked are deleted with this client */
+  if(cache_inode_client_init(&recall_client,
+                             &(nfs_param.cache_layers_param.cache_inode_client_param),
+                             SMALL_CLIENT_INDEX, NULL))
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_STATE,
+               "Cache Inode client could not be initialized");
+    }
+
+  LogInfo(COMPONENT_STATE, "%s successfully initialized", thr_name);
+
+  while(1)
+    state_deleg_recall_run(&recall_client, DELEG_RECALL_WAIT);
+
+  return NULL;
+}                               /* state_deleg_recall_thread */
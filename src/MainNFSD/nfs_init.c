@@ -96,13 +96,18 @@ pthread_t worker_thrid[NB_MAX_WORKER_THREAD];
 pthread_t flusher_thrid[NB_MAX_FLUSHER_THREAD];
 nfs_flush_thread_data_t flush_info[NB_MAX_FLUSHER_THREAD];
 
-pthread_t rpc_dispatcher_thrid;
+pthread_t rpc_dispatcher_thrid[NB_MAX_DISPATCHER_THREAD];
 pthread_t stat_thrid;
 pthread_t stat_exporter_thrid;
 pthread_t admin_thrid;
 pthread_t fcc_gc_thrid;
 pthread_t sigmgr_thrid;
 pthread_t reaper_thrid;
+pthread_t idmapper_refresh_thrid;
+pthread_t uid2grp_refresh_thrid;
+pthread_t cache_inode_gc_thrid[NB_MAX_CACHE_INODE_GC_THREAD];
+pthread_t write_behind_thrid[NB_MAX_WRITE_BEHIND_THREAD];
+pthread_t deleg_recall_thrid[NB_MAX_DELEG_RECALL_THREAD];
 nfs_tcb_t gccb;
 
 #ifdef _USE_9P
@@ -149,6 +154,9 @@ void *sigmgr_thread( void * arg )
           LogEvent(COMPONENT_MAIN,
                    "SIGHUP_HANDLER: Received SIGHUP.... initiating export list reload");
           admin_replace_exports();
+
+          /* Let the log files be rotated */
+          LogAsync_Reopen();
         }
     }
 
@@ -184,6 +192,9 @@ void *sigmgr_thread( void * arg )
    * the daemon is stopping anyway */
   unlink( pidfile_path ) ;
 
+  /* Flush the log, what comes next is written synchronously */
+  LogAsync_Stop();
+
   /* Might as well exit - no need for this thread any more */
   return NULL;
 }                    /* sigmgr_thread */
@@ -241,8 +252,9 @@ void nfs_print_param_config()
   printf("\tNFS_Program = %u ;\n", nfs_param.core_param.program[P_NFS]);
   printf("\tMNT_Program = %u ;\n", nfs_param.core_param.program[P_NFS]);
   printf("\tNb_Worker = %u ; \n", nfs_param.core_param.nb_worker);
-  printf("\tb_Call_Before_Queue_Avg = %u ; \n", nfs_param.core_param.nb_call_before_queue_avg);
+  printf("\tNb_Dispatcher = %u ; \n", nfs_param.core_param.nb_dispatcher);
   printf("\tNb_MaxConcurrentGC = %u ; \n", nfs_param.core_param.nb_max_concurrent_gc);
+  printf("\tNb_Write_Behind_Thread = %u ; \n", nfs_param.core_param.nb_write_behind_thread);
   printf("\tDupReq_Expiration = %lu ; \n", nfs_param.core_param.expiration_dupreq);
   printf("\tCore_Dump_Size = %ld ; \n", nfs_param.core_param.core_dump_size);
   printf("\tNb_Max_Fd = %d ; \n", nfs_param.core_param.nb_max_fd);
@@ -273,6 +285,15 @@ void nfs_print_param_config()
   else
     printf("\tDrop_Delay_Errors = FALSE ;\n");
 
+  if(nfs_param.core_param.log_async)
+    printf("\tLog_Async = TRUE ; \n");
+  else
+    printf("\tLog_Async = FALSE ;\n");
+
+  printf("\tLog_Async_Ring_Size = %u ;\n", nfs_param.core_param.log_async_ring_size);
+  printf("\tNb_Read_Buffers = %u ;\n", nfs_param.core_param.nb_read_buffers);
+  printf("\tRead_Buffer_Size = %u ;\n", nfs_param.core_param.read_buffer_size);
+
   printf("}\n\n");
 
   printf("NFS_Worker_Param\n{\n");
@@ -293,8 +314,9 @@ void nfs_set_param_default()
 
   /* Core parameters */
   nfs_param.core_param.nb_worker = NB_WORKER_THREAD_DEFAULT;
-  nfs_param.core_param.nb_call_before_queue_avg = NB_REQUEST_BEFORE_QUEUE_AVG;
+  nfs_param.core_param.nb_dispatcher = NB_DISPATCHER_THREAD_DEFAULT;
   nfs_param.core_param.nb_max_concurrent_gc = NB_MAX_CONCURRENT_GC;
+  nfs_param.core_param.nb_write_behind_thread = NB_WRITE_BEHIND_THREAD_DEFAULT;
   nfs_param.core_param.expiration_dupreq = DUPREQ_EXPIRATION;
   nfs_param.core_param.port[P_NFS] = NFS_PORT;
   nfs_param.core_param.port[P_MNT] = 0;
@@ -309,6 +331,7 @@ void nfs_set_param_default()
 #endif
 #ifdef _USE_9P
   nfs_param._9p_param._9p_port = _9P_PORT ;
+  nfs_param._9p_param.nb_io_threads = _9P_NB_IO_THREADS ;
 #endif
 #ifdef _USE_RQUOTA
   nfs_param.core_param.program[P_RQUOTA] = RQUOTAPROG;
@@ -317,6 +340,8 @@ void nfs_set_param_default()
   nfs_param.core_param.drop_io_errors = TRUE;
   nfs_param.core_param.drop_inval_errors = FALSE;
   nfs_param.core_param.drop_delay_errors = TRUE;
+  nfs_param.core_param.log_async = FALSE;
+  nfs_param.core_param.log_async_ring_size = LOG_ASYNC_RING_SIZE;
   nfs_param.core_param.core_dump_size = -1;
   nfs_param.core_param.nb_max_fd = -1;       /* Use OS's default */
   nfs_param.core_param.stats_update_delay = 60;
@@ -336,6 +361,8 @@ void nfs_set_param_default()
 
   nfs_param.core_param.max_send_buffer_size = NFS_DEFAULT_SEND_BUFFER_SIZE;
   nfs_param.core_param.max_recv_buffer_size = NFS_DEFAULT_RECV_BUFFER_SIZE;
+  nfs_param.core_param.nb_read_buffers = NFS_NB_READ_BUFFERS_DEFAULT;
+  nfs_param.core_param.read_buffer_size = NFS_READ_BUFFER_SIZE_DEFAULT;
 
 #ifdef _USE_NLM
   nfs_param.core_param.nsm_use_caller_name = FALSE;
@@ -343,24 +370,12 @@ void nfs_set_param_default()
 
   nfs_param.core_param.clustered = FALSE;
 
-  /* Worker parameters : LRU */
-  nfs_param.worker_param.lru_param.nb_entry_prealloc = NB_PREALLOC_LRU_WORKER;
-  nfs_param.worker_param.lru_param.nb_call_gc_invalid = 100;
-  nfs_param.worker_param.lru_param.clean_entry = NULL;// poison so that GC isnt executed
-  nfs_param.worker_param.lru_param.entry_to_str = print_pending_request;
-  nfs_param.worker_param.lru_param.lp_name = "Worker LRU";
-
-  /* Worker parameters : LRU dupreq */
-  nfs_param.worker_param.lru_dupreq.nb_entry_prealloc = NB_PREALLOC_LRU_DUPREQ;
-  nfs_param.worker_param.lru_dupreq.nb_call_gc_invalid = 100;
-  nfs_param.worker_param.lru_dupreq.clean_entry = clean_entry_dupreq;
-  nfs_param.worker_param.lru_dupreq.entry_to_str = print_entry_dupreq;
-  nfs_param.worker_param.lru_dupreq.lp_name = "Worker DupReq LRU";
+  /* Worker parameters : pending requests queue */
+  nfs_param.worker_param.pending_queue_size = NB_PENDING_QUEUE_SIZE;
 
   /* Worker parameters : GC */
   nfs_param.worker_param.nb_pending_prealloc = NB_MAX_PENDING_REQUEST;
   nfs_param.worker_param.nb_before_gc = NB_REQUEST_BEFORE_GC;
-  nfs_param.worker_param.nb_dupreq_prealloc = NB_PREALLOC_HASH_DUPREQ;
 
   /* Workers parameters : IP/Name values pool prealloc */
   nfs_param.worker_param.nb_ip_stats_prealloc = 20;
@@ -390,19 +405,17 @@ void nfs_set_param_default()
   nfs_param.nfsv4_param.fh_expire = FALSE;
   nfs_param.nfsv4_param.returns_err_fh_expired = TRUE;
   nfs_param.nfsv4_param.return_bad_stateid = TRUE;
+  nfs_param.nfsv4_param.nb_max_slots = NFS41_NB_SLOTS_DEF;
+  nfs_param.nfsv4_param.use_delegations = FALSE;
+  nfs_param.nfsv4_param.nb_deleg_recall_thread = NB_DELEG_RECALL_THREAD_DEFAULT;
   strncpy(nfs_param.nfsv4_param.domainname, DEFAULT_DOMAIN, MAXNAMLEN);
   strncpy(nfs_param.nfsv4_param.idmapconf, DEFAULT_IDMAPCONF, MAXPATHLEN);
 
-  /* Worker parameters : dupreq hash table */
-  nfs_param.dupreq_param.hash_param.index_size = PRIME_DUPREQ;
-  nfs_param.dupreq_param.hash_param.alphabet_length = 10;    /* Xid is a numerical decimal value */
-  nfs_param.dupreq_param.hash_param.nb_node_prealloc = NB_PREALLOC_HASH_DUPREQ;
-  nfs_param.dupreq_param.hash_param.hash_func_key = dupreq_value_hash_func;
-  nfs_param.dupreq_param.hash_param.hash_func_rbt = dupreq_rbt_hash_func;
-  nfs_param.dupreq_param.hash_param.compare_key = compare_req;
-  nfs_param.dupreq_param.hash_param.key_to_str = display_req_key;
-  nfs_param.dupreq_param.hash_param.val_to_str = display_req_val;
-  nfs_param.dupreq_param.hash_param.name = "Duplicate Request Cache";
+  /* Worker parameters : duplicate request cache */
+  nfs_param.dupreq_param.nb_shards = PRIME_DUPREQ;
+  nfs_param.dupreq_param.nb_buckets = DUPREQ_BUCKETS_PER_SHARD;
+  nfs_param.dupreq_param.max_client_bytes = DUPREQ_MAX_CLIENT_BYTES;
+  nfs_param.dupreq_param.non_idempotent_only = FALSE;
 
   /*  Worker parameters : IP/name hash table */
   nfs_param.ip_name_param.hash_param.index_size = PRIME_IP_NAME;
@@ -414,6 +427,7 @@ void nfs_set_param_default()
   nfs_param.ip_name_param.hash_param.key_to_str = display_ip_name_key;
   nfs_param.ip_name_param.hash_param.val_to_str = display_ip_name_val;
   nfs_param.ip_name_param.hash_param.name = "IP Name";
+  nfs_param.ip_name_param.hash_param.inline_keys = TRUE;
   nfs_param.ip_name_param.expiration_time = IP_NAME_EXPIRATION;
   strncpy(nfs_param.ip_name_param.mapfile, "", MAXPATHLEN);
 
@@ -425,9 +439,13 @@ void nfs_set_param_default()
   nfs_param.uidmap_cache_param.hash_param.hash_func_rbt = idmapper_rbt_hash_func;
   nfs_param.uidmap_cache_param.hash_param.compare_key = compare_idmapper;
   nfs_param.uidmap_cache_param.hash_param.key_to_str = display_idmapper_key;
-  nfs_param.uidmap_cache_param.hash_param.val_to_str = display_idmapper_val;
+  nfs_param.uidmap_cache_param.hash_param.val_to_str = display_idmapper_entry;
   nfs_param.uidmap_cache_param.hash_param.name = "UID Map Cache";
+  nfs_param.uidmap_cache_param.hash_param.inline_keys = TRUE;
   strncpy(nfs_param.uidmap_cache_param.mapfile, "", MAXPATHLEN);
+  strncpy(nfs_param.uidmap_cache_param.preload_file, "", MAXPATHLEN);
+  nfs_param.uidmap_cache_param.positive_ttl = ID_MAPPER_POSITIVE_TTL;
+  nfs_param.uidmap_cache_param.negative_ttl = ID_MAPPER_NEGATIVE_TTL;
 
   /*  Worker parameters : UNAME_MAPPER hash table */
   nfs_param.unamemap_cache_param.hash_param.index_size = PRIME_ID_MAPPER;
@@ -437,9 +455,12 @@ void nfs_set_param_default()
   nfs_param.unamemap_cache_param.hash_param.hash_func_rbt = namemapper_rbt_hash_func;
   nfs_param.unamemap_cache_param.hash_param.compare_key = compare_namemapper;
   nfs_param.unamemap_cache_param.hash_param.key_to_str = display_idmapper_val;
-  nfs_param.unamemap_cache_param.hash_param.val_to_str = display_idmapper_key;
+  nfs_param.unamemap_cache_param.hash_param.val_to_str = display_idmapper_entry;
   nfs_param.unamemap_cache_param.hash_param.name = "UNAME Map Cache";
   strncpy(nfs_param.unamemap_cache_param.mapfile, "", MAXPATHLEN);
+  strncpy(nfs_param.unamemap_cache_param.preload_file, "", MAXPATHLEN);
+  nfs_param.unamemap_cache_param.positive_ttl = ID_MAPPER_POSITIVE_TTL;
+  nfs_param.unamemap_cache_param.negative_ttl = ID_MAPPER_NEGATIVE_TTL;
 
   /*  Worker parameters : GID_MAPPER hash table */
   nfs_param.gidmap_cache_param.hash_param.index_size = PRIME_ID_MAPPER;
@@ -449,9 +470,13 @@ void nfs_set_param_default()
   nfs_param.gidmap_cache_param.hash_param.hash_func_rbt = idmapper_rbt_hash_func;
   nfs_param.gidmap_cache_param.hash_param.compare_key = compare_idmapper;
   nfs_param.gidmap_cache_param.hash_param.key_to_str = display_idmapper_key;
-  nfs_param.gidmap_cache_param.hash_param.val_to_str = display_idmapper_val;
+  nfs_param.gidmap_cache_param.hash_param.val_to_str = display_idmapper_entry;
   nfs_param.gidmap_cache_param.hash_param.name = "GID Map Cache";
+  nfs_param.gidmap_cache_param.hash_param.inline_keys = TRUE;
   strncpy(nfs_param.gidmap_cache_param.mapfile, "", MAXPATHLEN);
+  strncpy(nfs_param.gidmap_cache_param.preload_file, "", MAXPATHLEN);
+  nfs_param.gidmap_cache_param.positive_ttl = ID_MAPPER_POSITIVE_TTL;
+  nfs_param.gidmap_cache_param.negative_ttl = ID_MAPPER_NEGATIVE_TTL;
 
   /*  Worker parameters : UID->GID  hash table (for RPCSEC_GSS) */
   nfs_param.uidgidmap_cache_param.hash_param.index_size = PRIME_ID_MAPPER;
@@ -473,9 +498,26 @@ void nfs_set_param_default()
   nfs_param.gnamemap_cache_param.hash_param.hash_func_rbt = namemapper_rbt_hash_func;
   nfs_param.gnamemap_cache_param.hash_param.compare_key = compare_namemapper;
   nfs_param.gnamemap_cache_param.hash_param.key_to_str = display_idmapper_val;
-  nfs_param.gnamemap_cache_param.hash_param.val_to_str = display_idmapper_key;
+  nfs_param.gnamemap_cache_param.hash_param.val_to_str = display_idmapper_entry;
   nfs_param.gnamemap_cache_param.hash_param.name = "GNAME Map Cache";
   strncpy(nfs_param.gnamemap_cache_param.mapfile, "", MAXPATHLEN);
+  strncpy(nfs_param.gnamemap_cache_param.preload_file, "", MAXPATHLEN);
+  nfs_param.gnamemap_cache_param.positive_ttl = ID_MAPPER_POSITIVE_TTL;
+  nfs_param.gnamemap_cache_param.negative_ttl = ID_MAPPER_NEGATIVE_TTL;
+
+  /*  Worker parameters : UID->groups hash table (for Manage_Gids) */
+  nfs_param.uid2grp_cache_param.hash_param.index_size = PRIME_ID_MAPPER;
+  nfs_param.uid2grp_cache_param.hash_param.alphabet_length = 10;     /* Not used for UID_MAPPER */
+  nfs_param.uid2grp_cache_param.hash_param.nb_node_prealloc = NB_PREALLOC_ID_MAPPER;
+  nfs_param.uid2grp_cache_param.hash_param.hash_func_key = namemapper_value_hash_func;
+  nfs_param.uid2grp_cache_param.hash_param.hash_func_rbt = namemapper_rbt_hash_func;
+  nfs_param.uid2grp_cache_param.hash_param.compare_key = compare_namemapper;
+  nfs_param.uid2grp_cache_param.hash_param.key_to_str = display_idmapper_val;
+  nfs_param.uid2grp_cache_param.hash_param.val_to_str = display_uid2grp_val;
+  nfs_param.uid2grp_cache_param.hash_param.name = "UID->Groups Cache";
+  nfs_param.uid2grp_cache_param.max_entries = UID2GRP_MAX_ENTRIES;
+  nfs_param.uid2grp_cache_param.positive_ttl = ID_MAPPER_POSITIVE_TTL;
+  nfs_param.uid2grp_cache_param.negative_ttl = ID_MAPPER_NEGATIVE_TTL;
 
   /*  Worker parameters : IP/stats hash table */
   nfs_param.ip_stats_param.hash_param.index_size = PRIME_IP_STATS;
@@ -499,6 +541,7 @@ void nfs_set_param_default()
   nfs_param.client_id_param.hash_param.key_to_str = display_client_id;
   nfs_param.client_id_param.hash_param.val_to_str = display_client_id_val;
   nfs_param.client_id_param.hash_param.name = "Client ID";
+  nfs_param.client_id_param.hash_param.inline_keys = TRUE;
 
   /* NFSv4 Client id reverse table */
   nfs_param.client_id_param.hash_param_reverse.index_size = PRIME_CLIENT_ID;
@@ -525,6 +568,7 @@ void nfs_set_param_default()
   nfs_param.state_id_param.hash_param.key_to_str = display_state_id_key;
   nfs_param.state_id_param.hash_param.val_to_str = display_state_id_val;
   nfs_param.state_id_param.hash_param.name = "State ID";
+  nfs_param.state_id_param.hash_param.inline_keys = TRUE;
 
 #ifdef _USE_NFS4_1
   /* NFSv4 State Id hash */
@@ -537,6 +581,7 @@ void nfs_set_param_default()
   nfs_param.session_id_param.hash_param.key_to_str = display_session_id_key;
   nfs_param.session_id_param.hash_param.val_to_str = display_session_id_val;
   nfs_param.session_id_param.hash_param.name = "Session ID";
+  nfs_param.session_id_param.hash_param.inline_keys = TRUE;
 
 #endif                          /* _USE_NFS4_1 */
 
@@ -600,6 +645,7 @@ void nfs_set_param_default()
   nfs_param.cache_layers_param.cache_param.hparam.key_to_str = display_cache;
   nfs_param.cache_layers_param.cache_param.hparam.val_to_str = display_cache;
   nfs_param.cache_layers_param.cache_param.hparam.name = "Cache Inode";
+  nfs_param.cache_layers_param.cache_param.hparam.inline_keys = TRUE;
 
 #ifdef _USE_NLM
   /* Cache inode parameters : cookie hash table */
@@ -622,6 +668,8 @@ void nfs_set_param_default()
   //nfs_param.cache_layers_param.gcpol.run_interval = 3600;    /* 1h */
   nfs_param.cache_layers_param.gcpol.run_interval = 0;    /* NO Data Cache */
   nfs_param.cache_layers_param.gcpol.nb_call_before_gc = 1000;
+  nfs_param.cache_layers_param.gcpol.memory_hwmark = 0;      /* No memory limit */
+  nfs_param.cache_layers_param.gcpol.reclaim_step_duration = 10;    /* 10ms */
 
   /* Cache inode client parameters */
   nfs_param.cache_layers_param.cache_inode_client_param.lru_param.nb_entry_prealloc =
@@ -647,10 +695,15 @@ void nfs_set_param_default()
 #else
   nfs_param.cache_layers_param.cache_inode_client_param.attrmask = FSAL_ATTR_MASK_V2_V3;
 #endif
-  nfs_param.cache_layers_param.cache_inode_client_param.max_fd = 20;
+  nfs_param.cache_layers_param.cache_inode_client_param.max_fd = CACHE_INODE_DEFAULT_MAX_FD;
   nfs_param.cache_layers_param.cache_inode_client_param.use_fd_cache = 0;
   nfs_param.cache_layers_param.cache_inode_client_param.use_fsal_hash = 1;
   nfs_param.cache_layers_param.cache_inode_client_param.retention = 60;
+  nfs_param.cache_layers_param.cache_inode_client_param.max_dirty = CACHE_INODE_DEFAULT_MAX_DIRTY;
+  nfs_param.cache_layers_param.cache_inode_client_param.write_behind_chunk =
+      CACHE_INODE_DEFAULT_WRITE_BEHIND_CHUNK;
+  nfs_param.cache_layers_param.cache_inode_client_param.write_behind_delay =
+      CACHE_INODE_DEFAULT_WRITE_BEHIND_DELAY;
 
   /* Data cache client parameters */
   nfs_param.cache_layers_param.cache_content_client_param.nb_prealloc_entry = 128;
@@ -658,6 +711,8 @@ void nfs_set_param_default()
   nfs_param.cache_layers_param.cache_content_client_param.max_fd = 20;
   nfs_param.cache_layers_param.cache_content_client_param.use_fd_cache = 0;
   nfs_param.cache_layers_param.cache_content_client_param.retention = 60;
+  nfs_param.cache_layers_param.cache_content_client_param.aio_threads = 4;
+  nfs_param.cache_layers_param.cache_content_client_param.readahead_size = 1024 * 1024;
 
   strcpy(nfs_param.cache_layers_param.cache_content_client_param.cache_dir,
          "/tmp/ganesha.datacache");
@@ -1060,6 +1115,24 @@ int nfs_set_param_from_conf(nfs_start_info_t * p_start_info)
 		 "GID_MAPPER configuration read from config file");
     }
 
+  /* Worker paramters: uid->groups hash table, used by the exports with Manage_Gids */
+  if((rc = nfs_read_uid2grp_conf(config_struct, &nfs_param.uid2grp_cache_param)) < 0)
+    {
+      LogCrit(COMPONENT_INIT,
+              "Error while parsing UID2GRP configuration");
+      return -1;
+    }
+  else
+    {
+      /* No such stanza in configuration file */
+      if(rc == 1)
+        LogDebug(COMPONENT_INIT,
+		 "No UID2GRP configuration found in config file, using default");
+      else
+        LogDebug(COMPONENT_INIT,
+		 "UID2GRP configuration read from config file");
+    }
+
   /* Worker paramters: client_id hash table */
   if((rc = nfs_read_client_id_conf(config_struct, &nfs_param.client_id_param)) < 0)
     {
@@ -1348,6 +1421,22 @@ int nfs_check_param_consistency()
       return 1;
     }
 
+  if(nfs_param.core_param.nb_dispatcher == 0 ||
+     nfs_param.core_param.nb_dispatcher > NB_MAX_DISPATCHER_THREAD)
+    {
+      LogCrit(COMPONENT_INIT,
+              "BAD PARAMETER: number of dispatchers must be between 1 and %d",
+              NB_MAX_DISPATCHER_THREAD);
+      return 1;
+    }
+
+  if(nfs_param.nfsv4_param.nb_max_slots == 0)
+    {
+      LogCrit(COMPONENT_INIT,
+              "BAD PARAMETER: NFSv4.1 sessions need at least one slot");
+      return 1;
+    }
+
   if( 2*nfs_param.core_param.nb_worker  >  nfs_param.cache_layers_param.cache_param.hparam.index_size )
     {
       LogCrit(COMPONENT_INIT,
@@ -1356,26 +1445,18 @@ int nfs_check_param_consistency()
     }
 
 
-  if(nfs_param.worker_param.nb_before_gc <
-     nfs_param.worker_param.lru_param.nb_entry_prealloc / 2)
+  if(nfs_param.worker_param.pending_queue_size == 0)
     {
       LogCrit(COMPONENT_INIT,
-              "BAD PARAMETER: worker_param.nb_before_gc is too small: %d",
-              nfs_param.worker_param.nb_before_gc);
-      LogCrit(COMPONENT_INIT,
-              "BAD PARAMETER: It should be at least half of worker_param.lru_param.nb_entry_prealloc = %d",
-              nfs_param.worker_param.lru_param.nb_entry_prealloc);
-
+              "BAD PARAMETER: worker_param.pending_queue_size should be greater than 0");
       return 1;
     }
 
-  if(nfs_param.dupreq_param.hash_param.nb_node_prealloc <
-     nfs_param.worker_param.lru_dupreq.nb_entry_prealloc)
+  if(nfs_param.dupreq_param.nb_shards == 0 || nfs_param.dupreq_param.nb_buckets == 0)
     {
       LogCrit(COMPONENT_INIT,
-              "BAD PARAMETER(dupreq): nb_node_prealloc = %d should be greater than nb_entry_prealloc = %d",
-              nfs_param.dupreq_param.hash_param.nb_node_prealloc,
-              nfs_param.worker_param.lru_dupreq.nb_entry_prealloc);
+              "BAD PARAMETER(dupreq): nb_shards = %u and nb_buckets = %u should be greater than 0",
+              nfs_param.dupreq_param.nb_shards, nfs_param.dupreq_param.nb_buckets);
       return 1;
     }
 #ifdef _USE_MFSL_ASYNC
@@ -1570,16 +1651,21 @@ static void nfs_Start_threads(bool_t flush_datacache_mode)
        */
       wait_for_threads_to_awaken();
 
-      /* Starting the rpc dispatcher thread */
-      if((rc =
-	  pthread_create(&rpc_dispatcher_thrid, &attr_thr, rpc_dispatcher_thread,
-			 &nfs_param)) != 0)
+      /* Starting the rpc dispatcher threads, one per event engine shard */
+      for(i = 0; i < Svc_nb_event_shard; i++)
 	{
-	  LogFatal(COMPONENT_THREAD,
-		   "Could not create rpc_dispatcher_thread, error = %d (%s)",
-		   errno, strerror(errno));
+	  if((rc =
+	      pthread_create(&(rpc_dispatcher_thrid[i]), &attr_thr, rpc_dispatcher_thread,
+			     (void *)i)) != 0)
+	    {
+	      LogFatal(COMPONENT_THREAD,
+		       "Could not create rpc_dispatcher_thread #%lu, error = %d (%s)",
+		       i, errno, strerror(errno));
+	    }
 	}
-      LogEvent(COMPONENT_THREAD, "rpc dispatcher thread was started successfully");
+      LogEvent(COMPONENT_THREAD,
+	       "%u rpc dispatcher threads were started successfully",
+	       Svc_nb_event_shard);
 
 #ifdef _USE_9P
       /* Starting the 9p dispatcher thread */
@@ -1649,6 +1735,76 @@ static void nfs_Start_threads(bool_t flush_datacache_mode)
   LogEvent(COMPONENT_THREAD,
            "reaper thread was started successfully");
 
+  /* Starting the id mapper refresh thread */
+  if((rc =
+      pthread_create(&idmapper_refresh_thrid, &attr_thr, idmapper_refresh_thread, NULL)) != 0)
+    {
+      LogFatal(COMPONENT_THREAD,
+               "Could not create idmapper_refresh_thread, error = %d (%s)",
+               errno, strerror(errno));
+    }
+  LogEvent(COMPONENT_THREAD,
+           "id mapper refresh thread was started successfully");
+
+  /* Starting the group lists refresh thread */
+  if((rc =
+      pthread_create(&uid2grp_refresh_thrid, &attr_thr, uid2grp_refresh_thread, NULL)) != 0)
+    {
+      LogFatal(COMPONENT_THREAD,
+               "Could not create uid2grp_refresh_thread, error = %d (%s)",
+               errno, strerror(errno));
+    }
+  LogEvent(COMPONENT_THREAD,
+           "group lists refresh thread was started successfully");
+
+  /* Starting the cache_inode reclaimer threads */
+  for(i = 0; i < nfs_param.core_param.nb_max_concurrent_gc; i++)
+    {
+      if((rc = pthread_create(&(cache_inode_gc_thrid[i]), &attr_thr,
+                              cache_inode_gc_thread, (void *)i)) != 0)
+        {
+          LogFatal(COMPONENT_THREAD,
+                   "Could not create cache_inode_gc_thread #%lu, error = %d (%s)",
+                   i, errno, strerror(errno));
+        }
+    }
+  LogEvent(COMPONENT_THREAD,
+           "%u cache_inode reclaimer threads were started successfully",
+           nfs_param.core_param.nb_max_concurrent_gc);
+
+  /* Starting the threads writing the unstable writes behind */
+  for(i = 0; i < nfs_param.core_param.nb_write_behind_thread; i++)
+    {
+      if((rc = pthread_create(&(write_behind_thrid[i]), &attr_thr,
+                              cache_inode_write_behind_thread, (void *)i)) != 0)
+        {
+          LogFatal(COMPONENT_THREAD,
+                   "Could not create cache_inode_write_behind_thread #%lu, error = %d (%s)",
+                   i, errno, strerror(errno));
+        }
+    }
+  LogEvent(COMPONENT_THREAD,
+           "%u write-behind threads were started successfully",
+           nfs_param.core_param.nb_write_behind_thread);
+
+  if(nfs_param.nfsv4_param.use_delegations)
+    {
+      /* Starting the threads sending the callbacks of the delegations */
+      for(i = 0; i < nfs_param.nfsv4_param.nb_deleg_recall_thread; i++)
+        {
+          if((rc = pthread_create(&(deleg_recall_thrid[i]), &attr_thr,
+                                  state_deleg_recall_thread, (void *)i)) != 0)
+            {
+              LogFatal(COMPONENT_THREAD,
+                       "Could not create state_deleg_recall_thread #%lu, error = %d (%s)",
+                       i, errno, strerror(errno));
+            }
+        }
+      LogEvent(COMPONENT_THREAD,
+               "%u delegation recall threads were started successfully",
+               nfs_param.nfsv4_param.nb_deleg_recall_thread);
+    }
+
   if(nfs_param.cache_layers_param.dcgcpol.run_interval != 0)
     {
       tcb_new(&gccb, "NFS FILE CONTENT GARBAGE COLLECTION Thread"); 
@@ -1703,6 +1859,7 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
   state_status_t state_status;
   fsal_status_t fsal_status;
   unsigned int i = 0;
+  unsigned int max_fd;
   int rc = 0;
 #ifdef _HAVE_GSSAPI
   gss_name_t gss_service_name;
@@ -1784,6 +1941,24 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
   /* Set the cache inode GC policy */
   cache_inode_set_gc_policy(nfs_param.cache_layers_param.gcpol);
 
+  /* Set the budget of the fds kept open, leaving a quarter of RLIMIT_NOFILE to the sockets */
+  max_fd = nfs_param.cache_layers_param.cache_inode_client_param.max_fd;
+  if(nfs_param.core_param.nb_max_fd > 0 &&
+     max_fd > (unsigned int)nfs_param.core_param.nb_max_fd / 4 * 3)
+    {
+      max_fd = (unsigned int)nfs_param.core_param.nb_max_fd / 4 * 3;
+      LogEvent(COMPONENT_INIT,
+               "Max_Fd lowered from %u to %u, RLIMIT_NOFILE is %d",
+               nfs_param.cache_layers_param.cache_inode_client_param.max_fd, max_fd,
+               nfs_param.core_param.nb_max_fd);
+    }
+  cache_inode_set_fd_cache_budget(max_fd);
+
+  /* Set the budget of the unstable writes kept in memory */
+  cache_inode_set_write_behind_policy(nfs_param.cache_layers_param.cache_inode_client_param.max_dirty,
+                                      nfs_param.cache_layers_param.cache_inode_client_param.write_behind_chunk,
+                                      nfs_param.cache_layers_param.cache_inode_client_param.write_behind_delay);
+
   /* Set the cache content GC policy */
   cache_content_set_gc_policy(nfs_param.cache_layers_param.dcgcpol);
 
@@ -1874,12 +2049,6 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
   memset((char *)workers_data, 0,
          sizeof(nfs_worker_data_t) * nfs_param.core_param.nb_worker);
 
-  if(nfs_Init_gc_counter() != 0)
-    {
-      LogFatal(COMPONENT_INIT, "Error while initializing worker gc counter");
-    }
-  LogDebug(COMPONENT_INIT, "worker gc counter successfully initialized");
-
   LogDebug(COMPONENT_INIT, "Initializing workers data structure");
 
   for(i = 0; i < nfs_param.core_param.nb_worker; i++)
@@ -1922,20 +2091,6 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
           Fatal();
         }
 
-      /* Allocation of the nfs dupreq pool */
-      MakePool(&workers_data[i].dupreq_pool,
-               nfs_param.worker_param.nb_dupreq_prealloc,
-               dupreq_entry_t, NULL, NULL);
-      NamePool(&workers_data[i].dupreq_pool, "Duplicate Request Pool %d", i);
-
-      if(!IsPoolPreallocated(&workers_data[i].dupreq_pool))
-        {
-          LogCrit(COMPONENT_INIT,
-                  "Error while allocating duplicate request pool #%d", i);
-          LogError(COMPONENT_INIT, ERR_SYS, ERR_MALLOC, errno);
-          Fatal();
-        }
-
       /* Allocation of the IP/name pool */
       MakePool(&workers_data[i].ip_stats_pool,
                nfs_param.worker_param.nb_ip_stats_prealloc,
@@ -1975,15 +2130,15 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
           "NFSv4 pseudo file system successfully initialized");
 
   /* Init duplicate request cache */
-  LogDebug(COMPONENT_INIT, "Now building duplicate request hash table cache");
+  LogDebug(COMPONENT_INIT, "Now building duplicate request cache");
   if((rc = nfs_Init_dupreq(nfs_param.dupreq_param)) != DUPREQ_SUCCESS)
     {
       LogFatal(COMPONENT_INIT,
-               "Error %d while initializing duplicate request hash table cache",
+               "Error %d while initializing duplicate request cache",
                rc);
     }
   LogInfo(COMPONENT_INIT,
-          "duplicate request hash table cache successfully initialized");
+          "duplicate request cache successfully initialized");
 
   /* Init the IP/name cache */
   LogDebug(COMPONENT_INIT, "Now building IP/name cache");
@@ -2028,6 +2183,16 @@ static void nfs_Init(const nfs_start_info_t * p_start_info)
   LogInfo(COMPONENT_INIT,
           "GID_MAPPER cache successfully initialized");
 
+  /* Init the UID2GRP cache */
+  LogDebug(COMPONENT_INIT, "Now building UID2GRP cache (for Manage_Gids)");
+  if(uid2grp_init(nfs_param.uid2grp_cache_param) != ID_MAPPER_SUCCESS)
+    {
+      LogFatal(COMPONENT_INIT,
+               "Error while initializing UID2GRP cache");
+    }
+  LogInfo(COMPONENT_INIT,
+          "UID2GRP cache successfully initialized");
+
   /* Init the NFSv4 Clientid cache */
   LogDebug(COMPONENT_INIT, "Now building NFSv4 clientid cache");
   if(nfs_Init_client_id(nfs_param.client_id_param) != CLIENT_ID_SUCCESS)
@@ -2218,6 +2383,7 @@ void nfs_start(nfs_start_info_t * p_start_info)
   cache_content_status_t content_status;
   fsal_status_t fsal_status;
   fsal_op_context_t fsal_context;
+  exportlist_t *pexport;
   unsigned int i;
 
 #if 0
@@ -2312,6 +2478,13 @@ void nfs_start(nfs_start_info_t * p_start_info)
       exit(0);
     }
 
+  /* From now on, a thread of its own writes the log files */
+  if(nfs_param.core_param.log_async)
+    {
+      if(LogAsync_Start(nfs_param.core_param.log_async_ring_size) != 0)
+        LogCrit(COMPONENT_INIT, "Log files will be written synchronously");
+    }
+
   /* Set the Core dump size if set */
   if(nfs_param.core_param.core_dump_size != -1)
     {
@@ -2371,6 +2544,21 @@ void nfs_start(nfs_start_info_t * p_start_info)
   else
     LogInfo(COMPONENT_INIT, "File Content Cache directory initialized");
 
+  /* Start the readahead threads of the datacache, if some export uses it */
+  for(pexport = nfs_param.pexportlist; pexport != NULL; pexport = pexport->next)
+    if(pexport->options & EXPORT_OPTION_USE_DATACACHE)
+      break;
+
+  if(pexport != NULL &&
+     cache_content_aio_init(nfs_param.cache_layers_param.
+                            cache_content_client_param.aio_threads) != 0)
+    LogFatal(COMPONENT_INIT, "File Content Cache I/O threads could not be started");
+
+  /* The READ replies are read into registered buffers */
+  if(rpc_buffer_pool_init(nfs_param.core_param.nb_read_buffers,
+                          nfs_param.core_param.read_buffer_size) != 0)
+    LogFatal(COMPONENT_INIT, "Registered RPC buffers could not be allocated");
+
   /* Print the worker parameters in log */
   Print_param_worker_in_log(&(nfs_param.worker_param));
 
@@ -2468,6 +2656,26 @@ void nfs_start(nfs_start_info_t * p_start_info)
       nsm_unmonitor_all();
 #endif
 
+      /* Load the users and groups known before the first requests, the static
+       * mappings of the map files loaded next override them */
+      if(nfs_param.uidmap_cache_param.preload_file[0] != '\0')
+        {
+          LogDebug(COMPONENT_INIT, "Preloading UID_MAPPER with file %s",
+                   nfs_param.uidmap_cache_param.preload_file);
+          if(idmap_preload(nfs_param.uidmap_cache_param.preload_file, UIDMAP_TYPE) !=
+             ID_MAPPER_SUCCESS)
+            LogCrit(COMPONENT_INIT, "UID_MAPPER was NOT preloaded");
+        }
+
+      if(nfs_param.gidmap_cache_param.preload_file[0] != '\0')
+        {
+          LogDebug(COMPONENT_INIT, "Preloading GID_MAPPER with file %s",
+                   nfs_param.gidmap_cache_param.preload_file);
+          if(idmap_preload(nfs_param.gidmap_cache_param.preload_file, GIDMAP_TYPE) !=
+             ID_MAPPER_SUCCESS)
+            LogCrit(COMPONENT_INIT, "GID_MAPPER was NOT preloaded");
+        }
+
       /* Populate the ID_MAPPER file with mapping file if needed */
       if(nfs_param.uidmap_cache_param.mapfile[0] == '\0')
         {
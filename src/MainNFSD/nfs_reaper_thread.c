@@ -19,7 +19,8 @@
  */
 
 /**
- * nfs_reaper_thread.c : check for expired clients and whack them.
+ * nfs_reaper_thread.c : check for expired clients and whack them, and
+ * evict the expired replies of the duplicate request cache.
  *
  */
 #ifdef HAVE_CONFIG_H
@@ -42,13 +43,36 @@
 
 unsigned int reaper_delay = 10;
 
+/* Stops the walk on a client to expire, the client table being locked */
+static int reaper_check_client(hash_data_t *pdata, void *arg)
+{
+        nfs_client_id_t *clientp = (nfs_client_id_t *)pdata->buffval.pdata;
+        int v4;
+
+        /*
+         * little hack: only want to reap v4 clients
+         * 4.1 initializess this field to '1'
+         */
+        v4 = (clientp->create_session_sequence == 0);
+        if (clientp->confirmed != EXPIRED_CLIENT_ID &&
+            nfs4_is_lease_expired(clientp) && v4) {
+                *(nfs_client_id_t **)arg = clientp;
+                return FALSE;
+        }
+
+        if (clientp->confirmed == EXPIRED_CLIENT_ID) {
+                LogDebug(COMPONENT_MAIN,
+                    "reaper: client %s already expired",
+                    clientp->client_name);
+        }
+
+        return TRUE;
+}
+
 void *reaper_thread(void *unused)
 {
         hash_table_t *ht = ht_client_id;
-        struct rbt_head *head_rbt;
-        hash_data_t *pdata = NULL;
-        int i, v4;
-        struct rbt_node *pn;
+        unsigned int i;
         nfs_client_id_t *clientp;
 
 #ifndef _NO_BUDDY_SYSTEM
@@ -70,46 +94,25 @@ void *reaper_thread(void *unused)
                 LogFullDebug(COMPONENT_MAIN,
                     "NFS reaper : now checking clients");
 
-                /* For each bucket of the hashtable */
-                for(i = 0; i < ht->parameter.index_size; i++) {
-                        head_rbt = &(ht->array_rbt[i]);
-
-restart:
-                        /* acquire mutex */
-                        P_w(&(ht->array_lock[i]));
-
-                        /* go through all entries in the red-black-tree*/
-                        RBT_LOOP(head_rbt, pn) {
-                                pdata = RBT_OPAQ(pn);
-
-                                clientp =
-                                    (nfs_client_id_t *)pdata->buffval.pdata;
-                                /*
-                                 * little hack: only want to reap v4 clients
-                                 * 4.1 initializess this field to '1'
-                                 */
-                                v4 = (clientp->create_session_sequence == 0);
-                                if (clientp->confirmed != EXPIRED_CLIENT_ID &&
-                                    nfs4_is_lease_expired(clientp) && v4) {
-                                        V_w(&(ht->array_lock[i]));
-                                        LogDebug(COMPONENT_MAIN,
-                                            "NFS reaper: expire client %s",
-                                            clientp->client_name);
-                                        nfs_client_id_expire(clientp);
-                                        goto restart;
-                                }
-
-                                if (clientp->confirmed == EXPIRED_CLIENT_ID) {
-                                        LogDebug(COMPONENT_MAIN,
-                                            "reaper: client %s already expired",
-                                            clientp->client_name);
-                                }
-
-                                RBT_INCREMENT(pn);
-                        }
-                        V_w(&(ht->array_lock[i]));
+                /* The walk stops on each client to expire, which is
+                 * expired with the table unlocked, then goes on from the
+                 * same bucket. It works whatever the hash backend. */
+                i = 0;
+                while((i = HashTable_Walk(ht, i, reaper_check_client,
+                                          &clientp)) < ht->parameter.index_size) {
+                        LogDebug(COMPONENT_MAIN,
+                            "NFS reaper: expire client %s",
+                            clientp->client_name);
+                        nfs_client_id_expire(clientp);
                 }
 
+                /* Evict the expired replies of the duplicate request cache */
+                nfs_dupreq_gc();
+
+#ifdef _USE_SLAB_ALLOC
+                /* Give back the memory left unused since the last pass */
+                SlabReclaim();
+#endif
         }                           /* while ( 1 ) */
 
         return NULL;
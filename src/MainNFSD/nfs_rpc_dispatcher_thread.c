@@ -47,7 +47,6 @@
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/file.h>           /* for having FNDELAY */
-#include <sys/select.h>
 #include "HashData.h"
 #include "HashTable.h"
 #include "rpc.h"
@@ -77,7 +76,7 @@
   #define P_FAMILY AF_INET6
 #endif
 
-static pthread_mutex_t lock_worker_selection = PTHREAD_MUTEX_INITIALIZER;
+nfs_worker_selection_stat_t worker_selection_stat;
 
 #ifndef _NO_BUDDY_SYSTEM
 /* This structure is set to initial state (zero-ed) in stat thread */
@@ -507,7 +506,7 @@ void nfs_Init_svc()
   LogInfo(COMPONENT_DISPATCH, "NFS INIT: Core options = %d",
           nfs_param.core_param.core_options);
 
-  InitRPC(nfs_param.core_param.nb_max_fd);
+  InitRPC(nfs_param.core_param.nb_max_fd, nfs_param.core_param.nb_dispatcher);
 
 #ifdef _USE_TIRPC
   LogInfo(COMPONENT_DISPATCH, "NFS INIT: using TIRPC");
@@ -680,8 +679,29 @@ void nfs_Init_svc()
 }                               /* nfs_Init_svc */
 
 /**
- * Selects the smallest request queue,
- * whome the worker is ready and is not garbagging.
+ * worker_selection_random: per thread pseudo random generator (xorshift).
+ */
+static unsigned int worker_selection_random(void)
+{
+  static __thread uint32_t seed;
+
+  if(seed == 0)
+    seed = ((uint32_t) (unsigned long)pthread_self() ^ (uint32_t) time(NULL)) | 1;
+
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return seed;
+}                               /* worker_selection_random */
+
+/**
+ * Selects a worker for a new request.
+ *
+ * Two workers are drawn at random and the one with the shorter queue wins
+ * ("power of two choices"): this keeps queues balanced nearly as well as a
+ * full scan, without any lock or shared counter between dispatchers. Only
+ * when neither worker is available are the other workers scanned.
  */
 
 /* PhD: Please note that I renamed this function, added 
@@ -689,41 +709,51 @@ void nfs_Init_svc()
  * This is done to share this code with the 9P implementation */
 unsigned int nfs_core_select_worker_queue()
 {
-  #define NO_VALUE_CHOOSEN  1000000
-  unsigned int worker_index = NO_VALUE_CHOOSEN;
-  unsigned int avg_number_pending = NO_VALUE_CHOOSEN;
-  unsigned int total_number_pending = 0;
-
-  static unsigned int counter;
+  unsigned int nb_worker = nfs_param.core_param.nb_worker;
+  unsigned int worker_index;
+  unsigned int first, second;
+  unsigned int i, cpt;
+  worker_available_rc rc_first, rc_second, rc;
 
-  unsigned int i;
-  static unsigned int last;
-  unsigned int cpt = 0;
-  worker_available_rc rc;
+  first = worker_selection_random() % nb_worker;
+  rc_first = worker_available(first);
 
-  P(lock_worker_selection);
-  counter++;
+  if(nb_worker > 1)
+    {
+      second = worker_selection_random() % (nb_worker - 1);
+      if(second >= first)
+        second += 1;
+      rc_second = worker_available(second);
+    }
+  else
+    {
+      second = first;
+      rc_second = rc_first;
+    }
 
-  /* Calculate the average queue length if counter is bigger than configured value. */
-  if(counter > nfs_param.core_param.nb_call_before_queue_avg)
+  if(rc_first == WORKER_AVAILABLE && rc_second == WORKER_AVAILABLE)
     {
-      for(i = 0; i < nfs_param.core_param.nb_worker; i++)
-        {
-          total_number_pending += workers_data[i].pending_request->nb_entry;
-        }
-      avg_number_pending = total_number_pending / nfs_param.core_param.nb_worker;
-      /* Reset counter. */
-      counter = 0;
+      if(WorkQueue_Length(&workers_data[second].pending_request) <
+         WorkQueue_Length(&workers_data[first].pending_request))
+        worker_index = second;
+      else
+        worker_index = first;
     }
-  V(lock_worker_selection);
+  else if(rc_first == WORKER_AVAILABLE)
+    worker_index = first;
+  else if(rc_second == WORKER_AVAILABLE)
+    worker_index = second;
+  else
+    {
+      atomic_inc_uint64_t(&worker_selection_stat.nb_scan);
 
-  /* Choose the queue whose length is smaller than average. */
-      for(i = (last + 1) % nfs_param.core_param.nb_worker, cpt = 0;
-          cpt < nfs_param.core_param.nb_worker;
-          cpt++, i = (i + 1) % nfs_param.core_param.nb_worker)
+      /* Both are paused, doing gc or full: take the first available one */
+      worker_index = nb_worker;
+      for(i = (first + 1) % nb_worker, cpt = 0;
+          cpt < nb_worker;
+          cpt++, i = (i + 1) % nb_worker)
         {
-          /* Choose only fully initialized workers and that does not gc. */
-          rc = worker_available(i, avg_number_pending);
+          rc = worker_available(i);
           if(rc == WORKER_AVAILABLE)
             {
               worker_index = i;
@@ -732,26 +762,41 @@ unsigned int nfs_core_select_worker_queue()
           else if(rc == WORKER_ALL_PAUSED)
             {
               /* Wait for the threads to awaken */
-              rc = wait_for_threads_to_awaken();
-              /*              if(rc == PAUSE_EXIT)
-                {
-                }
-              */
-            }
-          else if(rc == WORKER_EXIT)
-            {
+              wait_for_threads_to_awaken();
             }
         }
 
-  if(worker_index == NO_VALUE_CHOOSEN)
-    worker_index = (last + 1) % nfs_param.core_param.nb_worker;
+      if(worker_index == nb_worker)
+        {
+          atomic_inc_uint64_t(&worker_selection_stat.nb_default);
+          worker_index = first;
+        }
+    }
 
-  last = worker_index;
+  atomic_inc_uint64_t(&workers_data[worker_index].nb_selected);
 
   return worker_index;
 
 } /* nfs_core_select_worker_queue */
 
+/**
+ * Gives the average number of requests waiting in the workers' queues.
+ *
+ * Queue lengths are read without any lock, the result is only meant to be
+ * used as a hint (e.g. to size the NFSv4.1 slot tables offered to clients).
+ */
+unsigned int nfs_core_worker_load()
+{
+  unsigned int nb_worker = nfs_param.core_param.nb_worker;
+  unsigned int total = 0;
+  unsigned int i;
+
+  for(i = 0; i < nb_worker; i++)
+    total += WorkQueue_Length(&workers_data[i].pending_request);
+
+  return total / nb_worker;
+} /* nfs_core_worker_load */
+
 /**
  * process_rpc_request: process an RPC request.
  *
@@ -786,9 +831,9 @@ process_status_t process_rpc_request(SVCXPRT *xprt)
     }
 
   LogFullDebug(COMPONENT_DISPATCH,
-               "Use request from Worker Thread #%u's pool, xprt->xp_sock=%d, thread has %d pending requests",
+               "Use request from Worker Thread #%u's pool, xprt->xp_sock=%d, thread has %u pending requests",
                worker_index, xprt->XP_SOCK,
-               workers_data[worker_index].pending_request->nb_entry);
+               WorkQueue_Length(&workers_data[worker_index].pending_request));
 
   /* Get a pnfsreq from the worker's pool */
   P(workers_data[worker_index].request_pool_mutex);
@@ -940,40 +985,40 @@ free_req:
 /**
  * nfs_rpc_getreq: Do half of the work done by svc_getreqset.
  *
- * This function wait for an incoming ONC message by waiting on a 'select' statement. Then getting a request
- * it perform the authentication and extracts the RPC message for the related socket. It then find the less busy
+ * This function is called with the sockets reported as readable by the event engine. For each of them,
+ * it performs the authentication and extracts the RPC message for the related socket. It then find the less busy
  * worker (the one with the shortest pending queue) and put the msg in this queue.
  *
- * @param readfds File Descriptor Set related to the socket used for RPC management.
+ * Sockets are watched in edge-triggered mode, so a socket has to be drained before the engine notifies it again.
+ * To stay fair between sockets, at most NFS_DISPATCH_BATCH requests are read from a socket per call: sockets
+ * that still have data are kept in the array and will be processed again at next call.
+ *
+ * @param fds    [INOUT] sockets to be processed, on return sockets that still have pending data.
+ * @param nb_fds [INOUT] number of sockets in fds.
  *
  * @return Nothing (void function), but calls svcerr_* function to notify the client when an error occures.
  *
  */
-void nfs_rpc_getreq(fd_set * readfds)
+void nfs_rpc_getreq(int *fds, int *nb_fds)
 {
   register SVCXPRT *xprt;
-  register int bit;
-  register long mask, *maskp;
-  register int sock;
   register int rpc_sock;
+  int i, batch;
+  int nb_left = 0;
 
-  /* portable access to fds_bits field */
-  maskp = __FDS_BITS(readfds);
-
-  for(sock = 0; sock < FD_SETSIZE; sock += NFDBITS)
+  for(i = 0; i < *nb_fds; i++)
     {
-      for(mask = *maskp++; (bit = ffsl(mask)); mask ^= (1L << (bit - 1)))
-        {
-          /* sock has input waiting */
-          rpc_sock = sock + bit - 1;
+      rpc_sock = fds[i];
 
+      for(batch = 0; batch < NFS_DISPATCH_BATCH; batch++)
+        {
           xprt = Xports[rpc_sock];
           if(xprt == NULL)
             {
               /* But do we control sock? */
               LogCrit(COMPONENT_DISPATCH,
                       "CRITICAL ERROR: Incoherency found in Xports array");
-              continue;
+              break;
             }
 
           /*
@@ -1086,50 +1131,47 @@ void nfs_rpc_getreq(fd_set * readfds)
 #endif                          /* _USE_QUOTA */
           else
             {
-              /* This is a regular tcp request on an established connection, should be handle by a dedicated thread */
-              LogDebug(COMPONENT_DISPATCH,
-                       "A NFS TCP request from an already connected client");
+              /* This is a regular tcp request on an established connection. With TI-RPC, the
+               * record is reassembled without blocking and is only decoded once complete */
+              LogFullDebug(COMPONENT_DISPATCH,
+                           "A NFS TCP request from an already connected client");
             }
 
-          process_rpc_request(xprt);
+          if(process_rpc_request(xprt) == PROCESS_LOST_CONN)
+            break;
+
+          /* Drain the socket, the event engine won't notify it again until new data arrive */
+          if(!Svc_event_pending(rpc_sock))
+            break;
         }
+
+      /* Socket still readable after a full batch, keep it for next round */
+      if(batch == NFS_DISPATCH_BATCH)
+        fds[nb_left++] = rpc_sock;
     }
-}                               /* nfs_rpc_getreq */
 
-/**
- *
- * print_pending_request: prints an entry related to a pending request in the LRU list.
- *
- * prints an entry related to a pending request in the LRU list.
- *
- * @param data [IN] data stored in a LRU entry to be printed.
- * @param str [OUT] string used to store the result.
- *
- * @return 0 if ok, other values mean an error.
- *
- */
-int print_pending_request(LRU_data_t data, char *str)
-{
-  return snprintf(str, LRU_DISPLAY_STRLEN, "not implemented for now");
-}                               /* print_pending_request */
+  *nb_fds = nb_left;
+}                               /* nfs_rpc_getreq */
 
 /**
  * nfs_rpc_dispatcher_svc_run: the same as svc_run.
  *
- * The same as svc_run.
+ * The same as svc_run, restricted to the sockets of one shard of the event engine.
  *
- * @param none
+ * @param shard [IN] the event engine shard managed by this dispatcher.
  *
  * @return nothing (void function)
  *
  */
 
-void rpc_dispatcher_svc_run()
+void rpc_dispatcher_svc_run(unsigned int shard)
 {
-  fd_set readfdset;
-  int rc = 0;
+  int readyfds[SVC_EVENT_BATCH];
+  int newfds[SVC_EVENT_BATCH];
+  int nb_ready = 0;
+  int i, j, rc = 0;
 
-  static int nb_iter = 0;
+  int nb_iter = 0;
 
 #ifndef _NO_BUDDY_SYSTEM
   /* Init stat */
@@ -1138,39 +1180,47 @@ void rpc_dispatcher_svc_run()
 
   while(TRUE)
     {
-      /* Always work on a copy of Svc_fdset */
-      readfdset = Svc_fdset;
-
-      /* Select on a fdset build with all socket used in NFS/RPC */
       LogFullDebug(COMPONENT_DISPATCH,
-                   "rpc dispatcher thread waiting for incoming RPC requests");
+                   "rpc dispatcher thread #%u waiting for incoming RPC requests",
+                   shard);
 
-      /* Do the select on the RPC fdset */
-      rc = select(FD_SETSIZE, &readfdset, NULL, NULL, NULL);
+      /* Do not block if some sockets were left with pending data at previous round */
+      if(nb_ready < SVC_EVENT_BATCH)
+        rc = Svc_event_wait(shard, newfds, SVC_EVENT_BATCH - nb_ready,
+                            (nb_ready > 0) ? 0 : -1);
+      else
+        rc = 0;
 
       LogFullDebug(COMPONENT_DISPATCH,
-                   "Waiting for incoming RPC requests, after select rc=%d",
+                   "Waiting for incoming RPC requests, after wait rc=%d",
                    rc);
-      switch (rc)
+
+      if(rc < 0)
         {
-        case -1:
-          if(errno == EBADF)
-            {
-              LogCrit(COMPONENT_DISPATCH,
-                      "Select failed, error %d (%s)", errno, strerror(errno));
-              return;
-            }
-          break;
+          if(errno == EINTR)
+            continue;
 
-        case 0:
-          continue;
+          LogCrit(COMPONENT_DISPATCH,
+                  "Wait on RPC sockets failed, error %d (%s)", errno, strerror(errno));
+          return;
+        }
 
-        default:
-          LogFullDebug(COMPONENT_DISPATCH, "NFS SVC RUN: request(s) received");
-          nfs_rpc_getreq(&readfdset);
-          break;
+      /* Add the newly notified sockets to the ones already pending */
+      for(i = 0; i < rc; i++)
+        {
+          for(j = 0; j < nb_ready; j++)
+            if(readyfds[j] == newfds[i])
+              break;
+
+          if(j == nb_ready)
+            readyfds[nb_ready++] = newfds[i];
+        }
 
-        }                       /* switch */
+      if(nb_ready > 0)
+        {
+          LogFullDebug(COMPONENT_DISPATCH, "NFS SVC RUN: request(s) received");
+          nfs_rpc_getreq(readyfds, &nb_ready);
+        }
 
       if(nb_iter > 1000)
         {
@@ -1225,14 +1275,18 @@ void rpc_dispatcher_svc_run()
  * Thead used for RPC dispatching. It gets the requests and then spool it to one of the worker's LRU.
  * The worker chosen is the one with the smaller load (its LRU is the shorter one).
  *
- * @param Arg (unused)
+ * @param Arg the index of the event engine shard managed by this thread, cast as a void *
  *
  * @return Pointer to the result (but this function will mostly loop forever).
  *
  */
 void *rpc_dispatcher_thread(void *Arg)
 {
-  SetNameFunction("dispatch_thr");
+  unsigned int shard = (unsigned int)((unsigned long)Arg);
+  char thr_name[32];
+
+  snprintf(thr_name, sizeof(thr_name), "dispatch_thr#%u", shard);
+  SetNameFunction(thr_name);
 
 #ifndef _NO_BUDDY_SYSTEM
   /* Initialisation of the Buddy Malloc */
@@ -1249,7 +1303,7 @@ void *rpc_dispatcher_thread(void *Arg)
   LogDebug(COMPONENT_DISPATCH,
            "My pthread id is %p", (caddr_t) pthread_self());
 
-  rpc_dispatcher_svc_run();
+  rpc_dispatcher_svc_run(shard);
 
   return NULL;
 }                               /* rpc_dispatcher_thread */
@@ -71,6 +71,8 @@
  * rpc_tcp_socket_manager_thread: manages a TCP socket connected to a client.
  *
  * this thread will manage a connection related to a specific TCP client.
+ * It is only used with the ONCRPC RPCAL, whose record stream can only be read in blocking
+ * mode. With TI-RPC, connections are served by the RPC dispatcher threads.
  *
  * @param IndexArg contains the socket number to be managed by this thread
  *
@@ -468,9 +468,7 @@ static int get_pending(snmp_adm_type_union * param, void *opt_arg)
 
   for(i = 0; i < nfs_param.core_param.nb_worker; i++)
     {
-      len_pending_request =
-          workers_data[i].pending_request->nb_entry -
-          workers_data[i].pending_request->nb_invalid;
+      len_pending_request = WorkQueue_Length(&workers_data[i].pending_request);
 
       if((len_pending_request < min_pending_request)
          || (min_pending_request == MIN_NOT_SET))
@@ -49,6 +49,7 @@
 #include "nfs_core.h"
 #include "nfs_stat.h"
 #include "nfs_exports.h"
+#include "sal_functions.h"
 #include "log.h"
 
 extern hash_table_t *ht_ip_stats[NB_MAX_WORKER_THREAD];
@@ -92,6 +93,7 @@ void stats_collect (ganesha_stats_t                 *ganesha_stats)
     buddy_stats_t *global_buddy_stat = &ganesha_stats->global_buddy;
 #endif
     unsigned int           i, j;
+    unsigned long long     selected;
 
 
     /* Zeroing the cache_stats */
@@ -162,6 +164,10 @@ void stats_collect (ganesha_stats_t                 *ganesha_stats)
     ganesha_stats->total_pending_request = 0;
     ganesha_stats->average_pending_request = 0;
     ganesha_stats->len_pending_request = 0;
+    ganesha_stats->total_worker_selected = 0;
+    ganesha_stats->min_worker_selected = ~0ULL;
+    ganesha_stats->max_worker_selected = 0;
+    ganesha_stats->total_queue_full = 0;
 
     for (i = 0; i < nfs_param.core_param.nb_worker; i++) {
         global_worker_stat->nb_total_req += workers_data[i].stats.nb_total_req;
@@ -381,8 +387,7 @@ void stats_collect (ganesha_stats_t                 *ganesha_stats)
 
         /* Computing the pending request stats */
         ganesha_stats->len_pending_request =
-            workers_data[i].pending_request->nb_entry -
-            workers_data[i].pending_request->nb_invalid;
+            WorkQueue_Length(&workers_data[i].pending_request);
 
         if (ganesha_stats->len_pending_request < ganesha_stats->min_pending_request)
             ganesha_stats->min_pending_request = ganesha_stats->len_pending_request;
@@ -391,8 +396,21 @@ void stats_collect (ganesha_stats_t                 *ganesha_stats)
             ganesha_stats->max_pending_request = ganesha_stats->len_pending_request;
 
         ganesha_stats->total_pending_request += ganesha_stats->len_pending_request;
+
+        /* Computing the worker selection stats */
+        selected = atomic_fetch_uint64_t(&workers_data[i].nb_selected);
+        ganesha_stats->total_worker_selected += selected;
+        if (selected < ganesha_stats->min_worker_selected)
+            ganesha_stats->min_worker_selected = selected;
+        if (selected > ganesha_stats->max_worker_selected)
+            ganesha_stats->max_worker_selected = selected;
+        ganesha_stats->total_queue_full +=
+            atomic_fetch_uint64_t(&workers_data[i].pending_request.nb_full);
     }                       /* for( i = 0 ; i < nfs_param.core_param.nb_worker ; i++ ) */
 
+    ganesha_stats->nb_selection_scan = atomic_fetch_uint64_t(&worker_selection_stat.nb_scan);
+    ganesha_stats->nb_selection_default = atomic_fetch_uint64_t(&worker_selection_stat.nb_default);
+
     /* Compute average pending request */
     ganesha_stats->average_pending_request = ganesha_stats->total_pending_request / nfs_param.core_param.nb_worker;
 
@@ -405,8 +423,22 @@ void stats_collect (ganesha_stats_t                 *ganesha_stats)
         }
     }
 
-    /* Printing the cache inode hash stat */
-    nfs_dupreq_get_stats(&ganesha_stats->drc_udp, &ganesha_stats->drc_tcp);
+    /* Stats of the duplicate request cache */
+    nfs_dupreq_get_stats(&ganesha_stats->drc);
+
+    /* Lookups of the id mapper caches */
+    idmap_get_cache_stats(UIDMAP_TYPE, &ganesha_stats->uid_cache);
+    idmap_get_cache_stats(GIDMAP_TYPE, &ganesha_stats->gid_cache);
+    uid2grp_get_stats(&ganesha_stats->uid2grp_cache);
+
+    /* Files kept open by the cache */
+    cache_inode_get_fd_cache_stats(&ganesha_stats->fd_cache);
+
+    /* Unstable writes waiting to be written */
+    cache_inode_get_write_behind_stats(&ganesha_stats->write_behind);
+
+    /* NFSv4 read delegations */
+    state_deleg_get_stats(&ganesha_stats->deleg);
 
     /* Printing the UIDMAP_TYPE hash table stats */
     idmap_get_stats(UIDMAP_TYPE, &ganesha_stats->uid_map, &ganesha_stats->uid_reverse);
@@ -503,9 +535,17 @@ void *stats_thread(void *addr)
   hash_stat_t            *ip_name_hstat = &ganesha_stats.ip_name_map;
   hash_stat_t            *hstat_uid_reverse = &ganesha_stats.uid_reverse;
   hash_stat_t            *hstat_gid_reverse = &ganesha_stats.gid_reverse;
-  hash_stat_t            *hstat_drc_udp = &ganesha_stats.drc_udp;
-  hash_stat_t            *hstat_drc_tcp = &ganesha_stats.drc_tcp;
+  nfs_dupreq_stat_t      *drc_stat = &ganesha_stats.drc;
+  idmap_cache_stat_t     *idmap_stat[3] = { &ganesha_stats.uid_cache, &ganesha_stats.gid_cache,
+                                          &ganesha_stats.uid2grp_cache };
+  const char             *idmap_tag[3] = { "UIDMAP_CACHE", "GIDMAP_CACHE", "UID2GRP_CACHE" };
   fsal_statistics_t      *global_fsal_stat = &ganesha_stats.global_fsal;
+  cache_inode_fd_stat_t  *fd_stat = &ganesha_stats.fd_cache;
+  cache_inode_fd_stat_t   prev_fd_stat;
+  cache_inode_wb_stat_t  *wb_stat = &ganesha_stats.write_behind;
+  state_deleg_stat_t     *deleg_stat = &ganesha_stats.deleg;
+  time_t                  prev_time = time(NULL);
+  double                  elapsed;
 
 
 #ifndef _NO_BUDDY_SYSTEM
@@ -515,6 +555,8 @@ void *stats_thread(void *addr)
 
   SetNameFunction("stat_thr");
 
+  memset(&prev_fd_stat, 0, sizeof(prev_fd_stat));
+
 #ifndef _NO_BUDDY_SYSTEM
   if((rc = BuddyInit(NULL)) != BUDDY_SUCCESS)
     {
@@ -648,6 +690,31 @@ void *stats_thread(void *addr)
               cache_inode_stat->dynamic.err.nb_get, cache_inode_stat->dynamic.ok.nb_del,
               cache_inode_stat->dynamic.notfound.nb_del, cache_inode_stat->dynamic.err.nb_del);
 
+      /* Files kept open by the cache, with the opens and closes per second since the last dump */
+      elapsed = (current_time > prev_time) ? (double)(current_time - prev_time) : 1.0;
+      fprintf(stats_file, "FD_CACHE,%s;%u,%u|%llu,%llu,%llu,%llu|%.2f,%.2f\n",
+              strdate, fd_stat->nb_opened, fd_stat->max_opened,
+              (unsigned long long)fd_stat->nb_open, (unsigned long long)fd_stat->nb_close,
+              (unsigned long long)fd_stat->nb_reuse, (unsigned long long)fd_stat->nb_evict,
+              (fd_stat->nb_open - prev_fd_stat.nb_open) / elapsed,
+              (fd_stat->nb_close - prev_fd_stat.nb_close) / elapsed);
+      prev_fd_stat = *fd_stat;
+      prev_time = current_time;
+
+      /* Unstable writes kept in memory and written behind */
+      fprintf(stats_file, "WRITE_BEHIND,%s;%llu,%llu|%llu,%llu,%llu,%llu|%llu,%llu\n",
+              strdate, (unsigned long long)wb_stat->nb_dirty,
+              (unsigned long long)wb_stat->max_dirty,
+              (unsigned long long)wb_stat->nb_write, (unsigned long long)wb_stat->nb_coalesced,
+              (unsigned long long)wb_stat->nb_flush, (unsigned long long)wb_stat->nb_flushed_bytes,
+              (unsigned long long)wb_stat->nb_throttled, (unsigned long long)wb_stat->nb_error);
+
+      /* Read delegations granted and recalled */
+      fprintf(stats_file, "DELEGATIONS,%s;%u,%u|%llu,%llu,%llu,%llu,%llu\n",
+              strdate, deleg_stat->nb_held, deleg_stat->nb_recalling,
+              deleg_stat->nb_granted, deleg_stat->nb_recalled, deleg_stat->nb_returned,
+              deleg_stat->nb_revoked, deleg_stat->nb_cb_failed);
+
       fprintf(stats_file, "NFS/MOUNT STATISTICS,%s;%u,%u,%u|%u,%u,%u,%u,%u|%u,%u,%u,%u\n",
               strdate,
               global_worker_stat->nb_total_req,
@@ -663,6 +730,15 @@ void *stats_thread(void *addr)
               ganesha_stats.max_pending_request,
               ganesha_stats.average_pending_request);
 
+      fprintf(stats_file, "WORKER SELECTION,%s;%llu,%llu,%llu|%llu,%llu|%llu\n",
+              strdate,
+              ganesha_stats.total_worker_selected,
+              ganesha_stats.min_worker_selected,
+              ganesha_stats.max_worker_selected,
+              ganesha_stats.nb_selection_scan,
+              ganesha_stats.nb_selection_default,
+              ganesha_stats.total_queue_full);
+
       fprintf(stats_file, "MNT V1 REQUEST,%s;%u", strdate,
               global_worker_stat->stat_req.nb_mnt1_req);
       for(j = 0; j < MNT_V1_NB_COMMAND; j++)
@@ -760,24 +836,28 @@ void *stats_thread(void *addr)
       fprintf(stats_file, "\n");
 
       fprintf(stats_file,
-              "DUP_REQ_HASH,%s;%u,%u,%u,%u|%u,%u,%u|%u,%u,%u|%u,%u,%u|%u,%u,%u\n",
-              strdate, 
-              hstat_drc_udp->dynamic.nb_entries            + hstat_drc_tcp->dynamic.nb_entries,
-              hstat_drc_udp->computed.min_rbt_num_node     + hstat_drc_tcp->computed.min_rbt_num_node,
-              hstat_drc_udp->computed.max_rbt_num_node     + hstat_drc_tcp->computed.max_rbt_num_node,
-              hstat_drc_udp->computed.average_rbt_num_node + hstat_drc_tcp->computed.average_rbt_num_node,
-              hstat_drc_udp->dynamic.ok.nb_set             + hstat_drc_tcp->dynamic.ok.nb_set,
-              hstat_drc_udp->dynamic.notfound.nb_set       + hstat_drc_tcp->dynamic.notfound.nb_set,
-              hstat_drc_udp->dynamic.err.nb_set            + hstat_drc_tcp->dynamic.err.nb_set,
-              hstat_drc_udp->dynamic.ok.nb_test            + hstat_drc_tcp->dynamic.ok.nb_test,
-              hstat_drc_udp->dynamic.notfound.nb_test      + hstat_drc_tcp->dynamic.notfound.nb_test,
-              hstat_drc_udp->dynamic.err.nb_test           + hstat_drc_tcp->dynamic.err.nb_test,
-              hstat_drc_udp->dynamic.ok.nb_get             + hstat_drc_tcp->dynamic.ok.nb_get,
-              hstat_drc_udp->dynamic.notfound.nb_get       + hstat_drc_tcp->dynamic.notfound.nb_get,
-              hstat_drc_udp->dynamic.err.nb_get            + hstat_drc_tcp->dynamic.err.nb_get,
-              hstat_drc_udp->dynamic.ok.nb_del             + hstat_drc_tcp->dynamic.ok.nb_del,
-              hstat_drc_udp->dynamic.notfound.nb_del       + hstat_drc_tcp->dynamic.notfound.nb_del,
-              hstat_drc_udp->dynamic.err.nb_del            + hstat_drc_tcp->dynamic.err.nb_del);
+              "DUP_REQ_CACHE,%s;%u,%u,%llu|%llu,%llu,%llu|%llu,%llu\n",
+              strdate, drc_stat->nb_entries, drc_stat->nb_clients,
+              (unsigned long long)drc_stat->mem_space,
+              (unsigned long long)drc_stat->nb_hits,
+              (unsigned long long)drc_stat->nb_in_progress,
+              (unsigned long long)drc_stat->nb_misses,
+              (unsigned long long)drc_stat->nb_evicted_size,
+              (unsigned long long)drc_stat->nb_evicted_age);
+
+      for(j = 0; j < 3; j++)
+        fprintf(stats_file,
+                "%s,%s;%llu,%llu,%llu|%llu|%llu,%llu,%llu,%llu\n",
+                idmap_tag[j], strdate,
+                (unsigned long long)idmap_stat[j]->nb_hits,
+                (unsigned long long)idmap_stat[j]->nb_negative_hits,
+                (unsigned long long)idmap_stat[j]->nb_misses,
+                (unsigned long long)idmap_stat[j]->nb_refresh,
+                (unsigned long long)idmap_stat[j]->nb_resolve,
+                (unsigned long long)idmap_stat[j]->nb_resolve_failed,
+                (unsigned long long)(idmap_stat[j]->nb_resolve ?
+                                     idmap_stat[j]->resolve_usec / idmap_stat[j]->nb_resolve : 0),
+                (unsigned long long)idmap_stat[j]->max_resolve_usec);
 
       fprintf(stats_file,
               "UIDMAP_HASH,%s;%u,%u,%u,%u|%u,%u,%u|%u,%u,%u|%u,%u,%u|%u,%u,%u\n", strdate,
@@ -867,6 +947,21 @@ void *stats_thread(void *addr)
 
 #endif
 
+#ifdef _USE_SLAB_ALLOC
+      {
+        slab_stats_t slab_stats;
+
+        /* for each cache: objects allocated, in use, slabs mapped, max and released */
+        for(j = 0; SlabGetStats(j, &slab_stats) == 0; j++)
+          if(slab_stats.nb_alloc != 0)
+            fprintf(stats_file, "SLAB_MEMORY,%s;%s,%lu|%llu,%llu|%u,%u,%llu\n",
+                    strdate, slab_stats.name, (unsigned long)slab_stats.size,
+                    slab_stats.nb_alloc, slab_stats.nb_alloc - slab_stats.nb_free,
+                    slab_stats.nb_slabs, slab_stats.wm_nb_slabs,
+                    slab_stats.nb_slabs_released);
+      }
+#endif
+
       /* Flush the data written */
       fprintf(stats_file, "END, ----- NO MORE STATS FOR THIS PASS ----\n");
       fflush(stats_file);
@@ -47,6 +47,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include <fcntl.h>
 #include <sys/file.h>           /* for having FNDELAY */
 #include "HashData.h"
@@ -77,10 +78,6 @@ void nfs_debug_debug_label_info();
 
 extern nfs_worker_data_t *workers_data;
 
-/* These two variables keep state of the thread that gc at this time */
-unsigned int nb_current_gc_workers;
-pthread_mutex_t lock_nb_current_gc_workers;
-
 const nfs_function_desc_t invalid_funcdesc =
   {nfs_Null, nfs_Null_Free, (xdrproc_t) xdr_void, (xdrproc_t) xdr_void, "invalid_function",
    NOTHING_SPECIAL};
@@ -181,7 +178,7 @@ const nfs_function_desc_t nfs4_func_desc[] = {
   {nfs_Null, nfs_Null_Free, (xdrproc_t) xdr_void, (xdrproc_t) xdr_void, "nfs_Null",
    NOTHING_SPECIAL},
   {nfs4_Compound, nfs4_Compound_Free, (xdrproc_t) xdr_COMPOUND4args,
-   (xdrproc_t) xdr_COMPOUND4res, "nfs4_Compound", NEEDS_CRED }
+   (xdrproc_t) nfs4_xdr_COMPOUND4res, "nfs4_Compound", NEEDS_CRED }
    /* SUPPORTS_GSS is missing from this list because while NFS v4 does indeed support GSS, we won't check it yet */
 };
 
@@ -363,33 +360,6 @@ const nfs_function_desc_t rquota2_func_desc[] = {
 
 extern const char *pause_state_str[];
 
-/**
- * nfs_Init_gc_counter: Init the worker's gc counters.
- *
- * This functions is used to init a mutex and a counter associated with it, to keep track of the number of worker currently
- * performing the garbagge collection.
- *
- * @param void No parameters
- *
- * @return 0 if successfull, -1 otherwise.
- *
- */
-
-int nfs_Init_gc_counter(void)
-{
-  pthread_mutexattr_t mutexattr;
-
-  if(pthread_mutexattr_init(&mutexattr) != 0)
-    return -1;
-
-  if(pthread_mutex_init(&lock_nb_current_gc_workers, &mutexattr) != 0)
-    return -1;
-
-  nb_current_gc_workers = 0;
-
-  return 0;                     /* Success */
-}                               /* nfs_Init_gc_counter */
-
 struct timeval time_diff(struct timeval time_from, struct timeval time_to)
 {
 
@@ -411,19 +381,17 @@ struct timeval time_diff(struct timeval time_from, struct timeval time_to)
 
 /**
  *
- * clean_pending_request: cleans an entry in a nfs request LRU,
+ * clean_pending_request: releases a processed request.
  *
- * cleans an entry in a nfs request LRU.
+ * releases a processed request.
  *
- * @param pentry [INOUT] entry to be cleaned.
+ * @param preq [INOUT] request to be released.
  * @param request_pool [IN] the memory pool into which the request is put back
  */
-static inline void clean_pending_request(LRU_entry_t * pentry, struct prealloc_pool *request_pool)
+static inline void clean_pending_request(request_data_t * preq, struct prealloc_pool *request_pool)
 {
-  nfs_request_data_t *preqnfs = (nfs_request_data_t *) (pentry->buffdata.pdata);
-
   /* Send the entry back to the pool */
-  ReleaseToPool(preqnfs, request_pool);
+  ReleaseToPool(preq, request_pool);
 }                               /* clean_pending_request */
 
 /**
@@ -694,7 +662,8 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
   nfs_arg_t *parg_nfs = &preqnfs->arg_nfs;
   nfs_res_t res_nfs;
   short exportid;
-  LRU_list_t *lru_dupreq = NULL;
+  dupreq_entry_t *pdupreq = NULL;
+  int reply_cached = FALSE;
   struct svc_req *ptr_req = &preqnfs->req;
   SVCXPRT *ptr_svc = preqnfs->xprt;
   nfs_stat_type_t stat_type;
@@ -718,9 +687,6 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
   struct timeval queue_timer_diff;
   nfs_request_latency_stat_t latency_stat;
 
-  /* Get the value from the worker data */
-  lru_dupreq = pworker_data->duplicate_request;
-
   /* initializing RPC structure */
   memset(&res_nfs, 0, sizeof(res_nfs));
 
@@ -758,8 +724,8 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
   status = nfs_dupreq_add_not_finished(rpcxid,
                                        ptr_req,
                                        preqnfs->xprt,
-                                       &pworker_data->dupreq_pool,
-                                       &res_nfs);
+                                       do_dupreq_cache,
+                                       &pdupreq);
   switch(status)
     {
       /* a new request, continue processing it */
@@ -781,8 +747,9 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
 
           P(mutex_cond_xprt[ptr_svc->XP_SOCK]);
 
+          /* The reply is cached in its encoded form */
           if(svc_sendreply
-             (ptr_svc, pworker_data->pfuncdesc->xdr_encode_func, (caddr_t) & res_nfs) == FALSE)
+             (ptr_svc, (xdrproc_t) nfs_dupreq_xdr_reply, (caddr_t) pdupreq) == FALSE)
             {
               LogDebug(COMPONENT_DISPATCH,
                        "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply");
@@ -794,6 +761,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
           LogFullDebug(COMPONENT_DISPATCH,
                        "After svc_sendreply on socket %d (dup req)",
                        ptr_svc->XP_SOCK);
+          nfs_dupreq_rele(pdupreq);
           return;
         }
       else
@@ -801,6 +769,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
           LogCrit(COMPONENT_DISPATCH,
                   "Error: Duplicate request rejected because it was found in the cache but is not allowed to be cached.");
           svcerr_systemerr(ptr_svc);
+          nfs_dupreq_rele(pdupreq);
           return;
         }
       break;
@@ -884,8 +853,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                     }
                   /* Bad argument */
                   svcerr_auth(ptr_svc, AUTH_FAILED);
-                  if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                        &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                  if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                     {
                       LogCrit(COMPONENT_DISPATCH,
                               "Attempt to delete duplicate request failed on line %d",
@@ -934,8 +902,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                     }
                   /* Bad argument */
                   svcerr_auth(ptr_svc, AUTH_FAILED);
-                  if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                        &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                  if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                     {
                       LogCrit(COMPONENT_DISPATCH,
                               "Attempt to delete duplicate request failed on line %d",
@@ -1039,8 +1006,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                 }
               /* Bad argument */
               svcerr_auth(ptr_svc, AUTH_FAILED);
-              if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                    &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+              if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                 {
                   LogCrit(COMPONENT_DISPATCH,
                           "Attempt to delete duplicate request failed on line %d",
@@ -1075,8 +1041,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                         "Export %s does not support AUTH_NONE",
                         pexport->dirname);
                 svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-                if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                      &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                   {
                     LogCrit(COMPONENT_DISPATCH,
                             "Attempt to delete duplicate request failed on line %d",
@@ -1093,8 +1058,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                         "Export %s does not support AUTH_UNIX",
                         pexport->dirname);
                 svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-                if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                      &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                   {
                     LogCrit(COMPONENT_DISPATCH,
                             "Attempt to delete duplicate request failed on line %d",
@@ -1114,8 +1078,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                 LogInfo(COMPONENT_DISPATCH,
                         "Export %s does not support RPCSEC_GSS",
                         pexport->dirname);
-                if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                      &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                   {
                     LogCrit(COMPONENT_DISPATCH,
                             "Attempt to delete duplicate request failed on line %d",
@@ -1141,8 +1104,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                                   "Export %s does not support RPCSEC_GSS_SVC_NONE",
                                   pexport->dirname);
                           svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-                          if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                                &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                          if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                             {
                               LogCrit(COMPONENT_DISPATCH,
                                       "Attempt to delete duplicate request failed on line %d",
@@ -1159,8 +1121,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                                   "Export %s does not support RPCSEC_GSS_SVC_INTEGRITY",
                                   pexport->dirname);
                           svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-                          if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                                &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                          if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                             {
                               LogCrit(COMPONENT_DISPATCH,
                                       "Attempt to delete duplicate request failed on line %d",
@@ -1177,8 +1138,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                                   "Export %s does not support RPCSEC_GSS_SVC_PRIVACY",
                                   pexport->dirname);
                           svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-                          if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                                &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                          if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                             {
                               LogCrit(COMPONENT_DISPATCH,
                                       "Attempt to delete duplicate request failed on line %d",
@@ -1193,8 +1153,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                               "Export %s does not support unknown RPCSEC_GSS_SVC %d",
                               pexport->dirname, (int) svc);
                       svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-                      if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                            &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+                      if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                         {
                           LogCrit(COMPONENT_DISPATCH,
                                   "Attempt to delete duplicate request failed on line %d",
@@ -1210,8 +1169,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                     "Export %s does not support unknown oa_flavor %d",
                     pexport->dirname, (int) ptr_req->rq_cred.oa_flavor);
             svcerr_auth(ptr_svc, AUTH_TOOWEAK);
-            if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                  &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+            if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
               {
                 LogCrit(COMPONENT_DISPATCH,
                         "Attempt to delete duplicate request failed on line %d",
@@ -1244,8 +1202,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
           svcerr_auth(ptr_svc, AUTH_TOOWEAK);
           pworker_data->current_xid = 0;    /* No more xid managed */
 
-          if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+          if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
             {
               LogCrit(COMPONENT_DISPATCH,
                       "Attempt to delete duplicate request failed on line %d",
@@ -1264,8 +1221,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
           svcerr_auth(ptr_svc, AUTH_TOOWEAK);
           pworker_data->current_xid = 0;    /* No more xid managed */
 
-          if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+          if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
             {
               LogCrit(COMPONENT_DISPATCH,
                       "Attempt to delete duplicate request failed on line %d",
@@ -1310,8 +1266,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
       svcerr_auth( ptr_svc, AUTH_TOOWEAK );
       pworker_data->current_xid = 0;        /* No more xid managed */
 
-      if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                            &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+      if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
         {
           LogCrit(COMPONENT_DISPATCH,
                   "Attempt to delete duplicate request failed on line %d",
@@ -1382,8 +1337,7 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
               svcerr_auth(ptr_svc, AUTH_TOOWEAK);
               pworker_data->current_xid = 0;    /* No more xid managed */
 
-              if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                    &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
+              if (nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
                 {
                   LogCrit(COMPONENT_DISPATCH,
                          "Attempt to delete duplicate request failed on line %d",
@@ -1492,20 +1446,24 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                rpcxid, (int)ptr_req->rq_prog,
                (int)ptr_req->rq_vers, (int)ptr_req->rq_proc);
 
-      /* If the request is not normally cached, then the entry will be removed
-       * later. We only remove a reply that is normally cached that has been
-       * dropped. */
-      if(do_dupreq_cache)
-        if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                              &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
-          {
-            LogCrit(COMPONENT_DISPATCH,
-                    "Attempt to delete duplicate request failed on line %d",
-                    __LINE__);
-          }
+      /* The entry of the request is removed below, the request was not
+       * answered and a retransmission will be processed again. */
     }
   else
     {
+      /* Cache the reply in its encoded form before sending it, so that a
+       * retransmission is answered as soon as the reply is sent */
+      if(do_dupreq_cache && pdupreq != NULL)
+        {
+          if(nfs_dupreq_finish(&pdupreq, pworker_data->pfuncdesc->xdr_encode_func,
+                               &res_nfs) == DUPREQ_SUCCESS)
+            reply_cached = TRUE;
+          else
+            LogCrit(COMPONENT_DISPATCH,
+                    "Could not cache the reply of xid=%u in the duplicate request cache",
+                    rpcxid);
+        }
+
       P(mutex_cond_xprt[ptr_svc->XP_SOCK]);
 
       LogFullDebug(COMPONENT_DISPATCH,
@@ -1514,22 +1472,16 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
 
       /* encoding the result on xdr output */
       CheckXprt(ptr_svc);
-      if(svc_sendreply(ptr_svc, pworker_data->pfuncdesc->xdr_encode_func, (caddr_t) & res_nfs) == FALSE)
+      if(reply_cached)
+        status = svc_sendreply(ptr_svc, (xdrproc_t) nfs_dupreq_xdr_reply, (caddr_t) pdupreq);
+      else
+        status = svc_sendreply(ptr_svc, pworker_data->pfuncdesc->xdr_encode_func,
+                               (caddr_t) & res_nfs);
+      if(status == FALSE)
         {
           LogDebug(COMPONENT_DISPATCH,
                    "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply");
           svcerr_systemerr(ptr_svc);
-
-          V(mutex_cond_xprt[ptr_svc->XP_SOCK]);
-
-          if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                                &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
-            {
-              LogCrit(COMPONENT_DISPATCH,
-                      "Attempt to delete duplicate request failed on line %d",
-                      __LINE__);
-            }
-          return;
         }
 
       LogFullDebug(COMPONENT_DISPATCH,
@@ -1537,19 +1489,17 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                    ptr_svc->XP_SOCK);
 
       V(mutex_cond_xprt[ptr_svc->XP_SOCK]);
-
-      /* Mark request as finished */
-      LogFullDebug(COMPONENT_DUPREQ, "YES?: %d", do_dupreq_cache);
-      if(do_dupreq_cache)
-        {
-          status = nfs_dupreq_finish(rpcxid,
-                                     ptr_req,
-                                     preqnfs->xprt,
-                                     &res_nfs,
-                                     lru_dupreq);
-        }
     } /* rc == NFS_REQ_DROP */
 
+  /* The request is finished: its entry in the duplicate request cache is
+   * kept with the reply cached, or removed */
+  if(reply_cached)
+    nfs_dupreq_rele(pdupreq);
+  else if(nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS)
+    LogCrit(COMPONENT_DISPATCH,
+            "Attempt to delete duplicate request failed on line %d",
+            __LINE__);
+
   /* Free the allocated resources once the work is done */
   /* Free the arguments */
   if(preqnfs->req.rq_vers == 2 || preqnfs->req.rq_vers == 3 || preqnfs->req.rq_vers == 4)
@@ -1560,24 +1510,10 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
                 pworker_data->pfuncdesc->funcname);
       }
 
-  /* Free the reply.
-   * This should not be done if the request is dupreq cached because this will
-   * mark the dupreq cached info eligible for being reuse by other requests */
-  if(!do_dupreq_cache)
-    {
-      if (nfs_dupreq_delete(rpcxid, ptr_req, preqnfs->xprt,
-                            &pworker_data->dupreq_pool) != DUPREQ_SUCCESS)
-        {
-          LogCrit(COMPONENT_DISPATCH,
-                  "Attempt to delete duplicate request failed on line %d",
-                  __LINE__);
-        }
-      /* Free only the non dropped requests */
-      if(rc == NFS_REQ_OK) {
-        pworker_data->pfuncdesc->free_function(&res_nfs);
-      }
-
-    }
+  /* Free the reply, the duplicate request cache keeps its encoded form.
+   * Free only the non dropped requests */
+  if(rc == NFS_REQ_OK)
+    pworker_data->pfuncdesc->free_function(&res_nfs);
 #ifdef _DEBUG_MEMLEAKS
   if(nb_iter_memleaks > 1000)
     {
@@ -1606,10 +1542,22 @@ static void nfs_rpc_execute(nfs_request_data_t * preqnfs,
   return;
 }                               /* nfs_rpc_execute */
 
-worker_available_rc worker_available(unsigned long worker_index, unsigned int avg_number_pending)
+/**
+ * worker_available: tells if a worker can be given a new request.
+ *
+ * The worker's state is read without taking its tcb_mutex: this is called
+ * for every request, and a stale answer only means a slightly worse choice.
+ * The state is checked again under lock by the worker itself.
+ *
+ * @param worker_index [IN] index of the worker.
+ *
+ * @return WORKER_AVAILABLE if the request may be queued to this worker.
+ *
+ */
+worker_available_rc worker_available(unsigned long worker_index)
 {
   worker_available_rc rc = WORKER_AVAILABLE;
-  P(workers_data[worker_index].wcb.tcb_mutex);
+
   switch(workers_data[worker_index].wcb.tcb_state)
     {
       case STATE_AWAKE:
@@ -1627,7 +1575,8 @@ worker_available_rc worker_available(unsigned long worker_index, unsigned int av
                          "worker thread #%lu is doing garbage collection", worker_index);
             rc = WORKER_GC;
           }
-        else if(workers_data[worker_index].pending_request->nb_entry >= avg_number_pending)
+        else if(WorkQueue_Length(&workers_data[worker_index].pending_request) >=
+                nfs_param.worker_param.pending_queue_size)
           {
             rc = WORKER_BUSY;
           }
@@ -1643,10 +1592,9 @@ worker_available_rc worker_available(unsigned long worker_index, unsigned int av
         rc = WORKER_EXIT;
         break;
     }
-  V(workers_data[worker_index].wcb.tcb_mutex);
 
   return rc;
-}
+}                               /* worker_available */
 
 /**
  * nfs_Init_worker_data: Init the data associated with a worker instance.
@@ -1663,7 +1611,6 @@ worker_available_rc worker_available(unsigned long worker_index, unsigned int av
 
 int nfs_Init_worker_data(nfs_worker_data_t * pdata)
 {
-  LRU_status_t status = LRU_LIST_SUCCESS;
   char name[256];
 
   if(pthread_mutex_init(&(pdata->request_pool_mutex), NULL) != 0)
@@ -1673,27 +1620,17 @@ int nfs_Init_worker_data(nfs_worker_data_t * pdata)
   if(tcb_new(&(pdata->wcb), name) != 0)
     return -1;
 
-  sprintf(name, "Worker Thread #%u Pending Request", pdata->worker_index);
-  nfs_param.worker_param.lru_param.lp_name = name;
-
-  if((pdata->pending_request =
-      LRU_Init(nfs_param.worker_param.lru_param, &status)) == NULL)
-    {
-      LogError(COMPONENT_DISPATCH, ERR_LRU, ERR_LRU_LIST_INIT, status);
-      return -1;
-    }
-
-  sprintf(name, "Worker Thread #%u Duplicate Request", pdata->worker_index);
-  nfs_param.worker_param.lru_dupreq.lp_name = name;
-
-  if((pdata->duplicate_request =
-      LRU_Init(nfs_param.worker_param.lru_dupreq, &status)) == NULL)
+  if(WorkQueue_Init(&pdata->pending_request,
+                    nfs_param.worker_param.pending_queue_size) != WORKQUEUE_SUCCESS)
     {
-      LogError(COMPONENT_DISPATCH, ERR_LRU, ERR_LRU_LIST_INIT, status);
+      LogCrit(COMPONENT_DISPATCH,
+              "Could not allocate the pending request queue of Worker Thread #%u",
+              pdata->worker_index);
       return -1;
     }
 
   pdata->passcounter = 0;
+  pdata->nb_selected = 0;
   pdata->wcb.tcb_ready = FALSE;
   pdata->gc_in_progress = FALSE;
   pdata->pfuncdesc = INVALID_FUNCDESC;
@@ -1701,46 +1638,56 @@ int nfs_Init_worker_data(nfs_worker_data_t * pdata)
   return 0;
 }                               /* nfs_Init_worker_data */
 
-void DispatchWorkNFS(request_data_t *pnfsreq, unsigned int worker_index)
+/**
+ * nfs_worker_queue_request: hands a request over to a worker.
+ *
+ * Pushes the request into the worker's pending queue without taking any
+ * lock. The worker's mutex is only taken when the worker went to sleep on
+ * an empty queue, by the one producer that has to wake it up. If the queue
+ * is full, the caller waits for the worker to catch up.
+ *
+ * @param preq [IN] the request to be processed.
+ * @param worker_index [IN] index of the worker that will process it.
+ *
+ * @return nothing (void function)
+ *
+ */
+void nfs_worker_queue_request(request_data_t *preq, unsigned int worker_index)
 {
-  LRU_entry_t *pentry = NULL;
-  LRU_status_t status;
-  struct svc_req *ptr_req = &pnfsreq->rcontent.nfs.req;
-  unsigned int rpcxid = get_rpc_xid(ptr_req);
+  work_queue_t *pqueue = &workers_data[worker_index].pending_request;
 
-  LogDebug(COMPONENT_DISPATCH,
-           "Awaking Worker Thread #%u for request %p, xid=%u",
-           worker_index, pnfsreq, rpcxid);
-
-  P(workers_data[worker_index].wcb.tcb_mutex);
-  P(workers_data[worker_index].request_pool_mutex);
-
-  pentry = LRU_new_entry(workers_data[worker_index].pending_request, &status);
-
-  if(pentry == NULL)
+  while(WorkQueue_Push(pqueue, preq) == WORKQUEUE_FULL)
     {
-      V(workers_data[worker_index].request_pool_mutex);
-      V(workers_data[worker_index].wcb.tcb_mutex);
-      LogMajor(COMPONENT_DISPATCH,
-               "Error while inserting pending request to Worker Thread #%u... Exiting",
-               worker_index);
-      Fatal();
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Worker Thread #%u's queue is full, waiting", worker_index);
+      sched_yield();
     }
 
-  pentry->buffdata.pdata = (caddr_t) pnfsreq;
-  pentry->buffdata.len = sizeof(*pnfsreq);
+  if(!WorkQueue_NeedWakeup(pqueue))
+    return;
 
+  P(workers_data[worker_index].wcb.tcb_mutex);
   if(pthread_cond_signal(&(workers_data[worker_index].wcb.tcb_condvar)) == -1)
     {
-      V(workers_data[worker_index].request_pool_mutex);
       V(workers_data[worker_index].wcb.tcb_mutex);
       LogMajor(COMPONENT_THREAD,
                "Error %d (%s) while signalling Worker Thread #%u... Exiting",
                errno, strerror(errno), worker_index);
       Fatal();
     }
-  V(workers_data[worker_index].request_pool_mutex);
   V(workers_data[worker_index].wcb.tcb_mutex);
+}                               /* nfs_worker_queue_request */
+
+void DispatchWorkNFS(request_data_t *pnfsreq, unsigned int worker_index)
+{
+  struct svc_req *ptr_req = &pnfsreq->rcontent.nfs.req;
+  unsigned int rpcxid = get_rpc_xid(ptr_req);
+
+  LogDebug(COMPONENT_DISPATCH,
+           "Awaking Worker Thread #%u for request %p, xid=%u",
+           worker_index, pnfsreq, rpcxid);
+
+  nfs_worker_queue_request(pnfsreq, worker_index);
 }
 
 enum auth_stat AuthenticateRequest(nfs_request_data_t *pnfsreq,
@@ -1822,6 +1769,9 @@ static void _9p_execute( _9p_request_data_t * preq9p,
                           nfs_worker_data_t * pworker_data)
 {
   _9p_process_request( preq9p, pworker_data ) ;
+
+  /* The reply is sent, the connection can go away */
+  _9p_conn_release( preq9p->pconn ) ;
   return ;
 } /* _9p_execute */
 #endif
@@ -1842,12 +1792,11 @@ void *worker_thread(void *IndexArg)
 {
   nfs_worker_data_t *pmydata;
   request_data_t *pnfsreq;
-  LRU_entry_t  out_entry;
   struct svc_req *preq;
   unsigned long worker_index;
+#ifndef _NO_BUDDY_SYSTEM
   int rc = 0;
-  cache_inode_status_t cache_status = CACHE_INODE_SUCCESS;
-  unsigned int gc_allowed = FALSE;
+#endif
   char thr_name[32];
 
 #ifdef _USE_MFSL
@@ -1874,8 +1823,8 @@ void *worker_thread(void *IndexArg)
     }
 
   LogFullDebug(COMPONENT_DISPATCH,
-               "Starting, nb_entry=%d",
-               pmydata->pending_request->nb_entry);
+               "Starting, nb_entry=%u",
+               WorkQueue_Length(&pmydata->pending_request));
   /* Initialisation of the Buddy Malloc */
 #ifndef _NO_BUDDY_SYSTEM
   if((rc = BuddyInit(&nfs_param.buddy_param_worker)) != BUDDY_SUCCESS)
@@ -1986,23 +1935,20 @@ void *worker_thread(void *IndexArg)
 
       /* Wait on condition variable for work to be done */
       LogFullDebug(COMPONENT_DISPATCH,
-                   "waiting for requests to process, nb_entry=%d, nb_invalid=%d",
-                   pmydata->pending_request->nb_entry,
-                   pmydata->pending_request->nb_invalid);
+                   "waiting for requests to process, nb_entry=%u",
+                   WorkQueue_Length(&pmydata->pending_request));
 
       /* Get the state without lock first, if things are fine
        * don't bother to check under lock.
        */
       if((pmydata->wcb.tcb_state != STATE_AWAKE) ||
-          (pmydata->pending_request->nb_entry ==
-           pmydata->pending_request->nb_invalid))
+          WorkQueue_IsEmpty(&pmydata->pending_request))
         {
           while(1)
             {
               P(pmydata->wcb.tcb_mutex);
               if(pmydata->wcb.tcb_state == STATE_AWAKE &&
-                 (pmydata->pending_request->nb_entry !=
-                  pmydata->pending_request->nb_invalid))
+                 !WorkQueue_IsEmpty(&pmydata->pending_request))
                 {
                   V(pmydata->wcb.tcb_mutex);
                   break;
@@ -2014,15 +1960,15 @@ void *worker_thread(void *IndexArg)
                     continue;
 
                   case THREAD_SM_BREAK:
-                    if(pmydata->pending_request->nb_entry ==
-                        pmydata->pending_request->nb_invalid)
+                    /* No work; tell the producers we sleep, then wait */
+                    if(WorkQueue_PrepareSleep(&pmydata->pending_request))
                       {
-                        /* No work; wait */
                         pthread_cond_wait(&(pmydata->wcb.tcb_condvar),
                                           &(pmydata->wcb.tcb_mutex));
-                        V(pmydata->wcb.tcb_mutex);
-                        continue;
+                        WorkQueue_CancelSleep(&pmydata->pending_request);
                       }
+                    V(pmydata->wcb.tcb_mutex);
+                    continue;
 
                   case THREAD_SM_EXIT:
                     LogDebug(COMPONENT_DISPATCH, "Worker exiting as requested");
@@ -2033,29 +1979,24 @@ void *worker_thread(void *IndexArg)
         }
 
       LogFullDebug(COMPONENT_DISPATCH,
-                   "Processing a new request, pause_state: %s, nb_entry=%u, nb_invalid=%u",
+                   "Processing a new request, pause_state: %s, nb_entry=%u",
                    pause_state_str[pmydata->wcb.tcb_state],
-                   pmydata->pending_request->nb_entry,
-                   pmydata->pending_request->nb_invalid);
+                   WorkQueue_Length(&pmydata->pending_request));
 
-      P(pmydata->request_pool_mutex);
-      if (LRU_pop_entry(pmydata->pending_request, &out_entry) == LRU_LIST_EMPTY_LIST) {
+      if((pnfsreq = WorkQueue_Pop(&pmydata->pending_request)) == NULL)
+        {
           LogMajor(COMPONENT_DISPATCH,
                    "No pending request available");
           continue;             /* return to main loop */
-      }
-      V(pmydata->request_pool_mutex);
-
-      pnfsreq = (request_data_t *) (out_entry.buffdata.pdata);
+        }
      
       switch( pnfsreq->rtype )
        {
           case NFS_REQUEST:
            LogFullDebug(COMPONENT_DISPATCH,
-                        "I have some work to do, pnfsreq=%p, length=%d, invalid=%d, xid=%lu",
+                        "I have some work to do, pnfsreq=%p, length=%u, xid=%lu",
                         pnfsreq,
-                        pmydata->pending_request->nb_entry,
-                        pmydata->pending_request->nb_invalid,
+                        WorkQueue_Length(&pmydata->pending_request),
                         (unsigned long) pnfsreq->rcontent.nfs.msg.rm_xid);
 
            if(pnfsreq->rcontent.nfs.xprt->XP_SOCK == 0)
@@ -2097,44 +2038,11 @@ void *worker_thread(void *IndexArg)
       LogFullDebug(COMPONENT_DISPATCH,
                    "Invalidating processed entry");
       P(pmydata->request_pool_mutex);
-      clean_pending_request(&out_entry, &pmydata->request_pool);
+      clean_pending_request(pnfsreq, &pmydata->request_pool);
       V(pmydata->request_pool_mutex);
 
       if(pmydata->passcounter > nfs_param.worker_param.nb_before_gc)
         {
-          /* Garbage collection on dup req cache */
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "before dupreq invalidation nb_entry=%d nb_invalid=%d",
-                       pmydata->duplicate_request->nb_entry,
-                       pmydata->duplicate_request->nb_invalid);
-          if((rc =
-              LRU_invalidate_by_function(pmydata->duplicate_request,
-                                         nfs_dupreq_gc_function,
-                                         NULL)) != LRU_LIST_SUCCESS)
-            {
-              LogCrit(COMPONENT_DISPATCH,
-                      "FAILURE: Impossible to invalidate entries for duplicate request cache (error %d)",
-                      rc);
-            }
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "after dupreq invalidation nb_entry=%d nb_invalid=%d",
-                       pmydata->duplicate_request->nb_entry,
-                       pmydata->duplicate_request->nb_invalid);
-          if((rc =
-              LRU_gc_invalid(pmydata->duplicate_request,
-                             (void *)&pmydata->dupreq_pool)) != LRU_LIST_SUCCESS)
-            LogCrit(COMPONENT_DISPATCH,
-                    "FAILURE: Impossible to gc entries for duplicate request cache (error %d)",
-                    rc);
-          else
-            LogFullDebug(COMPONENT_DISPATCH,
-                         "gc entries for duplicate request cache OK");
-
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "after dupreq gc nb_entry=%d nb_invalid=%d",
-                       pmydata->duplicate_request->nb_entry,
-                       pmydata->duplicate_request->nb_invalid);
-
           /* Performing garbabbge collection */
           LogFullDebug(COMPONENT_DISPATCH,
                        "Garbage collecting on pending request list");
@@ -2146,41 +2054,8 @@ void *worker_thread(void *IndexArg)
                      pmydata->passcounter, nfs_param.worker_param.nb_before_gc);
       pmydata->passcounter += 1;
 
-      /* If needed, perform garbage collection on cache_inode layer */
-      P(lock_nb_current_gc_workers);
-      if(nb_current_gc_workers < nfs_param.core_param.nb_max_concurrent_gc)
-        {
-          nb_current_gc_workers += 1;
-          gc_allowed = TRUE;
-        }
-      else
-        gc_allowed = FALSE;
-      V(lock_nb_current_gc_workers);
-
+      /* The cache_inode entries are garbage collected by the reclaimer threads */
       P(pmydata->wcb.tcb_mutex);
-      if(gc_allowed == TRUE && pmydata->wcb.tcb_state == STATE_AWAKE)
-        {
-          pmydata->gc_in_progress = TRUE;
-          V(pmydata->wcb.tcb_mutex);
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "There are %d concurrent garbage collection",
-                       nb_current_gc_workers);
-
-          if(cache_inode_gc(pmydata->ht,
-                            &(pmydata->cache_inode_client),
-                            &cache_status) != CACHE_INODE_SUCCESS)
-            {
-              LogCrit(COMPONENT_DISPATCH,
-                      "NFS WORKER: FAILURE: Bad cache_inode garbage collection");
-            }
-
-          P(lock_nb_current_gc_workers);
-          nb_current_gc_workers -= 1;
-          V(lock_nb_current_gc_workers);
-
-          P(pmydata->wcb.tcb_mutex);
-          pmydata->gc_in_progress = FALSE;
-        }
 #ifdef _USE_MFSL
       /* As MFSL context are refresh, and because this could be a time consuming operation, the worker is
        * set as "making garbagge collection" to avoid new requests to come in its pending queue */
@@ -0,0 +1,84 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * nfs_write_behind_thread.c : writes the unstable writes kept in memory.
+ *
+ * The unstable writes of the exports using the Ganesha write buffer are
+ * kept in the dirty extents of their file. The write-behind threads take
+ * the files queued one after the other and write their full chunks, and
+ * the extents old enough, so that COMMIT finds little left to write.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <pthread.h>
+#include <unistd.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "cache_inode.h"
+#include "nfs_core.h"
+
+/* Longest wait for a file to write, the extents not filling a chunk age meanwhile */
+#define WRITE_BEHIND_WAIT 1
+
+void *cache_inode_write_behind_thread(void *IndexArg)
+{
+  unsigned long wb_index = (unsigned long)IndexArg;
+  cache_inode_client_t wb_client;
+  char thr_name[32];
+
+  snprintf(thr_name, sizeof(thr_name), "Write Behind #%lu", wb_index);
+  SetNameFunction(thr_name);
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(&nfs_param.buddy_param_worker) != BUDDY_SUCCESS)
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_CACHE_INODE,
+               "Memory manager could not be initialized");
+    }
+  LogInfo(COMPONENT_CACHE_INODE, "Memory manager successfully initialized");
+#endif
+
+  /* The fds opened to write go to the cache of this client */
+  if(cache_inode_client_init(&wb_client,
+                             &(nfs_param.cache_layers_param.cache_inode_client_param),
+                             SMALL_CLIENT_INDEX, NULL))
+    {
+      /* Failed init */
+      LogFatal(COMPONENT_CACHE_INODE,
+               "Cache Inode client could not be initialized");
+    }
+
+  LogInfo(COMPONENT_CACHE_INODE, "%s successfully initialized", thr_name);
+
+  while(1)
+    cache_inode_write_behind_run(&wb_client, WRITE_BEHIND_WAIT);
+
+  return NULL;
+}                               /* cache_inode_write_behind_thread */
@@ -91,6 +91,10 @@ int _9p_read_conf( config_file_t   in_config,
         {
           pparam->_9p_port = atoi( key_value ) ;
         }
+      else if(!strcasecmp(key_name, "_9P_Nb_IO_Threads"))
+        {
+          pparam->nb_io_threads = atoi( key_value ) ;
+        }
       else if(!strcasecmp(key_name, "DebugLevel"))
         {
           DebugLevel = ReturnLevelAscii(key_value);
@@ -84,7 +84,9 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
 {
   nfs_client_id_t *pnfs_clientid;
   nfs41_session_t *pnfs41_session = NULL;
+  nfs41_session_slot_t *pslot;
   clientid4 clientid = 0;
+  uint32_t nb_slots;
 
 #define arg_CREATE_SESSION4 op->nfs_argop4_u.opcreate_session
 #define res_CREATE_SESSION4 resp->nfs_resop4_u.opcreate_session
@@ -114,22 +116,42 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
 
   if(data->oppos == 0)
     {
-      /* Special case : the request is used without use of OP_SEQUENCE */
+      /* Special case : the request is used without use of OP_SEQUENCE, the
+       * client id's slot is held until the reply is sent (see nfs4_Compound) */
+      pslot = &pnfs_clientid->create_session_slot;
+
+      if(pthread_mutex_trylock(&pslot->lock) != 0)
+        {
+          res_CREATE_SESSION4.csr_status = NFS4ERR_DELAY;
+          return res_CREATE_SESSION4.csr_status;
+        }
+
       if((arg_CREATE_SESSION4.csa_sequence + 1 == pnfs_clientid->create_session_sequence)
-         && (pnfs_clientid->create_session_slot.cache_used == TRUE))
+         && (pslot->cache_used == TRUE))
         {
           data->use_drc = TRUE;
-          data->pcached_res = pnfs_clientid->create_session_slot.cached_result;
+          data->pslot = pslot;
 
           res_CREATE_SESSION4.csr_status = NFS4_OK;
           return res_CREATE_SESSION4.csr_status;
         }
       else if(arg_CREATE_SESSION4.csa_sequence != pnfs_clientid->create_session_sequence)
         {
+          V(pslot->lock);
           res_CREATE_SESSION4.csr_status = NFS4ERR_SEQ_MISORDERED;
           return res_CREATE_SESSION4.csr_status;
         }
 
+      /* Create Session replay cache, filled by nfs4_Compound */
+      if(pslot->cached_result != NULL)
+        {
+          Mem_Free(pslot->cached_result);
+          pslot->cached_result = NULL;
+          pslot->cached_len = 0;
+        }
+      pslot->cache_used = TRUE;
+      data->cachethis = TRUE;
+      data->pslot = pslot;
     }
 
   pnfs_clientid->confirmed = CONFIRMED_CLIENT_ID;
@@ -162,12 +184,24 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
   pnfs41_session->fore_channel_attrs = arg_CREATE_SESSION4.csa_fore_chan_attrs;
   pnfs41_session->back_channel_attrs = arg_CREATE_SESSION4.csa_back_chan_attrs;
 
-  /* Set ca_maxrequests */
-  pnfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
-  pnfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
+  /* Negotiate ca_maxrequests: the slot table is sized as the client asks,
+   * up to the configured maximum */
+  nb_slots = arg_CREATE_SESSION4.csa_fore_chan_attrs.ca_maxrequests;
+  if(nb_slots > nfs_param.nfsv4_param.nb_max_slots)
+    nb_slots = nfs_param.nfsv4_param.nb_max_slots;
+  if(nb_slots == 0)
+    nb_slots = 1;
+
+  if(!nfs41_Session_Alloc_Slots(pnfs41_session, nb_slots))
+    {
+      res_CREATE_SESSION4.csr_status = NFS4ERR_SERVERFAULT;
+      return res_CREATE_SESSION4.csr_status;
+    }
+  pnfs41_session->fore_channel_attrs.ca_maxrequests = nb_slots;
 
   if(nfs41_Build_sessionid(&clientid, pnfs41_session->session_id) != 1)
     {
+      nfs41_Session_Free_Slots(pnfs41_session);
       res_CREATE_SESSION4.csr_status = NFS4ERR_SERVERFAULT;
       return res_CREATE_SESSION4.csr_status;
     }
@@ -186,12 +220,9 @@ int nfs41_op_create_session(struct nfs_argop4 *op,
   memcpy(res_CREATE_SESSION4.CREATE_SESSION4res_u.csr_resok4.csr_sessionid,
          pnfs41_session->session_id, NFS4_SESSIONID_SIZE);
 
-  /* Create Session replay cache */
-  data->pcached_res = pnfs_clientid->create_session_slot.cached_result;
-  pnfs_clientid->create_session_slot.cache_used = TRUE;
-
   if(!nfs41_Session_Set(pnfs41_session->session_id, pnfs41_session))
     {
+      nfs41_Session_Free_Slots(pnfs41_session);
       res_CREATE_SESSION4.csr_status = NFS4ERR_SERVERFAULT;     /* Maybe a more precise status would be better */
       return res_CREATE_SESSION4.csr_status;
     }
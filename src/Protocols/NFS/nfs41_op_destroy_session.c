@@ -89,6 +89,16 @@ int nfs41_op_destroy_session(struct nfs_argop4 *op,
   resp->resop = NFS4_OP_DESTROY_SESSION;
   res_DESTROY_SESSION4.dsr_status = NFS4_OK;
 
+  /* The slot held by this request is released now if it belongs to the
+   * destroyed session: nothing can be cached in it anymore */
+  if(data->psession != NULL && data->pslot != NULL
+     && !memcmp(data->psession->session_id, arg_DESTROY_SESSION4.dsa_sessionid,
+                NFS4_SESSIONID_SIZE))
+    {
+      V(data->pslot->lock);
+      data->pslot = NULL;
+    }
+
   if(!nfs41_Session_Del(arg_DESTROY_SESSION4.dsa_sessionid))
     res_DESTROY_SESSION4.dsr_status = NFS4ERR_BADSESSION;
   else
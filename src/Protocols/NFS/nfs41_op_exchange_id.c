@@ -252,10 +252,15 @@ int nfs41_op_exchange_id(struct nfs_argop4 *op,
                (unsigned int)ServerBootTime);
       nfs_clientid.confirmed = UNCONFIRMED_CLIENT_ID;
       nfs_clientid.cb_program = 0;      /* to be set at create_session time */
+      nfs_clientid.cb_ident = 0;
+      nfs_clientid.cb_path = CB_PATH_UNKNOWN;   /* no backchannel, no delegation */
       nfs_clientid.clientid = clientid;
       nfs_clientid.last_renew = 0;
       nfs_clientid.nb_session = 0;
       nfs_clientid.create_session_sequence = 1;
+      memset(&nfs_clientid.create_session_slot, 0,
+             sizeof(nfs_clientid.create_session_slot));
+      pthread_mutex_init(&nfs_clientid.create_session_slot.lock, NULL);
       nfs_clientid.credential = data->credential;
 
       if(gethostname(nfs_clientid.server_owner, MAXNAMLEN) == -1)
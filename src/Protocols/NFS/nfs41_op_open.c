@@ -490,6 +490,15 @@ int nfs41_op_open(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
                       openflags = FSAL_O_RDWR;
                     }
 
+                  /* The read delegations of the file are returned first */
+                  if(state_deleg_open_conflict(pentry_lookup, arg_OPEN4.share_access,
+                                               arg_OPEN4.share_deny))
+                    {
+                      res_OPEN4.status = NFS4ERR_DELAY;
+                      cause2 = " (delegation recalled)";
+                      goto out;
+                    }
+
                   /* Set the state for the related file */
 
                   /* Prepare state management structure */
@@ -864,6 +873,15 @@ int nfs41_op_open(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
               openflags = FSAL_O_RDWR;
             }
 
+          /* The read delegations of the file are returned first */
+          if(state_deleg_open_conflict(pentry_newfile, arg_OPEN4.share_access,
+                                       arg_OPEN4.share_deny))
+            {
+              res_OPEN4.status = NFS4ERR_DELAY;
+              cause2 = " (delegation recalled)";
+              goto out;
+            }
+
           /* Acquire lock to enter critical section on this entry */
           P_r(&pentry_newfile->lock);
 
@@ -346,13 +346,12 @@ int nfs41_op_read(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
 
     }
 
-  /* Some work is to be done */
-  if((bufferdata = (char *)Mem_Alloc(size)) == NULL)
+  /* Some work is to be done, the data is read where it will be sent from */
+  if((bufferdata = (char *)rpc_buffer_get(size)) == NULL)
     {
       res_READ4.status = NFS4ERR_SERVERFAULT;
       return res_READ4.status;
     }
-  memset((char *)bufferdata, 0, size);
 
   seek_descriptor.whence = FSAL_SEEK_SET;
   seek_descriptor.offset = offset;
@@ -369,6 +368,7 @@ int nfs41_op_read(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
                       data->pclient,
                       data->pcontext, TRUE, &cache_status) != CACHE_INODE_SUCCESS)
     {
+      rpc_buffer_release(bufferdata);
       res_READ4.status = nfs4_Errno(cache_status);
       return res_READ4.status;
     }
@@ -406,8 +406,7 @@ int nfs41_op_read(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
 void nfs41_op_read_Free(READ4res * resp)
 {
   if(resp->status == NFS4_OK)
-    if(resp->READ4res_u.resok4.data.data_len != 0)
-      Mem_Free(resp->READ4res_u.resok4.data.data_val);
+    rpc_buffer_release(resp->READ4res_u.resok4.data.data_val);
   return;
 }                               /* nfs41_op_read_Free */
 
@@ -434,8 +433,6 @@ static int op_dsread(struct nfs_argop4 *op,
   nfsstat4 nfs_status = 0;
   /* Buffer into which data is to be read */
   caddr_t buffer = NULL;
-  /* The system's page size */
-  const long page_size = sysconf(_SC_PAGESIZE);
   /* End of file flag */
   fsal_boolean_t eof = FALSE;
 
@@ -461,20 +458,12 @@ static int op_dsread(struct nfs_argop4 *op,
     }
 
   /*
-   * Allocate the memory for the read buffer to be page-aligned if we
-   * can find the page size.  Since the write buffer is allocated by
-   * the XDR code, aligned write support will be rolled into RPC
-   * enhancements.
+   * The read buffer is a page-aligned registered buffer, sent without
+   * copy.  Since the write buffer is allocated by the XDR code, aligned
+   * write support will be rolled into RPC enhancements.
    */
 
-  if (page_size == -1)
-    {
-      buffer = (caddr_t) Mem_Alloc(arg_READ4.count);
-    }
-  else
-    {
-      posix_memalign(&buffer, page_size, arg_READ4.count);
-    }
+  buffer = rpc_buffer_get(arg_READ4.count);
 
   if (buffer == NULL)
     {
@@ -495,7 +484,7 @@ static int op_dsread(struct nfs_argop4 *op,
                                   &eof))
       != NFS4_OK)
     {
-      Mem_Free(buffer);
+      rpc_buffer_release(buffer);
     }
 
   res_READ4.READ4res_u.resok4.eof = eof;
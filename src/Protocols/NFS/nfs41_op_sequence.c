@@ -62,6 +62,34 @@
 #include "nfs_tools.h"
 #include "nfs_file_handle.h"
 
+/**
+ *
+ * nfs41_target_highest_slotid: the number of slots the client should use.
+ *
+ * While workers are not too busy, clients may use all their slots. Beyond
+ * NFS41_SLOTS_LOAD_THRESHOLD pending requests per worker, the slot table is
+ * shrunk in proportion to the load, down to a single slot, and it grows back
+ * as the load decreases.
+ *
+ * @param psession [IN] the session used by the request
+ *
+ * @return the sr_target_highest_slotid to be replied.
+ *
+ */
+static slotid4 nfs41_target_highest_slotid(nfs41_session_t * psession)
+{
+  unsigned int load = nfs_core_worker_load();
+  uint32_t nb_slots = psession->nb_slots;
+
+  if(load > NFS41_SLOTS_LOAD_THRESHOLD)
+    nb_slots = (nb_slots * NFS41_SLOTS_LOAD_THRESHOLD) / load;
+
+  if(nb_slots == 0)
+    nb_slots = 1;
+
+  return nb_slots - 1;
+}                               /* nfs41_target_highest_slotid */
+
 /**
  *
  * nfs41_op_sequence: the NFS4_OP_SEQUENCE operation
@@ -85,6 +113,7 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
 #define res_SEQUENCE4  resp->nfs_resop4_u.opsequence
 
   nfs41_session_t *psession;
+  nfs41_session_slot_t *pslot;
 
   resp->resop = NFS4_OP_SEQUENCE;
   res_SEQUENCE4.sr_status = NFS4_OK;
@@ -103,25 +132,34 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
     }
 
   /* Check is slot is compliant with ca_maxrequests */
-  if(arg_SEQUENCE4.sa_slotid >= psession->fore_channel_attrs.ca_maxrequests)
+  if(arg_SEQUENCE4.sa_slotid >= psession->nb_slots)
     {
       res_SEQUENCE4.sr_status = NFS4ERR_BADSLOT;
       return res_SEQUENCE4.sr_status;
     }
 
+  pslot = &psession->slots[arg_SEQUENCE4.sa_slotid];
+
   /* By default, no DRC replay */
   data->use_drc = FALSE;
 
-  P(psession->slots[arg_SEQUENCE4.sa_slotid].lock);
-  if(psession->slots[arg_SEQUENCE4.sa_slotid].sequence + 1 != arg_SEQUENCE4.sa_sequenceid)
+  /* The slot is held until the reply is sent (see nfs4_Compound), a request
+   * arriving on a busy slot is a retransmission of a request in progress */
+  if(pthread_mutex_trylock(&pslot->lock) != 0)
+    {
+      res_SEQUENCE4.sr_status = NFS4ERR_DELAY;
+      return res_SEQUENCE4.sr_status;
+    }
+
+  if(pslot->sequence + 1 != arg_SEQUENCE4.sa_sequenceid)
     {
-      if(psession->slots[arg_SEQUENCE4.sa_slotid].sequence == arg_SEQUENCE4.sa_sequenceid)
+      if(pslot->sequence == arg_SEQUENCE4.sa_sequenceid)
         {
-          if(psession->slots[arg_SEQUENCE4.sa_slotid].cache_used == TRUE)
+          if(pslot->cache_used == TRUE)
             {
-              /* Replay operation through the DRC */
+              /* Replay operation through the DRC, the slot is released by nfs4_Compound */
               data->use_drc = TRUE;
-              data->pcached_res = psession->slots[arg_SEQUENCE4.sa_slotid].cached_result;
+              data->pslot = pslot;
 
               res_SEQUENCE4.sr_status = NFS4_OK;
               return res_SEQUENCE4.sr_status;
@@ -129,11 +167,12 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
           else
             {
               /* Illegal replay */
+              V(pslot->lock);
               res_SEQUENCE4.sr_status = NFS4ERR_RETRY_UNCACHED_REP;
               return res_SEQUENCE4.sr_status;
             }
         }
-      V(psession->slots[arg_SEQUENCE4.sa_slotid].lock);
+      V(pslot->lock);
       res_SEQUENCE4.sr_status = NFS4ERR_SEQ_MISORDERED;
       return res_SEQUENCE4.sr_status;
     }
@@ -142,28 +181,29 @@ int nfs41_op_sequence(struct nfs_argop4 *op,
   data->psession = psession;
 
   /* Update the sequence id within the slot */
-  psession->slots[arg_SEQUENCE4.sa_slotid].sequence += 1;
+  pslot->sequence += 1;
 
   memcpy((char *)res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_sessionid,
          (char *)arg_SEQUENCE4.sa_sessionid, NFS4_SESSIONID_SIZE);
-  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_sequenceid =
-      psession->slots[arg_SEQUENCE4.sa_slotid].sequence;
+  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_sequenceid = pslot->sequence;
   res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_slotid = arg_SEQUENCE4.sa_slotid;
-  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_highest_slotid = NFS41_NB_SLOTS - 1;
-  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid = arg_SEQUENCE4.sa_slotid;    /* Maybe not the best choice */
+  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_highest_slotid = psession->nb_slots - 1;
+  res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_target_highest_slotid =
+      nfs41_target_highest_slotid(psession);
   res_SEQUENCE4.SEQUENCE4res_u.sr_resok4.sr_status_flags = 0;   /* What is to be set here ? */
 
-  if(arg_SEQUENCE4.sa_cachethis == TRUE)
+  /* The previous reply is useless now that the client sent a new request */
+  if(pslot->cached_result != NULL)
     {
-      data->pcached_res = psession->slots[arg_SEQUENCE4.sa_slotid].cached_result;
-      psession->slots[arg_SEQUENCE4.sa_slotid].cache_used = TRUE;
+      Mem_Free(pslot->cached_result);
+      pslot->cached_result = NULL;
+      pslot->cached_len = 0;
     }
-  else
-    {
-      data->pcached_res = NULL;
-      psession->slots[arg_SEQUENCE4.sa_slotid].cache_used = FALSE;
-    }
-  V(psession->slots[arg_SEQUENCE4.sa_slotid].lock);
+
+  /* Reply is cached by nfs4_Compound, which releases the slot */
+  pslot->cache_used = arg_SEQUENCE4.sa_cachethis;
+  data->cachethis = arg_SEQUENCE4.sa_cachethis;
+  data->pslot = pslot;
 
   res_SEQUENCE4.sr_status = NFS4_OK;
   return res_SEQUENCE4.sr_status;
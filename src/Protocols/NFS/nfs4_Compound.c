@@ -200,6 +200,107 @@ nfs4_op_desc_t *optabvers[] =
 nfs4_op_desc_t *optabvers[] = { (nfs4_op_desc_t *) optab4v0 };
 #endif
 
+#ifdef _USE_NFS4_1
+/* Encoded reply replayed from a session slot by the current worker. It is
+ * sent by nfs4_xdr_COMPOUND4res and released by nfs4_Compound_Free, which
+ * both run in the worker thread that called nfs4_Compound. */
+static __thread char *replay_buff = NULL;
+static __thread unsigned int replay_len = 0;
+
+/**
+ * nfs4_Compound_CacheReply: keeps the encoded reply in a session slot.
+ *
+ * The reply is XDR encoded into a buffer of its exact size, so that a slot
+ * costs no more than the reply it has to replay.
+ *
+ * @param pslot [INOUT] the slot held by the request
+ * @param pres  [IN]    the reply to be cached
+ *
+ * @return nothing (void function). The slot is left empty if encoding fails.
+ *
+ */
+static void nfs4_Compound_CacheReply(nfs41_session_slot_t * pslot,
+                                     COMPOUND4res * pres)
+{
+  XDR xdrs;
+  unsigned long len;
+
+  pslot->cached_result = NULL;
+  pslot->cached_len = 0;
+
+  len = xdr_sizeof((xdrproc_t) xdr_COMPOUND4res, pres);
+  if(len == 0)
+    return;
+
+  if((pslot->cached_result = (char *)Mem_Alloc(len)) == NULL)
+    {
+      LogCrit(COMPONENT_NFS_V4,
+              "Unable to allocate %lu bytes to cache a session reply", len);
+      return;
+    }
+
+  xdrmem_create(&xdrs, pslot->cached_result, len, XDR_ENCODE);
+  if(!xdr_COMPOUND4res(&xdrs, pres))
+    {
+      LogCrit(COMPONENT_NFS_V4, "Unable to encode a session reply for caching");
+      Mem_Free(pslot->cached_result);
+      pslot->cached_result = NULL;
+      xdr_destroy(&xdrs);
+      return;
+    }
+  xdr_destroy(&xdrs);
+
+  pslot->cached_len = len;
+}                               /* nfs4_Compound_CacheReply */
+
+/**
+ * nfs4_Compound_Replay: prepares the replay of a reply cached in a slot.
+ *
+ * The cached bytes are copied, the slot may be reused as soon as it is
+ * unlocked while the copy is still to be sent.
+ *
+ * @param pslot [IN] the slot held by the request
+ *
+ * @return NFS4_OK if successful, NFS4ERR_RETRY_UNCACHED_REP if there is nothing to replay.
+ *
+ */
+static int nfs4_Compound_Replay(nfs41_session_slot_t * pslot)
+{
+  if(pslot->cached_result == NULL)
+    return NFS4ERR_RETRY_UNCACHED_REP;
+
+  if((replay_buff = (char *)Mem_Alloc(pslot->cached_len)) == NULL)
+    return NFS4ERR_SERVERFAULT;
+
+  memcpy(replay_buff, pslot->cached_result, pslot->cached_len);
+  replay_len = pslot->cached_len;
+
+  return NFS4_OK;
+}                               /* nfs4_Compound_Replay */
+#endif
+
+/**
+ * nfs4_xdr_COMPOUND4res: XDR routine used to send the COMPOUND4 replies.
+ *
+ * Encodes the reply like xdr_COMPOUND4res, unless nfs4_Compound replayed a
+ * reply from a session slot: the cached bytes are then sent as they are.
+ *
+ * @param xdrs [INOUT] the XDR stream
+ * @param objp [IN]    the reply
+ *
+ * @return TRUE if successful, FALSE otherwise.
+ *
+ */
+bool_t nfs4_xdr_COMPOUND4res(XDR * xdrs, COMPOUND4res * objp)
+{
+#ifdef _USE_NFS4_1
+  if(xdrs->x_op == XDR_ENCODE && replay_buff != NULL)
+    return XDR_PUTBYTES(xdrs, replay_buff, replay_len);
+#endif
+
+  return xdr_COMPOUND4res(xdrs, objp);
+}                               /* nfs4_xdr_COMPOUND4res */
+
 /**
  * nfs4_COMPOUND: The NFS PROC4 COMPOUND
  *
@@ -293,6 +394,10 @@ int nfs4_Compound(nfs_arg_t * parg /* IN     */ ,
 
   /* Initialisation of the compound request internal's data */
   memset(&data, 0, sizeof(data));
+#ifdef _USE_NFS4_1
+  replay_buff = NULL;
+  replay_len = 0;
+#endif
 
   /* Minor version related stuff */
   data.minorversion = COMPOUND4_MINOR;
@@ -457,10 +562,17 @@ int nfs4_Compound(nfs_arg_t * parg /* IN     */ ,
                   /* Manage sessions's DRC : replay previously cached request */
                   if(data.use_drc == TRUE)
                     {
-                      /* Replay cache */
-                      memcpy((char *)pres, data.pcached_res,
-                             (COMPOUND4_ARRAY.argarray_len) * sizeof(struct nfs_resop4));
-                      status = ((COMPOUND4res *) data.pcached_res)->status;
+                      /* Replay cache, the reply is sent by nfs4_xdr_COMPOUND4res */
+                      status = nfs4_Compound_Replay(data.pslot);
+                      if(status == NFS4_OK)
+                        pres->res_compound4.resarray.resarray_len = 0;
+                      else if(pres->res_compound4.resarray.resarray_val[0].resop ==
+                              NFS4_OP_CREATE_SESSION)
+                        pres->res_compound4.resarray.resarray_val[0].nfs_resop4_u.
+                            opcreate_session.csr_status = status;
+                      else
+                        pres->res_compound4.resarray.resarray_val[0].nfs_resop4_u.
+                            opsequence.sr_status = status;
                       break;    /* Exit the for loop */
                     }
                 }
@@ -473,14 +585,14 @@ int nfs4_Compound(nfs_arg_t * parg /* IN     */ ,
   pres->res_compound4.status = status;
 
 #ifdef _USE_NFS4_1
-  /* Manage session's DRC : keep NFS4.1 replay for later use */
-  if(COMPOUND4_MINOR == 1)
+  /* Manage session's DRC : keep NFS4.1 replay for later use, then release
+   * the slot locked by nfs41_op_sequence or nfs41_op_create_session */
+  if(COMPOUND4_MINOR == 1 && data.pslot != NULL)
     {
-      if(data.pcached_res != NULL)      /* Pointer has been set by nfs41_op_sequence and points to cached zone */
-        {
-          memcpy(data.pcached_res, (char *)pres,
-                 (COMPOUND4_ARRAY.argarray_len) * sizeof(struct nfs_resop4));
-        }
+      if(data.use_drc == FALSE && data.cachethis == TRUE)
+        nfs4_Compound_CacheReply(data.pslot, &pres->res_compound4);
+
+      V(data.pslot->lock);
     }
 #endif
 
@@ -734,6 +846,15 @@ void nfs4_Compound_Free(nfs_res_t * pres)
                pres,
                pres->res_compound4.resarray.resarray_len);
 
+#ifdef _USE_NFS4_1
+  if(replay_buff != NULL)
+    {
+      Mem_Free(replay_buff);
+      replay_buff = NULL;
+      replay_len = 0;
+    }
+#endif
+
   for(i = 0; i < pres->res_compound4.resarray.resarray_len; i++)
     nfs4_Compound_FreeOne(&pres->res_compound4.resarray.resarray_val[i]);
 
@@ -0,0 +1,510 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    nfs4_callback.c
+ * \brief   Callbacks sent by the server to the NFSv4 clients
+ *
+ * nfs4_callback.c : the CB_NULL and CB_RECALL sent to the callback program
+ * a client gave in SETCLIENTID. The connection to a client is kept from one
+ * callback to the next, until it fails, the client goes or it stays idle a
+ * lease. The calls to a client are serialized on its connection, the calls to
+ * different clients are made in parallel by the threads sending them.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "rpc.h"
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs4.h"
+#include "nfs_core.h"
+#include "nfs_proto_functions.h"
+
+/* A client not answering within this delay has its callback path down */
+#define NFS4_CB_TIMEOUT 5
+
+#define NFS4_CB_CONN_BUCKETS 64
+
+/* The connection to the callback of a client */
+typedef struct nfs4_cb_conn__
+{
+  struct glist_head ccn_list;
+  pthread_mutex_t ccn_mutex;    /* held by the thread making a call */
+  clientid4 ccn_clientid;
+  unsigned int ccn_refcount;    /* threads using it, under nfs4_cb_conn_mutex */
+  int ccn_forgotten;            /* out of the cache, freed by its last user */
+  CLIENT *ccn_clnt;             /* NULL when not connected */
+  int ccn_sock;
+  char ccn_r_addr[SOCK_NAME_MAX];       /* where it is connected to */
+  uint32_t ccn_program;
+  time_t ccn_last_use;
+} nfs4_cb_conn_t;
+
+static pthread_mutex_t nfs4_cb_conn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head nfs4_cb_conn_cache[NFS4_CB_CONN_BUCKETS];
+static int nfs4_cb_conn_cache_init = FALSE;
+
+/**
+ *
+ * nfs4_cb_parse_uaddr: gets the address of an IPv4 universal address.
+ *
+ * The universal address of an IPv4 callback is "h1.h2.h3.h4.p1.p2", the
+ * address then the port, in decimal bytes.
+ *
+ * @param uaddr [IN]  the universal address
+ * @param psin  [OUT] the address to connect to
+ *
+ * @return TRUE if the universal address is an IPv4 one, FALSE otherwise.
+ *
+ */
+static int nfs4_cb_parse_uaddr(char *uaddr, struct sockaddr_in *psin)
+{
+  unsigned int b[6];
+  char extra;
+  int i;
+
+  if(sscanf(uaddr, "%u.%u.%u.%u.%u.%u%c",
+            &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &extra) != 6)
+    return FALSE;
+
+  for(i = 0; i < 6; i++)
+    if(b[i] > 255)
+      return FALSE;
+
+  memset(psin, 0, sizeof(*psin));
+  psin->sin_family = AF_INET;
+  psin->sin_addr.s_addr = htonl((b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3]);
+  psin->sin_port = htons((b[4] << 8) | b[5]);
+
+  return TRUE;
+}                               /* nfs4_cb_parse_uaddr */
+
+/**
+ *
+ * nfs4_cb_connect: connects to the callback program of a client.
+ *
+ * The connection is made without blocking longer than NFS4_CB_TIMEOUT: the
+ * address of a client behind a firewall, or gone, must not hold the thread
+ * sending the callbacks.
+ *
+ * @param pclientid [IN]  the client record
+ * @param psock     [OUT] the socket of the connection, closed with it
+ *
+ * @return the RPC client, NULL if the client could not be reached.
+ *
+ */
+static CLIENT *nfs4_cb_connect(nfs_client_id_t * pclientid, int *psock)
+{
+  struct sockaddr_in sin;
+  struct pollfd pfd;
+  socklen_t errlen = sizeof(int);
+  int error = 0;
+  int flags;
+  int sock;
+  CLIENT *clnt;
+
+  if(strcmp(pclientid->client_r_netid, "tcp") != 0 ||
+     !nfs4_cb_parse_uaddr(pclientid->client_r_addr, &sin))
+    {
+      LogDebug(COMPONENT_NFS_V4,
+               "Callback of client %s on %s %s is not supported",
+               pclientid->client_name, pclientid->client_r_netid,
+               pclientid->client_r_addr);
+      return NULL;
+    }
+
+  if((sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)
+    {
+      LogCrit(COMPONENT_NFS_V4, "Cannot create a socket for a callback, errno=%d", errno);
+      return NULL;
+    }
+
+  flags = fcntl(sock, F_GETFL, 0);
+  fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+  if(connect(sock, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+    {
+      if(errno != EINPROGRESS)
+        error = errno;
+      else
+        {
+          pfd.fd = sock;
+          pfd.events = POLLOUT;
+          if(poll(&pfd, 1, NFS4_CB_TIMEOUT * 1000) != 1)
+            error = ETIMEDOUT;
+          else if(getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &errlen) < 0)
+            error = errno;
+        }
+    }
+
+  if(error != 0)
+    {
+      LogDebug(COMPONENT_NFS_V4,
+               "Cannot connect to the callback of client %s at %s, errno=%d",
+               pclientid->client_name, pclientid->client_r_addr, error);
+      close(sock);
+      return NULL;
+    }
+
+  fcntl(sock, F_SETFL, flags);
+
+  if((clnt = clnttcp_create(&sin, pclientid->cb_program, NFS_CB, &sock, 0, 0)) == NULL)
+    {
+      LogDebug(COMPONENT_NFS_V4,
+               "Cannot create the callback client of client %s at %s",
+               pclientid->client_name, pclientid->client_r_addr);
+      close(sock);
+      return NULL;
+    }
+
+  /* The clients refuse CB_COMPOUND with AUTH_NONE */
+  if((clnt->cl_auth = authunix_create_default()) == NULL)
+    {
+      clnt_destroy(clnt);
+      close(sock);
+      return NULL;
+    }
+
+  *psock = sock;
+  return clnt;
+}                               /* nfs4_cb_connect */
+
+static void nfs4_cb_disconnect(CLIENT * clnt, int sock)
+{
+  auth_destroy(clnt->cl_auth);
+  clnt_destroy(clnt);
+  close(sock);
+}                               /* nfs4_cb_disconnect */
+
+/* Must be called with nfs4_cb_conn_mutex held, and nobody using the connection */
+static void nfs4_cb_conn_free(nfs4_cb_conn_t * pconn)
+{
+  if(pconn->ccn_clnt != NULL)
+    nfs4_cb_disconnect(pconn->ccn_clnt, pconn->ccn_sock);
+  pthread_mutex_destroy(&pconn->ccn_mutex);
+  Mem_Free(pconn);
+}                               /* nfs4_cb_conn_free */
+
+/**
+ *
+ * nfs4_cb_conn_get: gets the connection to the callback of a client.
+ *
+ * The connection is returned locked for the caller to make a call on it, the
+ * other calls to the client waiting for it. Its ccn_clnt is NULL when the
+ * client could not be reached.
+ *
+ * @param pclientid [IN]  the client record, a copy being enough
+ * @param pfresh    [OUT] TRUE if the connection was made for this call
+ *
+ * @return the connection, NULL if it could not be allocated.
+ *
+ */
+static nfs4_cb_conn_t *nfs4_cb_conn_get(nfs_client_id_t * pclientid, int *pfresh)
+{
+  struct glist_head *bucket;
+  struct glist_head *glist;
+  nfs4_cb_conn_t *pconn = NULL;
+  unsigned int i;
+
+  *pfresh = FALSE;
+
+  P(nfs4_cb_conn_mutex);
+
+  if(!nfs4_cb_conn_cache_init)
+    {
+      for(i = 0; i < NFS4_CB_CONN_BUCKETS; i++)
+        init_glist(&nfs4_cb_conn_cache[i]);
+      nfs4_cb_conn_cache_init = TRUE;
+    }
+
+  bucket = &nfs4_cb_conn_cache[pclientid->clientid % NFS4_CB_CONN_BUCKETS];
+
+  glist_for_each(glist, bucket)
+    {
+      pconn = glist_entry(glist, nfs4_cb_conn_t, ccn_list);
+      if(pconn->ccn_clientid == pclientid->clientid)
+        break;
+      pconn = NULL;
+    }
+
+  if(pconn == NULL)
+    {
+      if((pconn = (nfs4_cb_conn_t *) Mem_Alloc(sizeof(nfs4_cb_conn_t))) == NULL)
+        {
+          V(nfs4_cb_conn_mutex);
+          LogCrit(COMPONENT_NFS_V4, "Cannot allocate the callback connection of a client");
+          return NULL;
+        }
+
+      memset(pconn, 0, sizeof(nfs4_cb_conn_t));
+      pthread_mutex_init(&pconn->ccn_mutex, NULL);
+      pconn->ccn_clientid = pclientid->clientid;
+      glist_add_tail(bucket, &pconn->ccn_list);
+    }
+
+  pconn->ccn_refcount += 1;
+
+  V(nfs4_cb_conn_mutex);
+
+  P(pconn->ccn_mutex);
+
+  /* SETCLIENTID may have changed the callback */
+  if(pconn->ccn_clnt != NULL &&
+     (pconn->ccn_program != pclientid->cb_program ||
+      strcmp(pconn->ccn_r_addr, pclientid->client_r_addr) != 0))
+    {
+      nfs4_cb_disconnect(pconn->ccn_clnt, pconn->ccn_sock);
+      pconn->ccn_clnt = NULL;
+    }
+
+  if(pconn->ccn_clnt == NULL)
+    {
+      pconn->ccn_clnt = nfs4_cb_connect(pclientid, &pconn->ccn_sock);
+      pconn->ccn_program = pclientid->cb_program;
+      strncpy(pconn->ccn_r_addr, pclientid->client_r_addr, SOCK_NAME_MAX - 1);
+      pconn->ccn_r_addr[SOCK_NAME_MAX - 1] = '\0';
+      *pfresh = TRUE;
+    }
+
+  return pconn;
+}                               /* nfs4_cb_conn_get */
+
+/* Unlocks a connection got by nfs4_cb_conn_get, closing it when the call failed */
+static void nfs4_cb_conn_put(nfs4_cb_conn_t * pconn, int failed)
+{
+  if(failed && pconn->ccn_clnt != NULL)
+    {
+      nfs4_cb_disconnect(pconn->ccn_clnt, pconn->ccn_sock);
+      pconn->ccn_clnt = NULL;
+    }
+
+  pconn->ccn_last_use = time(NULL);
+
+  V(pconn->ccn_mutex);
+
+  P(nfs4_cb_conn_mutex);
+  pconn->ccn_refcount -= 1;
+  if(pconn->ccn_forgotten && pconn->ccn_refcount == 0)
+    nfs4_cb_conn_free(pconn);
+  V(nfs4_cb_conn_mutex);
+}                               /* nfs4_cb_conn_put */
+
+/**
+ *
+ * nfs4_cb_call: makes a call to the callback program of a client.
+ *
+ * A call failing on a connection kept from a previous call, which the client
+ * may have closed meanwhile, is made again once on a new connection.
+ *
+ * @param pclientid [IN]  the client record, a copy being enough
+ * @param proc      [IN]  the procedure called
+ * @param xargs     [IN]  XDR function of the arguments
+ * @param args      [IN]  the arguments
+ * @param xres      [IN]  XDR function of the result
+ * @param res       [OUT] the result, to be freed with xdr_free if RPC_SUCCESS
+ *
+ * @return the status of the call.
+ *
+ */
+static enum clnt_stat nfs4_cb_call(nfs_client_id_t * pclientid, unsigned long proc,
+                                   xdrproc_t xargs, caddr_t args,
+                                   xdrproc_t xres, caddr_t res)
+{
+  struct timeval timeout = { NFS4_CB_TIMEOUT, 0 };
+  enum clnt_stat rc = RPC_CANTSEND;
+  nfs4_cb_conn_t *pconn;
+  int fresh;
+
+  if((pconn = nfs4_cb_conn_get(pclientid, &fresh)) == NULL)
+    return RPC_SYSTEMERROR;
+
+  while(pconn->ccn_clnt != NULL)
+    {
+      rc = clnt_call(pconn->ccn_clnt, proc, xargs, args, xres, res, timeout);
+
+      if(rc == RPC_SUCCESS || fresh)
+        break;
+
+      /* Try again on a new connection */
+      nfs4_cb_disconnect(pconn->ccn_clnt, pconn->ccn_sock);
+      pconn->ccn_clnt = nfs4_cb_connect(pclientid, &pconn->ccn_sock);
+      fresh = TRUE;
+    }
+
+  nfs4_cb_conn_put(pconn, rc != RPC_SUCCESS);
+
+  return rc;
+}                               /* nfs4_cb_call */
+
+/**
+ *
+ * nfs4_cb_forget: closes the callback connection of a client which expired.
+ *
+ * @param clientid [IN] the client
+ *
+ */
+void nfs4_cb_forget(clientid4 clientid)
+{
+  struct glist_head *glist;
+  nfs4_cb_conn_t *pconn;
+
+  P(nfs4_cb_conn_mutex);
+
+  if(nfs4_cb_conn_cache_init)
+    glist_for_each(glist, &nfs4_cb_conn_cache[clientid % NFS4_CB_CONN_BUCKETS])
+      {
+        pconn = glist_entry(glist, nfs4_cb_conn_t, ccn_list);
+        if(pconn->ccn_clientid != clientid)
+          continue;
+
+        glist_del(&pconn->ccn_list);
+        pconn->ccn_forgotten = TRUE;
+        if(pconn->ccn_refcount == 0)
+          nfs4_cb_conn_free(pconn);
+        break;
+      }
+
+  V(nfs4_cb_conn_mutex);
+}                               /* nfs4_cb_forget */
+
+/**
+ *
+ * nfs4_cb_close_idle: closes the callback connections not used for a while.
+ *
+ * @param max_idle [IN] seconds a connection may stay unused
+ *
+ */
+void nfs4_cb_close_idle(time_t max_idle)
+{
+  struct glist_head *glist, *glistn;
+  nfs4_cb_conn_t *pconn;
+  time_t now = time(NULL);
+  unsigned int i;
+
+  P(nfs4_cb_conn_mutex);
+
+  if(nfs4_cb_conn_cache_init)
+    for(i = 0; i < NFS4_CB_CONN_BUCKETS; i++)
+      glist_for_each_safe(glist, glistn, &nfs4_cb_conn_cache[i])
+        {
+          pconn = glist_entry(glist, nfs4_cb_conn_t, ccn_list);
+          if(pconn->ccn_refcount != 0 || now - pconn->ccn_last_use < max_idle)
+            continue;
+
+          glist_del(&pconn->ccn_list);
+          nfs4_cb_conn_free(pconn);
+        }
+
+  V(nfs4_cb_conn_mutex);
+}                               /* nfs4_cb_close_idle */
+
+/**
+ *
+ * nfs4_cb_probe: checks the callback path of a client with CB_NULL.
+ *
+ * @param pclientid [IN] the client record, a copy being enough
+ *
+ * @return TRUE if the client answered, FALSE otherwise.
+ *
+ */
+int nfs4_cb_probe(nfs_client_id_t * pclientid)
+{
+  enum clnt_stat rc;
+
+  rc = nfs4_cb_call(pclientid, CB_NULL,
+                    (xdrproc_t) xdr_void, (caddr_t) NULL,
+                    (xdrproc_t) xdr_void, (caddr_t) NULL);
+
+  LogDebug(COMPONENT_NFS_V4,
+           "CB_NULL to client %s at %s: %s", pclientid->client_name,
+           pclientid->client_r_addr, rc == RPC_SUCCESS ? "success" : clnt_sperrno(rc));
+
+  return rc == RPC_SUCCESS;
+}                               /* nfs4_cb_probe */
+
+/**
+ *
+ * nfs4_cb_send_recall: recalls a delegation with a CB_COMPOUND holding a CB_RECALL.
+ *
+ * The client answers once it has received the recall, it returns the
+ * delegation later with DELEGRETURN.
+ *
+ * @param pclientid [IN] the client record, a copy being enough
+ * @param pstateid  [IN] the stateid of the delegation
+ * @param pfh       [IN] the file handle of the file delegated
+ *
+ * @return TRUE if the client answered, FALSE otherwise.
+ *
+ */
+int nfs4_cb_send_recall(nfs_client_id_t * pclientid, stateid4 * pstateid, nfs_fh4 * pfh)
+{
+  CB_COMPOUND4args args;
+  CB_COMPOUND4res res;
+  nfs_cb_argop4 argop;
+  enum clnt_stat rc;
+
+  memset(&argop, 0, sizeof(argop));
+  argop.argop = NFS4_OP_CB_RECALL;
+  argop.nfs_cb_argop4_u.opcbrecall.stateid = *pstateid;
+  argop.nfs_cb_argop4_u.opcbrecall.truncate = FALSE;
+  argop.nfs_cb_argop4_u.opcbrecall.fh = *pfh;
+
+  memset(&args, 0, sizeof(args));
+  args.minorversion = 0;
+  args.callback_ident = pclientid->cb_ident;
+  args.argarray.argarray_len = 1;
+  args.argarray.argarray_val = &argop;
+
+  memset(&res, 0, sizeof(res));
+
+  rc = nfs4_cb_call(pclientid, CB_COMPOUND,
+                    (xdrproc_t) xdr_CB_COMPOUND4args, (caddr_t) & args,
+                    (xdrproc_t) xdr_CB_COMPOUND4res, (caddr_t) & res);
+
+  if(rc == RPC_SUCCESS)
+    {
+      LogDebug(COMPONENT_NFS_V4,
+               "CB_RECALL to client %s at %s: status %d", pclientid->client_name,
+               pclientid->client_r_addr, res.status);
+      xdr_free((xdrproc_t) xdr_CB_COMPOUND4res, (caddr_t) & res);
+    }
+  else
+    LogDebug(COMPONENT_NFS_V4,
+             "CB_RECALL to client %s at %s: %s", pclientid->client_name,
+             pclientid->client_r_addr, clnt_sperrno(rc));
+
+  return rc == RPC_SUCCESS;
+}                               /* nfs4_cb_send_recall */
@@ -0,0 +1,505 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    nfs4_fattr_plan.c
+ * \brief   Encoding of the fattr4 from plans compiled per attribute bitmap.
+ *
+ * nfs4_fattr_plan.c : The clients ask for a handful of different bitmaps
+ * (the Linux client uses one for GETATTR, one for READDIR...). The first
+ * time a bitmap is seen, it is compiled into a plan: the list of the
+ * attributes to encode, the size of the fixed width ones, and the bitmap
+ * of the reply. Then each object is encoded from the plan: the size of the
+ * attributes is known before they are encoded, so they are written once,
+ * straight into the buffer given to the reply.
+ *
+ * Only the attributes of the object itself, and the constant ones, are
+ * compiled. A bitmap asking for others (statfs, acl, fs_locations...) gets
+ * a plan which tells to use nfs4_FSALattr_To_Fattr's generic encoding.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "rpc.h"
+#include "log.h"
+#include "stuff_alloc.h"
+#include "common_utils.h"
+#include "nfs4.h"
+#include "nfs_core.h"
+#include "nfs_exports.h"
+#include "nfs_proto_functions.h"
+#include "nfs_tools.h"
+#include "nfs_file_handle.h"
+
+#define NFS4_FATTR_PLAN_CACHE_SIZE 64   /* power of 2 */
+#define NFS4_FATTR_PLAN_MAX_ATTRS  64
+
+#ifdef _USE_NFS4_1
+#define NFS4_FATTR_PLAN_LAST_ATTR FATTR4_FS_CHARSET_CAP
+#else
+#define NFS4_FATTR_PLAN_LAST_ATTR FATTR4_MOUNTED_ON_FILEID
+#endif
+
+typedef struct nfs4_fattr_plan__
+{
+  uint32_t request[3];                  /* bitmap the plan was compiled for */
+  bool_t compiled;                      /* FALSE if the generic encoding is needed */
+  bool_t owner;                         /* variable length attributes asked */
+  bool_t owner_group;
+  bool_t filehandle;
+  u_int fixed_size;                     /* size of all the other attributes */
+  uint32_t reply[3];                    /* bitmap of the reply */
+  u_int reply_len;
+  u_int nb_attrs;
+  uint8_t attrs[NFS4_FATTR_PLAN_MAX_ATTRS];     /* in the order of the bitmap */
+} nfs4_fattr_plan_t;
+
+static nfs4_fattr_plan_t *volatile fattr_plan_cache[NFS4_FATTR_PLAN_CACHE_SIZE];
+static pthread_mutex_t fattr_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int nfs4_fattr_plan_hash(uint32_t * request)
+{
+  uint32_t h = request[0] * 2654435761U;
+
+  h ^= request[1] * 2246822519U;
+  h ^= request[2] * 3266489917U;
+  h ^= h >> 15;
+
+  return h & (NFS4_FATTR_PLAN_CACHE_SIZE - 1);
+}                               /* nfs4_fattr_plan_hash */
+
+/**
+ *
+ * nfs4_fattr_plan_compile: builds the plan of a bitmap.
+ *
+ * @param request [IN]  the bitmap, as 3 words.
+ * @param pplan   [OUT] the plan.
+ *
+ * @return nothing (void function).
+ *
+ */
+static void nfs4_fattr_plan_compile(uint32_t * request, nfs4_fattr_plan_t * pplan)
+{
+  uint32_t attr;
+
+  memset(pplan, 0, sizeof(nfs4_fattr_plan_t));
+  memcpy(pplan->request, request, sizeof(pplan->request));
+  pplan->compiled = TRUE;
+
+  for(attr = 0; attr <= NFS4_FATTR_PLAN_LAST_ATTR; attr++)
+    {
+      if(!(request[attr / 32] & (1 << (attr % 32))))
+        continue;
+
+      switch (attr)
+        {
+        case FATTR4_TYPE:
+        case FATTR4_FH_EXPIRE_TYPE:
+        case FATTR4_CHANGE:
+        case FATTR4_SIZE:
+        case FATTR4_LINK_SUPPORT:
+        case FATTR4_SYMLINK_SUPPORT:
+        case FATTR4_NAMED_ATTR:
+        case FATTR4_FSID:
+        case FATTR4_UNIQUE_HANDLES:
+        case FATTR4_LEASE_TIME:
+        case FATTR4_RDATTR_ERROR:
+        case FATTR4_FILEID:
+        case FATTR4_MODE:
+        case FATTR4_NUMLINKS:
+        case FATTR4_RAWDEV:
+        case FATTR4_SPACE_USED:
+        case FATTR4_TIME_ACCESS:
+        case FATTR4_TIME_METADATA:
+        case FATTR4_TIME_MODIFY:
+        case FATTR4_MOUNTED_ON_FILEID:
+          pplan->fixed_size += fattr4tab[attr].size_fattr4;
+          break;
+
+        case FATTR4_FILEHANDLE:
+          pplan->filehandle = TRUE;
+          break;
+
+        case FATTR4_OWNER:
+          pplan->owner = TRUE;
+          break;
+
+        case FATTR4_OWNER_GROUP:
+          pplan->owner_group = TRUE;
+          break;
+
+        default:
+          /* Needs the generic encoding */
+          pplan->compiled = FALSE;
+          return;
+        }
+
+      pplan->attrs[pplan->nb_attrs++] = (uint8_t) attr;
+      pplan->reply[attr / 32] |= (1 << (attr % 32));
+      pplan->reply_len = attr / 32 + 1;
+    }
+
+  /* An empty reply is left to the generic encoding */
+  if(pplan->nb_attrs == 0)
+    pplan->compiled = FALSE;
+}                               /* nfs4_fattr_plan_compile */
+
+/**
+ *
+ * nfs4_fattr_plan_get: gets the plan of a bitmap, compiling it if needed.
+ *
+ * @param request [IN] the bitmap, as 3 words.
+ *
+ * @return the plan, NULL if it could not be cached.
+ *
+ */
+static nfs4_fattr_plan_t *nfs4_fattr_plan_get(uint32_t * request)
+{
+  unsigned int first = nfs4_fattr_plan_hash(request);
+  unsigned int i, slot;
+  nfs4_fattr_plan_t *pplan;
+
+  /* The plans are never changed nor freed once published, so they are
+   * looked up without the mutex */
+  for(i = 0; i < NFS4_FATTR_PLAN_CACHE_SIZE; i++)
+    {
+      slot = (first + i) & (NFS4_FATTR_PLAN_CACHE_SIZE - 1);
+      if((pplan = fattr_plan_cache[slot]) == NULL)
+        break;
+      if(!memcmp(pplan->request, request, sizeof(pplan->request)))
+        return pplan;
+    }
+
+  P(fattr_plan_mutex);
+
+  for(i = 0; i < NFS4_FATTR_PLAN_CACHE_SIZE; i++)
+    {
+      slot = (first + i) & (NFS4_FATTR_PLAN_CACHE_SIZE - 1);
+      if((pplan = fattr_plan_cache[slot]) == NULL)
+        break;
+      if(!memcmp(pplan->request, request, sizeof(pplan->request)))
+        {
+          /* Compiled by another thread meanwhile */
+          V(fattr_plan_mutex);
+          return pplan;
+        }
+    }
+
+  /* The cache is full: unusual bitmaps are not worth a plan */
+  if(i == NFS4_FATTR_PLAN_CACHE_SIZE ||
+     (pplan = (nfs4_fattr_plan_t *) Mem_Alloc_Label(sizeof(nfs4_fattr_plan_t),
+                                                    "nfs4_fattr_plan_t")) == NULL)
+    {
+      V(fattr_plan_mutex);
+      return NULL;
+    }
+
+  nfs4_fattr_plan_compile(request, pplan);
+
+  LogDebug(COMPONENT_NFS_V4,
+           "fattr4 plan for bitmap %08x|%08x|%08x: %s, %u attributes, %u fixed bytes",
+           request[0], request[1], request[2],
+           pplan->compiled ? "compiled" : "generic", pplan->nb_attrs, pplan->fixed_size);
+
+  /* The plan must be complete before it can be seen */
+  __sync_synchronize();
+  fattr_plan_cache[slot] = pplan;
+
+  V(fattr_plan_mutex);
+
+  return pplan;
+}                               /* nfs4_fattr_plan_get */
+
+static inline char *nfs4_fattr_put32(char *p, uint32_t val)
+{
+  val = htonl(val);
+  memcpy(p, &val, sizeof(uint32_t));
+  return p + sizeof(uint32_t);
+}
+
+static inline char *nfs4_fattr_put64(char *p, uint64_t val)
+{
+  val = nfs_htonl64(val);
+  memcpy(p, &val, sizeof(uint64_t));
+  return p + sizeof(uint64_t);
+}
+
+static inline char *nfs4_fattr_put_time(char *p, fsal_time_t * ptime)
+{
+  p = nfs4_fattr_put64(p, (int64_t) ptime->seconds);
+  return nfs4_fattr_put32(p, (uint32_t) ptime->nseconds);
+}
+
+/* Opaque data: length, data and padding to 4 bytes */
+static inline char *nfs4_fattr_put_opaque(char *p, char *val, u_int len)
+{
+  u_int pad = (4 - (len % 4)) % 4;
+
+  p = nfs4_fattr_put32(p, len);
+  memcpy(p, val, len);
+  memset(p + len, 0, pad);
+  return p + len + pad;
+}
+
+/**
+ *
+ * nfs4_FSALattr_To_Fattr_Plan: encodes the attributes from the plan of the bitmap.
+ *
+ * The result is the same as with the generic encoding of nfs4_FSALattr_To_Fattr.
+ *
+ * @param pexport [IN]  the related export entry
+ * @param pattr   [IN]  the FSAL attributes
+ * @param Fattr   [OUT] the NFSv4 attributes
+ * @param objFH   [IN]  the file handle of the object
+ * @param Bitmap  [IN]  the attributes asked
+ *
+ * @return 0 if successful, -1 if failed, NFS4_FATTR_PLAN_GENERIC if the
+ * bitmap has to be encoded by the generic code.
+ *
+ */
+int nfs4_FSALattr_To_Fattr_Plan(exportlist_t * pexport,
+                                fsal_attrib_list_t * pattr,
+                                fattr4 * Fattr, nfs_fh4 * objFH, bitmap4 * Bitmap)
+{
+  nfs4_fattr_plan_t *pplan;
+  uint32_t request[3] = { 0, 0, 0 };
+  utf8string owner, owner_group;
+  fattr4_type file_type;
+  u_int size, i;
+  char *p;
+
+  if(Bitmap->bitmap4_len > 3)
+    return NFS4_FATTR_PLAN_GENERIC;
+  for(i = 0; i < Bitmap->bitmap4_len; i++)
+    request[i] = Bitmap->bitmap4_val[i];
+
+  if((pplan = nfs4_fattr_plan_get(request)) == NULL || !pplan->compiled)
+    return NFS4_FATTR_PLAN_GENERIC;
+
+  if(pplan->filehandle && objFH == NULL)
+    return NFS4_FATTR_PLAN_GENERIC;
+
+  /* The variable length attributes are got first, to know the size */
+  size = pplan->fixed_size;
+  owner.utf8string_val = NULL;
+  owner_group.utf8string_val = NULL;
+
+  if(pplan->filehandle)
+    size += sizeof(u_int) + RNDUP(objFH->nfs_fh4_len);
+
+  if(pplan->owner)
+    {
+      /* On failure, the generic code leaves the attribute out */
+      if(uid2utf8(pattr->owner, &owner) != 0)
+        return NFS4_FATTR_PLAN_GENERIC;
+      size += sizeof(u_int) + RNDUP(owner.utf8string_len);
+    }
+
+  if(pplan->owner_group)
+    {
+      if(gid2utf8(pattr->group, &owner_group) != 0)
+        {
+          if(owner.utf8string_val != NULL)
+            Mem_Free(owner.utf8string_val);
+          return NFS4_FATTR_PLAN_GENERIC;
+        }
+      size += sizeof(u_int) + RNDUP(owner_group.utf8string_len);
+    }
+
+  if(size > NFS4_ATTRVALS_BUFFLEN)
+    {
+      if(owner.utf8string_val != NULL)
+        Mem_Free(owner.utf8string_val);
+      if(owner_group.utf8string_val != NULL)
+        Mem_Free(owner_group.utf8string_val);
+      return NFS4_FATTR_PLAN_GENERIC;
+    }
+
+  Fattr->attrmask.bitmap4_val = (uint32_t *) Mem_Alloc_Label(3 * sizeof(uint32_t),
+                                                             "FSALattr_To_Fattr:bitmap");
+  Fattr->attr_vals.attrlist4_val = Mem_Alloc_Label(size, "FSALattr_To_Fattr:attrvals");
+  if(Fattr->attrmask.bitmap4_val == NULL || Fattr->attr_vals.attrlist4_val == NULL)
+    {
+      if(owner.utf8string_val != NULL)
+        Mem_Free(owner.utf8string_val);
+      if(owner_group.utf8string_val != NULL)
+        Mem_Free(owner_group.utf8string_val);
+      return -1;
+    }
+
+  memcpy(Fattr->attrmask.bitmap4_val, pplan->reply, sizeof(pplan->reply));
+  Fattr->attrmask.bitmap4_len = pplan->reply_len;
+  Fattr->attr_vals.attrlist4_len = size;
+
+  p = Fattr->attr_vals.attrlist4_val;
+
+  for(i = 0; i < pplan->nb_attrs; i++)
+    {
+      switch (pplan->attrs[i])
+        {
+        case FATTR4_TYPE:
+          switch (pattr->type)
+            {
+            case FSAL_TYPE_FILE:
+            case FSAL_TYPE_XATTR:
+              file_type = NF4REG;
+              break;
+            case FSAL_TYPE_DIR:
+              file_type = NF4DIR;
+              break;
+            case FSAL_TYPE_BLK:
+              file_type = NF4BLK;
+              break;
+            case FSAL_TYPE_CHR:
+              file_type = NF4CHR;
+              break;
+            case FSAL_TYPE_LNK:
+              file_type = NF4LNK;
+              break;
+            case FSAL_TYPE_SOCK:
+              file_type = NF4SOCK;
+              break;
+            case FSAL_TYPE_FIFO:
+              file_type = NF4FIFO;
+              break;
+            default:
+              file_type = 0;
+              break;
+            }
+          p = nfs4_fattr_put32(p, file_type);
+          break;
+
+        case FATTR4_FH_EXPIRE_TYPE:
+          p = nfs4_fattr_put32(p, nfs_param.nfsv4_param.fh_expire == TRUE ?
+                               FH4_VOLATILE_ANY : FH4_PERSISTENT);
+          break;
+
+        case FATTR4_CHANGE:
+          p = nfs4_fattr_put64(p, (changeid4) pattr->change);
+          break;
+
+        case FATTR4_SIZE:
+          p = nfs4_fattr_put64(p, (fattr4_size) pattr->filesize);
+          break;
+
+        case FATTR4_LINK_SUPPORT:
+        case FATTR4_SYMLINK_SUPPORT:
+        case FATTR4_UNIQUE_HANDLES:
+          p = nfs4_fattr_put32(p, TRUE);
+          break;
+
+        case FATTR4_NAMED_ATTR:
+          p = nfs4_fattr_put32(p, FALSE);
+          break;
+
+        case FATTR4_FSID:
+          /* A referral is a different fs for the client */
+          if(nfs4_Is_Fh_Referral(objFH))
+            {
+              uint64_t fsid_major = ~nfs_htonl64((uint64_t) pexport->filesystem_id.major);
+              uint64_t fsid_minor = ~nfs_htonl64((uint64_t) pexport->filesystem_id.minor);
+
+              memcpy(p, &fsid_major, sizeof(uint64_t));
+              memcpy(p + sizeof(uint64_t), &fsid_minor, sizeof(uint64_t));
+              p += 2 * sizeof(uint64_t);
+            }
+          else
+            {
+              p = nfs4_fattr_put64(p, (uint64_t) pexport->filesystem_id.major);
+              p = nfs4_fattr_put64(p, (uint64_t) pexport->filesystem_id.minor);
+            }
+          break;
+
+        case FATTR4_LEASE_TIME:
+          p = nfs4_fattr_put32(p, nfs_param.nfsv4_param.lease_lifetime);
+          break;
+
+        case FATTR4_RDATTR_ERROR:
+          p = nfs4_fattr_put32(p, NFS4_OK);
+          break;
+
+        case FATTR4_FILEHANDLE:
+          p = nfs4_fattr_put_opaque(p, objFH->nfs_fh4_val, objFH->nfs_fh4_len);
+          break;
+
+        case FATTR4_FILEID:
+        case FATTR4_MOUNTED_ON_FILEID:
+          p = nfs4_fattr_put64(p, pattr->fileid);
+          break;
+
+        case FATTR4_MODE:
+          p = nfs4_fattr_put32(p, (fattr4_mode) fsal2unix_mode(pattr->mode));
+          break;
+
+        case FATTR4_NUMLINKS:
+          p = nfs4_fattr_put32(p, (fattr4_numlinks) pattr->numlinks);
+          break;
+
+        case FATTR4_OWNER:
+          p = nfs4_fattr_put_opaque(p, owner.utf8string_val, owner.utf8string_len);
+          break;
+
+        case FATTR4_OWNER_GROUP:
+          p = nfs4_fattr_put_opaque(p, owner_group.utf8string_val,
+                                    owner_group.utf8string_len);
+          break;
+
+        case FATTR4_RAWDEV:
+          p = nfs4_fattr_put32(p, pattr->rawdev.major);
+          p = nfs4_fattr_put32(p, pattr->rawdev.minor);
+          break;
+
+        case FATTR4_SPACE_USED:
+          p = nfs4_fattr_put64(p, (fattr4_space_used) pattr->spaceused);
+          break;
+
+        case FATTR4_TIME_ACCESS:
+          p = nfs4_fattr_put_time(p, &pattr->atime);
+          break;
+
+        case FATTR4_TIME_METADATA:
+          p = nfs4_fattr_put_time(p, &pattr->ctime);
+          break;
+
+        case FATTR4_TIME_MODIFY:
+          p = nfs4_fattr_put_time(p, &pattr->mtime);
+          break;
+        }
+    }
+
+  /* Free what was allocated by uid2utf8 and gid2utf8 */
+  if(owner.utf8string_val != NULL)
+    Mem_Free(owner.utf8string_val);
+  if(owner_group.utf8string_val != NULL)
+    Mem_Free(owner_group.utf8string_val);
+
+  return 0;
+}                               /* nfs4_FSALattr_To_Fattr_Plan */
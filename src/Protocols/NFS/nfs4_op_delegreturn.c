@@ -56,6 +56,7 @@
 #include "nfs4.h"
 #include "mount.h"
 #include "nfs_core.h"
+#include "sal_functions.h"
 #include "cache_inode.h"
 #include "cache_content.h"
 #include "nfs_exports.h"
@@ -82,11 +83,65 @@ int nfs4_op_delegreturn(struct nfs_argop4 *op,
                         compound_data_t * data, struct nfs_resop4 *resp)
 {
   char __attribute__ ((__unused__)) funcname[] = "nfs4_op_delegreturn";
+  state_status_t state_status;
+  state_t *pstate_found = NULL;
+  int rc;
 
-  /* Lock are not supported */
   resp->resop = NFS4_OP_DELEGRETURN;
   res_DELEGRETURN4.status = NFS4_OK;
 
+  /* If the filehandle is Empty */
+  if(nfs4_Is_Fh_Empty(&(data->currentFH)))
+    {
+      res_DELEGRETURN4.status = NFS4ERR_NOFILEHANDLE;
+      return res_DELEGRETURN4.status;
+    }
+
+  /* If the filehandle is invalid */
+  if(nfs4_Is_Fh_Invalid(&(data->currentFH)))
+    {
+      res_DELEGRETURN4.status = NFS4ERR_BADHANDLE;
+      return res_DELEGRETURN4.status;
+    }
+
+  /* Tests if the Filehandle is expired (for volatile filehandle) */
+  if(nfs4_Is_Fh_Expired(&(data->currentFH)))
+    {
+      res_DELEGRETURN4.status = NFS4ERR_FHEXPIRED;
+      return res_DELEGRETURN4.status;
+    }
+
+  /* Only regular files are delegated */
+  if(data->current_entry == NULL ||
+     data->current_entry->internal_md.type != REGULAR_FILE)
+    {
+      res_DELEGRETURN4.status = NFS4ERR_INVAL;
+      return res_DELEGRETURN4.status;
+    }
+
+  /* Check stateid correctness and get pointer to state */
+  if((rc = nfs4_Check_Stateid(&arg_DELEGRETURN4.deleg_stateid,
+                              data->current_entry,
+                              0LL,
+                              &pstate_found,
+                              data,
+                              STATEID_NO_SPECIAL,
+                              "DELEGRETURN")) != NFS4_OK)
+    {
+      res_DELEGRETURN4.status = rc;
+      LogDebug(COMPONENT_STATE,
+               "DELEGRETURN failed nfs4_Check_Stateid");
+      return res_DELEGRETURN4.status;
+    }
+
+  /* The delegation may have been revoked meanwhile, it is looked up again */
+  if(state_deleg_return(arg_DELEGRETURN4.deleg_stateid.other,
+                        data->pclient, &state_status) != STATE_SUCCESS)
+    {
+      res_DELEGRETURN4.status = nfs4_Errno_state(state_status);
+      return res_DELEGRETURN4.status;
+    }
+
   return res_DELEGRETURN4.status;
 }                               /* nfs4_op_delegreturn */
 
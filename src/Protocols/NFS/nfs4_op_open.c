@@ -112,6 +112,7 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
   nfs_client_id_t         * nfs_clientid;
   nfs_worker_data_t       * pworker = NULL;
   state_t                 * pfile_state = NULL;
+  state_t                 * pdeleg_state = NULL;
   state_t                 * pstate_iterate;
   state_nfs4_owner_name_t   owner_name;
   state_owner_t           * powner = NULL;
@@ -980,8 +981,24 @@ out_prev:
       (changeid4) pentry_parent->internal_md.mod_time;
   res_OPEN4.OPEN4res_u.resok4.cinfo.atomic = TRUE;
 
-  /* No delegation */
-  res_OPEN4.OPEN4res_u.resok4.delegation.delegation_type |= OPEN_DELEGATE_NONE;
+  /* A read delegation to the clients opening for read only */
+  if(claim == CLAIM_NULL &&
+     arg_OPEN4.share_access == OPEN4_SHARE_ACCESS_READ &&
+     state_deleg_grant(pentry_newfile, nfs_clientid, data->pexport, &data->currentFH,
+                       data->pclient, data->pcontext, &pdeleg_state))
+    {
+      open_read_delegation4 *pread =
+          &res_OPEN4.OPEN4res_u.resok4.delegation.open_delegation4_u.read;
+
+      res_OPEN4.OPEN4res_u.resok4.delegation.delegation_type = OPEN_DELEGATE_READ;
+      update_stateid(pdeleg_state, &pread->stateid, data, "DELEG");
+      pread->recall = FALSE;
+
+      /* No ACE, the client asks ACCESS for the other users */
+      memset(&pread->permissions, 0, sizeof(nfsace4));
+    }
+  else
+    res_OPEN4.OPEN4res_u.resok4.delegation.delegation_type = OPEN_DELEGATE_NONE;
 
   /* If server use OPEN_CONFIRM4, set the correct flag */
   if(powner->so_owner.so_nfs4_owner.so_confirmed == FALSE)
@@ -1157,6 +1174,13 @@ static nfsstat4 nfs4_do_open(struct nfs_argop4  * op,
         state_status_t state_status;
         cache_inode_status_t cache_status = CACHE_INODE_SUCCESS;
 
+        /* The read delegations of the file are returned first */
+        if(state_deleg_open_conflict(pentry_newfile, args->share_access,
+            args->share_deny)) {
+                *cause2 = " (delegation recalled)";
+                return NFS4ERR_DELAY;
+        }
+
         if(*statep == NULL) {
                 /* Set the state for the related file */
                 /* Prepare state management structure */
@@ -1176,6 +1200,10 @@ static nfsstat4 nfs4_do_open(struct nfs_argop4  * op,
                     powner, data->pclient, data->pcontext, statep,
                     &state_status) != STATE_SUCCESS) {
                         *cause2 = STATE_ADD;
+                        /* A delegation was granted meanwhile */
+                        if(state_deleg_open_conflict(pentry_newfile,
+                            args->share_access, args->share_deny))
+                                return NFS4ERR_DELAY;
                         return NFS4ERR_SHARE_DENIED;
                 }
 
@@ -177,6 +177,14 @@ int nfs4_op_remove(struct nfs_argop4 *op, compound_data_t * data, struct nfs_res
       return res_REMOVE4.status;
     }
 
+  /* The read delegations of the file are returned first */
+  if(state_deleg_remove_conflict(parent_entry, &name, data->pexport->cache_inode_policy,
+                                 data->ht, data->pclient, data->pcontext))
+    {
+      res_REMOVE4.status = NFS4ERR_DELAY;
+      return res_REMOVE4.status;
+    }
+
   if((cache_status = cache_inode_remove(parent_entry,
                                         &name,
                                         &attr_parent,
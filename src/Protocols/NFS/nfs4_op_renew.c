@@ -105,6 +105,17 @@ int nfs4_op_renew(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
     {
       nfs_clientid->last_renew = time(NULL);
       res_RENEW4.status = NFS4_OK;      /* Regular exit */
+
+      /* The lease is renewed, but a client holding delegations is told
+       * they cannot be recalled */
+      if(nfs_clientid->cb_path == CB_PATH_DOWN &&
+         nfs_clientid->clientid_owner != NULL)
+        {
+          P(nfs_clientid->clientid_owner->so_mutex);
+          if(!glist_empty(&nfs_clientid->clientid_owner->so_owner.so_nfs4_owner.so_state_list))
+            res_RENEW4.status = NFS4ERR_CB_PATH_DOWN;
+          V(nfs_clientid->clientid_owner->so_mutex);
+        }
     }
 
 out:
@@ -56,6 +56,7 @@
 #include "nfs4.h"
 #include "mount.h"
 #include "nfs_core.h"
+#include "sal_functions.h"
 #include "cache_inode.h"
 #include "cache_content.h"
 #include "nfs_exports.h"
@@ -143,6 +144,13 @@ int nfs4_op_setattr(struct nfs_argop4 *op,
       return res_SETATTR4.status;
     }
 
+  /* The read delegations of the file are returned first */
+  if(state_deleg_conflict(data->current_entry))
+    {
+      res_SETATTR4.status = NFS4ERR_DELAY;
+      return res_SETATTR4.status;
+    }
+
   /*
    * trunc may change Xtime so we have to start with trunc and finish
    * by the mtime and atime 
@@ -87,9 +87,19 @@ int nfs4_op_setclientid(struct nfs_argop4 *op,
   nfs_client_id_t * nfs_clientid;
   nfs_client_id_t   new_nfs_clientid;
   nfs_worker_data_t *pworker = NULL;
+  char *r_addr;
+  char *r_netid;
 
   pworker = (nfs_worker_data_t *) data->pclient->pworker;
 
+#ifdef _USE_NFS4_1
+  r_addr = arg_SETCLIENTID4.callback.cb_location.na_r_addr;
+  r_netid = arg_SETCLIENTID4.callback.cb_location.na_r_netid;
+#else
+  r_addr = arg_SETCLIENTID4.callback.cb_location.r_addr;
+  r_netid = arg_SETCLIENTID4.callback.cb_location.r_netid;
+#endif
+
   strncpy(str_verifier, arg_SETCLIENTID4.client.verifier, MAXNAMLEN);
   strncpy(str_client, arg_SETCLIENTID4.client.id.id_val,
           arg_SETCLIENTID4.client.id.id_len);
@@ -124,6 +134,15 @@ int nfs4_op_setclientid(struct nfs_argop4 *op,
   resp->resop = NFS4_OP_SETCLIENTID;
   res_SETCLIENTID4.status = NFS4_OK;
 
+  /* The callback address is kept in the client record */
+  if(strlen(r_addr) >= SOCK_NAME_MAX || strlen(r_netid) >= MAXNAMLEN)
+    {
+      LogDebug(COMPONENT_NFS_V4,
+               "SETCLIENTID callback address or netid too long");
+      res_SETCLIENTID4.status = NFS4ERR_INVAL;
+      return res_SETCLIENTID4.status;
+    }
+
   /* Compute the client id */
   if(nfs_client_id_basic_compute(str_client, &clientid) != CLIENT_ID_SUCCESS)
     {
@@ -218,7 +237,14 @@ retry:
                        "SETCLIENTID '%s' will set the client UNCONFIRMED and returns NFS4_OK",
                        nfs_clientid->client_name);
 
-              /* TODO: update callback program here. */
+              /* The callback may have changed, it is probed again on confirmation */
+              strncpy(nfs_clientid->client_r_addr, r_addr, SOCK_NAME_MAX - 1);
+              nfs_clientid->client_r_addr[SOCK_NAME_MAX - 1] = '\0';
+              strncpy(nfs_clientid->client_r_netid, r_netid, MAXNAMLEN - 1);
+              nfs_clientid->client_r_netid[MAXNAMLEN - 1] = '\0';
+              nfs_clientid->cb_program = arg_SETCLIENTID4.callback.cb_program;
+              nfs_clientid->cb_ident = arg_SETCLIENTID4.callback_ident;
+              nfs_clientid->cb_path = CB_PATH_UNKNOWN;
 
               /* Set the client UNCONFIRMED */
               nfs_clientid->confirmed = UNCONFIRMED_CLIENT_ID;
@@ -246,17 +272,10 @@ retry:
       strncpy(nfs_clientid->client_name, arg_SETCLIENTID4.client.id.id_val,
               arg_SETCLIENTID4.client.id.id_len);
       nfs_clientid->client_name[arg_SETCLIENTID4.client.id.id_len] = '\0';
-#ifdef _USE_NFS4_1
-      strncpy(nfs_clientid->client_r_addr, arg_SETCLIENTID4.callback.cb_location.na_r_addr,
-              SOCK_NAME_MAX);
-      strncpy(nfs_clientid->client_r_netid,
-              arg_SETCLIENTID4.callback.cb_location.na_r_netid, MAXNAMLEN);
-#else
-      strncpy(nfs_clientid->client_r_addr, arg_SETCLIENTID4.callback.cb_location.r_addr,
-              SOCK_NAME_MAX);
-      strncpy(nfs_clientid->client_r_netid, arg_SETCLIENTID4.callback.cb_location.r_netid,
-              MAXNAMLEN);
-#endif
+      strncpy(nfs_clientid->client_r_addr, r_addr, SOCK_NAME_MAX - 1);
+      nfs_clientid->client_r_addr[SOCK_NAME_MAX - 1] = '\0';
+      strncpy(nfs_clientid->client_r_netid, r_netid, MAXNAMLEN - 1);
+      nfs_clientid->client_r_netid[MAXNAMLEN - 1] = '\0';
       strncpy(nfs_clientid->incoming_verifier, arg_SETCLIENTID4.client.verifier,
               NFS4_VERIFIER_SIZE);
       snprintf(nfs_clientid->verifier, NFS4_VERIFIER_SIZE, "%u",
@@ -264,6 +283,8 @@ retry:
 
       nfs_clientid->confirmed = UNCONFIRMED_CLIENT_ID;
       nfs_clientid->cb_program = arg_SETCLIENTID4.callback.cb_program;
+      nfs_clientid->cb_ident = arg_SETCLIENTID4.callback_ident;
+      nfs_clientid->cb_path = CB_PATH_UNKNOWN;
       nfs_clientid->clientid = clientid;
       nfs_clientid->last_renew = time(NULL);
       nfs_clientid->credential = data->credential;
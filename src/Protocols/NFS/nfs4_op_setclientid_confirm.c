@@ -141,6 +141,10 @@ int nfs4_op_setclientid_confirm(struct nfs_argop4 *op,
           /* check if the client can perform reclaims */
           nfs4_chk_clid(nfs_clientid);
 
+          /* delegations are granted once the callback answered */
+          if(nfs_param.nfsv4_param.use_delegations)
+            state_deleg_probe(clientid);
+
 #if 0
           /* Set the new value */
           if(nfs_client_id_set(clientid, nfs_clientid, &pworker->clientid_pool) !=
@@ -389,6 +389,13 @@ int nfs4_op_write(struct nfs_argop4 *op, compound_data_t * data, struct nfs_reso
   seek_descriptor.whence = FSAL_SEEK_SET;
   seek_descriptor.offset = offset;
 
+  /* A write with a special stateid may find read delegations */
+  if(state_deleg_conflict(pentry))
+    {
+      res_WRITE4.status = NFS4ERR_DELAY;
+      return res_WRITE4.status;
+    }
+
   if(cache_inode_rdwr(pentry,
                       CACHE_CONTENT_WRITE,
                       &seek_descriptor,
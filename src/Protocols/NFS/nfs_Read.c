@@ -311,7 +311,8 @@ int nfs_Read(nfs_arg_t * parg,
     }
   else
     {
-      data = Mem_Alloc(size);
+      /* The data is read where it will be sent from */
+      data = rpc_buffer_get(size);
 
       if(data == NULL)
         {
@@ -345,6 +346,8 @@ int nfs_Read(nfs_arg_t * parg,
                * with error CACHE_INODE_CACHE_CONTENT_EXISTS which is not a pathological thing here */
 
               /* If we are here, there was an error */
+              rpc_buffer_release(data);
+
               if(nfs_RetryableError(cache_status))
                 {
                   return NFS_REQ_DROP;
@@ -417,6 +420,8 @@ int nfs_Read(nfs_arg_t * parg,
     }
 
   /* If we are here, there was an error */
+  rpc_buffer_release(data);
+
   if(nfs_RetryableError(cache_status))
     {
       return NFS_REQ_DROP;
@@ -444,9 +449,8 @@ int nfs_Read(nfs_arg_t * parg,
  */
 void nfs2_Read_Free(nfs_res_t * resp)
 {
-  if((resp->res_read2.status == NFS_OK) &&
-     (resp->res_read2.READ2res_u.readok.data.nfsdata2_len != 0))
-    Mem_Free(resp->res_read2.READ2res_u.readok.data.nfsdata2_val);
+  if(resp->res_read2.status == NFS_OK)
+    rpc_buffer_release(resp->res_read2.READ2res_u.readok.data.nfsdata2_val);
 }                               /* nfs2_Read_Free */
 
 /**
@@ -459,7 +463,6 @@ void nfs2_Read_Free(nfs_res_t * resp)
  */
 void nfs3_Read_Free(nfs_res_t * resp)
 {
-  if((resp->res_read3.status == NFS3_OK) &&
-     (resp->res_read3.READ3res_u.resok.data.data_len != 0))
-    Mem_Free(resp->res_read3.READ3res_u.resok.data.data_val);
+  if(resp->res_read3.status == NFS3_OK)
+    rpc_buffer_release(resp->res_read3.READ3res_u.resok.data.data_val);
 }                               /* nfs3_Read_Free */
@@ -56,6 +56,7 @@
 #include "nfs4.h"
 #include "mount.h"
 #include "nfs_core.h"
+#include "sal_functions.h"
 #include "cache_inode.h"
 #include "cache_content.h"
 #include "nfs_exports.h"
@@ -243,9 +244,12 @@ int nfs_Remove(nfs_arg_t * parg /* IN  */ ,
                            name.name);
 
               /*
-               * Remove the entry. 
+               * Remove the entry, once the NFSv4 read delegations of the
+               * file are returned.
                */
-              if(cache_inode_remove(parent_pentry,
+              if(state_deleg_conflict(pentry_child))
+                cache_status = CACHE_INODE_FSAL_DELAY;
+              else if(cache_inode_remove(parent_pentry,
                                     &name,
                                     &parent_attr,
                                     ht,
@@ -55,6 +55,7 @@
 #include "nfs4.h"
 #include "mount.h"
 #include "nfs_core.h"
+#include "sal_functions.h"
 #include "cache_inode.h"
 #include "cache_content.h"
 #include "nfs_exports.h"
@@ -235,7 +236,12 @@ int nfs_Setattr(nfs_arg_t * parg,
    * trunc may change Xtime so we have to start with trunc and finish
    * by the mtime and atime 
    */
-  if(do_trunc)
+  if(state_deleg_conflict(pentry))
+    {
+      /* The NFSv4 read delegations of the file are returned first */
+      cache_status = CACHE_INODE_FSAL_DELAY;
+    }
+  else if(do_trunc)
     {
       /* Should not be done on a directory */
       if(pentry->internal_md.type == DIRECTORY)
@@ -57,6 +57,7 @@
 #include "nfs4.h"
 #include "mount.h"
 #include "nfs_core.h"
+#include "sal_functions.h"
 #include "cache_inode.h"
 #include "cache_content.h"
 #include "cache_content_policy.h"
@@ -490,7 +491,10 @@ int nfs_Write(nfs_arg_t * parg,
       seek_descriptor.whence = FSAL_SEEK_SET;
       seek_descriptor.offset = offset;
 
-      if(cache_inode_rdwr(pentry,
+      /* The NFSv4 read delegations of the file are recalled first */
+      if(state_deleg_conflict(pentry))
+        cache_status = CACHE_INODE_FSAL_DELAY;
+      else if(cache_inode_rdwr(pentry,
                           CACHE_INODE_WRITE,
                           &seek_descriptor,
                           size,
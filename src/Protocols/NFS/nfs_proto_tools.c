@@ -708,7 +708,8 @@ static int nfs4_encode_acl(fsal_attrib_list_t * pattr, char *attrvalsBuffer, u_i
  *
  * nfs4_FSALattr_To_Fattr: Converts FSAL Attributes to NFSv4 Fattr buffer.
  *
- * Converts FSAL Attributes to NFSv4 Fattr buffer.
+ * Converts FSAL Attributes to NFSv4 Fattr buffer. The usual bitmaps are
+ * encoded from their precompiled plan, the others attribute by attribute.
  *
  * @param pexport [IN]  the related export entry.
  * @param pattr   [IN]  pointer to FSAL attributes.
@@ -724,6 +725,37 @@ int nfs4_FSALattr_To_Fattr(exportlist_t * pexport,
                            fsal_attrib_list_t * pattr,
                            fattr4 * Fattr,
                            compound_data_t * data, nfs_fh4 * objFH, bitmap4 * Bitmap)
+{
+  int rc;
+
+  rc = nfs4_FSALattr_To_Fattr_Plan(pexport, pattr, Fattr, objFH, Bitmap);
+  if(rc != NFS4_FATTR_PLAN_GENERIC)
+    return rc;
+
+  return nfs4_FSALattr_To_Fattr_Generic(pexport, pattr, Fattr, data, objFH, Bitmap);
+}                               /* nfs4_FSALattr_To_Fattr */
+
+/**
+ *
+ * nfs4_FSALattr_To_Fattr_Generic: Converts FSAL Attributes to NFSv4 Fattr buffer.
+ *
+ * Encodes the attributes one by one, whatever the bitmap.
+ *
+ * @param pexport [IN]  the related export entry.
+ * @param pattr   [IN]  pointer to FSAL attributes.
+ * @param Fattr   [OUT] NFSv4 Fattr buffer
+ * @param data    [IN]  NFSv4 compoud request's data.
+ * @param Bitmap  [OUT] NFSv4 attributes bitmap to the Fattr buffer.
+ * 
+ * @return -1 if failed, 0 if successful.
+ *
+ */
+
+int nfs4_FSALattr_To_Fattr_Generic(exportlist_t * pexport,
+                                   fsal_attrib_list_t * pattr,
+                                   fattr4 * Fattr,
+                                   compound_data_t * data, nfs_fh4 * objFH,
+                                   bitmap4 * Bitmap)
 {
   fattr4_type file_type;
   fattr4_link_support link_support;
@@ -1743,7 +1775,7 @@ int nfs4_FSALattr_To_Fattr(exportlist_t * pexport,
   /* LastOffset contains the length of the attrvalsBuffer usefull data */
 
   return 0;
-}                               /* nfs4_FSALattr_To_Fattr */
+}                               /* nfs4_FSALattr_To_Fattr_Generic */
 
 /**
  *
@@ -423,6 +423,8 @@ int nlm_process_parameters(struct svc_req        * preq,
           (*ppblock_data)->sbd_credential.group =  pcontext->credential.hpss_usercred.Gid ;
 #else
           (*ppblock_data)->sbd_credential = pcontext->credential;
+          /* The lock is granted after the request, with the first groups only */
+          FSAL_CRED_DROP_EXT_GROUPS(&(*ppblock_data)->sbd_credential);
 #endif
         }
     }
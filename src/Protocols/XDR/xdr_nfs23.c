@@ -766,7 +766,10 @@ WRITE2args *objp;
     return (FALSE);
   if(!xdr_u_int(xdrs, &objp->totalcount))
     return (FALSE);
-  if(!xdr_nfsdata2(xdrs, &objp->data))
+  /* The data is not copied when it comes in a registered buffer */
+  if(!xdr_rpc_buffer
+     (xdrs, (char **)&objp->data.nfsdata2_val, (u_int *) & objp->data.nfsdata2_len,
+      NFS2_MAXDATA))
     return (FALSE);
   return (TRUE);
 }
@@ -2119,7 +2122,8 @@ WRITE3args *objp;
     return (FALSE);
   if(!xdr_stable_how(xdrs, &objp->stable))
     return (FALSE);
-  if(!xdr_bytes(xdrs, (char **)&objp->data.data_val, (u_int *) & objp->data.data_len, ~0))
+  /* The data is not copied when it comes in a registered buffer */
+  if(!xdr_rpc_buffer(xdrs, (char **)&objp->data.data_val, (u_int *) & objp->data.data_len, ~0))
     return (FALSE);
   return (TRUE);
 }
@@ -2721,7 +2721,8 @@ bool_t xdr_WRITE4args(XDR * xdrs, WRITE4args * objp)
     return FALSE;
   if(!xdr_stable_how4(xdrs, &objp->stable))
     return FALSE;
-  if(!xdr_bytes(xdrs, (char **)&objp->data.data_val, (u_int *) & objp->data.data_len, ~0))
+  /* The data is not copied when it comes in a registered buffer */
+  if(!xdr_rpc_buffer(xdrs, (char **)&objp->data.data_val, (u_int *) & objp->data.data_len, ~0))
     return FALSE;
   return TRUE;
 }
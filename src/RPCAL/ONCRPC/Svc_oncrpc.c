@@ -66,6 +66,12 @@ int Xprt_register(SVCXPRT * xprt)
       mysvc_maxfd = max(mysvc_maxfd, sock);
     }
 
+  if(Svc_event_watch(sock) != 0)
+    {
+      Xprt_unregister(xprt);
+      return FALSE;
+    }
+
   return TRUE;
 }
 
@@ -80,6 +86,7 @@ void Xprt_unregister(SVCXPRT * xprt)
   if(Xports[sock] == xprt)
     {
       Xports[sock] = (SVCXPRT *) 0;
+      Svc_event_unwatch(sock);
     }
 
   if(sock < FD_SETSIZE)
@@ -99,6 +99,13 @@ SVCXPRT *xprt;
 
   Xports[sock] = xprt;
 
+  /* Connected TCP sockets are watched by Rendezvous_request, once they are fully set up */
+  if(get_xprt_type(xprt) != XPRT_TCP && Svc_event_watch(sock) != 0)
+    {
+      Xprt_unregister(xprt);
+      return FALSE;
+    }
+
   return TRUE;
 }
 
@@ -122,6 +129,8 @@ bool_t dolock;
     {
       Xports[sock] = NULL;
 
+      Svc_event_unwatch(sock);
+
       if(sock < FD_SETSIZE)
         {
           FD_CLR(sock, &Svc_fdset);
@@ -312,6 +321,7 @@ SVCXPRT *Svcxprt_copy(SVCXPRT *xprt_copy, SVCXPRT *xprt_orig)
       xprt_copy->xp_p1 = cd_c;
 #ifndef NO_XDRREC_PATCH
       Xdrrec_create(&(cd_c->xdrs), cd_c->sendsize, cd_c->recvsize, xprt_copy, Read_vc, Write_vc);
+      Xdrrec_set_writev(&(cd_c->xdrs), Writev_vc);
 #else
       xdrrec_create(&(cd_c->xdrs), cd_c->sendsize, cd_c->recvsize, xprt_copy, Read_vc, Write_vc);
 #endif
@@ -68,12 +68,9 @@
 #include "stuff_alloc.h"
 
 int getpeereid(int s, uid_t * euid, gid_t * egid);
-int fridgethr_get( pthread_t * pthrid, void *(*thrfunc)(void*), void * thrarg ) ;
 
 extern rw_lock_t Svc_fd_lock;
 
-extern void *rpc_tcp_socket_manager_thread(void *Arg);
-
 static SVCXPRT *Makefd_xprt(int, u_int, u_int);
 static bool_t Rendezvous_request(SVCXPRT *, struct rpc_msg *);
 static enum xprt_stat Rendezvous_stat(SVCXPRT *);
@@ -202,6 +199,7 @@ static SVCXPRT *Makefd_xprt(int fd, u_int sendsize, u_int recvsize)
   cd->strm_stat = XPRT_IDLE;
 #ifndef NO_XDRREC_PATCH
   Xdrrec_create(&(cd->xdrs), sendsize, recvsize, xprt, Read_vc, Write_vc);
+  Xdrrec_set_writev(&(cd->xdrs), Writev_vc);
 #else
   xdrrec_create(&(cd->xdrs), sendsize, recvsize, xprt, Read_vc, Write_vc);
 #endif
@@ -225,7 +223,7 @@ static SVCXPRT *Makefd_xprt(int fd, u_int sendsize, u_int recvsize)
 
 static bool_t Rendezvous_request(SVCXPRT *xprt, struct rpc_msg *msg)
 {
-  int sock, flags;
+  int sock;
   struct cf_rendezvous *r;
   struct cf_conn *cd;
   struct sockaddr_storage addr;
@@ -233,9 +231,6 @@ static bool_t Rendezvous_request(SVCXPRT *xprt, struct rpc_msg *msg)
   struct __rpc_sockinfo si;
   SVCXPRT *newxprt;
 
-  pthread_t sockmgr_thrid;
-  int rc = 0;
-
   assert(xprt != NULL);
   assert(msg != NULL);
 
@@ -296,35 +291,22 @@ static bool_t Rendezvous_request(SVCXPRT *xprt, struct rpc_msg *msg)
 
   cd->recvsize = r->recvsize;
   cd->sendsize = r->sendsize;
-  cd->maxrec = r->maxrec;
-
-  if(cd->maxrec != 0)
-    {
-      flags = fcntl(sock, F_GETFL);
-      if(flags == -1)
-        {
-          FreeXprt(xprt);
-          return (FALSE);
-        }
-      /*if (fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
-         return (FALSE); */
-      if(cd->recvsize > cd->maxrec)
-        cd->recvsize = cd->maxrec;
-      cd->nonblock = TRUE;
-      __Xdrrec_setnonblock(&cd->xdrs, cd->maxrec);
-    }
-  else
-    cd->nonblock = FALSE;
+  cd->maxrec = (r->maxrec != 0) ? r->maxrec : SVC_VC_MAXREC;
+
+  /* Connections are served by the RPC dispatcher threads, that must never block on a
+   * partial record: records are reassembled by Xdr_rec and only complete ones are decoded.
+   * The socket itself stays blocking for the workers sending replies, Read_vc does not wait */
+  if(cd->recvsize > cd->maxrec)
+    cd->recvsize = cd->maxrec;
+  cd->nonblock = TRUE;
+  __Xdrrec_setnonblock(&cd->xdrs, cd->maxrec);
   gettimeofday(&cd->last_recv_time, NULL);
 
-  FD_CLR(newxprt->xp_fd, &Svc_fdset);
-
-  if((rc =
-      fridgethr_get(&sockmgr_thrid, rpc_tcp_socket_manager_thread,
-                     (void *)((unsigned long)newxprt->xp_fd))) != 0)
+  /* Now the connection is set up, let the dispatchers watch it */
+  if(Svc_event_watch(newxprt->xp_fd) != 0)
     {
-      FreeXprt(xprt);
-      return FALSE;
+      Svc_vc_destroy(newxprt);
+      return (FALSE);
     }
 
   return (FALSE);               /* there is never an rpc msg to be processed */
@@ -400,16 +382,17 @@ int Read_vc(void *xprtp, void *buf, int len)
 
   if(cfp->nonblock)
     {
-      len = read(sock, buf, (size_t) len);
+      /* Do not wait for data, 0 means there is nothing to read yet */
+      len = recv(sock, buf, (size_t) len, MSG_DONTWAIT);
       if(len < 0)
         {
-          if(errno == EAGAIN)
-            len = 0;
-          else
-            goto fatal_err;
+          if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+          goto fatal_err;
         }
-      if(len != 0)
-        gettimeofday(&cfp->last_recv_time, NULL);
+      if(len == 0)
+        goto fatal_err;         /* the client closed the connection */
+      gettimeofday(&cfp->last_recv_time, NULL);
       return len;
     }
 
@@ -494,6 +477,68 @@ int Write_vc(void *xprtp, void *buf, int len)
   return (len);
 }
 
+/*
+ * writes data from several buffers to the tcp connection.
+ * Any error is fatal and the connection is closed.
+ */
+int Writev_vc(void *xprtp, struct iovec *iov, int iovcnt)
+{
+  SVCXPRT *xprt;
+  int len, i;
+  ssize_t cnt;
+  struct cf_conn *cd;
+  struct timeval tv0, tv1;
+
+  xprt = (SVCXPRT *) xprtp;
+  assert(xprt != NULL);
+
+  cd = (struct cf_conn *)xprt->xp_p1;
+
+  for(len = 0, i = 0; i < iovcnt; i++)
+    len += iov[i].iov_len;
+
+  if(cd->nonblock)
+    gettimeofday(&tv0, NULL);
+
+  while(iovcnt > 0)
+    {
+      cnt = writev(xprt->xp_fd, iov, iovcnt);
+      if(cnt < 0)
+        {
+          if(errno != EAGAIN || !cd->nonblock)
+            {
+              cd->strm_stat = XPRT_DIED;
+              return (-1);
+            }
+
+          /* Same 2 seconds limit as Write_vc */
+          gettimeofday(&tv1, NULL);
+          if(tv1.tv_sec - tv0.tv_sec >= 2)
+            {
+              cd->strm_stat = XPRT_DIED;
+              return (-1);
+            }
+          continue;
+        }
+
+      /* Skip what was written */
+      while(iovcnt > 0 && (size_t) cnt >= iov->iov_len)
+        {
+          cnt -= iov->iov_len;
+          iov++;
+          iovcnt--;
+        }
+
+      if(iovcnt > 0)
+        {
+          iov->iov_base = (char *)iov->iov_base + cnt;
+          iov->iov_len -= cnt;
+        }
+    }
+
+  return (len);
+}
+
 enum xprt_stat Svc_vc_stat(SVCXPRT *xprt)
 {
   struct cf_conn *cd;
@@ -522,12 +567,15 @@ bool_t Svc_vc_recv(SVCXPRT *xprt, struct rpc_msg *msg)
 
   if(cd->nonblock)
     {
-      if(!__Xdrrec_getrec(xdrs, &cd->strm_stat, TRUE))
+      /* Read_vc reports a closed connection as an error, so an empty read only
+       * means that the rest of the record has not arrived yet */
+      if(!__Xdrrec_getrec(xdrs, &cd->strm_stat, FALSE))
         return FALSE;
     }
+  else
+    (void)Xdrrec_skiprecord(xdrs);
 
   xdrs->x_op = XDR_DECODE;
-  (void)Xdrrec_skiprecord(xdrs);
   if(xdr_callmsg(xdrs, msg))
     {
       cd->x_id = msg->rm_xid;
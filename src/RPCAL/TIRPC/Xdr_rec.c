@@ -123,6 +123,27 @@ static const struct  xdr_ops Xdrrec_ops = {
 
 #define LAST_FRAG ((u_int32_t)(1 << 31))
 
+/*
+ * Registered buffers of at least XDRREC_ZEROCOPY_MIN bytes are not copied
+ * into the output buffer: they are remembered as segments, inserted at
+ * their position in the output buffer, and the whole is sent with writev.
+ */
+#define XDRREC_ZEROCOPY_MIN	4096
+#define XDRREC_MAX_SEGMENTS	8
+
+/*
+ * Records of at least XDRREC_LEND_MIN bytes are received into a registered
+ * buffer, so that their payload can be lent to the request instead of
+ * being copied out of the input buffer (see Xdrrec_lend).
+ */
+#define XDRREC_LEND_MIN		16384
+
+struct rec_segment {
+	char *pos;		/* where the segment goes in the output buffer */
+	const char *addr;
+	u_int len;
+};
+
 typedef struct rec_strm {
 	char *tcp_handle;
 	/*
@@ -134,6 +155,10 @@ typedef struct rec_strm {
 	char *out_boundry;	/* data cannot up to this address */
 	u_int32_t *frag_header;	/* beginning of curren fragment */
 	bool_t frag_sent;	/* true if buffer sent in middle of record */
+	int (*writevit)(void *, struct iovec *, int);
+	struct rec_segment out_segs[XDRREC_MAX_SEGMENTS];
+	int out_nsegs;
+	u_int out_seglen;	/* bytes in the segments */
 	/*
 	 * in-coming bits
 	 */
@@ -155,6 +180,9 @@ typedef struct rec_strm {
 	int in_reclen;
 	int in_received;
 	int in_maxrec;
+	char *in_saved_base;	/* regular input buffer, while in_base is registered */
+	u_int in_saved_size;
+	bool_t in_lent;		/* in_base belongs to a request now */
 } RECSTREAM;
 
 static u_int	fix_buf_size(u_int);
@@ -164,6 +192,8 @@ static bool_t	get_input_bytes(RECSTREAM *, char *, int);
 static bool_t	set_input_fragment(RECSTREAM *);
 static bool_t	skip_input_bytes(RECSTREAM *, long);
 static bool_t	realloc_stream(RECSTREAM *, int);
+static bool_t	register_stream(RECSTREAM *, int);
+static void	restore_stream(RECSTREAM *);
 
 
 /*
@@ -219,6 +249,9 @@ Xdrrec_create(xdrs, sendsize, recvsize, tcp_handle, readit, writeit)
 	rstrm->tcp_handle = tcp_handle;
 	rstrm->readit = readit;
 	rstrm->writeit = writeit;
+	rstrm->writevit = NULL;
+	rstrm->out_nsegs = 0;
+	rstrm->out_seglen = 0;
 	rstrm->out_finger = rstrm->out_boundry = rstrm->out_base;
 	rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_base;
 	rstrm->out_finger += sizeof(u_int32_t);
@@ -235,6 +268,9 @@ Xdrrec_create(xdrs, sendsize, recvsize, tcp_handle, readit, writeit)
 	rstrm->nonblock = FALSE;
 	rstrm->in_reclen = 0;
 	rstrm->in_received = 0;
+	rstrm->in_saved_base = NULL;
+	rstrm->in_saved_size = 0;
+	rstrm->in_lent = FALSE;
 }
 
 
@@ -326,8 +362,21 @@ Xdrrec_putbytes(xdrs, addr, len)
 	u_int len;
 {
 	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+	struct rec_segment *seg;
 	size_t current;
 
+	if (rstrm->writevit != NULL && len >= XDRREC_ZEROCOPY_MIN &&
+	    rstrm->out_nsegs < XDRREC_MAX_SEGMENTS &&
+	    rpc_buffer_is_registered(addr, len)) {
+		/* sent from where it is when the fragment is flushed */
+		seg = &rstrm->out_segs[rstrm->out_nsegs++];
+		seg->pos = rstrm->out_finger;
+		seg->addr = addr;
+		seg->len = len;
+		rstrm->out_seglen += len;
+		return (TRUE);
+	}
+
 	while (len > 0) {
 		current = (size_t)((u_long)rstrm->out_boundry -
 		    (u_long)rstrm->out_finger);
@@ -355,7 +404,8 @@ Xdrrec_getpos(xdrs)
 	switch (xdrs->x_op) {
 
 		case XDR_ENCODE:
-			pos = rstrm->out_finger - rstrm->out_base - BYTES_PER_XDR_UNIT;
+			pos = rstrm->out_finger - rstrm->out_base - BYTES_PER_XDR_UNIT
+			    + rstrm->out_seglen;
 			break;
 
 		case XDR_DECODE:
@@ -384,6 +434,10 @@ Xdrrec_setpos(xdrs, pos)
 
 		case XDR_ENCODE:
 			newpos = rstrm->out_finger - delta;
+			/* cannot move back over a segment */
+			if (rstrm->out_nsegs > 0 &&
+			    newpos < rstrm->out_segs[rstrm->out_nsegs - 1].pos)
+				break;
 			if ((newpos > (char *)(void *)(rstrm->frag_header)) &&
 				(newpos < rstrm->out_boundry)) {
 				rstrm->out_finger = newpos;
@@ -446,6 +500,7 @@ Xdrrec_destroy(xdrs)
 {
 	RECSTREAM *rstrm = (RECSTREAM *)xdrs->x_private;
 
+	restore_stream(rstrm);
 	mem_free(rstrm->out_base, rstrm->sendsize);
 	mem_free(rstrm->in_base, rstrm->recvsize);
 	mem_free(rstrm, sizeof(RECSTREAM));
@@ -514,6 +569,50 @@ Xdrrec_eof(xdrs)
 	return (FALSE);
 }
 
+/*
+ * Gives to the caller len bytes (and their padding) of the record being
+ * decoded, by reference, when the record is in a registered buffer.
+ * The caller then owns the whole buffer, and must give it back with
+ * rpc_buffer_release once it is done with the bytes. Only one caller
+ * can get bytes of a record this way.
+ * Returns NULL when the bytes have to be copied as usual.
+ */
+char *
+Xdrrec_lend(xdrs, len)
+	XDR *xdrs;
+	u_int len;
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+	u_int rndup = RNDUP(len);
+	char *addr;
+
+	if (xdrs->x_ops != &Xdrrec_ops || xdrs->x_op != XDR_DECODE ||
+	    rstrm->in_saved_base == NULL || rstrm->in_lent ||
+	    rndup > rstrm->fbtbc ||
+	    rstrm->in_finger + rndup > rstrm->in_boundry)
+		return (NULL);
+
+	addr = rstrm->in_finger;
+	rstrm->in_finger += rndup;
+	rstrm->fbtbc -= rndup;
+	rstrm->in_lent = TRUE;
+	return (addr);
+}
+
+/*
+ * Lets the stream send the registered buffers without copy, with a
+ * function like writev, but which takes the tcp_handle, not sock.
+ */
+void
+Xdrrec_set_writev(xdrs, writevit)
+	XDR *xdrs;
+	int (*writevit)(void *, struct iovec *, int);
+{
+	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
+
+	rstrm->writevit = writevit;
+}
+
 /*
  * The client must tell the package when an end-of-record has occurred.
  * The second paraemters tells whether the record should be flushed to the
@@ -528,7 +627,7 @@ Xdrrec_endofrecord(xdrs, sendnow)
 	RECSTREAM *rstrm = (RECSTREAM *)(xdrs->x_private);
 	u_long len;  /* fragment length */
 
-	if (sendnow || rstrm->frag_sent ||
+	if (sendnow || rstrm->frag_sent || rstrm->out_nsegs > 0 ||
 		((u_long)rstrm->out_finger + sizeof(u_int32_t) >=
 		(u_long)rstrm->out_boundry)) {
 		rstrm->frag_sent = FALSE;
@@ -556,6 +655,10 @@ __Xdrrec_getrec(xdrs, statp, expectdata)
 	ssize_t n;
 	int fraglen;
 
+	/* the previous record is done with */
+	if (!rstrm->in_haveheader && rstrm->in_reclen == 0)
+		restore_stream(rstrm);
+
 	if (!rstrm->in_haveheader) {
 		n = rstrm->readit(rstrm->tcp_handle, rstrm->in_hdrp,
 		    (int)sizeof (rstrm->in_header) - rstrm->in_hdrlen);
@@ -580,13 +683,22 @@ __Xdrrec_getrec(xdrs, statp, expectdata)
 			*statp = XPRT_DIED;
 			return FALSE;
 		}
+		if (rstrm->in_reclen == 0 && fraglen >= XDRREC_LEND_MIN)
+			register_stream(rstrm, fraglen);
 		rstrm->in_reclen += fraglen;
 		if (rstrm->in_reclen > rstrm->recvsize)
 			realloc_stream(rstrm, rstrm->in_reclen);
 		if (rstrm->in_header & LAST_FRAG) {
 			rstrm->in_header &= ~LAST_FRAG;
 			rstrm->last_frag = TRUE;
-		}
+		} else
+			rstrm->last_frag = FALSE;
+		rstrm->in_haveheader = TRUE;
+		/*
+		 * Reading the fragment header may have drained the
+		 * stream, the body may not be there yet.
+		 */
+		expectdata = FALSE;
 	}
 
 	n =  rstrm->readit(rstrm->tcp_handle,
@@ -648,12 +760,33 @@ flush_out(rstrm, eor)
 	u_int32_t eormask = (eor == TRUE) ? LAST_FRAG : 0;
 	u_int32_t len = (u_int32_t)((u_long)(rstrm->out_finger) - 
 		(u_long)(rstrm->frag_header) - sizeof(u_int32_t));
+	struct iovec iov[2 * XDRREC_MAX_SEGMENTS + 1];
+	char *start;
+	int i, iovcnt;
 
-	*(rstrm->frag_header) = htonl(len | eormask);
+	*(rstrm->frag_header) = htonl((len + rstrm->out_seglen) | eormask);
 	len = (u_int32_t)((u_long)(rstrm->out_finger) - 
 	    (u_long)(rstrm->out_base));
-	if ((*(rstrm->writeit))(rstrm->tcp_handle, rstrm->out_base, (int)len)
-		!= (int)len)
+	if (rstrm->out_nsegs > 0) {
+		/* the output buffer, cut where the segments go */
+		start = rstrm->out_base;
+		for (i = 0, iovcnt = 0; i < rstrm->out_nsegs; i++) {
+			iov[iovcnt].iov_base = start;
+			iov[iovcnt++].iov_len = rstrm->out_segs[i].pos - start;
+			iov[iovcnt].iov_base = (void *)rstrm->out_segs[i].addr;
+			iov[iovcnt++].iov_len = rstrm->out_segs[i].len;
+			start = rstrm->out_segs[i].pos;
+		}
+		iov[iovcnt].iov_base = start;
+		iov[iovcnt++].iov_len = rstrm->out_finger - start;
+		len += rstrm->out_seglen;
+		rstrm->out_nsegs = 0;
+		rstrm->out_seglen = 0;
+		if ((*(rstrm->writevit))(rstrm->tcp_handle, iov, iovcnt)
+			!= (int)len)
+			return (FALSE);
+	} else if ((*(rstrm->writeit))(rstrm->tcp_handle, rstrm->out_base,
+		(int)len) != (int)len)
 		return (FALSE);
 	rstrm->frag_header = (u_int32_t *)(void *)rstrm->out_base;
 	rstrm->out_finger = (char *)rstrm->out_base + sizeof(u_int32_t);
@@ -785,6 +918,24 @@ realloc_stream(rstrm, size)
 	ptrdiff_t diff;
 	char *buf;
 
+	if (rstrm->in_saved_base != NULL) {
+		/* the record outgrows its registered buffer: back to the regular one */
+		buf = rstrm->in_saved_base;
+		if (size > rstrm->in_saved_size &&
+		    (buf = realloc(buf, (size_t)size)) == NULL)
+			return FALSE;
+		memcpy(buf, rstrm->in_base, (size_t)rstrm->in_received);
+		rpc_buffer_release(rstrm->in_base);
+		if (size < rstrm->in_saved_size)
+			size = rstrm->in_saved_size;
+		rstrm->in_saved_base = NULL;
+		rstrm->in_base = rstrm->in_finger = buf;
+		rstrm->in_boundry = buf + size;
+		rstrm->recvsize = size;
+		rstrm->in_size = size;
+		return TRUE;
+	}
+
 	if (size > rstrm->recvsize) {
 		buf = realloc(rstrm->in_base, (size_t)size);
 		if (buf == NULL)
@@ -799,3 +950,47 @@ realloc_stream(rstrm, size)
 
 	return TRUE;
 }
+
+/*
+ * Receive a record into a registered buffer, if one is free.
+ */
+static bool_t
+register_stream(rstrm, size)
+	RECSTREAM *rstrm;
+	int size;
+{
+	size_t capacity;
+	char *buf;
+
+	if ((buf = rpc_buffer_get_registered((size_t)size, &capacity)) == NULL)
+		return FALSE;
+
+	rstrm->in_saved_base = rstrm->in_base;
+	rstrm->in_saved_size = rstrm->recvsize;
+	rstrm->in_lent = FALSE;
+	rstrm->in_base = rstrm->in_finger = rstrm->in_boundry = buf;
+	rstrm->recvsize = (u_int)capacity;
+	rstrm->in_size = capacity;
+	return TRUE;
+}
+
+/*
+ * Go back to the regular input buffer once the record in a registered
+ * buffer is done with. A buffer lent to a request is released by it.
+ */
+static void
+restore_stream(rstrm)
+	RECSTREAM *rstrm;
+{
+	if (rstrm->in_saved_base == NULL)
+		return;
+
+	if (!rstrm->in_lent)
+		rpc_buffer_release(rstrm->in_base);
+
+	rstrm->in_base = rstrm->in_finger = rstrm->in_boundry = rstrm->in_saved_base;
+	rstrm->recvsize = rstrm->in_saved_size;
+	rstrm->in_size = rstrm->in_saved_size;
+	rstrm->in_saved_base = NULL;
+	rstrm->in_lent = FALSE;
+}
@@ -4,6 +4,7 @@
 #ifndef GANESHA_TIRPC_H
 #define GANESHA_TIRPC_H
 
+#include <sys/uio.h>
 #include "../rpcal.h"
 #include <Rpc_com_tirpc.h>
 #ifdef PORTMAP
@@ -22,6 +23,9 @@ extern int Svc_maxfd;
 #define	su_data_set(xprt)	(xprt->xp_p2)
 #define	rpc_buffer(xprt) ((xprt)->xp_p1)
 
+/* Largest record accepted on a connection when the TI-RPC library does not set one */
+#define SVC_VC_MAXREC (4 * 1024 * 1024)
+
 struct cf_rendezvous
 {                               /* kept in xprt->xp_p1 for rendezvouser */
   u_int sendsize;
@@ -95,6 +99,7 @@ extern pthread_mutex_t dupreq_lock;
 extern int Svc_dg_enablecache(SVCXPRT *, u_int);
 extern int Read_vc(void *, void *, int);
 extern int Write_vc(void *, void *, int);
+extern int Writev_vc(void *, struct iovec *, int);
 
 #ifndef NO_XDRREC_PATCH
 extern void Xdrrec_create(XDR *xdrs,
@@ -103,6 +108,9 @@ extern void Xdrrec_create(XDR *xdrs,
                           void *tcp_handle,
                           int (*readit)(void *, void *, int), /* like read, but pass it a tcp_handle, not sock */
                           int (*writeit)(void *, void *, int)); /* like write, but pass it a tcp_handle, not sock */
+extern void     Xdrrec_set_writev(XDR *xdrs,
+                                  int (*writevit)(void *, struct iovec *, int)); /* like writev, but pass it a tcp_handle, not sock */
+extern char    *Xdrrec_lend(XDR *, u_int);
 extern bool_t   Xdrrec_eof(XDR *);
 extern bool_t   __Xdrrec_setnonblock(XDR *, int);
 extern bool_t   Xdrrec_endofrecord(XDR *, bool_t);
@@ -57,9 +57,6 @@
 #include <grp.h>
 
 #include "rpcal.h"
-#include "LRU_List.h"
-#include "HashData.h"
-#include "HashTable.h"
 #include "log.h"
 #include "nfs_core.h"
 #include "nfs23.h"
@@ -70,27 +67,54 @@
 #include "nfs_exports.h"
 #include "nfs_file_handle.h"
 #include "nfs_dupreq.h"
+#include "abstract_atomic.h"
 
-extern nfs_function_desc_t nfs2_func_desc[];
-extern nfs_function_desc_t nfs3_func_desc[];
-extern nfs_function_desc_t nfs4_func_desc[];
-extern nfs_function_desc_t mnt1_func_desc[];
-extern nfs_function_desc_t mnt3_func_desc[];
-#ifdef _USE_NLM
-extern nfs_function_desc_t nlm4_func_desc[];
-#endif                          /* _USE_NLM */
-#ifdef _USE_RQUOTA
-extern nfs_function_desc_t rquota1_func_desc[];
-extern nfs_function_desc_t rquota2_func_desc[];
-#endif                          /* _USE_QUOTA */
-/* Structure used for duplicated request cache */
-hash_table_t *ht_dupreq_udp;
-hash_table_t *ht_dupreq_tcp;
+/* The requests are spread over shards by client address and xid, each
+ * shard has its own lock. The replies kept for a client are in a list,
+ * oldest first, in a shard of clients: they are evicted when the client's
+ * replies take more than max_client_bytes, or when they expire. */
+#define DUPREQ_CLIENT_BUCKETS 64
+
+typedef struct dupreq_shard__
+{
+  pthread_mutex_t lock;
+  dupreq_entry_t **buckets;
+  uint64_t nb_hits;
+  uint64_t nb_in_progress;
+  uint64_t nb_misses;
+} dupreq_shard_t;
+
+struct dupreq_client__
+{
+  struct dupreq_client__ *next;         /* next client in the bucket */
+  sockaddr_t addr;
+  struct glist_head replies;            /* oldest first */
+  size_t mem_space;
+  unsigned int nb_entries;
+};
+
+typedef struct dupreq_client_shard__
+{
+  pthread_mutex_t lock;
+  dupreq_client_t *buckets[DUPREQ_CLIENT_BUCKETS];
+  unsigned int nb_clients;
+  unsigned int nb_entries;
+  uint64_t mem_space;
+  uint64_t nb_evicted_size;
+  uint64_t nb_evicted_age;
+} dupreq_client_shard_t;
+
+static nfs_rpc_dupreq_parameter_t dupreq_param;
+static dupreq_shard_t *dupreq_shards;
+static dupreq_client_shard_t *dupreq_client_shards;
 
 void LogDupReq(const char *label, sockaddr_t *addr, long xid, u_long rq_prog)
 {
   char namebuf[SOCK_NAME_MAX];
 
+  if(!isFullDebug(COMPONENT_DUPREQ))
+    return;
+
   sprint_sockaddr(addr, namebuf, sizeof(namebuf));
 
   LogFullDebug(COMPONENT_DUPREQ,
@@ -164,357 +188,245 @@ static unsigned int get_ipproto_by_xprt( SVCXPRT * xprt )
      return IPPROTO_IP ; /* Dummy output */
 }
 
-
-static hash_table_t * get_ht_by_xprt( SVCXPRT * xprt )
+/* Spreads the bits of a hash value, the xids of a client are consecutive */
+static inline unsigned long dupreq_mix(unsigned long h)
 {
-   return (get_ipproto_by_xprt( xprt )==IPPROTO_UDP)?ht_dupreq_udp:ht_dupreq_tcp ;
-}
+  uint64_t k = h;
 
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
 
-/**
- *
- * print_entry_dupreq: prints an entry in the LRU list.
- *
- * prints an entry in the LRU list.
- *
- * @param data [IN] data stored in a LRU entry to be printed.
- * @param str [OUT] string used to store the result.
- *
- * @return 0 if ok, other values mean an error.
- *
- */
-int print_entry_dupreq(LRU_data_t data, char *str)
-{
-  strcpy(str, "");
-  return 0;
+  return (unsigned long)k;
 }
 
-static int _remove_dupreq(hash_table_t * ht_dupreq, hash_buffer_t *buffkey, dupreq_entry_t *pdupreq,
-                          struct prealloc_pool *dupreq_pool, int nfs_req_status)
+static inline dupreq_shard_t *dupreq_shard(unsigned long hash)
 {
-  int rc;
-  nfs_function_desc_t funcdesc = nfs2_func_desc[0];
-  hash_buffer_t usedbuffkey;
-
-  rc = HashTable_Del(ht_dupreq, buffkey, &usedbuffkey, NULL);
-
-  /* if hashtable no such key => dupreq garbaged by another thread */
-  if(rc != HASHTABLE_SUCCESS && rc != HASHTABLE_ERROR_NO_SUCH_KEY)
-    return 1;                   /* Error while cleaning */
-  else if(rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-    return 0;                   /* don't free the dupreq twice */
-
-  /* Locate the function descriptor associated with this cached request */
-  if(pdupreq->rq_prog == nfs_param.core_param.program[P_NFS])
-    {
-      switch (pdupreq->rq_vers)
-        {
-        case NFS_V2:
-          funcdesc = nfs2_func_desc[pdupreq->rq_proc];
-          break;
-
-        case NFS_V3:
-          funcdesc = nfs3_func_desc[pdupreq->rq_proc];
-          break;
-
-        case NFS_V4:
-          funcdesc = nfs4_func_desc[pdupreq->rq_proc];
-          break;
-
-        default:
-          /* We should never go there (this situation is filtered in nfs_rpc_getreq) */
-          LogMajor(COMPONENT_DUPREQ,
-                   "NFS Protocol version %d unknown in dupreq_gc",
-                   (int)pdupreq->rq_vers);
-        }
-    }
-  else if(pdupreq->rq_prog == nfs_param.core_param.program[P_MNT])
-    {
-      switch (pdupreq->rq_vers)
-        {
-        case MOUNT_V1:
-          funcdesc = mnt1_func_desc[pdupreq->rq_proc];
-          break;
-
-        case MOUNT_V3:
-          funcdesc = mnt3_func_desc[pdupreq->rq_proc];
-          break;
-
-        default:
-          /* We should never go there (this situation is filtered in nfs_rpc_getreq) */
-          LogMajor(COMPONENT_DUPREQ,
-                   "MOUNT Protocol version %d unknown in dupreq_gc",
-                   (int)pdupreq->rq_vers);
-          break;
-        }                       /* switch( pdupreq->vers ) */
-    }
-#ifdef _USE_NLM
-  else if(pdupreq->rq_prog == nfs_param.core_param.program[P_NLM])
-    {
-
-      switch (pdupreq->rq_vers)
-        {
-        case NLM4_VERS:
-          funcdesc = nlm4_func_desc[pdupreq->rq_proc];
-          break;
-        }                       /* switch( pdupreq->vers ) */
-    }
-#endif                          /* _USE_NLM */
-#ifdef _USE_RQUOTA
-  else if(pdupreq->rq_prog == nfs_param.core_param.program[P_RQUOTA])
-    {
-
-      switch (pdupreq->rq_vers)
-        {
-        case RQUOTAVERS:
-          funcdesc = rquota1_func_desc[pdupreq->rq_proc];
-          break;
-
-        case EXT_RQUOTAVERS:
-          funcdesc = rquota2_func_desc[pdupreq->rq_proc];
-          break;
-        }                       /* switch( pdupreq->vers ) */
-    }
-#endif
-  else
-    {
-      /* We should never go there (this situation is filtered in nfs_rpc_getreq) */
-      LogMajor(COMPONENT_DUPREQ,
-               "protocol %d is not managed",
-               (int)pdupreq->rq_prog);
-    }
-
-  /* Call the free function */
-  if (nfs_req_status == NFS_REQ_OK)
-    funcdesc.free_function(&(pdupreq->res_nfs));
-
-  /* Send the entry back to the pool */
-  ReleaseToPool(pdupreq, dupreq_pool);
-  Mem_Free(usedbuffkey.pdata);
-
-  return DUPREQ_SUCCESS;
+  return &dupreq_shards[hash % dupreq_param.nb_shards];
 }
 
-int nfs_dupreq_delete(long xid, struct svc_req *ptr_req, SVCXPRT *xprt,
-                      struct prealloc_pool *dupreq_pool)
+static inline dupreq_entry_t **dupreq_bucket(dupreq_shard_t * pshard, unsigned long hash)
 {
-  int status;
-
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  dupreq_key_t dupkey;
-  dupreq_entry_t *pdupreq;
-  hash_table_t * ht_dupreq = NULL ;
-
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt( xprt ) ;
- 
-  /* Get the socket address for the key */
-  if(copy_xprt_addr(&dupkey.addr, xprt) == 0)
-    return DUPREQ_NOT_FOUND;
-
-  dupkey.xid = xid;
-  dupkey.checksum = 0;
-
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-
-  if(HashTable_Get(ht_dupreq, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-    {
-      pdupreq = (dupreq_entry_t *) buffval.pdata;
-
-      /* reset timestamp */
-      pdupreq->timestamp = time(NULL);
-
-      status = DUPREQ_SUCCESS;
-    }
-  else {
-    return DUPREQ_NOT_FOUND;
-  }
-
-  LogDupReq("REMOVING", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  return &pshard->buckets[(hash / dupreq_param.nb_shards) % dupreq_param.nb_buckets];
+}
 
-  status = _remove_dupreq( ht_dupreq, &buffkey, pdupreq, dupreq_pool, ! NFS_REQ_OK);
-  return status;
+static int dupreq_key_equal(dupreq_key_t * key1, dupreq_key_t * key2)
+{
+  return key1->xid == key2->xid &&
+         key1->ipproto == key2->ipproto &&
+         cmp_sockaddr(&key1->addr, &key2->addr, CHECK_PORT) != 0;
 }
 
 /**
  *
- * clean_entry_dupreq: cleans an entry in the dupreq cache.
+ * nfs_dupreq_rele: releases a reference on an entry of the duplicate request cache.
  *
- * cleans an entry in the dupreq cache.
+ * The entry is freed with the last reference, once it is out of the cache.
  *
- * @param pentry [INOUT] entry to be cleaned.
- * @param addparam [IN] additional parameter used for cleaning.
+ * @param pdupreq [IN] the entry, may be NULL
  *
- * @return 0 if ok, other values mean an error.
+ * @return nothing (void function)
  *
  */
-int clean_entry_dupreq(LRU_entry_t * pentry, void *addparam)
+void nfs_dupreq_rele(dupreq_entry_t * pdupreq)
 {
-  hash_buffer_t buffkey;
-  struct prealloc_pool *dupreq_pool = (struct prealloc_pool *) addparam;
-  dupreq_entry_t *pdupreq = (dupreq_entry_t *) (pentry->buffdata.pdata);
-  dupreq_key_t dupkey;
-  hash_table_t * ht_dupreq = NULL ;
-  
-  /* Get the socket address for the key */
-  memcpy((char *)&dupkey.addr, (char *)&pdupreq->addr, sizeof(dupkey.addr));
-  dupkey.xid = pdupreq->xid;
-  dupkey.checksum = pdupreq->checksum;
-
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-
-  /* Get correct HT depending on proto used */
-  if( pdupreq->ipproto == IPPROTO_TCP )
-     ht_dupreq = ht_dupreq_tcp ;
-  else
-     ht_dupreq = ht_dupreq_udp ;
-
-  LogDupReq("Garbage collection on", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  if(pdupreq == NULL)
+    return;
 
-  return _remove_dupreq(ht_dupreq, &buffkey, pdupreq, dupreq_pool, NFS_REQ_OK);
-}                               /* clean_entry_dupreq */
+  if(atomic_dec_uint32_t(&pdupreq->refcount) == 0)
+    Mem_Free(pdupreq);
+}                               /* nfs_dupreq_rele */
 
 /**
  *
- *  dupreq_rbt_hash_func: computes the hash value for the entry in dupreq cache.
+ * dupreq_unhash: removes an entry from its shard.
  *
- * Computes the hash value for the entry in dupreq cache. In fact, it just use the Xid modulo the hash array size.
- * This function is called internal in the HasTable_* function
+ * @param pdupreq [IN] the entry to remove
  *
- * @param hparam [IN] hash table parameter.
- * @param buffcleff[in] pointer to the hash key buffer
- *
- * @return the computed hash value.
- *
- * @see HashTable_Init
+ * @return TRUE if the entry was removed, FALSE if it was not in its shard.
  *
  */
-unsigned long dupreq_value_hash_func(hash_parameter_t * p_hparam,
-                                     hash_buffer_t * buffclef)
+static int dupreq_unhash(dupreq_entry_t * pdupreq)
 {
-  dupreq_key_t *pdupkey = (dupreq_key_t *)(buffclef->pdata);
-  unsigned long addr_hash = hash_sockaddr((sockaddr_t *) &pdupkey->addr, CHECK_PORT);
-
-  return (((unsigned long)pdupkey->xid + addr_hash)^(pdupkey->checksum)) % p_hparam->index_size;
-}                               /*  dupreq_value_hash_func */
+  dupreq_shard_t *pshard = dupreq_shard(pdupreq->hash);
+  dupreq_entry_t **pprev;
+
+  P(pshard->lock);
+  for(pprev = dupreq_bucket(pshard, pdupreq->hash); *pprev != NULL;
+      pprev = &(*pprev)->next)
+    if(*pprev == pdupreq)
+      {
+        *pprev = pdupreq->next;
+        V(pshard->lock);
+
+        /* Drop the reference of the cache */
+        nfs_dupreq_rele(pdupreq);
+        return TRUE;
+      }
+  V(pshard->lock);
+
+  return FALSE;
+}                               /* dupreq_unhash */
 
 /**
  *
- *  dupreq_rbt_hash_func: computes the rbt value for the entry in dupreq cache.
+ * dupreq_evict_client: evicts the oldest replies of a client.
  *
- * Computes the rbt value for the entry in dupreq cache. In fact, it just use the Xid
- * itself (which is an unsigned integer) as the rbt value.
- * This function is called internal in the HasTable_* function
+ * Evicts the replies which expired, and the oldest ones while the replies
+ * of the client take more than the memory it is allowed. The client shard
+ * must be locked. The evicted entries are moved to a list, to be removed
+ * from their shard once the client shard is unlocked.
  *
- * @param hparam [IN] hash table parameter.
- * @param buffcleff[in] pointer to the hash key buffer
+ * @param pcshard [INOUT] the locked client shard
+ * @param pclient [INOUT] the client
+ * @param pkeep   [IN]    an entry not to be evicted for memory, or NULL
+ * @param now     [IN]    the current time
+ * @param victims [OUT]   the list the evicted entries are added to
  *
- * @return the computed rbt value.
- *
- * @see HashTable_Init
+ * @return nothing (void function)
  *
  */
-unsigned long dupreq_rbt_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef)
+static void dupreq_evict_client(dupreq_client_shard_t * pcshard,
+                                dupreq_client_t * pclient,
+                                dupreq_entry_t * pkeep,
+                                time_t now, struct glist_head *victims)
 {
-  dupreq_key_t *pdupkey = (dupreq_key_t *)(buffclef->pdata);
+  dupreq_entry_t *poldest;
+  size_t size;
 
-  unsigned long addr_hash = hash_sockaddr((sockaddr_t *) &pdupkey->addr, CHECK_PORT);
+  while((poldest = glist_first_entry(&pclient->replies, dupreq_entry_t,
+                                     client_list)) != NULL)
+    {
+      if(now - poldest->timestamp > nfs_param.core_param.expiration_dupreq)
+        pcshard->nb_evicted_age += 1;
+      else if(pclient->mem_space > dupreq_param.max_client_bytes && poldest != pkeep)
+        pcshard->nb_evicted_size += 1;
+      else
+        break;
 
-  return (((unsigned long)pdupkey->xid + addr_hash)^(pdupkey->checksum));
-}                               /* dupreq_rbt_hash_func */
+      size = sizeof(dupreq_entry_t) + poldest->reply_len;
+      pclient->mem_space -= size;
+      pclient->nb_entries -= 1;
+      pcshard->mem_space -= size;
+      pcshard->nb_entries -= 1;
 
-/**
- *
- * compare_req: compares the xid, ip, and port stored in the key buffers.
- * may also compare the checksum if the relevant option was enabled during
- * compile.
- *
- * compare the xid, ip, and port stored in the key buffers. This function is
- * to be used as 'compare_key' field in
- * the hashtable storing the nfs duplicated requests.
- *
- * @param buff1 [IN] first key
- * @param buff2 [IN] second key
- *
- * @return 0 if keys are identifical, 1 if they are different.
- *
- */
-int compare_req(hash_buffer_t * buff1, hash_buffer_t * buff2)
+      glist_del(&poldest->client_list);
+      glist_add_tail(victims, &poldest->client_list);
+    }
+}                               /* dupreq_evict_client */
+
+static void dupreq_unhash_victims(struct glist_head *victims)
 {
-  dupreq_key_t *key1 = (dupreq_key_t *)(buff1->pdata);
-  dupreq_key_t *key2 = (dupreq_key_t *)(buff2->pdata);
-
-  if (key1->xid != key2->xid)
-    return 1;
-  if (cmp_sockaddr(&key1->addr, &key2->addr, CHECK_PORT) == 0)
-    return 1;
-  if (key1->checksum != key2->checksum)
-    return 1;
-  return 0;
-}                               /* compare_xid */
+  struct glist_head *node, *noden;
+  dupreq_entry_t *pdupreq;
+
+  glist_for_each_safe(node, noden, victims)
+    {
+      pdupreq = glist_entry(node, dupreq_entry_t, client_list);
+      LogDupReq("Evicting", &pdupreq->key.addr, pdupreq->key.xid, pdupreq->rq_prog);
+      dupreq_unhash(pdupreq);
+    }
+}                               /* dupreq_unhash_victims */
 
 /**
  *
- * display_req_key: displays the key stored in the buffer.
+ * dupreq_client_add: accounts a reply to its client.
  *
- * displays the key stored in the buffer. This function is to be used as 'key_to_str' field in
- * the hashtable storing the nfs duplicated requests.
+ * Adds a reply just cached to the replies of its client, then evicts the
+ * client's replies which do not fit in its bounds any longer.
  *
- * @param buff1 [IN]  buffer to display
- * @param buff2 [OUT] output string
+ * @param pdupreq [IN] the entry of the reply
  *
- * @return number of character written.
+ * @return nothing (void function)
  *
  */
-int display_req_key(hash_buffer_t * pbuff, char *str)
+static void dupreq_client_add(dupreq_entry_t * pdupreq)
 {
-  dupreq_key_t *pdupkey = (dupreq_key_t *)(pbuff->pdata);
-  char namebuf[SOCK_NAME_MAX];
+  unsigned long hash = dupreq_mix(hash_sockaddr(&pdupreq->key.addr, IGNORE_PORT));
+  dupreq_client_shard_t *pcshard = &dupreq_client_shards[hash % dupreq_param.nb_shards];
+  dupreq_client_t **pbucket =
+      &pcshard->buckets[(hash / dupreq_param.nb_shards) % DUPREQ_CLIENT_BUCKETS];
+  dupreq_client_t *pclient;
+  size_t size = sizeof(dupreq_entry_t) + pdupreq->reply_len;
+  struct glist_head victims;
 
-  sprint_sockaddr(&pdupkey->addr, namebuf, sizeof(namebuf));
+  init_glist(&victims);
 
-  return sprintf("addr=%s xid=%ld checksum=%d",
-                 namebuf, pdupkey->xid, pdupkey->checksum);
+  P(pcshard->lock);
 
-}
+  for(pclient = *pbucket; pclient != NULL; pclient = pclient->next)
+    if(cmp_sockaddr(&pclient->addr, &pdupreq->key.addr, IGNORE_PORT) != 0)
+      break;
+
+  if(pclient == NULL)
+    {
+      if((pclient = (dupreq_client_t *) Mem_Alloc(sizeof(dupreq_client_t))) == NULL)
+        {
+          V(pcshard->lock);
+
+          /* The reply can not be bounded, do not keep it */
+          LogCrit(COMPONENT_DUPREQ,
+                  "Cannot allocate a client of the duplicate request cache");
+          dupreq_unhash(pdupreq);
+          return;
+        }
+
+      memcpy(&pclient->addr, &pdupreq->key.addr, sizeof(pclient->addr));
+      init_glist(&pclient->replies);
+      pclient->mem_space = 0;
+      pclient->nb_entries = 0;
+      pclient->next = *pbucket;
+      *pbucket = pclient;
+      pcshard->nb_clients += 1;
+    }
+
+  pdupreq->pclient = pclient;
+  glist_add_tail(&pclient->replies, &pdupreq->client_list);
+  pclient->mem_space += size;
+  pclient->nb_entries += 1;
+  pcshard->mem_space += size;
+  pcshard->nb_entries += 1;
+
+  dupreq_evict_client(pcshard, pclient, pdupreq, pdupreq->timestamp, &victims);
+
+  V(pcshard->lock);
+
+  dupreq_unhash_victims(&victims);
+}                               /* dupreq_client_add */
 
 /**
  *
- * display_req_val: displays the value stored in the buffer.
+ * nfs_dupreq_delete: removes the entry of a request being processed.
  *
- * displays the value stored in the buffer. This function is to be used as 'val_to_str' field in
- * the hashtable storing the nfs duplicated requests.
+ * Removes from the duplicate request cache the entry added by
+ * nfs_dupreq_add_not_finished for a request whose reply is not cached.
  *
- * @param buff1 [IN]  buffer to display
- * @param buff2 [OUT] output string
+ * @param pdupreq [IN] the entry, may be NULL if the request was not tracked
  *
- * @return number of character written.
+ * @return DUPREQ_SUCCESS if successfull\n.
+ * @return DUPREQ_NOT_FOUND if the entry was not in the cache.
  *
  */
-int display_req_val(hash_buffer_t * pbuff, char *str)
+int nfs_dupreq_delete(dupreq_entry_t * pdupreq)
 {
-  dupreq_entry_t *pdupreq = (dupreq_entry_t *)(pbuff->pdata);
-  char namebuf[SOCK_NAME_MAX];
+  if(pdupreq == NULL)
+    return DUPREQ_SUCCESS;
 
-  sprint_sockaddr(&pdupreq->addr, namebuf, sizeof(namebuf));
+  LogDupReq("REMOVING", &pdupreq->key.addr, pdupreq->key.xid, pdupreq->rq_prog);
 
-  return sprintf("addr=%s xid=%ld checksum=%d rq_prog=%lu rq_vers=%lu rq_proc=%lu",
-                 namebuf, pdupreq->xid, pdupreq->checksum,
-                 pdupreq->rq_prog, pdupreq->rq_vers, pdupreq->rq_proc);
-}
+  if(!dupreq_unhash(pdupreq))
+    return DUPREQ_NOT_FOUND;
+
+  return DUPREQ_SUCCESS;
+}                               /* nfs_dupreq_delete */
 
 /**
  *
- * nfs_Init_dupreq: Init the hashtable and LRU for duplicate request cache
+ * nfs_Init_dupreq: Init the shards of the duplicate request cache
  *
- * Perform all the required initialization for hashtable and LRU for duplicate request cache
+ * Perform all the required initialization for the duplicate request cache
  *
  * @param param [IN] parameter used to init the duplicate request cache
  *
@@ -523,20 +435,40 @@ int display_req_val(hash_buffer_t * pbuff, char *str)
  */
 int nfs_Init_dupreq(nfs_rpc_dupreq_parameter_t param)
 {
-  if((ht_dupreq_udp = HashTable_Init(param.hash_param)) == NULL)
+  unsigned int i;
+
+  if(param.nb_shards == 0 || param.nb_buckets == 0)
     {
       LogCrit(COMPONENT_DUPREQ,
-              "Cannot init the duplicate request hash table");
+              "The duplicate request cache needs at least one shard and one bucket");
       return -1;
     }
 
-  if((ht_dupreq_tcp = HashTable_Init(param.hash_param)) == NULL)
+  dupreq_param = param;
+
+  dupreq_shards = (dupreq_shard_t *) Mem_Calloc(param.nb_shards, sizeof(dupreq_shard_t));
+  dupreq_client_shards =
+      (dupreq_client_shard_t *) Mem_Calloc(param.nb_shards, sizeof(dupreq_client_shard_t));
+  if(dupreq_shards == NULL || dupreq_client_shards == NULL)
     {
       LogCrit(COMPONENT_DUPREQ,
-              "Cannot init the duplicate request hash table");
+              "Cannot init the duplicate request cache");
       return -1;
     }
 
+  for(i = 0; i < param.nb_shards; i++)
+    {
+      dupreq_shards[i].buckets =
+          (dupreq_entry_t **) Mem_Calloc(param.nb_buckets, sizeof(dupreq_entry_t *));
+      if(dupreq_shards[i].buckets == NULL ||
+         pthread_mutex_init(&dupreq_shards[i].lock, NULL) != 0 ||
+         pthread_mutex_init(&dupreq_client_shards[i].lock, NULL) != 0)
+        {
+          LogCrit(COMPONENT_DUPREQ,
+                  "Cannot init the duplicate request cache");
+          return -1;
+        }
+    }
 
   return DUPREQ_SUCCESS;
 }                               /* nfs_Init_dupreq */
@@ -545,288 +477,287 @@ int nfs_Init_dupreq(nfs_rpc_dupreq_parameter_t param)
  *
  * nfs_dupreq_add_not_finished: adds an entry in the duplicate requests cache.
  *
- * Adds an entry in the duplicate requests cache.
+ * Adds the entry of a request being processed in the duplicate requests
+ * cache, unless the request is already known.
  *
- * @param xid [IN] the transfer id to be used as key
- * @param pnfsreq [IN] the request pointer to cache
+ * @param xid       [IN]  the transfer id to be used as key
+ * @param ptr_req   [IN]  the request
+ * @param xprt      [IN]  the transport the request came from
+ * @param cacheable [IN]  TRUE if the reply of the request is to be cached
+ * @param ppdupreq  [OUT] the entry added, or the entry holding the reply to
+ *                        be replayed with a reference to be released by
+ *                        nfs_dupreq_rele. NULL if the request is not tracked.
  *
- * @return DUPREQ_SUCCESS if successfull\n.
+ * @return DUPREQ_SUCCESS if the request is new\n.
+ * @return DUPREQ_ALREADY_EXISTS if the reply of the request is cached\n.
+ * @return DUPREQ_BEING_PROCESSED if the request is being processed\n.
  * @return DUPREQ_INSERT_MALLOC_ERROR if an error occured during the insertion process.
  *
  */
-
 int nfs_dupreq_add_not_finished(long xid,
                                 struct svc_req *ptr_req,
                                 SVCXPRT *xprt,
-                                struct prealloc_pool *dupreq_pool,
-                                nfs_res_t *res_nfs)
+                                int cacheable,
+                                dupreq_entry_t **ppdupreq)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  hash_buffer_t buffdata;
-  dupreq_entry_t *pdupreq = NULL;
-  int status = 0;
-  dupreq_key_t *pdupkey = NULL;
-  hash_table_t * ht_dupreq = NULL ;
-
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt( xprt ) ;
- 
-  /* Entry to be cached */
-  GetFromPool(pdupreq, dupreq_pool, dupreq_entry_t);
-  if(pdupreq == NULL)
+  dupreq_entry_t *pdupreq;
+  dupreq_entry_t *pfound;
+  dupreq_entry_t **pbucket;
+  dupreq_shard_t *pshard;
+  int status;
+
+  *ppdupreq = NULL;
+
+  if(!cacheable && dupreq_param.non_idempotent_only)
+    return DUPREQ_SUCCESS;
+
+  /* Entry to be cached, with its key */
+  if((pdupreq = (dupreq_entry_t *) Mem_Alloc(sizeof(dupreq_entry_t))) == NULL)
     return DUPREQ_INSERT_MALLOC_ERROR;
 
   memset(pdupreq, 0, sizeof(*pdupreq));
-  if(pthread_mutex_init(&pdupreq->dupreq_mutex, NULL) == -1)
-    {
-      ReleaseToPool(pdupreq, dupreq_pool);
-      return DUPREQ_INSERT_MALLOC_ERROR;
-    }
 
-  if((pdupkey = (dupreq_key_t *) Mem_Alloc(sizeof(dupreq_key_t))) == NULL)
-    {
-      ReleaseToPool(pdupreq, dupreq_pool);
-      return DUPREQ_INSERT_MALLOC_ERROR;
-    }
-
-  /* Get the socket address for the key and the request */
-  if(copy_xprt_addr(&pdupkey->addr, xprt) == 0 ||
-     copy_xprt_addr(&pdupreq->addr, xprt) == 0)
+  /* Get the socket address for the key */
+  if(copy_xprt_addr(&pdupreq->key.addr, xprt) == 0)
     {
-      Mem_Free(pdupkey);
-      ReleaseToPool(pdupreq, dupreq_pool);
+      Mem_Free(pdupreq);
       return DUPREQ_INSERT_MALLOC_ERROR;
     }
 
-  pdupkey->xid = xid;
-  pdupreq->xid = xid;
-
-  /* Checksum the request */
-  pdupkey->checksum = 0;
-  pdupreq->checksum = 0;
-
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) pdupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-
-  /* I build the data with the request pointer that should be in state 'IN USE' */
+  pdupreq->key.xid = xid;
+  pdupreq->key.ipproto = get_ipproto_by_xprt(xprt);
+  pdupreq->hash = dupreq_mix(hash_sockaddr(&pdupreq->key.addr, CHECK_PORT) ^
+                             ((unsigned long)xid << 8) ^ pdupreq->key.ipproto);
   pdupreq->rq_prog = ptr_req->rq_prog;
   pdupreq->rq_vers = ptr_req->rq_vers;
   pdupreq->rq_proc = ptr_req->rq_proc;
   pdupreq->timestamp = time(NULL);
   pdupreq->processing = 1;
-  pdupreq->ipproto = get_ipproto_by_xprt( xprt ) ;
-  buffdata.pdata = (caddr_t) pdupreq;
-  buffdata.len = sizeof(dupreq_entry_t);
+  pdupreq->refcount = 1;
+
+  LogDupReq("Add Not Finished", &pdupreq->key.addr, xid, pdupreq->rq_prog);
 
-  LogDupReq("Add Not Finished", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  pshard = dupreq_shard(pdupreq->hash);
+  pbucket = dupreq_bucket(pshard, pdupreq->hash);
 
-  status = HashTable_Test_And_Set(ht_dupreq, &buffkey, &buffdata,
-                                  HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
+  P(pshard->lock);
 
-  if (status == HASHTABLE_ERROR_KEY_ALREADY_EXISTS)
+  for(pfound = *pbucket; pfound != NULL; pfound = pfound->next)
+    if(pfound->hash == pdupreq->hash && dupreq_key_equal(&pfound->key, &pdupreq->key))
+      break;
+
+  if(pfound == NULL)
     {
-      if(HashTable_Get(ht_dupreq, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-        {
-          P(((dupreq_entry_t *)buffval.pdata)->dupreq_mutex);
-          if ( ((dupreq_entry_t *)buffval.pdata)->processing == 1)
-            {
-              status = DUPREQ_BEING_PROCESSED;
-            }
-          else
-            {
-              *res_nfs = ((dupreq_entry_t *) buffval.pdata)->res_nfs;
-              status = DUPREQ_ALREADY_EXISTS;
-            }
-          V(((dupreq_entry_t *)buffval.pdata)->dupreq_mutex);
-        }
-      else
-        status = DUPREQ_NOT_FOUND;
+      pdupreq->next = *pbucket;
+      *pbucket = pdupreq;
+      pshard->nb_misses += 1;
+      *ppdupreq = pdupreq;
+      status = DUPREQ_SUCCESS;
+    }
+  else if(pfound->processing)
+    {
+      pshard->nb_in_progress += 1;
+      status = DUPREQ_BEING_PROCESSED;
     }
-  else if (status == HASHTABLE_INSERT_MALLOC_ERROR)
-      status = DUPREQ_INSERT_MALLOC_ERROR;
   else
-    status = DUPREQ_SUCCESS;
-  if (status != DUPREQ_SUCCESS) {
-    ReleaseToPool(pdupreq, dupreq_pool);
-    Mem_Free(pdupkey);
-  }
+    {
+      atomic_inc_uint32_t(&pfound->refcount);
+      pshard->nb_hits += 1;
+      *ppdupreq = pfound;
+      status = DUPREQ_ALREADY_EXISTS;
+    }
+
+  V(pshard->lock);
+
+  if(status != DUPREQ_SUCCESS)
+    {
+      LogDupReq(status == DUPREQ_ALREADY_EXISTS ? "Hit in the dupreq cache for" :
+                "Being processed", &pdupreq->key.addr, xid, pdupreq->rq_prog);
+      Mem_Free(pdupreq);
+    }
+
   return status;
 }                               /* nfs_dupreq_add_not_finished */
 
 /**
  *
- * nfs_dupreq_finish: Changes the being_processed flag in a dupreq to 0 and
- * adds the reply info to the buffval.
+ * nfs_dupreq_finish: caches the reply of a request.
  *
- * Changes the being_processed flag in a dupreq to 0 and adds the reply info
- * to the buffval. Used after the duplicate request has already been added to
- * the dupreq cache but has not been fully processed yet.
+ * Encodes the reply of a request added by nfs_dupreq_add_not_finished. The
+ * entry of the request is replaced by an entry of the reply, allocated in
+ * one piece with its encoded form, that is what is replayed and sent.
  *
- * @param xid [IN] the transfer id to be used as key
- * @param pnfsreq [IN] the request pointer to cache
+ * @param ppdupreq        [INOUT] the entry of the request, then the entry of the
+ *                                reply with a reference to be released by
+ *                                nfs_dupreq_rele. NULL if the reply could not
+ *                                be cached, the entry of the request is removed.
+ * @param xdr_encode_func [IN]    the encoding function of the reply
+ * @param p_res_nfs       [IN]    the reply
  *
  * @return DUPREQ_SUCCESS if successfull\n.
- * @return DUPREQ_INSERT_MALLOC_ERROR if an error occured during the insertion process.
+ * @return DUPREQ_INSERT_MALLOC_ERROR if the reply could not be encoded.
  *
  */
-
-int nfs_dupreq_finish(long xid,
-                      struct svc_req *ptr_req,
-                      SVCXPRT *xprt,
-                      nfs_res_t * p_res_nfs,
-                      LRU_list_t * lru_dupreq)
+int nfs_dupreq_finish(dupreq_entry_t **ppdupreq,
+                      xdrproc_t xdr_encode_func,
+                      nfs_res_t * p_res_nfs)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  LRU_entry_t *pentry = NULL;
-  LRU_status_t lru_status;
-  dupreq_key_t dupkey;
+  dupreq_entry_t *pold = *ppdupreq;
   dupreq_entry_t *pdupreq;
-  hash_table_t * ht_dupreq = NULL ;
+  dupreq_entry_t **pprev;
+  dupreq_shard_t *pshard;
+  unsigned long len;
+  XDR xdrs;
 
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt( xprt ) ;
- 
+  *ppdupreq = NULL;
 
-  /* Get the socket address for the key */
-  if(copy_xprt_addr(&dupkey.addr, xprt) == 0)
-    return DUPREQ_NOT_FOUND;
-
-  dupkey.xid = xid;
-  dupkey.checksum = 0;
+  len = xdr_sizeof(xdr_encode_func, p_res_nfs);
+  if(len == 0 ||
+     (pdupreq = (dupreq_entry_t *) Mem_Alloc(sizeof(dupreq_entry_t) + len)) == NULL)
+    {
+      LogCrit(COMPONENT_DUPREQ,
+              "Unable to allocate %lu bytes to cache a reply", len);
+      nfs_dupreq_delete(pold);
+      return DUPREQ_INSERT_MALLOC_ERROR;
+    }
 
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-  if(HashTable_Get(ht_dupreq, &buffkey, &buffval) != HASHTABLE_SUCCESS)
-    return DUPREQ_NOT_FOUND;
+  *pdupreq = *pold;
+  pdupreq->reply = (char *)(pdupreq + 1);
+  pdupreq->reply_len = len;
 
-  pdupreq = (dupreq_entry_t *)buffval.pdata;
+  xdrmem_create(&xdrs, pdupreq->reply, len, XDR_ENCODE);
+  if(!xdr_encode_func(&xdrs, p_res_nfs))
+    {
+      LogCrit(COMPONENT_DUPREQ, "Unable to encode a reply for caching");
+      xdr_destroy(&xdrs);
+      Mem_Free(pdupreq);
+      nfs_dupreq_delete(pold);
+      return DUPREQ_INSERT_MALLOC_ERROR;
+    }
+  xdr_destroy(&xdrs);
 
-  LogDupReq("Finish", &pdupreq->addr, pdupreq->xid, pdupreq->rq_prog);
+  /* One reference for the cache, one for the caller */
+  pdupreq->refcount = 2;
+  pdupreq->processing = 0;
+  pdupreq->timestamp = time(NULL);
 
-  P(pdupreq->dupreq_mutex);
+  LogDupReq("Finish", &pdupreq->key.addr, pdupreq->key.xid, pdupreq->rq_prog);
 
-  pdupreq->res_nfs = *p_res_nfs;
-  pdupreq->timestamp = time(NULL);
-  pdupreq->processing = 0;
+  /* Nobody else references the entry of a request being processed */
+  pshard = dupreq_shard(pdupreq->hash);
+  P(pshard->lock);
+  for(pprev = dupreq_bucket(pshard, pdupreq->hash); *pprev != pold;
+      pprev = &(*pprev)->next) ;
+  pdupreq->next = pold->next;
+  *pprev = pdupreq;
+  V(pshard->lock);
 
-  V(pdupreq->dupreq_mutex);
+  Mem_Free(pold);
 
-  /* Add it to lru list */
-  if((pentry = LRU_new_entry(lru_dupreq, &lru_status)) == NULL)
-    return DUPREQ_INSERT_MALLOC_ERROR;
-  pentry->buffdata.pdata = buffval.pdata;
-  pentry->buffdata.len = buffval.len;
+  dupreq_client_add(pdupreq);
 
+  *ppdupreq = pdupreq;
   return DUPREQ_SUCCESS;
 }                               /* nfs_dupreq_finish */
 
 /**
  *
- * nfs_dupreq_get: Tries to get a duplicated requests for dupreq cache
+ * nfs_dupreq_xdr_reply: sends the encoded reply kept in an entry.
  *
- * Tries to get a duplicated requests for dupreq cache.
+ * To be given to svc_sendreply, in place of the encoding function of the reply.
  *
- * @param xid [IN] the transfer id we are looking for
- * @param pstatus [OUT] the pointer to the status for the operation
+ * @param xdrs    [INOUT] the XDR stream of the reply
+ * @param pdupreq [IN]    the entry of the reply
  *
- * @return the result previously set if *pstatus == DUPREQ_SUCCESS
+ * @return TRUE if successful, FALSE otherwise.
  *
  */
-nfs_res_t nfs_dupreq_get(long xid, struct svc_req *ptr_req, SVCXPRT *xprt, int *pstatus)
+bool_t nfs_dupreq_xdr_reply(XDR * xdrs, dupreq_entry_t * pdupreq)
 {
-  hash_buffer_t buffkey;
-  hash_buffer_t buffval;
-  nfs_res_t res_nfs;
-  dupreq_key_t dupkey;
-  hash_table_t * ht_dupreq = NULL ;
-
-  /* Get correct HT depending on proto used */
-  ht_dupreq = get_ht_by_xprt( xprt ) ;
- 
+  if(xdrs->x_op != XDR_ENCODE)
+    return TRUE;
 
-  memset(&res_nfs, 0, sizeof(res_nfs));
-
-  /* Get the socket address for the key */
-  if(copy_xprt_addr(&dupkey.addr, xprt) == 0)
-    {
-      *pstatus = DUPREQ_NOT_FOUND;
-      return res_nfs;
-    }
-
-  dupkey.xid = xid;
-  dupkey.checksum = 0;
-
-  /* I have to keep an integer as key, I wil use the pointer buffkey->pdata for this,
-   * this also means that buffkey->len will be 0 */
-  buffkey.pdata = (caddr_t) &dupkey;
-  buffkey.len = sizeof(dupreq_key_t);
-  if(HashTable_Get(ht_dupreq, &buffkey, &buffval) == HASHTABLE_SUCCESS)
-    {
-      dupreq_entry_t *pdupreq = (dupreq_entry_t *)buffval.pdata;
-      /* reset timestamp */
-      pdupreq->timestamp = time(NULL);
-
-      *pstatus = DUPREQ_SUCCESS;
-      res_nfs = pdupreq->res_nfs;
-      LogDupReq(" dupreq_get: Hit in the dupreq cache for", &pdupreq->addr,
-		pdupreq->xid, pdupreq->rq_prog);
-    }
-  else
-    {
-      LogDupReq("Failed to get dupreq entry", &dupkey.addr, dupkey.xid, ptr_req->rq_prog);
-      *pstatus = DUPREQ_NOT_FOUND;
-    }
-  return res_nfs;
-}                               /* nfs_dupreq_get */
+  return XDR_PUTBYTES(xdrs, pdupreq->reply, pdupreq->reply_len);
+}                               /* nfs_dupreq_xdr_reply */
 
 /**
  *
- * nfs_dupreq_gc_function: Tests is an entry in dupreq cache is to be set invalid (has expired).
- *
- * Tests is an entry in dupreq cache is to be set invalid (has expired).
+ * nfs_dupreq_gc: evicts the expired replies of the duplicate request cache.
  *
- * @param pentry [IN] pointer to the entry to test
+ * The replies of a client are also evicted each time a reply of the client
+ * is cached: this covers the clients which sent nothing for a while, and
+ * frees the clients left with no reply.
  *
- * @return 1 if entry must be set invalid, 0 if not.
- *
- * @see LRU_invalidate_by_function
- * @see LRU_gc_invalid
+ * @return nothing (void function)
  *
  */
-int nfs_dupreq_gc_function(LRU_entry_t * pentry, void *addparam)
+void nfs_dupreq_gc(void)
 {
-  dupreq_entry_t *pdupreq = NULL;
-
-  pdupreq = (dupreq_entry_t *) (pentry->buffdata.pdata);
+  dupreq_client_shard_t *pcshard;
+  dupreq_client_t **pprev;
+  dupreq_client_t *pclient;
+  struct glist_head victims;
+  time_t now = time(NULL);
+  unsigned int i, j;
+
+  for(i = 0; i < dupreq_param.nb_shards; i++)
+    {
+      pcshard = &dupreq_client_shards[i];
+      init_glist(&victims);
 
-  /* Test if entry is expired */
-  if(time(NULL) - pdupreq->timestamp > nfs_param.core_param.expiration_dupreq)
-    return LRU_LIST_SET_INVALID;
+      P(pcshard->lock);
+      for(j = 0; j < DUPREQ_CLIENT_BUCKETS; j++)
+        {
+          pprev = &pcshard->buckets[j];
+          while((pclient = *pprev) != NULL)
+            {
+              dupreq_evict_client(pcshard, pclient, NULL, now, &victims);
+
+              if(glist_empty(&pclient->replies))
+                {
+                  *pprev = pclient->next;
+                  pcshard->nb_clients -= 1;
+                  Mem_Free(pclient);
+                }
+              else
+                pprev = &pclient->next;
+            }
+        }
+      V(pcshard->lock);
 
-  return LRU_LIST_DO_NOT_SET_INVALID;
-}                               /* nfs_dupreq_fc_function */
+      dupreq_unhash_victims(&victims);
+    }
+}                               /* nfs_dupreq_gc */
 
 /**
  *
- * nfs_dupreq_get_stats: gets the hash table statistics for the duplicate requests.
+ * nfs_dupreq_get_stats: gets the statistics of the duplicate request cache.
  *
- * Gets the hash table statistics for the duplicate requests.
- *
- * @param phstat [OUT] pointer to the resulting stats.
+ * @param pstats [OUT] pointer to the resulting stats.
  *
  * @return nothing (void function)
  *
- * @see HashTable_GetStats
- *
  */
-void nfs_dupreq_get_stats(hash_stat_t * phstat_udp, hash_stat_t * phstat_tcp )
+void nfs_dupreq_get_stats(nfs_dupreq_stat_t * pstats)
 {
-  HashTable_GetStats(ht_dupreq_udp, phstat_udp);
-  HashTable_GetStats(ht_dupreq_tcp, phstat_tcp);
+  unsigned int i;
+
+  memset(pstats, 0, sizeof(*pstats));
+
+  for(i = 0; i < dupreq_param.nb_shards; i++)
+    {
+      P(dupreq_shards[i].lock);
+      pstats->nb_hits += dupreq_shards[i].nb_hits;
+      pstats->nb_in_progress += dupreq_shards[i].nb_in_progress;
+      pstats->nb_misses += dupreq_shards[i].nb_misses;
+      V(dupreq_shards[i].lock);
+
+      P(dupreq_client_shards[i].lock);
+      pstats->nb_entries += dupreq_client_shards[i].nb_entries;
+      pstats->nb_clients += dupreq_client_shards[i].nb_clients;
+      pstats->mem_space += dupreq_client_shards[i].mem_space;
+      pstats->nb_evicted_size += dupreq_client_shards[i].nb_evicted_size;
+      pstats->nb_evicted_age += dupreq_client_shards[i].nb_evicted_age;
+      V(dupreq_client_shards[i].lock);
+    }
 }                               /* nfs_dupreq_get_stats */
@@ -0,0 +1,301 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    rpc_buffers.c
+ * \brief   Pool of registered buffers for the READ replies.
+ *
+ * rpc_buffers.c : The data of the READ replies is read into page aligned
+ * buffers taken from a pool mapped once at startup. These buffers are
+ * "registered": they remain valid until the reply is freed, which is
+ * after it was sent, so the record stream of a TCP connection gives them
+ * to writev as they are instead of copying them into its send buffer.
+ *
+ * A request which does not fit in a buffer, or comes when all of them are
+ * in use, gets a regular allocation, which is copied as before.
+ *
+ * The same buffers receive the large records on TCP connections, so that
+ * the payload of a WRITE is decoded by reference (see xdr_rpc_buffer) and
+ * given as it is to the FSAL.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "rpcal.h"
+#if defined(_USE_TIRPC) && !defined(NO_XDRREC_PATCH)
+#include "TIRPC/tirpc.h"
+#endif
+#include "log.h"
+#include "stuff_alloc.h"
+#include "common_utils.h"
+
+static struct rpc_buffer_pool__
+{
+  pthread_mutex_t mutex;
+  char *base;                   /* nb_buffers contiguous buffers */
+  size_t buffer_size;           /* multiple of the page size */
+  unsigned int nb_buffers;
+  unsigned int *free_stack;     /* indexes of the free buffers */
+  unsigned int nb_free;
+} rpc_buffer_pool =
+{
+  PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, NULL, 0
+};
+
+/**
+ *
+ * rpc_buffer_pool_init: maps the registered buffers.
+ *
+ * The memory is only committed when a buffer is used for the first time.
+ *
+ * @param nb_buffers  [IN] number of buffers, 0 to disable the pool.
+ * @param buffer_size [IN] size of a buffer, rounded up to the page size.
+ *
+ * @return 0 if successful, an errno otherwise.
+ *
+ */
+int rpc_buffer_pool_init(unsigned int nb_buffers, size_t buffer_size)
+{
+  long page_size = sysconf(_SC_PAGESIZE);
+  unsigned int i;
+  void *base;
+
+  if(nb_buffers == 0 || buffer_size == 0)
+    return 0;
+
+  if(page_size <= 0)
+    page_size = 4096;
+
+  buffer_size = (buffer_size + page_size - 1) & ~((size_t) page_size - 1);
+
+  rpc_buffer_pool.free_stack =
+      (unsigned int *)Mem_Alloc_Label(nb_buffers * sizeof(unsigned int),
+                                      "rpc_buffer_pool");
+  if(rpc_buffer_pool.free_stack == NULL)
+    return ENOMEM;
+
+  base = mmap(NULL, nb_buffers * buffer_size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(base == MAP_FAILED)
+    {
+      Mem_Free(rpc_buffer_pool.free_stack);
+      rpc_buffer_pool.free_stack = NULL;
+      return errno;
+    }
+
+  for(i = 0; i < nb_buffers; i++)
+    rpc_buffer_pool.free_stack[i] = nb_buffers - 1 - i;
+
+  rpc_buffer_pool.buffer_size = buffer_size;
+  rpc_buffer_pool.nb_buffers = nb_buffers;
+  rpc_buffer_pool.nb_free = nb_buffers;
+  rpc_buffer_pool.base = (char *)base;
+
+  LogInfo(COMPONENT_RPC, "%u registered RPC buffers of %llu bytes mapped",
+          nb_buffers, (unsigned long long)buffer_size);
+
+  return 0;
+}                               /* rpc_buffer_pool_init */
+
+/**
+ *
+ * rpc_buffer_get_registered: gets a registered buffer, if one is free.
+ *
+ * @param size      [IN]  size needed.
+ * @param pcapacity [OUT] size of the buffer, at least size.
+ *
+ * @return the buffer, NULL if the size is too large or no buffer is free.
+ *
+ */
+caddr_t rpc_buffer_get_registered(size_t size, size_t * pcapacity)
+{
+  caddr_t buffer = NULL;
+
+  if(size > rpc_buffer_pool.buffer_size)
+    return NULL;
+
+  P(rpc_buffer_pool.mutex);
+  if(rpc_buffer_pool.nb_free > 0)
+    {
+      rpc_buffer_pool.nb_free -= 1;
+      buffer = rpc_buffer_pool.base +
+          rpc_buffer_pool.free_stack[rpc_buffer_pool.nb_free] *
+          rpc_buffer_pool.buffer_size;
+    }
+  V(rpc_buffer_pool.mutex);
+
+  if(pcapacity != NULL)
+    *pcapacity = rpc_buffer_pool.buffer_size;
+
+  return buffer;
+}                               /* rpc_buffer_get_registered */
+
+/**
+ *
+ * rpc_buffer_get: gets a buffer to read data to be sent in a reply.
+ *
+ * @param size [IN] size needed.
+ *
+ * @return the buffer, NULL if no memory was available.
+ *
+ */
+caddr_t rpc_buffer_get(size_t size)
+{
+  caddr_t buffer;
+
+  if((buffer = rpc_buffer_get_registered(size, NULL)) == NULL)
+    buffer = (caddr_t) Mem_Alloc(size);
+
+  return buffer;
+}                               /* rpc_buffer_get */
+
+/**
+ *
+ * rpc_buffer_release: gives back a buffer got with rpc_buffer_get.
+ *
+ * It may be called from another thread than the one which got the buffer.
+ *
+ * @param buffer [IN] the buffer, or any address in a registered buffer; may be NULL.
+ *
+ * @return nothing (void function)
+ *
+ */
+void rpc_buffer_release(caddr_t buffer)
+{
+  if(buffer == NULL)
+    return;
+
+  if(!rpc_buffer_is_registered(buffer, 0))
+    {
+      Mem_Free(buffer);
+      return;
+    }
+
+  P(rpc_buffer_pool.mutex);
+  rpc_buffer_pool.free_stack[rpc_buffer_pool.nb_free] =
+      (buffer - rpc_buffer_pool.base) / rpc_buffer_pool.buffer_size;
+  rpc_buffer_pool.nb_free += 1;
+  V(rpc_buffer_pool.mutex);
+}                               /* rpc_buffer_release */
+
+/**
+ *
+ * rpc_buffer_is_registered: tells if some memory lies in a registered buffer.
+ *
+ * @param addr [IN] start of the memory.
+ * @param len  [IN] its length.
+ *
+ * @return TRUE if it does, FALSE otherwise.
+ *
+ */
+bool_t rpc_buffer_is_registered(const char *addr, size_t len)
+{
+  char *end = rpc_buffer_pool.base +
+      rpc_buffer_pool.nb_buffers * rpc_buffer_pool.buffer_size;
+
+  return (rpc_buffer_pool.base != NULL &&
+          addr >= rpc_buffer_pool.base && addr < end && addr + len <= end);
+}                               /* rpc_buffer_is_registered */
+
+/**
+ *
+ * xdr_rpc_buffer: XDR routine for a counted byte string, like xdr_bytes.
+ *
+ * When the string is decoded from a record received into a registered
+ * buffer, it is not copied: it points into that buffer, which the string
+ * keeps until it is freed with XDR_FREE.
+ *
+ * @param xdrs    [INOUT] the XDR stream
+ * @param cpp     [INOUT] the string
+ * @param sizep   [INOUT] its length
+ * @param maxsize [IN]    maximum length accepted
+ *
+ * @return TRUE if successful, FALSE otherwise.
+ *
+ */
+bool_t xdr_rpc_buffer(XDR * xdrs, char **cpp, u_int * sizep, u_int maxsize)
+{
+  char *sp = *cpp;
+  u_int nodesize;
+
+  if(!xdr_u_int(xdrs, sizep))
+    return FALSE;
+
+  nodesize = *sizep;
+  if(nodesize > maxsize && xdrs->x_op != XDR_FREE)
+    return FALSE;
+
+  switch (xdrs->x_op)
+    {
+    case XDR_DECODE:
+      if(nodesize == 0)
+        return TRUE;
+
+#if defined(_USE_TIRPC) && !defined(NO_XDRREC_PATCH)
+      if(sp == NULL && (*cpp = Xdrrec_lend(xdrs, nodesize)) != NULL)
+        return TRUE;
+#endif
+
+      if(sp == NULL)
+        *cpp = sp = (char *)malloc(nodesize);
+      if(sp == NULL)
+        {
+          LogCrit(COMPONENT_RPC, "xdr_rpc_buffer: out of memory");
+          return FALSE;
+        }
+      /* fall into ... */
+
+    case XDR_ENCODE:
+      return xdr_opaque(xdrs, sp, nodesize);
+
+    case XDR_FREE:
+      if(sp != NULL)
+        {
+          /* Allocated like xdr_bytes does, or lent by the record stream */
+          if(rpc_buffer_is_registered(sp, 0))
+            rpc_buffer_release(sp);
+          else
+            free(sp);
+          *cpp = NULL;
+        }
+      return TRUE;
+    }
+
+  return FALSE;
+}                               /* xdr_rpc_buffer */
@@ -50,9 +50,15 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <errno.h>
 #include <pthread.h>
 #include <fcntl.h>
 #include <sys/file.h>           /* for having FNDELAY */
+#include <sys/select.h>
+#include <sys/poll.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #include <pwd.h>
 #include <grp.h>
 
@@ -76,6 +82,14 @@ pthread_cond_t *condvar_xprt;
 SVCXPRT **Xports;
 fd_set Svc_fdset;
 
+/* Number of event shards, there is one RPC dispatcher thread per shard */
+unsigned int Svc_nb_event_shard = 1;
+
+#ifdef HAVE_SYS_EPOLL_H
+/* One epoll instance per shard, a socket always belongs to shard (fd % Svc_nb_event_shard) */
+static int *Svc_epoll_fd = NULL;
+#endif
+
 const char *str_sock_type(int st)
 {
   static char buf[16];
@@ -484,7 +498,7 @@ void Clnt_destroy(CLIENT *clnt)
   pthread_mutex_unlock(&clnt_create_mutex);
 }
 
-void InitRPC(int num_sock)
+void InitRPC(int num_sock, unsigned int nb_event_shard)
 {
   /* Allocate resources that are based on the maximum number of open file descriptors */
   Xports = (SVCXPRT **) Mem_Alloc_Label(num_sock * sizeof(SVCXPRT *), "Xports array");
@@ -504,4 +518,191 @@ void InitRPC(int num_sock)
   /* RW_lock need to be initialized */
   rw_lock_init(&Svc_fd_lock);
 #endif
+
+  if(Svc_event_init(nb_event_shard) != 0)
+    LogFatal(COMPONENT_RPC,
+             "Could not initialize the RPC event engine");
 }
+
+/**
+ *
+ * Svc_event_init: creates the event engine used by the RPC dispatcher threads.
+ *
+ * With epoll, one epoll instance is created per shard and every registered
+ * socket is watched by exactly one of them. Without epoll, the engine falls
+ * back on select() over Svc_fdset and only one shard is available.
+ *
+ * @param nb_shard [IN] number of shards (one per dispatcher thread).
+ *
+ * @return 0 if ok, -1 otherwise.
+ *
+ */
+int Svc_event_init(unsigned int nb_shard)
+{
+  if(nb_shard == 0)
+    nb_shard = 1;
+
+#ifdef HAVE_SYS_EPOLL_H
+  unsigned int i;
+
+  Svc_epoll_fd = (int *)Mem_Alloc_Label(nb_shard * sizeof(int), "Svc_epoll_fd array");
+  if(Svc_epoll_fd == NULL)
+    return -1;
+
+  for(i = 0; i < nb_shard; i++)
+    {
+      if((Svc_epoll_fd[i] = epoll_create(FD_SETSIZE)) < 0)
+        {
+          LogCrit(COMPONENT_RPC,
+                  "epoll_create failed for shard %u, errno=%u (%s)",
+                  i, errno, strerror(errno));
+          return -1;
+        }
+      fcntl(Svc_epoll_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+#else
+  if(nb_shard > 1)
+    {
+      LogEvent(COMPONENT_RPC,
+               "No epoll support, only one RPC dispatcher shard will be used instead of %u",
+               nb_shard);
+      nb_shard = 1;
+    }
+#endif
+
+  Svc_nb_event_shard = nb_shard;
+
+  return 0;
+}                               /* Svc_event_init */
+
+/**
+ *
+ * Svc_event_watch: starts watching a socket for incoming data.
+ *
+ * Sockets are watched in edge-triggered mode: the dispatcher is notified once
+ * when data arrives and must drain the socket (see Svc_event_pending).
+ * Without epoll, this is a no-op since Xprt_register already updated Svc_fdset.
+ *
+ * @param fd [IN] the socket to be watched.
+ *
+ * @return 0 if ok, -1 otherwise.
+ *
+ */
+int Svc_event_watch(int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = fd;
+
+  if(epoll_ctl(Svc_epoll_fd[fd % Svc_nb_event_shard], EPOLL_CTL_ADD, fd, &ev) != 0 &&
+     errno != EEXIST)
+    {
+      LogCrit(COMPONENT_RPC,
+              "epoll_ctl(ADD) failed for fd=%d, errno=%u (%s)",
+              fd, errno, strerror(errno));
+      return -1;
+    }
+#endif
+  return 0;
+}                               /* Svc_event_watch */
+
+/**
+ *
+ * Svc_event_unwatch: stops watching a socket.
+ *
+ * Must be called before the socket is closed.
+ *
+ * @param fd [IN] the socket to be forgotten.
+ *
+ */
+void Svc_event_unwatch(int fd)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event ev;
+
+  /* ev is ignored but must be non NULL on old kernels */
+  if(epoll_ctl(Svc_epoll_fd[fd % Svc_nb_event_shard], EPOLL_CTL_DEL, fd, &ev) != 0 &&
+     errno != ENOENT && errno != EBADF)
+    LogCrit(COMPONENT_RPC,
+            "epoll_ctl(DEL) failed for fd=%d, errno=%u (%s)",
+            fd, errno, strerror(errno));
+#endif
+}                               /* Svc_event_unwatch */
+
+/**
+ *
+ * Svc_event_wait: waits for incoming data on the sockets of a shard.
+ *
+ * @param shard   [IN]  the shard to wait on.
+ * @param fds     [OUT] array filled with the sockets that became readable.
+ * @param maxfds  [IN]  size of fds, must be > 0 and <= SVC_EVENT_BATCH.
+ * @param timeout [IN]  timeout in milliseconds, -1 to wait forever.
+ *
+ * @return the number of sockets in fds, -1 if failed (errno is set).
+ *
+ */
+int Svc_event_wait(unsigned int shard, int *fds, int maxfds, int timeout)
+{
+#ifdef HAVE_SYS_EPOLL_H
+  struct epoll_event events[SVC_EVENT_BATCH];
+  int i, rc;
+
+  if(maxfds > SVC_EVENT_BATCH)
+    maxfds = SVC_EVENT_BATCH;
+
+  rc = epoll_wait(Svc_epoll_fd[shard], events, maxfds, timeout);
+
+  for(i = 0; i < rc; i++)
+    fds[i] = events[i].data.fd;
+
+  return rc;
+#else
+  fd_set readfdset;
+  struct timeval tv;
+  int rc, fd, nb = 0;
+
+  /* Always work on a copy of Svc_fdset */
+  readfdset = Svc_fdset;
+
+  tv.tv_sec = timeout / 1000;
+  tv.tv_usec = (timeout % 1000) * 1000;
+
+  rc = select(FD_SETSIZE, &readfdset, NULL, NULL, (timeout < 0) ? NULL : &tv);
+  if(rc <= 0)
+    return rc;
+
+  for(fd = 0; fd < FD_SETSIZE && nb < maxfds; fd++)
+    if(FD_ISSET(fd, &readfdset))
+      fds[nb++] = fd;
+
+  return nb;
+#endif
+}                               /* Svc_event_wait */
+
+/**
+ *
+ * Svc_event_pending: tells if a socket still has data to be read.
+ *
+ * Used by the dispatcher to drain edge-triggered sockets without making them non blocking.
+ *
+ * @param fd [IN] the socket to be tested.
+ *
+ * @return TRUE if a read on fd would not block, FALSE otherwise.
+ *
+ */
+bool_t Svc_event_pending(int fd)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  if(poll(&pfd, 1, 0) <= 0)
+    return FALSE;
+
+  return (pfd.revents & (POLLIN | POLLHUP | POLLERR)) ? TRUE : FALSE;
+}                               /* Svc_event_pending */
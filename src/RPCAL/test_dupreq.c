@@ -0,0 +1,356 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Checks the duplicate request cache: retransmissions of requests being
+ * processed, replay of the encoded replies, bounds of the replies kept for
+ * a client, then measures the cost of a request when threads of several
+ * clients go through the cache at once.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+#include "nfs_dupreq.h"
+
+/* These parameters are used throughout Ganesha code and must be initilized. */
+nfs_parameter_t nfs_param;
+
+#define REPLY_WORDS   20
+#define NB_REQUESTS   100
+#define KEPT_REPLIES  10
+#define NB_THREADS    8
+#define NB_BENCH_REQ  200000
+
+typedef struct test_client__
+{
+  SVCXPRT xprt;
+  struct sockaddr_in addr;
+} test_client_t;
+
+static void init_client(test_client_t * pclient, const char *ip, int port)
+{
+  memset(pclient, 0, sizeof(*pclient));
+  pclient->addr.sin_family = AF_INET;
+  pclient->addr.sin_port = htons(port);
+  inet_aton(ip, &pclient->addr.sin_addr);
+
+  /* A UDP transport */
+  pclient->xprt.xp_p2 = pclient;
+#ifdef _USE_TIRPC
+  pclient->xprt.xp_rtaddr.buf = &pclient->addr;
+  pclient->xprt.xp_rtaddr.len = sizeof(pclient->addr);
+#else
+  memcpy(&pclient->xprt.xp_raddr, &pclient->addr, sizeof(pclient->addr));
+#endif
+}
+
+/* The reply of a request: REPLY_WORDS words holding its xid */
+static bool_t xdr_test_res(XDR * xdrs, nfs_res_t * pres)
+{
+  u_int word = *(u_int *) pres;
+  int i;
+
+  for(i = 0; i < REPLY_WORDS; i++)
+    if(!xdr_u_int(xdrs, &word))
+      return FALSE;
+
+  return TRUE;
+}
+
+static int add(test_client_t * pclient, long xid, int cacheable, dupreq_entry_t ** ppdupreq)
+{
+  struct svc_req req;
+
+  memset(&req, 0, sizeof(req));
+  req.rq_prog = 100003;
+  req.rq_vers = 3;
+  req.rq_proc = 7;
+
+  return nfs_dupreq_add_not_finished(xid, &req, &pclient->xprt, cacheable, ppdupreq);
+}
+
+/* Processes a new request, and caches its reply */
+static void process(test_client_t * pclient, long xid)
+{
+  dupreq_entry_t *pdupreq;
+  nfs_res_t res;
+
+  if(add(pclient, xid, TRUE, &pdupreq) != DUPREQ_SUCCESS || pdupreq == NULL)
+    {
+      LogTest("Test FAILED: request xid=%ld is not new", xid);
+      exit(1);
+    }
+
+  memset(&res, 0, sizeof(res));
+  *(u_int *) & res = xid;
+  if(nfs_dupreq_finish(&pdupreq, (xdrproc_t) xdr_test_res, &res) != DUPREQ_SUCCESS)
+    {
+      LogTest("Test FAILED: could not cache the reply of xid=%ld", xid);
+      exit(1);
+    }
+  nfs_dupreq_rele(pdupreq);
+}
+
+/* Checks that the reply of a request is replayed as it was encoded */
+static int replayed(test_client_t * pclient, long xid)
+{
+  dupreq_entry_t *pdupreq;
+  u_int words[REPLY_WORDS + 1];
+  XDR xdrs;
+  int i, status;
+
+  status = add(pclient, xid, TRUE, &pdupreq);
+  if(status == DUPREQ_SUCCESS)
+    {
+      nfs_dupreq_delete(pdupreq);
+      return FALSE;
+    }
+  if(status != DUPREQ_ALREADY_EXISTS)
+    {
+      LogTest("Test FAILED: unexpected status %d for xid=%ld", status, xid);
+      exit(1);
+    }
+
+  xdrmem_create(&xdrs, (char *)words, sizeof(words), XDR_ENCODE);
+  if(!nfs_dupreq_xdr_reply(&xdrs, pdupreq) ||
+     xdr_getpos(&xdrs) != REPLY_WORDS * sizeof(u_int))
+    {
+      LogTest("Test FAILED: bad replay of xid=%ld", xid);
+      exit(1);
+    }
+  xdr_destroy(&xdrs);
+  nfs_dupreq_rele(pdupreq);
+
+  for(i = 0; i < REPLY_WORDS; i++)
+    if(ntohl(words[i]) != (u_int) xid)
+      {
+        LogTest("Test FAILED: replay of xid=%ld is not its reply", xid);
+        exit(1);
+      }
+
+  return TRUE;
+}
+
+static void init_cache(int non_idempotent_only)
+{
+  nfs_rpc_dupreq_parameter_t param;
+
+  param.nb_shards = 3;
+  param.nb_buckets = 7;
+  param.max_client_bytes = KEPT_REPLIES * (sizeof(dupreq_entry_t) + REPLY_WORDS * sizeof(u_int));
+  param.non_idempotent_only = non_idempotent_only;
+
+  if(nfs_Init_dupreq(param) != DUPREQ_SUCCESS)
+    {
+      LogTest("Test FAILED: could not init the duplicate request cache");
+      exit(1);
+    }
+}
+
+static void check_requests(void)
+{
+  test_client_t client, other_port, other_client;
+  dupreq_entry_t *pdupreq, *pnew;
+  nfs_dupreq_stat_t stats;
+  long xid;
+
+  init_client(&client, "10.0.0.1", 800);
+  init_client(&other_port, "10.0.0.1", 801);
+  init_client(&other_client, "10.0.0.2", 800);
+
+  /* A retransmission while the request is processed is dropped */
+  if(add(&client, 1, TRUE, &pdupreq) != DUPREQ_SUCCESS ||
+     add(&client, 1, TRUE, &pnew) != DUPREQ_BEING_PROCESSED || pnew != NULL)
+    {
+      LogTest("Test FAILED: retransmission of a request being processed not detected");
+      exit(1);
+    }
+
+  /* The same xid from another port is another request */
+  if(add(&other_port, 1, TRUE, &pnew) != DUPREQ_SUCCESS)
+    {
+      LogTest("Test FAILED: requests of two ports mixed up");
+      exit(1);
+    }
+  nfs_dupreq_delete(pnew);
+  nfs_dupreq_delete(pdupreq);
+
+  /* The reply of a request not cached is not kept */
+  if(add(&client, 2, FALSE, &pdupreq) != DUPREQ_SUCCESS || pdupreq == NULL ||
+     nfs_dupreq_delete(pdupreq) != DUPREQ_SUCCESS || replayed(&client, 2))
+    {
+      LogTest("Test FAILED: request not cached kept in the cache");
+      exit(1);
+    }
+
+  process(&client, 3);
+  if(!replayed(&client, 3) || !replayed(&client, 3))
+    {
+      LogTest("Test FAILED: reply not replayed");
+      exit(1);
+    }
+  LogTest("Retransmissions detected and replies replayed OK");
+
+  /* The replies of the client take at most KEPT_REPLIES entries, whatever the port */
+  process(&other_client, 1);
+  for(xid = 10; xid < 10 + NB_REQUESTS; xid++)
+    process((xid % 2) ? &client : &other_port, xid);
+
+  nfs_dupreq_get_stats(&stats);
+  if(stats.nb_entries != KEPT_REPLIES + 1 || stats.nb_clients != 2 ||
+     stats.nb_evicted_size != NB_REQUESTS + 1 - KEPT_REPLIES)
+    {
+      LogTest("Test FAILED: %u replies of %u clients kept, %llu evicted",
+              stats.nb_entries, stats.nb_clients,
+              (unsigned long long)stats.nb_evicted_size);
+      exit(1);
+    }
+  if(replayed(&client, 3) || replayed(&client, 11) ||
+     !replayed((xid - 1) % 2 ? &client : &other_port, xid - 1) ||
+     !replayed(&other_client, 1))
+    {
+      LogTest("Test FAILED: wrong replies evicted");
+      exit(1);
+    }
+  LogTest("Replies of a client bounded to %u entries OK", KEPT_REPLIES);
+
+  /* Everything expires */
+  nfs_param.core_param.expiration_dupreq = 1;
+  sleep(2);
+  nfs_dupreq_gc();
+
+  nfs_dupreq_get_stats(&stats);
+  if(stats.nb_entries != 0 || stats.nb_clients != 0 || stats.mem_space != 0 ||
+     stats.nb_evicted_age != KEPT_REPLIES + 1 || replayed(&other_client, 1))
+    {
+      LogTest("Test FAILED: %u expired replies of %u clients kept",
+              stats.nb_entries, stats.nb_clients);
+      exit(1);
+    }
+  nfs_param.core_param.expiration_dupreq = DUPREQ_EXPIRATION;
+  LogTest("Expired replies evicted OK: %llu hits, %llu in progress, %llu misses",
+          (unsigned long long)stats.nb_hits, (unsigned long long)stats.nb_in_progress,
+          (unsigned long long)stats.nb_misses);
+}
+
+static void check_non_idempotent_only(void)
+{
+  test_client_t client;
+  dupreq_entry_t *pdupreq;
+
+  init_cache(TRUE);
+  init_client(&client, "10.0.0.1", 800);
+
+  if(add(&client, 1, FALSE, &pdupreq) != DUPREQ_SUCCESS || pdupreq != NULL ||
+     add(&client, 1, FALSE, &pdupreq) != DUPREQ_SUCCESS || pdupreq != NULL)
+    {
+      LogTest("Test FAILED: request not cached tracked");
+      exit(1);
+    }
+
+  process(&client, 2);
+  if(!replayed(&client, 2))
+    {
+      LogTest("Test FAILED: reply not replayed");
+      exit(1);
+    }
+
+  LogTest("Only the requests whose reply is cached are tracked OK");
+}
+
+static void *bench_thread(void *arg)
+{
+  test_client_t client;
+  char ip[32];
+  long xid;
+
+  sprintf(ip, "10.0.1.%ld", (long)arg);
+  init_client(&client, ip, 800);
+
+  for(xid = 0; xid < NB_BENCH_REQ; xid++)
+    {
+      process(&client, xid);
+      if(xid % 16 == 0)
+        replayed(&client, xid);
+    }
+
+  return NULL;
+}
+
+static void bench(void)
+{
+  pthread_t threads[NB_THREADS];
+  struct timeval start, end;
+  unsigned long long us;
+  long i;
+
+  init_cache(FALSE);
+
+  gettimeofday(&start, NULL);
+  for(i = 0; i < NB_THREADS; i++)
+    pthread_create(&threads[i], NULL, bench_thread, (void *)i);
+  for(i = 0; i < NB_THREADS; i++)
+    pthread_join(threads[i], NULL);
+  gettimeofday(&end, NULL);
+
+  us = (end.tv_sec - start.tv_sec) * 1000000ULL + end.tv_usec - start.tv_usec;
+
+  LogTest("%d threads of different clients: %llu ns per request", NB_THREADS,
+          us * 1000 / (NB_THREADS * NB_BENCH_REQ));
+}
+
+int main(int argc, char *argv[])
+{
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_dupreq");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Memory manager could not be initialized");
+      exit(1);
+    }
+#endif
+
+  nfs_param.core_param.expiration_dupreq = DUPREQ_EXPIRATION;
+
+  init_cache(FALSE);
+  check_requests();
+  check_non_idempotent_only();
+
+#ifdef _NO_BUDDY_SYSTEM
+  /* Each thread of the buddy system would need its own init */
+  bench();
+#endif
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -0,0 +1,334 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Checks the pool of registered buffers, that the record stream sends
+ * them without copy and gives back the same records as with copy, and
+ * that it receives large records in them to lend their data.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "rpcal.h"
+#if defined(_USE_TIRPC) && !defined(NO_XDRREC_PATCH)
+#include "TIRPC/tirpc.h"
+#endif
+
+#define NB_BUFFERS 4
+#define BUFFER_SIZE 100000      /* rounded up to the page size */
+#define DATA_SIZE 70000         /* more than the send buffer */
+#define SEND_SIZE 32768
+
+#if defined(_USE_TIRPC) && !defined(NO_XDRREC_PATCH)
+
+static int nb_writev;
+
+static int test_read(void *handle, void *buf, int len)
+{
+  return read(*(int *)handle, buf, len);
+}
+
+static int test_write(void *handle, void *buf, int len)
+{
+  return write(*(int *)handle, buf, len);
+}
+
+static int test_writev(void *handle, struct iovec *iov, int iovcnt)
+{
+  nb_writev++;
+  return writev(*(int *)handle, iov, iovcnt);
+}
+
+/* Encodes a READ like reply: a word, the data, then a word */
+static void encode_reply(XDR * xdrs, char *data, u_int len)
+{
+  u_int before = 0xCAFE, after = 0xDECA;
+
+  xdrs->x_op = XDR_ENCODE;
+  if(!xdr_u_int(xdrs, &before) ||
+     !xdr_bytes(xdrs, &data, &len, ~0) ||
+     !xdr_u_int(xdrs, &after) || !Xdrrec_endofrecord(xdrs, TRUE))
+    {
+      LogTest("Test FAILED: could not encode a reply of %u bytes", len);
+      exit(1);
+    }
+}
+
+static void decode_reply(XDR * xdrs, char *expected, u_int len)
+{
+  u_int before = 0, after = 0, got_len = 0;
+  char *got = NULL;
+
+  xdrs->x_op = XDR_DECODE;
+  if(!Xdrrec_skiprecord(xdrs) ||
+     !xdr_u_int(xdrs, &before) ||
+     !xdr_bytes(xdrs, &got, &got_len, ~0) || !xdr_u_int(xdrs, &after))
+    {
+      LogTest("Test FAILED: could not decode a reply of %u bytes", len);
+      exit(1);
+    }
+
+  if(before != 0xCAFE || after != 0xDECA || got_len != len || memcmp(got, expected, len))
+    {
+      LogTest("Test FAILED: reply of %u bytes decoded wrong", len);
+      exit(1);
+    }
+
+  xdrs->x_op = XDR_FREE;
+  xdr_bytes(xdrs, &got, &got_len, ~0);
+}
+
+static void check_stream(char *registered)
+{
+  char path[] = "/tmp/test_rpc_buffers.XXXXXX";
+  char *copied;
+  XDR xdrs;
+  int fd, i;
+
+  if((fd = mkstemp(path)) == -1)
+    {
+      LogTest("Test FAILED: could not create %s", path);
+      exit(1);
+    }
+  unlink(path);
+
+  copied = (char *)Mem_Alloc(DATA_SIZE);
+  for(i = 0; i < DATA_SIZE; i++)
+    registered[i] = copied[i] = (char)(i * 7);
+
+  Xdrrec_create(&xdrs, SEND_SIZE, SEND_SIZE, &fd, test_read, test_write);
+  Xdrrec_set_writev(&xdrs, test_writev);
+
+  /* Odd sizes check the padding after the segment */
+  encode_reply(&xdrs, registered, DATA_SIZE);
+  encode_reply(&xdrs, copied, DATA_SIZE);
+  encode_reply(&xdrs, registered, DATA_SIZE - 3);
+  encode_reply(&xdrs, registered, 100);
+
+  if(nb_writev != 2)
+    {
+      LogTest("Test FAILED: %d records sent with writev, 2 expected", nb_writev);
+      exit(1);
+    }
+
+  lseek(fd, 0, SEEK_SET);
+
+  decode_reply(&xdrs, copied, DATA_SIZE);
+  decode_reply(&xdrs, copied, DATA_SIZE);
+  decode_reply(&xdrs, copied, DATA_SIZE - 3);
+  decode_reply(&xdrs, copied, 100);
+
+  XDR_DESTROY(&xdrs);
+  Mem_Free(copied);
+  close(fd);
+
+  LogTest("Record stream OK: registered buffers sent with writev");
+}
+
+/* Decodes a WRITE like request from a non blocking stream */
+static char *decode_request(XDR * xdrs, char *expected, u_int len)
+{
+  enum xprt_stat xstat;
+  u_int before = 0, after = 0, got_len = 0;
+  char *got = NULL;
+
+  xdrs->x_op = XDR_DECODE;
+  while(!__Xdrrec_getrec(xdrs, &xstat, TRUE))
+    if(xstat != XPRT_MOREREQS)
+      {
+        LogTest("Test FAILED: could not receive a request of %u bytes", len);
+        exit(1);
+      }
+
+  if(!xdr_u_int(xdrs, &before) ||
+     !xdr_rpc_buffer(xdrs, &got, &got_len, ~0) || !xdr_u_int(xdrs, &after))
+    {
+      LogTest("Test FAILED: could not decode a request of %u bytes", len);
+      exit(1);
+    }
+
+  if(before != 0xCAFE || after != 0xDECA || got_len != len || memcmp(got, expected, len))
+    {
+      LogTest("Test FAILED: request of %u bytes decoded wrong", len);
+      exit(1);
+    }
+
+  return got;
+}
+
+static void free_request(char *got, u_int len)
+{
+  XDR xdrs;
+
+  xdrs.x_op = XDR_FREE;
+  xdr_rpc_buffer(&xdrs, &got, &len, ~0);
+}
+
+static void check_lend(void)
+{
+  char path[] = "/tmp/test_rpc_buffers.XXXXXX";
+  caddr_t buffers[NB_BUFFERS];
+  char *data, *got[4];
+  XDR xdrs;
+  int fd, i;
+
+  if((fd = mkstemp(path)) == -1)
+    {
+      LogTest("Test FAILED: could not create %s", path);
+      exit(1);
+    }
+  unlink(path);
+
+  data = (char *)Mem_Alloc(DATA_SIZE);
+  for(i = 0; i < DATA_SIZE; i++)
+    data[i] = (char)(i * 13);
+
+  Xdrrec_create(&xdrs, SEND_SIZE, SEND_SIZE, &fd, test_read, test_write);
+
+  encode_reply(&xdrs, data, DATA_SIZE);
+  encode_reply(&xdrs, data, DATA_SIZE - 1);
+  encode_reply(&xdrs, data, 100);
+  encode_reply(&xdrs, data, DATA_SIZE);
+
+  lseek(fd, 0, SEEK_SET);
+  __Xdrrec_setnonblock(&xdrs, 2 * BUFFER_SIZE);
+
+  got[0] = decode_request(&xdrs, data, DATA_SIZE);
+  got[1] = decode_request(&xdrs, data, DATA_SIZE - 1);
+  got[2] = decode_request(&xdrs, data, 100);
+
+  if(!rpc_buffer_is_registered(got[0], DATA_SIZE) ||
+     !rpc_buffer_is_registered(got[1], DATA_SIZE - 1) ||
+     rpc_buffer_is_registered(got[2], 100))
+    {
+      LogTest("Test FAILED: data not lent by the record stream");
+      exit(1);
+    }
+
+  /* The stream keeps no buffer: only the requests hold them */
+  for(i = 0; i < 3; i++)
+    free_request(got[i], 0);
+
+  got[3] = decode_request(&xdrs, data, DATA_SIZE);
+  free_request(got[3], 0);
+
+  XDR_DESTROY(&xdrs);
+
+  /* All of the buffers are back */
+  for(i = 0; i < NB_BUFFERS; i++)
+    buffers[i] = rpc_buffer_get(1);
+  for(i = 0; i < NB_BUFFERS; i++)
+    if(!rpc_buffer_is_registered(buffers[i], 1))
+      {
+        LogTest("Test FAILED: buffer %d not given back after the requests", i);
+        exit(1);
+      }
+  for(i = 0; i < NB_BUFFERS; i++)
+    rpc_buffer_release(buffers[i]);
+
+  Mem_Free(data);
+  close(fd);
+
+  LogTest("Record stream OK: large requests decoded without copy");
+}
+
+#endif
+
+int main(int argc, char *argv[])
+{
+  caddr_t buffers[NB_BUFFERS + 1];
+  caddr_t big;
+  int i;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_rpc_buffers");
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  if(rpc_buffer_pool_init(NB_BUFFERS, BUFFER_SIZE) != 0)
+    {
+      LogTest("Test FAILED: could not map the buffers");
+      exit(1);
+    }
+
+  for(i = 0; i < NB_BUFFERS + 1; i++)
+    buffers[i] = rpc_buffer_get(BUFFER_SIZE);
+
+  for(i = 0; i < NB_BUFFERS; i++)
+    if(!rpc_buffer_is_registered(buffers[i], BUFFER_SIZE) ||
+       ((unsigned long)buffers[i] % sysconf(_SC_PAGESIZE)) != 0)
+      {
+        LogTest("Test FAILED: buffer %d is not a page aligned registered buffer", i);
+        exit(1);
+      }
+
+  /* The pool is empty, this one is allocated */
+  big = rpc_buffer_get(2 * BUFFER_SIZE);
+  if(buffers[NB_BUFFERS] == NULL || big == NULL ||
+     rpc_buffer_is_registered(buffers[NB_BUFFERS], 1) || rpc_buffer_is_registered(big, 1))
+    {
+      LogTest("Test FAILED: buffers out of the pool are wrong");
+      exit(1);
+    }
+
+  for(i = 0; i < NB_BUFFERS + 1; i++)
+    rpc_buffer_release(buffers[i]);
+  rpc_buffer_release(big);
+
+  /* All of them are back */
+  for(i = 0; i < NB_BUFFERS; i++)
+    buffers[i] = rpc_buffer_get(100);
+  for(i = 0; i < NB_BUFFERS; i++)
+    if(!rpc_buffer_is_registered(buffers[i], 100))
+      {
+        LogTest("Test FAILED: buffer %d was not given back to the pool", i);
+        exit(1);
+      }
+
+  LogTest("Pool of %d registered buffers OK", NB_BUFFERS);
+
+#if defined(_USE_TIRPC) && !defined(NO_XDRREC_PATCH)
+  check_stream(buffers[0]);
+#endif
+
+  for(i = 0; i < NB_BUFFERS; i++)
+    rpc_buffer_release(buffers[i]);
+
+#if defined(_USE_TIRPC) && !defined(NO_XDRREC_PATCH)
+  check_lend();
+#endif
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -30,6 +30,19 @@
  *
  * RW_Lock.c : this file contains the functions for the RW lock management.
  *
+ * Readers only touch the reader counter of their stripe and read the
+ * writer count: taking and releasing an uncontended read lock costs two
+ * atomic operations on a cache line shared with few other threads, and no
+ * mutex. Writers take the mutex, announce themselves in nbw, then wait for
+ * the sum of the reader counters to drop to zero. Readers arriving while a
+ * writer is active or waiting back off and sleep on condRead, so writers
+ * are preferred, as they were with the former implementation.
+ *
+ * A reader decrements its counter, then reads nbw, and a writer increments
+ * nbw, then reads the counters, both with full barriers: either the writer
+ * sees the reader gone, or the reader sees the writer and wakes it up under
+ * the mutex.
+ *
  */
 
 #ifdef HAVE_CONFIG_H
@@ -40,22 +53,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <execinfo.h>
 #include "RW_Lock.h"
-#include <execinfo.h>
 #include <malloc.h>
 #include <assert.h>
 
+/* Stripe of the reader counters used by the current thread */
+static __thread int rw_lock_stripe = -1;
+static uint32_t rw_lock_next_stripe = 0;
+
+static inline uint32_t *reader_counter(rw_lock_t * plock)
+{
+  if(rw_lock_stripe < 0)
+    rw_lock_stripe = atomic_inc_uint32_t(&rw_lock_next_stripe) % RW_LOCK_STRIPES;
+
+  return &plock->readers[rw_lock_stripe].nbr_active;
+}                               /* reader_counter */
+
+/* The counters wrap when a thread releases a lock taken by another one, their sum does not */
+static inline uint32_t readers_active(rw_lock_t * plock)
+{
+  uint32_t nbr_active = 0;
+  int i;
+
+  for(i = 0; i < RW_LOCK_STRIPES; i++)
+    nbr_active += atomic_fetch_uint32_t(&plock->readers[i].nbr_active);
+
+  return nbr_active;
+}                               /* readers_active */
+
 /*
  * Debugging function
  */
 static inline void print_lock(char *s, rw_lock_t * plock)
 {
-  
   LogFullDebug(COMPONENT_RW_LOCK,
-               "%s: id = %u:  Lock:%p State: nbr_active = %d, nbr_waiting = %d, nbw_active = %d, nbw_waiting = %d",
-               s, (unsigned int)pthread_self(), plock, plock->nbr_active, plock->nbr_waiting,
-               plock->nbw_active, plock->nbw_waiting);
+               "%s: id = %u:  Lock:%p State: nbr_active = %u, nbr_waiting = %u, nbw_active = %u, nbw_waiting = %u",
+               s, (unsigned int)pthread_self(), plock, readers_active(plock),
+               plock->nbr_waiting, plock->nbw_active,
+               atomic_fetch_uint32_t(&plock->nbw) - plock->nbw_active);
 }                               /* print_lock */
 
 #define DEBUG_STACK_SIZE 1000
@@ -81,37 +118,50 @@ void dbg_backtrace(void)
 }
 
 
+/* Drops a read reference and wakes up a writer waiting for the readers */
+static inline void reader_leave(rw_lock_t * plock)
+{
+  atomic_dec_uint32_t(reader_counter(plock));
+
+  if(atomic_fetch_uint32_t(&plock->nbw) > 0)
+    {
+      P(plock->mutexProtect);
+      print_lock("reader_leave lecteur libere un redacteur", plock);
+      pthread_cond_signal(&plock->condWrite);
+      V(plock->mutexProtect);
+    }
+}                               /* reader_leave */
+
 /* 
  * Take the lock for reading 
  */
 int P_r(rw_lock_t * plock)
 {
-  P(plock->mutexProtect);
+  for(;;)
+    {
+      atomic_inc_uint32_t(reader_counter(plock));
 
-  print_lock("P_r.1", plock);
+      /* no new read lock is granted if writters are waiting or active */
+      if(atomic_fetch_uint32_t(&plock->nbw) == 0)
+        return 0;
 
-  plock->nbr_waiting++;
+      reader_leave(plock);
 
-  /* no new read lock is granted if writters are waiting or active */
-  while(plock->nbw_active > 0 || plock->nbw_waiting > 0)
-    pthread_cond_wait(&(plock->condRead), &(plock->mutexProtect));
-  
-  assert(plock->nbw_active == 0);
-  assert(plock->nbw_waiting == 0);
+      P(plock->mutexProtect);
 
-  assert(plock->nbw_active==0);
-  assert(plock->nbw_waiting==0);
+      print_lock("P_r.1", plock);
 
-  /* There is no active or waiting writters, readers can go ... */
-  plock->nbr_waiting--;
-  plock->nbr_active++;
-  assert(plock->nbr_waiting >= 0);
+      plock->nbr_waiting++;
 
-  print_lock("P_r.end", plock);
-  V(plock->mutexProtect);
+      while(atomic_fetch_uint32_t(&plock->nbw) > 0)
+        pthread_cond_wait(&(plock->condRead), &(plock->mutexProtect));
 
+      /* There is no active or waiting writters, readers can go ... */
+      plock->nbr_waiting--;
 
-  return 0;
+      print_lock("P_r.end", plock);
+      V(plock->mutexProtect);
+    }
 }                               /* P_r */
 
 /*
@@ -119,29 +169,7 @@ int P_r(rw_lock_t * plock)
  */
 int V_r(rw_lock_t * plock)
 {
-  P(plock->mutexProtect);
-
-  print_lock("V_r.1", plock);
-
-  /* I am a reader that is no more active */
-  if(plock->nbr_active == 0)
-    // TODO: Failing on virtual machines
-    // dbg_backtrace();
-    print_lock("V_r.1_1", plock);
-  else
-    plock->nbr_active--;
-
-
-  /* I was the last active reader, and there are some waiting writters, I let one of them go */
-  if(plock->nbr_active == 0 && plock->nbw_waiting > 0)
-    {
-      print_lock("V_r.2 lecteur libere un redacteur", plock);
-      pthread_cond_signal(&plock->condWrite);
-    }
-
-  print_lock("V_r.end", plock);
-
-  V(plock->mutexProtect);
+  reader_leave(plock);
 
   return 0;
 }                               /* V_r */
@@ -155,21 +183,15 @@ int P_w(rw_lock_t * plock)
 
   print_lock("P_w.1", plock);
 
-  plock->nbw_waiting++;
+  /* From now on, new readers wait */
+  atomic_inc_uint32_t(&plock->nbw);
 
   /* nobody must be active obtain exclusive lock */
-  while(plock->nbr_active > 0 || plock->nbw_active > 0)
+  while(plock->nbw_active > 0 || readers_active(plock) > 0)
     pthread_cond_wait(&plock->condWrite, &plock->mutexProtect);
-  assert(plock->nbr_active == 0);
-  assert(plock->nbw_active == 0);
-
-  assert(plock->nbr_active==0);
-  assert(plock->nbw_active==0);
 
   /* I become active and no more waiting */
-  plock->nbw_waiting--;
-  plock->nbw_active++;
-  assert(plock->nbw_waiting >= 0);
+  plock->nbw_active = 1;
 
   print_lock("P_w.end", plock);
   V(plock->mutexProtect);
@@ -177,6 +199,40 @@ int P_w(rw_lock_t * plock)
   return 0;
 }                               /* P_w */
 
+/*
+ * Take the lock for writting if nobody holds it or waits for it, without blocking.
+ * Returns 0 if the lock was taken, EBUSY otherwise.
+ */
+int P_w_try(rw_lock_t * plock)
+{
+  P(plock->mutexProtect);
+
+  if(atomic_fetch_uint32_t(&plock->nbw) > 0 || readers_active(plock) > 0)
+    {
+      V(plock->mutexProtect);
+      return EBUSY;
+    }
+
+  atomic_inc_uint32_t(&plock->nbw);
+
+  /* A reader may have come in before nbw was set */
+  if(readers_active(plock) > 0)
+    {
+      if(atomic_dec_uint32_t(&plock->nbw) == 0 && plock->nbr_waiting > 0)
+        pthread_cond_broadcast(&(plock->condRead));
+
+      V(plock->mutexProtect);
+      return EBUSY;
+    }
+
+  plock->nbw_active = 1;
+
+  print_lock("P_w_try.end", plock);
+  V(plock->mutexProtect);
+
+  return 0;
+}                               /* P_w_try */
+
 /*
  * Release the lock after writting 
  */
@@ -188,36 +244,30 @@ int V_w(rw_lock_t * plock)
 
   /* I was the active writter, I am not it any more */
   if(plock->nbw_active == 0)
-    // TODO: Failing on virtual machines
-    //dbg_backtrace();
-    print_lock("V_w.1_1", plock);
-  else
-    plock->nbw_active--;
-
-  if(plock->nbw_waiting > 0)
     {
+      print_lock("V_w.1_1", plock);
+      V(plock->mutexProtect);
+      return 0;
+    }
 
-      print_lock("V_w.4 redacteur libere un lecteur", plock);
+  plock->nbw_active = 0;
 
-      /* There are waiting writters, but no waiting readers, I let a writter go */
+  if(atomic_dec_uint32_t(&plock->nbw) > 0)
+    {
+      /* There are waiting writters, I let a writter go */
+      print_lock("V_w.2 redacteur libere un redacteur", plock);
       pthread_cond_signal(&(plock->condWrite));
-
-      print_lock("V_w.5", plock);
-
     }
   else if(plock->nbr_waiting > 0)
     {
       /* if readers are waiting, let them go */
-      print_lock("V_w.2 redacteur libere les lecteurs", plock);
+      print_lock("V_w.3 redacteur libere les lecteurs", plock);
       pthread_cond_broadcast(&(plock->condRead));
-
-      print_lock("V_w.3", plock);
-
     }
+
   print_lock("V_w.end", plock);
   V(plock->mutexProtect);
 
-
   return 0;
 }                               /* V_w */
 
@@ -228,34 +278,28 @@ int rw_lock_downgrade(rw_lock_t * plock)
 
   print_lock("downgrade.1", plock);
 
+  /* caller is also a reader, now: the waiting writers keep waiting for it */
+  atomic_inc_uint32_t(reader_counter(plock));
+
   /* I was the active writter, I am not it any more */
   if(plock->nbw_active == 0)
-    // TODO: Failing on virtual machines
-    // dbg_backtrace();
     print_lock("downgrade.1_1", plock);
   else
-    plock->nbw_active--;
-
-  if(plock->nbr_waiting > 0)
     {
-
-      /* there are waiting readers, I let all the readers go */
-      print_lock("downgrade.2 libere les lecteurs", plock);
-      pthread_cond_broadcast(&(plock->condRead));
-
+      plock->nbw_active = 0;
+
+      if(atomic_dec_uint32_t(&plock->nbw) == 0 && plock->nbr_waiting > 0)
+        {
+          /* there are waiting readers and no writer, I let all the readers go */
+          print_lock("downgrade.2 libere les lecteurs", plock);
+          pthread_cond_broadcast(&(plock->condRead));
+        }
     }
 
-  /* nobody must break caller's read lock, so don't consider or unlock writers */
-
-  /* caller is also a reader, now */
-  plock->nbr_active++;
-
   print_lock("downgrade.end", plock);
   V(plock->mutexProtect);
 
-
   return 0;
-
 }                               /* rw_lock_downgrade */
 
 /*
@@ -267,6 +311,8 @@ int rw_lock_init(rw_lock_t * plock)
   pthread_mutexattr_t mutex_attr;
   pthread_condattr_t cond_attr;
 
+  memset(plock, 0, sizeof(rw_lock_t));
+
   if((rc = pthread_mutexattr_init(&mutex_attr) != 0))
     return 1;
   if((rc = pthread_condattr_init(&cond_attr) != 0))
@@ -280,12 +326,6 @@ int rw_lock_init(rw_lock_t * plock)
   if((rc = pthread_cond_init(&(plock->condWrite), &cond_attr)) != 0)
     return 1;
 
-  plock->nbr_waiting = 0;
-  plock->nbr_active = 0;
-
-  plock->nbw_waiting = 0;
-  plock->nbw_active = 0;
-
   return 0;
 }                               /* rw_lock_init */
 
@@ -3,6 +3,11 @@
  *
  * test_rw.c: test program for rw locks 
  *
+ * Checks that readers and writers exclude each other, including through
+ * downgrades, then measures how many lock/unlock pairs per second threads
+ * get on one lock with read mostly workloads, against a plain mutex and
+ * the pthread rwlocks.
+ *
  * $Header: /cea/home/cvs/cvs/SHERPA/BaseCvs/GANESHA/src/RW_Lock/test_rw.c,v 1.3 2004/08/16 14:48:38 deniel Exp $
  *
  * $Log: test_rw.c,v $
@@ -37,75 +42,201 @@
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <sys/time.h>
 #include "RW_Lock.h"
 #include "log.h"
 
-#define MAX_WRITTERS 3
-#define MAX_READERS 5
-#define NB_ITER 40
-#define MARGE_SECURITE 10
+#define MAX_THREADS 16
+#define NB_ITER 200000
+#define BENCH_DURATION 500000   /* microseconds per run */
+#define DEADLOCK_TIMEOUT 120    /* seconds */
 
 rw_lock_t lock;
 
-int OkWrite = 0;
-int OkRead = 0;
+/* Protected by lock: writers keep both equal and no reader is inside meanwhile */
+volatile unsigned int value_a = 0;
+volatile unsigned int value_b = 0;
+uint32_t readers_inside = 0;
+uint32_t writers_inside = 0;
+uint32_t nb_errors = 0;
+
+typedef enum bench_lock_type__
+{
+  BENCH_RW_LOCK,
+  BENCH_MUTEX,
+  BENCH_PTHREAD_RWLOCK
+} bench_lock_type_t;
+
+typedef struct bench_arg__
+{
+  bench_lock_type_t type;
+  unsigned int write_permille;
+  unsigned long long nb_ops;
+} bench_arg_t;
+
+pthread_mutex_t bench_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t bench_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+volatile int bench_stop = 0;
+volatile unsigned int bench_data[16];
+volatile unsigned int bench_sum;
+
+static void deadlock_detected(int sig)
+{
+  LogTest("RW_Lock test FAIL: deadlock");
+  exit(1);
+}                               /* deadlock_detected */
+
+static void check_read(void)
+{
+  if(atomic_fetch_uint32_t(&writers_inside) != 0 || value_a != value_b)
+    atomic_inc_uint32_t(&nb_errors);
+}                               /* check_read */
 
-void *thread_writter(void *arg)
+void *thread_checker(void *arg)
 {
-  int duree_sleep = 1;
-  int nb_iter = NB_ITER;
+  unsigned int seed = (unsigned int)(unsigned long)arg;
+  int nb_iter;
 
-  while(nb_iter > 0)
+  for(nb_iter = 0; nb_iter < NB_ITER; nb_iter++)
     {
-      P_w(&lock);
-      sleep(duree_sleep);
-      V_w(&lock);
-      nb_iter -= 1;
+      switch (rand_r(&seed) % 16)
+        {
+        case 0:
+          /* write */
+          P_w(&lock);
+          if(atomic_inc_uint32_t(&writers_inside) != 1
+             || atomic_fetch_uint32_t(&readers_inside) != 0)
+            atomic_inc_uint32_t(&nb_errors);
+          value_a++;
+          value_b++;
+          atomic_dec_uint32_t(&writers_inside);
+          V_w(&lock);
+          break;
+
+        case 1:
+          /* write, then read what was written */
+          P_w(&lock);
+          atomic_inc_uint32_t(&writers_inside);
+          value_a++;
+          value_b++;
+          atomic_dec_uint32_t(&writers_inside);
+          rw_lock_downgrade(&lock);
+          atomic_inc_uint32_t(&readers_inside);
+          check_read();
+          atomic_dec_uint32_t(&readers_inside);
+          V_r(&lock);
+          break;
+
+        default:
+          P_r(&lock);
+          atomic_inc_uint32_t(&readers_inside);
+          check_read();
+          atomic_dec_uint32_t(&readers_inside);
+          V_r(&lock);
+          break;
+        }
     }
-  OkWrite = 1;                  /* Ecriture concurrente ici, mais on s'en fout (pas d'impact) */
+
   return NULL;
-}                               /* thread_writter */
+}                               /* thread_checker */
 
-void *thread_reader(void *arg)
+static inline void bench_lock(bench_lock_type_t type, int write)
 {
-  int duree_sleep = 1;
-  int nb_iter = NB_ITER;
+  switch (type)
+    {
+    case BENCH_RW_LOCK:
+      if(write)
+        P_w(&lock);
+      else
+        P_r(&lock);
+      break;
 
-  while(nb_iter > 0)
+    case BENCH_MUTEX:
+      pthread_mutex_lock(&bench_mutex);
+      break;
+
+    case BENCH_PTHREAD_RWLOCK:
+      if(write)
+        pthread_rwlock_wrlock(&bench_rwlock);
+      else
+        pthread_rwlock_rdlock(&bench_rwlock);
+      break;
+    }
+}                               /* bench_lock */
+
+static inline void bench_unlock(bench_lock_type_t type, int write)
+{
+  switch (type)
     {
-      P_r(&lock);
-      sleep(duree_sleep);
-      V_r(&lock);
-      nb_iter -= 1;
+    case BENCH_RW_LOCK:
+      if(write)
+        V_w(&lock);
+      else
+        V_r(&lock);
+      break;
+
+    case BENCH_MUTEX:
+      pthread_mutex_unlock(&bench_mutex);
+      break;
+
+    case BENCH_PTHREAD_RWLOCK:
+      pthread_rwlock_unlock(&bench_rwlock);
+      break;
     }
-  OkRead = 1;                   /* Ecriture concurrente ici, mais on s'en fout (pas d'impact) */
+}                               /* bench_unlock */
+
+void *thread_bench(void *arg)
+{
+  bench_arg_t *parg = (bench_arg_t *) arg;
+  unsigned long long nb_ops = 0;
+  unsigned int seed = (unsigned int)(unsigned long)parg;
+  unsigned int sum = 0;
+  int write, i;
+
+  while(!bench_stop)
+    {
+      write = parg->write_permille > 0 && rand_r(&seed) % 1000 < parg->write_permille;
+
+      bench_lock(parg->type, write);
+
+      /* A short critical section, like a lookup in a directory */
+      for(i = 0; i < 16; i++)
+        if(write)
+          bench_data[i] += 1;
+        else
+          sum += bench_data[i];
+
+      bench_unlock(parg->type, write);
+      nb_ops++;
+    }
+
+  bench_sum = sum;
+  parg->nb_ops = nb_ops;
   return NULL;
-}                               /* thread_writter */
+}                               /* thread_bench */
 
-int main(int argc, char *argv[])
+static double bench(bench_lock_type_t type, unsigned int nb_threads,
+                    unsigned int write_permille)
 {
-  SetDefaultLogging("TEST");
-  SetNamePgm("test_rw");
-  pthread_attr_t attr_thr;
-  pthread_t ThrReaders[MAX_READERS];
-  pthread_t ThrWritters[MAX_WRITTERS];
-  int i;
+  pthread_t threads[MAX_THREADS];
+  bench_arg_t args[MAX_THREADS];
+  struct timeval start, end;
+  unsigned long long nb_ops = 0;
+  unsigned int i;
   int rc;
 
-  pthread_attr_init(&attr_thr);
-  pthread_attr_setscope(&attr_thr, PTHREAD_SCOPE_SYSTEM);
-  pthread_attr_setdetachstate(&attr_thr, PTHREAD_CREATE_JOINABLE);
+  bench_stop = 0;
 
-  LogTest("Init lock: %d", rw_lock_init(&lock));
-
-  LogTest("ESTIMATED TIME OF TEST: %d s",
-         (MAX_WRITTERS + MAX_READERS) * NB_ITER + MARGE_SECURITE);
-  fflush(stdout);
+  gettimeofday(&start, NULL);
 
-  for(i = 0; i < MAX_WRITTERS; i++)
+  for(i = 0; i < nb_threads; i++)
     {
-      if((rc =
-          pthread_create(&ThrWritters[i], &attr_thr, thread_writter, (void *)NULL)) != 0)
+      args[i].type = type;
+      args[i].write_permille = write_permille;
+      args[i].nb_ops = 0;
+
+      if((rc = pthread_create(&threads[i], NULL, thread_bench, &args[i])) != 0)
         {
           LogTest("pthread_create: Error %d %d ", rc, errno);
           LogTest("RW_Lock Test FAILED: Bad allocation thread");
@@ -113,10 +244,40 @@ int main(int argc, char *argv[])
         }
     }
 
-  for(i = 0; i < MAX_READERS; i++)
+  usleep(BENCH_DURATION);
+  bench_stop = 1;
+
+  for(i = 0; i < nb_threads; i++)
+    {
+      pthread_join(threads[i], NULL);
+      nb_ops += args[i].nb_ops;
+    }
+
+  gettimeofday(&end, NULL);
+
+  return nb_ops / ((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0);
+}                               /* bench */
+
+int main(int argc, char *argv[])
+{
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_rw");
+  pthread_t threads[MAX_THREADS];
+  unsigned int nb_threads, max_threads, write_permille;
+  long nb_cpus;
+  int i;
+  int rc;
+
+  LogTest("Init lock: %d", rw_lock_init(&lock));
+
+  signal(SIGALRM, deadlock_detected);
+  alarm(DEADLOCK_TIMEOUT);
+
+  /* Mutual exclusion */
+  for(i = 0; i < MAX_THREADS; i++)
     {
-      if((rc =
-          pthread_create(&ThrReaders[i], &attr_thr, thread_reader, (void *)NULL)) != 0)
+      if((rc = pthread_create(&threads[i], NULL, thread_checker,
+                              (void *)(unsigned long)(i + 1))) != 0)
         {
           LogTest("pthread_create: Error %d %d ", rc, errno);
           LogTest("RW_Lock Test FAILED: Bad allocation thread");
@@ -124,27 +285,68 @@ int main(int argc, char *argv[])
         }
     }
 
-  LogTest("Main thread sleeping while threads run locking tests");
+  for(i = 0; i < MAX_THREADS; i++)
+    pthread_join(threads[i], NULL);
 
-  sleep((MAX_WRITTERS + MAX_READERS) * NB_ITER + MARGE_SECURITE);
+  /* No reader must be left behind */
+  P_w(&lock);
+  V_w(&lock);
 
-  LogTest("End of sleep( %d ) ",
-         (MAX_WRITTERS + MAX_READERS) * NB_ITER + MARGE_SECURITE);
-  if((OkWrite == 1) && (OkRead == 1))
+  if(nb_errors != 0 || value_a != value_b)
     {
-      LogTest("Test RW_Lock succeeded: no deadlock detected");
-      exit(0);
-      return 0;                 /* for compiler */
+      LogTest("RW_Lock Test FAILED: %u readers and writers were inside together", nb_errors);
+      exit(1);
     }
-  else
+
+  LogTest("%d threads, %d lock operations each: mutual exclusion OK", MAX_THREADS, NB_ITER);
+
+  /* Non blocking write lock */
+  P_r(&lock);
+  rc = P_w_try(&lock);
+  V_r(&lock);
+  if(rc == 0)
     {
-      if(OkWrite == 0)
-        LogTest("RW_Lock test FAIL: deadlock in the editors");
-      if(OkRead == 0)
-        LogTest("RW_Lock Test FAILED: deadlock in the drive");
+      LogTest("RW_Lock Test FAILED: P_w_try got a lock held by a reader");
       exit(1);
-      return 1;                 /* for compiler */
+    }
 
+  if(P_w_try(&lock) != 0)
+    {
+      LogTest("RW_Lock Test FAILED: P_w_try could not get a free lock");
+      exit(1);
     }
 
+  rc = P_w_try(&lock);
+  V_w(&lock);
+  if(rc == 0)
+    {
+      LogTest("RW_Lock Test FAILED: P_w_try got a lock held by a writer");
+      exit(1);
+    }
+
+  P_r(&lock);
+  V_r(&lock);
+
+  LogTest("P_w_try OK");
+
+  /* Contention */
+  nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  max_threads = (nb_cpus > 0 && nb_cpus < MAX_THREADS) ? nb_cpus : MAX_THREADS;
+  if(max_threads < 4)
+    max_threads = 4;
+
+  for(write_permille = 0; write_permille <= 10; write_permille += 10)
+    for(nb_threads = 1; nb_threads <= max_threads; nb_threads *= 2)
+      LogTest("%2u threads, %2u.%u%% writes: rw_lock_t %10.0f ops/s, "
+              "pthread_mutex_t %10.0f ops/s, pthread_rwlock_t %10.0f ops/s",
+              nb_threads, write_permille / 10, write_permille % 10,
+              bench(BENCH_RW_LOCK, nb_threads, write_permille),
+              bench(BENCH_MUTEX, nb_threads, write_permille),
+              bench(BENCH_PTHREAD_RWLOCK, nb_threads, write_permille));
+
+  alarm(0);
+
+  LogTest("Test RW_Lock succeeded: no deadlock detected");
+  exit(0);
+  return 0;                     /* for compiler */
 }                               /* main */
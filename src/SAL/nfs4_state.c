@@ -90,6 +90,13 @@ int state_conflict(state_t      * pstate,
              (pstate->state_data.share.share_deny & pstate_data->share.share_access))
             return TRUE;
         }
+      else if(pstate->state_type == STATE_TYPE_DELEG)
+        {
+          /* A read delegation granted since its recall was checked */
+          if((pstate_data->share.share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+             (pstate_data->share.share_deny & OPEN4_SHARE_DENY_READ))
+            return TRUE;
+        }
       return FALSE;
 
     case STATE_TYPE_LOCK:
@@ -99,8 +106,20 @@ int state_conflict(state_t      * pstate,
       return FALSE;              /** layout conflict is managed by the FSAL */
 
     case STATE_TYPE_DELEG:
-      /* Not yet implemented for now, answer TRUE to avoid weird behavior */
-      return TRUE;
+      /* A read delegation is not granted on a file open for write or denying
+       * read, nor while the delegations of the file are being recalled */
+      if(pstate->state_type == STATE_TYPE_SHARE)
+        {
+          if((pstate->state_data.share.share_access & OPEN4_SHARE_ACCESS_WRITE) ||
+             (pstate->state_data.share.share_deny & OPEN4_SHARE_DENY_READ))
+            return TRUE;
+        }
+      else if(pstate->state_type == STATE_TYPE_DELEG)
+        {
+          if(pstate->state_data.deleg.sd_recall_time != 0)
+            return TRUE;
+        }
+      return FALSE;
     }
 
   return TRUE;
@@ -0,0 +1,624 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    state_deleg.c
+ * \brief   This file contains functions used in delegation management.
+ *
+ * state_deleg.c : the NFSv4 read delegations.
+ *
+ * A read delegation is granted by OPEN for read to a client whose callback
+ * answered CB_NULL, on a file nobody has open for write. It is a state of the
+ * clientid owner of the client, in the state list of the file. An operation
+ * changing the file (OPEN for write or denying read, SETATTR, REMOVE, WRITE)
+ * first calls state_deleg_conflict: the delegations of the file are marked
+ * recalled and their CB_RECALL queued for the recall threads, the operation
+ * is answered NFS4ERR_DELAY until the clients have returned them. Those not
+ * returned within a lease of their CB_RECALL being sent are revoked.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif                          /* _SOLARIS */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <time.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "log.h"
+#include "HashData.h"
+#include "HashTable.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "fsal.h"
+#include "sal_functions.h"
+#include "stuff_alloc.h"
+
+/* A callback for the recall thread to send */
+typedef struct state_deleg_work__
+{
+  struct glist_head sdw_list;
+  int sdw_probe;                /* CB_NULL to the client, CB_RECALL otherwise */
+  clientid4 sdw_clientid;
+  uint32_t sdw_seqid;           /* The stateid of the delegation recalled */
+  char sdw_other[OTHERSIZE];
+  time_t sdw_recall_time;       /* When the CB_RECALL was sent */
+  u_int sdw_fh_len;
+  char sdw_fh_val[NFS4_FHSIZE];
+} state_deleg_work_t;
+
+/* The lock order is deleg_del_mutex, the entry, then deleg_mutex */
+static pthread_mutex_t deleg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t deleg_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head deleg_queue = { &deleg_queue, &deleg_queue };
+static struct glist_head deleg_recalled = { &deleg_recalled, &deleg_recalled };
+static state_deleg_stat_t deleg_stat;
+
+/* A delegation found by its stateid is deleted once: DELEGRETURN, the
+ * revocation and the expiry of the client may race for it */
+static pthread_mutex_t deleg_del_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static state_status_t state_deleg_del(state_t * pstate,
+                                      cache_inode_client_t * pclient,
+                                      unsigned long long *pcounter,
+                                      state_status_t * pstatus)
+{
+  if(state_del(pstate, pclient, pstatus) == STATE_SUCCESS)
+    {
+      P(deleg_mutex);
+      deleg_stat.nb_held -= 1;
+      *pcounter += 1;
+      V(deleg_mutex);
+    }
+
+  return *pstatus;
+}                               /* state_deleg_del */
+
+/**
+ *
+ * state_deleg_grant: grants a read delegation on a file just opened for read.
+ *
+ * The delegation is granted when the delegations are enabled, the callback
+ * of the client answered, and the client has no delegation on the file yet.
+ * state_add refuses it when the file is open for write, or denying read, or
+ * when its delegations are being recalled.
+ *
+ * @param pentry    [IN]  the file opened
+ * @param pclientid [IN]  the client which opened it
+ * @param pexport   [IN]  the export of the file
+ * @param pfh       [IN]  the file handle of the file, sent back in CB_RECALL
+ * @param pclient   [IN]  cache inode client of the worker
+ * @param pcontext  [IN]  FSAL credentials
+ * @param ppstate   [OUT] the delegation granted
+ *
+ * @return TRUE if the delegation was granted, FALSE otherwise.
+ *
+ */
+int state_deleg_grant(cache_entry_t        * pentry,
+                      nfs_client_id_t      * pclientid,
+                      exportlist_t         * pexport,
+                      nfs_fh4              * pfh,
+                      cache_inode_client_t * pclient,
+                      fsal_op_context_t    * pcontext,
+                      state_t             ** ppstate)
+{
+  state_owner_t * powner = pclientid->clientid_owner;
+  state_data_t candidate_data;
+  state_status_t state_status;
+  struct glist_head *glist;
+  state_t *pstate;
+  int held = FALSE;
+  int cb_up;
+
+  if(!nfs_param.nfsv4_param.use_delegations ||
+     pentry->internal_md.type != REGULAR_FILE ||
+     pfh->nfs_fh4_len > NFS4_FHSIZE || powner == NULL)
+    return FALSE;
+
+  P(pclientid->clientid_mutex);
+  cb_up = (pclientid->cb_path == CB_PATH_UP);
+  V(pclientid->clientid_mutex);
+
+  if(!cb_up)
+    return FALSE;
+
+  /* One delegation per client on a file */
+  P_r(&pentry->lock);
+  glist_for_each(glist, &pentry->object.file.state_list)
+    {
+      pstate = glist_entry(glist, state_t, state_list);
+      if(pstate->state_type == STATE_TYPE_DELEG && pstate->state_powner == powner)
+        {
+          held = TRUE;
+          break;
+        }
+    }
+  V_r(&pentry->lock);
+
+  if(held)
+    return FALSE;
+
+  memset(&candidate_data, 0, sizeof(candidate_data));
+  candidate_data.deleg.sd_type = OPEN_DELEGATE_READ;
+  candidate_data.deleg.sd_grant_time = time(NULL);
+  candidate_data.deleg.sd_recall_time = 0;
+  candidate_data.deleg.sd_fh_len = pfh->nfs_fh4_len;
+  memcpy(candidate_data.deleg.sd_fh_val, pfh->nfs_fh4_val, pfh->nfs_fh4_len);
+
+  /* Released by state_del */
+  inc_state_owner_ref(powner);
+
+  if(state_add(pentry, STATE_TYPE_DELEG, &candidate_data, powner,
+               pclient, pcontext, &pstate, &state_status) != STATE_SUCCESS)
+    {
+      dec_state_owner_ref(powner, pclient);
+      return FALSE;
+    }
+
+  /* Attach the delegation to the export */
+  pstate->state_pexport = pexport;
+  P(pexport->exp_state_mutex);
+  glist_add_tail(&pexport->exp_state_list, &pstate->state_export_list);
+  V(pexport->exp_state_mutex);
+
+  P(deleg_mutex);
+  deleg_stat.nb_held += 1;
+  deleg_stat.nb_granted += 1;
+  V(deleg_mutex);
+
+  LogFullDebug(COMPONENT_STATE,
+               "Read delegation granted to client %"PRIx64" on entry %p",
+               pclientid->clientid, pentry);
+
+  *ppstate = pstate;
+  return TRUE;
+}                               /* state_deleg_grant */
+
+/**
+ *
+ * state_deleg_conflict: recalls the delegations of a file about to change.
+ *
+ * Called before an operation which conflicts with the read delegations of
+ * the file. The delegations not recalled yet are marked recalled, which
+ * stops granting new ones, and their CB_RECALL is queued.
+ *
+ * @param pentry [IN] the file about to change, unlocked
+ *
+ * @return TRUE if delegations are held on the file, the operation is to be
+ *         answered NFS4ERR_DELAY (NFS3ERR_JUKEBOX), FALSE otherwise.
+ *
+ */
+int state_deleg_conflict(cache_entry_t * pentry)
+{
+  state_deleg_work_t *pwork;
+  struct glist_head *glist;
+  state_t *pstate;
+  int nb_delegs = 0;
+
+  /* Nothing to recall, always the case with the delegations disabled */
+  if(deleg_stat.nb_held == 0 || pentry->internal_md.type != REGULAR_FILE)
+    return FALSE;
+
+  /* Looked for under the read lock first: the writes of a file without
+   * delegation, the usual case, do not serialize on the entry */
+  P_r(&pentry->lock);
+  glist_for_each(glist, &pentry->object.file.state_list)
+    {
+      pstate = glist_entry(glist, state_t, state_list);
+      if(pstate->state_type == STATE_TYPE_DELEG)
+        {
+          nb_delegs += 1;
+          break;
+        }
+    }
+  V_r(&pentry->lock);
+
+  if(nb_delegs == 0)
+    return FALSE;
+
+  nb_delegs = 0;
+
+  P_w(&pentry->lock);
+
+  glist_for_each(glist, &pentry->object.file.state_list)
+    {
+      pstate = glist_entry(glist, state_t, state_list);
+
+      if(pstate->state_type != STATE_TYPE_DELEG)
+        continue;
+
+      nb_delegs += 1;
+
+      if(pstate->state_data.deleg.sd_recall_time != 0)
+        continue;
+
+      /* Not marked recalled without a recall to send, it is tried again later */
+      if((pwork = (state_deleg_work_t *) Mem_Alloc(sizeof(state_deleg_work_t))) == NULL)
+        {
+          LogCrit(COMPONENT_STATE, "Cannot allocate the recall of a delegation");
+          continue;
+        }
+
+      pstate->state_data.deleg.sd_recall_time = time(NULL);
+
+      pwork->sdw_probe = FALSE;
+      pwork->sdw_clientid = pstate->state_powner->so_owner.so_nfs4_owner.so_clientid;
+      /* The OPEN granting it may not have set its seqid yet */
+      pwork->sdw_seqid = (pstate->state_seqid != 0) ? pstate->state_seqid : 1;
+      memcpy(pwork->sdw_other, pstate->stateid_other, OTHERSIZE);
+      pwork->sdw_recall_time = 0;
+      pwork->sdw_fh_len = pstate->state_data.deleg.sd_fh_len;
+      memcpy(pwork->sdw_fh_val, pstate->state_data.deleg.sd_fh_val, pwork->sdw_fh_len);
+
+      P(deleg_mutex);
+      glist_add_tail(&deleg_queue, &pwork->sdw_list);
+      deleg_stat.nb_recalling += 1;
+      deleg_stat.nb_recalled += 1;
+      pthread_cond_signal(&deleg_cond);
+      V(deleg_mutex);
+    }
+
+  V_w(&pentry->lock);
+
+  return nb_delegs != 0;
+}                               /* state_deleg_conflict */
+
+/**
+ *
+ * state_deleg_open_conflict: recalls the delegations of a file opened for write.
+ *
+ * @param pentry       [IN] the file opened
+ * @param share_access [IN] the share access of the OPEN
+ * @param share_deny   [IN] the share deny of the OPEN
+ *
+ * @return TRUE if the OPEN is to be answered NFS4ERR_DELAY, FALSE otherwise.
+ *
+ */
+int state_deleg_open_conflict(cache_entry_t * pentry,
+                              unsigned int share_access, unsigned int share_deny)
+{
+  if(!(share_access & OPEN4_SHARE_ACCESS_WRITE) && !(share_deny & OPEN4_SHARE_DENY_READ))
+    return FALSE;
+
+  return state_deleg_conflict(pentry);
+}                               /* state_deleg_open_conflict */
+
+/**
+ *
+ * state_deleg_remove_conflict: recalls the delegations of a file about to be removed.
+ *
+ * The file is looked up only when delegations are held.
+ *
+ * @param pentry_parent [IN] the directory of the file
+ * @param pname         [IN] the name of the file
+ * @param policy        [IN] the cache policy of the export
+ * @param ht            [IN] the hash table of the cache
+ * @param pclient       [IN] cache inode client of the worker
+ * @param pcontext      [IN] FSAL credentials
+ *
+ * @return TRUE if the REMOVE is to be answered NFS4ERR_DELAY, FALSE otherwise.
+ *
+ */
+int state_deleg_remove_conflict(cache_entry_t        * pentry_parent,
+                                fsal_name_t          * pname,
+                                cache_inode_policy_t   policy,
+                                hash_table_t         * ht,
+                                cache_inode_client_t * pclient,
+                                fsal_op_context_t    * pcontext)
+{
+  cache_inode_status_t cache_status;
+  fsal_attrib_list_t attr;
+  cache_entry_t *pentry;
+
+  if(deleg_stat.nb_held == 0)
+    return FALSE;
+
+  if((pentry = cache_inode_lookup(pentry_parent, pname, policy, &attr, ht,
+                                  pclient, pcontext, &cache_status)) == NULL)
+    return FALSE;
+
+  return state_deleg_conflict(pentry);
+}                               /* state_deleg_remove_conflict */
+
+/**
+ *
+ * state_deleg_return: deletes a delegation given back by DELEGRETURN.
+ *
+ * @param other   [IN]  the stateid of the delegation
+ * @param pclient [IN]  cache inode client of the worker
+ * @param pstatus [OUT] returned status
+ *
+ * @return the same as *pstatus
+ *
+ */
+state_status_t state_deleg_return(char other[OTHERSIZE],
+                                  cache_inode_client_t * pclient,
+                                  state_status_t * pstatus)
+{
+  state_t *pstate;
+
+  P(deleg_del_mutex);
+
+  if(!nfs4_State_Get_Pointer(other, &pstate))
+    *pstatus = STATE_NOT_FOUND;
+  else if(pstate->state_type != STATE_TYPE_DELEG)
+    *pstatus = STATE_BAD_TYPE;
+  else
+    state_deleg_del(pstate, pclient, &deleg_stat.nb_returned, pstatus);
+
+  V(deleg_del_mutex);
+
+  return *pstatus;
+}                               /* state_deleg_return */
+
+/**
+ *
+ * state_deleg_release: deletes the delegations of a client which expired.
+ *
+ * @param pclientid_owner [IN] the clientid owner of the client
+ * @param pclient         [IN] cache inode client to be used
+ *
+ */
+void state_deleg_release(state_owner_t * pclientid_owner, cache_inode_client_t * pclient)
+{
+  struct glist_head *glist, *glistn;
+  state_status_t state_status;
+  state_t *pstate;
+
+  P(deleg_del_mutex);
+
+  glist_for_each_safe(glist, glistn, &pclientid_owner->so_owner.so_nfs4_owner.so_state_list)
+    {
+      pstate = glist_entry(glist, state_t, state_owner_list);
+
+      if(pstate->state_type != STATE_TYPE_DELEG)
+        continue;
+
+      if(state_deleg_del(pstate, pclient, &deleg_stat.nb_revoked,
+                         &state_status) != STATE_SUCCESS)
+        LogDebug(COMPONENT_STATE,
+                 "Could not release a delegation, error %s",
+                 state_err_str(state_status));
+    }
+
+  V(deleg_del_mutex);
+}                               /* state_deleg_release */
+
+/**
+ *
+ * state_deleg_probe: queues the CB_NULL checking the callback of a client.
+ *
+ * Called when the client id is confirmed, delegations are granted to the
+ * client once its callback answered.
+ *
+ * @param clientid [IN] the client
+ *
+ */
+void state_deleg_probe(clientid4 clientid)
+{
+  state_deleg_work_t *pwork;
+
+  if((pwork = (state_deleg_work_t *) Mem_Alloc(sizeof(state_deleg_work_t))) == NULL)
+    {
+      LogCrit(COMPONENT_STATE, "Cannot allocate the callback probe of a client");
+      return;
+    }
+
+  memset(pwork, 0, sizeof(state_deleg_work_t));
+  pwork->sdw_probe = TRUE;
+  pwork->sdw_clientid = clientid;
+
+  P(deleg_mutex);
+  glist_add_tail(&deleg_queue, &pwork->sdw_list);
+  pthread_cond_signal(&deleg_cond);
+  V(deleg_mutex);
+}                               /* state_deleg_probe */
+
+/* The state of the callback of a client, if it still exists */
+static void state_deleg_set_cb_path(clientid4 clientid, nfs_cb_path_state_t cb_path)
+{
+  nfs_client_id_t *pclientid;
+
+  if(nfs_client_id_Get_Pointer(clientid, &pclientid) != CLIENT_ID_SUCCESS)
+    return;
+
+  P(pclientid->clientid_mutex);
+  pclientid->cb_path = cb_path;
+  V(pclientid->clientid_mutex);
+}                               /* state_deleg_set_cb_path */
+
+static void state_deleg_send(state_deleg_work_t * pwork)
+{
+  nfs_client_id_t client_copy;
+  stateid4 stateid;
+  nfs_fh4 fh;
+
+  /* The delegations of a client gone are gone as well */
+  if(nfs_client_id_get(pwork->sdw_clientid, &client_copy) != CLIENT_ID_SUCCESS)
+    return;
+
+  if(pwork->sdw_probe)
+    {
+      if(nfs4_cb_probe(&client_copy))
+        state_deleg_set_cb_path(pwork->sdw_clientid, CB_PATH_UP);
+      else
+        {
+          LogInfo(COMPONENT_STATE,
+                  "The callback of client %s at %s %s does not answer, no delegation is granted to it",
+                  client_copy.client_name, client_copy.client_r_netid,
+                  client_copy.client_r_addr);
+          state_deleg_set_cb_path(pwork->sdw_clientid, CB_PATH_DOWN);
+        }
+      return;
+    }
+
+  stateid.seqid = pwork->sdw_seqid;
+  memcpy(stateid.other, pwork->sdw_other, OTHERSIZE);
+  fh.nfs_fh4_len = pwork->sdw_fh_len;
+  fh.nfs_fh4_val = pwork->sdw_fh_val;
+
+  if(!nfs4_cb_send_recall(&client_copy, &stateid, &fh))
+    {
+      LogEvent(COMPONENT_STATE,
+               "CB_RECALL to client %s at %s failed, its delegation is revoked in %u seconds",
+               client_copy.client_name, client_copy.client_r_addr,
+               nfs_param.nfsv4_param.lease_lifetime);
+
+      state_deleg_set_cb_path(pwork->sdw_clientid, CB_PATH_DOWN);
+
+      P(deleg_mutex);
+      deleg_stat.nb_cb_failed += 1;
+      V(deleg_mutex);
+    }
+}                               /* state_deleg_send */
+
+/* Forgets the recalls returned, revokes the delegations not returned in a lease */
+static void state_deleg_revoke_expired(cache_inode_client_t * pclient)
+{
+  struct glist_head expired;
+  struct glist_head *glist, *glistn;
+  state_deleg_work_t *pwork;
+  state_status_t state_status;
+  state_t *pstate;
+  time_t now = time(NULL);
+
+  init_glist(&expired);
+
+  P(deleg_del_mutex);
+
+  P(deleg_mutex);
+
+  glist_for_each_safe(glist, glistn, &deleg_recalled)
+    {
+      pwork = glist_entry(glist, state_deleg_work_t, sdw_list);
+
+      if(nfs4_State_Get_Pointer(pwork->sdw_other, &pstate) &&
+         now - pwork->sdw_recall_time < (time_t) nfs_param.nfsv4_param.lease_lifetime)
+        continue;
+
+      glist_del(&pwork->sdw_list);
+      glist_add_tail(&expired, &pwork->sdw_list);
+      deleg_stat.nb_recalling -= 1;
+    }
+
+  V(deleg_mutex);
+
+  glist_for_each_safe(glist, glistn, &expired)
+    {
+      pwork = glist_entry(glist, state_deleg_work_t, sdw_list);
+
+      if(nfs4_State_Get_Pointer(pwork->sdw_other, &pstate))
+        {
+          LogEvent(COMPONENT_STATE,
+                   "Delegation of client %"PRIx64" not returned %u seconds after its recall, revoked",
+                   pwork->sdw_clientid, nfs_param.nfsv4_param.lease_lifetime);
+
+          if(state_deleg_del(pstate, pclient, &deleg_stat.nb_revoked,
+                             &state_status) != STATE_SUCCESS)
+            LogDebug(COMPONENT_STATE,
+                     "Could not revoke a delegation, error %s",
+                     state_err_str(state_status));
+        }
+
+      glist_del(&pwork->sdw_list);
+      Mem_Free(pwork);
+    }
+
+  V(deleg_del_mutex);
+
+  /* The connections to the callbacks not used for a lease are closed */
+  nfs4_cb_close_idle((time_t) nfs_param.nfsv4_param.lease_lifetime);
+}                               /* state_deleg_revoke_expired */
+
+/**
+ *
+ * state_deleg_recall_run: sends the next callback queued.
+ *
+ * Waits for a callback to send up to timeout seconds. Several recall threads
+ * send the callbacks queued in parallel, those to one client being made one
+ * at a time on its connection. A recall sent waits for the delegation to be
+ * returned, then the delegations recalled for more than a lease are revoked.
+ *
+ * @param pclient [IN] ressource allocated by the recall thread.
+ * @param timeout [IN] most seconds to wait for a callback.
+ *
+ */
+void state_deleg_recall_run(cache_inode_client_t * pclient, unsigned int timeout)
+{
+  state_deleg_work_t *pwork = NULL;
+  struct timespec deadline;
+
+  P(deleg_mutex);
+
+  if(glist_empty(&deleg_queue))
+    {
+      deadline.tv_sec = time(NULL) + timeout;
+      deadline.tv_nsec = 0;
+      pthread_cond_timedwait(&deleg_cond, &deleg_mutex, &deadline);
+    }
+
+  if(!glist_empty(&deleg_queue))
+    {
+      pwork = glist_first_entry(&deleg_queue, state_deleg_work_t, sdw_list);
+      glist_del(&pwork->sdw_list);
+    }
+
+  V(deleg_mutex);
+
+  if(pwork != NULL)
+    {
+      state_deleg_send(pwork);
+
+      if(pwork->sdw_probe)
+        Mem_Free(pwork);
+      else
+        {
+          /* The client has a lease from now on to return it */
+          pwork->sdw_recall_time = time(NULL);
+
+          P(deleg_mutex);
+          glist_add_tail(&deleg_recalled, &pwork->sdw_list);
+          V(deleg_mutex);
+        }
+    }
+
+  state_deleg_revoke_expired(pclient);
+}                               /* state_deleg_recall_run */
+
+/**
+ *
+ * state_deleg_get_stats: gets the counters of the delegations.
+ *
+ * @param pstat [OUT] the counters
+ *
+ */
+void state_deleg_get_stats(state_deleg_stat_t * pstat)
+{
+  P(deleg_mutex);
+  *pstat = deleg_stat;
+  V(deleg_mutex);
+}                               /* state_deleg_get_stats */
@@ -247,6 +247,16 @@ static inline int different_lock(fsal_lock_param_t *lock1, fsal_lock_param_t *lo
          (lock1->lock_length != lock2->lock_length);
 }
 
+/* Two overlapping locks conflict if one is exclusive and the owners differ */
+static inline int locks_conflict(state_lock_entry_t *found_entry,
+                                 state_owner_t      *powner,
+                                 fsal_lock_param_t  *plock)
+{
+  return (found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
+          plock->lock_type == FSAL_LOCK_W) &&
+         different_owners(found_entry->sle_owner, powner);
+}
+
 /******************************************************************************
  *
  * Functions to log locks in various ways
@@ -428,6 +438,81 @@ void dump_all_locks(const char * label)
  * Functions to manage lock entries and lock list
  *
  ******************************************************************************/
+
+/*
+ * Every lock entry on the lock list of a file is also indexed by range, in
+ * one of two interval trees: granted locks (STATE_NON_BLOCKING and
+ * STATE_GRANTING) and blocked locks (blocking or canceled). Conflict checks,
+ * merges, splits and grants only visit the locks overlapping the range they
+ * work on. The lock list keeps all the entries of the file.
+ */
+static inline struct itree *lock_tree(cache_entry_t    * pentry,
+                                      state_blocking_t   blocked)
+{
+  if(blocked == STATE_NON_BLOCKING || blocked == STATE_GRANTING)
+    return &pentry->object.file.lock_granted_tree;
+  else
+    return &pentry->object.file.lock_blocked_tree;
+}
+
+static inline state_lock_entry_t *lock_tree_entry(struct itree_node *node)
+{
+  if(node == NULL)
+    return NULL;
+
+  return itree_entry(node, state_lock_entry_t, sle_tree_node);
+}
+
+static void index_lock_entry(state_lock_entry_t * lock_entry)
+{
+  lock_entry->sle_tree = lock_tree(lock_entry->sle_pentry, lock_entry->sle_blocked);
+
+  itree_insert(lock_entry->sle_tree,
+               &lock_entry->sle_tree_node,
+               lock_entry->sle_lock.lock_start,
+               lock_end(&lock_entry->sle_lock));
+}
+
+static void unindex_lock_entry(state_lock_entry_t * lock_entry)
+{
+  if(lock_entry->sle_tree == NULL)
+    return;
+
+  itree_remove(lock_entry->sle_tree, &lock_entry->sle_tree_node);
+  lock_entry->sle_tree = NULL;
+}
+
+/* Must be called after changing the range of an entry on the lock list */
+static void reindex_lock_entry(state_lock_entry_t * lock_entry)
+{
+  if(lock_entry->sle_tree == NULL)
+    return;
+
+  unindex_lock_entry(lock_entry);
+  index_lock_entry(lock_entry);
+}
+
+/* Adds an entry to the lock list of its file */
+static void insert_lock_entry(state_lock_entry_t * lock_entry)
+{
+  glist_add_tail(&lock_entry->sle_pentry->object.file.lock_list,
+                 &lock_entry->sle_list);
+  index_lock_entry(lock_entry);
+}
+
+#ifdef _USE_BLOCKING_LOCKS
+/* Changes the blocked state of an entry, moving it to the right tree */
+static void set_lock_blocked(state_lock_entry_t * lock_entry,
+                             state_blocking_t     blocked)
+{
+  lock_entry->sle_blocked = blocked;
+
+  if(lock_entry->sle_tree != NULL &&
+     lock_entry->sle_tree != lock_tree(lock_entry->sle_pentry, blocked))
+    reindex_lock_entry(lock_entry);
+}
+#endif
+
 static state_lock_entry_t *create_state_lock_entry(cache_entry_t      * pentry,
                                                    fsal_op_context_t  * pcontext,
                                                    exportlist_t       * pexport,
@@ -622,6 +707,7 @@ static void remove_from_locklist(state_lock_entry_t   * lock_entry,
     }
 
   lock_entry->sle_owner = NULL;
+  unindex_lock_entry(lock_entry);
   glist_del(&lock_entry->sle_list);
   lock_entry_dec_ref(lock_entry);
 }
@@ -631,47 +717,36 @@ static state_lock_entry_t *get_overlapping_entry(cache_entry_t     * pentry,
                                                  state_owner_t     * powner,
                                                  fsal_lock_param_t * plock)
 {
-  struct glist_head *glist;
+  struct itree_node *node;
   state_lock_entry_t *found_entry = NULL;
-  uint64_t found_entry_end, plock_end = lock_end(plock);
+  uint64_t plock_end = lock_end(plock);
 
-  glist_for_each(glist, &pentry->object.file.lock_list)
+  /* Only granted locks can conflict, and only if they overlap */
+  for(node = itree_first_overlap(&pentry->object.file.lock_granted_tree,
+                                 plock->lock_start, plock_end);
+      node != NULL;
+      node = itree_next_overlap(node, plock->lock_start, plock_end))
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      found_entry = lock_tree_entry(node);
 
       LogEntry("Checking", found_entry);
 
-      /* Skip blocked or cancelled locks */
-      if(found_entry->sle_blocked == STATE_NLM_BLOCKING ||
-         found_entry->sle_blocked == STATE_NFSV4_BLOCKING ||
-         found_entry->sle_blocked == STATE_CANCELED)
-          continue;
-
-      found_entry_end = lock_end(&found_entry->sle_lock);
-
-      if((found_entry_end >= plock->lock_start) &&
-         (found_entry->sle_lock.lock_start <= plock_end))
+      /* lock overlaps see if we can allow
+       * allow if neither lock is exclusive or the owner is the same
+       */
+      if(locks_conflict(found_entry, powner, plock))
         {
-          /* lock overlaps see if we can allow
-           * allow if neither lock is exclusive or the owner is the same
-           */
-          if((found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
-              plock->lock_type == FSAL_LOCK_W) &&
-             different_owners(found_entry->sle_owner, powner)
-             )
-            {
-              /* found a conflicting lock, return it */
-              return found_entry;
-            }
+          /* found a conflicting lock, return it */
+          return found_entry;
         }
     }
 
   return NULL;
 }
 
-/* We need to iterate over the full lock list and remove
- * any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
- * implies remove all entries
+/* We need to iterate over the granted locks touching or overlapping
+ * lock_entry and remove any mapping entry. And l_offset = 0 and
+ * sle_lock.lock_length = 0 lock_entry implies remove all entries
  */
 static void merge_lock_entry(cache_entry_t        * pentry,
                              fsal_op_context_t    * pcontext,
@@ -682,103 +757,138 @@ static void merge_lock_entry(cache_entry_t        * pentry,
   state_lock_entry_t * check_entry_right;
   uint64_t             check_entry_end;
   uint64_t             lock_entry_end;
-  struct glist_head  * glist;
-  struct glist_head  * glistn;
+  uint64_t             merge_start, merge_end;
+  struct itree_node  * node;
+  struct itree_node  * next;
+  bool_t               indexed = lock_entry->sle_tree != NULL;
+  bool_t               grown;
 
   /* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-  glist_for_each_safe(glist, glistn, &pentry->object.file.lock_list)
+  /* lock_entry grows while merging, keep it out of the tree meanwhile */
+  unindex_lock_entry(lock_entry);
+
+  /* Once lock_entry has grown, look again for locks touching the new range */
+  do
     {
-      check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      grown = FALSE;
 
-      /* Skip entry being merged - it could be in the list */
-      if(check_entry == lock_entry)
-        continue;
+      merge_start = lock_entry->sle_lock.lock_start;
+      if(merge_start > 0)
+        merge_start--;
 
-      if(different_owners(check_entry->sle_owner, lock_entry->sle_owner))
-        continue;
+      merge_end = lock_end(&lock_entry->sle_lock);
+      if(merge_end < UINT64_MAX)
+        merge_end++;
 
-      /* Only merge fully granted locks */
-      if(check_entry->sle_blocked != STATE_NON_BLOCKING)
-        continue;
+      for(node = itree_first_overlap(&pentry->object.file.lock_granted_tree,
+                                     merge_start, merge_end);
+          node != NULL;
+          node = next)
+        {
+          next = itree_next_overlap(node, merge_start, merge_end);
+          check_entry = lock_tree_entry(node);
 
-      check_entry_end = lock_end(&check_entry->sle_lock);
-      lock_entry_end  = lock_end(&lock_entry->sle_lock);
+          if(different_owners(check_entry->sle_owner, lock_entry->sle_owner))
+            continue;
 
-      if((check_entry_end + 1) < lock_entry->sle_lock.lock_start)
-        /* nothing to merge */
-        continue;
+          /* Only merge fully granted locks */
+          if(check_entry->sle_blocked != STATE_NON_BLOCKING)
+            continue;
 
-      if((lock_entry_end + 1) < check_entry->sle_lock.lock_start)
-        /* nothing to merge */
-        continue;
+          check_entry_end = lock_end(&check_entry->sle_lock);
+          lock_entry_end  = lock_end(&lock_entry->sle_lock);
 
-      /* Need to handle locks of different types differently, may split an old lock.
-       * If new lock totally overlaps old lock, the new lock will replace the old
-       * lock so no special work to be done.
-       */
-      if((check_entry->sle_lock.lock_type != lock_entry->sle_lock.lock_type) &&
-         ((lock_entry_end < check_entry_end) ||
-          (check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)))
-        {
-          if(lock_entry_end < check_entry_end &&
-             check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)
+          if((check_entry_end + 1) < lock_entry->sle_lock.lock_start)
+            /* nothing to merge */
+            continue;
+
+          if((lock_entry_end + 1) < check_entry->sle_lock.lock_start)
+            /* nothing to merge */
+            continue;
+
+          /* Need to handle locks of different types differently, may split an old lock.
+           * If new lock totally overlaps old lock, the new lock will replace the old
+           * lock so no special work to be done.
+           */
+          if((check_entry->sle_lock.lock_type != lock_entry->sle_lock.lock_type) &&
+             ((lock_entry_end < check_entry_end) ||
+              (check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)))
             {
-              /* Need to split old lock */
-              check_entry_right = state_lock_entry_t_dup(pcontext, check_entry);
-              if(check_entry_right == NULL)
+              if(lock_entry_end < check_entry_end &&
+                 check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)
+                {
+                  /* Need to split old lock */
+                  check_entry_right = state_lock_entry_t_dup(pcontext, check_entry);
+                  if(check_entry_right == NULL)
+                    {
+                      // TODO FSF: OOPS....
+                      // Leave old lock in place, it may cause false conflicts, but should eventually be released
+                      LogMajor(COMPONENT_STATE,
+                               "Memory allocation failure during lock upgrade/downgrade");
+                      continue;
+                    }
+                  insert_lock_entry(check_entry_right);
+                }
+              else
                 {
-                  // TODO FSF: OOPS....
-                  // Leave old lock in place, it may cause false conflicts, but should eventually be released
-                  LogMajor(COMPONENT_STATE,
-                           "Memory allocation failure during lock upgrade/downgrade");
+                  /* No split, just shrink, make the logic below work on original lock */
+                  check_entry_right = check_entry;
+                }
+              if(lock_entry_end < check_entry_end)
+                {
+                  /* Need to shrink old lock from beginning (right lock if split) */
+                  if(check_entry_right->sle_lock.lock_start == lock_entry_end + 1)
+                    /* only touching, nothing to shrink */
+                    continue;
+                  LogEntry("Merge shrinking right", check_entry_right);
+                  check_entry_right->sle_lock.lock_start  = lock_entry_end + 1;
+                  check_entry_right->sle_lock.lock_length = check_entry_end - lock_entry_end;
+                  reindex_lock_entry(check_entry_right);
+                  LogEntry("Merge shrunk right", check_entry_right);
                   continue;
                 }
-              glist_add_tail(&pentry->object.file.lock_list, &(check_entry_right->sle_list));
-            }
-          else
-            {
-              /* No split, just shrink, make the logic below work on original lock */
-              check_entry_right = check_entry;
+              if(check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)
+                {
+                  /* Need to shrink old lock from end (left lock if split) */
+                  LogEntry("Merge shrinking left", check_entry);
+                  check_entry->sle_lock.lock_length = lock_entry->sle_lock.lock_start - check_entry->sle_lock.lock_start;
+                  reindex_lock_entry(check_entry);
+                  LogEntry("Merge shrunk left", check_entry);
+                  continue;
+                }
+              /* Done splitting/shrinking old lock */
+              continue;
             }
+
+          /* check_entry touches or overlaps lock_entry, expand lock_entry */
           if(lock_entry_end < check_entry_end)
             {
-              /* Need to shrink old lock from beginning (right lock if split) */
-              LogEntry("Merge shrinking right", check_entry_right);
-              check_entry_right->sle_lock.lock_start  = lock_entry_end + 1;
-              check_entry_right->sle_lock.lock_length = check_entry_end - lock_entry_end;
-              LogEntry("Merge shrunk right", check_entry_right);
-              continue;
+              /* Expand end of lock_entry */
+              lock_entry_end = check_entry_end;
+              grown = TRUE;
             }
+
           if(check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)
             {
-              /* Need to shrink old lock from end (left lock if split) */
-              LogEntry("Merge shrinking left", check_entry);
-              check_entry->sle_lock.lock_length = lock_entry->sle_lock.lock_start - check_entry->sle_lock.lock_start;
-              LogEntry("Merge shrunk left", check_entry);
-              continue;
+              /* Expand start of lock_entry */
+              lock_entry->sle_lock.lock_start = check_entry->sle_lock.lock_start;
+              grown = TRUE;
             }
-          /* Done splitting/shrinking old lock */
-          continue;
-        }
-
-      /* check_entry touches or overlaps lock_entry, expand lock_entry */
-      if(lock_entry_end < check_entry_end)
-        /* Expand end of lock_entry */
-        lock_entry_end = check_entry_end;
 
-      if(check_entry->sle_lock.lock_start < lock_entry->sle_lock.lock_start)
-        /* Expand start of lock_entry */
-        lock_entry->sle_lock.lock_start = check_entry->sle_lock.lock_start;
+          /* Compute new lock length */
+          lock_entry->sle_lock.lock_length = lock_entry_end - lock_entry->sle_lock.lock_start + 1;
 
-      /* Compute new lock length */
-      lock_entry->sle_lock.lock_length = lock_entry_end - lock_entry->sle_lock.lock_start + 1;
-
-      /* Remove merged entry */
-      LogEntry("Merged", lock_entry);
-      LogEntry("Merging removing", check_entry);
-      remove_from_locklist(check_entry, pclient);
+          /* Remove merged entry */
+          LogEntry("Merged", lock_entry);
+          LogEntry("Merging removing", check_entry);
+          remove_from_locklist(check_entry, pclient);
+        }
     }
+  while(grown);
+
+  if(indexed)
+    index_lock_entry(lock_entry);
 }
 
 static void free_list(struct glist_head    * list,
@@ -865,13 +975,43 @@ static bool_t subtract_lock_from_entry(cache_entry_t        * pentry,
 complete_remove:
 
   /* Remove the lock from the list it's on and put it on the remove_list */
+  unindex_lock_entry(found_entry);
   glist_del(&found_entry->sle_list);
   glist_add_tail(remove_list, &(found_entry->sle_list));
 
   return TRUE;
 }
 
-/* Subtract a lock from a list of locks, possibly splitting entries in the list. */
+/* Checks whether a lock entry is affected when subtracting a lock of powner */
+static bool_t lock_entry_subtractable(state_lock_entry_t * found_entry,
+                                      state_owner_t      * powner,
+                                      state_t            * pstate)
+{
+  if(powner != NULL && different_owners(found_entry->sle_owner, powner))
+    return FALSE;
+
+  /* Only care about granted locks */
+  if(found_entry->sle_blocked != STATE_NON_BLOCKING)
+    return FALSE;
+
+#ifdef _USE_NLM
+  /* Skip locks owned by this NLM state.
+   * This protects NLM locks from the current iteration of an NLM
+   * client from being released by SM_NOTIFY.
+   */
+  if(pstate != NULL &&
+     lock_owner_is_nlm(found_entry) &&
+     found_entry->sle_state == pstate)
+    return FALSE;
+#endif
+
+  return TRUE;
+}
+
+/* Subtract a lock from a list of locks, possibly splitting entries in the list.
+ * When the list is the lock list of pentry, only the granted locks overlapping
+ * plock are visited, through the granted lock tree.
+ */
 static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
                                       fsal_op_context_t    * pcontext,
                                       state_owner_t        * powner,
@@ -884,51 +1024,70 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
   state_lock_entry_t *found_entry;
   struct glist_head split_lock_list, remove_list;
   struct glist_head *glist, *glistn;
+  struct itree_node *node, *next;
+  uint64_t plock_end = lock_end(plock);
+  bool_t indexed = (list == &pentry->object.file.lock_list);
   bool_t rc = FALSE;
 
   init_glist(&split_lock_list);
   init_glist(&remove_list);
 
-  glist_for_each_safe(glist, glistn, list)
-    {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+  *pstatus = STATE_SUCCESS;
 
-      if(powner != NULL && different_owners(found_entry->sle_owner, powner))
-        continue;
+  /*
+   * Even though we are taking a reference to found_entry, we
+   * don't inc the ref count because we want to drop the lock entry.
+   */
+  if(indexed)
+    {
+      for(node = itree_first_overlap(&pentry->object.file.lock_granted_tree,
+                                     plock->lock_start, plock_end);
+          node != NULL;
+          node = next)
+        {
+          next = itree_next_overlap(node, plock->lock_start, plock_end);
+          found_entry = lock_tree_entry(node);
 
-      /* Only care about granted locks */
-      if(found_entry->sle_blocked != STATE_NON_BLOCKING)
-        continue;
+          if(!lock_entry_subtractable(found_entry, powner, pstate))
+            continue;
 
+          rc |= subtract_lock_from_entry(pentry,
+                                         pcontext,
+                                         found_entry,
+                                         plock,
+                                         &split_lock_list,
+                                         &remove_list,
+                                         pstatus,
+                                         pclient);
+          if(*pstatus != STATE_SUCCESS)
+            {
+              /* We ran out of memory while splitting, deal with it outside loop */
+              break;
+            }
+        }
+    }
+  else
+    {
+      glist_for_each_safe(glist, glistn, list)
+        {
+          found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
-#ifdef _USE_NLM
-      /* Skip locks owned by this NLM state.
-       * This protects NLM locks from the current iteration of an NLM
-       * client from being released by SM_NOTIFY.
-       */
-      if(pstate != NULL &&
-         lock_owner_is_nlm(found_entry) &&
-         found_entry->sle_state == pstate)
-        continue;
-#endif
+          if(!lock_entry_subtractable(found_entry, powner, pstate))
+            continue;
 
-      /*
-       * We have matched owner.
-       * Even though we are taking a reference to found_entry, we
-       * don't inc the ref count because we want to drop the lock entry.
-       */
-      rc |= subtract_lock_from_entry(pentry,
-                                     pcontext,
-                                     found_entry,
-                                     plock,
-                                     &split_lock_list,
-                                     &remove_list,
-                                     pstatus,
-                                     pclient);
-      if(*pstatus != STATE_SUCCESS)
-        {
-          /* We ran out of memory while splitting, deal with it outside loop */
-          break;
+          rc |= subtract_lock_from_entry(pentry,
+                                         pcontext,
+                                         found_entry,
+                                         plock,
+                                         &split_lock_list,
+                                         &remove_list,
+                                         pstatus,
+                                         pclient);
+          if(*pstatus != STATE_SUCCESS)
+            {
+              /* We ran out of memory while splitting, deal with it outside loop */
+              break;
+            }
         }
     }
 
@@ -944,7 +1103,10 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
         {
           found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
           glist_del(&found_entry->sle_list);
-          glist_add_tail(list, &(found_entry->sle_list));
+          if(indexed)
+            insert_lock_entry(found_entry);
+          else
+            glist_add_tail(list, &(found_entry->sle_list));
         }
     }
   else
@@ -953,6 +1115,10 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
       free_list(&remove_list, pclient);
 
       /* now add the split lock list */
+      if(indexed)
+        glist_for_each(glist, &split_lock_list)
+          index_lock_entry(glist_entry(glist, state_lock_entry_t, sle_list));
+
       glist_add_list_tail(list, &split_lock_list);
     }
 
@@ -963,33 +1129,40 @@ static bool_t subtract_lock_from_list(cache_entry_t        * pentry,
   return rc;
 }
 
+/* Subtract from target the locks of pentry overlapping plock */
 static state_status_t subtract_list_from_list(cache_entry_t        * pentry,
                                               fsal_op_context_t    * pcontext,
                                               struct glist_head    * target,
-                                              struct glist_head    * source,
+                                              fsal_lock_param_t    * plock,
                                               state_status_t       * pstatus,
                                               cache_inode_client_t * pclient)
 {
-  state_lock_entry_t *found_entry;
-  struct glist_head *glist, *glistn;
+  struct itree      * trees[2];
+  struct itree_node * node;
+  uint64_t            plock_end = lock_end(plock);
+  int                 i;
 
   *pstatus = STATE_SUCCESS;
 
-  glist_for_each_safe(glist, glistn, source)
-    {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+  trees[0] = &pentry->object.file.lock_granted_tree;
+  trees[1] = &pentry->object.file.lock_blocked_tree;
 
-      subtract_lock_from_list(pentry,
-                              pcontext,
-                              NULL,
-                              NULL,
-                              &found_entry->sle_lock,
-                              pstatus,
-                              target,
-                              pclient);
-      if(*pstatus != STATE_SUCCESS)
-        break;
-    }
+  for(i = 0; i < 2 && *pstatus == STATE_SUCCESS; i++)
+    for(node = itree_first_overlap(trees[i], plock->lock_start, plock_end);
+        node != NULL;
+        node = itree_next_overlap(node, plock->lock_start, plock_end))
+      {
+        subtract_lock_from_list(pentry,
+                                pcontext,
+                                NULL,
+                                NULL,
+                                &lock_tree_entry(node)->sle_lock,
+                                pstatus,
+                                target,
+                                pclient);
+        if(*pstatus != STATE_SUCCESS)
+          break;
+      }
 
   return *pstatus;
 }
@@ -1411,7 +1584,7 @@ void grant_blocked_lock_immediate(cache_entry_t         * pentry,
     }
 
   /* Mark lock as granted */
-  lock_entry->sle_blocked = STATE_NON_BLOCKING;
+  set_lock_blocked(lock_entry, STATE_NON_BLOCKING);
 
   /* Merge any touching or overlapping locks into this one. */
   LogEntry("Granted immediate, merging locks for", lock_entry);
@@ -1439,7 +1612,7 @@ void state_complete_grant(fsal_op_context_t     * pcontext,
   if(lock_entry->sle_blocked == STATE_GRANTING)
     {
       /* Mark lock as granted */
-      lock_entry->sle_blocked = STATE_NON_BLOCKING;
+      set_lock_blocked(lock_entry, STATE_NON_BLOCKING);
 
       /* Merge any touching or overlapping locks into this one. */
       LogEntry("Granted, merging locks for", lock_entry);
@@ -1478,7 +1651,7 @@ void try_to_grant_lock(state_lock_entry_t   * lock_entry,
        * reference to the lock entry if needed.
        */
       blocked = lock_entry->sle_blocked;
-      lock_entry->sle_blocked = STATE_GRANTING;
+      set_lock_blocked(lock_entry, STATE_GRANTING);
       if(lock_entry->sle_block_data->sbd_grant_type == STATE_GRANT_NONE)
         lock_entry->sle_block_data->sbd_grant_type = STATE_GRANT_INTERNAL;
 
@@ -1488,7 +1661,7 @@ void try_to_grant_lock(state_lock_entry_t   * lock_entry,
                    &status) == STATE_LOCK_BLOCKED)
         {
           /* The lock is still blocked, restore it's type and leave it in the list */
-          lock_entry->sle_blocked = blocked;
+          set_lock_blocked(lock_entry, blocked);
           return;
         }
 
@@ -1521,16 +1694,20 @@ static void grant_blocked_locks(cache_entry_t        * pentry,
                                 cache_inode_client_t * pclient)
 {
   state_lock_entry_t   * found_entry;
-  struct glist_head    * glist, * glistn;
+  struct itree_node    * node, * next;
   fsal_staticfsinfo_t  * pstatic = pcontext->export_context->fe_static_fs_info;
 
   /* If FSAL supports async blocking locks, allow it to grant blocked locks. */
   if(pstatic->lock_support_async_block)
     return;
 
-  glist_for_each_safe(glist, glistn, &pentry->object.file.lock_list)
+  /* Blocked locks are tried in range order */
+  for(node = itree_first(&pentry->object.file.lock_blocked_tree);
+      node != NULL;
+      node = next)
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      next = itree_next(node);
+      found_entry = lock_tree_entry(node);
 
       if(found_entry->sle_blocked != STATE_NLM_BLOCKING &&
          found_entry->sle_blocked != STATE_NFSV4_BLOCKING)
@@ -1558,7 +1735,7 @@ state_status_t cancel_blocked_lock(cache_entry_t        * pentry,
 
   /* Mark lock as canceled */
   LogEntry("Cancelling blocked", lock_entry);
-  lock_entry->sle_blocked = STATE_CANCELED;
+  set_lock_blocked(lock_entry, STATE_CANCELED);
 
       /* Unlocking the entire region will remove any FSAL locks we held, whether
        * from fully granted locks, or from blocking locks that were in the process
@@ -1649,42 +1826,48 @@ void cancel_blocked_locks_range(cache_entry_t        * pentry,
                                 fsal_lock_param_t    * plock,
                                 cache_inode_client_t * pclient)
 {
-  struct glist_head  * glist, * glistn;
+  struct itree       * trees[2];
+  struct itree_node  * node, * next;
   state_lock_entry_t * found_entry = NULL;
-  uint64_t             found_entry_end, plock_end = lock_end(plock);
+  uint64_t             plock_end = lock_end(plock);
+  int                  i;
 
-  glist_for_each_safe(glist, glistn, &pentry->object.file.lock_list)
-    {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+  /* Locks being granted are in the granted tree. Walk it last, because
+   * canceling moves its locks into the blocked tree.
+   */
+  trees[0] = &pentry->object.file.lock_blocked_tree;
+  trees[1] = &pentry->object.file.lock_granted_tree;
 
-      /* Skip locks not owned by owner */
-      if(powner != NULL && different_owners(found_entry->sle_owner, powner))
-        continue;
+  for(i = 0; i < 2; i++)
+    for(node = itree_first_overlap(trees[i], plock->lock_start, plock_end);
+        node != NULL;
+        node = next)
+      {
+        next = itree_next_overlap(node, plock->lock_start, plock_end);
+        found_entry = lock_tree_entry(node);
 
-      /* Skip locks owned by this NLM state.
-       * This protects NLM locks from the current iteration of an NLM
-       * client from being released by SM_NOTIFY.
-       */
-      if(pstate != NULL &&
-         lock_owner_is_nlm(found_entry) &&
-         found_entry->sle_state == pstate)
-        continue;
+        /* Skip locks not owned by owner */
+        if(powner != NULL && different_owners(found_entry->sle_owner, powner))
+          continue;
 
-      /* Skip granted locks */
-      if(found_entry->sle_blocked == STATE_NON_BLOCKING)
-        continue;
+        /* Skip locks owned by this NLM state.
+         * This protects NLM locks from the current iteration of an NLM
+         * client from being released by SM_NOTIFY.
+         */
+        if(pstate != NULL &&
+           lock_owner_is_nlm(found_entry) &&
+           found_entry->sle_state == pstate)
+          continue;
 
-      LogEntry("Checking", found_entry);
+        /* Skip granted locks */
+        if(found_entry->sle_blocked == STATE_NON_BLOCKING)
+          continue;
 
-      found_entry_end = lock_end(&found_entry->sle_lock);
+        LogEntry("Checking", found_entry);
 
-      if((found_entry_end >= plock->lock_start) &&
-         (found_entry->sle_lock.lock_start <= plock_end))
-        {
-          /* lock overlaps, cancel it. */
-          (void) cancel_blocked_lock(pentry, pcontext, found_entry, pclient);
-        }
-    }
+        /* lock overlaps, cancel it. */
+        (void) cancel_blocked_lock(pentry, pcontext, found_entry, pclient);
+      }
 }
 
 state_status_t state_release_grant(fsal_op_context_t     * pcontext,
@@ -1709,7 +1892,7 @@ state_status_t state_release_grant(fsal_op_context_t     * pcontext,
   if(lock_entry->sle_blocked == STATE_GRANTING)
     {
       /* Mark lock as canceled */
-      lock_entry->sle_blocked = STATE_CANCELED;
+      set_lock_blocked(lock_entry, STATE_CANCELED);
 
       /* Remove the lock from the lock list.
        * Will not free yet because of cookie reference to lock entry.
@@ -1768,6 +1951,19 @@ inline const char *fsal_lock_op_str(fsal_lock_op_t op)
   return "unknown";
 }
 
+/* The FSAL file of an fd kept by the cache, NULL if the file could not be opened */
+static fsal_file_t *state_lock_fsal_fd(cache_inode_opened_file_t * pfd)
+{
+  if(pfd == NULL)
+    return NULL;
+
+#ifdef _USE_MFSL
+  return &pfd->mfsl_fd.fsal_file;
+#else
+  return &pfd->fd;
+#endif
+}
+
 /**
  *
  * FSAL_unlock_no_owner: Handle FSAL unlock when owner is not supported.
@@ -1800,6 +1996,8 @@ state_status_t do_unlock_no_owner(cache_entry_t        * pentry,
   fsal_status_t        fsal_status;
   state_status_t       status = STATE_SUCCESS, t_status;
   fsal_lock_param_t  * punlock;
+  cache_inode_opened_file_t * pfd;
+  cache_inode_status_t cache_status;
 
   unlock_entry = create_state_lock_entry(pentry,
                                          pcontext,
@@ -1821,7 +2019,7 @@ state_status_t do_unlock_no_owner(cache_entry_t        * pentry,
   if(subtract_list_from_list(pentry,
                              pcontext,
                              &fsal_unlock_list,
-                             &pentry->object.file.lock_list,
+                             plock,
                              &status,
                              pclient) != STATE_SUCCESS)
     {
@@ -1834,6 +2032,9 @@ state_status_t do_unlock_no_owner(cache_entry_t        * pentry,
                state_err_str(status));
     }
 
+  /* The fd stays open while the FSAL unlocks */
+  pfd = cache_inode_fd_get(pentry, pclient, FSAL_O_RDWR, pcontext, &cache_status);
+
   glist_for_each_safe(glist, glistn, &fsal_unlock_list)
     {
       found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
@@ -1841,7 +2042,7 @@ state_status_t do_unlock_no_owner(cache_entry_t        * pentry,
 
       LogEntry("FSAL Unlock", found_entry);
 
-      fsal_status = FSAL_lock_op(cache_inode_fd(pentry),
+      fsal_status = FSAL_lock_op(state_lock_fsal_fd(pfd),
                                  &pentry->handle,
                                  pcontext,
                                  NULL,
@@ -1867,6 +2068,9 @@ state_status_t do_unlock_no_owner(cache_entry_t        * pentry,
       remove_from_locklist(found_entry, pclient);
     }
 
+  if(pfd != NULL)
+    cache_inode_fd_put(pfd, pclient);
+
   return status;
 }
 
@@ -1884,6 +2088,8 @@ state_status_t do_lock_op(cache_entry_t        * pentry,
   fsal_status_t         fsal_status;
   state_status_t        status = STATE_SUCCESS;
   fsal_lock_param_t     conflicting_lock;
+  cache_inode_opened_file_t * pfd;
+  cache_inode_status_t  cache_status;
   fsal_staticfsinfo_t * pstatic = pcontext->export_context->fe_static_fs_info;
 
   /* Quick exit if:
@@ -1909,7 +2115,12 @@ state_status_t do_lock_op(cache_entry_t        * pentry,
       if(lock_op == FSAL_OP_LOCKB && !pstatic->lock_support_async_block)
         lock_op = FSAL_OP_LOCK;
 
-      fsal_status = FSAL_lock_op(cache_inode_fd(pentry),
+      /* The fd stays open while the FSAL locks */
+      if((pfd = cache_inode_fd_get(pentry, pclient, FSAL_O_RDWR, pcontext,
+                                   &cache_status)) == NULL)
+        return cache_inode_status_to_state_status(cache_status);
+
+      fsal_status = FSAL_lock_op(state_lock_fsal_fd(pfd),
                                  &pentry->handle,
                                  pcontext,
                                  pstatic->lock_support_owner ? powner : NULL,
@@ -1917,6 +2128,8 @@ state_status_t do_lock_op(cache_entry_t        * pentry,
                                  *plock,
                                  &conflicting_lock);
 
+      cache_inode_fd_put(pfd, pclient);
+
       status = state_error_convert(fsal_status);
 
       LogFullDebug(COMPONENT_STATE,
@@ -2073,6 +2286,7 @@ state_status_t state_lock(cache_entry_t         * pentry,
 {
   bool_t                 allow = TRUE, overlap = FALSE;
   struct glist_head    * glist;
+  struct itree_node    * node;
   state_lock_entry_t   * found_entry;
   uint64_t               found_entry_end;
   uint64_t               plock_end = lock_end(plock);
@@ -2088,8 +2302,44 @@ state_status_t state_lock(cache_entry_t         * pentry,
       return *pstatus;
     }
 
-#ifdef _USE_BLOCKING_LOCKS
   P(pentry->object.file.lock_list_mutex);
+
+  /* Need to reject lock request if this lock owner already has a lock
+   * on this file via a different export. All the locks of an owner on a
+   * file come from the same export, so the first one found in the lock
+   * list of the owner tells.
+   */
+  found_entry = NULL;
+
+  P(powner->so_mutex);
+
+  glist_for_each(glist, &powner->so_lock_list)
+    {
+      found_entry = glist_entry(glist, state_lock_entry_t, sle_owner_locks);
+
+      if(found_entry->sle_pentry == pentry)
+        break;
+
+      found_entry = NULL;
+    }
+
+  V(powner->so_mutex);
+
+  if(found_entry != NULL && found_entry->sle_pexport != pexport)
+    {
+      V(pentry->object.file.lock_list_mutex);
+      LogEvent(COMPONENT_STATE,
+               "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+               found_entry->sle_pexport->id,
+               found_entry->sle_pexport->fullpath,
+               pexport->id,
+               pexport->fullpath);
+      LogEntry("Found lock entry belonging to another export", found_entry);
+      *pstatus = STATE_INVALID_ARGUMENT;
+      return *pstatus;
+    }
+
+#ifdef _USE_BLOCKING_LOCKS
   if(blocking != STATE_NON_BLOCKING)
     {
       /*
@@ -2097,30 +2347,16 @@ state_status_t state_lock(cache_entry_t         * pentry,
        * request and keep sending us new lock request again and again. So if
        * we have a mapping blocked request return that
        */
-      glist_for_each(glist, &pentry->object.file.lock_list)
+      for(node = itree_first_overlap(&pentry->object.file.lock_blocked_tree,
+                                     plock->lock_start, plock_end);
+          node != NULL;
+          node = itree_next_overlap(node, plock->lock_start, plock_end))
         {
-          found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+          found_entry = lock_tree_entry(node);
 
           if(different_owners(found_entry->sle_owner, powner))
             continue;
 
-          /* Need to reject lock request if this lock owner already has a lock
-           * on this file via a different export.
-           */
-          if(found_entry->sle_pexport != pexport)
-            {
-              V(pentry->object.file.lock_list_mutex);
-              LogEvent(COMPONENT_STATE,
-                       "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-                       found_entry->sle_pexport->id,
-                       found_entry->sle_pexport->fullpath,
-                       pexport->id,
-                       pexport->fullpath);
-              LogEntry("Found lock entry belonging to another export", found_entry);
-              *pstatus = STATE_INVALID_ARGUMENT;
-              return *pstatus;
-            }
-
           if(found_entry->sle_blocked != blocking)
             continue;
 
@@ -2139,59 +2375,34 @@ state_status_t state_lock(cache_entry_t         * pentry,
     }
 #endif
 
-  glist_for_each(glist, &pentry->object.file.lock_list)
+  for(node = itree_first_overlap(&pentry->object.file.lock_granted_tree,
+                                 plock->lock_start, plock_end);
+      node != NULL;
+      node = itree_next_overlap(node, plock->lock_start, plock_end))
     {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+      found_entry = lock_tree_entry(node);
 
-      /* Need to reject lock request if this lock owner already has a lock
-       * on this file via a different export.
+      /* lock overlaps see if we can allow
+       * allow if neither lock is exclusive or the owner is the same
        */
-      if(found_entry->sle_pexport != pexport &&
-         !different_owners(found_entry->sle_owner, powner))
+      if(locks_conflict(found_entry, powner, plock))
         {
-          V(pentry->object.file.lock_list_mutex);
-          LogEvent(COMPONENT_STATE,
-                   "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-                   found_entry->sle_pexport->id,
-                   found_entry->sle_pexport->fullpath,
-                   pexport->id,
-                   pexport->fullpath);
-          LogEntry("Found lock entry belonging to another export", found_entry);
-          *pstatus = STATE_INVALID_ARGUMENT;
-          return *pstatus;
+          /* Found a conflicting lock, break out of loop.
+           * Also indicate overlap hint.
+           */
+          LogEntry("Conflicts with", found_entry);
+          LogList("Locks", pentry, &pentry->object.file.lock_list);
+          copy_conflict(found_entry, holder, conflict);
+          allow   = FALSE;
+          overlap = TRUE;
+          break;
         }
 
-      /* Don't skip blocked locks for fairness */
-
       found_entry_end = lock_end(&found_entry->sle_lock);
 
-      if((found_entry_end >= plock->lock_start) &&
-         (found_entry->sle_lock.lock_start <= plock_end))
-        {
-          /* lock overlaps see if we can allow
-           * allow if neither lock is exclusive or the owner is the same
-           */
-          if((found_entry->sle_lock.lock_type == FSAL_LOCK_W ||
-              plock->lock_type == FSAL_LOCK_W) &&
-             different_owners(found_entry->sle_owner, powner))
-            {
-              /* Found a conflicting lock, break out of loop.
-               * Also indicate overlap hint.
-               */
-              LogEntry("Conflicts with", found_entry);
-              LogList("Locks", pentry, &pentry->object.file.lock_list);
-              copy_conflict(found_entry, holder, conflict);
-              allow   = FALSE;
-              overlap = TRUE;
-              break;
-            }
-        }
-
       if(found_entry_end >= plock_end &&
          found_entry->sle_lock.lock_start <= plock->lock_start &&
-         found_entry->sle_lock.lock_type == plock->lock_type &&
-         (found_entry->sle_blocked == STATE_NON_BLOCKING ||
-          found_entry->sle_blocked == STATE_GRANTING))
+         found_entry->sle_lock.lock_type == plock->lock_type)
         {
           /* Found an entry that entirely overlaps the new entry
            * (and due to the preceding test does not prevent
@@ -2200,10 +2411,10 @@ state_status_t state_lock(cache_entry_t         * pentry,
            */
           if(!different_owners(found_entry->sle_owner, powner))
             {
- #ifdef _USE_BLOCKING_LOCKS
-             /* The lock actually has the same owner, we're done,
-              * other than dealing with a lock in GRANTING state.
-              */
+#ifdef _USE_BLOCKING_LOCKS
+              /* The lock actually has the same owner, we're done,
+               * other than dealing with a lock in GRANTING state.
+               */
               if(found_entry->sle_blocked == STATE_GRANTING)
                 {
                   /* Need to handle completion of granting of this lock
@@ -2233,6 +2444,26 @@ state_status_t state_lock(cache_entry_t         * pentry,
         }
     }
 
+  /* Don't skip blocked locks for fairness */
+  if(allow)
+    for(node = itree_first_overlap(&pentry->object.file.lock_blocked_tree,
+                                   plock->lock_start, plock_end);
+        node != NULL;
+        node = itree_next_overlap(node, plock->lock_start, plock_end))
+      {
+        found_entry = lock_tree_entry(node);
+
+        if(locks_conflict(found_entry, powner, plock))
+          {
+            LogEntry("Conflicts with", found_entry);
+            LogList("Locks", pentry, &pentry->object.file.lock_list);
+            copy_conflict(found_entry, holder, conflict);
+            allow   = FALSE;
+            overlap = TRUE;
+            break;
+          }
+      }
+
   /* Decide how to proceed */
   if(pstatic->lock_support_async_block && blocking == STATE_NLM_BLOCKING)
     {
@@ -2348,7 +2579,7 @@ state_status_t state_lock(cache_entry_t         * pentry,
       /* Insert entry into lock list */
       LogEntry("New", found_entry);
 
-      glist_add_tail(&pentry->object.file.lock_list, &found_entry->sle_list);
+      insert_lock_entry(found_entry);
 
 #ifdef _USE_BLOCKING_LOCKS
       /* A lock downgrade could unblock blocked locks */
@@ -2373,7 +2604,7 @@ state_status_t state_lock(cache_entry_t         * pentry,
       /* Insert entry into lock list */
       LogEntry("FSAL block for", found_entry);
 
-      glist_add_tail(&pentry->object.file.lock_list, &found_entry->sle_list);
+      insert_lock_entry(found_entry);
 
       V(pentry->object.file.lock_list_mutex);
 
@@ -2523,34 +2754,43 @@ state_status_t state_cancel(cache_entry_t        * pentry,
                             cache_inode_client_t * pclient,
                             state_status_t       * pstatus)
 {
-  struct glist_head *glist;
-  state_lock_entry_t *found_entry;
+  struct itree       * trees[2];
+  struct itree_node  * node;
+  state_lock_entry_t * found_entry = NULL;
+  uint64_t             plock_end = lock_end(plock);
+  int                  i;
 
   *pstatus = STATE_NOT_FOUND;
 
   P(pentry->object.file.lock_list_mutex);
 
-  glist_for_each(glist, &pentry->object.file.lock_list)
-    {
-      found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+  /* The lock may be blocked or being granted */
+  trees[0] = &pentry->object.file.lock_blocked_tree;
+  trees[1] = &pentry->object.file.lock_granted_tree;
 
-      if(different_owners(found_entry->sle_owner, powner))
-        continue;
+  for(i = 0; i < 2 && found_entry == NULL; i++)
+    for(node = itree_first_overlap(trees[i], plock->lock_start, plock_end);
+        node != NULL;
+        node = itree_next_overlap(node, plock->lock_start, plock_end))
+      {
+        found_entry = lock_tree_entry(node);
 
-      /* Can not cancel a lock once it is granted */
-      if(found_entry->sle_blocked == STATE_NON_BLOCKING)
-        continue;
+        if(!different_owners(found_entry->sle_owner, powner) &&
+           /* Can not cancel a lock once it is granted */
+           found_entry->sle_blocked != STATE_NON_BLOCKING &&
+           !different_lock(&found_entry->sle_lock, plock))
+          break;
 
-      if(different_lock(&found_entry->sle_lock, plock))
-        continue;
+        found_entry = NULL;
+      }
 
+  if(found_entry != NULL)
+    {
       /* Cancel the blocked lock */
       *pstatus = cancel_blocked_lock(pentry, pcontext, found_entry, pclient);
 
       /* Check to see if we can grant any blocked locks. */
       grant_blocked_locks(pentry, pcontext, pclient);
-
-      break;
     }
 
   V(pentry->object.file.lock_list_mutex);
@@ -0,0 +1,446 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Runs the real delegation management of state_deleg.c over a file and a
+ * client of its own: the states of the file, the client records and the
+ * callbacks below it are fakes, the callbacks recorded instead of sent. The
+ * recall thread is played by calling state_deleg_recall_run in the test.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+
+/* These parameters are used throughout Ganesha code and must be initilized. */
+nfs_parameter_t nfs_param;
+
+#define TEST_CLIENTID 0x1234
+#define MAX_STATES    8
+#define LEASE         1
+
+static nfs_client_id_t client;
+static state_owner_t owner;
+static cache_entry_t entry;
+static exportlist_t export;
+static cache_inode_client_t cache_client;
+static char fh_val[] = "test file handle";
+
+/* The states of the file, found by their stateid */
+static state_t *states[MAX_STATES];
+static unsigned int next_other = 1;
+
+/* The callbacks the delegation management made */
+static int cb_answers = TRUE;
+static unsigned int nb_probe_sent;
+static unsigned int nb_recall_sent;
+static stateid4 recall_stateid;
+static char recall_fh[NFS4_FHSIZE];
+static u_int recall_fh_len;
+
+state_status_t state_add(cache_entry_t         * pentry,
+                         state_type_t            state_type,
+                         state_data_t          * pstate_data,
+                         state_owner_t         * powner_input,
+                         cache_inode_client_t  * pclient,
+                         fsal_op_context_t     * pcontext,
+                         state_t              ** ppstate,
+                         state_status_t        * pstatus)
+{
+  struct glist_head *glist;
+  state_t *pstate;
+  int i;
+
+  /* The conflicts of state_conflict which stop granting a delegation */
+  glist_for_each(glist, &pentry->object.file.state_list)
+    {
+      pstate = glist_entry(glist, state_t, state_list);
+      if((pstate->state_type == STATE_TYPE_SHARE &&
+          (pstate->state_data.share.share_access & OPEN4_SHARE_ACCESS_WRITE)) ||
+         (pstate->state_type == STATE_TYPE_DELEG &&
+          pstate->state_data.deleg.sd_recall_time != 0))
+        {
+          *pstatus = STATE_STATE_CONFLICT;
+          return *pstatus;
+        }
+    }
+
+  for(i = 0; i < MAX_STATES; i++)
+    if(states[i] == NULL)
+      break;
+
+  if(i == MAX_STATES || (pstate = (state_t *) Mem_Alloc(sizeof(state_t))) == NULL)
+    {
+      *pstatus = STATE_MALLOC_ERROR;
+      return *pstatus;
+    }
+
+  memset(pstate, 0, sizeof(state_t));
+  pstate->state_type = state_type;
+  pstate->state_data = *pstate_data;
+  pstate->state_powner = powner_input;
+  pstate->state_pentry = pentry;
+  memcpy(pstate->stateid_other, &next_other, sizeof(next_other));
+  next_other += 1;
+
+  glist_add_tail(&pentry->object.file.state_list, &pstate->state_list);
+  glist_add_tail(&powner_input->so_owner.so_nfs4_owner.so_state_list,
+                 &pstate->state_owner_list);
+  states[i] = pstate;
+
+  *ppstate = pstate;
+  *pstatus = STATE_SUCCESS;
+  return *pstatus;
+}
+
+state_status_t state_del(state_t              * pstate,
+                         cache_inode_client_t * pclient,
+                         state_status_t       * pstatus)
+{
+  int i;
+
+  for(i = 0; i < MAX_STATES; i++)
+    if(states[i] == pstate)
+      break;
+
+  if(i == MAX_STATES)
+    {
+      *pstatus = STATE_STATE_ERROR;
+      return *pstatus;
+    }
+
+  states[i] = NULL;
+
+  P_w(&pstate->state_pentry->lock);
+  glist_del(&pstate->state_owner_list);
+  glist_del(&pstate->state_list);
+  V_w(&pstate->state_pentry->lock);
+
+  P(pstate->state_pexport->exp_state_mutex);
+  glist_del(&pstate->state_export_list);
+  V(pstate->state_pexport->exp_state_mutex);
+
+  Mem_Free(pstate);
+
+  *pstatus = STATE_SUCCESS;
+  return *pstatus;
+}
+
+int nfs4_State_Get_Pointer(char other[OTHERSIZE], state_t ** ppstate)
+{
+  int i;
+
+  for(i = 0; i < MAX_STATES; i++)
+    if(states[i] != NULL && !memcmp(states[i]->stateid_other, other, OTHERSIZE))
+      {
+        *ppstate = states[i];
+        return 1;
+      }
+
+  return 0;
+}
+
+void inc_state_owner_ref(state_owner_t * powner)
+{
+}
+
+void dec_state_owner_ref(state_owner_t * powner, cache_inode_client_t * pclient)
+{
+}
+
+const char *state_err_str(state_status_t err)
+{
+  return "STATE_ERROR";
+}
+
+int nfs_client_id_get(clientid4 clientid, nfs_client_id_t * client_id_res)
+{
+  if(clientid != client.clientid)
+    return CLIENT_ID_NOT_FOUND;
+
+  *client_id_res = client;
+  return CLIENT_ID_SUCCESS;
+}
+
+int nfs_client_id_Get_Pointer(clientid4 clientid, nfs_client_id_t ** ppclient_id_res)
+{
+  if(clientid != client.clientid)
+    return CLIENT_ID_NOT_FOUND;
+
+  *ppclient_id_res = &client;
+  return CLIENT_ID_SUCCESS;
+}
+
+int nfs4_cb_probe(nfs_client_id_t * pclientid)
+{
+  nb_probe_sent += 1;
+  return cb_answers;
+}
+
+int nfs4_cb_send_recall(nfs_client_id_t * pclientid, stateid4 * pstateid, nfs_fh4 * pfh)
+{
+  nb_recall_sent += 1;
+  recall_stateid = *pstateid;
+  recall_fh_len = pfh->nfs_fh4_len;
+  memcpy(recall_fh, pfh->nfs_fh4_val, pfh->nfs_fh4_len);
+  return cb_answers;
+}
+
+void nfs4_cb_forget(clientid4 clientid)
+{
+}
+
+void nfs4_cb_close_idle(time_t max_idle)
+{
+}
+
+cache_entry_t *cache_inode_lookup(cache_entry_t * pentry_parent,
+                                  fsal_name_t * pname,
+                                  cache_inode_policy_t policy,
+                                  fsal_attrib_list_t * pattr,
+                                  hash_table_t * ht,
+                                  cache_inode_client_t * pclient,
+                                  fsal_op_context_t * pcontext,
+                                  cache_inode_status_t * pstatus)
+{
+  *pstatus = CACHE_INODE_NOT_FOUND;
+  return NULL;
+}
+
+static void check(int cond, const char *what)
+{
+  if(!cond)
+    {
+      LogTest("Test FAILED: %s", what);
+      exit(1);
+    }
+}
+
+static void check_stats(unsigned int nb_held, unsigned int nb_recalling,
+                        unsigned long long nb_revoked, const char *what)
+{
+  state_deleg_stat_t stats;
+
+  state_deleg_get_stats(&stats);
+  if(stats.nb_held != nb_held || stats.nb_recalling != nb_recalling ||
+     stats.nb_revoked != nb_revoked)
+    {
+      LogTest("Test FAILED: %s: %u held, %u recalling, %llu revoked, expected %u, %u, %llu",
+              what, stats.nb_held, stats.nb_recalling, stats.nb_revoked,
+              nb_held, nb_recalling, nb_revoked);
+      exit(1);
+    }
+}
+
+static int grant(state_t ** ppstate)
+{
+  nfs_fh4 fh;
+
+  fh.nfs_fh4_len = sizeof(fh_val);
+  fh.nfs_fh4_val = fh_val;
+
+  return state_deleg_grant(&entry, &client, &export, &fh, &cache_client, NULL, ppstate);
+}
+
+/* The delegation is granted only to a client whose callback answered, once */
+static void test_grant(void)
+{
+  state_status_t state_status;
+  state_t *pstate, *pstate2;
+
+  nfs_param.nfsv4_param.use_delegations = FALSE;
+  client.cb_path = CB_PATH_UP;
+  check(!grant(&pstate), "delegation granted with delegations disabled");
+
+  nfs_param.nfsv4_param.use_delegations = TRUE;
+  client.cb_path = CB_PATH_DOWN;
+  check(!grant(&pstate), "delegation granted to a client without callback");
+
+  /* The callback is probed by the recall thread */
+  state_deleg_probe(client.clientid);
+  state_deleg_recall_run(&cache_client, 0);
+  check(nb_probe_sent == 1, "CB_NULL not sent");
+  check(client.cb_path == CB_PATH_UP, "callback not up after CB_NULL answered");
+
+  check(grant(&pstate), "delegation not granted");
+  check(pstate->state_type == STATE_TYPE_DELEG &&
+        pstate->state_data.deleg.sd_type == OPEN_DELEGATE_READ,
+        "not a read delegation");
+  check(!glist_empty(&export.exp_state_list), "delegation not on its export");
+  check(!grant(&pstate2), "second delegation granted to the same client");
+  check_stats(1, 0, 0, "grant");
+
+  check(state_deleg_return(pstate->stateid_other, &cache_client,
+                           &state_status) == STATE_SUCCESS, "DELEGRETURN failed");
+  check(glist_empty(&entry.object.file.state_list), "delegation not deleted");
+  check(glist_empty(&export.exp_state_list), "delegation still on its export");
+  check_stats(0, 0, 0, "return");
+
+  LogTest("Delegation granted OK");
+}
+
+/* An OPEN for write recalls the delegation, the recall thread sends CB_RECALL */
+static void test_recall(void)
+{
+  state_status_t state_status;
+  state_t *pstate, *pstate2;
+  unsigned int sent = nb_recall_sent;
+
+  check(grant(&pstate), "delegation not granted");
+  pstate->state_seqid = 3;
+
+  check(!state_deleg_open_conflict(&entry, OPEN4_SHARE_ACCESS_READ, OPEN4_SHARE_DENY_NONE),
+        "OPEN for read recalled the delegation");
+  check(state_deleg_open_conflict(&entry, OPEN4_SHARE_ACCESS_WRITE, OPEN4_SHARE_DENY_NONE),
+        "OPEN for write did not conflict");
+  check(pstate->state_data.deleg.sd_recall_time != 0, "delegation not marked recalled");
+  check(nb_recall_sent == sent, "CB_RECALL sent by the operation");
+
+  /* No new delegation while the file is being recalled */
+  check(!grant(&pstate2), "delegation granted during a recall");
+  check(nfs4_State_Get_Pointer(pstate->stateid_other, &pstate2), "delegation lost");
+
+  /* Recalled once, while it is not returned */
+  check(state_deleg_open_conflict(&entry, OPEN4_SHARE_ACCESS_WRITE, OPEN4_SHARE_DENY_NONE),
+        "second OPEN for write did not conflict");
+
+  state_deleg_recall_run(&cache_client, 0);
+  check(nb_recall_sent == sent + 1, "CB_RECALL not sent once");
+  check(recall_stateid.seqid == 3 &&
+        !memcmp(recall_stateid.other, pstate->stateid_other, OTHERSIZE),
+        "CB_RECALL sent with a wrong stateid");
+  check(recall_fh_len == sizeof(fh_val) && !memcmp(recall_fh, fh_val, sizeof(fh_val)),
+        "CB_RECALL sent with a wrong file handle");
+  check_stats(1, 1, 0, "recall");
+
+  check(state_deleg_return(pstate->stateid_other, &cache_client,
+                           &state_status) == STATE_SUCCESS, "DELEGRETURN failed");
+  check(!state_deleg_conflict(&entry), "conflict after DELEGRETURN");
+
+  /* The next run forgets the recall returned */
+  state_deleg_recall_run(&cache_client, 0);
+  check_stats(0, 0, 0, "return after recall");
+
+  LogTest("Delegation recalled OK");
+}
+
+/* A delegation not returned within a lease of its CB_RECALL is revoked */
+static void test_revoke(void)
+{
+  state_t *pstate;
+  unsigned int sent = nb_recall_sent;
+
+  check(grant(&pstate), "delegation not granted");
+  check(state_deleg_conflict(&entry), "no conflict");
+
+  /* Queued for longer than a lease: the clock starts when it is sent */
+  sleep(LEASE + 1);
+  state_deleg_recall_run(&cache_client, 0);
+  check(nb_recall_sent == sent + 1, "CB_RECALL not sent");
+  check_stats(1, 1, 0, "revoked before its CB_RECALL was sent");
+
+  sleep(LEASE + 1);
+  state_deleg_recall_run(&cache_client, 0);
+  check(glist_empty(&entry.object.file.state_list), "delegation not deleted");
+  check(glist_empty(&owner.so_owner.so_nfs4_owner.so_state_list),
+        "delegation still owned");
+  check_stats(0, 0, 1, "revoke");
+
+  LogTest("Delegation revoked OK");
+}
+
+/* A client which does not answer CB_RECALL gets no more delegations */
+static void test_cb_failed(void)
+{
+  state_deleg_stat_t stats;
+  state_t *pstate;
+
+  check(grant(&pstate), "delegation not granted");
+  check(state_deleg_conflict(&entry), "no conflict");
+
+  cb_answers = FALSE;
+  state_deleg_recall_run(&cache_client, 0);
+  state_deleg_get_stats(&stats);
+  check(stats.nb_cb_failed == 1, "failed CB_RECALL not counted");
+  check(client.cb_path == CB_PATH_DOWN, "callback still up after CB_RECALL failed");
+
+  /* Still revoked a lease later, or released with the client */
+  state_deleg_release(&owner, &cache_client);
+  check(glist_empty(&entry.object.file.state_list), "delegation not released");
+  check(!grant(&pstate), "delegation granted to a client without callback");
+
+  sleep(LEASE + 1);
+  state_deleg_recall_run(&cache_client, 0);
+  check_stats(0, 0, 2, "release");
+
+  LogTest("Failed callback OK");
+}
+
+int main(int argc, char *argv[])
+{
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_state_deleg");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Memory manager could not be initialized");
+      exit(1);
+    }
+#endif
+
+  nfs_param.nfsv4_param.lease_lifetime = LEASE;
+
+  memset(&owner, 0, sizeof(owner));
+  owner.so_owner.so_nfs4_owner.so_clientid = TEST_CLIENTID;
+  init_glist(&owner.so_owner.so_nfs4_owner.so_state_list);
+
+  memset(&client, 0, sizeof(client));
+  client.clientid = TEST_CLIENTID;
+  client.clientid_owner = &owner;
+  strcpy(client.client_name, "test");
+  pthread_mutex_init(&client.clientid_mutex, NULL);
+
+  memset(&entry, 0, sizeof(entry));
+  entry.internal_md.type = REGULAR_FILE;
+  rw_lock_init(&entry.lock);
+  init_glist(&entry.object.file.state_list);
+
+  memset(&export, 0, sizeof(export));
+  pthread_mutex_init(&export.exp_state_mutex, NULL);
+  init_glist(&export.exp_state_list);
+
+  test_grant();
+  test_recall();
+  test_revoke();
+  test_cb_failed();
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
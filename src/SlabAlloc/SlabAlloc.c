@@ -0,0 +1,952 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    SlabAlloc.c
+ * \brief   Slab allocator with per-CPU magazines and a depot.
+ *
+ * SlabAlloc.c: the memory is managed by slab caches, one per size class
+ * for Mem_Alloc and one per type of pooled entries for GetFromPool. A
+ * cache has three layers:
+ *
+ * - per-CPU magazines: each CPU has a loaded and a previous magazine,
+ *   small stacks of free objects, under a lock only contended by the
+ *   threads running on that CPU. Most allocations and frees stop there,
+ *   whichever thread allocated the object.
+ * - the depot: the full and empty magazines exchanged by the CPUs when
+ *   both of theirs are empty (allocation) or full (free).
+ * - the slabs: areas mapped from the system, carved into objects. They
+ *   fill the magazines when the depot has no full one, and are given back
+ *   to the system when no object of theirs is in use any more.
+ *
+ * Every object is preceded by a header telling its slab, so that it can
+ * be freed without knowing its size or its cache.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "SlabAlloc.h"
+#include "log.h"
+#include "common_utils.h"
+
+#define SLAB_ALIGN           16
+#define SLAB_MIN_SIZE        (64 * 1024)
+#define SLAB_MIN_OBJECTS     8
+#define SLAB_MAGAZINE_SIZE   32
+#define SLAB_KEEP_EMPTY      1  /* empty slabs a cache keeps between two reclaims */
+#define SLAB_CACHE_LINE      64
+
+#define SLAB_ROUNDUP(n, a)   (((n) + (a) - 1) & ~((size_t) (a) - 1))
+
+/* Header of every object: its slab, NULL if it was got from malloc */
+typedef struct slab_obj_header__
+{
+  struct slab__ *oh_slab;
+  union
+  {
+    size_t oh_size;                     /* size asked, for malloc'ed objects */
+    struct slab_obj_header__ *oh_next;  /* next free object in the slab */
+  } u;
+} slab_obj_header_t;
+
+#define SLAB_HEADER_SIZE     SLAB_ROUNDUP(sizeof(slab_obj_header_t), SLAB_ALIGN)
+#define slab_header(ptr)     ((slab_obj_header_t *) ((char *)(ptr) - SLAB_HEADER_SIZE))
+#define slab_object(hdr)     ((void *) ((char *)(hdr) + SLAB_HEADER_SIZE))
+
+typedef enum slab_list__
+{
+  SLAB_LIST_FULL,
+  SLAB_LIST_PARTIAL,
+  SLAB_LIST_EMPTY
+} slab_list_t;
+
+typedef struct slab__
+{
+  slab_cache_t *s_cache;
+  struct slab__ *s_next;
+  struct slab__ *s_prev;
+  slab_obj_header_t *s_free;            /* free objects */
+  unsigned int s_nb_used;
+  slab_list_t s_list;                   /* list of the cache the slab is in */
+} slab_t;
+
+#define SLAB_FIRST_OBJECT    SLAB_ROUNDUP(sizeof(slab_t), SLAB_ALIGN)
+
+typedef struct slab_magazine__
+{
+  struct slab_magazine__ *m_next;
+  unsigned int m_rounds;                /* objects in the magazine */
+  void *m_objs[SLAB_MAGAZINE_SIZE];
+} slab_magazine_t;
+
+typedef struct slab_cpu__
+{
+  pthread_mutex_t c_mutex;
+  slab_magazine_t *c_loaded;
+  slab_magazine_t *c_previous;
+  unsigned long long c_nb_alloc;
+  unsigned long long c_nb_free;
+} __attribute__ ((aligned(SLAB_CACHE_LINE))) slab_cpu_t;
+
+struct slab_cache__
+{
+  char sc_name[SLAB_NAME_LEN];
+  size_t sc_size;                       /* size of the objects asked */
+  size_t sc_obj_size;                   /* with their header */
+  size_t sc_slab_size;
+  unsigned int sc_nb_per_slab;
+  unsigned int sc_mag_rounds;           /* objects in a full magazine */
+  slab_constructor_t sc_ctor;
+  slab_cpu_t *sc_cpus;
+
+  /* The depot */
+  pthread_mutex_t sc_depot_mutex;
+  slab_magazine_t *sc_full;
+  slab_magazine_t *sc_empty;
+  unsigned int sc_nb_full;
+  unsigned int sc_min_full;             /* fewest full magazines since the last reclaim */
+
+  /* The slabs */
+  pthread_mutex_t sc_mutex;
+  slab_t *sc_partial;
+  slab_t *sc_empty_slabs;
+  unsigned int sc_nb_slabs;
+  unsigned int sc_nb_empty_slabs;
+  unsigned int sc_wm_nb_slabs;
+  unsigned long long sc_nb_slabs_released;
+
+  slab_cache_t *sc_next;
+};
+
+#define SLAB_NB_CLASSES      40
+
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
+static unsigned int slab_nb_cpus = 1;
+
+static slab_cache_t *slab_classes[SLAB_NB_CLASSES];
+static unsigned char slab_class_index[SLAB_MAX_SMALL_SIZE / SLAB_ALIGN + 1];
+
+/* All of the caches, classes first, then the pools in their creation order */
+static pthread_mutex_t slab_caches_mutex = PTHREAD_MUTEX_INITIALIZER;
+static slab_cache_t *slab_caches = NULL;
+static slab_cache_t *slab_caches_tail = NULL;
+
+/* Objects larger than SLAB_MAX_SMALL_SIZE */
+static size_t slab_large_space = 0;
+static unsigned long long slab_nb_large_alloc = 0;
+static unsigned long long slab_nb_large_free = 0;
+
+static void slab_list_add(slab_t ** phead, slab_t * pslab, slab_list_t list)
+{
+  pslab->s_prev = NULL;
+  pslab->s_next = *phead;
+  if(*phead != NULL)
+    (*phead)->s_prev = pslab;
+  *phead = pslab;
+  pslab->s_list = list;
+}
+
+static void slab_list_del(slab_t ** phead, slab_t * pslab)
+{
+  if(pslab->s_prev != NULL)
+    pslab->s_prev->s_next = pslab->s_next;
+  else
+    *phead = pslab->s_next;
+  if(pslab->s_next != NULL)
+    pslab->s_next->s_prev = pslab->s_prev;
+  pslab->s_list = SLAB_LIST_FULL;
+}
+
+/**
+ * slab_cache_init: creates a cache and adds it to the list of the caches.
+ * Must be called with slab_caches_mutex held.
+ */
+static slab_cache_t *slab_cache_init(const char *name, size_t size,
+                                     slab_constructor_t ctor)
+{
+  slab_cache_t *cache;
+  void *cpus;
+  unsigned int i;
+
+  if((cache = (slab_cache_t *) calloc(1, sizeof(slab_cache_t))) == NULL)
+    return NULL;
+
+  if(posix_memalign(&cpus, SLAB_CACHE_LINE, slab_nb_cpus * sizeof(slab_cpu_t)) != 0)
+    {
+      free(cache);
+      return NULL;
+    }
+  memset(cpus, 0, slab_nb_cpus * sizeof(slab_cpu_t));
+  cache->sc_cpus = (slab_cpu_t *) cpus;
+  for(i = 0; i < slab_nb_cpus; i++)
+    pthread_mutex_init(&cache->sc_cpus[i].c_mutex, NULL);
+
+  strncpy(cache->sc_name, name, SLAB_NAME_LEN - 1);
+  cache->sc_size = size;
+  cache->sc_obj_size = SLAB_HEADER_SIZE + SLAB_ROUNDUP(size, SLAB_ALIGN);
+  cache->sc_ctor = ctor;
+
+  cache->sc_slab_size = SLAB_MIN_SIZE;
+  while((cache->sc_slab_size - SLAB_FIRST_OBJECT) / cache->sc_obj_size < SLAB_MIN_OBJECTS)
+    cache->sc_slab_size *= 2;
+  cache->sc_nb_per_slab = (cache->sc_slab_size - SLAB_FIRST_OBJECT) / cache->sc_obj_size;
+
+  /* The CPUs keep fewer large objects */
+  if(size <= 1024)
+    cache->sc_mag_rounds = SLAB_MAGAZINE_SIZE;
+  else if(size <= 8192)
+    cache->sc_mag_rounds = SLAB_MAGAZINE_SIZE / 4;
+  else
+    cache->sc_mag_rounds = SLAB_MAGAZINE_SIZE / 8;
+
+  pthread_mutex_init(&cache->sc_depot_mutex, NULL);
+  pthread_mutex_init(&cache->sc_mutex, NULL);
+
+  if(slab_caches_tail == NULL)
+    slab_caches = cache;
+  else
+    slab_caches_tail->sc_next = cache;
+  slab_caches_tail = cache;
+
+  return cache;
+}                               /* slab_cache_init */
+
+static void slab_init(void)
+{
+  long nb_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  char name[SLAB_NAME_LEN];
+  size_t size, prev_size, i;
+  unsigned int c = 0;
+
+  if(nb_cpus > 0)
+    slab_nb_cpus = (unsigned int)nb_cpus;
+
+  /* 16 bytes steps up to 128, then 4 classes per power of 2 */
+  P(slab_caches_mutex);
+  for(size = SLAB_ALIGN, prev_size = 0; size <= SLAB_MAX_SMALL_SIZE && c < SLAB_NB_CLASSES;)
+    {
+      snprintf(name, SLAB_NAME_LEN, "size-%llu", (unsigned long long)size);
+      if((slab_classes[c] = slab_cache_init(name, size, NULL)) == NULL)
+        LogFatal(COMPONENT_MEMALLOC, "SlabAlloc: could not create the cache %s", name);
+
+      for(i = prev_size / SLAB_ALIGN + 1; i <= size / SLAB_ALIGN; i++)
+        slab_class_index[i] = c;
+
+      prev_size = size;
+      c++;
+
+      if(size < 128)
+        size += SLAB_ALIGN;
+      else
+        {
+          size_t pow2 = 128;
+
+          while(pow2 * 2 <= size)
+            pow2 *= 2;
+          size += pow2 / 4;
+        }
+    }
+  V(slab_caches_mutex);
+
+  slab_class_index[0] = 0;
+}                               /* slab_init */
+
+static inline slab_cpu_t *slab_get_cpu(slab_cache_t * cache)
+{
+  int cpu = sched_getcpu();
+
+  if(cpu < 0)
+    cpu = (int)(((unsigned long)pthread_self() >> 8) & 0xFFFF);
+
+  return &cache->sc_cpus[cpu % slab_nb_cpus];
+}                               /* slab_get_cpu */
+
+/**
+ * slab_new: maps a slab and carves it into free objects, constructed.
+ */
+static slab_t *slab_new(slab_cache_t * cache)
+{
+  slab_t *pslab;
+  slab_obj_header_t *phdr;
+  char *pobj;
+  unsigned int i;
+
+  pslab = (slab_t *) mmap(NULL, cache->sc_slab_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(pslab == MAP_FAILED)
+    {
+      LogMajor(COMPONENT_MEMALLOC,
+               "SlabAlloc: could not map a slab of %llu bytes for %s, errno=%d",
+               (unsigned long long)cache->sc_slab_size, cache->sc_name, errno);
+      return NULL;
+    }
+
+  pslab->s_cache = cache;
+  pslab->s_free = NULL;
+  pslab->s_nb_used = 0;
+
+  /* Chained from the last, so that they are handed out in address order */
+  pobj = (char *)pslab + SLAB_FIRST_OBJECT + cache->sc_nb_per_slab * cache->sc_obj_size;
+  for(i = 0; i < cache->sc_nb_per_slab; i++)
+    {
+      pobj -= cache->sc_obj_size;
+      phdr = (slab_obj_header_t *) pobj;
+      phdr->oh_slab = pslab;
+      phdr->u.oh_next = pslab->s_free;
+      pslab->s_free = phdr;
+
+      if(cache->sc_ctor != NULL)
+        cache->sc_ctor(slab_object(phdr));
+    }
+
+  return pslab;
+}                               /* slab_new */
+
+/**
+ * slab_release: gives back to the system the empty slabs of a cache
+ * beyond the keep first ones. Must be called with the cache's sc_mutex held,
+ * returns the slabs to be unmapped once it is released.
+ */
+static slab_t *slab_release(slab_cache_t * cache, unsigned int keep)
+{
+  slab_t *released = NULL;
+  slab_t *pslab;
+
+  /* The state of constructed objects would be lost */
+  if(cache->sc_ctor != NULL)
+    return NULL;
+
+  while(cache->sc_nb_empty_slabs > keep)
+    {
+      pslab = cache->sc_empty_slabs;
+      slab_list_del(&cache->sc_empty_slabs, pslab);
+      cache->sc_nb_empty_slabs -= 1;
+      cache->sc_nb_slabs -= 1;
+      cache->sc_nb_slabs_released += 1;
+
+      pslab->s_next = released;
+      released = pslab;
+    }
+
+  return released;
+}                               /* slab_release */
+
+static void slab_unmap(slab_cache_t * cache, slab_t * released)
+{
+  slab_t *pslab;
+
+  while(released != NULL)
+    {
+      pslab = released;
+      released = released->s_next;
+      munmap(pslab, cache->sc_slab_size);
+    }
+}                               /* slab_unmap */
+
+/**
+ * slab_get_objects: takes up to nb free objects from the slabs of a cache,
+ * mapping new slabs if needed.
+ *
+ * @return the number of objects taken, 0 if no memory is available.
+ */
+static unsigned int slab_get_objects(slab_cache_t * cache, void **objs, unsigned int nb)
+{
+  slab_t *pslab;
+  slab_obj_header_t *phdr;
+  unsigned int got = 0;
+
+  P(cache->sc_mutex);
+  while(got < nb)
+    {
+      if((pslab = cache->sc_partial) == NULL)
+        {
+          if((pslab = cache->sc_empty_slabs) != NULL)
+            {
+              slab_list_del(&cache->sc_empty_slabs, pslab);
+              cache->sc_nb_empty_slabs -= 1;
+            }
+          else
+            {
+              /* The constructors may allocate */
+              V(cache->sc_mutex);
+              pslab = slab_new(cache);
+              P(cache->sc_mutex);
+
+              if(pslab == NULL)
+                break;
+
+              cache->sc_nb_slabs += 1;
+              if(cache->sc_nb_slabs > cache->sc_wm_nb_slabs)
+                cache->sc_wm_nb_slabs = cache->sc_nb_slabs;
+            }
+          slab_list_add(&cache->sc_partial, pslab, SLAB_LIST_PARTIAL);
+        }
+
+      while(got < nb && pslab->s_free != NULL)
+        {
+          phdr = pslab->s_free;
+          pslab->s_free = phdr->u.oh_next;
+          pslab->s_nb_used += 1;
+          objs[got++] = slab_object(phdr);
+        }
+
+      if(pslab->s_free == NULL)
+        slab_list_del(&cache->sc_partial, pslab);
+    }
+  V(cache->sc_mutex);
+
+  return got;
+}                               /* slab_get_objects */
+
+/**
+ * slab_put_objects: gives objects back to their slabs.
+ */
+static void slab_put_objects(slab_cache_t * cache, void **objs, unsigned int nb)
+{
+  slab_t *pslab;
+  slab_t *released;
+  slab_obj_header_t *phdr;
+  unsigned int i;
+
+  P(cache->sc_mutex);
+  for(i = 0; i < nb; i++)
+    {
+      phdr = slab_header(objs[i]);
+      pslab = phdr->oh_slab;
+
+      phdr->u.oh_next = pslab->s_free;
+      pslab->s_free = phdr;
+      pslab->s_nb_used -= 1;
+
+      if(pslab->s_nb_used == 0)
+        {
+          if(pslab->s_list == SLAB_LIST_PARTIAL)
+            slab_list_del(&cache->sc_partial, pslab);
+          slab_list_add(&cache->sc_empty_slabs, pslab, SLAB_LIST_EMPTY);
+          cache->sc_nb_empty_slabs += 1;
+        }
+      else if(pslab->s_list == SLAB_LIST_FULL)
+        slab_list_add(&cache->sc_partial, pslab, SLAB_LIST_PARTIAL);
+    }
+  released = slab_release(cache, SLAB_KEEP_EMPTY);
+  V(cache->sc_mutex);
+
+  slab_unmap(cache, released);
+}                               /* slab_put_objects */
+
+static slab_magazine_t *slab_magazine_new(void)
+{
+  slab_magazine_t *mag;
+
+  if((mag = (slab_magazine_t *) malloc(sizeof(slab_magazine_t))) != NULL)
+    {
+      mag->m_next = NULL;
+      mag->m_rounds = 0;
+    }
+
+  return mag;
+}                               /* slab_magazine_new */
+
+/**
+ * slab_cpu_ready: gives its magazines to a CPU the first time it is used.
+ * Must be called with the CPU's mutex held.
+ */
+static int slab_cpu_ready(slab_cpu_t * pcpu)
+{
+  if(pcpu->c_previous != NULL)
+    return TRUE;
+
+  if(pcpu->c_loaded == NULL && (pcpu->c_loaded = slab_magazine_new()) == NULL)
+    return FALSE;
+
+  return (pcpu->c_previous = slab_magazine_new()) != NULL;
+}                               /* slab_cpu_ready */
+
+/**
+ *
+ * SlabCacheAlloc: allocates an object of a cache.
+ *
+ * @param cache [IN] the cache.
+ *
+ * @return the object, NULL with errno set to ENOMEM if no memory is available.
+ *
+ */
+void *SlabCacheAlloc(slab_cache_t * cache)
+{
+  slab_cpu_t *pcpu = slab_get_cpu(cache);
+  slab_magazine_t *mag;
+  void *obj;
+
+  P(pcpu->c_mutex);
+
+  if(!slab_cpu_ready(pcpu))
+    {
+      V(pcpu->c_mutex);
+      if(slab_get_objects(cache, &obj, 1) == 0)
+        {
+          errno = ENOMEM;
+          return NULL;
+        }
+      P(pcpu->c_mutex);
+      pcpu->c_nb_alloc += 1;
+      V(pcpu->c_mutex);
+      return obj;
+    }
+
+  while(pcpu->c_loaded->m_rounds == 0)
+    {
+      /* The previous magazine may still have objects */
+      if(pcpu->c_previous->m_rounds > 0)
+        {
+          mag = pcpu->c_loaded;
+          pcpu->c_loaded = pcpu->c_previous;
+          pcpu->c_previous = mag;
+          break;
+        }
+
+      /* Both are empty: exchange the previous one for a full one of the depot */
+      P(cache->sc_depot_mutex);
+      if((mag = cache->sc_full) != NULL)
+        {
+          cache->sc_full = mag->m_next;
+          cache->sc_nb_full -= 1;
+          if(cache->sc_nb_full < cache->sc_min_full)
+            cache->sc_min_full = cache->sc_nb_full;
+
+          pcpu->c_previous->m_next = cache->sc_empty;
+          cache->sc_empty = pcpu->c_previous;
+          V(cache->sc_depot_mutex);
+
+          pcpu->c_previous = pcpu->c_loaded;
+          pcpu->c_loaded = mag;
+          break;
+        }
+      V(cache->sc_depot_mutex);
+
+      /* The depot has none either: fill the loaded one from the slabs */
+      pcpu->c_loaded->m_rounds =
+          slab_get_objects(cache, pcpu->c_loaded->m_objs, cache->sc_mag_rounds);
+      if(pcpu->c_loaded->m_rounds == 0)
+        {
+          V(pcpu->c_mutex);
+          errno = ENOMEM;
+          return NULL;
+        }
+    }
+
+  mag = pcpu->c_loaded;
+  obj = mag->m_objs[--mag->m_rounds];
+  pcpu->c_nb_alloc += 1;
+
+  V(pcpu->c_mutex);
+
+  return obj;
+}                               /* SlabCacheAlloc */
+
+/**
+ *
+ * SlabCacheFree: frees an object of a cache.
+ *
+ * @param cache [IN] the cache the object was allocated from.
+ * @param ptr   [IN] the object.
+ *
+ * @return nothing (void function)
+ *
+ */
+void SlabCacheFree(slab_cache_t * cache, void *ptr)
+{
+  slab_cpu_t *pcpu = slab_get_cpu(cache);
+  slab_magazine_t *mag;
+
+  P(pcpu->c_mutex);
+  pcpu->c_nb_free += 1;
+
+  if(!slab_cpu_ready(pcpu))
+    {
+      V(pcpu->c_mutex);
+      slab_put_objects(cache, &ptr, 1);
+      return;
+    }
+
+  while(pcpu->c_loaded->m_rounds == cache->sc_mag_rounds)
+    {
+      /* The previous magazine may still have room */
+      if(pcpu->c_previous->m_rounds < cache->sc_mag_rounds)
+        {
+          mag = pcpu->c_loaded;
+          pcpu->c_loaded = pcpu->c_previous;
+          pcpu->c_previous = mag;
+          break;
+        }
+
+      /* Both are full: give the previous one to the depot for an empty one */
+      P(cache->sc_depot_mutex);
+      if((mag = cache->sc_empty) != NULL)
+        cache->sc_empty = mag->m_next;
+      V(cache->sc_depot_mutex);
+
+      if(mag == NULL && (mag = slab_magazine_new()) == NULL)
+        {
+          V(pcpu->c_mutex);
+          slab_put_objects(cache, &ptr, 1);
+          return;
+        }
+      mag->m_rounds = 0;
+
+      P(cache->sc_depot_mutex);
+      pcpu->c_previous->m_next = cache->sc_full;
+      cache->sc_full = pcpu->c_previous;
+      cache->sc_nb_full += 1;
+      V(cache->sc_depot_mutex);
+
+      pcpu->c_previous = pcpu->c_loaded;
+      pcpu->c_loaded = mag;
+      break;
+    }
+
+  mag = pcpu->c_loaded;
+  mag->m_objs[mag->m_rounds++] = ptr;
+
+  V(pcpu->c_mutex);
+}                               /* SlabCacheFree */
+
+/**
+ *
+ * SlabCacheCreate: gets the cache for the entries of a type.
+ *
+ * @param name [IN] name of the type, for the stats.
+ * @param size [IN] size of an entry.
+ * @param ctor [IN] constructor of the entries, or NULL.
+ *
+ * @return the cache, NULL if no memory is available.
+ *
+ */
+slab_cache_t *SlabCacheCreate(const char *name, size_t size, slab_constructor_t ctor)
+{
+  slab_cache_t *cache;
+
+  pthread_once(&slab_once, slab_init);
+
+  P(slab_caches_mutex);
+
+  for(cache = slab_caches; cache != NULL; cache = cache->sc_next)
+    if(cache->sc_size == size && cache->sc_ctor == ctor &&
+       !strncmp(cache->sc_name, name, SLAB_NAME_LEN - 1))
+      break;
+
+  if(cache == NULL)
+    cache = slab_cache_init(name, size, ctor);
+
+  V(slab_caches_mutex);
+
+  return cache;
+}                               /* SlabCacheCreate */
+
+/**
+ *
+ * SlabMalloc: allocates memory.
+ *
+ * @param Size [IN] size needed.
+ *
+ * @return the memory, aligned on 16 bytes, NULL if none is available.
+ *
+ */
+void *SlabMalloc(size_t Size)
+{
+  slab_obj_header_t *phdr;
+
+  pthread_once(&slab_once, slab_init);
+
+  if(Size <= SLAB_MAX_SMALL_SIZE)
+    return SlabCacheAlloc(slab_classes[slab_class_index[(Size + SLAB_ALIGN - 1) /
+                                                        SLAB_ALIGN]]);
+
+  if((phdr = (slab_obj_header_t *) malloc(SLAB_HEADER_SIZE + Size)) == NULL)
+    return NULL;
+
+  phdr->oh_slab = NULL;
+  phdr->u.oh_size = Size;
+
+  __sync_fetch_and_add(&slab_large_space, Size);
+  __sync_fetch_and_add(&slab_nb_large_alloc, 1);
+
+  return slab_object(phdr);
+}                               /* SlabMalloc */
+
+void *SlabCalloc(size_t NumberOfElements, size_t ElementSize)
+{
+  size_t size = NumberOfElements * ElementSize;
+  void *ptr;
+
+  if(ElementSize != 0 && size / ElementSize != NumberOfElements)
+    {
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  if((ptr = SlabMalloc(size)) != NULL)
+    memset(ptr, 0, size);
+
+  return ptr;
+}                               /* SlabCalloc */
+
+/**
+ *
+ * SlabFree: frees memory got from any of the Slab functions.
+ *
+ * @param ptr [IN] the memory, may be NULL.
+ *
+ * @return nothing (void function)
+ *
+ */
+void SlabFree(void *ptr)
+{
+  slab_obj_header_t *phdr;
+
+  if(ptr == NULL)
+    return;
+
+  phdr = slab_header(ptr);
+
+  if(phdr->oh_slab != NULL)
+    {
+      SlabCacheFree(phdr->oh_slab->s_cache, ptr);
+      return;
+    }
+
+  __sync_fetch_and_sub(&slab_large_space, phdr->u.oh_size);
+  __sync_fetch_and_add(&slab_nb_large_free, 1);
+
+  free(phdr);
+}                               /* SlabFree */
+
+void *SlabRealloc(void *ptr, size_t Size)
+{
+  slab_obj_header_t *phdr;
+  size_t old_size;
+  void *new_ptr;
+
+  if(ptr == NULL)
+    return SlabMalloc(Size);
+
+  phdr = slab_header(ptr);
+
+  if(phdr->oh_slab != NULL)
+    old_size = phdr->oh_slab->s_cache->sc_size;
+  else
+    old_size = phdr->u.oh_size;
+
+  if(Size <= old_size)
+    return ptr;
+
+  if((new_ptr = SlabMalloc(Size)) == NULL)
+    return NULL;
+
+  memcpy(new_ptr, ptr, old_size);
+  SlabFree(ptr);
+
+  return new_ptr;
+}                               /* SlabRealloc */
+
+char *SlabStr_Dup(const char *Str)
+{
+  size_t len = strlen(Str) + 1;
+  char *new_str;
+
+  if((new_str = (char *)SlabMalloc(len)) != NULL)
+    memcpy(new_str, Str, len);
+
+  return new_str;
+}                               /* SlabStr_Dup */
+
+static void slab_cache_reclaim(slab_cache_t * cache)
+{
+  slab_magazine_t *full = NULL;
+  slab_magazine_t *empty;
+  slab_magazine_t *mag;
+  slab_t *released;
+  unsigned int i;
+
+  /* The full magazines the depot kept unused since the last reclaim,
+   * and all of its empty ones */
+  P(cache->sc_depot_mutex);
+  for(i = 0; i < cache->sc_min_full; i++)
+    {
+      mag = cache->sc_full;
+      cache->sc_full = mag->m_next;
+      mag->m_next = full;
+      full = mag;
+    }
+  cache->sc_nb_full -= cache->sc_min_full;
+  cache->sc_min_full = cache->sc_nb_full;
+
+  empty = cache->sc_empty;
+  cache->sc_empty = NULL;
+  V(cache->sc_depot_mutex);
+
+  while(full != NULL)
+    {
+      mag = full;
+      full = full->m_next;
+      slab_put_objects(cache, mag->m_objs, mag->m_rounds);
+      free(mag);
+    }
+
+  while(empty != NULL)
+    {
+      mag = empty;
+      empty = empty->m_next;
+      free(mag);
+    }
+
+  P(cache->sc_mutex);
+  released = slab_release(cache, 0);
+  V(cache->sc_mutex);
+
+  slab_unmap(cache, released);
+}                               /* slab_cache_reclaim */
+
+/**
+ *
+ * SlabReclaim: gives back to the system the memory left unused.
+ *
+ * Meant to be called periodically: the magazines a depot did not need
+ * between two calls are emptied, and the slabs with no object in use are
+ * unmapped.
+ *
+ * @return nothing (void function)
+ *
+ */
+void SlabReclaim(void)
+{
+  slab_cache_t *cache;
+
+  pthread_once(&slab_once, slab_init);
+
+  /* The caches are never removed from the list */
+  P(slab_caches_mutex);
+  cache = slab_caches;
+  V(slab_caches_mutex);
+
+  for(; cache != NULL; cache = cache->sc_next)
+    slab_cache_reclaim(cache);
+}                               /* SlabReclaim */
+
+/**
+ *
+ * SlabGetStats: gets the stats of a cache.
+ *
+ * @param index  [IN]  index of the cache, from 0.
+ * @param pstats [OUT] its stats.
+ *
+ * @return 0 if successful, ENOENT if there is no such cache.
+ *
+ */
+int SlabGetStats(unsigned int index, slab_stats_t * pstats)
+{
+  slab_cache_t *cache;
+  unsigned int i;
+
+  pthread_once(&slab_once, slab_init);
+
+  P(slab_caches_mutex);
+  for(cache = slab_caches; cache != NULL && index > 0; cache = cache->sc_next)
+    index--;
+  V(slab_caches_mutex);
+
+  if(cache == NULL)
+    return ENOENT;
+
+  memset(pstats, 0, sizeof(slab_stats_t));
+  strncpy(pstats->name, cache->sc_name, SLAB_NAME_LEN);
+  pstats->size = cache->sc_size;
+
+  for(i = 0; i < slab_nb_cpus; i++)
+    {
+      P(cache->sc_cpus[i].c_mutex);
+      pstats->nb_alloc += cache->sc_cpus[i].c_nb_alloc;
+      pstats->nb_free += cache->sc_cpus[i].c_nb_free;
+      V(cache->sc_cpus[i].c_mutex);
+    }
+
+  P(cache->sc_mutex);
+  pstats->nb_slabs = cache->sc_nb_slabs;
+  pstats->wm_nb_slabs = cache->sc_wm_nb_slabs;
+  pstats->nb_slabs_released = cache->sc_nb_slabs_released;
+  pstats->mem_space = cache->sc_nb_slabs * cache->sc_slab_size;
+  V(cache->sc_mutex);
+
+  return 0;
+}                               /* SlabGetStats */
+
+size_t SlabGetTotalMemSpace(void)
+{
+  slab_stats_t stats;
+  size_t total = slab_large_space;
+  unsigned int i;
+
+  for(i = 0; SlabGetStats(i, &stats) == 0; i++)
+    total += stats.mem_space;
+
+  return total;
+}                               /* SlabGetTotalMemSpace */
+
+/**
+ *
+ * SlabDumpStats: prints the stats of the caches in use.
+ *
+ * @param output [IN] where to print them.
+ *
+ * @return nothing (void function)
+ *
+ */
+void SlabDumpStats(FILE * output)
+{
+  slab_stats_t stats;
+  unsigned int i;
+
+  fprintf(output, "%-32s %8s %12s %12s %8s %8s %10s\n", "cache", "size",
+          "allocated", "in use", "slabs", "max", "released");
+
+  for(i = 0; SlabGetStats(i, &stats) == 0; i++)
+    {
+      if(stats.nb_alloc == 0 && stats.nb_slabs == 0)
+        continue;
+
+      fprintf(output, "%-32s %8llu %12llu %12lld %8u %8u %10llu\n", stats.name,
+              (unsigned long long)stats.size, stats.nb_alloc,
+              (long long)(stats.nb_alloc - stats.nb_free), stats.nb_slabs,
+              stats.wm_nb_slabs, stats.nb_slabs_released);
+    }
+
+  fprintf(output, "%-32s %8s %12llu %12lld %8s %8s %10s\n", "large", "-",
+          slab_nb_large_alloc, (long long)(slab_nb_large_alloc - slab_nb_large_free),
+          "-", "-", "-");
+}                               /* SlabDumpStats */
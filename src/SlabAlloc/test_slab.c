@@ -0,0 +1,287 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Checks the slab allocator, then compares it with malloc when objects
+ * are allocated by a thread and freed by another.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "log.h"
+#include "SlabAlloc.h"
+
+#define NB_OBJECTS    100000
+#define NB_THREADS    8
+#define NB_ROUNDS     200
+#define BATCH_SIZE    1000
+
+static void check_sizes(void)
+{
+  static size_t sizes[] = { 0, 1, 16, 17, 100, 128, 129, 1000, 4096, 5000,
+    32768, 32769, 100000
+  };
+  char *ptr[sizeof(sizes) / sizeof(sizes[0])];
+  char *zeroed, *grown;
+  unsigned int i, j;
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+      if((ptr[i] = (char *)SlabMalloc(sizes[i])) == NULL ||
+         ((unsigned long)ptr[i] % 16) != 0)
+        {
+          LogTest("Test FAILED: bad allocation of %llu bytes",
+                  (unsigned long long)sizes[i]);
+          exit(1);
+        }
+      memset(ptr[i], i, sizes[i]);
+    }
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+      for(j = 0; j < sizes[i]; j++)
+        if(ptr[i][j] != (char)i)
+          {
+            LogTest("Test FAILED: allocation of %llu bytes overwritten",
+                    (unsigned long long)sizes[i]);
+            exit(1);
+          }
+      SlabFree(ptr[i]);
+    }
+
+  /* Calloc gets objects freed dirty */
+  zeroed = (char *)SlabCalloc(10, 100);
+  for(i = 0; i < 1000; i++)
+    if(zeroed[i] != 0)
+      {
+        LogTest("Test FAILED: SlabCalloc did not zero the memory");
+        exit(1);
+      }
+
+  /* Through the classes up to a large allocation */
+  memset(zeroed, 'a', 1000);
+  grown = zeroed;
+  for(i = 1000; i <= 64000; i *= 2)
+    grown = (char *)SlabRealloc(grown, i);
+  for(i = 0; i < 1000; i++)
+    if(grown[i] != 'a')
+      {
+        LogTest("Test FAILED: SlabRealloc lost the content");
+        exit(1);
+      }
+  SlabFree(grown);
+  SlabFree(NULL);
+
+  LogTest("Allocations of all the size classes OK");
+}
+
+typedef struct entry__
+{
+  int constructed;
+  int uses;
+  char data[200];
+} entry_t;
+
+static void constructor_entry(void *ptr)
+{
+  entry_t *pentry = (entry_t *) ptr;
+
+  pentry->constructed = 1;
+  pentry->uses = 0;
+}
+
+static void check_cache(void)
+{
+  slab_cache_t *cache, *same;
+  entry_t *entries[1000];
+  int i, reused;
+
+  cache = SlabCacheCreate("entry_t", sizeof(entry_t), constructor_entry);
+  same = SlabCacheCreate("entry_t", sizeof(entry_t), constructor_entry);
+  if(cache == NULL || cache != same)
+    {
+      LogTest("Test FAILED: the pools of a type do not share their cache");
+      exit(1);
+    }
+
+  for(i = 0; i < 1000; i++)
+    {
+      entries[i] = (entry_t *) SlabCacheAlloc(cache);
+      if(!entries[i]->constructed)
+        {
+          LogTest("Test FAILED: entry not constructed");
+          exit(1);
+        }
+      entries[i]->uses++;
+    }
+  for(i = 0; i < 1000; i++)
+    SlabCacheFree(cache, entries[i]);
+
+  /* The entries are reused as they were left, not constructed again */
+  for(i = 0; i < 1000; i++)
+    entries[i] = (entry_t *) SlabCacheAlloc(cache);
+  for(i = 0, reused = 0; i < 1000; i++)
+    {
+      if(!entries[i]->constructed || entries[i]->uses > 1)
+        {
+          LogTest("Test FAILED: entry did not keep its state");
+          exit(1);
+        }
+      reused += entries[i]->uses;
+      SlabFree(entries[i]);
+    }
+
+  if(reused == 0)
+    {
+      LogTest("Test FAILED: no entry reused");
+      exit(1);
+    }
+
+  LogTest("Cache of constructed entries OK");
+}
+
+static void check_reclaim(void)
+{
+  static void *objs[NB_OBJECTS];
+  size_t before, peak, after;
+  int i;
+
+  SlabReclaim();
+  SlabReclaim();
+  before = SlabGetTotalMemSpace();
+
+  for(i = 0; i < NB_OBJECTS; i++)
+    objs[i] = SlabMalloc(300);
+  peak = SlabGetTotalMemSpace();
+  for(i = 0; i < NB_OBJECTS; i++)
+    SlabFree(objs[i]);
+
+  /* The first reclaim sees the depot's working set, the second empties it */
+  SlabReclaim();
+  SlabReclaim();
+  after = SlabGetTotalMemSpace();
+
+  if(peak < before + NB_OBJECTS * 300 || after > before + (peak - before) / 10)
+    {
+      LogTest("Test FAILED: memory not given back: %llu before, %llu peak, %llu after",
+              (unsigned long long)before, (unsigned long long)peak,
+              (unsigned long long)after);
+      exit(1);
+    }
+
+  LogTest("Memory given back: %llu bytes before, %llu peak, %llu after reclaim",
+          (unsigned long long)before, (unsigned long long)peak,
+          (unsigned long long)after);
+}
+
+/* Each thread frees, at each round, the objects allocated by the next one */
+static void *batches[NB_THREADS][BATCH_SIZE];
+static pthread_barrier_t round_barrier;
+static int use_slab;
+
+static void *bench_thread(void *arg)
+{
+  long id = (long)arg;
+  long next = (id + 1) % NB_THREADS;
+  unsigned int seed = id;
+  int round, i;
+
+  for(round = 0; round < NB_ROUNDS; round++)
+    {
+      for(i = 0; i < BATCH_SIZE; i++)
+        {
+          size_t size = 16 + rand_r(&seed) % 1024;
+
+          batches[id][i] = use_slab ? SlabMalloc(size) : malloc(size);
+          *(long *)batches[id][i] = id;
+        }
+
+      pthread_barrier_wait(&round_barrier);
+
+      for(i = 0; i < BATCH_SIZE; i++)
+        {
+          if(*(long *)batches[next][i] != next)
+            {
+              LogTest("Test FAILED: object of thread %ld overwritten", next);
+              exit(1);
+            }
+          if(use_slab)
+            SlabFree(batches[next][i]);
+          else
+            free(batches[next][i]);
+        }
+
+      pthread_barrier_wait(&round_barrier);
+    }
+
+  return NULL;
+}
+
+static unsigned long long bench(int slab)
+{
+  pthread_t threads[NB_THREADS];
+  struct timeval start, end;
+  long i;
+
+  use_slab = slab;
+  pthread_barrier_init(&round_barrier, NULL, NB_THREADS);
+
+  gettimeofday(&start, NULL);
+  for(i = 0; i < NB_THREADS; i++)
+    pthread_create(&threads[i], NULL, bench_thread, (void *)i);
+  for(i = 0; i < NB_THREADS; i++)
+    pthread_join(threads[i], NULL);
+  gettimeofday(&end, NULL);
+
+  pthread_barrier_destroy(&round_barrier);
+
+  return (end.tv_sec - start.tv_sec) * 1000000ULL + end.tv_usec - start.tv_usec;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long long slab_us, malloc_us;
+  unsigned long long nb_ops = 2ULL * NB_THREADS * NB_ROUNDS * BATCH_SIZE;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_slab");
+
+  check_sizes();
+  check_cache();
+  check_reclaim();
+
+  slab_us = bench(TRUE);
+  malloc_us = bench(FALSE);
+
+  LogTest("%d threads, objects freed by another thread: slab %llu ns, malloc %llu ns per operation",
+          NB_THREADS, slab_us * 1000 / nb_ops, malloc_us * 1000 / nb_ops);
+
+  if(argc > 1)
+    SlabDumpStats(stdout);
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
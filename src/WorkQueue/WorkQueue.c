@@ -0,0 +1,298 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    WorkQueue.c
+ * \brief   Lock free multi producers / single consumer work queues.
+ *
+ * WorkQueue.c : Each cell carries a sequence number. A cell at position pos
+ * is free for a producer when seq == pos, and holds an item ready for the
+ * consumer when seq == pos + 1. Once consumed, the cell is given back to
+ * producers for the next lap with seq = pos + size.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "stuff_alloc.h"
+#include "WorkQueue.h"
+
+/**
+ *
+ * WorkQueue_Init: Init a work queue.
+ *
+ * Init a work queue. The number of cells is rounded up to a power of two.
+ *
+ * @param pqueue [OUT] the queue to be initialized.
+ * @param size [IN] the minimum number of items the queue can hold.
+ *
+ * @return WORKQUEUE_SUCCESS if ok, an error code otherwise.
+ *
+ */
+int WorkQueue_Init(work_queue_t * pqueue, unsigned int size)
+{
+  uint64_t nb_cells = 2;
+  uint64_t i;
+
+  if(pqueue == NULL || size == 0)
+    return WORKQUEUE_INVALID_ARGUMENT;
+
+  while(nb_cells < size)
+    nb_cells <<= 1;
+
+  if((pqueue->cells =
+      (work_queue_cell_t *) Mem_Alloc_Label(nb_cells * sizeof(work_queue_cell_t),
+                                            "WorkQueue cells")) == NULL)
+    return WORKQUEUE_MALLOC_ERROR;
+
+  for(i = 0; i < nb_cells; i++)
+    {
+      pqueue->cells[i].seq = i;
+      pqueue->cells[i].pdata = NULL;
+    }
+
+  pqueue->mask = nb_cells - 1;
+  pqueue->enqueue_pos = 0;
+  pqueue->dequeue_pos = 0;
+  pqueue->sleeping = 0;
+  pqueue->nb_full = 0;
+
+  atomic_barrier();
+
+  return WORKQUEUE_SUCCESS;
+}                               /* WorkQueue_Init */
+
+/**
+ *
+ * WorkQueue_Destroy: Releases the memory used by a work queue.
+ *
+ * Releases the memory used by a work queue. Items still queued are not freed.
+ *
+ * @param pqueue [INOUT] the queue to be destroyed.
+ *
+ * @return nothing (void function)
+ *
+ */
+void WorkQueue_Destroy(work_queue_t * pqueue)
+{
+  if(pqueue->cells != NULL)
+    Mem_Free(pqueue->cells);
+  pqueue->cells = NULL;
+}                               /* WorkQueue_Destroy */
+
+/**
+ *
+ * WorkQueue_Push: Adds an item at the tail of the queue.
+ *
+ * Adds an item at the tail of the queue. Safe to be called by several threads at once.
+ *
+ * @param pqueue [INOUT] the queue.
+ * @param pdata [IN] the item to be queued, must not be NULL.
+ *
+ * @return WORKQUEUE_SUCCESS if ok, WORKQUEUE_FULL if there is no room left.
+ *
+ */
+int WorkQueue_Push(work_queue_t * pqueue, void *pdata)
+{
+  work_queue_cell_t *pcell;
+  uint64_t pos;
+  uint64_t seq;
+  int64_t dif;
+
+  pos = atomic_fetch_uint64_t(&pqueue->enqueue_pos);
+
+  while(1)
+    {
+      pcell = &pqueue->cells[pos & pqueue->mask];
+      seq = atomic_fetch_uint64_t(&pcell->seq);
+      dif = (int64_t) seq - (int64_t) pos;
+
+      if(dif == 0)
+        {
+          /* The cell is free, try to reserve it */
+          if(atomic_cas_uint64_t(&pqueue->enqueue_pos, pos, pos + 1))
+            break;
+          pos = atomic_fetch_uint64_t(&pqueue->enqueue_pos);
+        }
+      else if(dif < 0)
+        {
+          /* The consumer has not released this cell yet: one lap behind */
+          atomic_inc_uint64_t(&pqueue->nb_full);
+          return WORKQUEUE_FULL;
+        }
+      else
+        {
+          /* Another producer took this cell, reload */
+          pos = atomic_fetch_uint64_t(&pqueue->enqueue_pos);
+        }
+    }
+
+  /* The cell is ours, publish the item */
+  pcell->pdata = pdata;
+  atomic_store_uint64_t(&pcell->seq, pos + 1);
+
+  return WORKQUEUE_SUCCESS;
+}                               /* WorkQueue_Push */
+
+/**
+ *
+ * WorkQueue_Pop: Removes the item at the head of the queue.
+ *
+ * Removes the item at the head of the queue. Must be called by a single thread.
+ *
+ * @param pqueue [INOUT] the queue.
+ *
+ * @return the item, or NULL if no item is ready.
+ *
+ */
+void *WorkQueue_Pop(work_queue_t * pqueue)
+{
+  work_queue_cell_t *pcell;
+  uint64_t pos = pqueue->dequeue_pos;
+  void *pdata;
+
+  pcell = &pqueue->cells[pos & pqueue->mask];
+
+  if(atomic_fetch_uint64_t(&pcell->seq) != pos + 1)
+    return NULL;
+
+  pdata = pcell->pdata;
+  pcell->pdata = NULL;
+
+  /* Give the cell back to producers for the next lap */
+  atomic_store_uint64_t(&pcell->seq, pos + pqueue->mask + 1);
+  atomic_store_uint64_t(&pqueue->dequeue_pos, pos + 1);
+
+  return pdata;
+}                               /* WorkQueue_Pop */
+
+/**
+ *
+ * WorkQueue_Length: Returns the number of queued items.
+ *
+ * Returns the number of queued items. This is a snapshot, it may be stale as soon as returned.
+ *
+ * @param pqueue [IN] the queue.
+ *
+ * @return the number of items, including the ones being pushed right now.
+ *
+ */
+unsigned int WorkQueue_Length(work_queue_t * pqueue)
+{
+  uint64_t dequeue_pos = atomic_fetch_uint64_t(&pqueue->dequeue_pos);
+  uint64_t enqueue_pos = atomic_fetch_uint64_t(&pqueue->enqueue_pos);
+
+  if(enqueue_pos <= dequeue_pos)
+    return 0;
+
+  return (unsigned int)(enqueue_pos - dequeue_pos);
+}                               /* WorkQueue_Length */
+
+/**
+ *
+ * WorkQueue_IsEmpty: Tells if the consumer has something to pop.
+ *
+ * Tells if the consumer has something to pop. Meant to be called by the consumer.
+ *
+ * @param pqueue [IN] the queue.
+ *
+ * @return TRUE if WorkQueue_Pop would return NULL, FALSE otherwise.
+ *
+ */
+int WorkQueue_IsEmpty(work_queue_t * pqueue)
+{
+  uint64_t pos = pqueue->dequeue_pos;
+
+  return atomic_fetch_uint64_t(&pqueue->cells[pos & pqueue->mask].seq) != pos + 1;
+}                               /* WorkQueue_IsEmpty */
+
+/**
+ *
+ * WorkQueue_PrepareSleep: Announces that the consumer is about to sleep.
+ *
+ * Announces that the consumer is about to sleep, then checks the queue again.
+ * The consumer must hold the mutex producers take to signal it, and may only
+ * wait if this returns TRUE. Either the consumer sees the last pushed item,
+ * or its producer sees the announcement and signals.
+ *
+ * @param pqueue [INOUT] the queue.
+ *
+ * @return TRUE if the consumer may sleep, FALSE if an item showed up.
+ *
+ */
+int WorkQueue_PrepareSleep(work_queue_t * pqueue)
+{
+  atomic_store_uint32_t(&pqueue->sleeping, 1);
+
+  if(!WorkQueue_IsEmpty(pqueue))
+    {
+      WorkQueue_CancelSleep(pqueue);
+      return 0;
+    }
+
+  return 1;
+}                               /* WorkQueue_PrepareSleep */
+
+/**
+ *
+ * WorkQueue_CancelSleep: The consumer is awake again.
+ *
+ * The consumer is awake again, producers do not need to signal it anymore.
+ *
+ * @param pqueue [INOUT] the queue.
+ *
+ * @return nothing (void function)
+ *
+ */
+void WorkQueue_CancelSleep(work_queue_t * pqueue)
+{
+  atomic_store_uint32_t(&pqueue->sleeping, 0);
+}                               /* WorkQueue_CancelSleep */
+
+/**
+ *
+ * WorkQueue_NeedWakeup: Tells a producer if it has to signal the consumer.
+ *
+ * Tells a producer if it has to signal the consumer. To be called after a
+ * successful push. Only one caller gets TRUE for a given sleep.
+ *
+ * @param pqueue [INOUT] the queue.
+ *
+ * @return TRUE if the caller must signal the consumer, FALSE otherwise.
+ *
+ */
+int WorkQueue_NeedWakeup(work_queue_t * pqueue)
+{
+  atomic_barrier();
+
+  if(pqueue->sleeping == 0)
+    return 0;
+
+  return atomic_cas_uint32_t(&pqueue->sleeping, 1, 0);
+}                               /* WorkQueue_NeedWakeup */
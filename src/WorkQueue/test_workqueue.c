@@ -0,0 +1,309 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ * Test and micro benchmark for the work queues.
+ *
+ * Several producers feed a single consumer, as the dispatcher threads feed a
+ * worker. The same load is run through the lock free queue and through a LRU
+ * list protected by a mutex, the way worker queues used to be managed.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+#include "BuddyMalloc.h"
+#include "LRU_List.h"
+#include "WorkQueue.h"
+#include "log.h"
+
+#define QUEUE_SIZE 1024
+#define NB_ITEMS_PER_PRODUCER 200000
+#define MAX_PRODUCERS 8
+
+typedef struct test_item__
+{
+  unsigned int producer;
+  unsigned int seq;
+} test_item_t;
+
+static test_item_t items[MAX_PRODUCERS][NB_ITEMS_PER_PRODUCER];
+static unsigned int nb_producers;
+
+static pthread_mutex_t cons_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cons_condvar = PTHREAD_COND_INITIALIZER;
+
+static work_queue_t queue;
+static LRU_list_t *plru;
+
+static unsigned int check_item(test_item_t * pitem, unsigned int *next_seq)
+{
+  if(pitem->producer >= nb_producers || pitem->seq != next_seq[pitem->producer])
+    {
+      LogTest("Test FAILED: item %u from producer %u out of order, expected %u",
+              pitem->seq, pitem->producer,
+              pitem->producer < nb_producers ? next_seq[pitem->producer] : 0);
+      exit(1);
+    }
+  next_seq[pitem->producer] += 1;
+  return 1;
+}                               /* check_item */
+
+/* Lock free queue: producers only lock to wake up a sleeping consumer */
+static void *wq_producer(void *arg)
+{
+  unsigned int id = (unsigned int)(uintptr_t) arg;
+  unsigned int i;
+
+  for(i = 0; i < NB_ITEMS_PER_PRODUCER; i++)
+    {
+      while(WorkQueue_Push(&queue, &items[id][i]) == WORKQUEUE_FULL)
+        sched_yield();
+
+      if(WorkQueue_NeedWakeup(&queue))
+        {
+          pthread_mutex_lock(&cons_mutex);
+          pthread_cond_signal(&cons_condvar);
+          pthread_mutex_unlock(&cons_mutex);
+        }
+    }
+  return NULL;
+}                               /* wq_producer */
+
+static void *wq_consumer(void *arg)
+{
+  unsigned int next_seq[MAX_PRODUCERS];
+  unsigned int total = nb_producers * NB_ITEMS_PER_PRODUCER;
+  unsigned int done = 0;
+  test_item_t *pitem;
+
+  memset(next_seq, 0, sizeof(next_seq));
+
+  while(done < total)
+    {
+      if((pitem = WorkQueue_Pop(&queue)) != NULL)
+        {
+          done += check_item(pitem, next_seq);
+          continue;
+        }
+
+      pthread_mutex_lock(&cons_mutex);
+      if(WorkQueue_PrepareSleep(&queue))
+        {
+          pthread_cond_wait(&cons_condvar, &cons_mutex);
+          WorkQueue_CancelSleep(&queue);
+        }
+      pthread_mutex_unlock(&cons_mutex);
+    }
+  return NULL;
+}                               /* wq_consumer */
+
+/* Mutex protected LRU: every push locks and signals */
+static void *lru_producer(void *arg)
+{
+  unsigned int id = (unsigned int)(uintptr_t) arg;
+  LRU_entry_t *pentry;
+  LRU_status_t status;
+  unsigned int i;
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  for(i = 0; i < NB_ITEMS_PER_PRODUCER; i++)
+    {
+      pthread_mutex_lock(&cons_mutex);
+      if((pentry = LRU_new_entry(plru, &status)) == NULL)
+        {
+          LogTest("Test FAILED: bad entry add, status = %d", status);
+          exit(1);
+        }
+      pentry->buffdata.pdata = (caddr_t) & items[id][i];
+      pentry->buffdata.len = sizeof(test_item_t);
+      pthread_cond_signal(&cons_condvar);
+      pthread_mutex_unlock(&cons_mutex);
+    }
+  return NULL;
+}                               /* lru_producer */
+
+static void *lru_consumer(void *arg)
+{
+  unsigned int next_seq[MAX_PRODUCERS];
+  unsigned int total = nb_producers * NB_ITEMS_PER_PRODUCER;
+  unsigned int done = 0;
+  LRU_entry_t out_entry;
+
+  memset(next_seq, 0, sizeof(next_seq));
+
+  while(done < total)
+    {
+      pthread_mutex_lock(&cons_mutex);
+      while(plru->nb_entry == plru->nb_invalid)
+        pthread_cond_wait(&cons_condvar, &cons_mutex);
+      LRU_pop_entry(plru, &out_entry);
+      pthread_mutex_unlock(&cons_mutex);
+
+      done += check_item((test_item_t *) out_entry.buffdata.pdata, next_seq);
+    }
+  return NULL;
+}                               /* lru_consumer */
+
+static double run(void *(*producer) (void *), void *(*consumer) (void *))
+{
+  pthread_t prod_thrid[MAX_PRODUCERS];
+  pthread_t cons_thrid;
+  struct timeval start, end;
+  unsigned int i;
+
+  gettimeofday(&start, NULL);
+
+  pthread_create(&cons_thrid, NULL, consumer, NULL);
+  for(i = 0; i < nb_producers; i++)
+    pthread_create(&prod_thrid[i], NULL, producer, (void *)(uintptr_t) i);
+
+  for(i = 0; i < nb_producers; i++)
+    pthread_join(prod_thrid[i], NULL);
+  pthread_join(cons_thrid, NULL);
+
+  gettimeofday(&end, NULL);
+
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}                               /* run */
+
+int main(int argc, char *argv[])
+{
+  LRU_parameter_t param;
+  LRU_status_t status = 0;
+  unsigned int i, j;
+  double wq_time, lru_time;
+  void *pdata;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_workqueue");
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  for(i = 0; i < MAX_PRODUCERS; i++)
+    for(j = 0; j < NB_ITEMS_PER_PRODUCER; j++)
+      {
+        items[i][j].producer = i;
+        items[i][j].seq = j;
+      }
+
+  /* Basic checks */
+  if(WorkQueue_Init(&queue, 3) != WORKQUEUE_SUCCESS)
+    {
+      LogTest("Test FAILED: Bad Init");
+      exit(1);
+    }
+
+  if(WorkQueue_Pop(&queue) != NULL || !WorkQueue_IsEmpty(&queue))
+    {
+      LogTest("Test FAILED: new queue is not empty");
+      exit(1);
+    }
+
+  for(i = 0; i < 4; i++)
+    if(WorkQueue_Push(&queue, &items[0][i]) != WORKQUEUE_SUCCESS)
+      {
+        LogTest("Test FAILED: push %u failed", i);
+        exit(1);
+      }
+
+  if(WorkQueue_Push(&queue, &items[0][4]) != WORKQUEUE_FULL || WorkQueue_Length(&queue) != 4)
+    {
+      LogTest("Test FAILED: queue of size 4 accepted a 5th item");
+      exit(1);
+    }
+
+  for(i = 0; i < 4; i++)
+    if((pdata = WorkQueue_Pop(&queue)) != &items[0][i])
+      {
+        LogTest("Test FAILED: pop %u returned %p instead of %p", i, pdata, &items[0][i]);
+        exit(1);
+      }
+
+  if(WorkQueue_Pop(&queue) != NULL || WorkQueue_Length(&queue) != 0)
+    {
+      LogTest("Test FAILED: drained queue is not empty");
+      exit(1);
+    }
+
+  if(!WorkQueue_PrepareSleep(&queue) || !WorkQueue_NeedWakeup(&queue)
+     || WorkQueue_NeedWakeup(&queue))
+    {
+      LogTest("Test FAILED: wake up is not delivered exactly once");
+      exit(1);
+    }
+
+  WorkQueue_Destroy(&queue);
+  LogTest("Basic checks OK");
+
+  /* Benchmark */
+  param.nb_entry_prealloc = QUEUE_SIZE;
+  param.nb_call_gc_invalid = 100;
+  param.entry_to_str = NULL;
+  param.clean_entry = NULL;
+  param.lp_name = "Test";
+
+  if((plru = LRU_Init(param, &status)) == NULL)
+    {
+      LogTest("Test FAILED: Bad LRU Init");
+      exit(1);
+    }
+
+  for(nb_producers = 1; nb_producers <= MAX_PRODUCERS; nb_producers *= 2)
+    {
+      if(WorkQueue_Init(&queue, QUEUE_SIZE) != WORKQUEUE_SUCCESS)
+        {
+          LogTest("Test FAILED: Bad Init");
+          exit(1);
+        }
+
+      wq_time = run(wq_producer, wq_consumer);
+      lru_time = run(lru_producer, lru_consumer);
+
+      LogTest("%u producer(s), %u items: WorkQueue %.3fs (%.0f items/s, %llu full), mutex+LRU %.3fs (%.0f items/s)",
+              nb_producers, nb_producers * NB_ITEMS_PER_PRODUCER,
+              wq_time, nb_producers * NB_ITEMS_PER_PRODUCER / wq_time,
+              (unsigned long long)queue.nb_full,
+              lru_time, nb_producers * NB_ITEMS_PER_PRODUCER / lru_time);
+
+      WorkQueue_Destroy(&queue);
+    }
+
+  /* Tous les tests sont ok */
+  LogTest("\n-----------------------------------------");
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}                               /* main */
@@ -0,0 +1,400 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    interval_tree.c
+ * \brief   Intrusive interval tree.
+ *
+ * interval_tree.c : AVL balancing with parent links. After any change, the
+ * heights and the max_end of the nodes are fixed from the changed node up to
+ * the root, rotating on the way where the tree is unbalanced.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include "interval_tree.h"
+
+static inline int itree_height(const struct itree_node *node)
+{
+  return node != NULL ? node->height : 0;
+}
+
+/* Recomputes height and max_end from the children */
+static inline void itree_update(struct itree_node *node)
+{
+  int hl = itree_height(node->left);
+  int hr = itree_height(node->right);
+
+  node->height = (hl > hr ? hl : hr) + 1;
+
+  node->max_end = node->end;
+  if(node->left != NULL && node->left->max_end > node->max_end)
+    node->max_end = node->left->max_end;
+  if(node->right != NULL && node->right->max_end > node->max_end)
+    node->max_end = node->right->max_end;
+}                               /* itree_update */
+
+static inline int itree_less(const struct itree_node *a, const struct itree_node *b)
+{
+  if(a->start != b->start)
+    return a->start < b->start;
+  if(a->end != b->end)
+    return a->end < b->end;
+  return (uintptr_t) a < (uintptr_t) b;
+}                               /* itree_less */
+
+static inline void itree_replace_child(struct itree *tree,
+                                       struct itree_node *parent,
+                                       struct itree_node *old,
+                                       struct itree_node *new)
+{
+  if(parent == NULL)
+    tree->root = new;
+  else if(parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}                               /* itree_replace_child */
+
+static struct itree_node *itree_rotate_left(struct itree *tree, struct itree_node *node)
+{
+  struct itree_node *pivot = node->right;
+
+  node->right = pivot->left;
+  if(pivot->left != NULL)
+    pivot->left->parent = node;
+
+  pivot->parent = node->parent;
+  itree_replace_child(tree, node->parent, node, pivot);
+
+  pivot->left = node;
+  node->parent = pivot;
+
+  itree_update(node);
+  itree_update(pivot);
+
+  return pivot;
+}                               /* itree_rotate_left */
+
+static struct itree_node *itree_rotate_right(struct itree *tree, struct itree_node *node)
+{
+  struct itree_node *pivot = node->left;
+
+  node->left = pivot->right;
+  if(pivot->right != NULL)
+    pivot->right->parent = node;
+
+  pivot->parent = node->parent;
+  itree_replace_child(tree, node->parent, node, pivot);
+
+  pivot->right = node;
+  node->parent = pivot;
+
+  itree_update(node);
+  itree_update(pivot);
+
+  return pivot;
+}                               /* itree_rotate_right */
+
+/* Fixes the nodes from node up to the root */
+static void itree_rebalance(struct itree *tree, struct itree_node *node)
+{
+  int balance;
+
+  while(node != NULL)
+    {
+      itree_update(node);
+      balance = itree_height(node->left) - itree_height(node->right);
+
+      if(balance > 1)
+        {
+          if(itree_height(node->left->left) < itree_height(node->left->right))
+            itree_rotate_left(tree, node->left);
+          node = itree_rotate_right(tree, node);
+        }
+      else if(balance < -1)
+        {
+          if(itree_height(node->right->right) < itree_height(node->right->left))
+            itree_rotate_right(tree, node->right);
+          node = itree_rotate_left(tree, node);
+        }
+
+      node = node->parent;
+    }
+}                               /* itree_rebalance */
+
+static inline struct itree_node *itree_leftmost(struct itree_node *node)
+{
+  if(node == NULL)
+    return NULL;
+
+  while(node->left != NULL)
+    node = node->left;
+
+  return node;
+}                               /* itree_leftmost */
+
+/**
+ *
+ * itree_init: initializes an empty tree.
+ *
+ * @param tree [OUT] the tree
+ *
+ * @return nothing (void function)
+ *
+ */
+void itree_init(struct itree *tree)
+{
+  tree->root = NULL;
+  tree->size = 0;
+}                               /* itree_init */
+
+/**
+ *
+ * itree_insert: inserts a node.
+ *
+ * @param tree  [INOUT] the tree
+ * @param node  [INOUT] the node, which must not be in a tree
+ * @param start [IN]    first value of the interval
+ * @param end   [IN]    last value of the interval, start <= end
+ *
+ * @return nothing (void function)
+ *
+ */
+void itree_insert(struct itree *tree, struct itree_node *node,
+                  uint64_t start, uint64_t end)
+{
+  struct itree_node *parent = NULL;
+  struct itree_node **link = &tree->root;
+
+  node->left = NULL;
+  node->right = NULL;
+  node->start = start;
+  node->end = end;
+  node->max_end = end;
+  node->height = 1;
+
+  while(*link != NULL)
+    {
+      parent = *link;
+      if(itree_less(node, parent))
+        link = &parent->left;
+      else
+        link = &parent->right;
+    }
+
+  *link = node;
+  node->parent = parent;
+  tree->size += 1;
+
+  itree_rebalance(tree, parent);
+}                               /* itree_insert */
+
+/**
+ *
+ * itree_remove: removes a node.
+ *
+ * The other nodes are relinked, never moved, so pointers to them remain
+ * valid.
+ *
+ * @param tree [INOUT] the tree
+ * @param node [INOUT] a node of this tree
+ *
+ * @return nothing (void function)
+ *
+ */
+void itree_remove(struct itree *tree, struct itree_node *node)
+{
+  struct itree_node *child;
+  struct itree_node *succ;
+  struct itree_node *fix;
+
+  if(node->left != NULL && node->right != NULL)
+    {
+      /* Put the successor in place of node */
+      succ = itree_leftmost(node->right);
+
+      if(succ->parent == node)
+        fix = succ;
+      else
+        {
+          fix = succ->parent;
+
+          fix->left = succ->right;
+          if(succ->right != NULL)
+            succ->right->parent = fix;
+
+          succ->right = node->right;
+          succ->right->parent = succ;
+        }
+
+      succ->left = node->left;
+      succ->left->parent = succ;
+
+      succ->parent = node->parent;
+      itree_replace_child(tree, node->parent, node, succ);
+    }
+  else
+    {
+      child = (node->left != NULL) ? node->left : node->right;
+      if(child != NULL)
+        child->parent = node->parent;
+
+      itree_replace_child(tree, node->parent, node, child);
+      fix = node->parent;
+    }
+
+  tree->size -= 1;
+
+  node->left = NULL;
+  node->right = NULL;
+  node->parent = NULL;
+
+  itree_rebalance(tree, fix);
+}                               /* itree_remove */
+
+/**
+ *
+ * itree_first: gets the node with the lowest interval.
+ *
+ * @param tree [IN] the tree
+ *
+ * @return the first node, NULL if the tree is empty.
+ *
+ */
+struct itree_node *itree_first(const struct itree *tree)
+{
+  return itree_leftmost(tree->root);
+}                               /* itree_first */
+
+/**
+ *
+ * itree_next: gets the node following a node.
+ *
+ * @param node [IN] a node of a tree
+ *
+ * @return the next node, NULL if node was the last one.
+ *
+ */
+struct itree_node *itree_next(const struct itree_node *node)
+{
+  if(node->right != NULL)
+    return itree_leftmost(node->right);
+
+  while(node->parent != NULL && node == node->parent->right)
+    node = node->parent;
+
+  return node->parent;
+}                               /* itree_next */
+
+/* First node of a subtree overlapping [start, end] */
+static struct itree_node *itree_subtree_first_overlap(struct itree_node *node,
+                                                      uint64_t start, uint64_t end)
+{
+  while(node != NULL)
+    {
+      if(node->max_end < start)
+        return NULL;
+
+      if(node->left != NULL && node->left->max_end >= start)
+        {
+          /* If none of the left intervals that end after start overlaps,
+           * they all begin after end, and so do node and its right subtree */
+          return itree_subtree_first_overlap(node->left, start, end);
+        }
+
+      if(node->start > end)
+        return NULL;
+
+      if(node->end >= start)
+        return node;
+
+      node = node->right;
+    }
+
+  return NULL;
+}                               /* itree_subtree_first_overlap */
+
+/**
+ *
+ * itree_first_overlap: gets the first node overlapping an interval.
+ *
+ * @param tree  [IN] the tree
+ * @param start [IN] first value of the interval
+ * @param end   [IN] last value of the interval
+ *
+ * @return the node with the lowest interval overlapping [start, end], NULL if none does.
+ *
+ */
+struct itree_node *itree_first_overlap(const struct itree *tree,
+                                       uint64_t start, uint64_t end)
+{
+  return itree_subtree_first_overlap(tree->root, start, end);
+}                               /* itree_first_overlap */
+
+/**
+ *
+ * itree_next_overlap: gets the next node overlapping an interval.
+ *
+ * @param node  [IN] a node of a tree, as returned by itree_(first|next)_overlap
+ * @param start [IN] first value of the interval
+ * @param end   [IN] last value of the interval
+ *
+ * @return the node following node and overlapping [start, end], NULL if none does.
+ *
+ */
+struct itree_node *itree_next_overlap(const struct itree_node *node,
+                                      uint64_t start, uint64_t end)
+{
+  struct itree_node *found;
+  struct itree_node *parent;
+
+  found = itree_subtree_first_overlap(node->right, start, end);
+  if(found != NULL)
+    return found;
+
+  for(;;)
+    {
+      while(node->parent != NULL && node == node->parent->right)
+        node = node->parent;
+
+      parent = node->parent;
+      if(parent == NULL || parent->start > end)
+        return NULL;
+
+      if(parent->end >= start)
+        return parent;
+
+      found = itree_subtree_first_overlap(parent->right, start, end);
+      if(found != NULL)
+        return found;
+
+      node = parent;
+    }
+}                               /* itree_next_overlap */
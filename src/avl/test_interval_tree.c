@@ -0,0 +1,422 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ * Test and lock storm benchmark for the interval tree.
+ *
+ * The tree is first checked against a brute force search with random
+ * intervals. Then many owners lock disjoint records of one file, the way
+ * MPI-IO ranks do, and every lock and unlock looks for conflicting or owned
+ * locks. The same storm is run through a linked list walked linearly, as
+ * the SAL lock lists used to be, and through the interval tree.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include "interval_tree.h"
+#include "nlm_list.h"
+#include "log.h"
+
+#define NB_NODES 2000
+#define NB_ROUNDS 20
+#define NB_QUERIES 500
+#define VALUE_RANGE 100000
+
+#define NB_OWNERS 64
+#define RECORD_SIZE 4096
+
+typedef struct test_lock__
+{
+  struct glist_head list;
+  struct itree_node node;
+  unsigned int owner;
+  int exclusive;
+  uint64_t start;
+  uint64_t end;
+  int in_tree;
+} test_lock_t;
+
+static test_lock_t *locks;
+
+static void failed(const char *what)
+{
+  LogTest("Test FAILED: %s", what);
+  exit(1);
+}                               /* failed */
+
+/* Checks links, order, balance and max_end of a subtree, returns its height */
+static int check_subtree(struct itree_node *node, struct itree_node *parent,
+                         uint64_t * pcount)
+{
+  int hl, hr;
+  uint64_t max_end;
+
+  if(node == NULL)
+    return 0;
+
+  if(node->parent != parent)
+    failed("bad parent link");
+
+  if(node->left != NULL && node->left->start > node->start)
+    failed("bad order on the left");
+  if(node->right != NULL && node->right->start < node->start)
+    failed("bad order on the right");
+
+  hl = check_subtree(node->left, node, pcount);
+  hr = check_subtree(node->right, node, pcount);
+
+  if(hl - hr > 1 || hr - hl > 1)
+    failed("unbalanced tree");
+  if(node->height != (hl > hr ? hl : hr) + 1)
+    failed("bad height");
+
+  max_end = node->end;
+  if(node->left != NULL && node->left->max_end > max_end)
+    max_end = node->left->max_end;
+  if(node->right != NULL && node->right->max_end > max_end)
+    max_end = node->right->max_end;
+  if(node->max_end != max_end)
+    failed("bad max_end");
+
+  *pcount += 1;
+
+  return node->height;
+}                               /* check_subtree */
+
+static void check_queries(struct itree *tree)
+{
+  struct itree_node *node;
+  test_lock_t *plock;
+  uint64_t start, end, prev_start;
+  unsigned int i, j, expected, found;
+
+  for(i = 0; i < NB_QUERIES; i++)
+    {
+      start = random() % VALUE_RANGE;
+      end = start + random() % (VALUE_RANGE / 20);
+
+      expected = 0;
+      for(j = 0; j < NB_NODES; j++)
+        if(locks[j].in_tree && locks[j].start <= end && locks[j].end >= start)
+          expected += 1;
+
+      found = 0;
+      prev_start = 0;
+      for(node = itree_first_overlap(tree, start, end);
+          node != NULL;
+          node = itree_next_overlap(node, start, end))
+        {
+          plock = itree_entry(node, test_lock_t, node);
+          if(!plock->in_tree || plock->start > end || plock->end < start)
+            failed("overlap lookup returned a wrong node");
+          if(node->start < prev_start)
+            failed("overlap lookup out of order");
+          prev_start = node->start;
+          found += 1;
+        }
+
+      if(found != expected)
+        {
+          LogTest("[%llu, %llu]: found %u intervals, expected %u",
+                  (unsigned long long)start, (unsigned long long)end, found, expected);
+          failed("overlap lookup missed intervals");
+        }
+    }
+}                               /* check_queries */
+
+static void basic_checks(void)
+{
+  struct itree tree;
+  struct itree_node *node, *next;
+  uint64_t count;
+  unsigned int i, round;
+
+  itree_init(&tree);
+
+  for(i = 0; i < NB_NODES; i++)
+    {
+      locks[i].start = random() % VALUE_RANGE;
+      /* A few intervals are identical, a few go up to the end of the file */
+      if(i % 100 == 1)
+        locks[i].start = locks[i - 1].start;
+      locks[i].end = (i % 97 == 0) ? UINT64_MAX
+          : locks[i].start + random() % (VALUE_RANGE / 50);
+      if(i % 100 == 1)
+        locks[i].end = locks[i - 1].end;
+
+      itree_insert(&tree, &locks[i].node, locks[i].start, locks[i].end);
+      locks[i].in_tree = 1;
+    }
+
+  for(round = 0; round < NB_ROUNDS; round++)
+    {
+      count = 0;
+      check_subtree(tree.root, NULL, &count);
+      if(count != tree.size)
+        failed("bad size");
+
+      check_queries(&tree);
+
+      /* Remove some intervals while walking them, move some others */
+      for(node = itree_first(&tree); node != NULL; node = next)
+        {
+          test_lock_t *plock = itree_entry(node, test_lock_t, node);
+
+          next = itree_next(node);
+
+          if(random() % 4 == 0)
+            {
+              itree_remove(&tree, node);
+              plock->in_tree = 0;
+            }
+        }
+
+      for(i = 0; i < NB_NODES; i++)
+        {
+          if(locks[i].in_tree && random() % 8 == 0)
+            {
+              itree_remove(&tree, &locks[i].node);
+              locks[i].start = random() % VALUE_RANGE;
+              locks[i].end = locks[i].start + random() % (VALUE_RANGE / 50);
+              itree_insert(&tree, &locks[i].node, locks[i].start, locks[i].end);
+            }
+          else if(!locks[i].in_tree && random() % 2 == 0)
+            {
+              itree_insert(&tree, &locks[i].node, locks[i].start, locks[i].end);
+              locks[i].in_tree = 1;
+            }
+        }
+    }
+
+  for(i = 0; i < NB_NODES; i++)
+    if(locks[i].in_tree)
+      {
+        itree_remove(&tree, &locks[i].node);
+        locks[i].in_tree = 0;
+      }
+
+  if(!itree_empty(&tree) || tree.size != 0)
+    failed("tree is not empty after removing every node");
+}                               /* basic_checks */
+
+static inline int conflicts(test_lock_t * plock, unsigned int owner, int exclusive)
+{
+  return (plock->exclusive || exclusive) && plock->owner != owner;
+}                               /* conflicts */
+
+/* Lock storm through a linked list */
+static double storm_list(unsigned int nb_locks, unsigned int *pnb_conflicts)
+{
+  struct glist_head list;
+  struct glist_head *glist, *glistn;
+  struct timeval start, end;
+  test_lock_t *plock;
+  unsigned int i, owner;
+  uint64_t lstart, lend;
+  int conflict;
+
+  init_glist(&list);
+  *pnb_conflicts = 0;
+
+  gettimeofday(&start, NULL);
+
+  for(i = 0; i < nb_locks; i++)
+    {
+      owner = i % NB_OWNERS;
+      lstart = (uint64_t) i * RECORD_SIZE;
+      lend = lstart + RECORD_SIZE - 1;
+
+      /* Another rank tries the same record first */
+      conflict = 0;
+      glist_for_each(glist, &list)
+        {
+          plock = glist_entry(glist, test_lock_t, list);
+          if(plock->start <= lend && plock->end >= lstart
+             && conflicts(plock, owner + 1, 1))
+            {
+              conflict = 1;
+              break;
+            }
+        }
+      *pnb_conflicts += conflict;
+
+      conflict = 0;
+      glist_for_each(glist, &list)
+        {
+          plock = glist_entry(glist, test_lock_t, list);
+          if(plock->start <= lend && plock->end >= lstart
+             && conflicts(plock, owner, 1))
+            {
+              conflict = 1;
+              break;
+            }
+        }
+      if(conflict)
+        failed("unexpected conflict in the list");
+
+      locks[i].owner = owner;
+      locks[i].exclusive = 1;
+      locks[i].start = lstart;
+      locks[i].end = lend;
+      glist_add_tail(&list, &locks[i].list);
+    }
+
+  /* Every rank unlocks its records */
+  for(i = 0; i < nb_locks; i++)
+    {
+      owner = i % NB_OWNERS;
+      lstart = (uint64_t) i * RECORD_SIZE;
+      lend = lstart + RECORD_SIZE - 1;
+
+      glist_for_each_safe(glist, glistn, &list)
+        {
+          plock = glist_entry(glist, test_lock_t, list);
+          if(plock->owner == owner && plock->start <= lend && plock->end >= lstart)
+            glist_del(&plock->list);
+        }
+    }
+
+  gettimeofday(&end, NULL);
+
+  if(!glist_empty(&list))
+    failed("list is not empty after the storm");
+
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}                               /* storm_list */
+
+/* Same lock storm through the interval tree */
+static double storm_tree(unsigned int nb_locks, unsigned int *pnb_conflicts)
+{
+  struct itree tree;
+  struct itree_node *node, *next;
+  struct timeval start, end;
+  test_lock_t *plock;
+  unsigned int i, owner;
+  uint64_t lstart, lend;
+  int conflict;
+
+  itree_init(&tree);
+  *pnb_conflicts = 0;
+
+  gettimeofday(&start, NULL);
+
+  for(i = 0; i < nb_locks; i++)
+    {
+      owner = i % NB_OWNERS;
+      lstart = (uint64_t) i * RECORD_SIZE;
+      lend = lstart + RECORD_SIZE - 1;
+
+      conflict = 0;
+      for(node = itree_first_overlap(&tree, lstart, lend);
+          node != NULL;
+          node = itree_next_overlap(node, lstart, lend))
+        if(conflicts(itree_entry(node, test_lock_t, node), owner + 1, 1))
+          {
+            conflict = 1;
+            break;
+          }
+      *pnb_conflicts += conflict;
+
+      for(node = itree_first_overlap(&tree, lstart, lend);
+          node != NULL;
+          node = itree_next_overlap(node, lstart, lend))
+        if(conflicts(itree_entry(node, test_lock_t, node), owner, 1))
+          failed("unexpected conflict in the tree");
+
+      locks[i].owner = owner;
+      locks[i].exclusive = 1;
+      locks[i].start = lstart;
+      locks[i].end = lend;
+      itree_insert(&tree, &locks[i].node, lstart, lend);
+    }
+
+  for(i = 0; i < nb_locks; i++)
+    {
+      owner = i % NB_OWNERS;
+      lstart = (uint64_t) i * RECORD_SIZE;
+      lend = lstart + RECORD_SIZE - 1;
+
+      for(node = itree_first_overlap(&tree, lstart, lend); node != NULL; node = next)
+        {
+          next = itree_next_overlap(node, lstart, lend);
+          plock = itree_entry(node, test_lock_t, node);
+          if(plock->owner == owner)
+            itree_remove(&tree, node);
+        }
+    }
+
+  gettimeofday(&end, NULL);
+
+  if(!itree_empty(&tree))
+    failed("tree is not empty after the storm");
+
+  return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+}                               /* storm_tree */
+
+int main(int argc, char *argv[])
+{
+  unsigned int nb_locks;
+  unsigned int list_conflicts, tree_conflicts;
+  double list_time, tree_time;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_interval_tree");
+
+  srandom(1);
+
+  if((locks = (test_lock_t *) calloc(8192, sizeof(test_lock_t))) == NULL)
+    failed("no memory");
+
+  /* Basic checks */
+  basic_checks();
+  LogTest("Basic checks OK");
+
+  /* Benchmark */
+  for(nb_locks = 1024; nb_locks <= 8192; nb_locks *= 2)
+    {
+      list_time = storm_list(nb_locks, &list_conflicts);
+      tree_time = storm_tree(nb_locks, &tree_conflicts);
+
+      if(list_conflicts != tree_conflicts)
+        failed("list and tree disagree on conflicts");
+
+      LogTest("%u locks by %u owners: list %.3fs (%.0f ops/s), interval tree %.3fs (%.0f ops/s)",
+              nb_locks, NB_OWNERS,
+              list_time, 3 * nb_locks / list_time,
+              tree_time, 3 * nb_locks / tree_time);
+    }
+
+  free(locks);
+
+  /* Tous les tests sont ok */
+  LogTest("\n-----------------------------------------");
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}                               /* main */
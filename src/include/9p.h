@@ -46,6 +46,7 @@ typedef uint64_t u64;
 #define PRIME_9P 17 
 
 #define _9P_PORT 564
+#define _9P_NB_IO_THREADS 4
 #define _9P_SEND_BUFFER_SIZE 65560
 #define _9P_RECV_BUFFER_SIZE 65560
 #define _9p_READ_BUFFER_SIZE _9P_SEND_BUFFER_SIZE
@@ -271,6 +272,7 @@ typedef struct _9p_qid {
 typedef struct _9p_param__
 {
   unsigned short _9p_port ;
+  unsigned int   nb_io_threads ;   /* Threads reading the messages from all the connections */
 } _9p_parameter_t ;
 
 typedef struct _9p_fid__
@@ -292,6 +294,7 @@ typedef struct _9p_conn__
 {
   long int        sockfd ;
   struct timeval  birth;  /* This is useful if same sockfd is reused on socket's close/open  */
+  u32             refcount ; /* One for the I/O thread, one per request being processed */
   _9p_fid_t       fids[_9P_FID_PER_CONN] ;
 } _9p_conn_t ;
 
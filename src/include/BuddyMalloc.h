@@ -254,6 +254,11 @@ typedef struct buddy_stats__
  */
 void BuddyGetStats(buddy_stats_t * budd_stats);
 
+/**
+ *  Get the memory space allocated by all the threads.
+ */
+size_t BuddyGetTotalMemSpace(void);
+
 #ifdef _DEBUG_MEMLEAKS
 
 /**
@@ -127,9 +127,12 @@ typedef struct
 #define FSAL_OP_CONTEXT_TO_UID( pcontext ) ( pcontext->credential.user )
 #define FSAL_OP_CONTEXT_TO_GID( pcontext ) ( pcontext->credential.group )
 
+#define VFS_READDIR_THREADS_DEFAULT 8
+
 typedef struct
 {
   char vfs_mount_point[MAXPATHLEN];
+  unsigned int readdir_threads;         /* threads getting the attributes of directory entries */
 } vfsfs_specific_initinfo_t;
 
 /**< directory cookie */
@@ -41,6 +41,8 @@
 #include <rbt_node.h>
 #include <rbt_tree.h>
 #include <pthread.h>
+#include <stdint.h>
+#include "abstract_atomic.h"
 #include "RW_Lock.h"
 #include "HashData.h"
 #include "log.h"
@@ -56,6 +58,16 @@ typedef struct hashparameter__ *p_hash_parameter_t;
 
 typedef int (*ref_func)(void *);
 
+/**
+ * Storage used behind the HashTable API. Both split the table into
+ * index_size partitions selected by hash_func_key (or hash_func_both).
+ */
+typedef enum hash_table_backend__
+{
+  HASHTABLE_BACKEND_RBT = 0,    /**< One red-black tree per partition (default) */
+  HASHTABLE_BACKEND_OPEN = 1    /**< One resizable open addressing array per partition */
+} hash_table_backend_t;
+
 typedef struct hashparameter__
 {
   unsigned int index_size;                                    /**< Number of rbtree managed, this MUST be a prime number. */
@@ -69,6 +81,8 @@ typedef struct hashparameter__
   int (*key_to_str) (hash_buffer_t *, char *);                                  /**< Function used to convert a key to a string. */
   int (*val_to_str) (hash_buffer_t *, char *);                                  /**< Function used to convert a value to a string. */
   char *name;                                                                   /**< Name of this hash table. */
+  hash_table_backend_t backend;                                                 /**< How entries are stored. */
+  int inline_keys;                                                              /**< TRUE if pdata points to the len bytes of the keys, which may then be copied (open addressing). */
 } hash_parameter_t;
 
 typedef unsigned long (*hash_function_t) (hash_parameter_t *, hash_buffer_t *);
@@ -105,6 +119,37 @@ typedef struct hashstat__
   hash_stat_computed_t computed;  /**< Statistics computed when HashTable_GetStats is called. */
 } hash_stat_t;
 
+/* Keys up to this size are copied into the open addressing slots of the
+ * tables with parameter.inline_keys set, they are then looked up without any
+ * lock. compare_key must only read the len bytes of such keys, as it is given
+ * the copy. The tables whose keys are values held in pdata itself leave
+ * inline_keys unset and always take the lock. */
+#define HASHTABLE_INLINE_KEY_SIZE 32
+
+typedef struct hash_open_slot__
+{
+  hash_data_t data;                              /**< Key and value, as provided by the caller */
+  unsigned int inline_len;                       /**< Length of the inline copy of the key, 0 if none */
+  char inline_key[HASHTABLE_INLINE_KEY_SIZE];    /**< Copy of the key, zero padded */
+} hash_open_slot_t;
+
+typedef struct hash_open_array__
+{
+  unsigned int size;                             /**< Number of slots, a power of 2 */
+  uint64_t *fingerprint;                         /**< Per slot: 0 if empty, 1 if deleted, else key tag */
+  hash_open_slot_t *slot;                        /**< Per slot: the entry */
+  struct hash_open_array__ *retired;             /**< Arrays this one replaced, until no lockless reader may use them */
+} hash_open_array_t;
+
+typedef struct hash_open_partition__
+{
+  uint32_t seq;                                  /**< Odd while a writer modifies the partition */
+  uint32_t readers;                              /**< Lockless readers in the partition */
+  hash_open_array_t *array;                      /**< Current slot array */
+  unsigned int nb_used;                          /**< Slots that are not empty (live or deleted) */
+  rw_lock_t lock;                                /**< Serializes writers, and readers of long keys */
+} __attribute__ ((aligned(CACHE_LINE_SIZE))) hash_open_partition_t;
+
 typedef struct hashtable__
 {
   hash_parameter_t parameter;           /**< Definition parameter for the HashTable */
@@ -113,6 +158,7 @@ typedef struct hashtable__
   rw_lock_t *array_lock;                /**< Array of rw-locks for MT-safe management */
   struct prealloc_pool *node_prealloc;  /**< Pre-allocated nodes, ready to use for new entries (array of size parameter.nb_node_prealloc) */
   struct prealloc_pool *pdata_prealloc; /**< Pre-allocated pdata buffers  ready to use for new entries */
+  hash_open_partition_t *open_partition; /**< Array of open addressing partitions (HASHTABLE_BACKEND_OPEN only) */
 } hash_table_t;
 
 typedef enum hashtable_set_how__
@@ -146,11 +192,15 @@ int HashTable_Del(hash_table_t * ht, hash_buffer_t * buffkey,
                   hash_buffer_t * p_usedbuffkey, hash_buffer_t * p_usedbuffdata);
 int HashTable_Delall(hash_table_t * ht,
 		     int (*free_func)(hash_buffer_t, hash_buffer_t) );
+unsigned int HashTable_Walk(hash_table_t * ht, unsigned int first,
+                            int (*walk_func)(hash_data_t *, void *), void *arg);
 #define HashTable_Set( ht, buffkey, buffval ) HashTable_Test_And_Set( ht, buffkey, buffval, HASHTABLE_SET_HOW_SET_OVERWRITE )
 void HashTable_GetStats(hash_table_t * ht, hash_stat_t * hstat);
 void HashTable_Log(log_components_t component, hash_table_t * ht);
 void HashTable_Print(hash_table_t * ht);
 unsigned int HashTable_GetSize(hash_table_t * ht);
+int HashTable_BackendFromStr(char *str, hash_table_backend_t * pbackend);
+const char *HashTable_BackendToStr(hash_table_backend_t backend);
 
 /* The following function allows an atomic fetch hash only once,
  * If the entry is found, it is removed.
@@ -171,5 +221,24 @@ int HashTable_DelRef(hash_table_t * ht, hash_buffer_t * buffkey,
                      hash_buffer_t * p_usedbuffkey, hash_buffer_t * p_usedbuffdata,
                      int (*put_ref)(hash_buffer_t *) );
 
+/*
+ * Open addressing backend (HashOpen.c), called by the functions above when
+ * parameter.backend is HASHTABLE_BACKEND_OPEN.
+ */
+int HashOpen_Init(hash_table_t * ht);
+int HashOpen_Test_And_Set(hash_table_t * ht, hash_buffer_t * buffkey,
+                          hash_buffer_t * buffval, hashtable_set_how_t how);
+int HashOpen_GetRef(hash_table_t * ht, hash_buffer_t * buffkey, hash_buffer_t * buffval,
+                    void (*get_ref)(hash_buffer_t *) );
+int HashOpen_Get_and_Del(hash_table_t * ht, hash_buffer_t * buffkey,
+                         hash_buffer_t * buffval, hash_buffer_t * buff_used_key);
+int HashOpen_DelRef(hash_table_t * ht, hash_buffer_t * buffkey,
+                    hash_buffer_t * p_usedbuffkey, hash_buffer_t * p_usedbuffdata,
+                    int (*put_ref)(hash_buffer_t *) );
+int HashOpen_Delall(hash_table_t * ht, int (*free_func)(hash_buffer_t, hash_buffer_t) );
+unsigned int HashOpen_Walk(hash_table_t * ht, unsigned int first,
+                           int (*walk_func)(hash_data_t *, void *), void *arg);
+void HashOpen_Log(log_components_t component, hash_table_t * ht, int to_stderr);
+
 extern hash_table_t * ht_client_id;
 #endif                          /* _HASHTABLE_H */
@@ -32,17 +32,29 @@
 #define _RW_LOCK_H
 
 #include <pthread.h>
+#include <stdint.h>
 #include "log.h"
 #include "common_utils.h"
+#include "abstract_atomic.h"
 
+/* Number of reader counters of a lock. Each counter sits on its own cache
+ * line, threads are spread over them so that readers running on different
+ * cores do not write to the same line. */
+#define RW_LOCK_STRIPES 4
+
+typedef struct _RW_LOCK_STRIPE
+{
+  uint32_t nbr_active;          /* Readers counted here, modulo 2^32 */
+  char pad[CACHE_LINE_SIZE - sizeof(uint32_t)];
+} rw_lock_stripe_t;
 
 /* Type representing the lock itself */
 typedef struct _RW_LOCK
 {
-  unsigned int nbr_active;
-  unsigned int nbr_waiting;
+  rw_lock_stripe_t readers[RW_LOCK_STRIPES];
+  uint32_t nbw;                 /* Writers active or waiting, readers wait while non zero */
   unsigned int nbw_active;
-  unsigned int nbw_waiting;
+  unsigned int nbr_waiting;
   pthread_mutex_t mutexProtect;
   pthread_cond_t condWrite;
   pthread_cond_t condRead;
@@ -51,6 +63,7 @@ typedef struct _RW_LOCK
 int rw_lock_init(rw_lock_t * plock);
 int rw_lock_destroy(rw_lock_t * plock);
 int P_w(rw_lock_t * plock);
+int P_w_try(rw_lock_t * plock);
 int V_w(rw_lock_t * plock);
 int P_r(rw_lock_t * plock);
 int V_r(rw_lock_t * plock);
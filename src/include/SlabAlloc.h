@@ -0,0 +1,122 @@
+/*
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    SlabAlloc.h
+ * \brief   Slab allocator with per-CPU magazines.
+ *
+ * SlabAlloc: memory allocator shared by all the threads. Each size class,
+ * and each type of pooled entries, has a slab cache. The objects are taken
+ * from and given back to magazines of the CPU the thread runs on, so that
+ * an object allocated by a thread and freed by another costs no more than
+ * one freed by the thread which allocated it.
+ *
+ */
+
+#ifndef _SLAB_ALLOC_H
+#define _SLAB_ALLOC_H
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/** Largest size served by the size classes, above it malloc is used. */
+#define SLAB_MAX_SMALL_SIZE   32768
+
+/** Length of the names of the caches, in the stats. */
+#define SLAB_NAME_LEN         64
+
+typedef struct slab_cache__ slab_cache_t;
+
+typedef void (*slab_constructor_t) (void *entry);
+
+/**
+ * SlabMalloc: allocates at least Size bytes, aligned on 16 bytes.
+ * Returns NULL, errno set, if no memory is available.
+ */
+void *SlabMalloc(size_t Size);
+
+void *SlabCalloc(size_t NumberOfElements, size_t ElementSize);
+
+void *SlabRealloc(void *ptr, size_t Size);
+
+char *SlabStr_Dup(const char *Str);
+
+/**
+ * SlabFree: frees memory got from any of the Slab functions,
+ * by any thread. ptr may be NULL.
+ */
+void SlabFree(void *ptr);
+
+/**
+ * SlabCacheCreate: gets the cache for the entries of a type.
+ * The pools of the same type, size and constructor share their cache.
+ * The constructor is called once per entry, when it is first carved out
+ * of a slab: the entries keep their state from one use to the next, and
+ * the slabs of a cache with a constructor are never given back.
+ */
+slab_cache_t *SlabCacheCreate(const char *name, size_t size, slab_constructor_t ctor);
+
+void *SlabCacheAlloc(slab_cache_t * cache);
+
+void SlabCacheFree(slab_cache_t * cache, void *ptr);
+
+/**
+ * SlabReclaim: gives back to the system the memory left unused since the
+ * previous call: the magazines the depots did not need, and the slabs
+ * with no object in use.
+ */
+void SlabReclaim(void);
+
+/** Stats of a cache. */
+typedef struct slab_stats__
+{
+  char name[SLAB_NAME_LEN];
+  size_t size;                          /* size of the objects */
+  unsigned long long nb_alloc;          /* objects allocated */
+  unsigned long long nb_free;           /* objects freed */
+  unsigned int nb_slabs;                /* slabs mapped (current) */
+  unsigned int wm_nb_slabs;             /* high watermark of slabs mapped */
+  unsigned long long nb_slabs_released; /* slabs given back to the system */
+  size_t mem_space;                     /* memory of the slabs */
+} slab_stats_t;
+
+/**
+ * SlabGetStats: gets the stats of the index-th cache.
+ * Returns 0, or ENOENT if there is no such cache.
+ */
+int SlabGetStats(unsigned int index, slab_stats_t * pstats);
+
+/**
+ * SlabGetTotalMemSpace: memory got from the system, slabs and
+ * allocations larger than SLAB_MAX_SMALL_SIZE.
+ */
+size_t SlabGetTotalMemSpace(void);
+
+void SlabDumpStats(FILE * output);
+
+#endif                          /* _SLAB_ALLOC_H */
@@ -0,0 +1,81 @@
+/*
+ *
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    WorkQueue.h
+ * \brief   Lock free multi producers / single consumer work queues.
+ *
+ * WorkQueue.h : A bounded ring of pointers. Any number of threads may push
+ * into it concurrently, one single thread pops from it. Neither side takes
+ * a lock: producers reserve a cell with a compare and swap on the enqueue
+ * position, then publish it by bumping the cell's sequence number.
+ *
+ * The queue does not block. A consumer that wants to sleep when the queue
+ * is empty uses WorkQueue_PrepareSleep() under its own mutex, and producers
+ * call WorkQueue_NeedWakeup() after a push to know if they have to signal
+ * it. Only one producer is told to signal a given sleep, so a burst of
+ * pushes costs a single wake up.
+ *
+ */
+
+#ifndef _WORKQUEUE_H
+#define _WORKQUEUE_H
+
+#include <stdint.h>
+#include "abstract_atomic.h"
+
+typedef struct work_queue_cell__
+{
+  uint64_t seq;                 /**< Position this cell is ready for */
+  void *pdata;                  /**< The queued item */
+} work_queue_cell_t;
+
+typedef struct work_queue__
+{
+  uint64_t enqueue_pos __attribute__ ((aligned(CACHE_LINE_SIZE)));  /**< Written by producers */
+  uint64_t dequeue_pos __attribute__ ((aligned(CACHE_LINE_SIZE)));  /**< Written by the consumer */
+  uint32_t sleeping __attribute__ ((aligned(CACHE_LINE_SIZE)));     /**< Consumer waits for a signal */
+  uint64_t nb_full;             /**< How many pushes found the queue full */
+  uint64_t mask __attribute__ ((aligned(CACHE_LINE_SIZE)));        /**< Number of cells - 1 */
+  work_queue_cell_t *cells;
+} work_queue_t;
+
+int WorkQueue_Init(work_queue_t * pqueue, unsigned int size);
+void WorkQueue_Destroy(work_queue_t * pqueue);
+int WorkQueue_Push(work_queue_t * pqueue, void *pdata);
+void *WorkQueue_Pop(work_queue_t * pqueue);
+unsigned int WorkQueue_Length(work_queue_t * pqueue);
+int WorkQueue_IsEmpty(work_queue_t * pqueue);
+int WorkQueue_PrepareSleep(work_queue_t * pqueue);
+void WorkQueue_CancelSleep(work_queue_t * pqueue);
+int WorkQueue_NeedWakeup(work_queue_t * pqueue);
+
+/* Possible errors */
+#define WORKQUEUE_SUCCESS         0
+#define WORKQUEUE_MALLOC_ERROR    1
+#define WORKQUEUE_FULL            2
+#define WORKQUEUE_INVALID_ARGUMENT 3
+
+#endif                          /* _WORKQUEUE_H */
@@ -0,0 +1,174 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    abstract_atomic.h
+ * \brief   Atomic operations on integers and pointers.
+ *
+ * abstract_atomic.h : Thin wrappers around the compiler's atomic builtins,
+ * so that the rest of the code does not depend on a given compiler.
+ * Every operation below is sequentially consistent. Recent compilers provide
+ * plain loads and stores with that guarantee, older ones fall back on the
+ * __sync builtins, which are full barriers.
+ *
+ */
+
+#ifndef _ABSTRACT_ATOMIC_H
+#define _ABSTRACT_ATOMIC_H
+
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE 64
+
+/* Full memory barrier */
+static inline void atomic_barrier(void)
+{
+  __sync_synchronize();
+}
+
+/* Loads and stores, ordered with respect to other atomic operations */
+#ifdef __ATOMIC_SEQ_CST
+static inline uint32_t atomic_fetch_uint32_t(uint32_t * var)
+{
+  return __atomic_load_n(var, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t atomic_fetch_uint64_t(uint64_t * var)
+{
+  return __atomic_load_n(var, __ATOMIC_SEQ_CST);
+}
+
+static inline void *atomic_fetch_voidptr(void **var)
+{
+  return __atomic_load_n(var, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_store_uint32_t(uint32_t * var, uint32_t val)
+{
+  __atomic_store_n(var, val, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_store_uint64_t(uint64_t * var, uint64_t val)
+{
+  __atomic_store_n(var, val, __ATOMIC_SEQ_CST);
+}
+
+static inline void atomic_store_voidptr(void **var, void *val)
+{
+  __atomic_store_n(var, val, __ATOMIC_SEQ_CST);
+}
+#else
+static inline uint32_t atomic_fetch_uint32_t(uint32_t * var)
+{
+  return __sync_fetch_and_add(var, 0);
+}
+
+static inline uint64_t atomic_fetch_uint64_t(uint64_t * var)
+{
+  return __sync_fetch_and_add(var, 0);
+}
+
+static inline void *atomic_fetch_voidptr(void **var)
+{
+  return __sync_fetch_and_add(var, 0);
+}
+
+static inline void atomic_store_uint32_t(uint32_t * var, uint32_t val)
+{
+  (void)__sync_lock_test_and_set(var, val);
+  __sync_synchronize();
+}
+
+static inline void atomic_store_uint64_t(uint64_t * var, uint64_t val)
+{
+  (void)__sync_lock_test_and_set(var, val);
+  __sync_synchronize();
+}
+
+static inline void atomic_store_voidptr(void **var, void *val)
+{
+  (void)__sync_lock_test_and_set(var, val);
+  __sync_synchronize();
+}
+#endif
+
+/* Arithmetic, the returned value is the new one */
+static inline uint32_t atomic_add_uint32_t(uint32_t * var, uint32_t val)
+{
+  return __sync_add_and_fetch(var, val);
+}
+
+static inline uint32_t atomic_sub_uint32_t(uint32_t * var, uint32_t val)
+{
+  return __sync_sub_and_fetch(var, val);
+}
+
+static inline uint32_t atomic_inc_uint32_t(uint32_t * var)
+{
+  return __sync_add_and_fetch(var, 1);
+}
+
+static inline uint32_t atomic_dec_uint32_t(uint32_t * var)
+{
+  return __sync_sub_and_fetch(var, 1);
+}
+
+static inline uint64_t atomic_add_uint64_t(uint64_t * var, uint64_t val)
+{
+  return __sync_add_and_fetch(var, val);
+}
+
+static inline uint64_t atomic_sub_uint64_t(uint64_t * var, uint64_t val)
+{
+  return __sync_sub_and_fetch(var, val);
+}
+
+static inline uint64_t atomic_inc_uint64_t(uint64_t * var)
+{
+  return __sync_add_and_fetch(var, 1);
+}
+
+static inline uint64_t atomic_dec_uint64_t(uint64_t * var)
+{
+  return __sync_sub_and_fetch(var, 1);
+}
+
+/* Compare and swap, return non zero if *var was oldval and is now newval */
+static inline int atomic_cas_uint32_t(uint32_t * var, uint32_t oldval, uint32_t newval)
+{
+  return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+
+static inline int atomic_cas_uint64_t(uint64_t * var, uint64_t oldval, uint64_t newval)
+{
+  return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+
+static inline int atomic_cas_voidptr(void **var, void *oldval, void *newval)
+{
+  return __sync_bool_compare_and_swap(var, oldval, newval);
+}
+
+#endif                          /* _ABSTRACT_ATOMIC_H */
@@ -88,6 +88,8 @@ typedef struct cache_content_opened_file__
 {
   int local_fd;
   time_t last_op;
+  off_t seq_offset;             /**< End of the last read, to detect sequential reads */
+  off_t readahead_end;          /**< End of the last readahead window                  */
 } cache_content_opened_file_t;
 
 typedef enum cache_content_sync_state__
@@ -119,6 +121,8 @@ typedef struct cache_content_client_parameter__
   unsigned int max_fd;                        /**< Max fd open per client */
   time_t retention;                           /**< Fd retention duration */
   unsigned int use_fd_cache;                  /** Do we cache fd or not ? */
+  unsigned int aio_threads;                   /**< Readahead threads of the local cache, 0 for no readahead */
+  size_t readahead_size;                      /**< Readahead window on sequential reads, 0 to disable */
 } cache_content_client_parameter_t;
 
 #define CACHE_CONTENT_SPEC_DATA_SIZE 400
@@ -143,6 +147,7 @@ typedef struct cache_content_local_entry__
   char cache_path_index[MAXPATHLEN];                               /**< Path to the index file (for crash recovery) */
   cache_content_opened_file_t opened_file;                         /**< Opened file descriptor related to the entry */
   cache_content_sync_state_t sync_state;                           /**< Is this entry synchronized ?                */
+  unsigned int write_count;                                        /**< Changes of the content, to know if a flush is up to date */
 } cache_content_local_entry_t;
 
 typedef struct cache_content_entry__
@@ -179,6 +184,7 @@ typedef struct cache_content_client__
   time_t retention;                                 /**< Fd retention duration                                    */
   unsigned int use_fd_cache;                        /**< Do we cache fd or not ?                                  */
   int fd_gc_needed;                                 /**< Should we perform fd gc ?                                */
+  size_t readahead_size;                            /**< Readahead window on sequential reads                     */
 } cache_content_client_t;
 
 typedef enum cache_content_op__
@@ -245,6 +251,12 @@ typedef enum cache_content_refresh_how__
   DEFAULT_REFRESH
 } cache_content_refresh_how_t;
 
+/* Readahead on the local cache files */
+#define CACHE_CONTENT_AIO_READAHEAD_SLOTS 256
+
+/* Buffer of the copy of a data file to its flush snapshot */
+#define CACHE_CONTENT_FLUSH_BUFFER_SIZE 65536
+
 typedef struct cache_content_flush_thread_data__
 {
   unsigned int thread_pos;
@@ -322,6 +334,9 @@ cache_content_status_t cache_content_sync_all(cache_content_client_t * pclient,
                                               fsal_op_context_t * pcontext,
                                               cache_content_status_t * pstatus);
 
+int cache_content_aio_init(unsigned int nb_threads);
+void cache_content_aio_readahead(int fd, off_t offset, size_t size);
+
 cache_content_status_t cache_content_read_conf_client_parameter(config_file_t in_config,
                                                                 cache_content_client_parameter_t
                                                                 * pparam);
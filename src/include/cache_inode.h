@@ -51,6 +51,7 @@
 #include "HashData.h"
 #include "HashTable.h"
 #include "avltree.h"
+#include "interval_tree.h"
 #include "fsal.h"
 #ifdef _USE_MFSL
 #include "mfsl.h"
@@ -79,7 +80,13 @@ typedef struct cache_inode_client_t cache_inode_client_t;
 /* #define CHILDREN_ARRAY_SIZE 64 */
 #define CHILDREN_ARRAY_SIZE 16
 
-#define CACHE_INODE_UNSTABLE_BUFFERSIZE 100*1024*1024
+/* Default budget of the unstable writes kept in memory, and how they are written behind */
+#define CACHE_INODE_DEFAULT_MAX_DIRTY          (256*1024*1024)
+#define CACHE_INODE_DEFAULT_WRITE_BEHIND_CHUNK (1024*1024)
+#define CACHE_INODE_DEFAULT_WRITE_BEHIND_DELAY 5
+
+/* Default budget of the fds kept open by the cache, for all the workers */
+#define CACHE_INODE_DEFAULT_MAX_FD 1024
 #define DIR_ENTRY_NAMLEN 1024
 
 #define CACHE_INODE_TIME( __pentry ) (__pentry->internal_md.read_time > __pentry->internal_md.mod_time)?__pentry->internal_md.read_time:__pentry->internal_md.mod_time
@@ -180,10 +187,13 @@ typedef struct cache_inode_client_parameter__
   time_t grace_period_dirent;                          /**< Cached dirent grace period                       */
   unsigned int getattr_dir_invalidation;               /**< Use getattr as cookie for directory invalidation */
   unsigned int use_test_access;                        /**< Is FSAL_test_access to be used ?                 */
-  unsigned int max_fd;                                 /**< Max fd open per client                           */
+  unsigned int max_fd;                                 /**< Max fd open by the cache, all clients together   */
   time_t retention;                                    /**< Fd retention duration                            */
   unsigned int use_fd_cache;                           /** Do we cache fd or not ?                           */
   unsigned int use_fsal_hash ;                         /** Do we rely on FSAL to hash handle or not ?        */
+  uint64_t max_dirty;                                  /**< Unstable writes kept in memory, in bytes         */
+  uint64_t write_behind_chunk;                         /**< Size and alignment of the writes behind          */
+  time_t write_behind_delay;                           /**< Age of the partial chunks written behind         */
 } cache_inode_client_parameter_t;
 
 typedef struct cache_inode_opened_file__
@@ -196,8 +206,33 @@ typedef struct cache_inode_opened_file__
   unsigned int fileno;
   fsal_openflags_t openflags;
   time_t last_op;
+  unsigned int refcount;            /**< I/Os in progress on the fd, it is not closed before they end */
+  struct glist_head fd_lru;         /**< In the LRU of the open files, while open                     */
+  cache_entry_t *pentry;            /**< The file the fd is open on                                   */
 } cache_inode_opened_file_t;
 
+typedef struct cache_inode_fd_stat__
+{
+  uint64_t nb_open;                 /**< Files opened in the FSAL                     */
+  uint64_t nb_close;                /**< Files closed in the FSAL                     */
+  uint64_t nb_reuse;                /**< Opens served by a file already open          */
+  uint64_t nb_evict;                /**< Files closed to stay within the budget       */
+  unsigned int nb_opened;           /**< Files open now                               */
+  unsigned int max_opened;          /**< Budget of open files                         */
+} cache_inode_fd_stat_t;
+
+typedef struct cache_inode_wb_stat__
+{
+  uint64_t nb_write;                /**< Unstable writes kept in memory               */
+  uint64_t nb_coalesced;            /**< Of them, merged into a dirty extent          */
+  uint64_t nb_flush;                /**< Extents written to the FSAL                  */
+  uint64_t nb_flushed_bytes;        /**< Bytes written to the FSAL                    */
+  uint64_t nb_throttled;            /**< Writes flushed by the worker, over budget    */
+  uint64_t nb_error;                /**< Extents the FSAL failed to write             */
+  uint64_t nb_dirty;                /**< Memory of the dirty extents now              */
+  uint64_t max_dirty;               /**< Budget of the dirty extents                  */
+} cache_inode_wb_stat_t;
+
 typedef enum cache_inode_file_type__
 { UNASSIGNED = 1,
   REGULAR_FILE = 2,
@@ -273,12 +308,19 @@ struct cache_inode_symlink__
   fsal_path_t content;                                    /**< Content of the link */
 };
 
-typedef struct cache_inode_unstable_data__
+typedef enum cache_inode_wb_state__
+{ CACHE_INODE_WB_IDLE = 0,
+  CACHE_INODE_WB_QUEUED = 1,
+  CACHE_INODE_WB_RUNNING = 2
+} cache_inode_wb_state_t;
+
+typedef struct cache_inode_io_range__
 {
-  caddr_t buffer;
-  uint64_t offset;
-  uint32_t length;
-} cache_inode_unstable_data_t;
+  struct glist_head io_list;                   /**< Link in the io_ranges of the file  */
+  uint64_t offset;                             /**< First byte of the I/O              */
+  uint64_t length;                             /**< Bytes read or written              */
+  cache_inode_io_direction_t direction;        /**< Overlapping writes are exclusive   */
+} cache_inode_io_range_t;
 
 struct cache_inode_dir_entry__
 {
@@ -300,14 +342,21 @@ struct cache_entry_t
   {
     struct cache_inode_file__
     {
-      cache_inode_opened_file_t open_fd;                             /**< Cached fsal_file_t for optimized access              */
+      cache_inode_opened_file_t open_fd;                             /**< Cached fsal_file_t for writes and locks              */
+      cache_inode_opened_file_t read_fd;                             /**< Cached fsal_file_t for reads, if open_fd cannot read */
       fsal_name_t *pname;                                            /**< Pointer to filename, for PROXY only                  */
       cache_entry_t *pentry_parent_open;                             /**< Parent associated with pname, for PROXY only         */
       void *pentry_content;                                          /**< Entry in file content cache (NULL if not cached)     */
       struct glist_head state_list;                                  /**< Pointers for state list                              */
       struct glist_head lock_list;                                   /**< Pointers for lock list                               */
+      struct itree lock_granted_tree;                                /**< Granted locks of lock_list, by range                 */
+      struct itree lock_blocked_tree;                                /**< Blocked locks of lock_list, by range                 */
       pthread_mutex_t lock_list_mutex;                               /**< Mutex to protect lock list                           */
-      cache_inode_unstable_data_t unstable_data;                     /**< Unstable data, for use with WRITE/COMMIT             */
+      struct cache_inode_write_behind__ *write_behind;              /**< Unstable writes, for WRITE/COMMIT (NULL if none)     */
+      pthread_mutex_t io_mutex;                                      /**< Protects io_ranges, write_behind, attrs set by I/O   */
+      pthread_cond_t io_cond;                                        /**< Signaled when an I/O range or an extent is released  */
+      struct glist_head io_ranges;                                   /**< Ranges of the I/O in progress                        */
+      unsigned int io_waiters;                                       /**< Number of I/O waiting for a range                    */
     } file;                                   /**< file related filed     */
 
     struct cache_inode_symlink__ *symlink;     /**< symlink related field  */
@@ -332,6 +381,9 @@ struct cache_entry_t
   cache_inode_internal_md_t internal_md;      /**< My metadata (from this cache's point of view)      */
   LRU_entry_t *gc_lru_entry;                  /**< related LRU entry in the LRU list used for GC      */
   LRU_list_t *gc_lru;                         /**< related LRU list for GC                            */    
+  cache_entry_t *clock_next;                  /**< next entry in the reclaimer's clock, NULL if out   */
+  cache_entry_t *clock_prev;                  /**< previous entry in the reclaimer's clock            */
+  unsigned int clock_referenced;              /**< used since the clock hand last passed              */
   
   /* XXX In the next step past asyncrhronous cache invalidates (i.e., invalidate
    * upcalls), we may wish to support removal of specific links to an entry, updating
@@ -398,7 +450,6 @@ struct cache_inode_client_t
   time_t time_of_last_gc_fd;                                       /**< Epoch time for the last file descriptor gc               */
   caddr_t pcontent_client;                                         /**< Pointer to cache content client                          */
   void *pworker;                                                   /**< Pointer to the information on the worker I belong to     */
-  unsigned int max_fd;                                             /**< Max fd open per client                                   */
   time_t retention;                                                /**< Fd retention duration                                    */
   unsigned int use_fd_cache;                                       /** Do we cache fd or not ?                                   */
   int fd_gc_needed;                                                /**< Should we perform fd gc ?                                */
@@ -415,6 +466,8 @@ typedef struct cache_inode_gc_policy__
   unsigned int lwmark_nb_entries;             /**< low water mark for cache_inode gc (number of entries)  */
   unsigned int run_interval;                  /**< garbagge collection run-time interval                  */
   unsigned int nb_call_before_gc;             /**< Number of call to be made before thinking about gc run */
+  size_t memory_hwmark;                       /**< high water mark for memory allocated, 0 if none        */
+  unsigned int reclaim_step_duration;         /**< time given to one reclaim step, in milliseconds        */
 } cache_inode_gc_policy_t;
 
 typedef struct cache_inode_param_gc__
@@ -491,6 +544,33 @@ typedef enum cache_inode_status_t
   CACHE_INODE_KILLED                = 42,
 } cache_inode_status_t;
 
+/* A range of unstable writes kept in memory, to be written behind */
+typedef struct cache_inode_dirty_extent__
+{
+  struct glist_head extent_list;               /**< Link in the extents of the file, by offset */
+  uint64_t offset;                             /**< First byte of the data                     */
+  uint64_t length;                             /**< Bytes of data                              */
+  uint64_t size;                               /**< Bytes allocated for the buffer             */
+  caddr_t buffer;                              /**< The data                                   */
+  time_t dirty_time;                           /**< When the extent was first written          */
+  unsigned int flushing;                       /**< Being written to the FSAL                  */
+  cache_inode_status_t status;                 /**< Error of its last write, retried by COMMIT */
+  unsigned int flush_gen;                      /**< The flush which got this error             */
+} cache_inode_dirty_extent_t;
+
+/* The unstable writes of a file, allocated with its first one */
+typedef struct cache_inode_write_behind__
+{
+  struct glist_head extents;                   /**< Dirty extents, by offset, disjoint         */
+  struct glist_head wb_list;                   /**< Link in the queue of write-behind          */
+  cache_inode_wb_state_t state;                /**< Under the mutex of the write-behind queue  */
+  unsigned int requeue;                        /**< Written to while RUNNING                   */
+  cache_inode_status_t status;                 /**< Error of a write behind, for next COMMIT   */
+  unsigned int flush_gen;                      /**< Flushes of the file, to try an extent once */
+  cache_entry_t *pentry;                       /**< The file                                   */
+  fsal_op_context_t context;                   /**< Credentials of the last unstable write     */
+} cache_inode_write_behind_t;
+
 const char *cache_inode_err_str(cache_inode_status_t err);
 
 #define inc_func_call(pclient, x)                       \
@@ -570,11 +650,26 @@ cache_inode_status_t cache_inode_close(cache_entry_t * pentry,
                                        cache_inode_status_t * pstatus);
 #endif
 
-#ifdef _USE_MFSL
-mfsl_file_t * cache_inode_fd(cache_entry_t * pentry);
-#else
-fsal_file_t * cache_inode_fd(cache_entry_t * pentry);
-#endif
+cache_inode_opened_file_t *cache_inode_fd_get(cache_entry_t * pentry,
+                                              cache_inode_client_t * pclient,
+                                              fsal_openflags_t openflags,
+                                              fsal_op_context_t * pcontext,
+                                              cache_inode_status_t * pstatus);
+
+cache_inode_opened_file_t *cache_inode_fd_pin(cache_entry_t * pentry);
+
+void cache_inode_fd_put(cache_inode_opened_file_t * pfd, cache_inode_client_t * pclient);
+
+void cache_inode_fd_discard(cache_inode_opened_file_t * pfd,
+                            cache_inode_client_t * pclient);
+
+void cache_inode_forget_fds(cache_entry_t * pentry, cache_inode_client_t * pclient);
+
+unsigned int cache_inode_close_idle_fds(cache_inode_client_t * pclient);
+
+void cache_inode_set_fd_cache_budget(unsigned int max_opened);
+
+void cache_inode_get_fd_cache_stats(cache_inode_fd_stat_t * pstat);
 
 cache_inode_status_t cache_inode_open(cache_entry_t * pentry,
                                       cache_inode_client_t * pclient,
@@ -800,6 +895,45 @@ cache_inode_status_t cache_inode_release_data_cache(cache_entry_t * pentry,
                                                     fsal_op_context_t * pcontext,
                                                     cache_inode_status_t * pstatus);
 
+void cache_inode_io_range_lock(cache_entry_t * pentry,
+                               cache_inode_io_range_t * prange,
+                               cache_inode_io_direction_t direction,
+                               uint64_t offset, uint64_t length);
+
+void cache_inode_io_range_unlock(cache_entry_t * pentry, cache_inode_io_range_t * prange);
+
+void cache_inode_set_write_behind_policy(uint64_t max_dirty, uint64_t chunk, time_t delay);
+
+void cache_inode_get_write_behind_stats(cache_inode_wb_stat_t * pstat);
+
+cache_inode_status_t cache_inode_dirty_write(cache_entry_t * pentry,
+                                             uint64_t offset,
+                                             fsal_size_t size,
+                                             caddr_t buffer,
+                                             cache_inode_client_t * pclient,
+                                             fsal_op_context_t * pcontext,
+                                             cache_inode_status_t * pstatus);
+
+cache_inode_status_t cache_inode_dirty_flush(cache_entry_t * pentry,
+                                             uint64_t offset,
+                                             uint64_t length,
+                                             cache_inode_client_t * pclient,
+                                             cache_inode_status_t * pstatus);
+
+cache_inode_status_t cache_inode_dirty_commit(cache_entry_t * pentry,
+                                              uint64_t offset,
+                                              uint64_t length,
+                                              cache_inode_client_t * pclient,
+                                              cache_inode_status_t * pstatus);
+
+void cache_inode_dirty_truncate(cache_entry_t * pentry, uint64_t length);
+
+uint64_t cache_inode_dirty_end(cache_entry_t * pentry);
+
+void cache_inode_forget_dirty(cache_entry_t * pentry);
+
+uint64_t cache_inode_write_behind_run(cache_inode_client_t * pclient, unsigned int timeout);
+
 cache_inode_status_t cache_inode_rdwr(cache_entry_t * pentry,
                                       cache_inode_io_direction_t read_or_write,
                                       fsal_seek_t * seek_descriptor,
@@ -859,6 +993,8 @@ cache_inode_status_t cache_inode_renew_entry(cache_entry_t * pentry,
                                              fsal_op_context_t * pcontext,
                                              cache_inode_status_t * pstatus);
 
+int cache_inode_renew_needed(cache_entry_t * pentry, cache_inode_client_t * pclient);
+
 cache_inode_status_t cache_inode_add_cached_dirent(cache_entry_t * pdir,
                                                    fsal_name_t * pname,
                                                    cache_entry_t * pentry_added,
@@ -883,6 +1019,8 @@ cache_inode_status_t cache_inode_valid(cache_entry_t * pentry,
                                        cache_inode_op_t op,
                                        cache_inode_client_t * pclient);
 
+void cache_inode_touch(cache_entry_t * pentry, cache_inode_client_t * pclient);
+
 cache_inode_status_t cache_inode_invalidate_all_cached_dirent(cache_entry_t *
                                                               pentry_parent,
                                                               hash_table_t * ht,
@@ -893,6 +1031,8 @@ cache_inode_status_t cache_inode_invalidate_all_cached_dirent(cache_entry_t *
 
 void cache_inode_set_attributes(cache_entry_t * pentry, fsal_attrib_list_t * pattr);
 
+void cache_inode_get_attributes(cache_entry_t * pentry, fsal_attrib_list_t * pattr);
+
 cache_inode_file_type_t cache_inode_fsal_type_convert(fsal_nodetype_t type);
 
 int cache_inode_type_are_rename_compatible(cache_entry_t * pentry_src,
@@ -928,6 +1068,15 @@ cache_inode_status_t cache_inode_gc(hash_table_t * ht,
 cache_inode_status_t cache_inode_gc_fd(cache_inode_client_t * pclient,
                                        cache_inode_status_t * pstatus);
 
+void cache_inode_clock_insert(cache_entry_t * pentry);
+void cache_inode_clock_remove(cache_entry_t * pentry);
+int cache_inode_gc_wait_pressure(unsigned int timeout);
+unsigned int cache_inode_gc_reclaim(hash_table_t * ht,
+                                    cache_inode_client_t * pclient,
+                                    unsigned int duration, int *pexhausted);
+void cache_inode_gc_give_back(cache_inode_client_t * pclient);
+void cache_inode_gc_take_back(cache_inode_client_t * pclient);
+
 cache_inode_status_t cache_inode_kill_entry( cache_entry_t * pentry,
                                              cache_inode_lock_how_t lock_how,
                                              hash_table_t * ht,
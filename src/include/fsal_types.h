@@ -216,9 +216,26 @@ struct user_credentials {
   uid_t user;
   gid_t group;
   int nbgroups;
+  gid_t *ext_groups;            /* all the groups, if more than FSAL_NGROUPS_MAX */
   gid_t alt_groups[FSAL_NGROUPS_MAX];
 };
 
+/* The nbgroups groups of credentials. Past FSAL_NGROUPS_MAX, only the first
+ * ones are copied in alt_groups, the list stays with the caller for the
+ * time of the request. */
+#define FSAL_CRED_GROUPS(pcred) \
+  ((pcred)->nbgroups > FSAL_NGROUPS_MAX ? (pcred)->ext_groups : (pcred)->alt_groups)
+
+/* A copy of credentials that outlives the request keeps alt_groups only */
+#define FSAL_CRED_DROP_EXT_GROUPS(pcred)                \
+  do {                                                  \
+    if((pcred)->nbgroups > FSAL_NGROUPS_MAX)            \
+      {                                                 \
+        (pcred)->ext_groups = NULL;                     \
+        (pcred)->nbgroups = FSAL_NGROUPS_MAX;           \
+      }                                                 \
+  } while(0)
+
 typedef struct fsal_name__
 {
   char name[FSAL_MAX_NAME_LEN];
@@ -0,0 +1,89 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    interval_tree.h
+ * \brief   Intrusive interval tree.
+ *
+ * interval_tree.h : An AVL tree of closed intervals [start, end], ordered by
+ * start, then end, then node address, so that identical intervals may be
+ * stored. Every node also keeps the largest end of its subtree, which lets
+ * the overlap lookups skip the subtrees that can not match: finding the k
+ * intervals overlapping a range costs O(k log n) instead of a full walk.
+ *
+ * Nodes are embedded in the caller's structures (see itree_entry). The tree
+ * does no allocation and no locking. A node may be removed, or removed and
+ * inserted again with another interval, while iterating, provided the next
+ * node was fetched before.
+ *
+ */
+
+#ifndef _INTERVAL_TREE_H
+#define _INTERVAL_TREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct itree_node
+{
+  struct itree_node *left;
+  struct itree_node *right;
+  struct itree_node *parent;
+  uint64_t start;               /**< First value of the interval */
+  uint64_t end;                 /**< Last value of the interval, included */
+  uint64_t max_end;             /**< Largest end in the subtree */
+  int height;
+};
+
+struct itree
+{
+  struct itree_node *root;
+  uint64_t size;
+};
+
+#define itree_entry(node, type, member) \
+  ((type *)((char *)(node) - offsetof(type, member)))
+
+static inline int itree_empty(const struct itree *tree)
+{
+  return tree->root == NULL;
+}
+
+void itree_init(struct itree *tree);
+void itree_insert(struct itree *tree, struct itree_node *node,
+                  uint64_t start, uint64_t end);
+void itree_remove(struct itree *tree, struct itree_node *node);
+
+/* In order walk */
+struct itree_node *itree_first(const struct itree *tree);
+struct itree_node *itree_next(const struct itree_node *node);
+
+/* Walk of the nodes overlapping [start, end], in order */
+struct itree_node *itree_first_overlap(const struct itree *tree,
+                                       uint64_t start, uint64_t end);
+struct itree_node *itree_next_overlap(const struct itree_node *node,
+                                      uint64_t start, uint64_t end);
+
+#endif                          /* _INTERVAL_TREE_H */
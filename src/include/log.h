@@ -391,6 +391,14 @@ int SetComponentLogFile(log_components_t component, char *name);
 void SetComponentLogBuffer(log_components_t component, char *buffer);
 void SetComponentLogLevel(log_components_t component, int level_to_set);
 
+/* Asynchronous writing of the messages logged to files (log_async.c) */
+int LogAsync_Start(unsigned int ring_size);
+void LogAsync_Stop(void);
+void LogAsync_Reopen(void);
+int LogAsync_IsActive(void);
+int LogAsync_Write(log_components_t component, const char *text, size_t len);
+void LogAsync_GetStats(unsigned long long *pnb_written, unsigned long long *pnb_dropped);
+
 #define SetLogLevel(level_to_set) \
   SetComponentLogLevel(COMPONENT_ALL, level_to_set)
 
@@ -59,14 +59,20 @@
 #include "nfs4.h"
 
 #define NFS41_SESSION_PER_CLIENT 3
-#define NFS41_NB_SLOTS           3
-#define NFS41_DRC_SIZE          32768
+
+/* Default upper bound of the slot table negotiated in CREATE_SESSION */
+#define NFS41_NB_SLOTS_DEF       64
+
+/* Average number of requests pending per worker above which clients are
+ * asked (through sr_target_highest_slotid) to use fewer slots */
+#define NFS41_SLOTS_LOAD_THRESHOLD 4
 
 typedef struct nfs41_session_slot__
 {
   sequenceid4 sequence;
-  pthread_mutex_t lock;
-  char cached_result[NFS41_DRC_SIZE];
+  pthread_mutex_t lock;         /* held by the request using the slot, from SEQUENCE to the reply */
+  char *cached_result;          /* XDR encoded COMPOUND4res, allocated to its exact size */
+  unsigned int cached_len;
   unsigned int cache_used;
 } nfs41_session_slot_t;
 
@@ -78,7 +84,8 @@ typedef struct nfs41_session__
   char session_id[NFS4_SESSIONID_SIZE];
   channel_attrs4 fore_channel_attrs;
   channel_attrs4 back_channel_attrs;
-  nfs41_session_slot_t slots[NFS41_NB_SLOTS];
+  uint32_t nb_slots;            /* fore_channel_attrs.ca_maxrequests, as negotiated */
+  nfs41_session_slot_t *slots;
 } nfs41_session_t;
 
 #endif                          /* _NFS41_SESSION_H */
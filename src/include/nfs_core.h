@@ -45,6 +45,7 @@
 
 #include "rpc.h"
 #include "LRU_List.h"
+#include "WorkQueue.h"
 #include "fsal.h"
 #ifdef _USE_MFSL
 #include "mfsl.h"
@@ -87,22 +88,32 @@
 /* Maximum thread count */
 #define NB_MAX_WORKER_THREAD 4096
 #define NB_MAX_FLUSHER_THREAD 100
+#define NB_MAX_DISPATCHER_THREAD 64
+#define NB_MAX_CACHE_INODE_GC_THREAD 16
+#define NB_MAX_WRITE_BEHIND_THREAD 16
+#define NB_MAX_DELEG_RECALL_THREAD 16
 
 /* NFS daemon behavior default values */
 #define NB_WORKER_THREAD_DEFAULT  16
 #define NB_FLUSHER_THREAD_DEFAULT 16
-#define NB_REQUEST_BEFORE_QUEUE_AVG  1000
-#define NB_MAX_CONCURRENT_GC 3
+#define NB_DISPATCHER_THREAD_DEFAULT 1
+#define NFS_DISPATCH_BATCH 32    /* max requests read from one socket before serving the others */
+#define NB_MAX_CONCURRENT_GC 1    /* cache_inode reclaimer threads */
+#define NB_WRITE_BEHIND_THREAD_DEFAULT 2  /* threads writing the unstable writes behind */
+#define NB_DELEG_RECALL_THREAD_DEFAULT 4  /* threads sending the callbacks of the delegations */
 #define NB_MAX_PENDING_REQUEST 30
-#define NB_PREALLOC_LRU_WORKER 100
+#define NB_PENDING_QUEUE_SIZE 1024  /* rounded up to a power of 2 */
+#define LOG_ASYNC_RING_SIZE (256 * 1024)  /* bytes per logging thread */
 #define NB_REQUEST_BEFORE_GC 50
 #define PRIME_DUPREQ 17         /* has to be a prime number */
+#define DUPREQ_BUCKETS_PER_SHARD 1024
+#define DUPREQ_MAX_CLIENT_BYTES (1024 * 1024)
 #define PRIME_ID_MAPPER 17      /* has to be a prime number */
 #define DUPREQ_EXPIRATION 180
-#define NB_PREALLOC_HASH_DUPREQ 100
-#define NB_PREALLOC_LRU_DUPREQ 100
-#define NB_PREALLOC_GC_DUPREQ 100
 #define NB_PREALLOC_ID_MAPPER 200
+#define ID_MAPPER_POSITIVE_TTL 900
+#define ID_MAPPER_NEGATIVE_TTL 60
+#define UID2GRP_MAX_ENTRIES 10000
 
 #define PRIME_CACHE_INODE 37    /* has to be a prime number */
 #define NB_PREALLOC_HASH_CACHE_INODE 1000
@@ -137,6 +148,7 @@
 #define CONF_LABEL_SESSION_ID       "NFSv4_Session_Cache"
 #define CONF_LABEL_UID_MAPPER       "UidMapper_Cache"
 #define CONF_LABEL_GID_MAPPER       "GidMapper_Cache"
+#define CONF_LABEL_UID2GRP          "Uid2Grp_Cache"
 #define CONF_LABEL_UID_MAPPER_TABLE "Users"
 #define CONF_LABEL_GID_MAPPER_TABLE "Groups"
 #define CONF_LABEL_IP_NAME_HOSTS    "Hosts"
@@ -151,6 +163,8 @@
 #define RQCRED_SIZE           400        /* this size is excessive */
 #define NFS_DEFAULT_SEND_BUFFER_SIZE 32768
 #define NFS_DEFAULT_RECV_BUFFER_SIZE 32768
+#define NFS_NB_READ_BUFFERS_DEFAULT  64
+#define NFS_READ_BUFFER_SIZE_DEFAULT 1048576
 
 /* Default 'Raw Dev' values */
 #define GANESHA_RAW_DEV_MAJOR 168
@@ -174,6 +188,7 @@
 #define ID_MAPPER_NOT_FOUND           2
 #define ID_MAPPER_INVALID_ARGUMENT    3
 #define ID_MAPPER_FAIL                4
+#define ID_MAPPER_NEGATIVE            5
 
 /* Hard and soft limit for nfsv4 quotas */
 #define NFS_V4_MAX_QUOTA_SOFT 4294967296LL      /*  4 GB */
@@ -204,6 +219,12 @@ typedef enum nfs_clientid_confirm_state__
   EXPIRED_CLIENT_ID = 5
 } nfs_clientid_confirm_state_t;
 
+typedef enum nfs_cb_path_state__
+{ CB_PATH_UNKNOWN = 0,          /* not checked yet, or no callback (NFSv4.1) */
+  CB_PATH_UP = 1,               /* answered CB_NULL, delegations may be granted */
+  CB_PATH_DOWN = 2
+} nfs_cb_path_state_t;
+
 typedef char path_str_t[MAXPATHLEN] ;
 
 #define CLIENT_ID_MAX_LEN             72        /* MUST be a multiple of 9 */
@@ -224,10 +245,8 @@ typedef char path_str_t[MAXPATHLEN] ;
 
 typedef struct nfs_worker_param__
 {
-  LRU_parameter_t lru_param;
-  LRU_parameter_t lru_dupreq;
+  unsigned int pending_queue_size;
   unsigned int nb_pending_prealloc;
-  unsigned int nb_dupreq_prealloc;
   unsigned int nb_client_id_prealloc;
   unsigned int nb_ip_stats_prealloc;
   unsigned int nb_before_gc;
@@ -236,7 +255,10 @@ typedef struct nfs_worker_param__
 
 typedef struct nfs_rpc_dupreq_param__
 {
-  hash_parameter_t hash_param;
+  unsigned int nb_shards;               /* each shard has its own lock */
+  unsigned int nb_buckets;              /* buckets of each shard */
+  size_t max_client_bytes;              /* memory of the replies kept for a client */
+  unsigned int non_idempotent_only;     /* only track the requests whose reply is cached */
 } nfs_rpc_dupreq_parameter_t;
 
 typedef struct nfs_cache_layer_parameter__
@@ -267,13 +289,16 @@ typedef struct nfs_core_param__
   struct sockaddr_in bind_addr; // IPv4 only for now...
   unsigned int program[P_COUNT];
   unsigned int nb_worker;
-  unsigned int nb_call_before_queue_avg;
+  unsigned int nb_dispatcher;
   unsigned int nb_max_concurrent_gc;
+  unsigned int nb_write_behind_thread;
   long core_dump_size;
   int nb_max_fd;
   unsigned int drop_io_errors;
   unsigned int drop_inval_errors;
   unsigned int drop_delay_errors;
+  unsigned int log_async;
+  unsigned int log_async_ring_size;
   unsigned int use_nfs_commit;
   time_t expiration_dupreq;
   unsigned int stats_update_delay;
@@ -286,6 +311,8 @@ typedef struct nfs_core_param__
   unsigned int core_options;
   unsigned int max_send_buffer_size; /* Size of RPC send buffer */
   unsigned int max_recv_buffer_size; /* Size of RPC recv buffer */
+  unsigned int nb_read_buffers; /* Registered buffers for the READ replies */
+  unsigned int read_buffer_size;
 #ifdef _USE_NLM
   bool_t nsm_use_caller_name;
 #endif
@@ -314,8 +341,19 @@ typedef struct nfs_idmap_cache_param__
 {
   hash_parameter_t hash_param;
   char mapfile[MAXPATHLEN];
+  char preload_file[MAXPATHLEN];  /* passwd or group style file loaded at startup */
+  unsigned int positive_ttl;      /* lifetime of the mappings found, 0 for ever */
+  unsigned int negative_ttl;      /* lifetime of the failed lookups, 0 not to keep them */
 } nfs_idmap_cache_parameter_t;
 
+typedef struct nfs_uid2grp_cache_param__
+{
+  hash_parameter_t hash_param;
+  unsigned int max_entries;       /* group lists kept, the least used are dropped first */
+  unsigned int positive_ttl;      /* lifetime of the group lists found, 0 for ever */
+  unsigned int negative_ttl;      /* lifetime of the uids unknown, 0 not to keep them */
+} nfs_uid2grp_cache_parameter_t;
+
 #ifdef _USE_NFS4_1
 typedef struct nfs_session_id_param__
 {
@@ -338,6 +376,9 @@ typedef struct nfs_version4_parameter__
   unsigned int fh_expire;
   unsigned int returns_err_fh_expired;
   unsigned int return_bad_stateid;
+  unsigned int nb_max_slots;
+  unsigned int use_delegations;
+  unsigned int nb_deleg_recall_thread;
   char domainname[NFS4_MAX_DOMAIN_LEN];
   char idmapconf[MAXPATHLEN];
 } nfs_version4_parameter_t;
@@ -353,6 +394,7 @@ typedef struct nfs_param__
   nfs_idmap_cache_parameter_t unamemap_cache_param;
   nfs_idmap_cache_parameter_t gnamemap_cache_param;
   nfs_idmap_cache_parameter_t uidgidmap_cache_param;
+  nfs_uid2grp_cache_parameter_t uid2grp_cache_param;
   nfs_ip_stats_parameter_t ip_stats_param;
 #ifdef _USE_9P
   _9p_parameter_t _9p_param ;
@@ -419,9 +461,49 @@ typedef struct nfs_worker_stat__
 
 typedef struct nfs_dupreq_stat__
 {
-  hash_stat_t htstat;
+  unsigned int nb_entries;              /* replies cached */
+  unsigned int nb_clients;              /* clients with cached replies */
+  uint64_t mem_space;                   /* memory of the replies cached */
+  uint64_t nb_hits;                     /* replies replayed */
+  uint64_t nb_in_progress;              /* retransmissions of requests being processed */
+  uint64_t nb_misses;                   /* new requests */
+  uint64_t nb_evicted_size;             /* replies evicted for the client's memory bound */
+  uint64_t nb_evicted_age;              /* replies evicted once expired */
 } nfs_dupreq_stat_t;
 
+typedef struct idmap_cache_stat__
+{
+  uint64_t nb_hits;                     /* lookups answered by a mapping */
+  uint64_t nb_negative_hits;            /* lookups answered by a failed lookup kept */
+  uint64_t nb_misses;                   /* lookups left to the name service */
+  uint64_t nb_refresh;                  /* mappings refreshed before they expired */
+  uint64_t nb_resolve;                  /* requests to the name service */
+  uint64_t nb_resolve_failed;           /* requests to the name service which found nothing */
+  uint64_t resolve_usec;                /* time spent in the name service */
+  uint64_t max_resolve_usec;            /* longest request to the name service */
+} idmap_cache_stat_t;
+
+/**
+ * The groups of a user, as the name service knows them. The group lists are
+ * shared by the workers: uid2grp() returns a reference, to drop with
+ * uid2grp_unref() once the credentials no longer use them.
+ */
+typedef struct uid2grp_groups__
+{
+  uid_t uid;
+  gid_t gid;                            /* primary group */
+  unsigned int nbgroups;
+  gid_t *groups;                        /* all the groups, primary one included */
+  unsigned int negative;                /* the name service knows no such uid */
+  time_t expires;                       /* 0 if the list never expires */
+  time_t refresh_after;                 /* a use past this time queues the list for a refresh */
+  unsigned int refreshing;              /* queued or refreshed, under the refresh mutex */
+  unsigned int referenced;              /* used since the last pass of the eviction clock */
+  uint32_t refcount;
+  struct glist_head lru;                /* hashed lists, in order of insertion */
+  struct glist_head refresh_list;
+} uid2grp_groups_t;
+
 typedef struct nfs_request_data__
 {
   SVCXPRT *xprt;
@@ -458,6 +540,8 @@ typedef struct nfs_client_id__
   char client_name[NFS4_MAX_DOMAIN_LEN];
   clientid4 clientid;
   uint32_t cb_program;
+  uint32_t cb_ident;
+  nfs_cb_path_state_t cb_path;
   char client_r_addr[SOCK_NAME_MAX];
   char client_r_netid[MAXNAMLEN];
   verifier4 verifier;
@@ -509,10 +593,9 @@ typedef struct nfs_thread_control_block__
 typedef struct nfs_worker_data__
 {
   unsigned int worker_index;
-  LRU_list_t *pending_request;
-  LRU_list_t *duplicate_request;
+  work_queue_t pending_request;
+  uint64_t nb_selected;         /* Requests handed to this worker by nfs_core_select_worker_queue */
   struct prealloc_pool request_pool;
-  struct prealloc_pool dupreq_pool;
   struct prealloc_pool ip_stats_pool;
   struct prealloc_pool clientid_pool;
   cache_inode_client_t cache_inode_client;
@@ -562,6 +645,15 @@ typedef struct fridge_entry__
   struct fridge_entry__ * pnext ;
 } fridge_entry_t  ;
 
+/**
+ * outcome of worker selections that did not find a candidate among two random workers
+ */
+typedef struct nfs_worker_selection_stat__
+{
+  uint64_t nb_scan;             /* both candidates unavailable, other workers were scanned */
+  uint64_t nb_default;          /* no worker available at all, fell back on a random one */
+} nfs_worker_selection_stat_t;
+
 /**
  * group together all of NFS-Ganesha's statistics
  */
@@ -574,8 +666,13 @@ typedef struct ganesha_stats__ {
     hash_stat_t             ip_name_map;
     hash_stat_t             uid_reverse;
     hash_stat_t             gid_reverse;
-    hash_stat_t             drc_udp;
-    hash_stat_t             drc_tcp;
+    nfs_dupreq_stat_t       drc;
+    idmap_cache_stat_t      uid_cache;
+    idmap_cache_stat_t      gid_cache;
+    idmap_cache_stat_t      uid2grp_cache;
+    cache_inode_fd_stat_t   fd_cache;
+    cache_inode_wb_stat_t   write_behind;
+    state_deleg_stat_t      deleg;
     fsal_statistics_t       global_fsal;
 #ifndef _NO_BUDDY_SYSTEM
     buddy_stats_t           global_buddy;
@@ -586,6 +683,12 @@ typedef struct ganesha_stats__ {
     unsigned int total_pending_request;
     unsigned int average_pending_request;
     unsigned int len_pending_request;
+    unsigned long long total_worker_selected;
+    unsigned long long min_worker_selected;
+    unsigned long long max_worker_selected;
+    unsigned long long total_queue_full;
+    unsigned long long nb_selection_scan;
+    unsigned long long nb_selection_default;
     unsigned int avg_latency;
     unsigned long long     total_fsal_calls;
 } ganesha_stats_t;
@@ -593,6 +696,7 @@ typedef struct ganesha_stats__ {
 extern nfs_parameter_t nfs_param;
 extern time_t ServerBootTime;
 extern nfs_worker_data_t *workers_data;
+extern nfs_worker_selection_stat_t worker_selection_stat;
 extern char config_path[MAXPATHLEN];
 extern char pidfile_path[MAXPATHLEN] ;
 extern ushort g_nodeid;
@@ -640,11 +744,12 @@ typedef enum worker_available_rc
  */
 enum auth_stat AuthenticateRequest(nfs_request_data_t *pnfsreq,
                                    bool_t *dispatch);
-worker_available_rc worker_available(unsigned long index, unsigned int avg_number_pending);
+worker_available_rc worker_available(unsigned long index);
 pause_rc pause_workers(pause_reason_t reason);
 pause_rc wake_workers(awaken_reason_t reason);
 pause_rc wait_for_workers_to_awaken();
 void DispatchWorkNFS(request_data_t *pnfsreq, unsigned int worker_index);
+void nfs_worker_queue_request(request_data_t *preq, unsigned int worker_index);
 void *worker_thread(void *IndexArg);
 process_status_t process_rpc_request(SVCXPRT *xprt);
 int stats_snmp(nfs_worker_data_t * workers_data_local);
@@ -659,10 +764,15 @@ void *stat_exporter_thread(void *IndexArg);
 void *file_content_gc_thread(void *IndexArg);
 void *nfs_file_content_flush_thread(void *flush_data_arg);
 void *reaper_thread(void *arg);
+void *idmapper_refresh_thread(void *arg);
+void *uid2grp_refresh_thread(void *arg);
+void *cache_inode_gc_thread(void *IndexArg);
+void *cache_inode_write_behind_thread(void *IndexArg);
 void *rpc_tcp_socket_manager_thread(void *Arg);
 void *sigmgr_thread( void * arg );
 void *fsal_up_thread(void *Arg);
 void *state_async_thread(void *argp);
+void *state_deleg_recall_thread(void *IndexArg);
 
 #ifdef _USE_UPCALL_SIMULATOR
 void * upcall_simulator_thread( void * UnusedArg ) ;
@@ -671,6 +781,7 @@ void * upcall_simulator_thread( void * UnusedArg ) ;
 #ifdef _USE_9P
 void * _9p_dispatcher_thread(void *arg);
 void DispatchWork9P(request_data_t *pnfsreq, unsigned int worker_index);
+void _9p_conn_release(_9p_conn_t *pconn);
 void _9p_process_request( _9p_request_data_t * preq9p, nfs_worker_data_t * pworker_data ) ;
 #endif
 
@@ -682,7 +793,6 @@ void nfs_Init_svc(void);
 void nfs_Init_admin_data(hash_table_t *ht);
 int nfs_Init_worker_data(nfs_worker_data_t * pdata);
 int nfs_Init_request_data(nfs_request_data_t * pdata);
-int nfs_Init_gc_counter(void);
 void constructor_nfs_request_data_t(void *ptr);
 void constructor_request_data_t(void *ptr);
 
@@ -700,6 +810,7 @@ int nfs_read_krb5_conf(config_file_t in_config, nfs_krb5_parameter_t * pparam);
 #endif
 int nfs_read_uidmap_conf(config_file_t in_config, nfs_idmap_cache_parameter_t * pparam);
 int nfs_read_gidmap_conf(config_file_t in_config, nfs_idmap_cache_parameter_t * pparam);
+int nfs_read_uid2grp_conf(config_file_t in_config, nfs_uid2grp_cache_parameter_t * pparam);
 int nfs_read_state_id_conf(config_file_t in_config, nfs_state_id_parameter_t * pparam);
 #ifdef _USE_NFS4_1
 int nfs_read_session_id_conf(config_file_t in_config,
@@ -739,14 +850,6 @@ void Print_param_in_log();
 
 void nfs_reset_stats(void);
 
-int display_req_key(hash_buffer_t * pbuff, char *str);
-int display_req_val(hash_buffer_t * pbuff, char *str);
-int compare_req(hash_buffer_t * buff1, hash_buffer_t * buff2);
-
-int print_entry_dupreq(LRU_data_t data, char *str);
-int clean_entry_dupreq(LRU_entry_t * pentry, void *addparam);
-
-int print_pending_request(LRU_data_t data, char *str);
 
 void auth_stat2str(enum auth_stat, char *str);
 
@@ -774,6 +877,11 @@ void nfs_client_id_expire(nfs_client_id_t *client_record);
 int nfs_client_id_compute(char *name, clientid4 * pclientid);
 int nfs_client_id_basic_compute(char *name, clientid4 * pclientid);
 
+int nfs4_cb_probe(nfs_client_id_t * pclientid);
+int nfs4_cb_send_recall(nfs_client_id_t * pclientid, stateid4 * pstateid, nfs_fh4 * pfh);
+void nfs4_cb_forget(clientid4 clientid);
+void nfs4_cb_close_idle(time_t max_idle);
+
 int display_client_id(hash_buffer_t * pbuff, char *str);
 int display_client_id_reverse(hash_buffer_t * pbuff, char *str);
 int display_client_id_val(hash_buffer_t * pbuff, char *str);
@@ -822,6 +930,7 @@ int idmap_uname_init(nfs_idmap_cache_parameter_t param);
 int uidgidmap_init(nfs_idmap_cache_parameter_t param);
 
 int display_idmapper_val(hash_buffer_t * pbuff, char *str);
+int display_idmapper_entry(hash_buffer_t * pbuff, char *str);
 int display_idmapper_key(hash_buffer_t * pbuff, char *str);
 
 int compare_idmapper(hash_buffer_t * buff1, hash_buffer_t * buff2);
@@ -829,29 +938,27 @@ int compare_namemapper(hash_buffer_t * buff1, hash_buffer_t * buff2);
 int compare_state_id(hash_buffer_t * buff1, hash_buffer_t * buff2);
 
 int idmap_compute_hash_value(char *name, uint32_t * phashval);
-int idmap_add(hash_table_t * ht, char *key, unsigned int val);
 int uidmap_add(char *key, unsigned int val);
 int gidmap_add(char *key, unsigned int val);
+int uidmap_add_negative(char *key);
+int gidmap_add_negative(char *key);
 
-int namemap_add(hash_table_t * ht, unsigned int key, char *val);
 int unamemap_add(unsigned int key, char *val);
 int gnamemap_add(unsigned int key, char *val);
+int unamemap_add_negative(unsigned int key);
+int gnamemap_add_negative(unsigned int key);
 int uidgidmap_add(unsigned int key, unsigned int value);
 
-int idmap_get(hash_table_t * ht, char *key, unsigned long *pval);
 int uidmap_get(char *key, unsigned long *pval);
 int gidmap_get(char *key, unsigned long *pval);
 
-int namemap_get(hash_table_t * ht, unsigned int key, char *pval);
 int unamemap_get(unsigned int key, char *val);
 int gnamemap_get(unsigned int key, char *val);
 int uidgidmap_get(unsigned int key, unsigned int *pval);
 
-int idmap_remove(hash_table_t * ht, char *key);
 int uidmap_remove(char *key);
 int gidmap_remove(char *key);
 
-int namemap_remove(hash_table_t * ht, unsigned int key);
 int unamemap_remove(unsigned int key);
 int gnamemap_remove(unsigned int key);
 int uidgidmap_remove(unsigned int key);
@@ -863,11 +970,26 @@ int namemap_clear();
 void idmap_get_stats(idmap_type_t maptype, hash_stat_t * phstat,
                      hash_stat_t * phstat_reverse);
 
+int idmap_preload(char *path, idmap_type_t maptype);
+int idmap_resolve(idmap_type_t maptype, int by_id, char *name, unsigned int *pid);
+void idmap_resolve_done(idmap_type_t maptype, uint64_t usec, int found);
+void idmap_get_cache_stats(idmap_type_t maptype, idmap_cache_stat_t * pstat);
+
+int uid2grp_init(nfs_uid2grp_cache_parameter_t param);
+int display_uid2grp_val(hash_buffer_t * pbuff, char *str);
+int uid2grp_resolve(uid_t uid, gid_t * pgid, gid_t ** pgroups, unsigned int *pnbgroups);
+int uid2grp_get(uid_t uid, uid2grp_groups_t ** ppgroups);
+int uid2grp(uid_t uid, uid2grp_groups_t ** ppgroups);
+void uid2grp_unref(uid2grp_groups_t * pgroups);
+int uid2grp_remove(uid_t uid);
+void uid2grp_get_stats(idmap_cache_stat_t * pstat);
+
 int fridgethr_get( pthread_t * pthrid, void *(*thrfunc)(void*), void * thrarg ) ;
 fridge_entry_t * fridgethr_freeze( ) ;
 int fridgethr_init() ;
 
 unsigned int nfs_core_select_worker_queue() ;
+unsigned int nfs_core_worker_load() ;
 
 #ifdef _USE_NFS4_1
 int display_session_id_key(hash_buffer_t * pbuff, char *str);
@@ -887,6 +1009,8 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 int nfs41_Session_Update(char sessionid[NFS4_SESSIONID_SIZE],
                          nfs41_session_t * psession_data);
 int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE]);
+int nfs41_Session_Alloc_Slots(nfs41_session_t * psession, uint32_t nb_slots);
+void nfs41_Session_Free_Slots(nfs41_session_t * psession);
 int nfs41_Build_sessionid(clientid4 * pclientid, char sessionid[NFS4_SESSIONID_SIZE]);
 void nfs41_Session_PrintAll(void);
 #endif
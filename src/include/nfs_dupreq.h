@@ -45,13 +45,12 @@ typedef unsigned long u_long;
 #endif                          /* _SOLARIS */
 
 #include "rpc.h"
-#include "HashData.h"
-#include "HashTable.h"
 #include "nfs_core.h"
 #include "nfs23.h"
 #include "nfs4.h"
 #include "fsal.h"
 #include "nfs_tools.h"
+#include "nlm_list.h"
 
 typedef struct dupreq_key__
 {
@@ -65,56 +64,51 @@ typedef struct dupreq_key__
    * This is much much stronger. */
   sockaddr_t addr;
 
-  /* In very rare cases, ip/port/xid is not enough. In databases
-   * and other specific applications this may be a greater concern.
-   * In those cases a checksum of the first 200 bytes of the request
-   * should be used */
-  int checksum;
+  /* The requests received over UDP and TCP are kept apart */
+  int ipproto;
 } dupreq_key_t;
 
+typedef struct dupreq_client__ dupreq_client_t;
+
+/* An entry is allocated in one piece with the encoded reply it caches.
+ * While the request is processed, the entry has no reply: it is replaced
+ * by the entry of the reply once the reply is encoded. */
 typedef struct dupreq_entry__
 {
-  long xid;
-  sockaddr_t addr;
-  int checksum;
-  int ipproto ;
-
-  pthread_mutex_t dupreq_mutex;
-  int processing; /* if currently being processed, this should be = 1 */
-
-  nfs_res_t res_nfs;
-  u_long rq_prog;               /* service program number        */
-  u_long rq_vers;               /* service protocol version      */
+  struct dupreq_entry__ *next;          /* next entry in the bucket */
+  struct glist_head client_list;        /* replies of the client, oldest first */
+  dupreq_client_t *pclient;
+  dupreq_key_t key;
+  unsigned long hash;
+  uint32_t refcount;                    /* the cache holds one reference */
+  int processing;                       /* if currently being processed, this should be = 1 */
+  u_long rq_prog;                       /* service program number        */
+  u_long rq_vers;                       /* service protocol version      */
   u_long rq_proc;
   time_t timestamp;
+  unsigned int reply_len;               /* encoded reply, after the entry */
+  char *reply;
 } dupreq_entry_t;
 
 unsigned int get_rpc_xid(struct svc_req *reqp);
 
-int compare_req(hash_buffer_t * buff1, hash_buffer_t * buff2);
-int print_entry_dupreq(LRU_data_t data, char *str);
-int clean_entry_dupreq(LRU_entry_t * pentry, void *addparam);
-int nfs_dupreq_gc_function(LRU_entry_t * pentry, void *addparam);
-
-nfs_res_t nfs_dupreq_get(long xid, struct svc_req *ptr_req, SVCXPRT *xprt, int *pstatus);
-int nfs_dupreq_delete(long xid, struct svc_req *ptr_req, SVCXPRT *xprt,
-                      struct prealloc_pool *dupreq_pool);
 int nfs_dupreq_add_not_finished(long xid,
-				struct svc_req *ptr_req,
-				SVCXPRT *xprt,
-				struct prealloc_pool *dupreq_pool,
-				nfs_res_t *res_nfs);
-
-int nfs_dupreq_finish(long xid,
-		      struct svc_req *ptr_req,
-		      SVCXPRT *xprt,
-		      nfs_res_t * p_res_nfs,
-		      LRU_list_t * lru_dupreq);
-
-unsigned long dupreq_value_hash_func(hash_parameter_t * p_hparam,
-                                     hash_buffer_t * buffclef);
-unsigned long dupreq_rbt_hash_func(hash_parameter_t * p_hparam, hash_buffer_t * buffclef);
-void nfs_dupreq_get_stats(hash_stat_t * phstat_udp, hash_stat_t * phstat_tcp ) ;
+                                struct svc_req *ptr_req,
+                                SVCXPRT *xprt,
+                                int cacheable,
+                                dupreq_entry_t **ppdupreq);
+
+int nfs_dupreq_finish(dupreq_entry_t **ppdupreq,
+                      xdrproc_t xdr_encode_func,
+                      nfs_res_t * p_res_nfs);
+
+int nfs_dupreq_delete(dupreq_entry_t *pdupreq);
+void nfs_dupreq_rele(dupreq_entry_t *pdupreq);
+bool_t nfs_dupreq_xdr_reply(XDR * xdrs, dupreq_entry_t * pdupreq);
+
+void nfs_dupreq_gc(void);
+struct nfs_dupreq_stat__;
+void nfs_dupreq_get_stats(struct nfs_dupreq_stat__ *pstats);
 
 
 #define DUPREQ_SUCCESS             0
@@ -141,12 +141,32 @@ typedef struct exportlist_client_entry__
 
 #define EXPORTS_NB_MAX_CLIENTS 128
 
+/* Compiled form of a client array, see support/export_client_index.c */
+typedef struct exportlist_client_index__ exportlist_client_index_t;
+
 typedef struct exportlist_client__
 {
   unsigned int num_clients;     /* num clients        */
   exportlist_client_entry_t clientarray[EXPORTS_NB_MAX_CLIENTS];        /* allowed clients    */
+  exportlist_client_index_t *index;     /* compiled clientarray, NULL if not built */
 } exportlist_client_t;
 
+/* Result of matching a client entry that the index can not resolve by address */
+typedef enum exportlist_client_match__
+{
+  EXPORT_CLIENT_NO_MATCH = 0,
+  EXPORT_CLIENT_MATCH    = 1,
+  EXPORT_CLIENT_STOP     = 2    /* no match, and stop looking at the next entries */
+} exportlist_client_match_t;
+
+/* Matches one client entry. Sets *pvolatile if the result depends on
+ * name resolution rather than only on the address. */
+typedef exportlist_client_match_t (*export_client_slow_match_t) (exportlist_client_entry_t *
+                                                                 pclient, void *arg,
+                                                                 int *pvolatile);
+
+#define EXPORT_CLIENT_DECISION_CACHE_SIZE 256
+
 /* fsal up filter list is needed in exportlist.
  * Inluding fsal_up.h would cause header file issues however. */
 #ifdef _USE_FSAL_UP
@@ -187,6 +207,7 @@ typedef struct exportlist__
 
   bool_t use_ganesha_write_buffer;
   bool_t use_commit;
+  bool_t manage_gids;           /* AUTH_UNIX users get the groups of the name service, not those of the request */
 
   fsal_size_t MaxRead;          /* Max Read for this entry                           */
   fsal_size_t MaxWrite;         /* Max Write for this entry                          */
@@ -358,7 +379,8 @@ typedef struct compoud_data
   cache_inode_client_t *pclient;                      /**< client ressource for the request                              */
   nfs_client_cred_t credential;                       /**< RPC Request related to the compound                           */
 #ifdef _USE_NFS4_1
-  caddr_t pcached_res;                                /**< NFv41: pointer to cached RPC res in a session's slot          */
+  nfs41_session_slot_t *pslot;                        /**< NFSv41: slot held by the request, unlocked once replied       */
+  bool_t cachethis;                                   /**< Set to TRUE if the reply is to be kept in the slot            */
   bool_t use_drc;                                     /**< Set to TRUE if session DRC is to be used                      */
   uint32_t oppos;                                     /**< Position of the operation within the request processed        */
   nfs41_session_t *psession;                          /**< Related session (found by OP_SEQUENCE)                        */
@@ -401,4 +423,15 @@ int nfs_export_check_access(sockaddr_t *hostaddr,
 int nfs_export_tag2path(exportlist_t * exportroot, char *tag, int taglen, char *path,
                         int pathlen);
 
+/* Compiled client arrays */
+int export_client_index_build(exportlist_client_t * clients);
+void export_client_index_free(exportlist_client_t * clients);
+int export_client_index_lookup(exportlist_client_t * clients,
+                               int family,
+                               void *paddr,
+                               unsigned int export_option,
+                               export_client_slow_match_t slow_match,
+                               void *arg,
+                               time_t volatile_ttl);
+
 #endif                          /* _NFS_EXPORTS_H */
@@ -1293,6 +1293,7 @@ void nfs3_Read_Free(nfs_res_t * resp);
 void nfs2_Readlink_Free(nfs_res_t * resp);
 void nfs4_Compound_FreeOne(nfs_resop4 * pres);
 void nfs4_Compound_Free(nfs_res_t * pres);
+bool_t nfs4_xdr_COMPOUND4res(XDR * xdrs, COMPOUND4res * objp);
 void nfs4_Compound_CopyResOne(nfs_resop4 * pres_dst, nfs_resop4 * pres_src);
 void nfs4_Compound_CopyRes(nfs_res_t * pres_dst, nfs_res_t * pres_src);
 
@@ -1526,6 +1527,19 @@ int nfs4_FSALattr_To_Fattr(exportlist_t * pexport,
                            fattr4 * Fattr,
                            compound_data_t * data, nfs_fh4 * objFH, bitmap4 * Bitmap);
 
+int nfs4_FSALattr_To_Fattr_Generic(exportlist_t * pexport,
+                                   fsal_attrib_list_t * pattr,
+                                   fattr4 * Fattr,
+                                   compound_data_t * data, nfs_fh4 * objFH,
+                                   bitmap4 * Bitmap);
+
+/* Returned when the bitmap has no plan and needs the generic encoding */
+#define NFS4_FATTR_PLAN_GENERIC 1
+
+int nfs4_FSALattr_To_Fattr_Plan(exportlist_t * pexport,
+                                fsal_attrib_list_t * pattr,
+                                fattr4 * Fattr, nfs_fh4 * objFH, bitmap4 * Bitmap);
+
                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                 /* time_how4          * mtime_set, *//* Out: How to set mtime */
                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                                         /* time_how4          * atimen_set ) ; *//* Out: How to set atime */
 
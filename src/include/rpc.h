@@ -51,7 +51,7 @@ typedef struct sockaddr_in sockaddr_t;
 #define AUTH_SYS 1
 #endif
 
-extern void InitRPC(int num_sock);
+extern void InitRPC(int num_sock, unsigned int nb_event_shard);
 
 #ifdef _USE_TIRPC
 extern void Svc_dg_soft_destroy(SVCXPRT * xport);
@@ -143,6 +143,24 @@ enum auth_stat Rpcsecgss__authenticate(register struct svc_req *rqst,
 
 extern fd_set Svc_fdset;
 
+/* Event engine used by the RPC dispatcher threads (epoll when available, select otherwise) */
+#define SVC_EVENT_BATCH 256
+
+extern unsigned int Svc_nb_event_shard;
+extern int Svc_event_init(unsigned int nb_shard);
+extern int Svc_event_watch(int fd);
+extern void Svc_event_unwatch(int fd);
+extern int Svc_event_wait(unsigned int shard, int *fds, int maxfds, int timeout);
+extern bool_t Svc_event_pending(int fd);
+
+/* Page aligned buffers for the READ replies and the WRITE requests, not copied on TCP connections */
+extern int rpc_buffer_pool_init(unsigned int nb_buffers, size_t buffer_size);
+extern caddr_t rpc_buffer_get(size_t size);
+extern caddr_t rpc_buffer_get_registered(size_t size, size_t * pcapacity);
+extern void rpc_buffer_release(caddr_t buffer);
+extern bool_t rpc_buffer_is_registered(const char *addr, size_t len);
+extern bool_t xdr_rpc_buffer(XDR * xdrs, char **cpp, u_int * sizep, u_int maxsize);
+
 /* Declare the various RPC transport dynamic arrays */
 extern SVCXPRT         **Xports;
 extern pthread_mutex_t  *mutex_cond_xprt;
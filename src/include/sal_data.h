@@ -132,9 +132,24 @@ typedef struct state_lock_t
 
 typedef struct state_deleg__
 {
-  unsigned int nothing;
+  open_delegation_type4  sd_type;                 /**< Only OPEN_DELEGATE_READ is granted          */
+  time_t                 sd_grant_time;           /**< When the delegation was granted              */
+  time_t                 sd_recall_time;          /**< When it was recalled, 0 if not recalled      */
+  u_int                  sd_fh_len;               /**< The file handle sent back in CB_RECALL       */
+  char                   sd_fh_val[NFS4_FHSIZE];
 } state_deleg_t;
 
+typedef struct state_deleg_stat__
+{
+  unsigned int nb_held;                           /**< Delegations currently granted                */
+  unsigned int nb_recalling;                      /**< Recalled delegations not yet returned        */
+  unsigned long long nb_granted;                  /**< Delegations granted by OPEN                  */
+  unsigned long long nb_recalled;                 /**< CB_RECALL sent on a conflicting operation    */
+  unsigned long long nb_returned;                 /**< Delegations given back by DELEGRETURN        */
+  unsigned long long nb_revoked;                  /**< Recall timed out, or client expired          */
+  unsigned long long nb_cb_failed;                /**< Callbacks the client did not answer          */
+} state_deleg_stat_t;
+
 typedef struct state_layout__
 {
 #ifdef _USE_FSALMDS
@@ -404,6 +419,8 @@ typedef void state_block_data_t;
 struct state_lock_entry_t
 {
   struct glist_head      sle_list;
+  struct itree_node      sle_tree_node;
+  struct itree         * sle_tree;        /* tree of the file indexing sle_tree_node, or NULL */
   struct glist_head      sle_owner_locks;
   struct glist_head      sle_locks;
 #ifdef _DEBUG_MEMLEAKS
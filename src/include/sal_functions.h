@@ -454,6 +454,47 @@ state_status_t state_lookup_layout_state(cache_entry_t * pentry,
                                          layouttype4     type,
                                          state_t      ** pstate);
 #endif                          /*  _USE_FSALMDS */
+
+/******************************************************************************
+ *
+ * Delegation functions
+ *
+ ******************************************************************************/
+
+int state_deleg_grant(cache_entry_t        * pentry,
+                      nfs_client_id_t      * pclientid,
+                      exportlist_t         * pexport,
+                      nfs_fh4              * pfh,
+                      cache_inode_client_t * pclient,
+                      fsal_op_context_t    * pcontext,
+                      state_t             ** ppstate);
+
+int state_deleg_conflict(cache_entry_t * pentry);
+
+int state_deleg_open_conflict(cache_entry_t * pentry,
+                              unsigned int    share_access,
+                              unsigned int    share_deny);
+
+int state_deleg_remove_conflict(cache_entry_t        * pentry_parent,
+                                fsal_name_t          * pname,
+                                cache_inode_policy_t   policy,
+                                hash_table_t         * ht,
+                                cache_inode_client_t * pclient,
+                                fsal_op_context_t    * pcontext);
+
+state_status_t state_deleg_return(char                   other[OTHERSIZE],
+                                  cache_inode_client_t * pclient,
+                                  state_status_t       * pstatus);
+
+void state_deleg_release(state_owner_t        * pclientid_owner,
+                         cache_inode_client_t * pclient);
+
+void state_deleg_probe(clientid4 clientid);
+
+void state_deleg_recall_run(cache_inode_client_t * pclient, unsigned int timeout);
+
+void state_deleg_get_stats(state_deleg_stat_t * pstat);
+
 /******************************************************************************
  *
  * Async functions
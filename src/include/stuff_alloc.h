@@ -65,6 +65,24 @@ struct prealloc_pool;
 #endif
 
 
+#ifdef _USE_SLAB_ALLOC
+
+#include "SlabAlloc.h"
+
+#define Mem_Alloc( a )                  SlabMalloc( a )
+#define Mem_Calloc( s1, s2 )            SlabCalloc( s1, s2 )
+#define Mem_Realloc( p, s )             SlabRealloc( p, s )
+#define Mem_Alloc_Label( a, lbl )       SlabMalloc( a )
+#define Mem_Calloc_Label( s1, s2, lbl ) SlabCalloc( s1, s2 )
+#define Mem_Realloc_Label( p, s, lbl)   SlabRealloc( p, s )
+#define Mem_Free( a )                   SlabFree( a )
+#define Mem_Free_Label( a, lbl )        SlabFree( a )
+#define Mem_Errno                       errno
+#define Str_Dup( a )                    SlabStr_Dup( a )
+#define Str_Dup_Label( a, lbl )         SlabStr_Dup( a )
+
+#else
+
 #define Mem_Alloc( a )                  malloc( a )
 #define Mem_Calloc( s1, s2 )            calloc( s1, s2 )
 #define Mem_Realloc( p, s )             realloc( p, s )
@@ -76,6 +94,8 @@ struct prealloc_pool;
 #define Mem_Errno                       errno
 #define Str_Dup( a )                    strdup( a )
 
+#endif
+
 #define GetPreferedPool( _n, _s )  (_n)
 
 #else
@@ -112,13 +132,60 @@ struct prealloc_pool;
 
 #endif
 
+#if defined(_USE_SLAB_ALLOC)
+
+/*******************************************************************************
+ *
+ * slab caches
+ *
+ * The entries of a type are allocated from its slab cache, shared by all the
+ * pools of that type: they can be released by any thread, and the memory they
+ * no longer use goes back to the system. As with preallocation, the
+ * constructor is called once per entry, which keeps its state from one use to
+ * the next.
+ *
+ ******************************************************************************/
+
+typedef struct prealloc_pool
+{
+  slab_cache_t           *pa_cache;       // slab cache of the type
+  constructor             pa_constructor; // constructor
+  constructor             pa_destructor;  // destructor
+} prealloc_pool;
+
+#define IsPoolPreallocated(pool) ((pool)->pa_cache != NULL)
+
+#define InitPool(pool, num_alloc, type, ctor, dtor)          \
+do {                                                         \
+  (pool)->pa_constructor = ctor;                             \
+  (pool)->pa_destructor  = dtor;                             \
+  (pool)->pa_cache       = SlabCacheCreate(# type, sizeof(type), ctor); \
+} while (0)
+
+#define MakePool(pool, num_alloc, type, ctor, dtor)          \
+  InitPool(pool, num_alloc, type, ctor, dtor)
+
+#define NamePool(pool, fmt, args...)
+
+#define GetFromPool(entry, pool, type)                       \
+do {                                                         \
+  entry = (type *)SlabCacheAlloc((pool)->pa_cache);          \
+} while (0)
+
+#define ReleaseToPool(entry, pool)                           \
+do {                                                         \
+  if ((pool)->pa_destructor != NULL)                         \
+    (pool)->pa_destructor(entry);                            \
+  SlabCacheFree((pool)->pa_cache, entry);                    \
+} while (0)
+
 /*******************************************************************************
  *
  * block preallocation
  *
  ******************************************************************************/
 
-#ifndef _NO_BLOCK_PREALLOC
+#elif !defined(_NO_BLOCK_PREALLOC)
 
 typedef struct prealloc_header
 {
@@ -488,6 +555,6 @@ do {                                                         \
   Mem_Free(entry);                                           \
 } while (0)
 
-#endif                          /* no block preallocation */
+#endif                          /* slab caches, block preallocation or not */
 
 #endif                          /* _STUFF_ALLOC_H */
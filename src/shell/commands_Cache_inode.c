@@ -553,6 +553,7 @@ int cacheinode_init(char *filename, int flag_v, FILE * output)
       }
 
   /* Reading the hash parameter */
+  memset(&cache_param, 0, sizeof(cache_param));
   rc = cache_inode_read_conf_hash_parameter(config_file, &cache_param);
   if(rc != CACHE_INODE_SUCCESS)
     {
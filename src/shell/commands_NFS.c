@@ -416,6 +416,8 @@ int nfs_init(char *filename, int flag_v, FILE * output)
   nfs_param.cache_layers_param.cache_content_client_param.max_fd = 20;
   nfs_param.cache_layers_param.cache_content_client_param.use_fd_cache = 0;
   nfs_param.cache_layers_param.cache_content_client_param.retention = 60;
+  nfs_param.cache_layers_param.cache_content_client_param.aio_threads = 0;
+  nfs_param.cache_layers_param.cache_content_client_param.readahead_size = 0;
   strcpy(nfs_param.cache_layers_param.cache_content_client_param.cache_dir,
          "/tmp/ganesha.datacache");
 
@@ -0,0 +1,572 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    export_client_index.c
+ * \brief   Compiled client arrays of the exports.
+ *
+ * export_client_index.c : The client array of an export is compiled, when
+ * the exports are loaded, into:
+ *
+ * - a hash of the IPv4 and IPv6 host addresses,
+ * - a binary trie of the IPv4 networks, indexed by prefix,
+ * - the set of the entries which can only be matched one by one (netgroups,
+ *   wildcards, networks with a non contiguous netmask...).
+ *
+ * Every node of these structures holds the set of the positions in the
+ * array of the entries it stands for. A lookup gathers the positions of the
+ * hosts and networks matching the address, keeps those with the requested
+ * options, and the first one in the array wins, as with the linear scan.
+ * Only the entries that can not be matched by address and come before this
+ * one are then matched one by one.
+ *
+ * Decisions are kept in a small per export cache, keyed by client address
+ * family, address and requested options. The cache goes away with the compiled array when
+ * the exports are reloaded. Decisions depending on name resolution expire
+ * like the IP/name cache does.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef _SOLARIS
+#include "solaris_port.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "abstract_atomic.h"
+#include "nfs_exports.h"
+
+#define CLIENT_SET_WORDS ((EXPORTS_NB_MAX_CLIENTS + 63) / 64)
+
+/* A set of positions in a client array */
+typedef struct client_set__
+{
+  uint64_t bits[CLIENT_SET_WORDS];
+} client_set_t;
+
+typedef struct client_trie_node__
+{
+  struct client_trie_node__ *child[2];
+  int has_clients;
+  client_set_t clients;         /* networks with exactly this prefix */
+} client_trie_node_t;
+
+typedef struct client_host__
+{
+  int used;
+  int family;                   /* an IPv4 host is not its v4-mapped IPv6 address */
+  struct in6_addr addr;         /* IPv4 addresses are stored mapped */
+  client_set_t clients;
+} client_host_t;
+
+typedef struct client_decision__
+{
+  uint32_t seq;                 /* odd while the slot is being written */
+  uint32_t option;
+  int32_t family;
+  struct in6_addr addr;
+  int32_t position;             /* -1 for no match */
+  time_t expire;                /* 0 if the decision does not expire */
+} client_decision_t;
+
+struct exportlist_client_index__
+{
+  client_set_t by_option[32];   /* entries having each option bit */
+  client_set_t slow4;           /* entries to match one by one for IPv4 */
+  client_set_t stop6;           /* entries ending an IPv6 search */
+  client_trie_node_t *trie4;
+  client_host_t *hosts;
+  unsigned int hosts_size;      /* power of 2 */
+  client_decision_t cache[EXPORT_CLIENT_DECISION_CACHE_SIZE];
+};
+
+static inline void client_set_add(client_set_t * set, unsigned int pos)
+{
+  set->bits[pos / 64] |= 1ULL << (pos % 64);
+}
+
+static inline void client_set_or(client_set_t * set, const client_set_t * other)
+{
+  int i;
+
+  for(i = 0; i < CLIENT_SET_WORDS; i++)
+    set->bits[i] |= other->bits[i];
+}
+
+/* Returns the first position of the set, -1 if it is empty */
+static inline int client_set_first(const client_set_t * set)
+{
+  int i;
+
+  for(i = 0; i < CLIENT_SET_WORDS; i++)
+    if(set->bits[i] != 0)
+      return i * 64 + __builtin_ctzll(set->bits[i]);
+
+  return -1;
+}
+
+static inline void client_set_remove(client_set_t * set, unsigned int pos)
+{
+  set->bits[pos / 64] &= ~(1ULL << (pos % 64));
+}
+
+static inline void addr_from_ipv4(struct in6_addr *paddr6, in_addr_t addr)
+{
+  memset(paddr6, 0, sizeof(*paddr6));
+  paddr6->s6_addr[10] = 0xFF;
+  paddr6->s6_addr[11] = 0xFF;
+  memcpy(&paddr6->s6_addr[12], &addr, 4);
+}
+
+static inline uint32_t addr_hash(int family, const struct in6_addr *paddr)
+{
+  uint32_t words[4];
+  uint32_t h;
+
+  memcpy(words, paddr->s6_addr, sizeof(words));
+
+  h = words[0] ^ (words[1] * 0x9E3779B1) ^ (words[2] * 0x85EBCA6B) ^
+      ((words[3] ^ family) * 0xC2B2AE35);
+  return h ^ (h >> 16);
+}
+
+static client_host_t *client_host_find(exportlist_client_index_t * index,
+                                       int family,
+                                       const struct in6_addr *paddr,
+                                       int add)
+{
+  unsigned int i;
+
+  if(index->hosts_size == 0)
+    return NULL;
+
+  for(i = addr_hash(family, paddr) & (index->hosts_size - 1);
+      index->hosts[i].used;
+      i = (i + 1) & (index->hosts_size - 1))
+    if(index->hosts[i].family == family &&
+       !memcmp(&index->hosts[i].addr, paddr, sizeof(*paddr)))
+      return &index->hosts[i];
+
+  if(!add)
+    return NULL;
+
+  index->hosts[i].used = TRUE;
+  index->hosts[i].family = family;
+  index->hosts[i].addr = *paddr;
+  return &index->hosts[i];
+}
+
+/* Netmasks like 255.0.255.0 can not be stored in the trie */
+static inline int netmask_prefix(unsigned int netmask)
+{
+  unsigned int inverted = ~netmask;
+  int prefix = 0;
+
+  if((inverted & (inverted + 1)) != 0)
+    return -1;
+
+  while(prefix < 32 && (netmask & (0x80000000U >> prefix)))
+    prefix++;
+
+  return prefix;
+}
+
+static int client_trie_add(client_trie_node_t ** proot,
+                           unsigned int netaddr, int prefix, unsigned int pos)
+{
+  client_trie_node_t **pnode = proot;
+  int depth;
+
+  for(depth = 0;; depth++)
+    {
+      if(*pnode == NULL)
+        {
+          *pnode = (client_trie_node_t *) Mem_Alloc(sizeof(client_trie_node_t));
+          if(*pnode == NULL)
+            return ENOMEM;
+          memset(*pnode, 0, sizeof(client_trie_node_t));
+        }
+
+      if(depth == prefix)
+        break;
+
+      pnode = &(*pnode)->child[(netaddr >> (31 - depth)) & 1];
+    }
+
+  (*pnode)->has_clients = TRUE;
+  client_set_add(&(*pnode)->clients, pos);
+
+  return 0;
+}
+
+static void client_trie_free(client_trie_node_t * node)
+{
+  if(node == NULL)
+    return;
+
+  client_trie_free(node->child[0]);
+  client_trie_free(node->child[1]);
+  Mem_Free(node);
+}
+
+/**
+ *
+ * export_client_index_free: frees the compiled form of a client array.
+ *
+ * @param clients [INOUT] the client array
+ *
+ * @return nothing (void function)
+ *
+ */
+void export_client_index_free(exportlist_client_t * clients)
+{
+  exportlist_client_index_t *index = clients->index;
+
+  if(index == NULL)
+    return;
+
+  clients->index = NULL;
+
+  client_trie_free(index->trie4);
+  if(index->hosts != NULL)
+    Mem_Free(index->hosts);
+  Mem_Free(index);
+}                               /* export_client_index_free */
+
+/**
+ *
+ * export_client_index_build: compiles a client array.
+ *
+ * Must be called again whenever the array changes. The array must not be
+ * looked up meanwhile.
+ *
+ * @param clients [INOUT] the client array
+ *
+ * @return 0 if successful, ENOMEM otherwise. The array is then looked up
+ * linearly.
+ *
+ */
+int export_client_index_build(exportlist_client_t * clients)
+{
+  exportlist_client_index_t *index;
+  exportlist_client_entry_t *pclient;
+  client_host_t *phost;
+  struct in6_addr addr6;
+  unsigned int pos, bit, nb_hosts = 0;
+  int prefix;
+
+  export_client_index_free(clients);
+
+  index = (exportlist_client_index_t *) Mem_Alloc(sizeof(exportlist_client_index_t));
+  if(index == NULL)
+    return ENOMEM;
+
+  memset(index, 0, sizeof(exportlist_client_index_t));
+
+  for(pos = 0; pos < clients->num_clients; pos++)
+    if(clients->clientarray[pos].type == HOSTIF_CLIENT ||
+       clients->clientarray[pos].type == HOSTIF_CLIENT_V6)
+      nb_hosts++;
+
+  /* Keep the hash at most half full */
+  if(nb_hosts > 0)
+    {
+      for(index->hosts_size = 8; index->hosts_size < 2 * nb_hosts; index->hosts_size *= 2) ;
+
+      index->hosts = (client_host_t *) Mem_Alloc(index->hosts_size * sizeof(client_host_t));
+      if(index->hosts == NULL)
+        {
+          Mem_Free(index);
+          return ENOMEM;
+        }
+      memset(index->hosts, 0, index->hosts_size * sizeof(client_host_t));
+    }
+
+  for(pos = 0; pos < clients->num_clients; pos++)
+    {
+      pclient = &clients->clientarray[pos];
+
+      for(bit = 0; bit < 32; bit++)
+        if(pclient->options & (1U << bit))
+          client_set_add(&index->by_option[bit], pos);
+
+      switch (pclient->type)
+        {
+        case HOSTIF_CLIENT:
+          addr_from_ipv4(&addr6, pclient->client.hostif.clientaddr);
+          phost = client_host_find(index, AF_INET, &addr6, TRUE);
+          client_set_add(&phost->clients, pos);
+          break;
+
+        case HOSTIF_CLIENT_V6:
+          phost = client_host_find(index, AF_INET6,
+                                   &pclient->client.hostif.clientaddr6, TRUE);
+          client_set_add(&phost->clients, pos);
+          break;
+
+        case NETWORK_CLIENT:
+          prefix = netmask_prefix(pclient->client.network.netmask);
+          if(prefix < 0)
+            {
+              client_set_add(&index->slow4, pos);
+              break;
+            }
+
+          if(client_trie_add(&index->trie4,
+                             pclient->client.network.netaddr, prefix, pos) != 0)
+            {
+              clients->index = index;
+              export_client_index_free(clients);
+              return ENOMEM;
+            }
+          break;
+
+        case NETGROUP_CLIENT:
+        case WILDCARDHOST_CLIENT:
+        case GSSPRINCIPAL_CLIENT:
+          client_set_add(&index->slow4, pos);
+          break;
+
+        default:
+          /* Bad entries are reported (IPv4) or end the search (IPv6) */
+          client_set_add(&index->slow4, pos);
+          client_set_add(&index->stop6, pos);
+          break;
+        }
+    }
+
+  clients->index = index;
+
+  LogDebug(COMPONENT_CONFIG,
+           "Compiled a client list of %u entries, %u hosts",
+           clients->num_clients, nb_hosts);
+
+  return 0;
+}                               /* export_client_index_build */
+
+/* Entries having the options looked for, as tested by export_client_match */
+static void client_option_filter(exportlist_client_index_t * index,
+                                 unsigned int export_option,
+                                 client_set_t * pfilter)
+{
+  client_set_t *root = &index->by_option[__builtin_ctz(EXPORT_OPTION_ROOT)];
+  unsigned int bit;
+  int i;
+
+  memset(pfilter, 0, sizeof(*pfilter));
+
+  for(bit = 0; bit < 32; bit++)
+    if(export_option & (1U << bit))
+      client_set_or(pfilter, &index->by_option[bit]);
+
+  for(i = 0; i < CLIENT_SET_WORDS; i++)
+    if(export_option & EXPORT_OPTION_ROOT)
+      pfilter->bits[i] &= root->bits[i];
+    else
+      pfilter->bits[i] &= ~root->bits[i];
+}                               /* client_option_filter */
+
+static inline client_decision_t *client_decision_slot(exportlist_client_index_t * index,
+                                                      int family,
+                                                      const struct in6_addr *paddr,
+                                                      unsigned int export_option)
+{
+  return &index->cache[(addr_hash(family, paddr) ^ (export_option * 0x9E3779B1))
+                       % EXPORT_CLIENT_DECISION_CACHE_SIZE];
+}
+
+/* Lock free read of a cached decision, returns FALSE if there is none */
+static int client_decision_get(exportlist_client_index_t * index,
+                               int family,
+                               const struct in6_addr *paddr,
+                               unsigned int export_option,
+                               int *pposition)
+{
+  client_decision_t *slot = client_decision_slot(index, family, paddr, export_option);
+  uint32_t seq;
+  int found;
+
+  seq = atomic_fetch_uint32_t(&slot->seq);
+  if(seq == 0 || (seq & 1))
+    return FALSE;
+
+  found = slot->option == export_option && slot->family == family &&
+      !memcmp(&slot->addr, paddr, sizeof(*paddr)) &&
+      (slot->expire == 0 || slot->expire > time(NULL));
+  *pposition = slot->position;
+
+  atomic_barrier();
+
+  return found && atomic_fetch_uint32_t(&slot->seq) == seq;
+}                               /* client_decision_get */
+
+static void client_decision_set(exportlist_client_index_t * index,
+                                int family,
+                                const struct in6_addr *paddr,
+                                unsigned int export_option,
+                                int position,
+                                time_t expire)
+{
+  client_decision_t *slot = client_decision_slot(index, family, paddr, export_option);
+  uint32_t seq;
+
+  /* If another thread is writing the slot, let it win */
+  seq = atomic_fetch_uint32_t(&slot->seq);
+  if((seq & 1) || !atomic_cas_uint32_t(&slot->seq, seq, seq + 1))
+    return;
+
+  slot->option = export_option;
+  slot->family = family;
+  slot->addr = *paddr;
+  slot->position = position;
+  slot->expire = expire;
+
+  atomic_barrier();
+  atomic_store_uint32_t(&slot->seq, seq + 2);
+}                               /* client_decision_set */
+
+/**
+ *
+ * export_client_index_lookup: finds the first entry of a client array
+ * matching an address.
+ *
+ * @param clients       [IN] the client array
+ * @param family        [IN] AF_INET or AF_INET6
+ * @param paddr         [IN] the address, an in_addr_t or a struct in6_addr
+ * @param export_option [IN] options the entry must have
+ * @param slow_match    [IN] matches the entries that are not hosts or networks
+ * @param arg           [IN] argument of slow_match
+ * @param volatile_ttl  [IN] lifetime of the cached decisions depending on names
+ *
+ * @return the position of the entry, -1 if none matches.
+ *
+ */
+int export_client_index_lookup(exportlist_client_t * clients,
+                               int family,
+                               void *paddr,
+                               unsigned int export_option,
+                               export_client_slow_match_t slow_match,
+                               void *arg,
+                               time_t volatile_ttl)
+{
+  exportlist_client_index_t *index = clients->index;
+  client_set_t candidates, filter, slow;
+  client_trie_node_t *node;
+  client_host_t *phost;
+  struct in6_addr addr6;
+  unsigned int haddr;
+  int position, pos, depth, i;
+  int is_volatile = FALSE;
+
+  if(family == AF_INET)
+    addr_from_ipv4(&addr6, *(in_addr_t *) paddr);
+  else
+    addr6 = *(struct in6_addr *)paddr;
+
+  if(client_decision_get(index, family, &addr6, export_option, &position))
+    return position;
+
+  memset(&candidates, 0, sizeof(candidates));
+
+  phost = client_host_find(index, family, &addr6, FALSE);
+  if(phost != NULL)
+    client_set_or(&candidates, &phost->clients);
+
+  if(family == AF_INET)
+    {
+      /* Gather all the networks containing the address */
+      haddr = ntohl(*(in_addr_t *) paddr);
+
+      for(node = index->trie4, depth = 0; node != NULL; depth++)
+        {
+          if(node->has_clients)
+            client_set_or(&candidates, &node->clients);
+
+          if(depth == 32)
+            break;
+
+          node = node->child[(haddr >> (31 - depth)) & 1];
+        }
+
+      slow = index->slow4;
+    }
+  else
+    slow = index->stop6;
+
+  client_option_filter(index, export_option, &filter);
+
+  for(i = 0; i < CLIENT_SET_WORDS; i++)
+    {
+      candidates.bits[i] &= filter.bits[i];
+      slow.bits[i] &= filter.bits[i];
+    }
+
+  position = client_set_first(&candidates);
+
+  /* Entries before the first matching host or network may match first */
+  while((pos = client_set_first(&slow)) >= 0 && (position < 0 || pos < position))
+    {
+      client_set_remove(&slow, pos);
+
+      if(family != AF_INET)
+        {
+          position = -1;
+          break;
+        }
+
+      switch (slow_match(&clients->clientarray[pos], arg, &is_volatile))
+        {
+        case EXPORT_CLIENT_MATCH:
+          position = pos;
+          break;
+
+        case EXPORT_CLIENT_STOP:
+          position = -1;
+          break;
+
+        case EXPORT_CLIENT_NO_MATCH:
+          continue;
+        }
+
+      break;
+    }
+
+  if(!is_volatile)
+    client_decision_set(index, family, &addr6, export_option, position, 0);
+  else if(volatile_ttl > 0)
+    client_decision_set(index, family, &addr6, export_option, position,
+                        time(NULL) + volatile_ttl);
+
+  return position;
+}                               /* export_client_index_lookup */
@@ -121,6 +121,7 @@ cache_content_client_t recover_datacache_client;
 #define CONF_EXPORT_UQUOTA             "User_Quota"
 #define CONF_EXPORT_USE_COMMIT                  "Use_NFS_Commit"
 #define CONF_EXPORT_USE_GANESHA_WRITE_BUFFER    "Use_Ganesha_Write_Buffer"
+#define CONF_EXPORT_MANAGE_GIDS        "Manage_Gids"
 #define CONF_EXPORT_USE_FSAL_UP        "Use_FSAL_UP"
 #define CONF_EXPORT_FSAL_UP_FILTERS    "FSAL_UP_Filters"
 #define CONF_EXPORT_FSAL_UP_TIMEOUT    "FSAL_UP_Timeout"
@@ -509,6 +510,11 @@ int nfs_AddClientsToClientArray(exportlist_client_t *clients,
    */
   (*clients).num_clients += new_clients_number;
 
+  /* Compile the new list, it will be looked up linearly if this fails */
+  if(export_client_index_build(clients) != 0)
+    LogCrit(COMPONENT_CONFIG,
+            "Could not compile the client list, it will be scanned linearly");
+
   return 0;                     /* success !! */
 }                               /* nfs_AddClientsToClientArray */
 
@@ -1987,6 +1993,28 @@ static int BuildExportEntry(config_item_t block, exportlist_t ** pp_export)
               p_entry->use_commit = FALSE;
               break;
 
+            default:           /* error */
+              {
+                LogCrit(COMPONENT_CONFIG,
+                        "NFS READ_EXPORT: ERROR: Invalid value for %s (%s): TRUE or FALSE expected.",
+                        var_name, var_value);
+                err_flag = TRUE;
+                continue;
+              }
+            }
+        }
+      else if(!STRCMP(var_name, CONF_EXPORT_MANAGE_GIDS))
+        {
+          switch (StrToBoolean(var_value))
+            {
+            case 1:
+              p_entry->manage_gids = TRUE;
+              break;
+
+            case 0:
+              p_entry->manage_gids = FALSE;
+              break;
+
             default:           /* error */
               {
                 LogCrit(COMPONENT_CONFIG,
@@ -2201,6 +2229,7 @@ exportlist_t *BuildDefaultExport()
   p_entry->options = 0;
   p_entry->status = EXPORTLIST_OK;
   p_entry->clients.num_clients = 0;
+  p_entry->clients.index = NULL;
   p_entry->access_type = ACCESSTYPE_RW;
   p_entry->anonymous_uid = (uid_t) ANON_UID;
   p_entry->MaxOffsetWrite = (fsal_off_t) 0;
@@ -2348,6 +2377,155 @@ int ReadExports(config_file_t in_config,        /* The file that contains the ex
     return nb_entries;
 }
 
+/* What export_client_match_entry needs to know about the client */
+typedef struct export_client_addr__
+{
+  sockaddr_t *hostaddr;
+  char *ipstring;
+} export_client_addr_t;
+
+/**
+ * function for matching an IPv4 client with one entry of a client export list.
+ * Sets *pvolatile if the result depends on the name of the client.
+ */
+static exportlist_client_match_t export_client_match_entry(exportlist_client_entry_t * pclient,
+                                                           void *arg,
+                                                           int *pvolatile)
+{
+  export_client_addr_t *pclient_addr = (export_client_addr_t *) arg;
+  sockaddr_t *hostaddr = pclient_addr->hostaddr;
+  int rc;
+  char hostname[MAXHOSTNAMELEN];
+  in_addr_t addr = get_in_addr(hostaddr);
+
+  switch (pclient->type)
+    {
+    case HOSTIF_CLIENT:
+      if(pclient->client.hostif.clientaddr == addr)
+        {
+          LogFullDebug(COMPONENT_DISPATCH, "This matches host address");
+          return EXPORT_CLIENT_MATCH;
+        }
+      break;
+
+    case NETWORK_CLIENT:
+      LogDebug( COMPONENT_DISPATCH, "test NETWORK_CLIENT: addr=%#.08X, netmask=%#.08X, match with %#.08X",
+                pclient->client.network.netaddr,
+                pclient->client.network.netmask, ntohl(addr));
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Test net %d.%d.%d.%d in %d.%d.%d.%d ??",
+                   (unsigned int)(pclient->client.network.netaddr >> 24),
+                   (unsigned int)((pclient->client.network.netaddr >> 16) & 0xFF),
+                   (unsigned int)((pclient->client.network.netaddr >> 8) & 0xFF),
+                   (unsigned int)(pclient->client.network.netaddr & 0xFF),
+                   (unsigned int)(addr >> 24),
+                   (unsigned int)(addr >> 16) & 0xFF,
+                   (unsigned int)(addr >> 8) & 0xFF,
+                   (unsigned int)(addr & 0xFF));
+
+      if((pclient->client.network.netmask & ntohl(addr)) ==
+         pclient->client.network.netaddr)
+        {
+          LogFullDebug(COMPONENT_DISPATCH, "This matches network address");
+          return EXPORT_CLIENT_MATCH;
+        }
+      break;
+
+    case NETGROUP_CLIENT:
+      *pvolatile = TRUE;
+
+      /* Try to get the entry from th IP/name cache */
+      if((rc = nfs_ip_name_get(hostaddr, hostname)) != IP_NAME_SUCCESS)
+        {
+          if(rc == IP_NAME_NOT_FOUND)
+            {
+              /* IPaddr was not cached, add it to the cache */
+              if(nfs_ip_name_add(hostaddr, hostname) != IP_NAME_SUCCESS)
+                {
+                  /* Major failure, name could not be resolved */
+                  break;
+                }
+            }
+        }
+
+      /* At this point 'hostname' should contain the name that was found */
+      if(innetgr
+         (pclient->client.netgroup.netgroupname, hostname,
+          NULL, NULL) == 1)
+        {
+          return EXPORT_CLIENT_MATCH;
+        }
+      break;
+
+    case WILDCARDHOST_CLIENT:
+      /* Now checking for IP wildcards */
+      if(fnmatch
+         (pclient->client.wildcard.wildcard, pclient_addr->ipstring,
+          FNM_PATHNAME) == 0)
+        {
+          return EXPORT_CLIENT_MATCH;
+        }
+
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Did not match the ip address with a wildcard.");
+
+      *pvolatile = TRUE;
+
+      /* Try to get the entry from th IP/name cache */
+      if((rc = nfs_ip_name_get(hostaddr, hostname)) != IP_NAME_SUCCESS)
+        {
+          if(rc == IP_NAME_NOT_FOUND)
+            {
+              /* IPaddr was not cached, add it to the cache */
+              if(nfs_ip_name_add(hostaddr, hostname) != IP_NAME_SUCCESS)
+                {
+                  /* Major failure, name could not be resolved */
+                  LogFullDebug(COMPONENT_DISPATCH,
+                               "Could not resolve hostame for addr %u.%u.%u.%u ... not checking if a hostname wildcard matches",
+                               (unsigned int)(addr & 0xFF),
+                               (unsigned int)(addr >> 8) & 0xFF,
+                               (unsigned int)(addr >> 16) & 0xFF,
+                               (unsigned int)(addr >> 24));
+                  break;
+                }
+            }
+        }
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "Wildcarded hostname: testing if '%s' matches '%s'",
+                   hostname, pclient->client.wildcard.wildcard);
+
+      /* At this point 'hostname' should contain the name that was found */
+      if(fnmatch
+         (pclient->client.wildcard.wildcard, hostname,
+          FNM_PATHNAME) == 0)
+        {
+          return EXPORT_CLIENT_MATCH;
+        }
+      LogFullDebug(COMPONENT_DISPATCH, "'%s' not matching '%s'",
+                   hostname, pclient->client.wildcard.wildcard);
+      break;
+
+    case GSSPRINCIPAL_CLIENT:
+      /** @toto BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "----------> Unsupported type GSS_PRINCIPAL_CLIENT");
+      return EXPORT_CLIENT_STOP;
+      break;
+
+    case BAD_CLIENT:
+      LogDebug(COMPONENT_DISPATCH,
+               "Bad client seen in export list");
+      break;
+
+    default:
+      LogCrit(COMPONENT_DISPATCH,
+              "Unsupported client in export list with type %u", pclient->type);
+      break;
+    }                           /* switch */
+
+  return EXPORT_CLIENT_NO_MATCH;
+}                               /* export_client_match_entry */
+
 /**
  * function for matching a specific option in the client export list.
  */
@@ -2358,9 +2536,9 @@ int export_client_match(sockaddr_t *hostaddr,
 			unsigned int export_option)
 {
   unsigned int i;
-  int rc;
-  char hostname[MAXHOSTNAMELEN];
+  int pos, is_volatile;
   in_addr_t addr = get_in_addr(hostaddr);
+  export_client_addr_t client_addr;
 
   if(export_option & EXPORT_OPTION_ROOT)
     LogFullDebug(COMPONENT_DISPATCH,
@@ -2374,6 +2552,26 @@ int export_client_match(sockaddr_t *hostaddr,
     LogFullDebug(COMPONENT_DISPATCH,
                  "Looking for nonroot access write entries");
 
+  client_addr.hostaddr = hostaddr;
+  client_addr.ipstring = ipstring;
+
+  /* Use the compiled client list when there is one */
+  if(clients->index != NULL)
+    {
+      pos = export_client_index_lookup(clients,
+                                       AF_INET,
+                                       &addr,
+                                       export_option,
+                                       export_client_match_entry,
+                                       &client_addr,
+                                       nfs_param.ip_name_param.expiration_time);
+      if(pos < 0)
+        return FALSE;
+
+      *pclient_found = clients->clientarray[pos];
+      return TRUE;
+    }
+
   for(i = 0; i < clients->num_clients; i++)
     {
       /* Make sure the client entry has the permission flags we're looking for
@@ -2382,131 +2580,18 @@ int export_client_match(sockaddr_t *hostaddr,
          ((clients->clientarray[i].options & EXPORT_OPTION_ROOT) != (export_option & EXPORT_OPTION_ROOT)))
         continue;
 
-      switch (clients->clientarray[i].type)
+      switch (export_client_match_entry(&clients->clientarray[i], &client_addr, &is_volatile))
         {
-        case HOSTIF_CLIENT:
-          if(clients->clientarray[i].client.hostif.clientaddr == addr)
-            {
-              LogFullDebug(COMPONENT_DISPATCH, "This matches host address");
-              *pclient_found = clients->clientarray[i];
-              return TRUE;
-            }
-          break;
-
-        case NETWORK_CLIENT:
-          LogDebug( COMPONENT_DISPATCH, "test NETWORK_CLIENT: addr=%#.08X, netmask=%#.08X, match with %#.08X",
-                    clients->clientarray[i].client.network.netaddr,
-                    clients->clientarray[i].client.network.netmask, ntohl(addr));
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "Test net %d.%d.%d.%d in %d.%d.%d.%d ??",
-                       (unsigned int)(clients->clientarray[i].client.network.netaddr >> 24),
-                       (unsigned int)((clients->clientarray[i].client.network.netaddr >> 16) & 0xFF),
-                       (unsigned int)((clients->clientarray[i].client.network.netaddr >> 8) & 0xFF),
-                       (unsigned int)(clients->clientarray[i].client.network.netaddr & 0xFF),
-                       (unsigned int)(addr >> 24),
-                       (unsigned int)(addr >> 16) & 0xFF,
-                       (unsigned int)(addr >> 8) & 0xFF,
-                       (unsigned int)(addr & 0xFF));
-
-          if((clients->clientarray[i].client.network.netmask & ntohl(addr)) ==
-             clients->clientarray[i].client.network.netaddr)
-            {
-              LogFullDebug(COMPONENT_DISPATCH, "This matches network address");
-              *pclient_found = clients->clientarray[i];
-              return TRUE;
-            }
-          break;
-
-        case NETGROUP_CLIENT:
-          /* Try to get the entry from th IP/name cache */
-          if((rc = nfs_ip_name_get(hostaddr, hostname)) != IP_NAME_SUCCESS)
-            {
-              if(rc == IP_NAME_NOT_FOUND)
-                {
-                  /* IPaddr was not cached, add it to the cache */
-                  if(nfs_ip_name_add(hostaddr, hostname) != IP_NAME_SUCCESS)
-                    {
-                      /* Major failure, name could not be resolved */
-                      break;
-                    }
-                }
-            }
-
-          /* At this point 'hostname' should contain the name that was found */
-          if(innetgr
-             (clients->clientarray[i].client.netgroup.netgroupname, hostname,
-              NULL, NULL) == 1)
-            {
-              *pclient_found = clients->clientarray[i];
-              return TRUE;
-            }
-          break;
+        case EXPORT_CLIENT_MATCH:
+          *pclient_found = clients->clientarray[i];
+          return TRUE;
 
-        case WILDCARDHOST_CLIENT:
-          /* Now checking for IP wildcards */
-          if(fnmatch
-             (clients->clientarray[i].client.wildcard.wildcard, ipstring,
-              FNM_PATHNAME) == 0)
-            {
-              *pclient_found = clients->clientarray[i];
-              return TRUE;
-            }
-
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "Did not match the ip address with a wildcard.");
-
-          /* Try to get the entry from th IP/name cache */
-          if((rc = nfs_ip_name_get(hostaddr, hostname)) != IP_NAME_SUCCESS)
-            {
-              if(rc == IP_NAME_NOT_FOUND)
-                {
-                  /* IPaddr was not cached, add it to the cache */
-                  if(nfs_ip_name_add(hostaddr, hostname) != IP_NAME_SUCCESS)
-                    {
-                      /* Major failure, name could not be resolved */
-                      LogFullDebug(COMPONENT_DISPATCH,
-                                   "Could not resolve hostame for addr %u.%u.%u.%u ... not checking if a hostname wildcard matches",
-                                   (unsigned int)(addr & 0xFF),
-                                   (unsigned int)(addr >> 8) & 0xFF,
-                                   (unsigned int)(addr >> 16) & 0xFF,
-                                   (unsigned int)(addr >> 24));
-                      break;
-                    }
-                }
-            }
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "Wildcarded hostname: testing if '%s' matches '%s'",
-                       hostname, clients->clientarray[i].client.wildcard.wildcard);
-
-          /* At this point 'hostname' should contain the name that was found */
-          if(fnmatch
-             (clients->clientarray[i].client.wildcard.wildcard, hostname,
-              FNM_PATHNAME) == 0)
-            {
-              *pclient_found = clients->clientarray[i];
-              return TRUE;
-            }
-          LogFullDebug(COMPONENT_DISPATCH, "'%s' not matching '%s'",
-                       hostname, clients->clientarray[i].client.wildcard.wildcard);
-          break;
-
-        case GSSPRINCIPAL_CLIENT:
-          /** @toto BUGAZOMEU a completer lors de l'integration de RPCSEC_GSS */
-          LogFullDebug(COMPONENT_DISPATCH,
-                       "----------> Unsupported type GSS_PRINCIPAL_CLIENT");
+        case EXPORT_CLIENT_STOP:
           return FALSE;
-          break;
 
-       case BAD_CLIENT:
-          LogDebug(COMPONENT_DISPATCH,
-                  "Bad client in position %u seen in export list", i );
-	  continue ;
-
-        default:
-           LogCrit(COMPONENT_DISPATCH,
-                   "Unsupported client in position %u in export list with type %u", i, clients->clientarray[i].type);
-	   continue ;
-        }                       /* switch */
+        case EXPORT_CLIENT_NO_MATCH:
+          break;
+        }
     }                           /* for */
 
   /* no export found for this option */
@@ -2520,6 +2605,7 @@ int export_client_matchv6(struct in6_addr *paddrv6,
 			  unsigned int export_option)
 {
   unsigned int i;
+  int pos;
 
   if(export_option & EXPORT_OPTION_ROOT)
     LogFullDebug(COMPONENT_DISPATCH,
@@ -2533,6 +2619,25 @@ int export_client_matchv6(struct in6_addr *paddrv6,
     LogFullDebug(COMPONENT_DISPATCH,
                  "Looking for nonroot access write entries");
 
+  /* Use the compiled client list when there is one */
+  if(clients->index != NULL)
+    {
+      pos = export_client_index_lookup(clients,
+                                       AF_INET6,
+                                       paddrv6,
+                                       export_option,
+                                       NULL,
+                                       NULL,
+                                       0);
+      if(pos < 0)
+        return FALSE;
+
+      LogFullDebug(COMPONENT_DISPATCH,
+                   "This matches host adress in IPv6");
+      *pclient_found = clients->clientarray[pos];
+      return TRUE;
+    }
+
   for(i = 0; i < clients->num_clients; i++)
     {
       /* Make sure the client entry has the permission flags we're looking for
@@ -3126,6 +3231,8 @@ exportlist_t *RemoveExportEntry(exportlist_t * exportEntry)
   if (exportEntry->proot_handle != NULL)
     Mem_Free(exportEntry->proot_handle);
 
+  export_client_index_free(&exportEntry->clients);
+
   Mem_Free(exportEntry);
   return next;
 }
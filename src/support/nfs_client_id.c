@@ -561,6 +561,11 @@ void nfs_client_id_expire(nfs_client_id_t *client_record)
       release_openstate(popen_owner);
     }
 
+  /* the delegations are states of the clientid owner */
+  state_deleg_release(client_record->clientid_owner,
+                      client_record->clientid_owner->so_pclient);
+  nfs4_cb_forget(client_record->clientid);
+
   dec_state_owner_ref(client_record->clientid_owner, client_record->clientid_owner->so_pclient);
 
   if (client_record->recov_dir != NULL)
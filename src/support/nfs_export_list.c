@@ -322,11 +322,29 @@ int nfs_check_anon(exportlist_client_entry_t * pexport_client,
   return TRUE;
 }
 
+/* The groups of the last context built by a thread with Manage_Gids: past
+ * FSAL_NGROUPS_MAX, the FSAL credentials point in them. */
+static pthread_key_t uid2grp_groups_key;
+static pthread_once_t uid2grp_groups_once = PTHREAD_ONCE_INIT;
+
+static void uid2grp_groups_release(void *arg)
+{
+  uid2grp_unref((uid2grp_groups_t *) arg);
+}                               /* uid2grp_groups_release */
+
+static void uid2grp_groups_init_key(void)
+{
+  pthread_key_create(&uid2grp_groups_key, uid2grp_groups_release);
+}                               /* uid2grp_groups_init_key */
+
 /**
  *
  * nfs_build_fsal_context: Builds the FSAL context according to the request and the export entry.
  *
  * Builds the FSAL credentials according to the request and the export entry.
+ * On the exports with Manage_Gids, the groups of AUTH_UNIX users are those the
+ * name service knows, got from the uid2grp cache. The thread keeps a
+ * reference on them until it builds its next context.
  *
  * @param ptr_req [IN]  incoming request.
  * @param pexport_client [IN] related export client
@@ -343,15 +361,48 @@ int nfs_build_fsal_context(struct svc_req *ptr_req,
                            struct user_cred *user_credentials)
 {
   fsal_status_t fsal_status;
+  uid2grp_groups_t *pgroups = NULL;
+  uid2grp_groups_t *pold;
+  gid_t *garray;
+  unsigned int glen;
 
   if (user_credentials == NULL)
     return FALSE;
 
+  garray = user_credentials->caller_garray;
+  glen = user_credentials->caller_glen;
+
+  /* With Manage_Gids, an AUTH_UNIX user gets all the groups the name service
+   * knows, not the 16 of the request. The users squashed to the anonymous uid
+   * keep no groups. */
+  if(pexport->manage_gids && ptr_req->rq_cred.oa_flavor == AUTH_UNIX &&
+     ((struct authunix_parms *)ptr_req->rq_clntcred)->aup_uid ==
+     user_credentials->caller_uid)
+    {
+      if(uid2grp(user_credentials->caller_uid, &pgroups))
+        {
+          garray = pgroups->groups;
+          glen = pgroups->nbgroups;
+        }
+      else
+        LogDebug(COMPONENT_DISPATCH,
+                 "No groups known for uid %d, using the groups of the request",
+                 user_credentials->caller_uid);
+    }
+
   /* Build the credentials */
   fsal_status = FSAL_GetClientContext(pcontext,
                                       &pexport->FS_export_context,
                                       user_credentials->caller_uid, user_credentials->caller_gid,
-                                      user_credentials->caller_garray, user_credentials->caller_glen);
+                                      garray, glen);
+
+  /* Past FSAL_NGROUPS_MAX, the context uses the groups in place: they are
+   * kept for the request, the ones of the previous request are released */
+  pthread_once(&uid2grp_groups_once, uid2grp_groups_init_key);
+  pold = (uid2grp_groups_t *) pthread_getspecific(uid2grp_groups_key);
+  pthread_setspecific(uid2grp_groups_key, pgroups);
+  if(pold != NULL)
+    uid2grp_unref(pold);
 
   if(FSAL_IS_ERROR(fsal_status))
     {
@@ -363,8 +414,8 @@ int nfs_build_fsal_context(struct svc_req *ptr_req,
     }
   else
     LogDebug(COMPONENT_DISPATCH,
-             "NFS DISPATCHER: FSAL Cred acquired for (uid=%d,gid=%d)",
-             user_credentials->caller_uid, user_credentials->caller_gid);
+             "NFS DISPATCHER: FSAL Cred acquired for (uid=%d,gid=%d,ngroups=%u)",
+             user_credentials->caller_uid, user_credentials->caller_gid, glen);
 
   return TRUE;
 }                               /* nfs_build_fsal_context */
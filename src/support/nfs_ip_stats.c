@@ -420,23 +420,28 @@ hash_table_t *nfs_Init_ip_stats(nfs_ip_stats_parameter_t param)
   return ht_ip_stats;
 }                               /* nfs_Init_ip_stats */
 
+/* What the dump of the stats of one client needs */
+typedef struct nfs_ip_stats_dump_arg__
+{
+  hash_table_t **ht_ip_stats;
+  unsigned int nb_worker;
+  char *path_stat;
+  char *strdate;
+} nfs_ip_stats_dump_arg_t;
+
 /**
  *
- * nfs_ip_stats_dump: Dumps the IP Stats for each client to a file per client
+ * nfs_ip_stats_dump_client: Dumps the IP Stats of one client, for HashTable_Walk.
  *
- * @param ht_ip_stats [IN] hash table to be dumped
- * @param path_stat   [IN] pattern used to build path used for dumping stats
+ * @param pdata [IN] the entry of the client in the table of worker #0
+ * @param arg   [IN] the nfs_ip_stats_dump_arg_t of the dump
  *
- * @return nothing (void function).
+ * @return TRUE to dump the next client, FALSE to stop on an error.
  *
  */
-void nfs_ip_stats_dump(hash_table_t ** ht_ip_stats,
-                       unsigned int nb_worker, char *path_stat)
+static int nfs_ip_stats_dump_client(hash_data_t * pdata, void *arg)
 {
-  struct rbt_node *it;
-  struct rbt_head *tete_rbt;
-  hash_data_t *pdata = NULL;
-  unsigned int i = 0;
+  nfs_ip_stats_dump_arg_t *pdump = (nfs_ip_stats_dump_arg_t *) arg;
   unsigned int j = 0;
   unsigned int k = 0;
   nfs_ip_stats_t *pnfs_ip_stats[NB_MAX_WORKER_THREAD];
@@ -445,10 +450,108 @@ void nfs_ip_stats_dump(hash_table_t ** ht_ip_stats,
   char ipaddrbuf[40];
   char ifpathdump[MAXPATHLEN];
   sockaddr_t * ipaddr;
+  char *strdate = pdump->strdate;
+  FILE *flushipstat = NULL;
+
+  ipaddr = (sockaddr_t *) pdata->buffkey.pdata;
+
+  sprint_sockaddr(ipaddr, ipaddrbuf, sizeof(ipaddrbuf));
+
+  snprintf(ifpathdump, MAXPATHLEN, "%s/stats_nfs-%s", pdump->path_stat, ipaddrbuf);
+
+  if((flushipstat = fopen(ifpathdump, "a")) == NULL)
+    return FALSE;
+
+  /* Collect stats for each worker and aggregate them */
+  memset(&ip_stats_aggreg, 0, sizeof(ip_stats_aggreg));
+  for(j = 0; j < pdump->nb_worker; j++)
+    {
+      if(nfs_ip_stats_get(pdump->ht_ip_stats[j],
+                          ipaddr, &pnfs_ip_stats[j]) != IP_STATS_SUCCESS)
+        {
+          fclose(flushipstat);
+          return FALSE;
+        }
+      ip_stats_aggreg.nb_call += (pnfs_ip_stats[j])->nb_call;
+
+      ip_stats_aggreg.nb_req_nfs2 += (pnfs_ip_stats[j])->nb_req_nfs2;
+      ip_stats_aggreg.nb_req_nfs3 += (pnfs_ip_stats[j])->nb_req_nfs3;
+      ip_stats_aggreg.nb_req_nfs4 += (pnfs_ip_stats[j])->nb_req_nfs4;
+      ip_stats_aggreg.nb_req_mnt1 += (pnfs_ip_stats[j])->nb_req_mnt1;
+      ip_stats_aggreg.nb_req_mnt3 += (pnfs_ip_stats[j])->nb_req_mnt3;
+
+      for(k = 0; k < MNT_V1_NB_COMMAND; k++)
+        ip_stats_aggreg.req_mnt1[k] += (pnfs_ip_stats[j])->req_mnt1[k];
+
+      for(k = 0; k < MNT_V3_NB_COMMAND; k++)
+        ip_stats_aggreg.req_mnt3[k] += (pnfs_ip_stats[j])->req_mnt3[k];
+
+      for(k = 0; k < NFS_V2_NB_COMMAND; k++)
+        ip_stats_aggreg.req_nfs2[k] += (pnfs_ip_stats[j])->req_nfs2[k];
+
+      for(k = 0; k < NFS_V3_NB_COMMAND; k++)
+        ip_stats_aggreg.req_nfs3[k] += (pnfs_ip_stats[j])->req_nfs3[k];
+    }
+
+  /* Write stats to file */
+  fprintf(flushipstat, "NFS/MOUNT STATISTICS,%s;%u|%u,%u,%u,%u,%u\n",
+          strdate,
+          ip_stats_aggreg.nb_call,
+          ip_stats_aggreg.nb_req_mnt1,
+          ip_stats_aggreg.nb_req_mnt3,
+          ip_stats_aggreg.nb_req_nfs2,
+          ip_stats_aggreg.nb_req_nfs3, ip_stats_aggreg.nb_req_nfs4);
+
+  fprintf(flushipstat, "MNT V1 REQUEST,%s;%u|", strdate,
+          ip_stats_aggreg.nb_req_mnt1);
+  for(k = 0; k < MNT_V1_NB_COMMAND - 1; k++)
+    fprintf(flushipstat, "%u,", ip_stats_aggreg.req_mnt1[k]);
+  fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_mnt1[MNT_V1_NB_COMMAND - 1]);
+
+  fprintf(flushipstat, "MNT V3 REQUEST,%s;%u|", strdate,
+          ip_stats_aggreg.nb_req_mnt3);
+  for(k = 0; k < MNT_V3_NB_COMMAND - 1; k++)
+    fprintf(flushipstat, "%u,", ip_stats_aggreg.req_mnt3[k]);
+  fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_mnt3[MNT_V3_NB_COMMAND - 1]);
+
+  fprintf(flushipstat, "NFS V2 REQUEST,%s;%u|", strdate,
+          ip_stats_aggreg.nb_req_nfs2);
+  for(k = 0; k < NFS_V2_NB_COMMAND - 1; k++)
+    fprintf(flushipstat, "%u,", ip_stats_aggreg.req_nfs2[k]);
+  fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_nfs2[NFS_V2_NB_COMMAND - 1]);
+
+  fprintf(flushipstat, "NFS V3 REQUEST,%s;%u|", strdate,
+          ip_stats_aggreg.nb_req_nfs3);
+  for(k = 0; k < NFS_V3_NB_COMMAND - 1; k++)
+    fprintf(flushipstat, "%u,", ip_stats_aggreg.req_nfs3[k]);
+  fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_nfs3[NFS_V3_NB_COMMAND - 1]);
+
+  fprintf(flushipstat, "END, ----- NO MORE STATS FOR THIS PASS ----\n");
+
+  fflush(flushipstat);
+
+  fclose(flushipstat);
+
+  return TRUE;
+}                               /* nfs_ip_stats_dump_client */
+
+/**
+ *
+ * nfs_ip_stats_dump: Dumps the IP Stats for each client to a file per client
+ *
+ * @param ht_ip_stats [IN] hash table to be dumped
+ * @param path_stat   [IN] pattern used to build path used for dumping stats
+ *
+ * @return nothing (void function).
+ *
+ */
+void nfs_ip_stats_dump(hash_table_t ** ht_ip_stats,
+                       unsigned int nb_worker, char *path_stat)
+{
+  nfs_ip_stats_dump_arg_t dump;
   time_t current_time;
   struct tm current_time_struct;
   char strdate[1024];
-  FILE *flushipstat = NULL;
 
   /* Do nothing if configuration disables IP_Stats */
   if(nfs_param.core_param.dump_stats_per_client == 0)
@@ -465,97 +568,12 @@ void nfs_ip_stats_dump(hash_table_t ** ht_ip_stats,
            current_time_struct.tm_hour,
            current_time_struct.tm_min, current_time_struct.tm_sec);
 
+  dump.ht_ip_stats = ht_ip_stats;
+  dump.nb_worker = nb_worker;
+  dump.path_stat = path_stat;
+  dump.strdate = strdate;
+
   /* All clients are supposed to have call at least one time worker #0 
    * we loop on every client in the HashTable */
-  for(i = 0; i < ht_ip_stats[0]->parameter.index_size; i++)
-    {
-      tete_rbt = &((ht_ip_stats[0]->array_rbt)[i]);
-      RBT_LOOP(tete_rbt, it)
-      {
-        pdata = (hash_data_t *) it->rbt_opaq;
-
-        ipaddr = (sockaddr_t *) pdata->buffkey.pdata;
-
-        sprint_sockaddr(ipaddr, ipaddrbuf, sizeof(ipaddrbuf));
-
-        snprintf(ifpathdump, MAXPATHLEN, "%s/stats_nfs-%s", path_stat, ipaddrbuf);
-
-        if((flushipstat = fopen(ifpathdump, "a")) == NULL)
-          return;
-
-        /* Collect stats for each worker and aggregate them */
-        memset(&ip_stats_aggreg, 0, sizeof(ip_stats_aggreg));
-        for(j = 0; j < nb_worker; j++)
-          {
-            if(nfs_ip_stats_get(ht_ip_stats[j],
-                                ipaddr, &pnfs_ip_stats[j]) != IP_STATS_SUCCESS)
-              {
-                fclose(flushipstat);
-                return;
-              }
-            ip_stats_aggreg.nb_call += (pnfs_ip_stats[j])->nb_call;
-
-            ip_stats_aggreg.nb_req_nfs2 += (pnfs_ip_stats[j])->nb_req_nfs2;
-            ip_stats_aggreg.nb_req_nfs3 += (pnfs_ip_stats[j])->nb_req_nfs3;
-            ip_stats_aggreg.nb_req_nfs4 += (pnfs_ip_stats[j])->nb_req_nfs4;
-            ip_stats_aggreg.nb_req_mnt1 += (pnfs_ip_stats[j])->nb_req_mnt1;
-            ip_stats_aggreg.nb_req_mnt3 += (pnfs_ip_stats[j])->nb_req_mnt3;
-
-            for(k = 0; k < MNT_V1_NB_COMMAND; k++)
-              ip_stats_aggreg.req_mnt1[k] += (pnfs_ip_stats[j])->req_mnt1[k];
-
-            for(k = 0; k < MNT_V3_NB_COMMAND; k++)
-              ip_stats_aggreg.req_mnt3[k] += (pnfs_ip_stats[j])->req_mnt3[k];
-
-            for(k = 0; k < NFS_V2_NB_COMMAND; k++)
-              ip_stats_aggreg.req_nfs2[k] += (pnfs_ip_stats[j])->req_nfs2[k];
-
-            for(k = 0; k < NFS_V3_NB_COMMAND; k++)
-              ip_stats_aggreg.req_nfs3[k] += (pnfs_ip_stats[j])->req_nfs3[k];
-          }
-
-        /* Write stats to file */
-        fprintf(flushipstat, "NFS/MOUNT STATISTICS,%s;%u|%u,%u,%u,%u,%u\n",
-                strdate,
-                ip_stats_aggreg.nb_call,
-                ip_stats_aggreg.nb_req_mnt1,
-                ip_stats_aggreg.nb_req_mnt3,
-                ip_stats_aggreg.nb_req_nfs2,
-                ip_stats_aggreg.nb_req_nfs3, ip_stats_aggreg.nb_req_nfs4);
-
-        fprintf(flushipstat, "MNT V1 REQUEST,%s;%u|", strdate,
-                ip_stats_aggreg.nb_req_mnt1);
-        for(k = 0; k < MNT_V1_NB_COMMAND - 1; k++)
-          fprintf(flushipstat, "%u,", ip_stats_aggreg.req_mnt1[k]);
-        fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_mnt1[MNT_V1_NB_COMMAND - 1]);
-
-        fprintf(flushipstat, "MNT V3 REQUEST,%s;%u|", strdate,
-                ip_stats_aggreg.nb_req_mnt3);
-        for(k = 0; k < MNT_V3_NB_COMMAND - 1; k++)
-          fprintf(flushipstat, "%u,", ip_stats_aggreg.req_mnt3[k]);
-        fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_mnt3[MNT_V3_NB_COMMAND - 1]);
-
-        fprintf(flushipstat, "NFS V2 REQUEST,%s;%u|", strdate,
-                ip_stats_aggreg.nb_req_nfs2);
-        for(k = 0; k < NFS_V2_NB_COMMAND - 1; k++)
-          fprintf(flushipstat, "%u,", ip_stats_aggreg.req_nfs2[k]);
-        fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_nfs2[NFS_V2_NB_COMMAND - 1]);
-
-        fprintf(flushipstat, "NFS V3 REQUEST,%s;%u|", strdate,
-                ip_stats_aggreg.nb_req_nfs3);
-        for(k = 0; k < NFS_V3_NB_COMMAND - 1; k++)
-          fprintf(flushipstat, "%u,", ip_stats_aggreg.req_nfs3[k]);
-        fprintf(flushipstat, "%u\n", ip_stats_aggreg.req_nfs3[NFS_V3_NB_COMMAND - 1]);
-
-        fprintf(flushipstat, "END, ----- NO MORE STATS FOR THIS PASS ----\n");
-
-        fflush(flushipstat);
-
-        /* Check next client */
-        RBT_INCREMENT(it);
-
-        fclose(flushipstat);
-      }
-
-    }
+  HashTable_Walk(ht_ip_stats[0], 0, nfs_ip_stats_dump_client, &dump);
 }                               /* nfs_ip_stats_dump */
@@ -169,9 +169,13 @@ int nfs_read_worker_conf(config_file_t in_config, nfs_worker_parameter_t * ppara
         {
           pparam->nb_before_gc = atoi(key_value);
         }
-      else if(!strcasecmp(key_name, "Nb_DupReq_Prealloc"))
+      else if(!strcasecmp(key_name, "Nb_DupReq_Prealloc") ||
+              !strcasecmp(key_name, "LRU_DupReq_Prealloc_PoolSize"))
         {
-          pparam->nb_dupreq_prealloc = atoi(key_value);
+          /* The duplicate request cache allocates its entries as the requests come */
+          LogInfo(COMPONENT_CONFIG,
+                  "Key %s (item %s) is no longer used",
+                  key_name, CONF_LABEL_NFS_WORKER);
         }
       else if(!strcasecmp(key_name, "Nb_Client_Id_Prealloc"))
         {
@@ -181,13 +185,14 @@ int nfs_read_worker_conf(config_file_t in_config, nfs_worker_parameter_t * ppara
         {
           pparam->nb_ip_stats_prealloc = atoi(key_value);
         }
-      else if(!strcasecmp(key_name, "LRU_Pending_Job_Prealloc_PoolSize"))
+      else if(!strcasecmp(key_name, "Pending_Job_Queue_Size"))
         {
-          pparam->lru_param.nb_entry_prealloc = atoi(key_value);
+          pparam->pending_queue_size = atoi(key_value);
         }
-      else if(!strcasecmp(key_name, "LRU_DupReq_Prealloc_PoolSize"))
+      else if(!strcasecmp(key_name, "LRU_Pending_Job_Prealloc_PoolSize"))
         {
-          pparam->lru_dupreq.nb_entry_prealloc = atoi(key_value);
+          /* Former name of Pending_Job_Queue_Size, from when pending jobs were kept in a LRU */
+          pparam->pending_queue_size = atoi(key_value);
         }
       else
         {
@@ -265,13 +270,38 @@ int nfs_read_core_conf(config_file_t in_config, nfs_core_parameter_t * pparam)
         {
           pparam->nb_worker = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Nb_Dispatcher"))
+        {
+          pparam->nb_dispatcher = atoi(key_value);
+        }
       else if(!strcasecmp(key_name, "Nb_Call_Before_Queue_Avg"))
         {
-          pparam->nb_call_before_queue_avg = atoi(key_value);
+          /* Obsolete: queue lengths are compared on each selection, no average is kept */
+          LogWarn(COMPONENT_CONFIG,
+                  "Nb_Call_Before_Queue_Avg is obsolete and ignored (item %s)",
+                  CONF_LABEL_NFS_CORE);
         }
       else if(!strcasecmp(key_name, "Nb_MaxConcurrentGC"))
         {
           pparam->nb_max_concurrent_gc = atoi(key_value);
+          if(pparam->nb_max_concurrent_gc > NB_MAX_CACHE_INODE_GC_THREAD)
+            {
+              LogWarn(COMPONENT_CONFIG,
+                      "Nb_MaxConcurrentGC is limited to %u reclaimer threads",
+                      NB_MAX_CACHE_INODE_GC_THREAD);
+              pparam->nb_max_concurrent_gc = NB_MAX_CACHE_INODE_GC_THREAD;
+            }
+        }
+      else if(!strcasecmp(key_name, "Nb_Write_Behind_Thread"))
+        {
+          pparam->nb_write_behind_thread = atoi(key_value);
+          if(pparam->nb_write_behind_thread > NB_MAX_WRITE_BEHIND_THREAD)
+            {
+              LogWarn(COMPONENT_CONFIG,
+                      "Nb_Write_Behind_Thread is limited to %u write-behind threads",
+                      NB_MAX_WRITE_BEHIND_THREAD);
+              pparam->nb_write_behind_thread = NB_MAX_WRITE_BEHIND_THREAD;
+            }
         }
       else if(!strcasecmp(key_name, "DupReq_Expiration"))
         {
@@ -289,6 +319,22 @@ int nfs_read_core_conf(config_file_t in_config, nfs_core_parameter_t * pparam)
         {
           pparam->drop_delay_errors = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "Log_Async"))
+        {
+          pparam->log_async = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Log_Async_Ring_Size"))
+        {
+          pparam->log_async_ring_size = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Nb_Read_Buffers"))
+        {
+          pparam->nb_read_buffers = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Read_Buffer_Size"))
+        {
+          pparam->read_buffer_size = atoi(key_value);
+        }
       else if(!strcasecmp(key_name, "NFS_Port"))
         {
           pparam->port[P_NFS] = (unsigned short)atoi(key_value);
@@ -483,9 +529,10 @@ int nfs_read_core_conf(config_file_t in_config, nfs_core_parameter_t * pparam)
 
 /**
  *
- * nfs_read_dupreq_hash_conf: reads the configuration for the hash in Duplicate Request layer.
+ * nfs_read_dupreq_hash_conf: reads the configuration for the Duplicate Request cache.
  *
- * Reads the configuration for the hash in Duplicate Request layer
+ * Reads the configuration for the Duplicate Request cache: its shards and
+ * the bounds of the replies it keeps for a client.
  *
  * @param in_config [IN] configuration file handle
  * @param pparam [OUT] read parameters
@@ -543,15 +590,29 @@ int nfs_read_dupreq_hash_conf(config_file_t in_config,
 
       if(!strcasecmp(key_name, "Index_Size"))
         {
-          pparam->hash_param.index_size = atoi(key_value);
+          /* Number of shards */
+          pparam->nb_shards = atoi(key_value);
         }
-      else if(!strcasecmp(key_name, "Alphabet_Length"))
+      else if(!strcasecmp(key_name, "Buckets_Per_Shard"))
         {
-          pparam->hash_param.alphabet_length = atoi(key_value);
+          pparam->nb_buckets = atoi(key_value);
         }
-      else if(!strcasecmp(key_name, "Prealloc_Node_Pool_Size"))
+      else if(!strcasecmp(key_name, "Max_Client_Bytes"))
         {
-          pparam->hash_param.nb_node_prealloc = atoi(key_value);
+          pparam->max_client_bytes = strtoul(key_value, NULL, 10);
+        }
+      else if(!strcasecmp(key_name, "Non_Idempotent_Only"))
+        {
+          pparam->non_idempotent_only = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Alphabet_Length") ||
+              !strcasecmp(key_name, "Prealloc_Node_Pool_Size") ||
+              !strcasecmp(key_name, "Hash_Backend"))
+        {
+          /* The duplicate request cache is no longer a hash table */
+          LogInfo(COMPONENT_CONFIG,
+                  "Key %s (item %s) is no longer used",
+                  key_name, CONF_LABEL_NFS_DUPREQ);
         }
       else
         {
@@ -634,6 +695,16 @@ int nfs_read_ip_name_conf(config_file_t in_config, nfs_ip_name_parameter_t * ppa
         {
           pparam->hash_param.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_NFS_IP_NAME);
+              return -1;
+            }
+        }
       else if(!strcasecmp(key_name, "Expiration_Time"))
         {
           pparam->expiration_time = atoi(key_value);
@@ -716,6 +787,16 @@ int nfs_read_client_id_conf(config_file_t in_config, nfs_client_id_parameter_t *
         {
           pparam->hash_param.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_CLIENT_ID);
+              return -1;
+            }
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -790,6 +871,16 @@ int nfs_read_state_id_conf(config_file_t in_config, nfs_state_id_parameter_t * p
         {
           pparam->hash_param.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_STATE_ID);
+              return -1;
+            }
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -853,6 +944,16 @@ int nfs_read_session_id_conf(config_file_t in_config, nfs_session_id_parameter_t
         {
           pparam->hash_param.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_SESSION_ID);
+              return -1;
+            }
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -938,10 +1039,32 @@ int nfs_read_uidmap_conf(config_file_t in_config, nfs_idmap_cache_parameter_t *
         {
           pparam->hash_param.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_UID_MAPPER);
+              return -1;
+            }
+        }
       else if(!strcasecmp(key_name, "Map"))
         {
           strncpy(pparam->mapfile, key_value, MAXPATHLEN);
         }
+      else if(!strcasecmp(key_name, "Preload_File"))
+        {
+          strncpy(pparam->preload_file, key_value, MAXPATHLEN);
+        }
+      else if(!strcasecmp(key_name, "Positive_TTL"))
+        {
+          pparam->positive_ttl = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Negative_TTL"))
+        {
+          pparam->negative_ttl = atoi(key_value);
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -1025,10 +1148,32 @@ int nfs_read_gidmap_conf(config_file_t in_config, nfs_idmap_cache_parameter_t *
         {
           pparam->hash_param.nb_node_prealloc = atoi(key_value);
         }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_GID_MAPPER);
+              return -1;
+            }
+        }
       else if(!strcasecmp(key_name, "Map"))
         {
           strncpy(pparam->mapfile, key_value, MAXPATHLEN);
         }
+      else if(!strcasecmp(key_name, "Preload_File"))
+        {
+          strncpy(pparam->preload_file, key_value, MAXPATHLEN);
+        }
+      else if(!strcasecmp(key_name, "Positive_TTL"))
+        {
+          pparam->positive_ttl = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Negative_TTL"))
+        {
+          pparam->negative_ttl = atoi(key_value);
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -1041,6 +1186,108 @@ int nfs_read_gidmap_conf(config_file_t in_config, nfs_idmap_cache_parameter_t *
   return 0;
 }                               /* nfs_read_gidmap_conf */
 
+/**
+ *
+ * nfs_read_uid2grp_conf: reads the configuration for the UID2GRP Cache
+ *
+ * Reads the configuration for the cache of the groups of the users, used by
+ * the exports with Manage_Gids.
+ *
+ * @param in_config [IN] configuration file handle
+ * @param pparam [OUT] read parameters
+ *
+ * @return 0 if ok,  -1 if not, 1 is stanza is not there.
+ *
+ */
+int nfs_read_uid2grp_conf(config_file_t in_config, nfs_uid2grp_cache_parameter_t * pparam)
+{
+  int var_max;
+  int var_index;
+  int err;
+  char *key_name;
+  char *key_value;
+  config_item_t block;
+
+  /* Is the config tree initialized ? */
+  if(in_config == NULL || pparam == NULL)
+    return -1;
+
+  /* Get the config BLOCK */
+  if((block = config_FindItemByName(in_config, CONF_LABEL_UID2GRP)) == NULL)
+    {
+      LogDebug(COMPONENT_CONFIG,
+               "Cannot read item \"%s\" from configuration file",
+               CONF_LABEL_UID2GRP);
+      return 1;
+    }
+  else if(config_ItemType(block) != CONFIG_ITEM_BLOCK)
+    {
+      /* Expected to be a block */
+      LogDebug(COMPONENT_CONFIG,
+               "Item \"%s\" is expected to be a block",
+               CONF_LABEL_UID2GRP);
+      return 1;
+    }
+
+  var_max = config_GetNbItems(block);
+
+  for(var_index = 0; var_index < var_max; var_index++)
+    {
+      config_item_t item;
+
+      item = config_GetItemByIndex(block, var_index);
+
+      /* Get key's name */
+      if((err = config_GetKeyValue(item, &key_name, &key_value)) != 0)
+        {
+          LogCrit(COMPONENT_CONFIG,
+                  "Error reading key[%d] from section \"%s\" of configuration file.",
+                  var_index, CONF_LABEL_UID2GRP);
+          return -1;
+        }
+
+      if(!strcasecmp(key_name, "Index_Size"))
+        {
+          pparam->hash_param.index_size = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Prealloc_Node_Pool_Size"))
+        {
+          pparam->hash_param.nb_node_prealloc = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Hash_Backend"))
+        {
+          if(HashTable_BackendFromStr(key_value, &pparam->hash_param.backend) != 0)
+            {
+              LogCrit(COMPONENT_CONFIG,
+                      "Invalid value for %s: %s (item %s), expected RBT or Open_Addressing",
+                      key_name, key_value, CONF_LABEL_UID2GRP);
+              return -1;
+            }
+        }
+      else if(!strcasecmp(key_name, "Max_Entries"))
+        {
+          pparam->max_entries = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Positive_TTL"))
+        {
+          pparam->positive_ttl = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Negative_TTL"))
+        {
+          pparam->negative_ttl = atoi(key_value);
+        }
+      else
+        {
+          LogCrit(COMPONENT_CONFIG,
+                  "Unknown or unsettable key: %s (item %s)",
+                  key_name, CONF_LABEL_UID2GRP);
+          return -1;
+        }
+    }
+
+  return 0;
+}                               /* nfs_read_uid2grp_conf */
+
 #ifdef _HAVE_GSSAPI
 /**
  *
@@ -1209,6 +1456,27 @@ int nfs_read_version4_conf(config_file_t in_config, nfs_version4_parameter_t * p
         {
           pparam->return_bad_stateid = StrToBoolean(key_value);
         }
+      else if(!strcasecmp(key_name, "Nb_Max_Slots"))
+        {
+          pparam->nb_max_slots = atoi(key_value);
+        }
+      else if(!strcasecmp(key_name, "Delegations"))
+        {
+          pparam->use_delegations = StrToBoolean(key_value);
+        }
+      else if(!strcasecmp(key_name, "Nb_Deleg_Recall_Thread"))
+        {
+          pparam->nb_deleg_recall_thread = atoi(key_value);
+          if(pparam->nb_deleg_recall_thread > NB_MAX_DELEG_RECALL_THREAD)
+            {
+              LogWarn(COMPONENT_CONFIG,
+                      "Nb_Deleg_Recall_Thread is limited to %u recall threads",
+                      NB_MAX_DELEG_RECALL_THREAD);
+              pparam->nb_deleg_recall_thread = NB_MAX_DELEG_RECALL_THREAD;
+            }
+          if(pparam->nb_deleg_recall_thread == 0)
+            pparam->nb_deleg_recall_thread = 1;
+        }
       else
         {
           LogCrit(COMPONENT_CONFIG,
@@ -1235,8 +1503,8 @@ int nfs_read_version4_conf(config_file_t in_config, nfs_version4_parameter_t * p
 void Print_param_worker_in_log(nfs_worker_parameter_t * pparam)
 {
   LogInfo(COMPONENT_INIT,
-          "NFS PARAM : worker_param.lru_param.nb_entry_prealloc = %d",
-          pparam->lru_param.nb_entry_prealloc);
+          "NFS PARAM : worker_param.pending_queue_size = %u",
+          pparam->pending_queue_size);
   LogInfo(COMPONENT_INIT,
           "NFS PARAM : worker_param.nb_pending_prealloc = %d",
           pparam->nb_pending_prealloc);
@@ -370,6 +370,74 @@ int nfs41_Session_Update(char sessionid[NFS4_SESSIONID_SIZE],
   return 1;
 }                               /* nfs41_Session_Update */
 
+/**
+ *
+ * nfs41_Session_Alloc_Slots
+ *
+ * This routine allocates the slot table of a new session.
+ *
+ * @param psession [INOUT] the session
+ * @param nb_slots [IN]    number of slots negotiated in CREATE_SESSION
+ *
+ * @return 1 if ok, 0 otherwise.
+ *
+ */
+int nfs41_Session_Alloc_Slots(nfs41_session_t * psession, uint32_t nb_slots)
+{
+  uint32_t i;
+
+  if((psession->slots = (nfs41_session_slot_t *)
+      Mem_Calloc(nb_slots, sizeof(nfs41_session_slot_t))) == NULL)
+    {
+      LogCrit(COMPONENT_SESSIONS,
+              "Unable to allocate a table of %u slots", nb_slots);
+      return 0;
+    }
+
+  for(i = 0; i < nb_slots; i++)
+    pthread_mutex_init(&psession->slots[i].lock, NULL);
+
+  psession->nb_slots = nb_slots;
+
+  return 1;
+}                               /* nfs41_Session_Alloc_Slots */
+
+/**
+ *
+ * nfs41_Session_Free_Slots
+ *
+ * This routine releases the slot table of a session and the replies cached in it.
+ * The session must be out of the hash table already and the slot held by the
+ * calling request, if any, released.
+ *
+ * @param psession [INOUT] the session
+ *
+ * @return nothing (void function).
+ *
+ */
+void nfs41_Session_Free_Slots(nfs41_session_t * psession)
+{
+  uint32_t i;
+
+  if(psession->slots == NULL)
+    return;
+
+  /* Wait for the requests still using a slot to be replied */
+  for(i = 0; i < psession->nb_slots; i++)
+    {
+      P(psession->slots[i].lock);
+      V(psession->slots[i].lock);
+
+      if(psession->slots[i].cached_result != NULL)
+        Mem_Free(psession->slots[i].cached_result);
+      pthread_mutex_destroy(&psession->slots[i].lock);
+    }
+
+  Mem_Free(psession->slots);
+  psession->slots = NULL;
+  psession->nb_slots = 0;
+}                               /* nfs41_Session_Free_Slots */
+
 /**
  *
  * nfs41_Session_Del
@@ -402,7 +470,9 @@ int nfs41_Session_Del(char sessionid[NFS4_SESSIONID_SIZE])
       /* free the key that was stored in hash table */
       Mem_Free((void *)old_key.pdata);
 
-      /* State is managed in stuff alloc, no fre is needed for old_value.pdata */
+      /* State is managed in stuff alloc, no fre is needed for old_value.pdata,
+       * but its slot table and cached replies are allocated apart */
+      nfs41_Session_Free_Slots((nfs41_session_t *) old_value.pdata);
 
       return 1;
     }
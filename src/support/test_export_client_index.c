@@ -0,0 +1,377 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright CEA/DAM/DIF  (2008)
+ * contributeur : Philippe DENIEL   philippe.deniel@cea.fr
+ *                Thomas LEIBOVICI  thomas.leibovici@cea.fr
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Checks the compiled client lists against a linear scan of random lists.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_exports.h"
+
+#define NB_LISTS 200
+#define NB_QUERIES 2000
+#define NB_BENCH_QUERIES 1000000
+
+static exportlist_client_t clients;
+
+static unsigned int options[] = {
+  EXPORT_OPTION_ROOT,
+  EXPORT_OPTION_READ_ACCESS,
+  EXPORT_OPTION_WRITE_ACCESS,
+  EXPORT_OPTION_MD_READ_ACCESS,
+  EXPORT_OPTION_MD_WRITE_ACCESS,
+  EXPORT_OPTION_READ_ACCESS | EXPORT_OPTION_WRITE_ACCESS
+};
+
+#define NB_OPTIONS (sizeof(options) / sizeof(options[0]))
+
+/* Addresses are drawn from 10.0.0.0/22 so that lists and queries meet */
+static in_addr_t random_addr(void)
+{
+  return htonl(0x0A000000 | (random() % 1024));
+}
+
+static void random_addr6(struct in6_addr *paddr)
+{
+  memset(paddr, 0, sizeof(*paddr));
+  paddr->s6_addr[0] = 0xFE;
+  paddr->s6_addr[1] = 0x80;
+  paddr->s6_addr[15] = random() % 64;
+}
+
+/* The v4-mapped IPv6 address of an IPv4 address */
+static void mapped_addr6(struct in6_addr *paddr, in_addr_t addr)
+{
+  memset(paddr, 0, sizeof(*paddr));
+  paddr->s6_addr[10] = 0xFF;
+  paddr->s6_addr[11] = 0xFF;
+  memcpy(&paddr->s6_addr[12], &addr, 4);
+}
+
+static void random_list(unsigned int nb_clients)
+{
+  exportlist_client_entry_t *pclient;
+  unsigned int i, prefix;
+
+  memset(&clients, 0, sizeof(clients));
+  clients.num_clients = nb_clients;
+
+  for(i = 0; i < clients.num_clients; i++)
+    {
+      pclient = &clients.clientarray[i];
+      pclient->options = options[random() % (NB_OPTIONS - 1)];
+      if(random() % 3 == 0)
+        pclient->options |= options[random() % (NB_OPTIONS - 1)];
+
+      switch (random() % 20)
+        {
+        case 0:
+        case 1:
+          pclient->type = WILDCARDHOST_CLIENT;
+          sprintf(pclient->client.wildcard.wildcard, "10.0.%ld.*", random() % 4);
+          break;
+
+        case 2:
+          pclient->type = (random() % 4 == 0) ? GSSPRINCIPAL_CLIENT : BAD_CLIENT;
+          break;
+
+        case 3:
+        case 4:
+        case 5:
+          pclient->type = HOSTIF_CLIENT_V6;
+          if(random() % 2)
+            mapped_addr6(&pclient->client.hostif.clientaddr6, random_addr());
+          else
+            random_addr6(&pclient->client.hostif.clientaddr6);
+          break;
+
+        case 6:
+          /* non contiguous netmask */
+          pclient->type = NETWORK_CLIENT;
+          pclient->client.network.netmask = 0xFFFF00F0;
+          pclient->client.network.netaddr = ntohl(random_addr()) & 0xFFFF00F0;
+          break;
+
+        case 7:
+        case 8:
+        case 9:
+        case 10:
+        case 11:
+          pclient->type = NETWORK_CLIENT;
+          prefix = 20 + random() % 13;
+          pclient->client.network.netmask = prefix == 0 ? 0 : 0xFFFFFFFFU << (32 - prefix);
+          pclient->client.network.netaddr =
+              ntohl(random_addr()) & pclient->client.network.netmask;
+          break;
+
+        default:
+          pclient->type = HOSTIF_CLIENT;
+          pclient->client.hostif.clientaddr = random_addr();
+          break;
+        }
+    }
+}
+
+/* Matches the wildcards on the address string */
+static exportlist_client_match_t slow_match(exportlist_client_entry_t * pclient,
+                                            void *arg, int *pvolatile)
+{
+  char *ipstring = (char *)arg;
+
+  switch (pclient->type)
+    {
+    case NETWORK_CLIENT:
+      if((pclient->client.network.netmask & ntohl(inet_addr(ipstring))) ==
+         pclient->client.network.netaddr)
+        return EXPORT_CLIENT_MATCH;
+      break;
+
+    case WILDCARDHOST_CLIENT:
+      if(fnmatch(pclient->client.wildcard.wildcard, ipstring, FNM_PATHNAME) == 0)
+        return EXPORT_CLIENT_MATCH;
+      break;
+
+    case GSSPRINCIPAL_CLIENT:
+      return EXPORT_CLIENT_STOP;
+
+    default:
+      break;
+    }
+
+  return EXPORT_CLIENT_NO_MATCH;
+}
+
+static int has_options(exportlist_client_entry_t * pclient, unsigned int export_option)
+{
+  return (pclient->options & export_option) != 0 &&
+      (pclient->options & EXPORT_OPTION_ROOT) == (export_option & EXPORT_OPTION_ROOT);
+}
+
+/* The linear scan of export_client_match */
+static int linear_match(in_addr_t addr, char *ipstring, unsigned int export_option)
+{
+  exportlist_client_entry_t *pclient;
+  unsigned int i;
+  int is_volatile;
+
+  for(i = 0; i < clients.num_clients; i++)
+    {
+      pclient = &clients.clientarray[i];
+
+      if(!has_options(pclient, export_option))
+        continue;
+
+      if(pclient->type == HOSTIF_CLIENT)
+        {
+          if(pclient->client.hostif.clientaddr == addr)
+            return i;
+          continue;
+        }
+
+      switch (slow_match(pclient, ipstring, &is_volatile))
+        {
+        case EXPORT_CLIENT_MATCH:
+          return i;
+        case EXPORT_CLIENT_STOP:
+          return -1;
+        case EXPORT_CLIENT_NO_MATCH:
+          break;
+        }
+    }
+
+  return -1;
+}
+
+/* The linear scan of export_client_matchv6 */
+static int linear_matchv6(struct in6_addr *paddr, unsigned int export_option)
+{
+  exportlist_client_entry_t *pclient;
+  unsigned int i;
+
+  for(i = 0; i < clients.num_clients; i++)
+    {
+      pclient = &clients.clientarray[i];
+
+      if(!has_options(pclient, export_option))
+        continue;
+
+      if(pclient->type == HOSTIF_CLIENT_V6)
+        {
+          if(!memcmp(&pclient->client.hostif.clientaddr6, paddr, sizeof(*paddr)))
+            return i;
+        }
+      else if(pclient->type > HOSTIF_CLIENT_V6)
+        return -1;
+    }
+
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned int list, query, export_option, round;
+  in_addr_t addr;
+  struct in6_addr addr6;
+  struct in_addr inaddr;
+  char ipstring[INET_ADDRSTRLEN];
+  static char ipstrings[1024][INET_ADDRSTRLEN];
+  int expected, found;
+  struct timeval start, end;
+  double linear_time, index_time;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("test_export_client_index");
+
+#ifndef _NO_BUDDY_SYSTEM
+  BuddyInit(NULL);
+#endif
+
+  srandom(1);
+
+  for(list = 0; list < NB_LISTS; list++)
+    {
+      random_list(1 + random() % EXPORTS_NB_MAX_CLIENTS);
+
+      if(export_client_index_build(&clients) != 0)
+        {
+          LogTest("Test FAILED: could not compile list %u", list);
+          exit(1);
+        }
+
+      for(query = 0; query < NB_QUERIES; query++)
+        {
+          export_option = options[random() % NB_OPTIONS];
+          if(random() % 2)
+            export_option |= EXPORT_OPTION_ROOT;
+
+          addr = random_addr();
+          inaddr.s_addr = addr;
+          inet_ntop(AF_INET, &inaddr, ipstring, sizeof(ipstring));
+
+          /* A v4-mapped address is not the IPv4 host, nor its cached decision */
+          if(random() % 4 == 0)
+            mapped_addr6(&addr6, addr);
+          else
+            random_addr6(&addr6);
+
+          /* The second round is answered by the decision cache */
+          for(round = 0; round < 2; round++)
+            {
+              expected = linear_match(addr, ipstring, export_option);
+              found = export_client_index_lookup(&clients, AF_INET, &addr, export_option,
+                                                 slow_match, ipstring, 0);
+              if(found != expected)
+                {
+                  LogTest("Test FAILED: list %u, %s, options %#x: found %d, expected %d",
+                          list, ipstring, export_option, found, expected);
+                  exit(1);
+                }
+
+              expected = linear_matchv6(&addr6, export_option);
+              found = export_client_index_lookup(&clients, AF_INET6, &addr6, export_option,
+                                                 NULL, NULL, 0);
+              if(found != expected)
+                {
+                  LogTest("Test FAILED: list %u, IPv6, options %#x: found %d, expected %d",
+                          list, export_option, found, expected);
+                  exit(1);
+                }
+            }
+        }
+
+      export_client_index_free(&clients);
+      if(clients.index != NULL)
+        {
+          LogTest("Test FAILED: index not freed");
+          exit(1);
+        }
+    }
+
+  LogTest("%u random lists OK", NB_LISTS);
+
+  /* Lookups by 1024 clients in a full list of hosts and networks */
+  random_list(EXPORTS_NB_MAX_CLIENTS);
+  for(list = 0; list < clients.num_clients; list++)
+    if(clients.clientarray[list].type != NETWORK_CLIENT)
+      {
+        clients.clientarray[list].type = HOSTIF_CLIENT;
+        clients.clientarray[list].client.hostif.clientaddr = random_addr();
+      }
+  export_client_index_build(&clients);
+
+  for(query = 0; query < 1024; query++)
+    {
+      inaddr.s_addr = htonl(0x0A000000 | query);
+      inet_ntop(AF_INET, &inaddr, ipstrings[query], INET_ADDRSTRLEN);
+    }
+
+  gettimeofday(&start, NULL);
+  for(query = 0, found = 0; query < NB_BENCH_QUERIES; query++)
+    {
+      addr = htonl(0x0A000000 | (query % 1024));
+      found += linear_match(addr, ipstrings[query % 1024], EXPORT_OPTION_READ_ACCESS);
+    }
+  gettimeofday(&end, NULL);
+  linear_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+
+  gettimeofday(&start, NULL);
+  for(query = 0, expected = 0; query < NB_BENCH_QUERIES; query++)
+    {
+      addr = htonl(0x0A000000 | (query % 1024));
+      expected += export_client_index_lookup(&clients, AF_INET, &addr,
+                                             EXPORT_OPTION_READ_ACCESS,
+                                             slow_match, ipstrings[query % 1024], 0);
+    }
+  gettimeofday(&end, NULL);
+  index_time = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+
+  if(found != expected)
+    {
+      LogTest("Test FAILED: benchmark results differ");
+      exit(1);
+    }
+
+  LogTest("%u lookups in %u entries: linear %.3fs, compiled %.3fs",
+          NB_BENCH_QUERIES, clients.num_clients, linear_time, index_time);
+
+  export_client_index_free(&clients);
+
+  /* Tous les tests sont ok */
+  LogTest("\n-----------------------------------------");
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
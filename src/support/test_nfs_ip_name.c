@@ -90,7 +90,9 @@ void nfs_set_ip_name_param_default()
 
 void init() 
 {
+#ifndef _NO_BUDDY_SYSTEM
     BuddyInit(NULL);
+#endif
 
     nfs_set_ip_name_param_default();
     nfs_Init_ip_name(nfs_param.ip_name_param);
@@ -86,7 +86,9 @@ void nfs_set_ip_stats_param_default()
 
 void init() 
 {
+#ifndef _NO_BUDDY_SYSTEM
     BuddyInit(NULL);
+#endif
 
     nfs_set_ip_stats_param_default();
     ipstats = nfs_Init_ip_stats(nfs_param.ip_stats_param);
@@ -49,14 +49,15 @@ static char usage[] =
 
 int main(int argc, char **argv)
 {
-  int rc;
 
   /* Init the Buddy System allocation */
-  if((rc = BuddyInit(NULL)) != BUDDY_SUCCESS)
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
     {
       LogTest("Error initializing memory allocator");
       exit(1);
     }
+#endif
 
   SetDefaultLogging("TEST");
   SetNamePgm("test_support");
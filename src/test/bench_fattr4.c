@@ -0,0 +1,208 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Encodes the fattr4 of the bitmaps the clients usually ask for, with
+ * their precompiled plan and with the generic encoding: checks that both
+ * give the same bytes, and prints the time each one takes.
+ *
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "nfs_exports.h"
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+#include "nfs_proto_functions.h"
+#include "../MainNFSD/nfs_init.h"
+
+/* These parameters are used throughout Ganesha code and must be initilized. */
+nfs_parameter_t nfs_param;
+char ganesha_exec_path[MAXPATHLEN] = "/usr/bin/gpfs.ganesha.nfsd";
+
+#define NB_ITERATIONS 200000
+
+static const int getattr_attrs[] = {
+  FATTR4_TYPE, FATTR4_CHANGE, FATTR4_SIZE, FATTR4_FSID, FATTR4_FILEID,
+  FATTR4_MODE, FATTR4_NUMLINKS, FATTR4_OWNER, FATTR4_OWNER_GROUP,
+  FATTR4_RAWDEV, FATTR4_SPACE_USED, FATTR4_TIME_ACCESS,
+  FATTR4_TIME_METADATA, FATTR4_TIME_MODIFY, FATTR4_MOUNTED_ON_FILEID, -1
+};
+
+static const int readdir_attrs[] = {
+  FATTR4_TYPE, FATTR4_CHANGE, FATTR4_SIZE, FATTR4_FSID, FATTR4_RDATTR_ERROR,
+  FATTR4_FILEHANDLE, FATTR4_FILEID, FATTR4_MODE, FATTR4_NUMLINKS,
+  FATTR4_OWNER, FATTR4_OWNER_GROUP, FATTR4_RAWDEV, FATTR4_SPACE_USED,
+  FATTR4_TIME_ACCESS, FATTR4_TIME_METADATA, FATTR4_TIME_MODIFY,
+  FATTR4_MOUNTED_ON_FILEID, -1
+};
+
+static const int postop_attrs[] = {
+  FATTR4_CHANGE, FATTR4_SIZE, FATTR4_TIME_METADATA, FATTR4_TIME_MODIFY, -1
+};
+
+static void make_bitmap(bitmap4 * pbitmap, uint32_t * words, const int *attrs)
+{
+  memset(words, 0, 3 * sizeof(uint32_t));
+
+  for(; *attrs != -1; attrs++)
+    words[*attrs / 32] |= 1 << (*attrs % 32);
+
+  pbitmap->bitmap4_val = words;
+  pbitmap->bitmap4_len = (words[2] != 0) ? 3 : 2;
+}
+
+static unsigned long long now_ns(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (unsigned long long)tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+static void free_fattr(fattr4 * Fattr)
+{
+  Mem_Free(Fattr->attrmask.bitmap4_val);
+  Mem_Free(Fattr->attr_vals.attrlist4_val);
+}
+
+static void bench(const char *name, const int *attrs, exportlist_t * pexport,
+                  fsal_attrib_list_t * pattr, nfs_fh4 * objFH)
+{
+  uint32_t words[3];
+  bitmap4 bitmap;
+  fattr4 plan, generic;
+  unsigned long long start, plan_ns, generic_ns;
+  int i;
+
+  make_bitmap(&bitmap, words, attrs);
+
+  if(nfs4_FSALattr_To_Fattr_Plan(pexport, pattr, &plan, objFH, &bitmap) != 0 ||
+     nfs4_FSALattr_To_Fattr_Generic(pexport, pattr, &generic, NULL, objFH, &bitmap) != 0)
+    {
+      LogTest("Test FAILED: could not encode the %s attributes", name);
+      exit(1);
+    }
+
+  if(plan.attrmask.bitmap4_len != generic.attrmask.bitmap4_len ||
+     memcmp(plan.attrmask.bitmap4_val, generic.attrmask.bitmap4_val,
+            plan.attrmask.bitmap4_len * sizeof(uint32_t)) ||
+     plan.attr_vals.attrlist4_len != generic.attr_vals.attrlist4_len ||
+     memcmp(plan.attr_vals.attrlist4_val, generic.attr_vals.attrlist4_val,
+            plan.attr_vals.attrlist4_len))
+    {
+      LogTest("Test FAILED: the plan encodes the %s attributes differently", name);
+      exit(1);
+    }
+
+  free_fattr(&plan);
+  free_fattr(&generic);
+
+  start = now_ns();
+  for(i = 0; i < NB_ITERATIONS; i++)
+    {
+      nfs4_FSALattr_To_Fattr_Plan(pexport, pattr, &plan, objFH, &bitmap);
+      free_fattr(&plan);
+    }
+  plan_ns = now_ns() - start;
+
+  start = now_ns();
+  for(i = 0; i < NB_ITERATIONS; i++)
+    {
+      nfs4_FSALattr_To_Fattr_Generic(pexport, pattr, &generic, NULL, objFH, &bitmap);
+      free_fattr(&generic);
+    }
+  generic_ns = now_ns() - start;
+
+  LogTest("%-8s %4u bytes: plan %5llu ns, generic %5llu ns per encoding", name,
+          generic.attr_vals.attrlist4_len, plan_ns / NB_ITERATIONS,
+          generic_ns / NB_ITERATIONS);
+}
+
+int main(int argc, char *argv[])
+{
+  exportlist_t export;
+  fsal_attrib_list_t attr;
+  nfs_fh4 fh;
+  char fh_val[NFS4_FHSIZE];
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("bench_fattr4");
+
+  /* Get the FSAL functions and consts */
+  FSAL_LoadFunctions();
+  FSAL_LoadConsts();
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Memory manager could not be initialized");
+      exit(1);
+    }
+#endif
+
+  nfs_set_param_default();
+
+  if(idmap_uid_init(nfs_param.uidmap_cache_param) != ID_MAPPER_SUCCESS ||
+     idmap_uname_init(nfs_param.unamemap_cache_param) != ID_MAPPER_SUCCESS ||
+     idmap_gid_init(nfs_param.gidmap_cache_param) != ID_MAPPER_SUCCESS ||
+     idmap_gname_init(nfs_param.gnamemap_cache_param) != ID_MAPPER_SUCCESS)
+    {
+      LogTest("Test FAILED: could not initialize the id mapper");
+      exit(1);
+    }
+
+  memset(&export, 0, sizeof(export));
+  export.filesystem_id.major = 152;
+  export.filesystem_id.minor = 152;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = FSAL_TYPE_FILE;
+  attr.change = 0x123456789ULL;
+  attr.filesize = 1234567;
+  attr.fileid = 4242;
+  attr.mode = 0644;
+  attr.numlinks = 1;
+  attr.owner = 0;
+  attr.group = 0;
+  attr.spaceused = 1236992;
+  attr.atime.seconds = 1300000000;
+  attr.atime.nseconds = 1;
+  attr.ctime.seconds = 1300000001;
+  attr.ctime.nseconds = 2;
+  attr.mtime.seconds = 1300000002;
+  attr.mtime.nseconds = 3;
+
+  /* An odd length checks the padding of the handle */
+  memset(fh_val, 0, sizeof(fh_val));
+  fh.nfs_fh4_val = fh_val;
+  fh.nfs_fh4_len = 37;
+
+  bench("GETATTR", getattr_attrs, &export, &attr, &fh);
+  bench("READDIR", readdir_attrs, &export, &attr, &fh);
+  bench("post-op", postop_attrs, &export, &attr, &fh);
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
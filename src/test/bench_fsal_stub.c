@@ -0,0 +1,524 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    bench_fsal_stub.c
+ * \brief   An FSAL kept in memory, for the benchmarks of the cache inode layer.
+ *
+ * bench_fsal_stub.c : The FSAL calls of the cache inode layer go through the
+ * function table of fsal_glue.c, the stub fills it with its own functions.
+ * The handles and the fds only hold the id of the object. Reads and writes
+ * copy nothing: they last latency_us, to look like a remote FSAL, and check
+ * that no I/O in progress on the same file overlaps a write.
+ *
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "log.h"
+#include "abstract_atomic.h"
+#include "bench_fsal_stub.h"
+
+#define BENCH_STUB_MAX_IO 64    /* I/O in progress at the same time, all files together */
+
+/* The table fsal_glue.c dispatches the FSAL calls through */
+extern fsal_functions_t fsal_functions_array[];
+#ifdef _USE_SHARED_FSAL
+extern __thread int my_fsalid;
+#endif
+
+typedef struct bench_stub_io__
+{
+  int used;
+  unsigned int id;
+  fsal_off_t offset;
+  fsal_size_t length;
+  int write;
+} bench_stub_io_t;
+
+static unsigned int stub_nb_files;
+static fsal_size_t stub_file_size;
+static unsigned int stub_latency_us;
+static time_t stub_time;
+
+static bench_stub_stat_t stub_stat;
+static bench_stub_io_t stub_io[BENCH_STUB_MAX_IO];
+static unsigned int stub_io_inflight;
+static pthread_mutex_t stub_io_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static fsal_status_t stub_status(int major)
+{
+  fsal_status_t status;
+
+  status.major = major;
+  status.minor = 0;
+
+  return status;
+}
+
+static unsigned int stub_handle_id(fsal_handle_t * phandle)
+{
+  unsigned int id;
+
+  memcpy(&id, (char *)phandle, sizeof(id));
+  return id;
+}
+
+static unsigned int stub_file_id(fsal_file_t * pfile)
+{
+  unsigned int id;
+
+  memcpy(&id, (char *)pfile, sizeof(id));
+  return id;
+}
+
+static int stub_valid_id(unsigned int id)
+{
+  return id >= BENCH_STUB_ROOT_ID && id < stub_nb_files + 2;
+}
+
+static void stub_fill_attrs(unsigned int id, fsal_attrib_list_t * pattr)
+{
+  fsal_attrib_mask_t asked = pattr->asked_attributes;
+
+  memset(pattr, 0, sizeof(fsal_attrib_list_t));
+
+  pattr->asked_attributes = asked;
+  pattr->supported_attributes = asked;
+  pattr->fileid = id;
+  pattr->fsid.major = 1;
+  pattr->owner = 0;
+  pattr->group = 0;
+  pattr->atime.seconds = pattr->ctime.seconds = pattr->mtime.seconds = stub_time;
+  pattr->chgtime = pattr->creation = pattr->mtime;
+
+  if(id == BENCH_STUB_ROOT_ID)
+    {
+      pattr->type = FSAL_TYPE_DIR;
+      pattr->mode = 0755;
+      pattr->numlinks = 2;
+      pattr->filesize = pattr->spaceused = 4096;
+    }
+  else
+    {
+      pattr->type = FSAL_TYPE_FILE;
+      pattr->mode = 0644;
+      pattr->numlinks = 1;
+      pattr->filesize = pattr->spaceused = stub_file_size;
+    }
+}
+
+static fsal_status_t stub_getattrs(fsal_handle_t * p_filehandle,
+                                   fsal_op_context_t * p_context,
+                                   fsal_attrib_list_t * p_object_attributes)
+{
+  unsigned int id = stub_handle_id(p_filehandle);
+
+  atomic_inc_uint32_t(&stub_stat.nb_getattrs);
+
+  if(!stub_valid_id(id))
+    return stub_status(ERR_FSAL_STALE);
+
+  if(p_object_attributes != NULL)
+    stub_fill_attrs(id, p_object_attributes);
+
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static fsal_status_t stub_lookup(fsal_handle_t * p_parent_directory_handle,
+                                 fsal_name_t * p_filename,
+                                 fsal_op_context_t * p_context,
+                                 fsal_handle_t * p_object_handle,
+                                 fsal_attrib_list_t * p_object_attributes)
+{
+  unsigned int index;
+  char *end;
+
+  atomic_inc_uint32_t(&stub_stat.nb_lookup);
+
+  if(stub_handle_id(p_parent_directory_handle) != BENCH_STUB_ROOT_ID)
+    return stub_status(ERR_FSAL_NOTDIR);
+
+  if(strncmp(p_filename->name, "file", 4) != 0)
+    return stub_status(ERR_FSAL_NOENT);
+
+  index = strtoul(p_filename->name + 4, &end, 10);
+  if(*end != '\0' || end == p_filename->name + 4 || index >= stub_nb_files)
+    return stub_status(ERR_FSAL_NOENT);
+
+  bench_stub_handle(index + 2, p_object_handle);
+
+  if(p_object_attributes != NULL)
+    stub_fill_attrs(index + 2, p_object_attributes);
+
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static fsal_status_t stub_access(fsal_handle_t * p_object_handle,
+                                 fsal_op_context_t * p_context,
+                                 fsal_accessflags_t access_type,
+                                 fsal_attrib_list_t * p_object_attributes)
+{
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static fsal_status_t stub_test_access(fsal_op_context_t * p_context,
+                                      fsal_accessflags_t access_type,
+                                      fsal_attrib_list_t * p_object_attributes)
+{
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static fsal_status_t stub_open(fsal_handle_t * p_filehandle,
+                               fsal_op_context_t * p_context,
+                               fsal_openflags_t openflags,
+                               fsal_file_t * p_file_descriptor,
+                               fsal_attrib_list_t * p_file_attributes)
+{
+  unsigned int id = stub_handle_id(p_filehandle);
+
+  if(!stub_valid_id(id) || id == BENCH_STUB_ROOT_ID)
+    return stub_status(ERR_FSAL_STALE);
+
+  memset((char *)p_file_descriptor, 0, sizeof(fsal_file_t));
+  memcpy((char *)p_file_descriptor, &id, sizeof(id));
+
+  if(p_file_attributes != NULL)
+    stub_fill_attrs(id, p_file_attributes);
+
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static fsal_status_t stub_close(fsal_file_t * p_file_descriptor)
+{
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static unsigned int stub_getfileno(fsal_file_t * p_file_descriptor)
+{
+  /* Never 0, which the cache inode layer takes for a closed fd */
+  return stub_file_id(p_file_descriptor);
+}
+
+/* Records an I/O in progress, counting the ones it should have waited for */
+static int stub_io_begin(unsigned int id, fsal_off_t offset, fsal_size_t length, int write)
+{
+  int i, slot = -1;
+
+  P(stub_io_mutex);
+
+  for(i = 0; i < BENCH_STUB_MAX_IO; i++)
+    {
+      if(!stub_io[i].used)
+        {
+          if(slot == -1)
+            slot = i;
+          continue;
+        }
+
+      if(stub_io[i].id == id && (write || stub_io[i].write) &&
+         offset < stub_io[i].offset + stub_io[i].length &&
+         stub_io[i].offset < offset + length)
+        stub_stat.nb_overlaps += 1;
+    }
+
+  if(slot == -1)
+    {
+      V(stub_io_mutex);
+      LogTest("Test FAILED: more than %d I/O in progress", BENCH_STUB_MAX_IO);
+      exit(1);
+    }
+
+  stub_io[slot].used = TRUE;
+  stub_io[slot].id = id;
+  stub_io[slot].offset = offset;
+  stub_io[slot].length = length;
+  stub_io[slot].write = write;
+
+  stub_io_inflight += 1;
+  if(stub_io_inflight > stub_stat.max_io_inflight)
+    stub_stat.max_io_inflight = stub_io_inflight;
+
+  stub_stat.nb_io += 1;
+
+  V(stub_io_mutex);
+
+  return slot;
+}
+
+static void stub_io_end(int slot)
+{
+  if(stub_latency_us != 0)
+    usleep(stub_latency_us);
+
+  P(stub_io_mutex);
+  stub_io[slot].used = FALSE;
+  stub_io_inflight -= 1;
+  V(stub_io_mutex);
+}
+
+static fsal_status_t stub_read(fsal_file_t * p_file_descriptor,
+                               fsal_seek_t * p_seek_descriptor,
+                               fsal_size_t buffer_size,
+                               caddr_t buffer,
+                               fsal_size_t * p_read_amount,
+                               fsal_boolean_t * p_end_of_file)
+{
+  fsal_off_t offset = p_seek_descriptor->offset;
+  int slot;
+
+  slot = stub_io_begin(stub_file_id(p_file_descriptor), offset, buffer_size, FALSE);
+
+  if(offset >= stub_file_size)
+    *p_read_amount = 0;
+  else if(offset + buffer_size > stub_file_size)
+    *p_read_amount = stub_file_size - offset;
+  else
+    *p_read_amount = buffer_size;
+
+  *p_end_of_file = (offset + *p_read_amount >= stub_file_size);
+
+  stub_io_end(slot);
+
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static fsal_status_t stub_write(fsal_file_t * p_file_descriptor,
+                                fsal_seek_t * p_seek_descriptor,
+                                fsal_size_t buffer_size,
+                                caddr_t buffer,
+                                fsal_size_t * p_write_amount)
+{
+  int slot;
+
+  slot = stub_io_begin(stub_file_id(p_file_descriptor), p_seek_descriptor->offset,
+                       buffer_size, TRUE);
+
+  *p_write_amount = buffer_size;
+
+  stub_io_end(slot);
+
+  return stub_status(ERR_FSAL_NO_ERROR);
+}
+
+static int stub_handlecmp(fsal_handle_t * handle1, fsal_handle_t * handle2,
+                          fsal_status_t * status)
+{
+  *status = stub_status(ERR_FSAL_NO_ERROR);
+
+  return stub_handle_id(handle1) != stub_handle_id(handle2);
+}
+
+static unsigned int stub_handle_to_hashindex(fsal_handle_t * p_handle,
+                                             unsigned int cookie,
+                                             unsigned int alphabet_len,
+                                             unsigned int index_size)
+{
+  return (stub_handle_id(p_handle) + cookie) % index_size;
+}
+
+static unsigned int stub_handle_to_rbtindex(fsal_handle_t * p_handle, unsigned int cookie)
+{
+  return stub_handle_id(p_handle) ^ cookie;
+}
+
+/**
+ *
+ * bench_stub_init: sets the stub up as the FSAL of the program.
+ *
+ * The FSAL functions the stub does not provide are left NULL, a call to one
+ * of them is a bug of the benchmark.
+ *
+ * @param nb_files   [IN] number of files in the directory
+ * @param file_size  [IN] size of each file
+ * @param latency_us [IN] duration of each read or write
+ *
+ */
+void bench_stub_init(unsigned int nb_files, fsal_size_t file_size, unsigned int latency_us)
+{
+  fsal_functions_t *pfunctions = &fsal_functions_array[0];
+
+  stub_nb_files = nb_files;
+  stub_file_size = file_size;
+  stub_latency_us = latency_us;
+  stub_time = time(NULL);
+
+  memset((char *)pfunctions, 0, sizeof(fsal_functions_t));
+
+  pfunctions->fsal_getattrs = stub_getattrs;
+  pfunctions->fsal_lookup = stub_lookup;
+  pfunctions->fsal_access = stub_access;
+  pfunctions->fsal_test_access = stub_test_access;
+  pfunctions->fsal_open = stub_open;
+  pfunctions->fsal_close = stub_close;
+  pfunctions->fsal_getfileno = stub_getfileno;
+  pfunctions->fsal_read = stub_read;
+  pfunctions->fsal_write = stub_write;
+  pfunctions->fsal_handlecmp = stub_handlecmp;
+  pfunctions->fsal_handle_to_hashindex = stub_handle_to_hashindex;
+  pfunctions->fsal_handle_to_rbtindex = stub_handle_to_rbtindex;
+
+  bench_stub_reset_stats();
+  bench_stub_thread_init();
+}                               /* bench_stub_init */
+
+/**
+ *
+ * bench_stub_thread_init: makes the calls of a new thread go to the stub.
+ *
+ */
+void bench_stub_thread_init(void)
+{
+#ifdef _USE_SHARED_FSAL
+  my_fsalid = 0;
+#endif
+}                               /* bench_stub_thread_init */
+
+/**
+ *
+ * bench_stub_handle: builds the handle of an object of the stub.
+ *
+ * @param id      [IN]  BENCH_STUB_ROOT_ID, or n + 2 for file<n>
+ * @param phandle [OUT] the handle
+ *
+ */
+void bench_stub_handle(unsigned int id, fsal_handle_t * phandle)
+{
+  memset((char *)phandle, 0, sizeof(fsal_handle_t));
+  memcpy((char *)phandle, &id, sizeof(id));
+}                               /* bench_stub_handle */
+
+/**
+ *
+ * bench_stub_name: builds the name of a file of the directory.
+ *
+ * @param index [IN]  n for file<n>
+ * @param pname [OUT] the name
+ *
+ */
+void bench_stub_name(unsigned int index, fsal_name_t * pname)
+{
+  char str[FSAL_MAX_NAME_LEN];
+
+  snprintf(str, FSAL_MAX_NAME_LEN, "file%u", index);
+  FSAL_str2name(str, FSAL_MAX_NAME_LEN, pname);
+}                               /* bench_stub_name */
+
+void bench_stub_get_stats(bench_stub_stat_t * pstat)
+{
+  P(stub_io_mutex);
+  *pstat = stub_stat;
+  pstat->nb_lookup = atomic_fetch_uint32_t(&stub_stat.nb_lookup);
+  pstat->nb_getattrs = atomic_fetch_uint32_t(&stub_stat.nb_getattrs);
+  V(stub_io_mutex);
+}                               /* bench_stub_get_stats */
+
+void bench_stub_reset_stats(void)
+{
+  P(stub_io_mutex);
+  memset((char *)&stub_stat, 0, sizeof(stub_stat));
+  V(stub_io_mutex);
+}                               /* bench_stub_reset_stats */
+
+static int bench_stub_lru_entry_to_str(LRU_data_t data, char *str)
+{
+  return sprintf(str, "Pentry: Addr %p", data.pdata);
+}
+
+static int bench_stub_lru_clean_entry(LRU_entry_t * entry, void *adddata)
+{
+  return 0;
+}
+
+/**
+ *
+ * bench_stub_cache_init: inits the entry cache, as the server does.
+ *
+ * @return the hash table of the cache, NULL if it could not be initialized.
+ *
+ */
+hash_table_t *bench_stub_cache_init(void)
+{
+  cache_inode_parameter_t cache_param;
+  cache_inode_status_t cache_status;
+
+  memset(&cache_param, 0, sizeof(cache_param));
+  cache_param.hparam.index_size = 31;
+  cache_param.hparam.alphabet_length = 10;
+  cache_param.hparam.nb_node_prealloc = 100;
+  cache_param.hparam.hash_func_key = cache_inode_fsal_hash_func;
+  cache_param.hparam.hash_func_rbt = cache_inode_fsal_rbt_func;
+  cache_param.hparam.compare_key = cache_inode_compare_key_fsal;
+  cache_param.hparam.key_to_str = display_key;
+  cache_param.hparam.val_to_str = display_value;
+  cache_param.hparam.name = "Cache Inode";
+  cache_param.hparam.backend = HASHTABLE_BACKEND_RBT;
+  cache_param.hparam.inline_keys = TRUE;
+
+  /* The fds stay open between the I/O, as with the fd cache of the server */
+  cache_inode_set_fd_cache_budget(1024);
+
+  return cache_inode_init(cache_param, &cache_status);
+}                               /* bench_stub_cache_init */
+
+/**
+ *
+ * bench_stub_client_init: inits the cache inode client of a worker.
+ *
+ * The attributes and the directory entries never expire, the fds are kept.
+ *
+ * @param pclient      [OUT] the client
+ * @param thread_index [IN]  index of the worker
+ *
+ * @return 0 if successful, 1 if failed.
+ *
+ */
+int bench_stub_client_init(cache_inode_client_t * pclient, int thread_index)
+{
+  cache_inode_client_parameter_t client_param;
+
+  memset(pclient, 0, sizeof(cache_inode_client_t));
+  memset(&client_param, 0, sizeof(client_param));
+
+  client_param.attrmask =
+      FSAL_ATTRS_MANDATORY | FSAL_ATTR_MTIME | FSAL_ATTR_CTIME | FSAL_ATTR_ATIME;
+  client_param.nb_prealloc_entry = 1024;
+  client_param.nb_pre_parent = 1024;
+  client_param.nb_pre_state_v4 = 10;
+
+  client_param.lru_param.nb_entry_prealloc = 1024;
+  client_param.lru_param.nb_call_gc_invalid = 100;
+  client_param.lru_param.entry_to_str = bench_stub_lru_entry_to_str;
+  client_param.lru_param.clean_entry = bench_stub_lru_clean_entry;
+
+  client_param.expire_type_attr = CACHE_INODE_EXPIRE_NEVER;
+  client_param.expire_type_link = CACHE_INODE_EXPIRE_NEVER;
+  client_param.expire_type_dirent = CACHE_INODE_EXPIRE_NEVER;
+  client_param.use_test_access = 1;
+  client_param.use_fd_cache = 1;
+  client_param.retention = 3600;
+
+  return cache_inode_client_init(pclient, &client_param, thread_index, NULL);
+}                               /* bench_stub_client_init */
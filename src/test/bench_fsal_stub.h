@@ -0,0 +1,59 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * \file    bench_fsal_stub.h
+ * \brief   An FSAL kept in memory, for the benchmarks of the cache inode layer.
+ *
+ * The stub serves one directory holding regular files named file0, file1...
+ * The benchmarks call the real cache inode functions on top of it, from as
+ * many workers as they like, without any filesystem behind.
+ *
+ */
+
+#ifndef _BENCH_FSAL_STUB_H
+#define _BENCH_FSAL_STUB_H
+
+#include "fsal.h"
+#include "HashTable.h"
+#include "cache_inode.h"
+
+#define BENCH_STUB_ROOT_ID 1    /* The directory, file<n> has the id n + 2 */
+
+typedef struct bench_stub_stat__
+{
+  uint32_t nb_lookup;           /**< FSAL_lookup calls                          */
+  uint32_t nb_getattrs;         /**< FSAL_getattrs calls                        */
+  uint32_t nb_io;               /**< FSAL_read and FSAL_write calls             */
+  uint32_t max_io_inflight;     /**< Most I/O in progress at the same time      */
+  uint32_t nb_overlaps;         /**< I/O started over a range written meanwhile */
+} bench_stub_stat_t;
+
+void bench_stub_init(unsigned int nb_files, fsal_size_t file_size, unsigned int latency_us);
+void bench_stub_thread_init(void);
+void bench_stub_handle(unsigned int id, fsal_handle_t * phandle);
+void bench_stub_name(unsigned int index, fsal_name_t * pname);
+void bench_stub_get_stats(bench_stub_stat_t * pstat);
+void bench_stub_reset_stats(void);
+
+hash_table_t *bench_stub_cache_init(void);
+int bench_stub_client_init(cache_inode_client_t * pclient, int thread_index);
+
+#endif                          /* _BENCH_FSAL_STUB_H */
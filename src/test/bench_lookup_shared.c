@@ -0,0 +1,230 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Threads call cache_inode_lookup on one directory of the cache, each with
+ * its own client, over the stub FSAL of bench_fsal_stub.c. The names of the
+ * directory are looked up once beforehand, then one lookup out of four asks
+ * for a name the directory does not hold. Checks that every name found is
+ * the entry cached beforehand, that only the missing names reach the FSAL,
+ * and prints the lookups per second for a growing number of threads.
+ *
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "stuff_alloc.h"
+#include "cache_inode.h"
+#include "bench_fsal_stub.h"
+
+#define NB_NAMES     1024
+#define NB_LOOKUPS   100000     /* per thread */
+#define MAX_THREADS  16
+
+static hash_table_t *ht;
+static cache_entry_t *pdir;
+static cache_entry_t *children[NB_NAMES];
+static cache_inode_client_t clients[MAX_THREADS];
+
+typedef struct bench_thread__
+{
+  pthread_t thr;
+  unsigned int index;
+  unsigned int found;
+  unsigned int missed;
+} bench_thread_t;
+
+static bench_thread_t threads[MAX_THREADS];
+
+static unsigned long long now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (unsigned long long)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void *bench_thread(void *arg)
+{
+  bench_thread_t *pthr = (bench_thread_t *) arg;
+  cache_inode_client_t *pclient = &clients[pthr->index];
+  cache_inode_status_t status;
+  fsal_op_context_t context;
+  fsal_attrib_list_t attr;
+  fsal_name_t name;
+  cache_entry_t *pentry;
+  unsigned int seed = pthr->index + 1;
+  unsigned int index;
+  unsigned int i;
+
+  bench_stub_thread_init();
+
+  memset(&context, 0, sizeof(context));
+
+  for(i = 0; i < NB_LOOKUPS; i++)
+    {
+      /* One lookup out of four misses */
+      index = rand_r(&seed) % (NB_NAMES * 4 / 3);
+      bench_stub_name(index, &name);
+
+      pentry = cache_inode_lookup(pdir, &name, CACHE_INODE_POLICY_FULL_WRITE_THROUGH,
+                                  &attr, ht, pclient, &context, &status);
+
+      if(index >= NB_NAMES)
+        {
+          if(pentry != NULL || status != CACHE_INODE_NOT_FOUND)
+            {
+              LogTest("Test FAILED: lookup of missing %s returned %p, status %d",
+                      name.name, pentry, status);
+              exit(1);
+            }
+          pthr->missed += 1;
+        }
+      else
+        {
+          if(pentry != children[index] || attr.fileid != index + 2)
+            {
+              LogTest("Test FAILED: lookup of %s returned %p instead of %p, status %d",
+                      name.name, pentry, children[index], status);
+              exit(1);
+            }
+          pthr->found += 1;
+        }
+    }
+
+  return NULL;
+}
+
+static void run(unsigned int nb_threads)
+{
+  bench_stub_stat_t stat;
+  unsigned long long start, elapsed;
+  unsigned int nb_missed = 0;
+  unsigned int i;
+
+  bench_stub_reset_stats();
+  start = now_us();
+
+  for(i = 0; i < nb_threads; i++)
+    {
+      threads[i].index = i;
+      threads[i].found = 0;
+      threads[i].missed = 0;
+      if(pthread_create(&threads[i].thr, NULL, bench_thread, &threads[i]) != 0)
+        {
+          LogTest("Test FAILED: could not create thread %u", i);
+          exit(1);
+        }
+    }
+
+  for(i = 0; i < nb_threads; i++)
+    {
+      pthread_join(threads[i].thr, NULL);
+      nb_missed += threads[i].missed;
+    }
+
+  elapsed = now_us() - start;
+  bench_stub_get_stats(&stat);
+
+  /* The names held by the directory are served from its cached entries */
+  if(stat.nb_lookup != nb_missed)
+    {
+      LogTest("Test FAILED: %u FSAL lookups for %u missing names", stat.nb_lookup,
+              nb_missed);
+      exit(1);
+    }
+
+  LogTest("%2u threads: %8llu lookups/s, %u missed, %u FSAL getattrs", nb_threads,
+          (unsigned long long)nb_threads * NB_LOOKUPS * 1000000ULL /
+          (elapsed ? elapsed : 1), nb_missed, stat.nb_getattrs);
+}
+
+int main(int argc, char *argv[])
+{
+  cache_inode_fsal_data_t fsdata;
+  cache_inode_status_t status;
+  fsal_op_context_t context;
+  fsal_attrib_list_t attr;
+  fsal_name_t name;
+  unsigned int nb_threads;
+  unsigned int i;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("bench_lookup_shared");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Test FAILED: could not initialize the memory manager");
+      exit(1);
+    }
+#endif
+
+  bench_stub_init(NB_NAMES, 4096, 0);
+
+  if((ht = bench_stub_cache_init()) == NULL)
+    {
+      LogTest("Test FAILED: could not initialize the cache");
+      exit(1);
+    }
+
+  for(i = 0; i < MAX_THREADS; i++)
+    if(bench_stub_client_init(&clients[i], i))
+      {
+        LogTest("Test FAILED: could not initialize client %u", i);
+        exit(1);
+      }
+
+  /* The directory, and its names looked up once */
+  memset(&context, 0, sizeof(context));
+  memset(&fsdata, 0, sizeof(fsdata));
+  bench_stub_handle(BENCH_STUB_ROOT_ID, &fsdata.handle);
+
+  pdir = cache_inode_make_root(&fsdata, CACHE_INODE_POLICY_FULL_WRITE_THROUGH, ht,
+                               &clients[0], &context, &status);
+  if(pdir == NULL)
+    {
+      LogTest("Test FAILED: could not cache the directory, status %d", status);
+      exit(1);
+    }
+
+  for(i = 0; i < NB_NAMES; i++)
+    {
+      bench_stub_name(i, &name);
+      children[i] = cache_inode_lookup(pdir, &name, CACHE_INODE_POLICY_FULL_WRITE_THROUGH,
+                                       &attr, ht, &clients[0], &context, &status);
+      if(children[i] == NULL)
+        {
+          LogTest("Test FAILED: could not look up %s, status %d", name.name, status);
+          exit(1);
+        }
+    }
+
+  for(nb_threads = 1; nb_threads <= MAX_THREADS; nb_threads *= 2)
+    run(nb_threads);
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -0,0 +1,242 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Threads call cache_inode_rdwr on one entry of the cache, each with its
+ * own client, over the stub FSAL of bench_fsal_stub.c. In the first pass
+ * each thread reads and writes blocks of its own, in the second all of
+ * them share a few blocks. Checks that no I/O reaches the FSAL over a
+ * range written meanwhile, that the disjoint I/O do run side by side, and
+ * prints the I/O per second of both passes for a growing number of threads.
+ *
+ * usage: bench_rdwr_ranges [latency_us]
+ * latency_us is the duration of each I/O in the stub, to look like a
+ * remote FSAL (100 by default).
+ *
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "stuff_alloc.h"
+#include "nfs_core.h"
+#include "cache_inode.h"
+#include "bench_fsal_stub.h"
+
+#define BLOCK_SIZE    65536
+#define NB_BLOCKS     64
+#define NB_SHARED     4         /* blocks of the second pass */
+#define NB_IO         500       /* per thread */
+#define MAX_THREADS   16
+#define FILE_ID       2         /* file0 of the stub */
+
+static hash_table_t *ht;
+static cache_entry_t *pentry;
+static cache_inode_client_t clients[MAX_THREADS];
+
+typedef struct bench_thread__
+{
+  pthread_t thr;
+  unsigned int index;
+  int shared;
+  char buffer[BLOCK_SIZE];
+} bench_thread_t;
+
+static bench_thread_t threads[MAX_THREADS];
+
+static unsigned long long now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (unsigned long long)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void *bench_thread(void *arg)
+{
+  bench_thread_t *pthr = (bench_thread_t *) arg;
+  cache_inode_client_t *pclient = &clients[pthr->index];
+  cache_inode_io_direction_t direction;
+  cache_inode_status_t status;
+  fsal_op_context_t context;
+  fsal_attrib_list_t attr;
+  fsal_seek_t seek;
+  fsal_size_t io_size;
+  fsal_boolean_t eof;
+  unsigned int block;
+  unsigned int i;
+
+  bench_stub_thread_init();
+
+  memset(&context, 0, sizeof(context));
+  memset(pthr->buffer, 'a' + pthr->index, BLOCK_SIZE);
+
+  for(i = 0; i < NB_IO; i++)
+    {
+      /* One read out of two, on blocks of the thread or on the shared ones */
+      direction = ((i + pthr->index) % 2) ? CACHE_INODE_WRITE : CACHE_INODE_READ;
+      if(pthr->shared)
+        block = (i + pthr->index) % NB_SHARED;
+      else
+        block = (pthr->index + i * MAX_THREADS) % NB_BLOCKS;
+
+      seek.whence = FSAL_SEEK_SET;
+      seek.offset = (fsal_off_t) block * BLOCK_SIZE;
+
+      if(cache_inode_rdwr(pentry, direction, &seek, BLOCK_SIZE, &io_size, &attr,
+                          pthr->buffer, &eof, ht, pclient, &context,
+                          FSAL_SAFE_WRITE_TO_FS, &status) != CACHE_INODE_SUCCESS)
+        {
+          LogTest("Test FAILED: cache_inode_rdwr returned %d at offset %llu", status,
+                  (unsigned long long)seek.offset);
+          exit(1);
+        }
+
+      if(io_size != BLOCK_SIZE)
+        {
+          LogTest("Test FAILED: %llu bytes done out of %d at offset %llu",
+                  (unsigned long long)io_size, BLOCK_SIZE,
+                  (unsigned long long)seek.offset);
+          exit(1);
+        }
+    }
+
+  return NULL;
+}
+
+static void run(unsigned int nb_threads, int shared, unsigned int latency_us)
+{
+  bench_stub_stat_t stat;
+  unsigned long long start, elapsed;
+  unsigned int i;
+
+  bench_stub_reset_stats();
+  start = now_us();
+
+  for(i = 0; i < nb_threads; i++)
+    {
+      threads[i].index = i;
+      threads[i].shared = shared;
+      if(pthread_create(&threads[i].thr, NULL, bench_thread, &threads[i]) != 0)
+        {
+          LogTest("Test FAILED: could not create thread %u", i);
+          exit(1);
+        }
+    }
+
+  for(i = 0; i < nb_threads; i++)
+    pthread_join(threads[i].thr, NULL);
+
+  elapsed = now_us() - start;
+  bench_stub_get_stats(&stat);
+
+  if(stat.nb_io != nb_threads * NB_IO)
+    {
+      LogTest("Test FAILED: %u I/O reached the FSAL out of %u", stat.nb_io,
+              nb_threads * NB_IO);
+      exit(1);
+    }
+
+  if(stat.nb_overlaps != 0)
+    {
+      LogTest("Test FAILED: %u I/O done over a range written meanwhile",
+              stat.nb_overlaps);
+      exit(1);
+    }
+
+  /* The I/O on blocks of their own must not wait for each other */
+  if(!shared && nb_threads > 1 && latency_us != 0 && stat.max_io_inflight < 2)
+    {
+      LogTest("Test FAILED: the I/O of %u threads on disjoint ranges were serialized",
+              nb_threads);
+      exit(1);
+    }
+
+  LogTest("%2u threads, %s blocks: %8llu I/O/s, at most %u I/O in progress",
+          nb_threads, shared ? "shared  " : "disjoint",
+          (unsigned long long)stat.nb_io * 1000000ULL / (elapsed ? elapsed : 1),
+          stat.max_io_inflight);
+}
+
+int main(int argc, char *argv[])
+{
+  cache_inode_fsal_data_t fsdata;
+  cache_inode_status_t status;
+  fsal_op_context_t context;
+  unsigned int latency_us = 100;
+  unsigned int nb_threads;
+  unsigned int i;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("bench_rdwr_ranges");
+
+  if(argc > 1)
+    latency_us = atoi(argv[1]);
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Test FAILED: could not initialize the memory manager");
+      exit(1);
+    }
+#endif
+
+  bench_stub_init(1, (fsal_size_t) NB_BLOCKS * BLOCK_SIZE, latency_us);
+
+  if((ht = bench_stub_cache_init()) == NULL)
+    {
+      LogTest("Test FAILED: could not initialize the cache");
+      exit(1);
+    }
+
+  for(i = 0; i < MAX_THREADS; i++)
+    if(bench_stub_client_init(&clients[i], i))
+      {
+        LogTest("Test FAILED: could not initialize client %u", i);
+        exit(1);
+      }
+
+  /* The file, as the server caches it, data cache off */
+  memset(&context, 0, sizeof(context));
+  memset(&fsdata, 0, sizeof(fsdata));
+  bench_stub_handle(FILE_ID, &fsdata.handle);
+
+  pentry = cache_inode_new_entry(&fsdata, NULL, REGULAR_FILE,
+                                 CACHE_INODE_POLICY_FULL_WRITE_THROUGH, NULL, NULL, ht,
+                                 &clients[0], &context, TRUE, &status);
+  if(pentry == NULL)
+    {
+      LogTest("Test FAILED: could not cache the file, status %d", status);
+      exit(1);
+    }
+
+  for(nb_threads = 1; nb_threads <= MAX_THREADS; nb_threads *= 2)
+    run(nb_threads, FALSE, latency_us);
+
+  for(nb_threads = 1; nb_threads <= MAX_THREADS; nb_threads *= 2)
+    run(nb_threads, TRUE, latency_us);
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -0,0 +1,230 @@
+/*
+ * vim:expandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * ---------------------------------------
+ *
+ * Unstable writes of random sizes and offsets, sequential then scattered,
+ * kept in the dirty extents of one file with a budget never reached. Checks
+ * after each pass that the extents are sorted, disjoint, within a chunk and
+ * hold the data written, then truncates the file. Prints the writes per
+ * second and the extents left, the writes coalesced.
+ *
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "stuff_alloc.h"
+#include "cache_inode.h"
+
+#define CHUNK        65536
+#define FILE_SIZE    (64 * CHUNK)
+#define MAX_WRITE    8192
+#define NB_WRITES    20000      /* sequential, the scattered ones leave holes */
+#define NB_SCATTERED 400
+
+static cache_entry_t entry;
+static char shadow[FILE_SIZE];
+static char written[FILE_SIZE];
+static char buffer[MAX_WRITE];
+
+static unsigned long long now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (unsigned long long)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/* The extents against the bytes written, returns the number of extents */
+static unsigned int check_extents(uint64_t size)
+{
+  cache_inode_write_behind_t *pwb = entry.object.file.write_behind;
+  cache_inode_dirty_extent_t *pext;
+  struct glist_head *glist;
+  uint64_t prev_end = 0;
+  uint64_t covered = 0;
+  uint64_t i;
+  unsigned int nb_extents = 0;
+
+  if(pwb == NULL)
+    return 0;
+
+  glist_for_each(glist, &pwb->extents)
+    {
+      pext = glist_entry(glist, cache_inode_dirty_extent_t, extent_list);
+
+      if(pext->length == 0 || pext->offset < prev_end ||
+         pext->offset / CHUNK != (pext->offset + pext->length - 1) / CHUNK ||
+         pext->length > pext->size)
+        {
+          LogTest("Test FAILED: extent %llu+%llu (size %llu) after %llu",
+                  (unsigned long long)pext->offset, (unsigned long long)pext->length,
+                  (unsigned long long)pext->size, (unsigned long long)prev_end);
+          exit(1);
+        }
+
+      for(i = 0; i < pext->length; i++)
+        if(!written[pext->offset + i] || pext->buffer[i] != shadow[pext->offset + i])
+          {
+            LogTest("Test FAILED: wrong byte at %llu",
+                    (unsigned long long)(pext->offset + i));
+            exit(1);
+          }
+
+      prev_end = pext->offset + pext->length;
+      covered += pext->length;
+      nb_extents += 1;
+    }
+
+  /* Every byte written below the size is in an extent */
+  for(i = 0; i < size; i++)
+    if(written[i])
+      covered -= 1;
+
+  if(covered != 0)
+    {
+      LogTest("Test FAILED: the extents do not cover the bytes written");
+      exit(1);
+    }
+
+  return nb_extents;
+}
+
+static void run(const char *label, int sequential, unsigned int nb_writes,
+                cache_inode_client_t * pclient, fsal_op_context_t * pcontext)
+{
+  cache_inode_wb_stat_t before, after;
+  cache_inode_status_t status;
+  unsigned long long start, elapsed;
+  unsigned int seed = 1;
+  uint64_t offset = 0;
+  uint64_t length;
+  unsigned int nb_extents;
+  unsigned int i;
+
+  /* From a clean file */
+  cache_inode_forget_dirty(&entry);
+  memset(written, 0, FILE_SIZE);
+
+  cache_inode_get_write_behind_stats(&before);
+  start = now_us();
+
+  for(i = 0; i < nb_writes; i++)
+    {
+      length = 1 + rand_r(&seed) % MAX_WRITE;
+      if(!sequential || offset + length > FILE_SIZE)
+        offset = rand_r(&seed) % (FILE_SIZE - length);
+
+      memset(buffer, 'a' + i % 26, length);
+      memcpy(shadow + offset, buffer, length);
+      memset(written + offset, 1, length);
+
+      if(cache_inode_dirty_write(&entry, offset, length, buffer, pclient, pcontext,
+                                 &status) != CACHE_INODE_SUCCESS)
+        {
+          LogTest("Test FAILED: unstable write returned %d", status);
+          exit(1);
+        }
+
+      offset += length;
+    }
+
+  elapsed = now_us() - start;
+  cache_inode_get_write_behind_stats(&after);
+
+  nb_extents = check_extents(FILE_SIZE);
+
+  LogTest("%s: %8llu writes/s, %llu coalesced out of %u, %u extents, %llu bytes dirty",
+          label, (unsigned long long)nb_writes * 1000000ULL / (elapsed ? elapsed : 1),
+          (unsigned long long)(after.nb_coalesced - before.nb_coalesced), nb_writes,
+          nb_extents, (unsigned long long)after.nb_dirty);
+}
+
+int main(int argc, char *argv[])
+{
+  cache_inode_client_t client;
+  fsal_op_context_t context;
+  cache_inode_wb_stat_t stat;
+
+  SetDefaultLogging("TEST");
+  SetNamePgm("bench_write_behind");
+
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
+    {
+      LogTest("Test FAILED: could not initialize the memory manager");
+      exit(1);
+    }
+#endif
+
+  /* Nothing is written to the FSAL: the budget is never reached */
+  cache_inode_set_write_behind_policy(1ULL << 40, CHUNK, 3600);
+
+  memset(&client, 0, sizeof(client));
+  memset(&context, 0, sizeof(context));
+
+  /* The fields of a regular file the unstable writes use */
+  memset(&entry, 0, sizeof(entry));
+  entry.internal_md.type = REGULAR_FILE;
+  if(pthread_mutex_init(&entry.object.file.io_mutex, NULL) != 0 ||
+     pthread_cond_init(&entry.object.file.io_cond, NULL) != 0)
+    {
+      LogTest("Test FAILED: could not initialize the entry");
+      exit(1);
+    }
+  init_glist(&entry.object.file.io_ranges);
+
+  run("sequential", TRUE, NB_WRITES, &client, &context);
+  run("scattered ", FALSE, NB_SCATTERED, &client, &context);
+
+  if(cache_inode_dirty_end(&entry) > FILE_SIZE || entry.attributes.filesize > FILE_SIZE)
+    {
+      LogTest("Test FAILED: the file grew past the bytes written");
+      exit(1);
+    }
+
+  /* Truncated in the middle of a chunk */
+  cache_inode_dirty_truncate(&entry, FILE_SIZE / 2 + CHUNK / 3);
+  memset(written + FILE_SIZE / 2 + CHUNK / 3, 0, FILE_SIZE / 2 - CHUNK / 3);
+  check_extents(FILE_SIZE);
+
+  if(cache_inode_dirty_end(&entry) > FILE_SIZE / 2 + CHUNK / 3)
+    {
+      LogTest("Test FAILED: dirty data left past the truncation");
+      exit(1);
+    }
+
+  cache_inode_forget_dirty(&entry);
+  cache_inode_get_write_behind_stats(&stat);
+
+  if(entry.object.file.write_behind != NULL || stat.nb_dirty != 0)
+    {
+      LogTest("Test FAILED: %llu bytes dirty after the file is forgotten",
+              (unsigned long long)stat.nb_dirty);
+      exit(1);
+    }
+
+  LogTest("Test succeeded: all tests pass successfully");
+
+  exit(0);
+}
@@ -24,8 +24,6 @@ char ganesha_exec_path[MAXPATHLEN] = "/usr/bin/gpfs.ganesha.nfsd";
 
 void init_vars(hash_table_t **ht_ip_stats, struct prealloc_pool **ip_stats_pool)
 {
-  int rc;
-
   /* Get the FSAL functions */
   FSAL_LoadFunctions();
 
@@ -33,12 +31,14 @@ void init_vars(hash_table_t **ht_ip_stats, struct prealloc_pool **ip_stats_pool)
   FSAL_LoadConsts();
 
   /* Initialize buddy malloc */
-  if((rc = BuddyInit(NULL)) != BUDDY_SUCCESS)
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
     {
       /* Failed init */
       LogTest("Memory manager could not be initialized");
       exit(1);
     }
+#endif
 
   nfs_set_param_default(&nfs_param);
 
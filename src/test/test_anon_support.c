@@ -38,7 +38,6 @@ const char *opnames[] = {"MOUNT", "READ", "WRITE", "MDONLY_READ", "MDONLY_WRITE"
 
 void init_vars(hash_table_t **ht_ip_stats, struct prealloc_pool *ip_stats_pool)
 {
-  int rc;
 
   /* Get the FSAL functions */
   FSAL_LoadFunctions();
@@ -47,12 +46,14 @@ void init_vars(hash_table_t **ht_ip_stats, struct prealloc_pool *ip_stats_pool)
   FSAL_LoadConsts();
 
   /* Initialize buddy malloc */
-  if((rc = BuddyInit(NULL)) != BUDDY_SUCCESS)
+#ifndef _NO_BUDDY_SYSTEM
+  if(BuddyInit(NULL) != BUDDY_SUCCESS)
     {
       /* Failed init */
       LogTest("Memory manager could not be initialized");
       exit(1);
     }
+#endif
 
   nfs_set_param_default(&nfs_param);
 
@@ -272,7 +272,75 @@ while (my $ligne=<STATS>)
       
       }
     }
-    elsif ( ( $tag eq "CACHE_INODE_HASH" ) || ( $tag eq "DUP_REQ_HASH" ) || ( $tag eq "UIDMAP_HASH" ) || ( $tag eq "IP_NAME_HASH" ) ||
+    elsif ( $tag eq "DUP_REQ_CACHE" )
+    {
+      next if ( ! ( $reste =~ m/^([^,]+),([^,]+),([^|]+)\|([^,]+),([^,]+),([^|]+)\|([^,]+),(.*)/ ) );  # go to next line
+
+      my $pct_hit = 0.0;
+
+      if ( $4 + $6 > 0 )
+      {
+        $pct_hit = 100.0 * ( $4 / ( $4 + $6 ) );
+      }
+
+      print "Nb entries : $1, clients : $2, bytes : $3\n";
+      printf( "Replayed : %d, in progress : %d, new : %d (%.2f%% replayed)\n", $4, $5, $6, $pct_hit );
+      print "Evicted : $7 for memory, $8 expired\n";
+    }
+    elsif ( $tag eq "FD_CACHE" )
+    {
+      next if ( ! ( $reste =~ m/^([^,]+),([^|]+)\|([^,]+),([^,]+),([^,]+),([^|]+)\|([^,]+),(.*)/ ) );  # go to next line
+
+      my $pct_reuse = 0.0;
+
+      if ( $3 + $5 > 0 )
+      {
+        $pct_reuse = 100.0 * ( $5 / ( $3 + $5 ) );
+      }
+
+      print "Open files : $1, budget : $2\n";
+      printf( "Opened : %d, closed : %d, reused : %d (%.2f%% reused), evicted : %d\n", $3, $4, $5, $pct_reuse, $6 );
+      print "Opens per second : $7, closes per second : $8\n";
+    }
+    elsif ( $tag eq "WRITE_BEHIND" )
+    {
+      next if ( ! ( $reste =~ m/^([^,]+),([^|]+)\|([^,]+),([^,]+),([^,]+),([^|]+)\|([^,]+),(.*)/ ) );  # go to next line
+
+      my $pct_coalesced = 0.0;
+
+      if ( $3 > 0 )
+      {
+        $pct_coalesced = 100.0 * ( $4 / $3 );
+      }
+
+      print "Dirty bytes : $1, budget : $2\n";
+      printf( "Writes : %d, coalesced : %d (%.2f%% coalesced)\n", $3, $4, $pct_coalesced );
+      print "Flushes : $5, bytes flushed : $6, throttled writes : $7, errors : $8\n";
+    }
+    elsif ( $tag eq "DELEGATIONS" )
+    {
+      next if ( ! ( $reste =~ m/^([^,]+),([^|]+)\|([^,]+),([^,]+),([^,]+),([^,]+),(.*)/ ) );  # go to next line
+
+      print "Delegations held : $1, being recalled : $2\n";
+      print "Granted : $3, recalled : $4, returned : $5, revoked : $6\n";
+      print "Callbacks unanswered : $7\n";
+    }
+    elsif ( ( $tag eq "UIDMAP_CACHE" ) || ( $tag eq "GIDMAP_CACHE" ) || ( $tag eq "UID2GRP_CACHE" ) )
+    {
+      next if ( ! ( $reste =~ m/^([^,]+),([^,]+),([^|]+)\|([^|]+)\|([^,]+),([^,]+),([^,]+),(.*)/ ) );  # go to next line
+
+      my $pct_hit = 0.0;
+
+      if ( $1 + $2 + $3 > 0 )
+      {
+        $pct_hit = 100.0 * ( ( $1 + $2 ) / ( $1 + $2 + $3 ) );
+      }
+
+      printf( "Hits : %d, unknown : %d, misses : %d (%.2f%% hits)\n", $1, $2, $3, $pct_hit );
+      print "Refreshed : $4\n";
+      print "Name service : $5 lookups, $6 failed, $7 usec on average, $8 usec max\n";
+    }
+    elsif ( ( $tag eq "CACHE_INODE_HASH" ) || ( $tag eq "UIDMAP_HASH" ) || ( $tag eq "IP_NAME_HASH" ) ||
 	    ( $tag eq "UNAMEMAP_HASH" )    || ( $tag eq "GIDMAP_HASH" )  || ( $tag eq "GNAMEMAP_HASH" ) )
     {
       next if ( ! ( $reste =~ m/^([^,]+),([^,]+),([^,]+),([^|]+)(.*)/ ) );  # go to next line